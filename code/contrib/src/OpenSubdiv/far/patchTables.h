@@ -443,6 +443,7 @@ namespace OpenSubdiv {
 
 				template <class T> friend class FarPatchTablesFactory;
 				friend class FarPatchTables;
+				friend class FarTablesLoader;
 
 				FVarData() : _fvarWidth(0) { }
 
@@ -460,6 +461,7 @@ namespace OpenSubdiv {
 		private:
 
 			template <class T> friend class FarPatchTablesFactory;
+			friend class FarTablesLoader;	// builds tables from flat arrays (topology cache)
 
 			// Returns the array of patches of type "desc", or NULL if there aren't any in the primitive
 			inline PatchArray * findPatchArray(Descriptor desc);
@@ -207,6 +207,7 @@ namespace OpenSubdiv {
 			template <class X, class Y> friend class FarCatmarkSubdivisionTablesFactory;
 			template <class X, class Y> friend class FarLoopSubdivisionTablesFactory;
 			template <class X, class Y> friend class FarSubdivisionTablesFactory;
+			friend class FarTablesLoader;	// builds tables from flat arrays (topology cache)
 
 			FarSubdivisionTables(int maxlevel, Scheme scheme);
 
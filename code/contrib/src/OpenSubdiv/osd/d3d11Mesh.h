@@ -113,7 +113,7 @@ public:
         delete _drawContext;
     }
 
-	virtual int GetNumPTexFaces() const{return _farMesh->GetNumPtexFaces();}
+	virtual int GetNumPTexFaces() const{return _farMesh->GetPatchTables()->GetNumPtexFaces();}
 
     virtual int GetNumVertices() const { return _farMesh->GetNumVertices(); }
 
@@ -179,7 +179,6 @@ private:
 		//ID3D11Device * pd3d11Device;
 		ID3D11Device1 * pd3d11Device = DXUTGetD3D11Device();
 		////_pd3d11DeviceContext->GetDevice(&pd3d11Device);
-		_pd3d11DeviceContext->GetDevice(&pd3d11Device);
 
 		int numVertices = _farMesh->GetNumVertices();
 		if (numVertexElements)
@@ -339,18 +339,23 @@ HRESULT Shader<T>::CompileShader( ID3DBlob** ppBlobOut )
 		}
 
 		// write compiled shader to disk			
+		// several processes (e.g. parallel batch runs) may compile the same shader, write to a per process file and move it in place
 		//std::wcout << m_fileNameCompiled << std::endl;
-		V(D3DWriteBlobToFile(*ppBlobOut,m_fileNameCompiled.c_str(), true));
+		const std::wstring tmpFileName = m_fileNameCompiled + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+		V(D3DWriteBlobToFile(*ppBlobOut,tmpFileName.c_str(), true));
 		if(hr!= S_OK)
 		{
-			std::wcout << L"filename " << m_fileNameCompiled << "to long, aborting" << std::endl;
+			std::wcout << L"filename " << tmpFileName << "to long, aborting" << std::endl;
 			V_RETURN(hr);
 			exit(1);
 		}
 
-		std::ofstream compiledFile(m_fileNameCompiled.c_str(), std::ios::out | std::ios::binary);
-		compiledFile.write((char*)(*ppBlobOut)->GetBufferPointer(), (*ppBlobOut)->GetBufferSize());
-		compiledFile.close();
+		if(!MoveFileExW(tmpFileName.c_str(), m_fileNameCompiled.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			// another process holds the cached file open, its copy is the same shader
+			std::wcout << L"could not replace " << m_fileNameCompiled << L", keeping the existing file" << std::endl;
+			DeleteFileW(tmpFileName.c_str());
+		}
 
 		// unref old shader if one is bound
 		SAFE_RELEASE(m_shader);
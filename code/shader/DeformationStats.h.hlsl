@@ -0,0 +1,42 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+// counters of the tile edit (TileEditCS), accumulated over all dispatches of a frame and read back asynchronously by TileEdit
+// keep in sync with DeformationStats in TileEdit.h
+// instrumentation only: every counter is a global atomic per thread
+
+#define DEFORM_STATS_TILES				0	// dispatched patch tiles
+#define DEFORM_STATS_TEXELS				1	// texels inside the tile, evaluated on the surface
+#define DEFORM_STATS_RAYS				2	// VoxelDDA calls, 5 per texel with multisampling
+#define DEFORM_STATS_DDA_STEPS			3	// voxels visited by VoxelDDA
+#define DEFORM_STATS_VOXELS_HIT			4	// visited voxels that are set
+#define DEFORM_STATS_SKIP_INVISIBLE		5	// early out, ptex face not intersected
+#define DEFORM_STATS_SKIP_UNALLOCATED	6	// early out, no tile memory
+#define DEFORM_STATS_SKIP_MISS			7	// early out, ray origin outside the grid or no voxel hit
+#define DEFORM_STATS_SKIP_ZERO			8	// early out, zero penetration depth
+#define DEFORM_STATS_TEXELS_WRITTEN		9
+#define DEFORM_STATS_TEXELS_CHANGED		10	// written with a different value
+#define DEFORM_STATS_MAX_DELTA			11	// asuint of the largest abs displacement change, positive floats order like uints
+#define DEFORM_STATS_COUNT				12
+
+#ifdef WITH_DEFORMATION_STATS
+RWBuffer<uint>	g_deformationStatsUAV	: register(u4);
+
+#define DEFORM_STATS_ADD(counter, value)	InterlockedAdd(g_deformationStatsUAV[counter], value)
+#define DEFORM_STATS_MAX(counter, value)	InterlockedMax(g_deformationStatsUAV[counter], value)
+#else
+#define DEFORM_STATS_ADD(counter, value)
+#define DEFORM_STATS_MAX(counter, value)
+#endif
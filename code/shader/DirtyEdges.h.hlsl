@@ -0,0 +1,53 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+// per ptex face dirty mask of the tile edit and the tile allocation (all bits of new tiles), consumed by the overlap update (shader/UpdateOverlap.hlsl)
+// bit e (0..3):	texels along edge e were written, same edge order as OverlapEdgesCS (0: v == 0, 1: u == 0, 2: v == ts, 3: u == ts)
+// bit 4+v (0..3):	corner texel of vertex v was written, same vertex order as OverlapEqualizeExtraordinaryCS
+// keep in sync with DirtyEdgeBits in TileOverlapUpdater.h
+
+#define DIRTY_EDGE_MASK			0xf
+#define DIRTY_CORNER_SHIFT		4
+#define DIRTY_CORNER_MASK		0xf0
+
+// compacted record: ptex id << DIRTY_RECORD_SHIFT | edges to update | DIRTY_RECORD_CORNERS
+#define DIRTY_RECORD_SHIFT		5
+#define DIRTY_RECORD_CORNERS	0x10
+
+#ifdef WITH_DIRTY_EDGES
+RWBuffer<uint>	g_dirtyEdgesUAV	: register(u3);
+
+// called for every written texel, only texels on the tile border touch the mask
+void MarkDirtyEdges(uint ptexFaceID, uint2 texel, uint tileSize)
+{
+	uint ts = tileSize - 1;
+	uint mask = 0;
+	if (texel.y == 0)	mask |= 1;
+	if (texel.x == 0)	mask |= 2;
+	if (texel.y == ts)	mask |= 4;
+	if (texel.x == ts)	mask |= 8;
+
+	if (mask == 0)
+		return;
+
+	// corners, v0 (0,0) v1 (ts,0) v2 (ts,ts) v3 (0,ts)
+	if ((mask & 0x3) == 0x3)	mask |= 0x10;
+	if ((mask & 0x9) == 0x9)	mask |= 0x20;
+	if ((mask & 0xc) == 0xc)	mask |= 0x40;
+	if ((mask & 0x6) == 0x6)	mask |= 0x80;
+
+	InterlockedOr(g_dirtyEdgesUAV[ptexFaceID], mask);
+}
+#endif
@@ -24,6 +24,8 @@ cbuffer ConfigCB : register(b6) {
 	uint g_NumVertexComponents;		// num float elements per vertex, for stride in vertex buffer, the first 3 are always pos
 	uint g_NumIndicesPerPatch;		// num indices per patch, TODO better use shader define
 	uint g_NumPatches;
+	uint g_CandidateOffset;			// temporal mode: offset of the patch array candidates in g_temporalCandidates
+	uint g_NumCandidates;			// temporal mode: number of ptex faces to clear
 };
 
 // readables (SRVs)
@@ -33,7 +35,8 @@ Buffer<uint>		g_IndexBuffer			: register(t1);	// t1 index buffer
 Buffer<uint2>		g_OsdPatchParamBuffer	: register(t2); // t2 tile rotation info and patch to tile mapping, CHECKME
 Buffer<int>			g_OsdValenceBuffer		: register(t3); // t3 valence buffer for gregory patch eval
 Buffer<int>			g_OsdQuadOffsetBuffer	: register(t4);
-Buffer<float>		g_maxPatchDisplacement	: register(t5);
+Buffer<float>		g_maxPatchDisplacement	: register(t5); // t5 per patch max displacement at the osd patch index (g_PrimitiveIdBase + local id), as written by TileEditCS
+Buffer<uint>		g_temporalCandidates	: register(t6); // t6 temporal mode: [ptex faces to clear | local patch ids per patch array]
 
 #ifndef BATCH_SIZE
 #define BATCH_SIZE 4u
@@ -328,6 +331,18 @@ void IntersectClearCS(uint3 blockIdx : SV_GroupID,
 	g_ptexFaceVisibleUAV[DTid.x] = INTERSECT_FALSE;
 }
 
+[numthreads(512, 1, 1)]
+void IntersectClearCandidatesCS(uint3 blockIdx : SV_GroupID,
+	uint3 DTid : SV_DispatchThreadID,
+	uint3 threadIdx : SV_GroupThreadID,
+	uint GI : SV_GroupIndex)
+{
+	if (DTid.x >= g_NumCandidates)
+		return;
+
+	g_ptexFaceVisibleUAV[g_temporalCandidates[g_CandidateOffset + DTid.x]] = INTERSECT_FALSE;
+}
+
 #ifndef TYPE_GREGORY
 [numthreads(2, 4, 4)]
 void IntersectRegularCS
@@ -344,6 +359,10 @@ uint GI : SV_GroupIndex
 	if (localPatchID >= g_NumPatches)
 		return;
 
+#ifdef TEMPORAL_CANDIDATES
+	localPatchID = g_temporalCandidates[g_CandidateOffset + localPatchID];
+#endif
+
 	
 	int ptexTileID = GetPtexTileID(localPatchID);
 
@@ -456,7 +475,7 @@ uint GI : SV_GroupIndex
 			float minDisplacement = -g_displacementScaler * 0.2;//0.2; //-g_maxDisplacement;// 0;	//g_maxDisplacement * g_PerPatchDisplacementInfo[patchID*2+1];
 
 #ifdef 		WITH_DYNAMIC_MAX_DISP
-			minDisplacement = -g_displacementScaler * g_maxPatchDisplacement[localPatchID];
+			minDisplacement = -g_displacementScaler * g_maxPatchDisplacement[localPatchID + g_PrimitiveIdBase];
 #endif
 			//extend by cone of normals
 			float3 coneExt = max(maxDisplacement * extP, minDisplacement * extM);
@@ -466,8 +485,8 @@ uint GI : SV_GroupIndex
 #else
 
 #ifdef 		WITH_DYNAMIC_MAX_DISP
-			bbMax = bbMax + g_displacementScaler * g_maxPatchDisplacement[localPatchID];
-			bbMin = bbMin - g_displacementScaler * g_maxPatchDisplacement[localPatchID];//- maxDisplacement;
+			bbMax = bbMax + g_displacementScaler * g_maxPatchDisplacement[localPatchID + g_PrimitiveIdBase];
+			bbMin = bbMin - g_displacementScaler * g_maxPatchDisplacement[localPatchID + g_PrimitiveIdBase];//- maxDisplacement;
 #else
 			bbMin = bbMin - 0.1* g_displacementScaler;//- maxDisplacement;
 			bbMax = bbMax + 0.1* g_displacementScaler;//+ minDisplacement;
@@ -633,6 +652,10 @@ uint GI : SV_GroupIndex
 	if (localPatchID >= g_NumPatches)
 		return;
 
+#ifdef TEMPORAL_CANDIDATES
+	localPatchID = g_temporalCandidates[g_CandidateOffset + localPatchID];
+#endif
+
 	int ptexTileID = GetPtexTileID(localPatchID);
 	//#define SET_ALL_ACTIVE
 #ifdef SET_ALL_ACTIVE
@@ -63,6 +63,8 @@ RWBuffer<uint>				g_maxPatchDisplacement : register (u2);
 //#include "VoxelDDA.hlsl"
 #include "PTexLookup.hlsl"
 #include "OSDPatchCommon.hlsl"
+#include "DirtyEdges.h.hlsl"
+#include "DeformationStats.h.hlsl"
 
 #ifndef OSD_NUM_ELEMENTS
 #define OSD_NUM_ELEMENTS 3
@@ -906,6 +908,9 @@ void TileEditCS(
 	int patchLevel = GetLevel(patchData.x);
 	uint tileSize = (uint) TILE_SIZE;
 
+	if (GI == 0 && blockIdx.y == 0)
+		DEFORM_STATS_ADD(DEFORM_STATS_TILES, 1);
+
 	if(patchLevel > 0)
 	{
 		float splitter = (0x1 << (patchLevel));		
@@ -932,6 +937,8 @@ void TileEditCS(
 	
 	if(idx.x >= tileSize || idx.y >= tileSize)
 		return;
+
+	DEFORM_STATS_ADD(DEFORM_STATS_TEXELS, 1);
 	
 	float2 UV = 0.f;	// uv coord in patch space 0..1 spanned by updated tile size
 	if(tileSize > 1)
@@ -947,7 +954,10 @@ void TileEditCS(
 	GetPatchInfo(UV,patchData.x, patchCoord, ptexInfo);
 	int faceID = int(patchCoord.w);
 	if (!g_ptexFaceVisibleSRV[faceID]) // Early exit - visibility
+	{
+		DEFORM_STATS_ADD(DEFORM_STATS_SKIP_INVISIBLE, 1);
 		return;
+	}
 
 #define _DEBUG_COLOR 	
 #ifdef DEBUG_COLOR
@@ -962,7 +972,10 @@ void TileEditCS(
 #endif
 
 	if(ppack.page == -1)	// early exit if tile data is not allocated
+	{
+		DEFORM_STATS_ADD(DEFORM_STATS_SKIP_UNALLOCATED, 1);
 		return ;	
+	}
 
 	float2 coords = float2(patchCoord.x * ppack.tileSize + ppack.uOffset,
 		patchCoord.y * ppack.tileSize + ppack.vOffset);
@@ -1081,6 +1094,7 @@ void TileEditCS(
 		if (VoxelDDA(rayOrigin, rayDir, dist) == false) 
 		{
 			dist = 0;
+			DEFORM_STATS_ADD(DEFORM_STATS_SKIP_MISS, 1);
 			return;
 		} 
 		else // we have and intersection
@@ -1091,19 +1105,25 @@ void TileEditCS(
 		}
 		sumDist += dist;
 	}
-	if(dist == 0) return;
+	if(dist == 0)
+	{
+		DEFORM_STATS_ADD(DEFORM_STATS_SKIP_ZERO, 1);
+		return;
+	}
 	dist = sumDist * 0.2;	
 
 #else
 	//is only false if outside the box
 	if (VoxelDDA(rayOrigin, rayDir, dist) == false) 
 	{
+		DEFORM_STATS_ADD(DEFORM_STATS_SKIP_MISS, 1);
 		return;
 	} 
 	else // we have an intersection depth
 	{
 		if (dist == 0.0f)	
 		{
+			DEFORM_STATS_ADD(DEFORM_STATS_SKIP_ZERO, 1);
 			return;
 		}
 		float3 p = rayDir * dist;
@@ -1116,13 +1136,27 @@ void TileEditCS(
 	float omega = g_Smoothness;
 #ifdef WITH_CONSTRAINTS
 	// constraints uav is bound, but we cannot reuse slot u0 due to compiler
-	float dispOut = lerp(g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)], dist, omega);
+	float dispIn = g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)];
+	float dispOut = lerp(dispIn, dist, omega);
 	g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)] = dispOut;
 #else
-	float outDisp = lerp(g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)], dist, omega);
+	float dispIn = g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)];
+	float outDisp = lerp(dispIn, dist, omega);
 	g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)] = outDisp;
 	uint oldVal = 0;
 	InterlockedMax(g_maxPatchDisplacement[patchData.x], asuint(abs(outDisp)), oldVal);	
+	float dispOut = outDisp;
+#endif
+
+	DEFORM_STATS_ADD(DEFORM_STATS_TEXELS_WRITTEN, 1);
+	if (dispOut != dispIn)
+	{
+		DEFORM_STATS_ADD(DEFORM_STATS_TEXELS_CHANGED, 1);
+		DEFORM_STATS_MAX(DEFORM_STATS_MAX_DELTA, asuint(abs(dispOut - dispIn)));
+	}
+
+#ifdef WITH_DIRTY_EDGES
+	MarkDirtyEdges(faceID, ucoord - uint2(ppack.uOffset, ppack.vOffset), ppack.tileSize);
 #endif
 
 #endif
@@ -1451,5 +1485,9 @@ void ApplyConstraintsOSDCulledCS(
 	uint2 ucoord = uint2(coords);    
 	float disp = getSmoothedValueQuadratic(ucoord.x, ucoord.y, ppack.page);
 	g_displacementUAV[int3(ucoord.x, ucoord.y, ppack.page)] = disp;
+
+#ifdef WITH_DIRTY_EDGES
+	MarkDirtyEdges(faceID, ucoord - uint2(ppack.uOffset, ppack.vOffset), ppack.tileSize);
+#endif
 }
 #endif
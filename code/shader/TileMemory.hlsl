@@ -15,6 +15,8 @@
 
 #define ALLOCATOR_BLOCKSIZE 32
 
+#include "DirtyEdges.h.hlsl"
+
 cbuffer ManageTilesCB : register(b11)
 {
 	uint g_NumTiles;
@@ -117,6 +119,11 @@ void AllocateTilesCS(uint3 DTid: SV_DispatchThreadID, uint GI : SV_GroupIndex)
 		{
 			uint memLoc = AtomicAlloc();
 			AllocTileMem(tileID, memLoc);
+
+#ifdef WITH_DIRTY_EDGES
+			// the new tile has no overlap yet. CompactDirtyEdgesCS also updates the shared edges and corners of the neighbors from this mask
+			InterlockedOr(g_dirtyEdgesUAV[tileID], DIRTY_EDGE_MASK | DIRTY_CORNER_MASK);
+#endif
 		}
 	}
 }
\ No newline at end of file
@@ -17,10 +17,13 @@
 #define TILE_SIZE 16
 #endif
 
+#include "DirtyEdges.h.hlsl"
+
 // read buffers (SRVs)
 Buffer<uint>	g_TileDescriptors	: register(t0);	//tile layout info, packed textureDisplace_Packing
 Buffer<int>		g_TileNeighData		: register(t1);
-StructuredBuffer<uint>	g_compactedVisibility	: register(t4);
+StructuredBuffer<uint>	g_compactedVisibility	: register(t4);	// visible ptex ids, or dirty edge records with DIRTY_EDGES
+Buffer<uint>			g_dirtyEdgeMask			: register(t5);	// per ptex face, see DirtyEdges.h.hlsl
 
 // writable buffers
 RWTexture2DArray<float>		g_displacementDataUAV	: register(u0);
@@ -73,7 +76,10 @@ void OverlapEdgesCS(
 	uint3 threadIdx : SV_GroupThreadID,
 	uint  GI		: SV_GroupIndex )
 {
-#ifdef COMPACTED_VISIBILITY	
+#if defined(DIRTY_EDGES)
+	uint record = g_compactedVisibility[blockIdx.x];
+	uint ptexID = record >> DIRTY_RECORD_SHIFT;
+#elif defined(COMPACTED_VISIBILITY)
 	uint ptexID = g_compactedVisibility[blockIdx.x];
 #else
 	uint ptexID = blockIdx.x;
@@ -85,6 +91,11 @@ void OverlapEdgesCS(
 	int4 neighPtexID = GetNeighPtexInfo(ptexID);		
 	uint edge = threadIdx.y; // asume edge 0 is XY 0,0 to TILE_SIZE, 0
 
+#ifdef DIRTY_EDGES
+	if ((record & (1u << edge)) == 0)
+		return;
+#endif
+
 	uint neighPtex = neighPtexID[edge];
 	if (!IsAllocated(neighPtex))
 		return;
@@ -135,7 +146,12 @@ void OverlapCornersCS(
 	uint  GI		: SV_GroupIndex )
 {
 
-#ifdef COMPACTED_VISIBILITY	
+#if defined(DIRTY_EDGES)
+	uint record = g_compactedVisibility[blockIdx.x];
+	uint ptexID = record >> DIRTY_RECORD_SHIFT;
+	if ((record & DIRTY_RECORD_CORNERS) == 0)
+		return;
+#elif defined(COMPACTED_VISIBILITY)
 	uint ptexID = g_compactedVisibility[blockIdx.x];
 #else
 	uint ptexID = blockIdx.x;
@@ -271,6 +287,18 @@ void OverlapEqualizeExtraordinaryCS(
 		ptex2faceVertex[i] = GetFaceAndVertexID(offset, i);			
 	}	
 
+#ifdef DIRTY_EDGES
+	// skip vertices none of whose corner texels were written
+	uint dirtyCorner = 0;
+	for(uint d = 0; d < MAX_VALENCE; ++d)
+	{
+		if(d >= valence) break;
+		dirtyCorner |= g_dirtyEdgeMask[GetPTexID(ptex2faceVertex[d])] & (1u << (DIRTY_CORNER_SHIFT + GetVertexIdx(ptex2faceVertex[d])));
+	}
+	if(dirtyCorner == 0)
+		return;
+#endif
+
 	const int ts = int(TILE_SIZE) - 1; // we are already at start texel so -1
 
 	int overlap = 1;	// checkme set from outside
@@ -377,4 +405,63 @@ void CompactIntersectAll(	uint3 DTid	: SV_DispatchThreadID )
 	{
 		g_compactedVisibilityAppend.Append(ptexID);
 	}
-}
\ No newline at end of file
+}
+
+
+// one thread per ptex face, gathers the edges that have to be copied from the dirty masks of the face and its neighbors:
+// edge e of a face is updated if it or the opposite edge of the neighbor was written. the corners of a face are read from the
+// overlap of the neighbors on edge 0 and 2, they are updated if a corner texel in the one ring of these neighbors was written.
+// cpu reference: TileOverlapUpdater::BuildDirtyEdgeRecordsCPU
+AppendStructuredBuffer<uint>	g_dirtyEdgeRecordsAppend	: register(u0);
+RWBuffer<uint>					g_dirtyEdgeStatsUAV			: register(u1);	// counters of the update, see DirtyEdgeStats in TileOverlapUpdater.h
+
+#define DIRTY_STATS_EDGES			0	// edges copied by OverlapEdgesCS
+#define DIRTY_STATS_CORNER_FACES	1	// faces processed by OverlapCornersCS
+#define DIRTY_STATS_RECORDS			2	// faces with at least one edge or corner update
+
+[numthreads(32, 1, 1)]
+void CompactDirtyEdgesCS( uint3 DTid : SV_DispatchThreadID )
+{
+	uint ptexID = DTid.x;
+	if(!IsAllocated(ptexID))
+		return;
+
+	int4 neighPtexID = GetNeighPtexInfo(ptexID);
+	int4 neighEdges  = GetNeighEdgeInfo(ptexID);
+
+	uint mask	 = g_dirtyEdgeMask[ptexID];
+	uint edges	 = mask & DIRTY_EDGE_MASK;
+	uint corners = mask & DIRTY_CORNER_MASK;
+
+	[unroll]
+	for(uint e = 0; e < 4; ++e)
+	{
+		if(neighPtexID[e] < 0)
+			continue;
+
+		uint neighMask = g_dirtyEdgeMask[neighPtexID[e]];
+		if(neighMask & (1u << neighEdges[e]))
+			edges |= 1u << e;
+		corners |= neighMask & DIRTY_CORNER_MASK;
+
+		if(e % 2 == 0)
+		{
+			int4 ring = GetNeighPtexInfo(neighPtexID[e]);
+			[unroll]
+			for(uint k = 0; k < 4; ++k)
+			{
+				if(ring[k] >= 0)
+					corners |= g_dirtyEdgeMask[ring[k]] & DIRTY_CORNER_MASK;
+			}
+		}
+	}
+
+	if(edges == 0 && corners == 0)
+		return;
+
+	g_dirtyEdgeRecordsAppend.Append((ptexID << DIRTY_RECORD_SHIFT) | edges | (corners ? DIRTY_RECORD_CORNERS : 0));
+
+	InterlockedAdd(g_dirtyEdgeStatsUAV[DIRTY_STATS_EDGES], countbits(edges));
+	InterlockedAdd(g_dirtyEdgeStatsUAV[DIRTY_STATS_CORNER_FACES], corners ? 1 : 0);
+	InterlockedAdd(g_dirtyEdgeStatsUAV[DIRTY_STATS_RECORDS], 1);
+}
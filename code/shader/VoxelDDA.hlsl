@@ -107,6 +107,7 @@ bool pointInAABBTest(in float3 p)
 bool VoxelDDA(in float3 origin, in float3 dir, out float dist)
 {
 	dist = 0;
+	DEFORM_STATS_ADD(DEFORM_STATS_RAYS, 1);
 	//const float eps = exp2(-50.0);
 	const float eps = 2 * MINF;
 	
@@ -178,6 +179,9 @@ bool VoxelDDA(in float3 origin, in float3 dir, out float dist)
 	uint maxSteps =  g_gridSize.x + g_gridSize.y + g_gridSize.z + 1;	
 	maxSteps = min(8, maxSteps);	// HENRY CHECKME, we dont have to go too deep
 
+	uint numSteps = 0;
+	uint numHits = 0;
+
 	[allow_uav_condition]		
 	for(uint i = 0; i < maxSteps; i++) {
 				
@@ -186,8 +190,12 @@ bool VoxelDDA(in float3 origin, in float3 dir, out float dist)
 		//if(tEnter + t >= tExit)	 
 		//	break;
 
+		numSteps++;
 		if (IsVoxelSet(currentVoxel))
+		{
 			dist = t;
+			numHits++;
+		}
 		
 		if(tMax.x <= t) { tMax.x += deltaT.x; currentVoxel.x += cellStep.x; }
 		if(tMax.y <= t) { tMax.y += deltaT.y; currentVoxel.y += cellStep.y; }
@@ -198,6 +206,9 @@ bool VoxelDDA(in float3 origin, in float3 dir, out float dist)
 				
 	}	
 
+	DEFORM_STATS_ADD(DEFORM_STATS_DDA_STEPS, numSteps);
+	DEFORM_STATS_ADD(DEFORM_STATS_VOXELS_HIT, numHits);
+
 	if (dist > 0)	return true;
 	else			return false;
 }
\ No newline at end of file
@@ -15,10 +15,13 @@
 
 #include "stdafx.h"
 #include "App.h"
+#include "compute/OsdCPUComputeController.h"
 #include <SDX/DXBuffer.h>
 //Henry: has to be last header
 #include "utils/DbgNew.h"
 
+App g_app;
+
 HRESULT App::Create( ID3D11Device1* pd3dDevice )
 {
 	HRESULT hr = S_OK;
@@ -54,6 +57,9 @@ HRESULT App::Create( ID3D11Device1* pd3dDevice )
 	queryDesc.MiscFlags = 0; 
 	V_RETURN(pd3dDevice->CreateQuery(&queryDesc, &g_pipelineQuery)); 
 
+	// stage latencies come from the profile scopes of real frames
+	g_profiler.SetEventCallback([this](const ProfileEvent& e){ g_TimingLog.onProfileEvent(e); });
+
 	return hr;	
 }
 
@@ -68,4 +74,56 @@ void App::Destroy()
 	SAFE_RELEASE( g_pipelineQuery );
 
 	SAFE_DELETE(  g_osdSubdivider );	
+	SAFE_DELETE(  g_osdSubdividerCPU );
+}
+
+// default settings of the interactive app and the batch runner
+void ApplyGlobalSettings()
+{
+	g_app.g_bRunSimulation = false;
+	g_app.g_fDisplacementScalar = 1.0f;
+	g_app.g_displacementTileSize = 128;
+	g_app.g_colorTileSize	     = 32;
+	g_app.g_maxSubdivisions      = 5;
+	g_app.g_useCPUSubdivision   = false;
+	g_app.g_useStencilRefinement = false;
+	g_app.g_stencilLimitSamples = 0;
+	g_app.g_useTopologyCache = true;
+	g_app.g_topologyCacheDir = "subd_cache";
+	g_app.g_useSceneCache = true;
+	g_app.g_sceneCacheDir = "scene_cache";
+	g_app.g_compressAnimations = false;
+	g_app.g_useAnimationLOD = false;
+	g_app.g_numLoaderThreads = 2;
+	g_app.g_loadBudgetMS = 8.0f;
+
+	g_app.g_memDebugDoPrealloc		= false; // prealloc for all mesh patches and disable mem management
+
+	// with memory management
+	g_app.g_memNumColorTiles	    = 3000;	 // preallocated buffer elements
+	g_app.g_memNumDisplacementTiles = 3000;//2000;	 // preallocated buffer elements
+
+	g_app.g_memMaxNumTilesPerObject = 85000;
+
+	g_app.g_adaptiveVoxelizationScale	= 50;
+	g_app.g_bShowVoxelization			= false;
+	g_app.g_showAllocated				= false;
+	g_app.g_fTessellationFactor			= 32.f;
+	g_app.g_voxelDeformationMultiSampling = false;
+	g_app.g_withVoxelJittering			= true;
+	g_app.g_withVoxelOBBRotate			= false;
+	g_app.g_profilePipelineStages		= false;
+	g_app.g_useCompactedVisibilityOverlap = true;
+	g_app.g_useDirtyEdgeOverlap = true;
+	g_app.g_validateDirtyEdgeOverlap = false;
+	g_app.g_deformationStats = false;
+	g_app.g_validateDeformationStats = false;
+	g_app.g_withOverlapUpdate = true;
+
+	g_app.g_useCulling					= true;		// ALWAYS ENABLE!!!, use below to disable culling for ray casting		// culling doubles performance on gtx 480, TODO patch frustum culling
+	g_app.g_useCullingForRayCast		= true;
+
+	g_app.g_useDisplacementConstraints = false;  // activate for best quality - ! has to be active on app start 
+
+	g_app.g_withPaintSculptTimings = false;
 }
@@ -10,6 +10,7 @@
 #include "Voxelization.h"
 
 class DXPicking;
+class OsdCPUComputeController;
 
 static ID3D11ShaderResourceView*	const g_ppSRVNULL[] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
 static ID3D11UnorderedAccessView*	const g_ppUAVNULL[] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
@@ -266,6 +267,8 @@ struct CB_OSDConfig {
 	unsigned int NumVertexComponents;
 	unsigned int NumIndicesPerPatch;
 	unsigned int NumPatches;
+	unsigned int CandidateOffset;		// temporal intersection: first candidate of the patch array
+	unsigned int NumCandidates;			// temporal intersection: number of ptex faces to clear
 };
 
 __declspec(align(16))
@@ -296,6 +299,18 @@ public:
 		
 		m_camModified			= true;
 		g_osdSubdivider			= NULL;
+		g_osdSubdividerCPU		= NULL;
+		g_useCPUSubdivision		= false;
+		g_useStencilRefinement	= false;
+		g_stencilLimitSamples	= 0;
+		g_useTopologyCache		= true;
+		g_topologyCacheDir		= "subd_cache";
+		g_useSceneCache			= true;
+		g_sceneCacheDir			= "scene_cache";
+		g_compressAnimations	= false;
+		g_useAnimationLOD		= false;
+		g_numLoaderThreads		= 2;
+		g_loadBudgetMS			= 8.0f;
 		
 		g_bTimingsEnabled = false;	
 		
@@ -308,9 +323,16 @@ public:
 		g_profilePipelineStages = false;
 		g_showIntersections = false;
 		g_useCompactedVisibilityOverlap = false;
+		g_useDirtyEdgeOverlap = false;
+		g_validateDirtyEdgeOverlap = false;
+		g_deformationStats = false;
+		g_validateDeformationStats = false;
 		g_useDisplacementConstraints = false;
 		g_showAllocated = false;
 		g_withOverlapUpdate = true;
+		g_useTemporalIntersection = false;
+		g_validateTemporalIntersection = false;
+		g_validateComputeBackend = false;
 
 		g_adaptiveTessellation = true;
 
@@ -570,6 +592,18 @@ public:
 	Timer		g_Timer;
 	TimingLog	g_TimingLog;
 	OpenSubdiv::OsdD3D11ComputeController* g_osdSubdivider;
+	OsdCPUComputeController* g_osdSubdividerCPU;
+	bool		g_useCPUSubdivision;		// subd meshes created with the cpu controller, refinement without gpu compute
+	bool		g_useStencilRefinement;		// subd meshes refined by one stencil mat-vec over the control cage instead of the kernel batches
+	UINT		g_stencilLimitSamples;		// limit stencils per coarse face edge (n x n per face) built with the subd meshes, 0 = none
+	bool		g_useTopologyCache;			// subd mesh topology loaded from / stored to binary files in g_topologyCacheDir
+	std::string	g_topologyCacheDir;
+	bool		g_useSceneCache;			// imported assimp scenes stored to / mapped from packed binary files in g_sceneCacheDir
+	std::string	g_sceneCacheDir;
+	bool		g_compressAnimations;		// imported animations stored as compressed clips (AnimationCompression.h), raw keys released
+	bool		g_useAnimationLOD;			// update rate and bone subset of the animated groups by camera distance (AnimationLOD.h)
+	UINT		g_numLoaderThreads;			// background threads of g_modelLoader, each prepares one model file at a time
+	float		g_loadBudgetMS;				// per frame time for inserting loaded models into the scene
 
 
 	// global app settings
@@ -608,10 +642,17 @@ public:
 	bool		g_enableOffsetUV;
 
 	bool		g_useCompactedVisibilityOverlap;
+	bool		g_useDirtyEdgeOverlap;			// overlap update only on edges written by the tile edit, instead of all intersected faces
+	bool		g_validateDirtyEdgeOverlap;		// compare the gpu dirty edge records with the cpu reference (stalls)
+	bool		g_deformationStats;				// count tiles, rays, dda steps and texels of the tile edit, read back asynchronously
+	bool		g_validateDeformationStats;		// compare the changed texel counters with the cpu reference (stalls)
 	bool		g_useDisplacementConstraints;
 
 	bool		g_showAllocated;
 	bool		g_withOverlapUpdate;
+	bool		g_useTemporalIntersection;
+	bool		g_validateTemporalIntersection;	// run the full intersection after each incremental one and compare the visibility (stalls)
+	bool		g_validateComputeBackend;		// run every intersection batch of the cpu compute backend on d3d11 too and compare the results (stalls)
 
 	uint32_t	g_maxSubdivisions;
 
@@ -648,4 +689,6 @@ private:
 
 extern App g_app;
 
+void ApplyGlobalSettings();
+
 
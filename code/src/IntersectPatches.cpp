@@ -21,23 +21,128 @@
 #include "scene/ModelInstance.h"
 #include "scene/DXSubDModel.h"
 #include "scene/DXModel.h"
+#include "compute/ComputeBackendD3D11.h"
+#include "compute/ComputeBackendCPU.h"
 
 
 #include <sstream>
+#include <tuple>
 
 using namespace DirectX;
 
 IntersectGPU g_intersectGPU;
 
-EffectRegistryIntersect g_intersectEffectRegistry;
+// temporal intersection settings
+static const float TEMPORAL_TELEPORT_THRESHOLD		= 0.5f;		// max obb corner motion per frame relative to the obb diagonal
+static const float TEMPORAL_MAX_CANDIDATE_FRACTION	= 0.5f;		// above this the full test is cheaper than the candidate upload
+
+// about 7 MB for UINT3 (gregory), 4.5 MB for UINT2 regular - has to be that large for complete displacement map transfer where all patches are active/intersected
+static const UINT INTERSECT_PATCH_DATA_ELEMENTS = 600000;
+
+typedef std::tuple<UINT, UINT, UINT> IntersectedPatch;	// append buffer element, uint2 (regular) or uint3 (gregory)
+
+// results of one batch, read back for the comparison of the backends
+struct IntersectResults
+{
+	std::vector<UINT>				visibility;
+	std::vector<IntersectedPatch>	patches[2][DEFORMATION_BATCH_SIZE];	// [regular, gregory][batch index], sorted
+};
+
+static ComputeBackend* GetBackend(UINT type)
+{
+	return type == static_cast<UINT>(ComputeBackendType::CPU) ? static_cast<ComputeBackend*>(&g_computeBackendCPU) : &g_computeBackendD3D11;
+}
+
+// non owning wrapper of the buffer behind a view, covers the whole buffer so it can be read back
+static ComputeResource* WrapViewBuffer(ID3D11ShaderResourceView* srv, ID3D11UnorderedAccessView* uav)
+{
+	if (!srv) return NULL;
+
+	ID3D11Resource* resource = NULL;
+	srv->GetResource(&resource);
+	ID3D11Buffer* buffer = static_cast<ID3D11Buffer*>(resource);
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	SAFE_RELEASE(resource);		// owned by the draw context or the instance
+
+	ComputeBufferDesc bufferDesc(desc.ByteWidth / sizeof(UINT), sizeof(UINT), DXGI_FORMAT_R32_UINT, COMPUTE_SRV | (uav ? COMPUTE_UAV : 0));
+	return g_computeBackendD3D11.WrapBuffer(bufferDesc, buffer, srv, uav);
+}
+
+static void SortPatches(const UINT* data, UINT count, UINT stride, std::vector<IntersectedPatch>& patches)
+{
+	patches.resize(count);
+	for (UINT i = 0; i < count; ++i)
+	{
+		const UINT* e = data + i * stride;
+		patches[i] = IntersectedPatch(e[0], e[1], stride > 2 ? e[2] : 0);
+	}
+	std::sort(patches.begin(), patches.end());
+}
+
+// kernel of an intersection variant, the defines select the hlsl code paths and are read by the cpu ports
+static ComputeKernelDesc GetIntersectKernelDesc(const IntersectConfig& effect)
+{
+	const bool isGregory = effect.patch_type == (UINT)IntersectPatchType::GREGORY;
+	ComputeKernelDesc desc(L"shader/IntersectOSDCS.hlsl", isGregory ? "IntersectGregoryCS" : "IntersectRegularCS");
+
+	if (effect.isct_mode == (UINT)IntersectMode::Brush)
+		desc.AddDefine("INTERSECT_BRUSH");
+	else if (effect.isct_mode == (UINT)IntersectMode::OBB)
+		desc.AddDefine("INTERSECT_OBB");
+
+	std::ostringstream ss;
+	if (isGregory)
+	{
+		ss << effect.max_valence;
+		desc.AddDefine("OSD_MAX_VALENCE", ss.str());
+		desc.AddDefine("TYPE_GREGORY");
+	}
+
+	ss.str("");	ss << effect.batch_size;
+	desc.AddDefine("BATCH_SIZE", ss.str());
+
+	if (effect.all_active)
+		desc.AddDefine("SET_ALL_ACTIVE");
+
+	if (effect.use_maxdisp)
+		desc.AddDefine("WITH_DYNAMIC_MAX_DISP");
+
+	if (effect.temporal)
+		desc.AddDefine("TEMPORAL_CANDIDATES");
+
+	return desc;
+}
+
+IntersectBindings::IntersectBindings()
+{
+	osdConfigCB = NULL;
+	obbBatchCB = NULL;
+	temporalCandidates = NULL;
+	temporalCandidatesCapacity = 0;
+	for (UINT i = 0; i < ARRAYSIZE(patchAppendRegular); ++i)
+	{
+		patchAppendRegular[i] = NULL;
+		patchAppendGregory[i] = NULL;
+	}
+}
+
+IntersectInputs::IntersectInputs()
+{
+	for (UINT i = 0; i < NUM_SRVS; ++i)
+		srv[i] = NULL;
+	visibility = NULL;
+	visibilityAll = NULL;
+}
 
 IntersectGPU::IntersectGPU()
 {
 	m_intersectMode = IntersectMode::Brush;
 	
-	m_intersectClear_CS = NULL;
+	m_intersectClearKernel = NULL;
+	m_intersectClearCandidatesKernel = NULL;
+	m_clearConfigCB = NULL;
 
-	m_osdConfigCB			= NULL;		// constant buffer for osd patch config
 	m_intersectModelCB		= NULL;
 	
 	m_isctMeshMaxValence = 4;
@@ -52,16 +157,14 @@ IntersectGPU::~IntersectGPU()
 HRESULT IntersectGPU::Create( ID3D11Device1* pd3dDevice )
 {
 	HRESULT hr = S_OK;
-	ID3DBlob* pBlob = nullptr;
-	m_intersectClear_CS		= g_shaderManager.AddComputeShader(L"shader/IntersectOSDCS.hlsl", "IntersectClearCS", "cs_5_0", &pBlob);
-	SAFE_RELEASE(pBlob);	
+	V_RETURN(g_computeBackend->CreateKernel(ComputeKernelDesc(L"shader/IntersectOSDCS.hlsl", "IntersectClearCS"), m_intersectClearKernel));
+	V_RETURN(g_computeBackend->CreateKernel(ComputeKernelDesc(L"shader/IntersectOSDCS.hlsl", "IntersectClearCandidatesCS"), m_intersectClearCandidatesKernel));
+	V_RETURN(g_computeBackend->CreateBuffer(ComputeBufferDesc(1, sizeof(CB_OSDConfig), DXGI_FORMAT_UNKNOWN, COMPUTE_CONSTANT), NULL, m_clearConfigCB));
 
 
 	// DATA
 	// constant buffers	
-	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_CONSTANT_BUFFER, sizeof(CB_OSDConfig)			, D3D11_CPU_ACCESS_WRITE, D3D11_USAGE_DYNAMIC, m_osdConfigCB));
 	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_CONSTANT_BUFFER, sizeof(CB_IntersectModel)		, D3D11_CPU_ACCESS_WRITE, D3D11_USAGE_DYNAMIC, m_intersectModelCB));	
-	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_CONSTANT_BUFFER, sizeof(CB_IntersectOBBBatch)	, D3D11_CPU_ACCESS_WRITE, D3D11_USAGE_DYNAMIC, m_intersectOBBBatchCB));
 	
 
 
@@ -69,7 +172,7 @@ HRESULT IntersectGPU::Create( ID3D11Device1* pd3dDevice )
 	// append buffer for queuing render patches that need work
 	// regular patches: we need to store an UINT3( localPatchID + PrimitiveIdBase,  indices_start + NumIndicesPerPatch * localPatchID, g_NumVertexComponents) // TODO num vertex components should always be 3 
 	// gregory patches: 
-	UINT numPatchDataElements = 600000; // about 7 MB for UINT3 (gregory), 4.5 MB for UINT2 regular - has to be that large for complete displacement map transfer where all patches are active/intersected
+	UINT numPatchDataElements = INTERSECT_PATCH_DATA_ELEMENTS;
 	for (uint32_t i = 0; i < DEFORMATION_BATCH_SIZE; ++i)
 	{		
 		V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, numPatchDataElements*sizeof(UINT) * 2,
@@ -103,22 +206,88 @@ HRESULT IntersectGPU::Create( ID3D11Device1* pd3dDevice )
 		V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_patchAppendRegular[i].BUF, &descUAV, &m_patchAppendRegular[i].UAV));
 		V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_patchAppendGregory[i].BUF, &descUAV, &m_patchAppendGregory[i].UAV));
 	}
+
+	// the d3d11 bindings also receive the results of the cpu backend
+	V_RETURN(CreateBindings(&g_computeBackendD3D11));
+	if (g_computeBackend != &g_computeBackendD3D11)
+		V_RETURN(CreateBindings(g_computeBackend));
 	return hr;
 }
 
+HRESULT IntersectGPU::CreateBindings(ComputeBackend* backend)
+{
+	HRESULT hr = S_OK;
+	IntersectBindings& bindings = GetBindings(backend);
+	V_RETURN(backend->CreateBuffer(ComputeBufferDesc(1, sizeof(CB_OSDConfig), DXGI_FORMAT_UNKNOWN, COMPUTE_CONSTANT), NULL, bindings.osdConfigCB));
+	V_RETURN(backend->CreateBuffer(ComputeBufferDesc(1, sizeof(CB_IntersectOBBBatch), DXGI_FORMAT_UNKNOWN, COMPUTE_CONSTANT), NULL, bindings.obbBatchCB));
+
+	const UINT flags = COMPUTE_SRV | COMPUTE_UAV | COMPUTE_STRUCTURED | COMPUTE_APPEND;
+	const ComputeBufferDesc regularDesc(INTERSECT_PATCH_DATA_ELEMENTS, sizeof(UINT) * 2, DXGI_FORMAT_UNKNOWN, flags);
+	const ComputeBufferDesc gregoryDesc(INTERSECT_PATCH_DATA_ELEMENTS, sizeof(UINT) * 3, DXGI_FORMAT_UNKNOWN, flags);
+	for (uint32_t i = 0; i < DEFORMATION_BATCH_SIZE; ++i)
+	{
+		if (backend == &g_computeBackendD3D11)
+		{
+			bindings.patchAppendRegular[i] = g_computeBackendD3D11.WrapBuffer(regularDesc, m_patchAppendRegular[i].BUF, m_patchAppendRegular[i].SRV, m_patchAppendRegular[i].UAV);
+			bindings.patchAppendGregory[i] = g_computeBackendD3D11.WrapBuffer(gregoryDesc, m_patchAppendGregory[i].BUF, m_patchAppendGregory[i].SRV, m_patchAppendGregory[i].UAV);
+		}
+		else
+		{
+			V_RETURN(backend->CreateBuffer(regularDesc, NULL, bindings.patchAppendRegular[i]));
+			V_RETURN(backend->CreateBuffer(gregoryDesc, NULL, bindings.patchAppendGregory[i]));
+		}
+	}
+	return hr;
+}
+
+void IntersectGPU::DestroyBindings(ComputeBackend* backend)
+{
+	IntersectBindings& bindings = GetBindings(backend);
+	backend->DestroyResource(bindings.osdConfigCB);
+	backend->DestroyResource(bindings.obbBatchCB);
+	backend->DestroyResource(bindings.temporalCandidates);
+	bindings.temporalCandidatesCapacity = 0;
+	for (UINT i = 0; i < ARRAYSIZE(bindings.patchAppendRegular); ++i)
+	{
+		backend->DestroyResource(bindings.patchAppendRegular[i]);
+		backend->DestroyResource(bindings.patchAppendGregory[i]);
+	}
+	for (auto& it : bindings.kernels)
+		backend->DestroyKernel(it.second);
+	bindings.kernels.clear();
+
+	for (auto& it : m_inputs[static_cast<UINT>(backend->GetType())])
+	{
+		for (UINT i = 0; i < IntersectInputs::NUM_SRVS; ++i)
+			backend->DestroyResource(it.second.srv[i]);
+		backend->DestroyResource(it.second.visibility);
+		backend->DestroyResource(it.second.visibilityAll);
+	}
+	m_inputs[static_cast<UINT>(backend->GetType())].clear();
+}
+
 void IntersectGPU::Destroy()
 {
-	SAFE_RELEASE(m_osdConfigCB);			
 	SAFE_RELEASE(m_intersectModelCB);
-	SAFE_RELEASE(m_intersectOBBBatchCB);
+
+	if (g_computeBackend)
+	{
+		g_computeBackend->DestroyKernel(m_intersectClearKernel);
+		g_computeBackend->DestroyKernel(m_intersectClearCandidatesKernel);
+		g_computeBackend->DestroyResource(m_clearConfigCB);
+	}
+	for (UINT type = 0; type < ARRAYSIZE(m_bindings); ++type)
+		DestroyBindings(GetBackend(type));
+
+	for (auto& it : m_temporalStates)
+		SAFE_DELETE(it.second);
+	m_temporalStates.clear();
 	
 	for (int i = 0; i < DEFORMATION_BATCH_SIZE; ++i)
 	{
 		m_patchAppendRegular[i].Destroy();
 		m_patchAppendGregory[i].Destroy();
 	}
-
-	g_intersectEffectRegistry.Reset();
 }
 
 //HRESULT IntersectGPU::IntersectModel( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, D3D11ObjectOrientedBoundingBox* obb )
@@ -177,43 +346,66 @@ HRESULT IntersectGPU::IntersectOBBBatch(ID3D11DeviceContext1 *pd3dImmediateConte
 	m_intersectMode = IntersectMode::OBB;
 		
 	{
-		D3D11_MAPPED_SUBRESOURCE MappedResource;
-		V_RETURN(pd3dImmediateContext->Map(m_intersectOBBBatchCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
-		CB_IntersectOBBBatch* pCB = (CB_IntersectOBBBatch*)MappedResource.pData;
+		CB_IntersectOBBBatch cb;
+		ZeroMemory(&cb, sizeof(CB_IntersectOBBBatch));
 
 		int penetratorID = 0;
 		for (auto penetrator : batch)
 		{
 			const DXObjectOrientedBoundingBox& isctObb = penetrator.second;					
-			pCB->modelToWorld[penetratorID] = deformableInstance->GetModelMatrix() * isctObb.getWorldToOOBB(); // modelToWorld * world2OBB					
+			cb.modelToWorld[penetratorID] = deformableInstance->GetModelMatrix() * isctObb.getWorldToOOBB(); // modelToWorld * world2OBB					
 			penetratorID++;
 		}
-		pCB->g_displacementScale = g_app.g_fDisplacementScalar;
+		cb.g_displacementScale = g_app.g_fDisplacementScalar;
 
-		pd3dImmediateContext->Unmap(m_intersectOBBBatchCB, 0);
-		pd3dImmediateContext->CSSetConstantBuffers(CB_LOC::INTERSECT, 1, &m_intersectOBBBatchCB);
+		V_RETURN(g_computeBackend->UpdateConstants(GetBindings(g_computeBackend).obbBatchCB, &cb, sizeof(CB_IntersectOBBBatch)));
 	}
 	
 	if (deformableInstance->IsSubD())
 	{
 		//std::cout << "batch size " << batch.size() << std::endl;
-		ClearIntersectBuffer(pd3dImmediateContext, deformableInstance);
+		const TemporalCandidates* candidates = NULL;
+		if (g_app.g_useTemporalIntersection)
+		{
+			candidates = GatherTemporalCandidates(pd3dImmediateContext, deformableInstance, batch);
+		}
+		else
+		{
+			InvalidateTemporalState(deformableInstance);
+		}
 
-		if (g_app.g_bTimingsEnabled)
+		if (candidates)
 		{
-			g_app.WaitForGPU();
-			g_app.g_TimingLog.m_dCullingTotal -= GetTimeMS() / (double)g_app.g_TimingLog.m_uNumRuns;
-			for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-			{
-				hr = IntersectOSDBatch(pd3dImmediateContext, deformableInstance, static_cast<uint32_t>(batch.size()));
-			}
-			g_app.WaitForGPU();
-			g_app.g_TimingLog.m_dCullingTotal += GetTimeMS() / (double)g_app.g_TimingLog.m_uNumRuns;
-			g_app.g_TimingLog.m_uCullingCount += static_cast<uint32_t>(batch.size());
+			V_RETURN(UploadTemporalCandidates(g_computeBackend, *candidates));
+			ClearIntersectCandidates(deformableInstance, *candidates);
+		}
+		else
+		{
+			ClearIntersectBuffer(deformableInstance);
+		}
+
+		const TimingStage stage = candidates ? TimingStage::CULLING_TEMPORAL : TimingStage::CULLING;
+		if (g_computeBackend->GetType() == ComputeBackendType::CPU)
+		{
+			// the cpu kernels run synchronously, the batch adds the dispatched patches as work
+			TIMING_CPU_STAGE_SCOPE(stage);
+			hr = IntersectOSDBatch(pd3dImmediateContext, deformableInstance, static_cast<uint32_t>(batch.size()), candidates);
 		}
 		else
 		{
-			hr = IntersectOSDBatch(pd3dImmediateContext, deformableInstance, static_cast<uint32_t>(batch.size()));
+			// the batch adds the dispatched patches as work
+			TIMING_STAGE_SCOPE(pd3dImmediateContext, stage);
+			hr = IntersectOSDBatch(pd3dImmediateContext, deformableInstance, static_cast<uint32_t>(batch.size()), candidates);
+		}
+
+		if (candidates && g_app.g_validateTemporalIntersection && SUCCEEDED(hr))
+		{
+			hr = ValidateTemporalIntersection(pd3dImmediateContext, deformableInstance, static_cast<uint32_t>(batch.size()));
+		}
+
+		if (g_app.g_useTemporalIntersection)
+		{
+			UpdateTemporalState(deformableInstance, batch);
 		}
 	}
 
@@ -221,18 +413,300 @@ HRESULT IntersectGPU::IntersectOBBBatch(ID3D11DeviceContext1 *pd3dImmediateConte
 	return hr;
 }
 
-void IntersectGPU::ClearIntersectBuffer( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance )
+void IntersectGPU::ClearIntersectBuffer( ModelInstance* instance )
 {	
+	g_computeBackend->SetKernel(m_intersectClearKernel);
+	g_computeBackend->SetUAV(0, instance->GetVisibilityCompute());			// u0 write per tile intersection result
+	g_computeBackend->Dispatch(instance->GetOSDMesh()->GetNumPTexFaces()/512 + 1, 1, 1);	
+	g_computeBackend->SetUAV(0, NULL);
+}
 
-	ID3D11UnorderedAccessView* ppUAV[] = {
-		instance->GetVisibility()->UAV							// u0 write per tile intersection result
-	};
+void IntersectGPU::ClearIntersectCandidates(ModelInstance* instance, const TemporalCandidates& candidates)
+{
+	if (candidates.numPtexFaces == 0) return;
+
+	// only the tiles touched by the swept penetrators can change, all other entries keep the result of the last batch
+	CB_OSDConfig config;
+	ZeroMemory(&config, sizeof(CB_OSDConfig));
+	config.CandidateOffset = 0;
+	config.NumCandidates = candidates.numPtexFaces;
+	g_computeBackend->UpdateConstants(m_clearConfigCB, &config, sizeof(CB_OSDConfig));
+
+	g_computeBackend->SetKernel(m_intersectClearCandidatesKernel);
+	g_computeBackend->SetConstantBuffer(CB_LOC::OSD_DEFORMATION_CONFIG, m_clearConfigCB);
+	g_computeBackend->SetSRV(6, GetBindings(g_computeBackend).temporalCandidates);
+	g_computeBackend->SetUAV(0, instance->GetVisibilityCompute());			// u0 write per tile intersection result
+	g_computeBackend->Dispatch(candidates.numPtexFaces / 512 + 1, 1, 1);
+	g_computeBackend->SetUAV(0, NULL);
+	g_computeBackend->SetSRV(6, NULL);
+}
 
-	pd3dImmediateContext->CSSetShader(m_intersectClear_CS->Get(), NULL, 0);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, ppUAV, NULL);
-	pd3dImmediateContext->Dispatch(instance->GetOSDMesh()->GetNumPTexFaces()/512 + 1, 1, 1);	
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, g_ppUAVNULL, NULL);
-	
+HRESULT IntersectGPU::UploadTemporalCandidates(ComputeBackend* backend, const TemporalCandidates& candidates)
+{
+	HRESULT hr = S_OK;
+	IntersectBindings& bindings = GetBindings(backend);
+	UINT numElements = std::max(1u, static_cast<UINT>(candidates.data.size()));
+
+	if (numElements > bindings.temporalCandidatesCapacity)
+	{
+		backend->DestroyResource(bindings.temporalCandidates);
+
+		// grow with some slack to avoid reallocations while the penetrators move
+		bindings.temporalCandidatesCapacity = std::max(numElements + numElements / 2, 4096u);
+		V_RETURN(backend->CreateBuffer(ComputeBufferDesc(bindings.temporalCandidatesCapacity, sizeof(UINT), DXGI_FORMAT_R32_UINT, COMPUTE_SRV | COMPUTE_DYNAMIC), NULL, bindings.temporalCandidates));
+	}
+
+	if (candidates.data.empty()) return hr;
+
+	V_RETURN(backend->Upload(bindings.temporalCandidates, &candidates.data[0], static_cast<UINT>(candidates.data.size() * sizeof(UINT))));
+
+	return hr;
+}
+
+const TemporalCandidates* IntersectGPU::GatherTemporalCandidates(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, const std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>& batch)
+{
+	TemporalIntersectState*& state = m_temporalStates[deformable];
+	if (!state)
+	{
+		state = new TemporalIntersectState();
+		if (FAILED(state->grid.Create(pd3dImmediateContext, deformable)))
+		{
+			std::cerr << "temporal intersection disabled for " << deformable->GetOSDMesh()->GetName() << std::endl;
+		}
+	}
+
+	TimingLog& log = g_app.g_TimingLog;
+	TIMING_CPU_STAGE_SCOPE(TimingStage::TEMPORAL_QUERY);
+
+	const TemporalCandidates* result = NULL;
+	const UINT numPatches = state->grid.GetNumPatches();
+
+	if (state->grid.IsValid())
+	{
+		ResolveMaxDisplacement(pd3dImmediateContext, state);
+		CopyMaxDisplacement(pd3dImmediateContext, deformable, state);
+	}
+
+	// previous visibility is only reusable if the deformable and its displacement bound did not change
+	XMFLOAT4X4 modelMatrix;
+	XMStoreFloat4x4(&modelMatrix, deformable->GetModelMatrix());
+	bool reusable =		state->grid.IsValid() && state->prevValid
+					&&	memcmp(&modelMatrix, &state->prevModelMatrix, sizeof(XMFLOAT4X4)) == 0
+					&&	state->prevDisplacementScale == g_app.g_fDisplacementScalar;
+
+	// edits which may have grown any patch are not read back yet
+	for (const auto& pending : state->pendingBatches)
+		reusable &= !pending.allPatches && pending.displacementScale == g_app.g_fDisplacementScalar;
+
+	if (reusable)
+	{
+		const UINT maxCandidates = static_cast<UINT>(TEMPORAL_MAX_CANDIDATE_FRACTION * numPatches);
+
+		state->grid.BeginQuery(state->candidates, g_app.g_fDisplacementScalar);
+
+		// patches selected by the previous or the current obb of each penetrator
+		for (auto& penetrator : batch)
+		{
+			TemporalIntersectState::PenetratorBounds current;
+			ComputePenetratorBounds(deformable->GetModelMatrix() * penetrator.second.getWorldToOOBB(), current);
+
+			auto prev = state->prevPenetrators.find(penetrator.first);
+			if (prev != state->prevPenetrators.end())
+			{
+				// teleport check: corner motion relative to the obb size
+				float diagonal = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&current.corners[7]), XMLoadFloat3(&current.corners[0]))));
+				float motion = 0.f;
+				for (UINT i = 0; i < 8; ++i)
+					motion = std::max(motion, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&current.corners[i]), XMLoadFloat3(&prev->second.corners[i])))));
+
+				if (motion > TEMPORAL_TELEPORT_THRESHOLD * diagonal || !state->grid.AddRegion(XMLoadFloat4x4(&prev->second.modelToOBB), maxCandidates))
+				{
+					reusable = false;
+					break;
+				}
+			}
+
+			if (!state->grid.AddRegion(XMLoadFloat4x4(&current.modelToOBB), maxCandidates))
+			{
+				reusable = false;
+				break;
+			}
+		}
+
+		// penetrators which left the batch still have to clear their tiles
+		for (auto& prev : state->prevPenetrators)
+		{
+			if (!reusable) break;
+			if (batch.find(prev.first) != batch.end()) continue;
+
+			reusable = state->grid.AddRegion(XMLoadFloat4x4(&prev.second.modelToOBB), maxCandidates);
+		}
+
+		// patches edited since the last resolved readback, their displacement bound on the cpu may be too small
+		for (const auto& pending : state->pendingBatches)
+		{
+			for (const auto& modelToOBB : pending.modelToOBB)
+			{
+				if (!reusable) break;
+				reusable = state->grid.AddRegion(XMLoadFloat4x4(&modelToOBB), maxCandidates);
+			}
+		}
+
+		if (reusable)
+		{
+			state->grid.EndQuery(state->candidates);
+			result = &state->candidates;
+		}
+	}
+
+	if (state->grid.IsValid())
+	{
+		// the tile edits of this batch only write the intersected patches, without culling they run on all visible tiles
+		TemporalIntersectState::PendingBatch pending;
+		pending.serial = state->batchSerial++;
+		pending.allPatches = !g_app.g_useCullingForRayCast;
+		pending.displacementScale = g_app.g_fDisplacementScalar;
+		for (auto& penetrator : batch)
+		{
+			pending.modelToOBB.push_back(XMFLOAT4X4());
+			XMStoreFloat4x4(&pending.modelToOBB.back(), deformable->GetModelMatrix() * penetrator.second.getWorldToOOBB());
+		}
+		state->pendingBatches.push_back(pending);
+	}
+
+	if (result)
+	{
+		log.m_uTemporalIncremental++;
+		log.m_uTemporalCandidatePatches += result->numPatches;
+	}
+	else
+	{
+		log.m_uTemporalFallback++;
+		log.m_uTemporalCandidatePatches += numPatches;
+	}
+	log.m_uTemporalTotalPatches += numPatches;
+	g_profiler.AddScopeValue(numPatches);
+
+	return result;
+}
+
+void IntersectGPU::ResolveMaxDisplacement(ID3D11DeviceContext1 *pd3dImmediateContext, TemporalIntersectState* state)
+{
+	// finished copies in submission order, the oldest copy in flight is at the write slot
+	for (UINT i = 0; i < TemporalIntersectState::MAX_DISP_FRAMES_IN_FLIGHT; ++i)
+	{
+		const UINT slot = (state->maxDispWriteSlot + i) % TemporalIntersectState::MAX_DISP_FRAMES_IN_FLIGHT;
+		if (!state->maxDispPending[slot]) continue;
+
+		D3D11_MAPPED_SUBRESOURCE MappedResource;
+		if (FAILED(pd3dImmediateContext->Map(state->maxDispStagingBUF[slot], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &MappedResource)))
+			break;	// still drawing
+
+		D3D11_BUFFER_DESC desc;
+		state->maxDispStagingBUF[slot]->GetDesc(&desc);
+		state->grid.UpdateMaxDisplacement(static_cast<const float*>(MappedResource.pData), desc.ByteWidth / sizeof(float));
+		pd3dImmediateContext->Unmap(state->maxDispStagingBUF[slot], 0);
+		state->maxDispPending[slot] = false;
+
+		while (!state->pendingBatches.empty() && state->pendingBatches.front().serial < state->maxDispCopySerial[slot])
+			state->pendingBatches.pop_front();
+	}
+}
+
+void IntersectGPU::CopyMaxDisplacement(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, TemporalIntersectState* state)
+{
+	// nothing edited since the last copy or all staging buffers in flight, the edits are picked up by a later copy
+	if (state->pendingBatches.empty() || state->pendingBatches.back().serial < state->lastCopySerial) return;
+	if (state->maxDispPending[state->maxDispWriteSlot]) return;
+
+	ID3D11Buffer*& stagingBUF = state->maxDispStagingBUF[state->maxDispWriteSlot];
+	if (!stagingBUF)
+	{
+		D3D11_BUFFER_DESC desc;
+		deformable->GetMaxDisplacement()->BUF->GetDesc(&desc);
+		if (FAILED(DXCreateBuffer(DXUTGetD3D11Device(), 0, desc.ByteWidth, D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, stagingBUF)))
+			return;
+	}
+
+	// all edits submitted so far, i.e. of the batches before this one
+	pd3dImmediateContext->CopyResource(stagingBUF, deformable->GetMaxDisplacement()->BUF);
+	state->maxDispCopySerial[state->maxDispWriteSlot] = state->batchSerial;
+	state->maxDispPending[state->maxDispWriteSlot] = true;
+	state->lastCopySerial = state->batchSerial;
+	state->maxDispWriteSlot = (state->maxDispWriteSlot + 1) % TemporalIntersectState::MAX_DISP_FRAMES_IN_FLIGHT;
+}
+
+void IntersectGPU::UpdateTemporalState(ModelInstance* deformable, const std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>& batch)
+{
+	auto it = m_temporalStates.find(deformable);
+	if (it == m_temporalStates.end() || !it->second->grid.IsValid()) return;
+
+	TemporalIntersectState* state = it->second;
+	state->prevPenetrators.clear();
+	for (auto& penetrator : batch)
+	{
+		ComputePenetratorBounds(deformable->GetModelMatrix() * penetrator.second.getWorldToOOBB(), state->prevPenetrators[penetrator.first]);
+	}
+	XMStoreFloat4x4(&state->prevModelMatrix, deformable->GetModelMatrix());
+	state->prevDisplacementScale = g_app.g_fDisplacementScalar;
+	state->prevValid = true;
+}
+
+void IntersectGPU::InvalidateTemporalState(ModelInstance* deformable)
+{
+	auto it = m_temporalStates.find(deformable);
+	if (it != m_temporalStates.end())
+	{
+		TemporalIntersectState* state = it->second;
+		state->prevValid = false;
+		state->prevPenetrators.clear();
+
+		// the batch runs without candidates, its edits are known after the next max displacement readback
+		if (state->grid.IsValid())
+		{
+			if (state->pendingBatches.empty() || !state->pendingBatches.back().allPatches)
+			{
+				state->pendingBatches.push_back(TemporalIntersectState::PendingBatch());
+				state->pendingBatches.back().allPatches = true;
+				state->pendingBatches.back().displacementScale = g_app.g_fDisplacementScalar;
+			}
+			state->pendingBatches.back().serial = state->batchSerial++;
+		}
+	}
+}
+
+HRESULT IntersectGPU::ValidateTemporalIntersection(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize)
+{
+	HRESULT hr = S_OK;
+	TimingLog& log = g_app.g_TimingLog;
+	const UINT numPtexFaces = instance->GetOSDMesh()->GetNumPTexFaces();
+
+	// visibility of the incremental test, then the full test on the same obbs. the full result stays in the buffers
+	UINT* temporalVisibility = (UINT*)CreateAndCopyToDebugBuf(pd3dImmediateContext, instance->GetVisibility()->BUF);
+	ClearIntersectBuffer(instance);
+	hr = IntersectOSDBatch(pd3dImmediateContext, instance, batchSize);
+	UINT* fullVisibility = (UINT*)CreateAndCopyToDebugBuf(pd3dImmediateContext, instance->GetVisibility()->BUF);
+
+	UINT numMismatches = 0;
+	UINT firstMismatch = 0;
+	for (UINT i = 0; i < numPtexFaces; ++i)
+	{
+		if (temporalVisibility[i] == fullVisibility[i]) continue;
+		if (numMismatches == 0) firstMismatch = i;
+		numMismatches++;
+	}
+	delete[] temporalVisibility;
+	delete[] fullVisibility;
+
+	log.m_uTemporalValidated++;
+	if (numMismatches > 0)
+	{
+		log.m_uTemporalMismatches++;
+		std::cerr << "IntersectGPU::ValidateTemporalIntersection " << instance->GetOSDMesh()->GetName() << ": " << numMismatches << " / " << numPtexFaces
+				  << " tiles differ from the full test, first at " << firstMismatch << std::endl;
+		return E_FAIL;
+	}
+	return hr;
 }
 
 HRESULT IntersectGPU::UpdateIntersectCB( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance )
@@ -253,195 +727,43 @@ HRESULT IntersectGPU::UpdateIntersectCB( ID3D11DeviceContext1 *pd3dImmediateCont
 }
 
 
-HRESULT IntersectGPU::IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize)
+HRESULT IntersectGPU::IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates)
 {
 	HRESULT hr = S_OK;
 
 	PERF_EVENT_SCOPED(perf, L"Intersect OBB");
 
-	DXOSDMesh* mesh = instance->GetOSDMesh();
-
-	auto osdMesh = mesh->GetMesh();
-	//UINT strides = mesh->GetNumVertexElements();
+	IntersectInputs* inputs = NULL;
+	V_RETURN(GetInputs(g_computeBackend, instance, inputs));
 
-	const auto& patches = osdMesh->GetDrawContext()->patchArrays;
-
-	assert(instance->GetVisibility()->UAV);
-
-	ID3D11ShaderResourceView* ppSRV[] = { osdMesh->GetDrawContext()->vertexBufferSRV,				// t0 vertex buffer, float, numcomponents set in cb
-		osdMesh->GetDrawContext()->patchIndexBufferSRV,			// t1 index buffer			
-		osdMesh->GetDrawContext()->ptexCoordinateBufferSRV,		// t2 tile rotation info and patch to tile mapping
-		osdMesh->GetDrawContext()->vertexValenceBufferSRV,
-		osdMesh->GetDrawContext()->quadOffsetBufferSRV,
-		instance->GetMaxDisplacement()->SRV
-	};
-
-
-	ID3D11UnorderedAccessView* ppUAV[] = {  instance->GetVisibility()->UAV,							// u0 write per tile intersection result
-											instance->GetVisibilityAll()->UAV,
-	};
-
-	ID3D11UnorderedAccessView* ppRegularUAV[] = {
-											m_patchAppendRegular[0].UAV,
-		
-											#if DEFORMATION_BATCH_SIZE > 1
-											m_patchAppendRegular[1].UAV,		
-											#endif
-											#if DEFORMATION_BATCH_SIZE > 2
-											m_patchAppendRegular[2].UAV,		
-											#endif
-											#if DEFORMATION_BATCH_SIZE > 3
-											m_patchAppendRegular[3].UAV,		
-											#endif
-											#if DEFORMATION_BATCH_SIZE > 4
-											m_patchAppendRegular[4].UAV,		
-											#endif
-											#if DEFORMATION_BATCH_SIZE > 5
-											m_patchAppendRegular[5].UAV,		
-											#endif
-											#if DEFORMATION_BATCH_SIZE > 6
-											m_patchAppendRegular[6].UAV,		
-											#endif
-										#if DEFORMATION_BATCH_SIZE > 7
-											m_patchAppendRegular[7].UAV,		
-										#endif
-	};
-
-	ID3D11UnorderedAccessView* ppGregoryUAV[] = {											
-											m_patchAppendGregory[0].UAV,
-										#if DEFORMATION_BATCH_SIZE > 1											
-											m_patchAppendGregory[1].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 2											
-											m_patchAppendGregory[2].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 3											
-											m_patchAppendGregory[3].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 4											
-											m_patchAppendGregory[4].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 5											
-											m_patchAppendGregory[5].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 6											
-											m_patchAppendGregory[6].UAV,
-										#endif
-										#if DEFORMATION_BATCH_SIZE > 7											
-											m_patchAppendGregory[7].UAV,
-										#endif	
-	};
-
-	UINT uavCounterValsInit[] = { 0, 0, 0, 0, 0, 0,  0, 0,  0, 0,  0, 0};
-	UINT uavCounterValsInitDone[] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
-	pd3dImmediateContext->CSSetShaderResources(0, 6, ppSRV);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppUAV, uavCounterValsInit);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(2, batchSize, ppGregoryUAV, uavCounterValsInit);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(2, batchSize, ppRegularUAV, uavCounterValsInit);
-	
+	const bool onCPU = g_computeBackend->GetType() == ComputeBackendType::CPU;
+	IntersectResults reference;
+	if (onCPU)
+	{
+		// the control points and max displacements are written by the d3d11 stages every frame
+		V_RETURN(ReadbackInputs(instance, *inputs));
+		if (g_app.g_validateComputeBackend)
+			V_RETURN(RunReference(instance, batchSize, candidates, reference));
+	}
 
-	UINT numRuns = 1;
 	if (g_app.g_withPaintSculptTimings)
-	{
 		g_app.GPUPerfTimerStart(pd3dImmediateContext);
-		numRuns = 100;
-	}
-	bool isRegular = false;
 
+	UINT numDispatched = 0;
+	V_RETURN(DispatchIntersection(g_computeBackend, GetBindings(g_computeBackend), *inputs, instance->GetVisibilityCompute(), instance, batchSize, candidates, numDispatched));
 
-	for (UINT i = 0; i < numRuns; ++i)
+	if (onCPU)
 	{
-		for (const auto& patch : patches)
-		{
-			auto numPatches = patch.GetNumPatches();
-			if (numPatches == 0) continue;
-
-			if (	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::REGULAR
-				&&	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY)			
-				continue;
-
-			if (patch.GetDescriptor().GetType() == OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY)
-			{
-				pd3dImmediateContext->CSSetUnorderedAccessViews(2, batchSize, ppGregoryUAV, NULL);
-			}
-			else
-			{
-				pd3dImmediateContext->CSSetUnorderedAccessViews(2, batchSize, ppRegularUAV, NULL);
-			}
-
-			// Problem 1: we dont have end regular patches in opensubdiv
-			// opensubdiv packs patches in arrays by type(e.g. regular, boundary,...), pattern (no transition, transition 1..) and subpatches in patterns
-			// workaround: run intersection for each pattern only on subpatch 0
-			if (patch.GetDescriptor().GetSubPatch() > 0) continue;
-
-			//if(patch.GetDescriptor().GetType() == OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY)	continue;
-
-			isRegular = patch.GetDescriptor().GetType() == OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::REGULAR ? true : false;
-
-			IntersectConfig config;
-			config.value = 0; // resets all 
-			config.batch_size = batchSize;
-			config.face_mode = static_cast<unsigned int>(IntersectFaceType::OSD);
-			config.patch_type = isRegular ? static_cast<unsigned int>(IntersectPatchType::REGULAR) : static_cast<unsigned int>(IntersectPatchType::GREGORY);
-			config.isct_mode = static_cast<unsigned int>(m_intersectMode);
-			config.max_valence = patch.GetDescriptor().GetMaxValence();
-			config.all_active = m_setAllActive;
-			config.use_maxdisp = true;
-			m_isctMeshMaxValence = patch.GetDescriptor().GetMaxValence();
-			
-			BindShaders(pd3dImmediateContext, config, instance);
-
-			// Update config state	
-			{
-				assert(m_osdConfigCB);
-
-				D3D11_MAPPED_SUBRESOURCE MappedResource;
-				pd3dImmediateContext->Map(m_osdConfigCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource);
-				CB_OSDConfig * pData = (CB_OSDConfig*)MappedResource.pData;
-				//std::cout << "greg quad offset" << patch.GetQuadOffsetIndex() << std::endl;
-				//pData->TessLevel = static_cast<float>(int(g_app.g_fTessellationFactor+0.5f));
-				pData->GregoryQuadOffsetBase = patch.GetQuadOffsetIndex();
-				pData->PrimitiveIdBase = patch.GetPatchIndex();			// patch id for ptex/far table access
-				pData->IndexStart = patch.GetVertIndex();			// index of first control vertex in global index array							
-				pData->NumVertexComponents = mesh->GetNumVertexElements();	// for stride in vertex buffer			
-				pData->NumIndicesPerPatch = patch.GetDescriptor().GetNumControlVertices(); // how many indices per patch, todo set using define in shader
-				pData->NumPatches = numPatches;
-
-				pd3dImmediateContext->Unmap(m_osdConfigCB, 0);
-				pd3dImmediateContext->CSSetConstantBuffers(CB_LOC::OSD_DEFORMATION_CONFIG, 1, &m_osdConfigCB);
-			}
+		g_profiler.AddScopeValue(numDispatched);
 
-			//if(isRegular)
-			//{
-			//	if(m_intersectMode == IntersectMode::Brush)	
-			//		pd3dImmediateContext->CSSetShader(m_intersectBrush_OSD_CS->Get(), NULL, 0);
-			//	else
-			//		pd3dImmediateContext->CSSetShader(m_intersectOBB_OSD_CS->Get(), NULL, 0);
-			//}
-			//else
-			//{
-			//	// gregory
-			//	bool maxValenceLess11 = patch.GetDescriptor().GetMaxValence()<11 ? true : false;
-			//	if(m_intersectMode == IntersectMode::Brush)	
-			//	{
-			//		pd3dImmediateContext->CSSetShader(maxValenceLess11 ? m_intersectBrush_OSD_Irregular_CS->Get() : m_intersectBrush_OSD_Irregular_Valence_Greater_10_CS->Get() , NULL, 0);
-			//	}
-			//	else
-			//	{
-			//		pd3dImmediateContext->CSSetShader(maxValenceLess11 ? m_intersectOBB_OSD_CS->Get() : m_intersectOBB_OSD_Irregular_Valence_Greater_10_CS->Get(), NULL, 0);
-			//	}
-			//}		
-
-
-
-
-
-			//pd3dImmediateContext->Dispatch(numPatches,1,1);				// 1 patch per block
-			pd3dImmediateContext->Dispatch((numPatches + 1) / 2, 1, 1);	// 2 patches per block
-		}
-
-		pd3dImmediateContext->CSSetShaderResources(0, 6, g_ppSRVNULL);
-		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2+batchSize, g_ppUAVNULL, NULL);
+		// later stages read the results from the d3d11 buffers
+		V_RETURN(PushResults(instance, batchSize));
+		if (g_app.g_validateComputeBackend)
+			V_RETURN(ValidateComputeBackend(instance, batchSize, reference));
+	}
+	else
+	{
+		g_profiler.AddGPUScopeValue(numDispatched);
 	}
 
 	// TODO write compacted intersect buffer using append buffer
@@ -451,7 +773,7 @@ HRESULT IntersectGPU::IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateConte
 	{
 		g_app.GPUPerfTimerEnd(pd3dImmediateContext);
 		double elapsed = g_app.GPUPerfTimerElapsed(pd3dImmediateContext);
-		std::cout << "intersect time:" << elapsed / numRuns << "ms " << std::endl;
+		std::cout << "intersect time:" << elapsed << "ms " << std::endl;
 	}
 
 	//else
@@ -548,6 +870,294 @@ HRESULT IntersectGPU::IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateConte
 	return hr;
 }
 
+HRESULT IntersectGPU::GetInputs(ComputeBackend* backend, ModelInstance* instance, IntersectInputs*& inputs)
+{
+	HRESULT hr = S_OK;
+	auto& cache = m_inputs[static_cast<UINT>(backend->GetType())];
+	auto it = cache.find(instance);
+	if (it != cache.end())
+	{
+		inputs = &it->second;
+		return hr;
+	}
+
+	if (backend == &g_computeBackendD3D11)
+	{
+		auto drawContext = instance->GetOSDMesh()->GetMesh()->GetDrawContext();
+		IntersectInputs& wrapped = cache[instance];
+		wrapped.srv[IntersectInputs::VERTICES]			= WrapViewBuffer(drawContext->vertexBufferSRV, NULL);			// t0 vertex buffer, float, numcomponents set in cb
+		wrapped.srv[IntersectInputs::PATCH_INDICES]		= WrapViewBuffer(drawContext->patchIndexBufferSRV, NULL);		// t1 index buffer
+		wrapped.srv[IntersectInputs::PATCH_PARAMS]		= WrapViewBuffer(drawContext->ptexCoordinateBufferSRV, NULL);	// t2 tile rotation info and patch to tile mapping
+		wrapped.srv[IntersectInputs::VALENCES]			= WrapViewBuffer(drawContext->vertexValenceBufferSRV, NULL);
+		wrapped.srv[IntersectInputs::QUAD_OFFSETS]		= WrapViewBuffer(drawContext->quadOffsetBufferSRV, NULL);
+		wrapped.srv[IntersectInputs::MAX_DISPLACEMENT]	= WrapViewBuffer(instance->GetMaxDisplacement()->SRV, NULL);
+		wrapped.visibility		= WrapViewBuffer(instance->GetVisibility()->SRV, instance->GetVisibility()->UAV);
+		wrapped.visibilityAll	= WrapViewBuffer(instance->GetVisibilityAll()->SRV, instance->GetVisibilityAll()->UAV);
+		inputs = &wrapped;
+		return hr;
+	}
+
+	// cpu copies with the layout of the d3d11 buffers
+	IntersectInputs* source = NULL;
+	V_RETURN(GetInputs(&g_computeBackendD3D11, instance, source));
+
+	IntersectInputs& copy = cache[instance];
+	for (UINT i = 0; i < IntersectInputs::NUM_SRVS; ++i)
+	{
+		if (!source->srv[i]) continue;
+
+		const ComputeBufferDesc& desc = source->srv[i]->GetBufferDesc();
+		V_RETURN(backend->CreateBuffer(ComputeBufferDesc(desc.numElements, desc.stride, desc.format, COMPUTE_SRV), NULL, copy.srv[i]));
+
+		// the patch tables do not change, vertices and max displacement are copied before each batch
+		if (i != IntersectInputs::VERTICES && i != IntersectInputs::MAX_DISPLACEMENT)
+			V_RETURN(g_computeBackendD3D11.Readback(source->srv[i], ComputeBackendCPU::GetData(copy.srv[i]), desc.GetByteWidth()));
+	}
+	const ComputeBufferDesc& allDesc = source->visibilityAll->GetBufferDesc();
+	V_RETURN(backend->CreateBuffer(ComputeBufferDesc(allDesc.numElements, allDesc.stride, allDesc.format, COMPUTE_SRV | COMPUTE_UAV), NULL, copy.visibilityAll));
+
+	inputs = &copy;
+	return hr;
+}
+
+HRESULT IntersectGPU::ReadbackInputs(ModelInstance* instance, IntersectInputs& inputs)
+{
+	HRESULT hr = S_OK;
+	IntersectInputs* source = NULL;
+	V_RETURN(GetInputs(&g_computeBackendD3D11, instance, source));
+
+	const UINT perBatch[] = { IntersectInputs::VERTICES, IntersectInputs::MAX_DISPLACEMENT };
+	for (UINT i : perBatch)
+	{
+		if (!inputs.srv[i]) continue;
+		V_RETURN(g_computeBackendD3D11.Readback(source->srv[i], ComputeBackendCPU::GetData(inputs.srv[i]), inputs.srv[i]->GetBufferDesc().GetByteWidth()));
+	}
+
+	// cleared on the gpu by the overlap update
+	V_RETURN(g_computeBackendD3D11.Readback(source->visibilityAll, ComputeBackendCPU::GetData(inputs.visibilityAll), inputs.visibilityAll->GetBufferDesc().GetByteWidth()));
+	return hr;
+}
+
+HRESULT IntersectGPU::DispatchIntersection(ComputeBackend* backend, IntersectBindings& bindings, const IntersectInputs& inputs, ComputeResource* visibility,
+										   ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates, UINT& numDispatched)
+{
+	HRESULT hr = S_OK;
+
+	DXOSDMesh* mesh = instance->GetOSDMesh();
+	const auto& patches = mesh->GetMesh()->GetDrawContext()->patchArrays;
+
+	assert(visibility);
+
+	for (UINT i = 0; i < IntersectInputs::NUM_SRVS; ++i)
+		backend->SetSRV(i, inputs.srv[i]);
+	backend->SetSRV(6, candidates ? bindings.temporalCandidates : NULL);		// t6 candidate patches
+	backend->SetUAV(0, visibility);												// u0 write per tile intersection result
+	backend->SetUAV(1, inputs.visibilityAll);
+	for (uint32_t i = 0; i < batchSize; ++i)
+	{
+		// resets the append counters of both patch types
+		backend->SetUAV(2 + i, bindings.patchAppendGregory[i], 0);
+		backend->SetUAV(2 + i, bindings.patchAppendRegular[i], 0);
+	}
+	backend->SetConstantBuffer(CB_LOC::INTERSECT, bindings.obbBatchCB);
+	backend->SetConstantBuffer(CB_LOC::OSD_DEFORMATION_CONFIG, bindings.osdConfigCB);
+
+	for (const auto& patch : patches)
+	{
+		auto numPatches = patch.GetNumPatches();
+		if (numPatches == 0) continue;
+
+		const UINT arrayIndex = static_cast<UINT>(&patch - &patches[0]);
+
+		if (	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::REGULAR
+			&&	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY)			
+			continue;
+
+		const bool isRegular = patch.GetDescriptor().GetType() == OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::REGULAR;
+		for (uint32_t i = 0; i < batchSize; ++i)
+			backend->SetUAV(2 + i, isRegular ? bindings.patchAppendRegular[i] : bindings.patchAppendGregory[i]);
+
+		// Problem 1: we dont have end regular patches in opensubdiv
+		// opensubdiv packs patches in arrays by type(e.g. regular, boundary,...), pattern (no transition, transition 1..) and subpatches in patterns
+		// workaround: run intersection for each pattern only on subpatch 0
+		if (patch.GetDescriptor().GetSubPatch() > 0) continue;
+
+		// temporal mode: only the candidate patches of this array
+		if (candidates)
+		{
+			numPatches = candidates->arrayCount[arrayIndex];
+			if (numPatches == 0) continue;
+		}
+
+		IntersectConfig config;
+		config.value = 0; // resets all 
+		config.batch_size = batchSize;
+		config.face_mode = static_cast<unsigned int>(IntersectFaceType::OSD);
+		config.patch_type = isRegular ? static_cast<unsigned int>(IntersectPatchType::REGULAR) : static_cast<unsigned int>(IntersectPatchType::GREGORY);
+		config.isct_mode = static_cast<unsigned int>(m_intersectMode);
+		config.max_valence = patch.GetDescriptor().GetMaxValence();
+		config.all_active = m_setAllActive;
+		config.use_maxdisp = true;
+		config.temporal = candidates ? 1 : 0;
+		m_isctMeshMaxValence = patch.GetDescriptor().GetMaxValence();
+
+		ComputeKernel*& kernel = bindings.kernels[config.value];
+		if (!kernel)
+			V_RETURN(backend->CreateKernel(GetIntersectKernelDesc(config), kernel));
+		backend->SetKernel(kernel);
+
+		// Update config state	
+		{
+			CB_OSDConfig osdConfig;
+			ZeroMemory(&osdConfig, sizeof(CB_OSDConfig));
+			osdConfig.GregoryQuadOffsetBase = patch.GetQuadOffsetIndex();
+			osdConfig.PrimitiveIdBase = patch.GetPatchIndex();			// patch id for ptex/far table access
+			osdConfig.IndexStart = patch.GetVertIndex();				// index of first control vertex in global index array							
+			osdConfig.NumVertexComponents = mesh->GetNumVertexElements();	// for stride in vertex buffer			
+			osdConfig.NumIndicesPerPatch = patch.GetDescriptor().GetNumControlVertices(); // how many indices per patch, todo set using define in shader
+			osdConfig.NumPatches = numPatches;
+			osdConfig.CandidateOffset = candidates ? candidates->arrayOffset[arrayIndex] : 0;
+			osdConfig.NumCandidates = 0;
+			V_RETURN(backend->UpdateConstants(bindings.osdConfigCB, &osdConfig, sizeof(CB_OSDConfig)));
+		}
+
+		backend->Dispatch((numPatches + 1) / 2, 1, 1);	// 2 patches per block
+		numDispatched += numPatches;
+	}
+
+	backend->UnbindAll();
+	return hr;
+}
+
+HRESULT IntersectGPU::RunReference(ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates, IntersectResults& reference)
+{
+	HRESULT hr = S_OK;
+	ComputeBackendD3D11* d3d11 = &g_computeBackendD3D11;
+	IntersectBindings& bindings = GetBindings(d3d11);
+	const UINT numPtexFaces = instance->GetOSDMesh()->GetNumPTexFaces();
+
+	IntersectInputs* inputs = NULL;
+	V_RETURN(GetInputs(d3d11, instance, inputs));
+
+	// same obbs, candidates and initial visibility as the cpu dispatch
+	V_RETURN(d3d11->UpdateConstants(bindings.obbBatchCB, ComputeBackendCPU::GetData(GetBindings(&g_computeBackendCPU).obbBatchCB), sizeof(CB_IntersectOBBBatch)));
+	if (candidates)
+		V_RETURN(UploadTemporalCandidates(d3d11, *candidates));
+	V_RETURN(d3d11->Upload(inputs->visibility, ComputeBackendCPU::GetData(instance->GetVisibilityCompute()), numPtexFaces * sizeof(UINT)));
+
+	UINT numDispatched = 0;
+	V_RETURN(DispatchIntersection(d3d11, bindings, *inputs, inputs->visibility, instance, batchSize, candidates, numDispatched));
+
+	reference.visibility.resize(numPtexFaces);
+	V_RETURN(d3d11->Readback(inputs->visibility, &reference.visibility[0], numPtexFaces * sizeof(UINT)));
+
+	ComputeResource* counts = NULL;
+	V_RETURN(d3d11->CreateBuffer(ComputeBufferDesc(2 * DEFORMATION_BATCH_SIZE, sizeof(UINT), DXGI_FORMAT_R32_UINT, COMPUTE_SRV), NULL, counts));
+	for (uint32_t i = 0; i < batchSize; ++i)
+	{
+		d3d11->CopyStructureCount(counts, (2 * i + 0) * static_cast<UINT>(sizeof(UINT)), bindings.patchAppendRegular[i]);
+		d3d11->CopyStructureCount(counts, (2 * i + 1) * static_cast<UINT>(sizeof(UINT)), bindings.patchAppendGregory[i]);
+	}
+	UINT numAppended[2 * DEFORMATION_BATCH_SIZE];
+	hr = d3d11->Readback(counts, numAppended, sizeof(numAppended));
+	d3d11->DestroyResource(counts);
+	V_RETURN(hr);
+
+	std::vector<UINT> data;
+	for (uint32_t i = 0; i < batchSize; ++i)
+	{
+		for (UINT type = 0; type < 2; ++type)
+		{
+			ComputeResource* append = type == 0 ? bindings.patchAppendRegular[i] : bindings.patchAppendGregory[i];
+			const UINT stride = append->GetBufferDesc().stride / sizeof(UINT);
+			const UINT count = std::min(numAppended[2 * i + type], append->GetBufferDesc().numElements);
+
+			data.resize(std::max(1u, count * stride));
+			if (count > 0)
+				V_RETURN(d3d11->Readback(append, &data[0], count * stride * sizeof(UINT)));
+			SortPatches(&data[0], count, stride, reference.patches[type][i]);
+		}
+	}
+	return hr;
+}
+
+HRESULT IntersectGPU::ValidateComputeBackend(ModelInstance* instance, uint32_t batchSize, const IntersectResults& reference)
+{
+	TimingLog& log = g_app.g_TimingLog;
+	IntersectBindings& bindings = GetBindings(&g_computeBackendCPU);
+	const UINT numPtexFaces = instance->GetOSDMesh()->GetNumPTexFaces();
+
+	const UINT* visibility = reinterpret_cast<const UINT*>(ComputeBackendCPU::GetData(instance->GetVisibilityCompute()));
+	UINT numMismatches = 0;
+	UINT firstMismatch = 0;
+	for (UINT i = 0; i < numPtexFaces; ++i)
+	{
+		if (visibility[i] == reference.visibility[i]) continue;
+		if (numMismatches == 0) firstMismatch = i;
+		numMismatches++;
+	}
+
+	// the append order depends on the thread scheduling on both backends, the sorted contents have to match
+	UINT numListMismatches = 0;
+	std::vector<IntersectedPatch> patches;
+	for (uint32_t i = 0; i < batchSize; ++i)
+	{
+		for (UINT type = 0; type < 2; ++type)
+		{
+			ComputeResource* append = type == 0 ? bindings.patchAppendRegular[i] : bindings.patchAppendGregory[i];
+			const UINT count = std::min<UINT>(static_cast<ComputeResourceCPU*>(append)->m_counter, append->GetBufferDesc().numElements);
+			SortPatches(reinterpret_cast<const UINT*>(ComputeBackendCPU::GetData(append)), count, append->GetBufferDesc().stride / sizeof(UINT), patches);
+			if (patches != reference.patches[type][i])
+				numListMismatches++;
+		}
+	}
+
+	log.m_uComputeValidated++;
+	if (numMismatches > 0 || numListMismatches > 0)
+	{
+		log.m_uComputeMismatches++;
+		std::cerr << "IntersectGPU::ValidateComputeBackend " << instance->GetOSDMesh()->GetName() << ": " << numMismatches << " / " << numPtexFaces
+				  << " tiles differ from d3d11, first at " << firstMismatch << ", " << numListMismatches << " patch lists differ" << std::endl;
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+HRESULT IntersectGPU::PushResults(ModelInstance* instance, uint32_t batchSize)
+{
+	HRESULT hr = S_OK;
+	ComputeBackendD3D11* d3d11 = &g_computeBackendD3D11;
+	const IntersectBindings& src = GetBindings(&g_computeBackendCPU);
+	const IntersectBindings& dst = GetBindings(d3d11);
+	const UINT numPtexFaces = instance->GetOSDMesh()->GetNumPTexFaces();
+
+	IntersectInputs* cpuInputs = NULL;
+	IntersectInputs* inputs = NULL;
+	V_RETURN(GetInputs(&g_computeBackendCPU, instance, cpuInputs));
+	V_RETURN(GetInputs(d3d11, instance, inputs));
+
+	V_RETURN(d3d11->Upload(inputs->visibility, ComputeBackendCPU::GetData(instance->GetVisibilityCompute()), numPtexFaces * sizeof(UINT)));
+	V_RETURN(d3d11->Upload(inputs->visibilityAll, ComputeBackendCPU::GetData(cpuInputs->visibilityAll), cpuInputs->visibilityAll->GetBufferDesc().GetByteWidth()));
+
+	for (uint32_t i = 0; i < batchSize; ++i)
+	{
+		for (UINT type = 0; type < 2; ++type)
+		{
+			ComputeResource* from = type == 0 ? src.patchAppendRegular[i] : src.patchAppendGregory[i];
+			ComputeResource* to = type == 0 ? dst.patchAppendRegular[i] : dst.patchAppendGregory[i];
+			const UINT count = std::min<UINT>(static_cast<ComputeResourceCPU*>(from)->m_counter, from->GetBufferDesc().numElements);
+
+			if (count > 0)
+				V_RETURN(d3d11->Upload(to, ComputeBackendCPU::GetData(from), count * from->GetBufferDesc().stride));
+
+			// the deformation reads the number of patches from the append counter
+			d3d11->SetUAV(0, to, count);
+		}
+	}
+	d3d11->SetUAV(0, NULL);
+	return hr;
+}
+
 HRESULT IntersectGPU::CreateVisibilityBuffer( ID3D11Device1* pd3dDevice, UINT numTiles, ID3D11Buffer*& visibilityBUF, ID3D11ShaderResourceView*& visibilitySRV, ID3D11UnorderedAccessView*& visibilityUAV ) const
 {
 	HRESULT hr = S_OK;
@@ -615,28 +1225,15 @@ HRESULT IntersectGPU::CreateCompactedVisibilityBuffer( ID3D11Device1* pd3dDevice
 	return hr;
 }
 
-void IntersectGPU::BindShaders( ID3D11DeviceContext1* pd3dImmediateContext, const IntersectConfig effect, const ModelInstance* instance ) const
-{
-	const D3D11_INPUT_ELEMENT_DESC hInElementDesc[] = 	{		{"POSITION" , 0, DXGI_FORMAT_R32G32B32A32_FLOAT	, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}	};
-
-	ID3D11InputLayout* tmp = NULL;
-	EffectRegistryIntersect::ConfigType * config = g_intersectEffectRegistry.GetDrawConfig( effect, DXUTGetD3D11Device(),
-													&(const_cast<ID3D11InputLayout*>(tmp)), hInElementDesc, ARRAYSIZE(hInElementDesc));
-
-	SAFE_RELEASE(tmp);
-
-	pd3dImmediateContext->CSSetShader(config->computeShader->Get(),NULL, 0);
-
-}
-
 HRESULT IntersectGPU::SetAllActive( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance )
 {
 	HRESULT hr = S_OK;
 	m_setAllActive = true;
 	m_intersectMode = IntersectMode::NONE;
+	InvalidateTemporalState(instance);
 	if(instance->IsSubD())
 	{
-		ClearIntersectBuffer(pd3dImmediateContext, instance);
+		ClearIntersectBuffer(instance);
 
 		V_RETURN(IntersectOSDBatch(pd3dImmediateContext, instance,1));
 		
@@ -644,71 +1241,3 @@ HRESULT IntersectGPU::SetAllActive( ID3D11DeviceContext1 *pd3dImmediateContext,
 	m_setAllActive = false;
 	return hr;
 }
-
-EffectRegistryIntersect::ConfigType * EffectRegistryIntersect::_CreateDrawConfig( DescType const & desc, SourceConfigType const * sconfig, ID3D11Device1 * pd3dDevice, ID3D11InputLayout ** ppInputLayout, D3D11_INPUT_ELEMENT_DESC const * pInputElementDescs, int numInputElements ) const  // make const
-{
-	ConfigType * config = DrawRegistryBase::_CreateDrawConfig(desc.value, sconfig, pd3dDevice, ppInputLayout, pInputElementDescs, numInputElements);
-	assert(config);
-
-	return config;
-}
-
-EffectRegistryIntersect::SourceConfigType * EffectRegistryIntersect::_CreateDrawSourceConfig( DescType const & desc, ID3D11Device1 * pd3dDevice ) const// make const
-{
-	IntersectConfig effect = desc;
-
-	SourceConfigType * sconfig = DrawRegistryBase::_CreateDrawSourceConfig(desc.value, pd3dDevice);
-	assert(sconfig);
-
-
-	sconfig->commonConfig.common_render_hash = effect.value;
-	sconfig->value = effect.value;
-
-	const wchar_t* shaderFileOSD = L"shader/IntersectOSDCS.hlsl";
-
-	std::ostringstream ss;
-
-	if (effect.face_mode == (UINT)IntersectFaceType::OSD)
-	{
-		sconfig->computeShader.sourceFile = shaderFileOSD;
-
-		if (effect.isct_mode == (UINT)IntersectMode::Brush)
-		{
-			sconfig->computeShader.AddDefine("INTERSECT_BRUSH");
-
-		}
-		else if (effect.isct_mode == (UINT)IntersectMode::OBB)
-		{
-			sconfig->computeShader.AddDefine("INTERSECT_OBB");
-		}
-
-
-		if (effect.patch_type == (UINT)IntersectPatchType::GREGORY)
-		{
-			ss.str("");	ss << effect.max_valence;
-			sconfig->computeShader.AddDefine("OSD_MAX_VALENCE", ss.str());
-			sconfig->computeShader.entry = "IntersectGregoryCS";
-			sconfig->computeShader.AddDefine("TYPE_GREGORY");
-
-		}
-		else
-		{
-			sconfig->computeShader.entry = "IntersectRegularCS";
-		}
-
-		{
-			ss.str("");	ss << effect.batch_size;
-			sconfig->computeShader.AddDefine("BATCH_SIZE", ss.str());
-		}
-
-		if (effect.all_active)
-			sconfig->computeShader.AddDefine("SET_ALL_ACTIVE");
-
-		if(effect.use_maxdisp)
-		{
-			sconfig->computeShader.AddDefine("WITH_DYNAMIC_MAX_DISP");
-		}
-	}
-
-	return sconfig;
-}
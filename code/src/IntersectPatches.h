@@ -19,10 +19,16 @@
 #include <SDX/DXShaderManager.h>
 #include <SDX/DXBuffer.h>
 
+#include <map>
+
+#include "IntersectTemporal.h"
+#include "compute/ComputeBackend.h"
+
 // fwd decls
 class ModelInstance;
 class Brush;
 class DXObjectOrientedBoundingBox;
+struct IntersectResults;
 
 enum class IntersectMode
 {
@@ -52,6 +58,7 @@ union IntersectConfig{	// settings bitfield, check bit <32 to match int value fo
 		unsigned int all_active		: 1;
 		unsigned int batch_size		: 4;
 		unsigned int use_maxdisp    : 1;
+		unsigned int temporal		: 1;	// test only the candidate patches of the temporal mode
 	}; 
 
 	int value;
@@ -63,15 +70,32 @@ union IntersectConfig{	// settings bitfield, check bit <32 to match int value fo
 	}
 };
 
+// resources of the patch intersection kernels on one compute backend
+struct IntersectBindings
+{
+	IntersectBindings();
+
+	ComputeResource*				osdConfigCB;			// CB_OSDConfig
+	ComputeResource*				obbBatchCB;				// CB_IntersectOBBBatch
+	ComputeResource*				temporalCandidates;		// t6
+	UINT							temporalCandidatesCapacity;
+	ComputeResource*				patchAppendRegular[8];	// u2.., uint2 per intersected patch
+	ComputeResource*				patchAppendGregory[8];	// u2.., uint3 per intersected patch
+	std::map<int, ComputeKernel*>	kernels;				// IntersectRegularCS/IntersectGregoryCS variants by IntersectConfig value
+};
 
-class EffectRegistryIntersect: public TEffectDrawRegistry<IntersectConfig> {
+// inputs of the patch intersection kernels for one deformable
+// d3d11: non owning wrappers of the osd draw context and instance buffers
+// cpu: copies of these, the patch tables are read back once, the vertices, max displacement and visibilityAll before each batch
+struct IntersectInputs
+{
+	IntersectInputs();
 
-protected:
-	virtual ConfigType * _CreateDrawConfig(	DescType const & desc,	SourceConfigType const * sconfig,
-		ID3D11Device1 * pd3dDevice,	ID3D11InputLayout ** ppInputLayout,
-		D3D11_INPUT_ELEMENT_DESC const * pInputElementDescs, int numInputElements) const;
+	enum { VERTICES, PATCH_INDICES, PATCH_PARAMS, VALENCES, QUAD_OFFSETS, MAX_DISPLACEMENT, NUM_SRVS };	// t0..t5
 
-	virtual SourceConfigType *	_CreateDrawSourceConfig(DescType const & desc, ID3D11Device1 * pd3dDevice) const;
+	ComputeResource*	srv[NUM_SRVS];
+	ComputeResource*	visibility;			// u0, d3d11 only, the cpu kernels write ModelInstance::GetVisibilityCompute
+	ComputeResource*	visibilityAll;		// u1
 };
 
 class IntersectGPU{
@@ -85,7 +109,8 @@ public:
 	HRESULT IntersectOBBBatch(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, const std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>& batch );
 	HRESULT SetAllActive(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance);
 
-	void BindShaders( ID3D11DeviceContext1* pd3dImmediateContext, const IntersectConfig effect, const ModelInstance* instance) const ;
+	// drops the temporal state of a deformable, next batch runs the full test
+	void	InvalidateTemporalState(ModelInstance* deformable);
 		 
 	ID3D11UnorderedAccessView* GetIntersectedPatchesOSDRegularUAV(uint32_t i) const { return m_patchAppendRegular[i].UAV; }
 	ID3D11ShaderResourceView*  GetIntersectedPatchesOSDRegularSRV(uint32_t i) const { return m_patchAppendRegular[i].SRV; }
@@ -99,22 +124,54 @@ public:
 	HRESULT CreateCompactedVisibilityBuffer(ID3D11Device1* pd3dDevice, UINT numTiles, ID3D11Buffer*& visibilityBUF, ID3D11ShaderResourceView*& visibilitySRV, ID3D11UnorderedAccessView*& visibilityUAV) const;
 private:
 	HRESULT UpdateIntersectCB	(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance);
-	void	ClearIntersectBuffer(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance);
-	HRESULT IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize);
-
-	Shader<ID3D11ComputeShader>	*m_intersectClear_CS;
+	void	ClearIntersectBuffer(ModelInstance* instance);
+	HRESULT IntersectOSDBatch(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates = NULL);
+	// runs the intersection kernels of all patch arrays on a backend, returns the number of dispatched patches
+	HRESULT DispatchIntersection(ComputeBackend* backend, IntersectBindings& bindings, const IntersectInputs& inputs, ComputeResource* visibility,
+								 ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates, UINT& numDispatched);
+
+	IntersectBindings&	GetBindings(ComputeBackend* backend) { return m_bindings[static_cast<UINT>(backend->GetType())]; }
+	HRESULT CreateBindings(ComputeBackend* backend);
+	void	DestroyBindings(ComputeBackend* backend);
+	HRESULT GetInputs(ComputeBackend* backend, ModelInstance* instance, IntersectInputs*& inputs);
+	// cpu backend: copies the inputs written on the gpu since the last batch
+	HRESULT ReadbackInputs(ModelInstance* instance, IntersectInputs& inputs);
+	// cpu backend: writes visibility, visibilityAll and the append buffers with their counters to the d3d11 buffers of the later stages
+	HRESULT PushResults(ModelInstance* instance, uint32_t batchSize);
+	// g_validateComputeBackend: runs the batch on d3d11 before the cpu dispatch and reads back its results (stalls)
+	HRESULT RunReference(ModelInstance* instance, uint32_t batchSize, const TemporalCandidates* candidates, IntersectResults& reference);
+	HRESULT ValidateComputeBackend(ModelInstance* instance, uint32_t batchSize, const IntersectResults& reference);
+
+	// temporal mode: returns the candidates of the incremental test or NULL if the full test is required
+	const TemporalCandidates* GatherTemporalCandidates(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, const std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>& batch);
+	void	UpdateTemporalState(ModelInstance* deformable, const std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>& batch);
+	HRESULT UploadTemporalCandidates(ComputeBackend* backend, const TemporalCandidates& candidates);
+	void	ClearIntersectCandidates(ModelInstance* instance, const TemporalCandidates& candidates);
+	// maps the finished max displacement copies and drops the batches they cover
+	void	ResolveMaxDisplacement(ID3D11DeviceContext1 *pd3dImmediateContext, TemporalIntersectState* state);
+	// copies the max displacement to a staging buffer if batches were intersected since the last copy
+	void	CopyMaxDisplacement(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, TemporalIntersectState* state);
+	// g_validateTemporalIntersection: runs the full test after the incremental one and compares the visibility (stalls)
+	HRESULT ValidateTemporalIntersection(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, uint32_t batchSize);
+
+	// the intersection runs through g_computeBackend, on the cpu backend the d3d11 bindings receive the results
+	ComputeKernel				*m_intersectClearKernel;
+	ComputeKernel				*m_intersectClearCandidatesKernel;
+	ComputeResource				*m_clearConfigCB;		// CB_OSDConfig for the candidates clear
+	IntersectBindings			m_bindings[2];			// by ComputeBackendType
+	std::unordered_map<ModelInstance*, IntersectInputs>	m_inputs[2];
 
-	ID3D11Buffer				*m_osdConfigCB;			// constant buffer for osd patch config
 	ID3D11Buffer				*m_intersectModelCB;
-	ID3D11Buffer				*m_intersectOBBBatchCB;
 
 	DirectX::DXBufferSRVUAV	m_patchAppendRegular[8];
 	DirectX::DXBufferSRVUAV	m_patchAppendGregory[8];
 
+	// temporal mode
+	std::unordered_map<ModelInstance*, TemporalIntersectState*>	m_temporalStates;
+
 	IntersectMode				m_intersectMode;
 	unsigned int				m_isctMeshMaxValence;
 	bool						m_setAllActive;
 };
 
-extern IntersectGPU g_intersectGPU;
-extern EffectRegistryIntersect	g_intersectEffectRegistry;
\ No newline at end of file
+extern IntersectGPU g_intersectGPU;
\ No newline at end of file
@@ -0,0 +1,407 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "IntersectTemporal.h"
+
+#include "App.h"
+#include "scene/ModelInstance.h"
+#include "scene/DXSubDModel.h"
+
+#include <SDX/DXBuffer.h>
+
+using namespace DirectX;
+
+// obb space tolerance of the candidate test, the gpu transforms the control points, the cpu the patch bounds
+static const float OBB_TEST_EPSILON = 1e-4f;
+
+void ComputePenetratorBounds(const XMMATRIX& modelToOBB, TemporalIntersectState::PenetratorBounds& bounds)
+{
+	XMStoreFloat4x4(&bounds.modelToOBB, modelToOBB);
+
+	// obb space is the unit cube, see IntersectOSDCS.hlsl
+	XMMATRIX obbToModel = XMMatrixInverse(NULL, modelToOBB);
+	for (UINT i = 0; i < 8; ++i)
+	{
+		XMVECTOR c = XMVectorSet((i & 1) ? 1.f : 0.f, (i & 2) ? 1.f : 0.f, (i & 4) ? 1.f : 0.f, 1.f);
+		XMStoreFloat3(&bounds.corners[i], XMVector3TransformCoord(c, obbToModel));
+	}
+}
+
+PatchBoundsGrid::PatchBoundsGrid()
+{
+	m_numPtexFaces = 0;
+	m_maxPatchRadius = 0.f;
+	m_hasGregory = false;
+	m_maxDisplacementAll = 0.f;
+	m_displacementScale = 0.f;
+	m_stamp = 0;
+	m_gridMin = XMFLOAT3(0, 0, 0);
+	m_invCellSize = XMFLOAT3(1, 1, 1);
+	m_gridDim[0] = m_gridDim[1] = m_gridDim[2] = 1;
+}
+
+PatchBoundsGrid::~PatchBoundsGrid()
+{
+	Destroy();
+}
+
+void PatchBoundsGrid::Destroy()
+{
+	m_patchMin.clear();
+	m_patchMax.clear();
+	m_patchPtexFace.clear();
+	m_patchPrimitive.clear();
+	m_patchGregory.clear();
+	m_patchArray.clear();
+	m_arrayFirstPatch.clear();
+	m_cellStart.clear();
+	m_cellPatches.clear();
+	m_patchStamp.clear();
+	m_ptexStamp.clear();
+	m_queryPatches.clear();
+	m_queryPtexFaces.clear();
+	m_maxDisplacement.clear();
+	m_numPtexFaces = 0;
+	m_maxPatchRadius = 0.f;
+	m_hasGregory = false;
+	m_maxDisplacementAll = 0.f;
+	m_stamp = 0;
+}
+
+HRESULT PatchBoundsGrid::Create(ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* deformable)
+{
+	HRESULT hr = S_OK;
+	Destroy();
+
+	DXOSDMesh* mesh = deformable->GetOSDMesh();
+	auto osdMesh = mesh->GetMesh();
+	auto drawContext = osdMesh->GetDrawContext();
+	const auto& patches = drawContext->patchArrays;
+
+	// one time readback of the refined vertices and the patch tables, the control points of the deformable do not change at runtime
+	float* vertices		= (float*)CreateAndCopyToDebugBuf(pd3dImmediateContext, osdMesh->BindVertexBuffer());
+	UINT*  indices		= (UINT*)CreateAndCopyToDebugBuf(pd3dImmediateContext, drawContext->patchIndexBufferBUF);
+	UINT*  patchParam	= (UINT*)CreateAndCopyToDebugBuf(pd3dImmediateContext, drawContext->ptexCoordinateBuffer);
+	int*   valences		= drawContext->vertexValenceBuffer ? (int*)CreateAndCopyToDebugBuf(pd3dImmediateContext, drawContext->vertexValenceBuffer) : NULL;
+
+	const UINT stride = mesh->GetNumVertexElements();
+	m_numPtexFaces = mesh->GetNumPTexFaces();
+
+	XMVECTOR meshMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR meshMax = XMVectorReplicate(-FLT_MAX);
+
+	m_arrayFirstPatch.assign(patches.size(), 0);
+	for (UINT a = 0; a < patches.size(); ++a)
+	{
+		const auto& patch = patches[a];
+		m_arrayFirstPatch[a] = static_cast<UINT>(m_patchMin.size());
+
+		// same selection as IntersectGPU::IntersectOSDBatch
+		if (patch.GetNumPatches() == 0) continue;
+		if (	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::REGULAR
+			&&	patch.GetDescriptor().GetType() != OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY)
+			continue;
+		if (patch.GetDescriptor().GetSubPatch() > 0) continue;
+
+		const bool isGregory = patch.GetDescriptor().GetType() == OpenSubdiv::OPENSUBDIV_VERSION::FarPatchTables::GREGORY;
+		const UINT numCVs = patch.GetDescriptor().GetNumControlVertices();
+		const UINT valenceStride = 2 * patch.GetDescriptor().GetMaxValence() + 1;
+
+		if (isGregory && !valences)	continue;
+
+		for (UINT p = 0; p < (UINT)patch.GetNumPatches(); ++p)
+		{
+			XMVECTOR bbMin = XMVectorReplicate(FLT_MAX);
+			XMVECTOR bbMax = XMVectorReplicate(-FLT_MAX);
+
+			auto addVertex = [&](UINT v)
+			{
+				XMVECTOR pos = XMVectorSet(vertices[v*stride + 0], vertices[v*stride + 1], vertices[v*stride + 2], 0);
+				bbMin = XMVectorMin(bbMin, pos);
+				bbMax = XMVectorMax(bbMax, pos);
+			};
+
+			const UINT* cvs = &indices[patch.GetVertIndex() + numCVs * p];
+			for (UINT i = 0; i < numCVs; ++i)
+			{
+				addVertex(cvs[i]);
+				if (isGregory)
+				{
+					// gregory control points are built from the one ring of the corners
+					const int* vv = &valences[cvs[i] * valenceStride];
+					int valence = abs(vv[0]);
+					for (int k = 0; k < 2 * valence; ++k)
+						addVertex(vv[1 + k]);
+				}
+			}
+
+			if (isGregory)
+			{
+				// gregory edge/face points can slightly leave the one ring hull
+				XMVECTOR pad = XMVectorScale(XMVectorSubtract(bbMax, bbMin), 0.25f);
+				bbMin = XMVectorSubtract(bbMin, pad);
+				bbMax = XMVectorAdd(bbMax, pad);
+			}
+
+			meshMin = XMVectorMin(meshMin, bbMin);
+			meshMax = XMVectorMax(meshMax, bbMax);
+			m_maxPatchRadius = std::max(m_maxPatchRadius, 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(bbMax, bbMin))));
+
+			XMFLOAT3 fMin, fMax;
+			XMStoreFloat3(&fMin, bbMin);
+			XMStoreFloat3(&fMax, bbMax);
+			m_patchMin.push_back(fMin);
+			m_patchMax.push_back(fMax);
+			m_patchPtexFace.push_back(patchParam[2 * (patch.GetPatchIndex() + p) + 0]);
+			m_patchPrimitive.push_back(patch.GetPatchIndex() + p);
+			m_patchGregory.push_back(isGregory);
+			m_patchArray.push_back(a);
+			m_hasGregory |= isGregory;
+		}
+	}
+
+	delete[] vertices;
+	delete[] indices;
+	delete[] patchParam;
+	delete[] valences;
+
+	const UINT numPatches = GetNumPatches();
+	if (numPatches == 0)
+	{
+		std::cerr << "PatchBoundsGrid: no intersectable patches for " << mesh->GetName() << std::endl;
+		return E_FAIL;
+	}
+
+	// about one patch per cell, cells are cubes
+	XMFLOAT3 extent;
+	XMStoreFloat3(&extent, XMVectorMax(XMVectorSubtract(meshMax, meshMin), XMVectorReplicate(1e-4f)));
+	XMStoreFloat3(&m_gridMin, meshMin);
+
+	float cellSize = std::pow((extent.x * extent.y * extent.z) / (float)numPatches, 1.f / 3.f);
+	cellSize = std::max(cellSize, std::max(extent.x, std::max(extent.y, extent.z)) / 256.f);
+
+	m_gridDim[0] = std::max(1, std::min(256, (int)std::ceil(extent.x / cellSize)));
+	m_gridDim[1] = std::max(1, std::min(256, (int)std::ceil(extent.y / cellSize)));
+	m_gridDim[2] = std::max(1, std::min(256, (int)std::ceil(extent.z / cellSize)));
+	m_invCellSize = XMFLOAT3(m_gridDim[0] / extent.x, m_gridDim[1] / extent.y, m_gridDim[2] / extent.z);
+
+	// CSR: count, scan, fill
+	const UINT numCells = m_gridDim[0] * m_gridDim[1] * m_gridDim[2];
+	m_cellStart.assign(numCells + 1, 0);
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (UINT p = 0; p < numPatches; ++p)
+		{
+			int cMin[3], cMax[3];
+			GetCellRange(m_patchMin[p], m_patchMax[p], cMin, cMax);
+			for (int z = cMin[2]; z <= cMax[2]; ++z)
+			for (int y = cMin[1]; y <= cMax[1]; ++y)
+			for (int x = cMin[0]; x <= cMax[0]; ++x)
+			{
+				UINT cell = (z * m_gridDim[1] + y) * m_gridDim[0] + x;
+				if (pass == 0)	m_cellStart[cell + 1]++;
+				else			m_cellPatches[m_cellStart[cell]++] = p;
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (UINT c = 0; c < numCells; ++c)
+				m_cellStart[c + 1] += m_cellStart[c];
+			m_cellPatches.resize(m_cellStart[numCells]);
+		}
+		else
+		{
+			// fill pass advanced the starts by one cell
+			for (UINT c = numCells; c > 0; --c)
+				m_cellStart[c] = m_cellStart[c - 1];
+			m_cellStart[0] = 0;
+		}
+	}
+
+	m_patchStamp.assign(numPatches, 0);
+	m_ptexStamp.assign(m_numPtexFaces, 0);
+	m_stamp = 0;
+
+	// the max displacement buffer is cleared at creation, see ModelInstance
+	m_maxDisplacement.assign(m_numPtexFaces, 0.f);
+	m_maxDisplacementAll = 0.f;
+
+	std::cout << "PatchBoundsGrid: " << numPatches << " patches, grid " << m_gridDim[0] << "x" << m_gridDim[1] << "x" << m_gridDim[2]
+		<< ", " << m_cellPatches.size() << " refs" << std::endl;
+
+	return hr;
+}
+
+void PatchBoundsGrid::GetCellRange(const XMFLOAT3& bbMin, const XMFLOAT3& bbMax, int cellMin[3], int cellMax[3]) const
+{
+	const float* mn = &bbMin.x;
+	const float* mx = &bbMax.x;
+	const float* gridMin = &m_gridMin.x;
+	const float* invCell = &m_invCellSize.x;
+	for (int i = 0; i < 3; ++i)
+	{
+		cellMin[i] = std::max(0, std::min(m_gridDim[i] - 1, (int)std::floor((mn[i] - gridMin[i]) * invCell[i])));
+		cellMax[i] = std::max(0, std::min(m_gridDim[i] - 1, (int)std::floor((mx[i] - gridMin[i]) * invCell[i])));
+	}
+}
+
+void PatchBoundsGrid::UpdateMaxDisplacement(const float* maxDisplacement, UINT count)
+{
+	count = std::min(count, static_cast<UINT>(m_maxDisplacement.size()));
+	for (UINT i = 0; i < count; ++i)
+	{
+		m_maxDisplacement[i] = std::max(m_maxDisplacement[i], maxDisplacement[i]);
+		m_maxDisplacementAll = std::max(m_maxDisplacementAll, m_maxDisplacement[i]);
+	}
+}
+
+bool PatchBoundsGrid::OverlapsOBB(UINT p, const XMMATRIX& modelToOBB) const
+{
+	// same as the kernels: obb space aabb of the patch against the unit cube. the obb space aabb of the model space bounds
+	// contains the one of the bezier control points. regular patches are extended by their max displacement, the gregory kernel
+	// offsets its bounds by the displacement scale
+	XMVECTOR pMin = XMLoadFloat3(&m_patchMin[p]);
+	XMVECTOR pMax = XMLoadFloat3(&m_patchMax[p]);
+	XMVECTOR center = XMVector3TransformCoord(XMVectorScale(XMVectorAdd(pMin, pMax), 0.5f), modelToOBB);
+	XMVECTOR extent = XMVectorScale(XMVectorSubtract(pMax, pMin), 0.5f);
+	extent =	XMVectorAdd(XMVectorScale(XMVectorAbs(modelToOBB.r[0]), XMVectorGetX(extent)),
+				XMVectorAdd(XMVectorScale(XMVectorAbs(modelToOBB.r[1]), XMVectorGetY(extent)),
+							XMVectorScale(XMVectorAbs(modelToOBB.r[2]), XMVectorGetZ(extent))));
+
+	float displacement = 1.f;
+	if (!m_patchGregory[p])
+		displacement = m_patchPrimitive[p] < m_maxDisplacement.size() ? m_maxDisplacement[m_patchPrimitive[p]] : 0.f;
+	extent = XMVectorAdd(extent, XMVectorReplicate(m_displacementScale * displacement + OBB_TEST_EPSILON));
+
+	XMFLOAT3 bbMin, bbMax;
+	XMStoreFloat3(&bbMin, XMVectorSubtract(center, extent));
+	XMStoreFloat3(&bbMax, XMVectorAdd(center, extent));
+	return	bbMin.x <= 1.f && bbMin.y <= 1.f && bbMin.z <= 1.f &&
+			bbMax.x >= 0.f && bbMax.y >= 0.f && bbMax.z >= 0.f;
+}
+
+void PatchBoundsGrid::AddPatch(UINT p)
+{
+	m_patchStamp[p] = m_stamp;
+	m_queryPatches.push_back(p);
+
+	UINT face = m_patchPtexFace[p];
+	if (face < m_numPtexFaces && m_ptexStamp[face] != m_stamp)
+	{
+		m_ptexStamp[face] = m_stamp;
+		m_queryPtexFaces.push_back(face);
+	}
+}
+
+void PatchBoundsGrid::BeginQuery(TemporalCandidates& candidates, float displacementScale)
+{
+	m_displacementScale = displacementScale;
+	candidates.Reset(m_arrayFirstPatch.size());
+	m_queryPatches.clear();
+	m_queryPtexFaces.clear();
+
+	if (++m_stamp == 0)
+	{
+		// wrapped around
+		std::fill(m_patchStamp.begin(), m_patchStamp.end(), 0);
+		std::fill(m_ptexStamp.begin(), m_ptexStamp.end(), 0);
+		m_stamp = 1;
+	}
+}
+
+bool PatchBoundsGrid::AddRegion(const XMMATRIX& modelToOBB, UINT maxCandidates)
+{
+	// model space box of all patches which can pass the obb test: a point of the obb space patch aabb is at most
+	// sqrt(3) * (patch radius + padding) away from the patch center, the padding is scaled by the longest obb axis
+	XMMATRIX obbToModel = XMMatrixInverse(NULL, modelToOBB);
+	const float axisLength = std::max(XMVectorGetX(XMVector3Length(obbToModel.r[0])),
+							 std::max(XMVectorGetX(XMVector3Length(obbToModel.r[1])), XMVectorGetX(XMVector3Length(obbToModel.r[2]))));
+	const float maxPadding = m_displacementScale * std::max(m_maxDisplacementAll, m_hasGregory ? 1.f : 0.f) + OBB_TEST_EPSILON;
+	const XMVECTOR expand = XMVectorReplicate(1.7321f * (m_maxPatchRadius + maxPadding * axisLength));
+
+	XMVECTOR regionMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR regionMax = XMVectorReplicate(-FLT_MAX);
+	for (UINT i = 0; i < 8; ++i)
+	{
+		XMVECTOR c = XMVector3TransformCoord(XMVectorSet((i & 1) ? 1.f : 0.f, (i & 2) ? 1.f : 0.f, (i & 4) ? 1.f : 0.f, 1.f), obbToModel);
+		regionMin = XMVectorMin(regionMin, c);
+		regionMax = XMVectorMax(regionMax, c);
+	}
+	XMFLOAT3 bbMin, bbMax;
+	XMStoreFloat3(&bbMin, XMVectorSubtract(regionMin, expand));
+	XMStoreFloat3(&bbMax, XMVectorAdd(regionMax, expand));
+
+	// region completely outside the mesh
+	const XMFLOAT3 gridMax(	m_gridMin.x + m_gridDim[0] / m_invCellSize.x,
+							m_gridMin.y + m_gridDim[1] / m_invCellSize.y,
+							m_gridMin.z + m_gridDim[2] / m_invCellSize.z);
+	if (bbMax.x < m_gridMin.x || bbMax.y < m_gridMin.y || bbMax.z < m_gridMin.z ||
+		bbMin.x > gridMax.x   || bbMin.y > gridMax.y   || bbMin.z > gridMax.z)
+		return true;
+
+	int cMin[3], cMax[3];
+	GetCellRange(bbMin, bbMax, cMin, cMax);
+
+	for (int z = cMin[2]; z <= cMax[2]; ++z)
+	for (int y = cMin[1]; y <= cMax[1]; ++y)
+	for (int x = cMin[0]; x <= cMax[0]; ++x)
+	{
+		UINT cell = (z * m_gridDim[1] + y) * m_gridDim[0] + x;
+		for (UINT i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i)
+		{
+			UINT p = m_cellPatches[i];
+			if (m_patchStamp[p] == m_stamp) continue;
+
+			const XMFLOAT3& pMin = m_patchMin[p];
+			const XMFLOAT3& pMax = m_patchMax[p];
+			if (pMin.x > bbMax.x || pMin.y > bbMax.y || pMin.z > bbMax.z ||
+				pMax.x < bbMin.x || pMax.y < bbMin.y || pMax.z < bbMin.z)
+				continue;
+
+			if (OverlapsOBB(p, modelToOBB))
+				AddPatch(p);
+		}
+
+		if (m_queryPatches.size() > maxCandidates)
+			return false;
+	}
+
+	return true;
+}
+
+void PatchBoundsGrid::EndQuery(TemporalCandidates& candidates)
+{
+	// grid patch ids are ordered by patch array, sorting gives contiguous ranges
+	std::sort(m_queryPatches.begin(), m_queryPatches.end());
+
+	candidates.data.reserve(m_queryPtexFaces.size() + m_queryPatches.size());
+	candidates.data.insert(candidates.data.end(), m_queryPtexFaces.begin(), m_queryPtexFaces.end());
+	candidates.numPtexFaces = static_cast<UINT>(m_queryPtexFaces.size());
+	candidates.numPatches	= static_cast<UINT>(m_queryPatches.size());
+
+	for (UINT i = 0; i < m_queryPatches.size(); ++i)
+	{
+		UINT p = m_queryPatches[i];
+		UINT a = m_patchArray[p];
+		if (candidates.arrayCount[a] == 0)
+			candidates.arrayOffset[a] = static_cast<UINT>(candidates.data.size());
+		candidates.arrayCount[a]++;
+		candidates.data.push_back(p - m_arrayFirstPatch[a]);	// local patch id within the osd patch array
+	}
+}
@@ -0,0 +1,166 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+// fwd decls
+class ModelInstance;
+
+// candidate list for the incremental obb test
+// layout of data: [ptex faces to clear | patch ids of osd patch array 0 | patch ids of array 1 | ...]
+struct TemporalCandidates
+{
+	std::vector<UINT>	data;
+	UINT				numPtexFaces;
+	UINT				numPatches;
+	std::vector<UINT>	arrayOffset;	// per osd patch array, offset into data
+	std::vector<UINT>	arrayCount;		// per osd patch array, number of candidate patches
+
+	void Reset(size_t numArrays)
+	{
+		data.clear();
+		numPtexFaces = 0;
+		numPatches = 0;
+		arrayOffset.assign(numArrays, 0);
+		arrayCount.assign(numArrays, 0);
+	}
+};
+
+// model space bounds of all patches of an osd mesh which are processed by the intersection kernels (regular and gregory, subpatch 0),
+// binned into a uniform grid (CSR layout). Built once per deformable from a readback of the refined vertices and patch tables.
+// Queries run the test of IntersectRegularCS/IntersectGregoryCS in obb space on the patch bounds, extended by the per patch max
+// displacement of the last readback, so a patch is a candidate whenever the full test could select it.
+class PatchBoundsGrid
+{
+public:
+	PatchBoundsGrid();
+	~PatchBoundsGrid();
+
+	HRESULT Create(ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* deformable);
+	void	Destroy();
+
+	bool	IsValid()			const { return !m_patchMin.empty(); }
+	UINT	GetNumPatches()		const { return static_cast<UINT>(m_patchMin.size()); }
+
+	// merges a readback of the per patch max displacement of the deformable (ModelInstance::GetMaxDisplacement), the values only grow
+	void	UpdateMaxDisplacement(const float* maxDisplacement, UINT count);
+
+	// starts a new candidate gathering pass, displacementScale as in the intersection cb
+	void	BeginQuery(TemporalCandidates& candidates, float displacementScale);
+	// adds all patches the intersection kernels would select for the obb to the candidates, returns false if the candidate budget is exceeded
+	bool	AddRegion(const DirectX::XMMATRIX& modelToOBB, UINT maxCandidates);
+	// sorts candidates by patch array and writes the final layout
+	void	EndQuery(TemporalCandidates& candidates);
+
+private:
+	void	GetCellRange(const DirectX::XMFLOAT3& bbMin, const DirectX::XMFLOAT3& bbMax, int cellMin[3], int cellMax[3]) const;
+	bool	OverlapsOBB(UINT patch, const DirectX::XMMATRIX& modelToOBB) const;
+	void	AddPatch(UINT patch);
+
+	// per patch data, patches are ordered by osd patch array
+	std::vector<DirectX::XMFLOAT3>	m_patchMin;
+	std::vector<DirectX::XMFLOAT3>	m_patchMax;
+	std::vector<UINT>				m_patchPtexFace;
+	std::vector<UINT>				m_patchPrimitive;	// osd patch index, the max displacement is stored per patch index
+	std::vector<bool>				m_patchGregory;
+	std::vector<UINT>				m_patchArray;		// index into the osd patch array vector
+	std::vector<UINT>				m_arrayFirstPatch;	// first grid patch id per osd patch array
+	UINT							m_numPtexFaces;
+	float							m_maxPatchRadius;	// half diagonal of the largest patch bounds
+	bool							m_hasGregory;
+
+	// cpu copy of the max displacement buffer
+	std::vector<float>				m_maxDisplacement;
+	float							m_maxDisplacementAll;
+
+	// uniform grid
+	DirectX::XMFLOAT3				m_gridMin;
+	DirectX::XMFLOAT3				m_invCellSize;
+	int								m_gridDim[3];
+	std::vector<UINT>				m_cellStart;		// numCells+1
+	std::vector<UINT>				m_cellPatches;
+
+	// query state
+	float							m_displacementScale;
+	std::vector<UINT>				m_patchStamp;
+	std::vector<UINT>				m_ptexStamp;
+	UINT							m_stamp;
+	std::vector<UINT>				m_queryPatches;
+	std::vector<UINT>				m_queryPtexFaces;
+};
+
+// per deformable state of the temporal intersection mode
+struct TemporalIntersectState
+{
+	static const UINT MAX_DISP_FRAMES_IN_FLIGHT = 3;
+
+	struct PenetratorBounds
+	{
+		DirectX::XMFLOAT4X4	modelToOBB;		// as in CB_IntersectOBBBatch
+		DirectX::XMFLOAT3	corners[8];		// obb corners in deformable model space
+	};
+
+	// an intersection batch whose tile edits are not in a resolved max displacement readback yet. the edits only grow patches
+	// the batch intersected; querying its obbs again selects them, a patch grown by an earlier pending batch is selected by that one
+	struct PendingBatch
+	{
+		UINT								serial;
+		bool								allPatches;		// without temporal state or culling, any patch may have grown
+		float								displacementScale;
+		std::vector<DirectX::XMFLOAT4X4>	modelToOBB;
+	};
+
+	TemporalIntersectState() : prevValid(false), prevDisplacementScale(0.f), batchSerial(0), lastCopySerial(0), maxDispWriteSlot(0)
+	{
+		for (UINT i = 0; i < MAX_DISP_FRAMES_IN_FLIGHT; ++i)
+		{
+			maxDispStagingBUF[i] = NULL;
+			maxDispCopySerial[i] = 0;
+			maxDispPending[i] = false;
+		}
+	}
+	~TemporalIntersectState()
+	{
+		for (UINT i = 0; i < MAX_DISP_FRAMES_IN_FLIGHT; ++i)
+			SAFE_RELEASE(maxDispStagingBUF[i]);
+	}
+
+	PatchBoundsGrid											grid;
+	TemporalCandidates										candidates;
+
+	// obbs of the last batch which wrote the visibility buffer
+	std::unordered_map<ModelInstance*, PenetratorBounds>	prevPenetrators;
+	DirectX::XMFLOAT4X4										prevModelMatrix;
+	float													prevDisplacementScale;
+	bool													prevValid;
+
+	// asynchronous readback of the max displacement, a copy covers the edits of all batches before its serial
+	UINT													batchSerial;
+	UINT													lastCopySerial;
+	std::deque<PendingBatch>								pendingBatches;
+	ID3D11Buffer*											maxDispStagingBUF[MAX_DISP_FRAMES_IN_FLIGHT];
+	UINT													maxDispCopySerial[MAX_DISP_FRAMES_IN_FLIGHT];
+	bool													maxDispPending[MAX_DISP_FRAMES_IN_FLIGHT];
+	UINT													maxDispWriteSlot;
+};
+
+// stores the obb transform and the corners of the unit obb space cube in deformable model space
+void ComputePenetratorBounds(const DirectX::XMMATRIX& modelToOBB, TemporalIntersectState::PenetratorBounds& bounds);
@@ -17,6 +17,7 @@
 #include "MemoryManager.h"
 
 #include "App.h"
+#include "TileOverlapUpdater.h"
 #include "scene/ModelInstance.h"
 #include "scene/DXSubDModel.h"
 #include "utils/MathHelpers.h"
@@ -42,6 +43,14 @@ MemoryManager::MemoryManager()
 	m_memTableStateBUF				 = NULL;
 	m_memTableStateSRV				 = NULL;
 	m_memTableStateUAV				 = NULL;
+	for (UINT i = 0; i < TABLE_STATE_FRAMES_IN_FLIGHT; ++i)
+	{
+		m_memTableStateReadbackBUF[i] = NULL;
+		m_memTableStatePending[i]	  = false;
+		m_memTableStateFrame[i]		  = 0;
+	}
+	m_memTableStateWriteSlot		 = 0;
+	m_tilesUsed						 = 0;
 									 
 	m_cbMemManageTask				 = NULL;
 	m_memManageTaskBUF				 = NULL;
@@ -95,6 +104,8 @@ MemoryManager::MemoryManager()
 	m_scanOSDApplyBucketResultsColorCS		= NULL;
 	m_scanOSDApplyBucketResultsDisplacementCS= NULL;
 	m_allocOSDCS						= NULL;
+	m_allocTilesCS						= NULL;
+	m_allocTilesDirtyEdgesCS			= NULL;
 	m_deallocOSDCS						= NULL;
 									 
 	m_maxNumColorTiles				 = 0;
@@ -188,6 +199,8 @@ HRESULT MemoryManager::Create( ID3D11Device1* pd3dDevice )
 	initMemState.maxLocTileDisplacement = 0;
 	
 	V_RETURN(DXCreateBuffer(pd3dDevice, 0, sizeof(FreeMemoryTableState), D3D11_CPU_ACCESS_READ,  D3D11_USAGE_STAGING, m_memTableStateStagingBUF, &initMemState.curLocTileDisplacement)); 
+	for (UINT i = 0; i < TABLE_STATE_FRAMES_IN_FLIGHT; ++i)
+		V_RETURN(DXCreateBuffer(pd3dDevice, 0, sizeof(FreeMemoryTableState), D3D11_CPU_ACCESS_READ,  D3D11_USAGE_STAGING, m_memTableStateReadbackBUF[i]));
 
 	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, sizeof(FreeMemoryTableState),  0, D3D11_USAGE_DEFAULT, m_memTableStateBUF, &initMemState.curLocTileDisplacement,
 							  0, sizeof(FreeMemoryTableState)));
@@ -317,6 +330,8 @@ HRESULT MemoryManager::Create( ID3D11Device1* pd3dDevice )
 	m_allocOSDCS						= g_shaderManager.AddComputeShader(L"shader/MemoryManagerOSD.hlsl", "AllocateCS",					"cs_5_0", &pBlob);	// copy mem locs from stack to descriptor buffer
 
 	m_allocTilesCS = g_shaderManager.AddComputeShader(L"shader/TileMemory.hlsl", "AllocateTilesCS", "cs_5_0", &pBlob, macro_displacement_mode);	// copy mem locs from stack to descriptor buffer
+	D3D_SHADER_MACRO macro_displacement_dirty_edges[] = { {"DISPLACEMENT_MODE" , "1"}, {"WITH_DIRTY_EDGES" , "1"}, { 0 } };
+	m_allocTilesDirtyEdgesCS = g_shaderManager.AddComputeShader(L"shader/TileMemory.hlsl", "AllocateTilesCS", "cs_5_0", &pBlob, macro_displacement_dirty_edges);
 	//m_deallocOSDCS						= g_shaderManager.AddComputeShader(L"shader/MemoryManagerOSD.hlsl", "DeallocateCS",					"cs_5_0", &pBlob);	// copy mem locs from descriptor buffer to stack
 
 	SAFE_RELEASE(pBlob);
@@ -328,6 +343,11 @@ void MemoryManager::Destroy()
 {
 	// global
 	SAFE_RELEASE(m_memTableStateStagingBUF);
+	for (UINT i = 0; i < TABLE_STATE_FRAMES_IN_FLIGHT; ++i)
+	{
+		SAFE_RELEASE(m_memTableStateReadbackBUF[i]);
+		m_memTableStatePending[i] = false;
+	}
 	SAFE_RELEASE(m_memTableStateBUF);
 	SAFE_RELEASE(m_memTableStateSRV);
 	SAFE_RELEASE(m_memTableStateUAV);
@@ -408,10 +428,9 @@ void MemoryManager::Destroy()
 
 }
 
-HRESULT MemoryManager::PrintTableState()
+HRESULT MemoryManager::GetTableState(FreeMemoryTableState& tableState)
 {
 	HRESULT hr = S_OK;
-	FreeMemoryTableState tableState;
 	g_app.WaitForGPU();
 	DXUTGetD3D11DeviceContext()->CopyResource(m_memTableStateStagingBUF, m_memTableStateBUF);
 	g_app.WaitForGPU();
@@ -422,6 +441,114 @@ HRESULT MemoryManager::PrintTableState()
 	DXUTGetD3D11DeviceContext()->Unmap( m_memTableStateStagingBUF, 0 );
 	g_app.WaitForGPU();
 
+	return hr;
+}
+
+bool MemoryManager::MapTableState(ID3D11DeviceContext1* pd3dImmediateContext, UINT slot, bool wait)
+{
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	if (FAILED(pd3dImmediateContext->Map(m_memTableStateReadbackBUF[slot], 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &MappedResource)))
+		return false;	// still drawing
+
+	const UINT tilesUsed = static_cast<const FreeMemoryTableState*>(MappedResource.pData)->curLocTileDisplacement;
+	pd3dImmediateContext->Unmap(m_memTableStateReadbackBUF[slot], 0);
+	m_memTableStatePending[slot] = false;
+
+	// the table pointer only grows until the tile memory is reinitialized. tiles are only counted while the stages are timed,
+	// as work of the allocation scopes of the frame the copy was issued in
+	if (tilesUsed > m_tilesUsed && g_profiler.IsEnabled())
+		g_app.g_TimingLog.addTilesAllocated(m_memTableStateFrame[slot], tilesUsed - m_tilesUsed);
+	m_tilesUsed = tilesUsed;
+	return true;
+}
+
+void MemoryManager::ResolveAllocationStats(ID3D11DeviceContext1* pd3dImmediateContext, bool wait)
+{
+	// finished frames in submission order, the oldest frame in flight is at the write slot
+	for (UINT i = 0; i < TABLE_STATE_FRAMES_IN_FLIGHT; ++i)
+	{
+		const UINT slot = (m_memTableStateWriteSlot + i) % TABLE_STATE_FRAMES_IN_FLIGHT;
+		if (m_memTableStatePending[slot] && !MapTableState(pd3dImmediateContext, slot, wait))
+			break;
+	}
+
+	// all readback buffers in flight, the next copy covers the allocations of this frame too
+	if (m_memTableStatePending[m_memTableStateWriteSlot]) return;
+
+	const UINT slot = m_memTableStateWriteSlot;
+	pd3dImmediateContext->CopyResource(m_memTableStateReadbackBUF[slot], m_memTableStateBUF);
+	m_memTableStatePending[slot] = true;
+	m_memTableStateFrame[slot] = g_profiler.GetFrame();
+	m_memTableStateWriteSlot = (m_memTableStateWriteSlot + 1) % TABLE_STATE_FRAMES_IN_FLIGHT;
+
+	if (wait)
+		MapTableState(pd3dImmediateContext, slot, true);
+}
+
+HRESULT MemoryManager::SaveDisplacementTiles(ID3D11DeviceContext1* pd3dImmediateContext, const std::string& fileName)
+{
+	HRESULT hr = S_OK;
+	if (!m_dataTileDisplacementTEX) return E_FAIL;
+
+	FreeMemoryTableState tableState;
+	V_RETURN(GetTableState(tableState));
+
+	D3D11_TEXTURE2D_DESC desc;
+	m_dataTileDisplacementTEX->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	ID3D11Texture2D* stagingTEX = NULL;
+	V_RETURN(DXUTGetD3D11Device()->CreateTexture2D(&desc, NULL, &stagingTEX));
+	pd3dImmediateContext->CopyResource(stagingTEX, m_dataTileDisplacementTEX);
+
+	// written to a temporary file and moved in place once complete, a failed map does not leave a truncated file behind
+	const std::string tmpFileName = fileName + ".tmp";
+	std::ofstream file(tmpFileName.c_str(), std::ios::out | std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "SaveDisplacementTiles: could not open " << tmpFileName << std::endl;
+		SAFE_RELEASE(stagingTEX);
+		return E_FAIL;
+	}
+
+	// layout: FreeMemoryTableState, width, height, pages, dxgi format, bytes per texel, then all pages row by row
+	const UINT bpp = (desc.Format == DXGI_FORMAT_R16_FLOAT) ? 2 : 4;
+	const UINT header[] = { desc.Width, desc.Height, desc.ArraySize, static_cast<UINT>(desc.Format), bpp };
+	file.write(reinterpret_cast<const char*>(&tableState), sizeof(FreeMemoryTableState));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	for (UINT page = 0; page < desc.ArraySize; ++page)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		hr = pd3dImmediateContext->Map(stagingTEX, D3D11CalcSubresource(0, page, 1), D3D11_MAP_READ, 0, &mappedResource);
+		if (FAILED(hr)) break;
+		for (UINT y = 0; y < desc.Height; ++y)
+			file.write(reinterpret_cast<const char*>(mappedResource.pData) + y * mappedResource.RowPitch, desc.Width * bpp);
+		pd3dImmediateContext->Unmap(stagingTEX, D3D11CalcSubresource(0, page, 1));
+	}
+
+	if (SUCCEEDED(hr) && !file.good()) hr = E_FAIL;
+	file.close();
+	SAFE_RELEASE(stagingTEX);
+
+	if (FAILED(hr) || !MoveFileExA(tmpFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		std::cerr << "SaveDisplacementTiles: could not write " << fileName << std::endl;
+		DeleteFileA(tmpFileName.c_str());
+		return FAILED(hr) ? hr : E_FAIL;
+	}
+	return hr;
+}
+
+HRESULT MemoryManager::PrintTableState()
+{
+	HRESULT hr = S_OK;
+	FreeMemoryTableState tableState;
+	V_RETURN(GetTableState(tableState));
+
 	std::cout << "tableState" << std::endl;
 	std::cout << "displacement: \tcur loc: " << tableState.curLocTileDisplacement << ", maxLoc " <<  tableState.maxLocTileDisplacement << std::endl;
 	std::cout << "color: \t\tcur loc: " << tableState.curLocTileColor << ", maxLoc " <<  tableState.maxLocTileColor << std::endl;
@@ -1515,6 +1642,8 @@ HRESULT MemoryManager::Alloc(ID3D11DeviceContext1* pd3dImmediateContext, ModelIn
 	HRESULT hr = S_OK;
 
 
+	TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::ALLOCATION);	// work are the allocated tiles, see ResolveAllocationStats
+
 	if (g_app.g_withPaintSculptTimings)
 	{
 		g_app.GPUPerfTimerStart(pd3dImmediateContext);
@@ -1543,19 +1672,22 @@ HRESULT MemoryManager::AllocInternal(ID3D11DeviceContext1* pd3dImmediateContext,
 	// constant buffer update	
 	UpdateTileCB(pd3dImmediateContext, numTiles);
 
-	pd3dImmediateContext->CSSetShader(m_allocTilesCS->Get(), NULL, 0);
+	// the overlap of new tiles is empty, with the dirty edge overlap update they have to be marked like edited tiles
+	const bool dirtyEdges = g_overlapUpdater.UseDirtyEdges(instance);
+	pd3dImmediateContext->CSSetShader(dirtyEdges ? m_allocTilesDirtyEdgesCS->Get() : m_allocTilesCS->Get(), NULL, 0);
 
 	ID3D11ShaderResourceView* ppSRV[] = { instance->GetVisibility()->SRV, m_memoryTableTileDisplacementSRV };
-	ID3D11UnorderedAccessView* ppDisplUAVS[] = { instance->GetDisplacementTileLayout()->UAV, m_memTableStateUAV };
+	ID3D11UnorderedAccessView* ppDisplUAVS[] = { instance->GetDisplacementTileLayout()->UAV, m_memTableStateUAV, NULL,
+												 dirtyEdges ? instance->GetDirtyEdges()->UAV : NULL };	// u3 dirty edge mask
 
 	pd3dImmediateContext->CSSetShaderResources(0, 2, ppSRV);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppDisplUAVS, NULL);
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 4, ppDisplUAVS, NULL);
 		
 	UINT groupsPass1 = (numTiles + 32 - 1) / 32;
 	pd3dImmediateContext->Dispatch(groupsPass1, 1, 1); // CHECKME
 
 	pd3dImmediateContext->CSSetShaderResources(0, 2, g_ppSRVNULL);
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, g_ppUAVNULL, NULL);
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 4, g_ppUAVNULL, NULL);
 		
 	if (0)
 	{
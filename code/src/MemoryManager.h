@@ -96,6 +96,14 @@ public:
 	HRESULT UpdateMemTableStates(UINT newMaxNumDiplacementTiles =0u, UINT newMaxNumColorTiles=0u, UINT newMaxNumParticles=0u);
 
 	HRESULT	PrintTableState();
+	HRESULT GetTableState(FreeMemoryTableState& tableState);
+
+	// allocated displacement tiles as work of the allocation stage (TimingLog), once per frame after the allocation.
+	// the table state is copied to a staging buffer and mapped when done, wait maps all copies in flight
+	void	ResolveAllocationStats(ID3D11DeviceContext1* pd3dImmediateContext, bool wait = false);
+
+	// writes the table state and the displacement tile pages to a binary file (see SaveDisplacementTiles for the layout)
+	HRESULT SaveDisplacementTiles(ID3D11DeviceContext1* pd3dImmediateContext, const std::string& fileName);
 	HRESULT PrintTileInfo( ID3D11DeviceContext1* pd3dImmediateContext, UINT numTiles, ID3D11Buffer* tileInfoBUF) const;
 
 	// create tile info buffer for meshes
@@ -107,6 +115,7 @@ protected:
 	void	UpdateTileCB( ID3D11DeviceContext1* pd3dImmediateContext, UINT numPatches);
 	HRESULT ScanInternalOSD(ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* instance, bool paintMode);
 	HRESULT AllocInternal(ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* instance);
+	bool	MapTableState(ID3D11DeviceContext1* pd3dImmediateContext, UINT slot, bool wait);
 
 	HRESULT CreateTileMemoryTable(ID3D11Device1* pd3dDevice, ID3D11Buffer*& layoutBUF, ID3D11ShaderResourceView*& layoutSRV, ID3D11UnorderedAccessView*& layoutUAV,
 								  UINT numPages, UINT numTilesX, UINT numTilesY, UINT tileWidth, UINT tileHeight, bool withOverlap);
@@ -116,6 +125,13 @@ protected:
 	ID3D11ShaderResourceView	*m_memTableStateSRV;
 	ID3D11UnorderedAccessView	*m_memTableStateUAV;
 
+	static const UINT TABLE_STATE_FRAMES_IN_FLIGHT = 4;
+	ID3D11Buffer				*m_memTableStateReadbackBUF[TABLE_STATE_FRAMES_IN_FLIGHT];
+	bool						 m_memTableStatePending[TABLE_STATE_FRAMES_IN_FLIGHT];
+	UINT						 m_memTableStateFrame[TABLE_STATE_FRAMES_IN_FLIGHT];	// profiler frame of the copy
+	UINT						 m_memTableStateWriteSlot;			// next readback buffer, the oldest one in flight
+	UINT						 m_tilesUsed;						// displacement table pointer of the last mapped copy
+
 	ID3D11Buffer				*m_cbMemManageTask;					// task constant buffer
 	ID3D11Buffer				*m_memManageTaskBUF;				// task buffer writable from gpu
 	ID3D11ShaderResourceView	*m_memManageTaskSRV;
@@ -170,6 +186,7 @@ protected:
 	Shader<ID3D11ComputeShader> *m_deallocOSDCS						;
 
 	Shader<ID3D11ComputeShader> *m_allocTilesCS;
+	Shader<ID3D11ComputeShader> *m_allocTilesDirtyEdgesCS;		// also marks the edges and corners of the new tiles dirty for the overlap update
 	
 	UINT						 m_maxNumColorTiles;
 	UINT						 m_colorTileSize;					// tile width, height
@@ -0,0 +1,316 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "OverlapGatherPlan.h"
+#include "utils/WorkStealingPool.h"
+
+#include <algorithm>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const UINT GATHER_PLAN_GRAIN_FACES	= 1024;
+static const UINT GATHER_PLAN_GRAIN_RUNS	= 4096;
+
+namespace
+{
+
+// overlap texel a face writes along its edge, offset runs along the edge (edgeOffsetsDst in UpdateOverlap.hlsl), ts = tile size - 1
+void GetDstOffset(UINT edge, int offset, int ts, int& x, int& y)
+{
+	switch (edge)
+	{
+	case 0:		x = ts - offset;	y = -1;				break;
+	case 1:		x = -1;				y = offset;			break;
+	case 2:		x = offset;			y = ts + 1;			break;
+	default:	x = ts + 1;			y = ts - offset;	break;
+	}
+}
+
+// texel a neighbor provides along its edge, opposite winding (edgeOffsetsSrc in UpdateOverlap.hlsl)
+void GetSrcOffset(UINT edge, int offset, int ts, int& x, int& y)
+{
+	switch (edge)
+	{
+	case 0:		x = offset;			y = 0;				break;
+	case 1:		x = 0;				y = ts - offset;	break;
+	case 2:		x = ts - offset;	y = ts;				break;
+	default:	x = ts;				y = offset;			break;
+	}
+}
+
+void CopyRuns(const OverlapCopyRun* runs, UINT begin, UINT end, float* texels)
+{
+	for (UINT r = begin; r < end; ++r)
+	{
+		const OverlapCopyRun& run = runs[r];
+		INT64 src = run.src;
+		INT64 dst = run.dst;
+		for (UINT i = 0; i < run.count; ++i, src += run.srcStep, dst += run.dstStep)
+			texels[dst] = texels[src];
+	}
+}
+
+}
+
+OverlapGatherPlan::OverlapGatherPlan()
+{
+	m_tileSize = 0;
+	m_pageWidth = 0;
+	m_pageHeight = 0;
+	m_numTexels = 0;
+	m_numRebuiltFaces = 0;
+}
+
+HRESULT OverlapGatherPlan::Create( const std::vector<SPtexNeighborData>& neighbors, const std::vector<uint16_t>& tileLayout, UINT tileSize, UINT pageWidth, UINT pageHeight, UINT numPages )
+{
+	Destroy();
+
+	const UINT numPtexFaces = static_cast<UINT>(neighbors.size());
+	if (tileLayout.size() != numPtexFaces * 4 || tileSize == 0)
+		return E_INVALIDARG;
+
+	// runs address the texels with 32 bit
+	if (static_cast<UINT64>(pageWidth) * pageHeight * numPages > UINT_MAX)
+	{
+		std::cerr << "overlap gather plan: tile texture array of " << numPages << " pages " << pageWidth << "x" << pageHeight << " exceeds 32 bit texel addresses" << std::endl;
+		return E_INVALIDARG;
+	}
+
+	m_neighbors = neighbors;
+	m_tileLayout = tileLayout;
+	m_tileSize = tileSize;
+	m_pageWidth = pageWidth;
+	m_pageHeight = pageHeight;
+
+	// faces reading from a tile: edge runs of all neighbors, corner runs of the neighbors on their edge 0 and 2
+	m_readerOffsets.assign(numPtexFaces + 1, 0);
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		for (UINT e = 0; e < 4; ++e)
+		{
+			if (neighbors[ptexID].ptexIDNeighbor[e] >= 0)
+				m_readerOffsets[neighbors[ptexID].ptexIDNeighbor[e] + 1]++;
+		}
+	}
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+		m_readerOffsets[ptexID + 1] += m_readerOffsets[ptexID];
+
+	m_readers.resize(m_readerOffsets[numPtexFaces]);
+	std::vector<UINT> fill(m_readerOffsets.begin(), m_readerOffsets.end() - 1);
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		for (UINT e = 0; e < 4; ++e)
+		{
+			if (neighbors[ptexID].ptexIDNeighbor[e] >= 0)
+				m_readers[fill[neighbors[ptexID].ptexIDNeighbor[e]]++] = ptexID;
+		}
+	}
+
+	m_edgeRuns.resize(numPtexFaces * 4);
+	m_cornerRuns.resize(numPtexFaces * 4);
+	g_workStealingPool.ParallelFor(numPtexFaces, GATHER_PLAN_GRAIN_FACES, [this](UINT begin, UINT end)
+	{
+		for (UINT ptexID = begin; ptexID < end; ++ptexID)
+			BuildFaceRuns(ptexID);
+	});
+
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+		m_numTexels += GetNumFaceTexels(ptexID);
+	m_numRebuiltFaces = numPtexFaces;
+
+	return S_OK;
+}
+
+void OverlapGatherPlan::Destroy()
+{
+	m_neighbors.clear();
+	m_tileLayout.clear();
+	m_readerOffsets.clear();
+	m_readers.clear();
+	m_edgeRuns.clear();
+	m_cornerRuns.clear();
+	m_numTexels = 0;
+	m_numRebuiltFaces = 0;
+}
+
+UINT OverlapGatherPlan::Update( const std::vector<uint16_t>& tileLayout )
+{
+	assert(tileLayout.size() == m_tileLayout.size());
+
+	const UINT numPtexFaces = static_cast<UINT>(m_neighbors.size());
+
+	// page and tile start, the mip info does not move texels
+	std::vector<UINT> faces;
+	UINT numChanged = 0;
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		const uint16_t* slot = &tileLayout[ptexID * 4];
+		uint16_t* planSlot = &m_tileLayout[ptexID * 4];
+		if (slot[0] == planSlot[0] && slot[1] == planSlot[1] && slot[2] == planSlot[2])
+			continue;
+
+		std::copy(slot, slot + 4, planSlot);
+		faces.push_back(ptexID);
+		faces.insert(faces.end(), m_readers.begin() + m_readerOffsets[ptexID], m_readers.begin() + m_readerOffsets[ptexID + 1]);
+		numChanged++;
+	}
+
+	std::sort(faces.begin(), faces.end());
+	faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+
+	for (UINT ptexID : faces)
+	{
+		m_numTexels -= GetNumFaceTexels(ptexID);
+		BuildFaceRuns(ptexID);
+		m_numTexels += GetNumFaceTexels(ptexID);
+	}
+	m_numRebuiltFaces = static_cast<UINT>(faces.size());
+
+	return numChanged;
+}
+
+void OverlapGatherPlan::Execute( float* texels, bool parallel ) const
+{
+	const UINT numRuns = static_cast<UINT>(m_edgeRuns.size());
+	if (numRuns == 0) return;
+
+	// every face writes only its own overlap texels, edge runs read tile interiors and corner runs read edge overlap
+	if (parallel)
+	{
+		g_workStealingPool.ParallelFor(numRuns, GATHER_PLAN_GRAIN_RUNS, [this, texels](UINT begin, UINT end) { CopyRuns(&m_edgeRuns[0], begin, end, texels); });
+		g_workStealingPool.ParallelFor(numRuns, GATHER_PLAN_GRAIN_RUNS, [this, texels](UINT begin, UINT end) { CopyRuns(&m_cornerRuns[0], begin, end, texels); });
+	}
+	else
+	{
+		CopyRuns(&m_edgeRuns[0], 0, numRuns, texels);
+		CopyRuns(&m_cornerRuns[0], 0, numRuns, texels);
+	}
+}
+
+void OverlapGatherPlan::UpdateOverlapCPU( const std::vector<SPtexNeighborData>& neighbors, const std::vector<uint16_t>& tileLayout, UINT tileSize, UINT pageWidth, UINT pageHeight, float* texels )
+{
+	const UINT numPtexFaces = static_cast<UINT>(neighbors.size());
+	const int ts = static_cast<int>(tileSize) - 1;
+
+	auto isAllocated = [&tileLayout](int ptexID) { return ptexID >= 0 && tileLayout[ptexID * 4 + 0] != USHRT_MAX; };
+	auto texel = [&](int ptexID, int x, int y) -> float&
+	{
+		const uint16_t* slot = &tileLayout[ptexID * 4];
+		return texels[static_cast<UINT64>(slot[0]) * pageWidth * pageHeight + static_cast<UINT64>(slot[2] + y) * pageWidth + slot[1] + x];
+	};
+
+	// OverlapEdgesCS, one thread per face, edge and texel
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		for (UINT edge = 0; edge < 4; ++edge)
+		{
+			for (int offset = 0; offset <= ts; ++offset)
+			{
+				const int neighPtex = neighbors[ptexID].ptexIDNeighbor[edge];
+				if (!isAllocated(ptexID) || !isAllocated(neighPtex))
+					continue;
+
+				int dstX, dstY, srcX, srcY;
+				GetDstOffset(edge, offset, ts, dstX, dstY);
+				GetSrcOffset(neighbors[ptexID].neighEdgeID[edge], offset, ts, srcX, srcY);
+				texel(ptexID, dstX, dstY) = texel(neighPtex, srcX, srcY);
+			}
+		}
+	}
+
+	// OverlapCornersCS, 4 threads per face
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		for (UINT thread = 0; thread < 4; ++thread)
+		{
+			const UINT edge = (thread / 2) * 2;
+			const int neighPtex = neighbors[ptexID].ptexIDNeighbor[edge];
+			if (!isAllocated(ptexID) || !isAllocated(neighPtex))
+				continue;
+
+			const int offset = (thread % 2) * (ts + 2) - 1;
+			int dstX, dstY, srcX, srcY;
+			GetDstOffset(edge, offset, ts, dstX, dstY);
+			GetSrcOffset(neighbors[ptexID].neighEdgeID[edge], offset, ts, srcX, srcY);
+			texel(ptexID, dstX, dstY) = texel(neighPtex, srcX, srcY);
+		}
+	}
+}
+
+UINT OverlapGatherPlan::GetTexelAddress( UINT ptexID, int x, int y ) const
+{
+	const uint16_t* slot = &m_tileLayout[ptexID * 4];
+	return slot[0] * m_pageWidth * m_pageHeight + (slot[2] + y) * m_pageWidth + slot[1] + x;
+}
+
+OverlapCopyRun OverlapGatherPlan::MakeRun( UINT ptexID, UINT neighID, UINT edge, UINT neighEdge, int offset, UINT count ) const
+{
+	const int ts = static_cast<int>(m_tileSize) - 1;
+
+	int dstX, dstY, srcX, srcY, nextX, nextY;
+	OverlapCopyRun run;
+	GetDstOffset(edge, offset, ts, dstX, dstY);
+	GetDstOffset(edge, offset + 1, ts, nextX, nextY);
+	run.dst		= GetTexelAddress(ptexID, dstX, dstY);
+	run.dstStep	= (nextX - dstX) + (nextY - dstY) * static_cast<int>(m_pageWidth);
+
+	GetSrcOffset(neighEdge, offset, ts, srcX, srcY);
+	GetSrcOffset(neighEdge, offset + 1, ts, nextX, nextY);
+	run.src		= GetTexelAddress(neighID, srcX, srcY);
+	run.srcStep	= (nextX - srcX) + (nextY - srcY) * static_cast<int>(m_pageWidth);
+
+	run.count	= count;
+	return run;
+}
+
+void OverlapGatherPlan::BuildFaceRuns( UINT ptexID )
+{
+	OverlapCopyRun* edgeRuns = &m_edgeRuns[ptexID * 4];
+	OverlapCopyRun* cornerRuns = &m_cornerRuns[ptexID * 4];
+	std::fill(edgeRuns, edgeRuns + 4, OverlapCopyRun());
+	std::fill(cornerRuns, cornerRuns + 4, OverlapCopyRun());
+
+	// unlike the kernels unallocated tiles and boundary edges are skipped here
+	if (!IsAllocated(ptexID))
+		return;
+
+	const SPtexNeighborData& neigh = m_neighbors[ptexID];
+	for (UINT e = 0; e < 4; ++e)
+	{
+		const int neighPtex = neigh.ptexIDNeighbor[e];
+		if (neighPtex >= 0 && IsAllocated(neighPtex))
+			edgeRuns[e] = MakeRun(ptexID, neighPtex, e, neigh.neighEdgeID[e], 0, m_tileSize);
+	}
+
+	// corner texels are copied from the edge overlap of the neighbors on edge 0 and 2, one texel before and after the edge
+	for (UINT c = 0; c < 4; ++c)
+	{
+		const UINT e = (c / 2) * 2;
+		const int neighPtex = neigh.ptexIDNeighbor[e];
+		if (neighPtex >= 0 && IsAllocated(neighPtex))
+			cornerRuns[c] = MakeRun(ptexID, neighPtex, e, neigh.neighEdgeID[e], (c % 2) * (m_tileSize + 1) - 1, 1);
+	}
+}
+
+UINT OverlapGatherPlan::GetNumFaceTexels( UINT ptexID ) const
+{
+	UINT count = 0;
+	for (UINT i = 0; i < 4; ++i)
+		count += m_edgeRuns[ptexID * 4 + i].count + m_cornerRuns[ptexID * 4 + i].count;
+	return count;
+}
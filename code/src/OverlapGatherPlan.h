@@ -0,0 +1,84 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+
+#include "App.h"
+
+// one strided texel copy of the overlap update. texel addresses index the tile texture array as a flat float array
+// (page * pageWidth * pageHeight + y * pageWidth + x), steps are +-1 along a tile row and +-pageWidth along a column
+struct OverlapCopyRun
+{
+	OverlapCopyRun() : src(0), dst(0), srcStep(0), dstStep(0), count(0) {}
+
+	UINT	src;
+	UINT	dst;
+	INT		srcStep;
+	INT		dstStep;
+	UINT	count;		// tile size for edges, 1 for corners, 0 = nothing to copy (boundary edge or tile not allocated)
+};
+
+// gather plan of OverlapEdgesCS and OverlapCornersCS for one deformable. the neighbor rotations and tile slots the kernels
+// resolve per texel every frame are resolved once when the plan is built, executing it is a streaming copy of the runs.
+// every ptex face owns 4 edge and 4 corner runs in fixed slots, a changed tile slot only rebuilds the runs of the face and of
+// the faces reading from it. the extraordinary vertex equalization averages texels and is not part of the plan.
+class OverlapGatherPlan
+{
+public:
+	OverlapGatherPlan();
+
+	// tileLayout: 4 uint16 per face as written by the memory manager (page 0xffff = not allocated), tiles start after their overlap texel
+	HRESULT Create(const std::vector<SPtexNeighborData>& neighbors, const std::vector<uint16_t>& tileLayout, UINT tileSize, UINT pageWidth, UINT pageHeight, UINT numPages);
+	void	Destroy();
+
+	// compares the tile slots with the ones the plan was built for and rebuilds the runs reading or writing changed tiles,
+	// returns the number of changed tiles (0 = plan unchanged)
+	UINT	Update(const std::vector<uint16_t>& tileLayout);
+
+	// copies the overlap texels of all runs, edges before corners since the corners are read from the edge overlap of the neighbors
+	void	Execute(float* texels, bool parallel = true) const;
+
+	// cpu reference of OverlapEdgesCS and OverlapCornersCS on all faces, neighbor rotation and tile slots resolved per texel
+	static void UpdateOverlapCPU(const std::vector<SPtexNeighborData>& neighbors, const std::vector<uint16_t>& tileLayout, UINT tileSize, UINT pageWidth, UINT pageHeight, float* texels);
+
+	const std::vector<OverlapCopyRun>&	GetEdgeRuns()		const { return m_edgeRuns; }
+	const std::vector<OverlapCopyRun>&	GetCornerRuns()		const { return m_cornerRuns; }
+	UINT64								GetNumTexels()		const { return m_numTexels; }						// texels copied by Execute
+	UINT64								GetNumBytes()		const { return m_numTexels * 2 * sizeof(float); }	// read + write
+	UINT								GetNumRebuiltFaces()const { return m_numRebuiltFaces; }					// by the last Create/Update
+
+protected:
+	bool	IsAllocated(UINT ptexID) const	{ return m_tileLayout[ptexID * 4 + 0] != USHRT_MAX; }
+	UINT	GetTexelAddress(UINT ptexID, int x, int y) const;
+	OverlapCopyRun MakeRun(UINT ptexID, UINT neighID, UINT edge, UINT neighEdge, int offset, UINT count) const;
+	void	BuildFaceRuns(UINT ptexID);
+	UINT	GetNumFaceTexels(UINT ptexID) const;
+
+	std::vector<SPtexNeighborData>	m_neighbors;
+	std::vector<uint16_t>			m_tileLayout;		// tile slots the runs were built for
+	std::vector<UINT>				m_readerOffsets;	// csr ptex face -> faces with a run reading from its tile
+	std::vector<UINT>				m_readers;
+	std::vector<OverlapCopyRun>		m_edgeRuns;			// 4 per face, edge order of the kernels
+	std::vector<OverlapCopyRun>		m_cornerRuns;		// 4 per face, thread order of OverlapCornersCS
+
+	UINT							m_tileSize;
+	UINT							m_pageWidth;
+	UINT							m_pageHeight;
+	UINT64							m_numTexels;
+	UINT							m_numRebuiltFaces;
+};
@@ -18,6 +18,7 @@
 #include "Pipeline.h"
 #include "App.h"
 #include "dynamics/Physics.h"
+#include "dynamics/DeformablePairCache.h"
 
 #include "scene/ModelInstance.h"
 #include "scene/DXSubDModel.h"
@@ -31,173 +32,189 @@
 #include "TileOverlapUpdater.h"
 #include "Voxelization.h"
 
+#include "utils/WorkStealingPool.h"
+
+#include <unordered_map>
+
 DeformationPipeline g_deformationPipeline;
 
 #define VOXELIZE_COLLIDER_OBB
 
 using namespace DirectX;
 
-void DeformationPipeline::DetectDeformableCollisionPairs(Physics* physicsEngine, bool useCollisionsFromPhysics)
+// uniform in [0, 1], depends only on the seed and index and not on the thread that evaluates the pair
+static float JitterRandom(UINT seed, UINT index)
 {
-	m_deformablePenetratorPairs.clear();
+	UINT h = seed ^ (index * 0x9e3779b9u);
+	// murmur3 finalizer
+	h ^= h >> 16;	h *= 0x85ebca6bu;
+	h ^= h >> 13;	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return static_cast<float>(h >> 8) / static_cast<float>(0xffffff);
+}
+
+static UINT JitterSeed(const ModelInstance* deformable, const ModelInstance* penetrator, UINT frameIndex)
+{
+	return (deformable->GetGlobalInstanceID() * 0x8da6b343u) ^ (penetrator->GetGlobalInstanceID() * 0xd8163841u) ^ (frameIndex * 0xcb1ab31fu);
+}
+
+// obb of the penetrator used for voxelization and intersection, the jitter is seeded by the pair and the frame
+static bool ComputePenetratorOBB(ModelInstance* deformable, ModelInstance* penetrator, UINT frameIndex, DXObjectOrientedBoundingBox& obb)
+{
+#ifdef VOXELIZE_COLLIDER_OBB
+	DXObjectOrientedBoundingBox isctOBB = penetrator->GetOBBWorld();
+#else
+	DXObjectOrientedBoundingBox isctOBB = penetrator->GetOBBWorld().intersect(deformable->GetOBBWorld());
+#endif
+	if (!isctOBB.IsValid()) return false;
+
+	//D3D11ObjectOrientedBoundingBox colliderObbScaled = penetrator->GetOBBWorld();
+
+	const UINT seed = JitterSeed(deformable, penetrator, frameIndex);
+
+	if (g_app.g_withVoxelOBBRotate)
+	{
+		float r0 = (JitterRandom(seed, 0) - 0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
+		float r1 = (JitterRandom(seed, 1) - 0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
+		float r2 = (JitterRandom(seed, 2) - 0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
+		float f = 32.0f;// g_VoxelJitterRotateDivider;
+
+		r0 /= f; r1 /= f; r2 /= f;
+
+		XMMATRIX RV = (XMMatrixRotationRollPitchYaw(r0, r1, r2));
+		XMFLOAT4X4 R;
+		XMStoreFloat4x4(&R, RV);
+		DXObjectOrientedBoundingBox isctOBB2;
+		//isctOBB.GetTransformedRotateAxesOnly(Matrix4x4<float>((float*)&R.m[0]), isctOBB2);
+		isctOBB.GetTransformedRotateAxesOnly(RV, isctOBB2);
+		//isctOBB2.scale(1.05f); // TODO: fix scale
+
+		XMFLOAT3 corners[16];
+		isctOBB.GetCornerPoints(&corners[0]);
+		isctOBB2.GetCornerPoints(&corners[8]);
+		DXObjectOrientedBoundingBox isctOBB3(&corners[0], 16, isctOBB2);
+
+		isctOBB = isctOBB3;
+	}
+
+	if (g_app.g_withVoxelJittering)
+	{
+		//std::cout << "jitter range: " << 1.f/penetrator->GetVoxelGridDefinition().m_VoxelGridSize.z << std::endl;
+		float randScale = JitterRandom(seed, 3) / (0.5f + penetrator->GetVoxelGridDefinition().m_VoxelGridSize.z);//0.01;
+		//std::cout << randScale << std::endl;
+		isctOBB = isctOBB.scale(1.01f/*g_obbScaler*/ + randScale);
+	}
+	else
+	{
+		isctOBB = isctOBB.scale(1.01f/*g_obbScaler*/);
+	}
+
+	obb = isctOBB;
+	return true;
+}
 
-	if (useCollisionsFromPhysics)
+void DeformationPipeline::ExpandCachedPairs(const DeformablePairCache* pairCache)
+{
+	const std::vector<DeformableGroupPair>& groupPairs = pairCache->GetPairs();
+
+	m_cachedEntries.clear();
+	for (UINT i = 0; i < groupPairs.size(); ++i)
 	{
-		// Get collission pairs
-		int btNumPairs = physicsEngine->GetBroadPhase()->getOverlappingPairCache()->getNumOverlappingPairs();
-		//int btNumPairs = physicsEngine->GetDynamicsWorld()->getPairCache()->getNumOverlappingPairs();
+		const DeformableGroupPair& groupPair = groupPairs[i];
+		if (groupPair.bothDeformable)
+		{
+			// no instance pairs, checked again in DetectDeformableCollisionPairs
+			continue;
+		}
 
-		if (btNumPairs > 0)
+		// deformable is the deformable group
+		// penetrator can be an OpenSubDMesh or a DXModel - has to be voxelized
+		for (auto* deformable : groupPair.deformable->modelInstances)
 		{
-			//g_rendererAdaptive.SetWithCulling(g_app.g_useCulling);			
+			if (!(deformable->IsDeformable() && deformable->IsSubD()))	continue;
 
-			btBroadphasePair* btPairArray = physicsEngine->GetBroadPhase()->getOverlappingPairCache()->getOverlappingPairArrayPtr();			// Get the broadphase pair array
-			//btBroadphasePair* btPairArray = physicsEngine->GetDynamicsWorld()->getPairCache()->getOverlappingPairArrayPtr();
-			UINT numDeformableCollisions = 0;
-			for (int i = 0; i < btNumPairs; ++i)
+			// loop over penetrating meshes
+			for (auto* penetrator : groupPair.penetrator->modelInstances)
 			{
+				if (penetrator->IsDeformable()) continue;
+				if (penetrator->IsCollider() == false) continue;
+
+				CachedPenetratorEntry cached;
+				cached.entry.deformable = deformable;
+				cached.entry.penetrator = penetrator;
+				cached.groupPair = i;
+				m_cachedEntries.push_back(cached);
+			}
+		}
+	}
 
-				btBroadphasePair* btPair = &btPairArray[i];
-				//std::cout << "pairs: " << btNumPairs << "groups: " << g_scene->GetModelGroups().size()  << std::endl;
+	// entries of one deformable are batched together
+	std::stable_sort(m_cachedEntries.begin(), m_cachedEntries.end(), [](const CachedPenetratorEntry& a, const CachedPenetratorEntry& b)
+	{
+		return a.entry.deformable->GetGlobalInstanceID() < b.entry.deformable->GetGlobalInstanceID();
+	});
 
-				// Retrieve the userpointers - pointing to our mesh objects
-				ModelGroup* m0 = (ModelGroup*)((btCollisionObject*)(btPair->m_pProxy0->m_clientObject))->getUserPointer();
-				ModelGroup* m1 = (ModelGroup*)((btCollisionObject*)(btPair->m_pProxy1->m_clientObject))->getUserPointer();
+	m_pairCache = pairCache;
+	m_pairCacheVersion = pairCache->GetVersion();
+}
 
-				// Sanity check
-				if (m0 != NULL && m1 != NULL)
-				{
+void DeformationPipeline::DetectDeformableCollisionPairs(Physics* physicsEngine, bool useCollisionsFromPhysics)
+{
+	m_deformablePenetratorPairs.clear();
 
-					// Only allow cases m0->IsDeformable() XOR m1->IsDeformable() == true
-					if (m0->HasDeformables() && m1->HasDeformables())
-					{
-						//std::cerr << "m0 and m1 contain deformable, aborting";
-						//exit(1);
-					}
+	if (!useCollisionsFromPhysics) return;
 
-					if (!(m0->HasDeformables() || m1->HasDeformables()))
-						continue;
-					//std::cout << "collission: " << m0->GetName() << " with " << m1->GetName() << std::endl;
+	// group pairs are maintained by the pair cache callbacks, only changed pairs cost time here
+	DeformablePairCache* pairCache = physicsEngine->GetDeformablePairCache();
+	if (!pairCache->IsValid())
+		pairCache->Rebuild(physicsEngine->GetBroadPhase()->getOverlappingPairCache());
 
-					if (physicsEngine->GetDynamicsWorld()->getDispatcher()->needsCollision((btCollisionObject*)(btPair->m_pProxy0->m_clientObject), (btCollisionObject*)(btPair->m_pProxy1->m_clientObject)))
-					{
-						//if(m0 && m1)
-						//	std::cout << m0->GetName() << " needs collision with " << m1->GetName() << std::endl;
-					}
-					else
-					{
-						//std::cout << m0->GetName() << ", " << m1->GetName() << std::endl;
-						if (!(m0->IsSpecial() || m1->IsSpecial()))
-							continue;
-					}
+	if (pairCache != m_pairCache || pairCache->GetVersion() != m_pairCacheVersion)
+		ExpandCachedPairs(pairCache);
 
-					bool caseA = m0->HasDeformables() && !m1->HasDeformables();
-					bool caseB = m1->HasDeformables() && !m0->HasDeformables();
-					bool caseC = m0->HasDeformables() && m1->HasDeformables();
-					//std::cout << "m0: " << m0->GetName() << std::endl;
-					//std::cout << "m1: " << m1->GetName() << std::endl;
+	const std::vector<DeformableGroupPair>& groupPairs = pairCache->GetPairs();
+	if (groupPairs.empty()) return;
 
-					if (caseC)
-					{
-						//CHECKME DOES NOT WORK CURRENTLY with both deformables because opensubdiv meshes are not rendered 100% watertight near extraordinary vertices (gregory patches)
-						//ApplyDeformation(pd3dImmediateContext, m0, m1); // m0 deformable, m1 penetrator
-						std::cerr << "two deformables currently disabled" << std::endl;
-						exit(1);
-						//UpdateOverlap();
-						//ApplyDeformation(pd3dImmediateContext, m1, m0);   // m1 deformable, m0 penetrator
-					}
-					else //(caseA || caseB) 
-					{
-						if (caseB)
-						{
-							// caseA == caseB if we swap m0 and m1  for caseB
-							std::swap(m0, m1);
-						}
-						// m0 is the deformable object
-						// m1 is the penetrator - can be an OpenSubDMesh or a DXModel - m1 has to be voxelized
-
-						// todo: support both groups contain deformables
-						for (auto* deformable : m0->modelInstances)
-						{
-							if (!(deformable->IsDeformable() && deformable->IsSubD()))	continue;
-
-
-							// loop over penetrating meshes
-							for (auto* penetrator : m1->modelInstances)
-							{
-
-								if (penetrator->IsDeformable()) continue;
-								if (penetrator->IsCollider() == false) continue;
-								numDeformableCollisions++;
-
-#ifdef VOXELIZE_COLLIDER_OBB								
-								DXObjectOrientedBoundingBox isctOBB = penetrator->GetOBBWorld();
-#else
-								DXObjectOrientedBoundingBox isctOBB = penetrator->GetOBBWorld().intersect(deformable->GetOBBWorld());
-#endif
-								if (!isctOBB.IsValid()) continue;
-
-								//D3D11ObjectOrientedBoundingBox colliderObbScaled = penetrator->GetOBBWorld();
-
-								if (g_app.g_withVoxelOBBRotate)
-								{
-									float r0 = (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)-0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
-									float r1 = (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)-0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
-									float r2 = (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)-0.5f) * 2.0f * (float)M_PI; // -M_PI .. +M_PI
-									float f = 32.0f;// g_VoxelJitterRotateDivider;
-
-									r0 /= f; r1 /= f; r2 /= f;
-
-									XMMATRIX RV = (XMMatrixRotationRollPitchYaw(r0, r1, r2));
-									XMFLOAT4X4 R;
-									XMStoreFloat4x4(&R, RV);
-									DXObjectOrientedBoundingBox isctOBB2;
-									//isctOBB.GetTransformedRotateAxesOnly(Matrix4x4<float>((float*)&R.m[0]), isctOBB2);
-									isctOBB.GetTransformedRotateAxesOnly(RV, isctOBB2);
-									//isctOBB2.scale(1.05f); // TODO: fix scale
-
-									XMFLOAT3 corners[16];
-									isctOBB.GetCornerPoints(&corners[0]);
-									isctOBB2.GetCornerPoints(&corners[8]);
-									DXObjectOrientedBoundingBox isctOBB3(&corners[0], 16, isctOBB2);
-
-									isctOBB = isctOBB3;
-								}
-
-								if (g_app.g_withVoxelJittering)
-								{
-									//std::cout << "jitter range: " << 1.f/penetrator->GetVoxelGridDefinition().m_VoxelGridSize.z << std::endl;
-									float randScale = static_cast<float>(rand()) / static_cast<float>(RAND_MAX) / (0.5f + penetrator->GetVoxelGridDefinition().m_VoxelGridSize.z);//0.01;
-									//std::cout << randScale << std::endl;
-									isctOBB = isctOBB.scale(1.01f/*g_obbScaler*/ + randScale);
-								}
-								else
-								{
-									isctOBB = isctOBB.scale(1.01f/*g_obbScaler*/);
-								}
-
-								if (m_deformablePenetratorPairs.find(deformable) == m_deformablePenetratorPairs.end())
-								{
-									std::unordered_map < ModelInstance*, DXObjectOrientedBoundingBox > penetratorEntry;
-									penetratorEntry[penetrator] = isctOBB;
-									m_deformablePenetratorPairs[deformable] = penetratorEntry;
-								}
-								else
-								{
-									m_deformablePenetratorPairs[deformable][penetrator] = isctOBB;
-								}
-
-
-
-
-							}// end loop penetrators
-						}// end deformable loop
-					} // end 					
-				}
-			}
-			//g_rendererAdaptive.SetWithCulling(false);
-			//std::cout << "num deformable collisions: " << numDeformableCollisions << std::endl;
+	// sleeping bodies and collision filters can change every frame
+	btDispatcher* dispatcher = physicsEngine->GetDynamicsWorld()->getDispatcher();
+	m_groupPairActive.resize(groupPairs.size());
+	for (size_t i = 0; i < groupPairs.size(); ++i)
+	{
+		const DeformableGroupPair& groupPair = groupPairs[i];
+		bool active = dispatcher->needsCollision((btCollisionObject*)(groupPair.proxy0->m_clientObject), (btCollisionObject*)(groupPair.proxy1->m_clientObject));
+		if (!active)
+			active = groupPair.deformable->IsSpecial() || groupPair.penetrator->IsSpecial();
+
+		if (active && groupPair.bothDeformable)
+		{
+			//CHECKME DOES NOT WORK CURRENTLY with both deformables because opensubdiv meshes are not rendered 100% watertight near extraordinary vertices (gregory patches)
+			std::cerr << "two deformables currently disabled" << std::endl;
+			exit(1);
 		}
+		m_groupPairActive[i] = active ? 1 : 0;
+	}
+
+	// update the cached obbs of the active pairs in parallel ranges, the merge keeps the deformable order
+	const UINT grainSize = 64;
+	const UINT numEntries = static_cast<UINT>(m_cachedEntries.size());
+	std::vector<BYTE> entryValid(numEntries, 0);
+
+	g_workStealingPool.ParallelFor(numEntries, grainSize, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			CachedPenetratorEntry& cached = m_cachedEntries[i];
+			if (!m_groupPairActive[cached.groupPair]) continue;
+
+			if (ComputePenetratorOBB(cached.entry.deformable, cached.entry.penetrator, m_frameIndex, cached.entry.obb))
+				entryValid[i] = 1;
+		}
+	});
+
+	for (UINT i = 0; i < numEntries; ++i)
+	{
+		if (entryValid[i])
+			m_deformablePenetratorPairs.push_back(m_cachedEntries[i].entry);
 	}
 }
 
@@ -207,37 +224,57 @@ void DeformationPipeline::CheckAndApplyDeformation(ID3D11Device1* pd3dDevice, ID
 {
 	int numVoxelizedLastRun = 0;
 
+	// next frame gets new obb jitter
+	m_frameIndex++;
+
 	// batch process deformation
 	const uint32_t maxBatchSize = XMMin(6, DEFORMATION_BATCH_SIZE);
 
-	for (auto& deformationPair : m_deformablePenetratorPairs)
-	{
-		ModelInstance* deformable = deformationPair.first;
+	typedef std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox> DeformationBatch;
 
-		// build batches for each deformable
-		std::vector<std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>> deformationBatches(1);
-		uint32_t currBatch = 0;
+	// ranges of consecutive entries with the same deformable
+	std::vector<std::pair<UINT, UINT>> deformableRanges;
+	for (UINT i = 0; i < m_deformablePenetratorPairs.size(); ++i)
+	{
+		if (deformableRanges.empty() || m_deformablePenetratorPairs[deformableRanges.back().first].deformable != m_deformablePenetratorPairs[i].deformable)
+			deformableRanges.push_back(std::make_pair(i, i));
+		deformableRanges.back().second = i + 1;
+	}
 
-		for (auto& penetratorMap : deformationPair.second)
+	// build batches for each deformable on the pool, the d3d work below stays on the render thread
+	std::vector<std::vector<DeformationBatch>> batchesPerDeformable(deformableRanges.size());
+	g_workStealingPool.ParallelFor(static_cast<UINT>(deformableRanges.size()), 1, [&](UINT begin, UINT end)
+	{
+		for (UINT d = begin; d < end; ++d)
 		{
-			ModelInstance* penetrator = penetratorMap.first;
-			DXObjectOrientedBoundingBox isctOBB = penetratorMap.second;
+			std::vector<DeformationBatch>& deformationBatches = batchesPerDeformable[d];
+			deformationBatches.resize(1);
+			uint32_t currBatch = 0;
 
-			// add new batch if if current batch is filled
-			if (deformationBatches[currBatch].size() >= maxBatchSize)
+			for (UINT i = deformableRanges[d].first; i < deformableRanges[d].second; ++i)
 			{
-				deformationBatches.push_back(std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>());
-				currBatch++;
-			}
+				// add new batch if if current batch is filled
+				if (deformationBatches[currBatch].size() >= maxBatchSize)
+				{
+					deformationBatches.push_back(DeformationBatch());
+					currBatch++;
+				}
 
-			deformationBatches[currBatch][penetrator] = isctOBB;
+				deformationBatches[currBatch][m_deformablePenetratorPairs[i].penetrator] = m_deformablePenetratorPairs[i].obb;
+			}
 		}
+	});
+
+	for (size_t d = 0; d < deformableRanges.size(); ++d)
+	{
+		ModelInstance* deformable = m_deformablePenetratorPairs[deformableRanges[d].first].deformable;
+		const std::vector<DeformationBatch>& deformationBatches = batchesPerDeformable[d];
 
 
 		// process deformation batches		
 		if (g_app.g_useCulling)
 		{
-			for (auto penetratorMap : deformationBatches)
+			for (const auto& penetratorMap : deformationBatches)
 			{
 				if (deformable->IsSubD())
 				{
@@ -291,6 +328,10 @@ void DeformationPipeline::CheckAndApplyDeformation(ID3D11Device1* pd3dDevice, ID
 
 		}
 	}
+
+	// counters of the edits and allocations of this frame, maps the finished earlier frames
+	g_deformation.ResolveStats(pd3dImmediateContext);
+	g_memoryManager.ResolveAllocationStats(pd3dImmediateContext);
 }
 
 HRESULT DeformationPipeline::Create(ID3D11Device1* pd3dDevice)
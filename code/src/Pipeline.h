@@ -14,30 +14,57 @@
 //
 
 #pragma once
-#include <unordered_map>
+#include <vector>
+
+#include <SDX/DXObjectOrientedBoundingBox.h>
 
 class ModelInstance;
-class DXObjectOrientedBoundingBox;
 class Physics;
+class DeformablePairCache;
+
 
+// deformable/penetrator instance pair with the obb used for voxelization and intersection
+struct DeformablePenetratorEntry
+{
+	ModelInstance*					deformable;
+	ModelInstance*					penetrator;
+	DXObjectOrientedBoundingBox		obb;
+};
 
-typedef std::unordered_map<ModelInstance*, std::unordered_map<ModelInstance*, DXObjectOrientedBoundingBox>> DeformableCollisionPair;
+// flat, entries of the same deformable are consecutive
+typedef std::vector<DeformablePenetratorEntry> DeformableCollisionPairs;
 
 class DeformationPipeline
 {
 public:
-	DeformationPipeline(){};
+	DeformationPipeline() : m_pairCache(NULL), m_pairCacheVersion(0), m_frameIndex(0) {};
 	~DeformationPipeline(){};
 	HRESULT Create(ID3D11Device1* pd3dDevice);
 	void Destroy();
 
-	const DeformableCollisionPair& GetCollisionPairs() { return m_deformablePenetratorPairs; };
+	const DeformableCollisionPairs& GetCollisionPairs() { return m_deformablePenetratorPairs; };
 	void DetectDeformableCollisionPairs(Physics* physicsEngine, bool useCollisionsFromPhysics);
 	void CheckAndApplyDeformation(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext);
 
 protected:
+	// instance pair of a group pair tracked by the physics pair cache
+	struct CachedPenetratorEntry
+	{
+		DeformablePenetratorEntry	entry;			// obb is updated in the frames the group pair needs collision
+		UINT						groupPair;		// index into the pair cache
+	};
+
+	void ExpandCachedPairs(const DeformablePairCache* pairCache);
+
+	DeformableCollisionPairs		m_deformablePenetratorPairs;
+
+	// instance pairs of the pair cache sorted by deformable, expanded again only when the cached group pairs change
+	std::vector<CachedPenetratorEntry>	m_cachedEntries;
+	std::vector<BYTE>					m_groupPairActive;
+	const DeformablePairCache*			m_pairCache;
+	UINT								m_pairCacheVersion;
 
-	DeformableCollisionPair m_deformablePenetratorPairs;
+	UINT								m_frameIndex;		// deformation frames, seeds the obb jitter of the pairs
 };
 
 extern DeformationPipeline g_deformationPipeline;
\ No newline at end of file
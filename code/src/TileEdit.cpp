@@ -27,6 +27,7 @@
 #include "scene/ModelInstance.h"
 
 #include <sstream>
+#include <cmath>
 
 //Henry: has to be last header
 #include "utils/DbgNew.h"
@@ -47,6 +48,16 @@ TileEdit::TileEdit()
 	m_VoxelGridCB = NULL;
 	m_osdCB = NULL;
 	m_dispatchIndirectBUF = NULL;
+	m_statsBUF = NULL;
+	m_statsUAV = NULL;
+	for (UINT i = 0; i < STATS_FRAMES_IN_FLIGHT; ++i)
+	{
+		m_statsStagingBUF[i] = NULL;
+		m_statsPending[i] = false;
+	}
+	m_statsWriteSlot = 0;
+	m_statsDirty = false;
+	m_numStatsFrames = 0;
 	m_samplerBilinear = NULL;
 	m_samplerNearest = NULL;
 }
@@ -77,6 +88,26 @@ HRESULT TileEdit::Create( ID3D11Device1* pd3dDevice )
 							 m_dispatchIndirectBUF, indirectInitialState, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, sizeof(UINT)*4));
 	DXUT_SetDebugName(m_dispatchIndirectBUF, "m_dispatchIndirectBUF");
 
+	// deformation counters, see DeformationStats
+	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_UNORDERED_ACCESS, sizeof(DeformationStats), 0, D3D11_USAGE_DEFAULT, m_statsBUF));
+	DXUT_SetDebugName(m_statsBUF, "TileEdit statsBUF");
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
+		ZeroMemory(&descUAV, sizeof(descUAV));
+		descUAV.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		descUAV.Format = DXGI_FORMAT_R32_UINT;
+		descUAV.Buffer.FirstElement = 0;
+		descUAV.Buffer.NumElements = sizeof(DeformationStats) / sizeof(UINT);
+		V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_statsBUF, &descUAV, &m_statsUAV));
+	}
+	for (UINT i = 0; i < STATS_FRAMES_IN_FLIGHT; ++i)
+	{
+		V_RETURN(DXCreateBuffer(pd3dDevice, 0, sizeof(DeformationStats), D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, m_statsStagingBUF[i]));
+		m_statsPending[i] = false;
+	}
+	m_statsWriteSlot = 0;
+	m_statsDirty = false;
+
 	D3D11_SAMPLER_DESC sdesc;
 	ZeroMemory(&sdesc,sizeof(sdesc));
 	sdesc.AddressU	= D3D11_TEXTURE_ADDRESS_WRAP;
@@ -101,6 +132,14 @@ void TileEdit::Destroy()
 
 	SAFE_RELEASE(m_dispatchIndirectBUF);
 
+	SAFE_RELEASE(m_statsBUF);
+	SAFE_RELEASE(m_statsUAV);
+	for (UINT i = 0; i < STATS_FRAMES_IN_FLIGHT; ++i)
+	{
+		SAFE_RELEASE(m_statsStagingBUF[i]);
+		m_statsPending[i] = false;
+	}
+
 	SAFE_RELEASE(m_samplerBilinear);
 	SAFE_RELEASE(m_samplerNearest);
 	
@@ -163,6 +202,8 @@ HRESULT TileEdit::Apply(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstanc
 	config.displacement_tile_size = log2Integer(g_app.g_displacementTileSize);	
 
 	config.update_max_disp = true; // CHECKME hardcoded
+	config.dirty_edges = g_app.g_useDirtyEdgeOverlap ? 1 : 0;
+	config.deformation_stats = g_app.g_deformationStats ? 1 : 0;
 
 
 	if(g_app.g_useCullingForRayCast)
@@ -213,7 +254,7 @@ HRESULT TileEdit::Apply(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstanc
 		}
 
 		pd3dImmediateContext->CSSetShaderResources(0, 11, g_ppSRVNULL);
-		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 3, g_ppUAVNULL, NULL);
+		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 5, g_ppUAVNULL, NULL);
 	}
 	else
 	{
@@ -275,7 +316,7 @@ HRESULT TileEdit::Apply(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstanc
 			pd3dImmediateContext->Dispatch(patch.GetNumPatches(),NUM_BLOCKS_DISP*NUM_BLOCKS_DISP,1);
 
 			pd3dImmediateContext->CSSetShaderResources(0, 11, g_ppSRVNULL);
-			pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, g_ppUAVNULL, NULL);
+			pd3dImmediateContext->CSSetUnorderedAccessViews(0, 5, g_ppUAVNULL, NULL);
 		}	
 	}
 	return hr;
@@ -287,7 +328,7 @@ void TileEdit::BindShaders(ID3D11DeviceContext1* pd3dImmediateContext, const Pai
 	const D3D11_INPUT_ELEMENT_DESC hInElementDesc[] = { { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 } };
 
 	ID3D11InputLayout* tmp = NULL;
-	EffectRegistryIntersect::ConfigType * config = g_paintDeformEffectRegistry.GetDrawConfig(effect, DXUTGetD3D11Device(), &(const_cast<ID3D11InputLayout*>(tmp)), hInElementDesc, ARRAYSIZE(hInElementDesc));
+	EffectRegistryPaintDeform::ConfigType * config = g_paintDeformEffectRegistry.GetDrawConfig(effect, DXUTGetD3D11Device(), &(const_cast<ID3D11InputLayout*>(tmp)), hInElementDesc, ARRAYSIZE(hInElementDesc));
 	SAFE_RELEASE(tmp);
 
 	DXOSDMesh* mesh = instance->GetOSDMesh();
@@ -312,6 +353,8 @@ void TileEdit::BindShaders(ID3D11DeviceContext1* pd3dImmediateContext, const Pai
 		effect.with_constraints == 1 ? g_memoryManager.GetDisplacementConstraintsUAV() : g_memoryManager.GetDisplacementDataUAV()				// u0
 		, g_memoryManager.GetColorDataUAV()						// u1 debug write colors
 		, effect.update_max_disp > 0 ? instance->GetMaxDisplacement()->UAV : NULL
+		, effect.dirty_edges > 0 ? instance->GetDirtyEdges()->UAV : NULL	// u3 dirty edge mask
+		, effect.deformation_stats > 0 ? m_statsUAV : NULL				// u4 deformation counters
 	};
 
 	ID3D11ShaderResourceView* ppUVSRV[] = { osdMesh->GetDrawContext()->fvarDataBufferSRV };
@@ -329,7 +372,7 @@ void TileEdit::BindShaders(ID3D11DeviceContext1* pd3dImmediateContext, const Pai
 		pd3dImmediateContext->CSSetShaderResources(10, 1, ppBrushSRV);
 	}
 
-	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 3, ppUAV, NULL);
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 5, ppUAV, NULL);
 
 	pd3dImmediateContext->CSSetShader(config->computeShader->Get(), NULL, 0);
 	
@@ -344,30 +387,239 @@ HRESULT TileEdit::VoxelDeformOSD( ID3D11DeviceContext1 *pd3dImmediateContext, Mo
 	SetVoxelGridCB(pd3dImmediateContext, penetratorVoxelization, deformable);
 	pd3dImmediateContext->CSSetConstantBuffers( CB_LOC::MATERIAL, 1, &penetratorVoxelization->GetMaterial()->_cbMat);
 
-	if (g_app.g_bTimingsEnabled) 
+	// the validation reads back the counters of every edit, the counter buffer is cleared before
+	ID3D11Texture2D* beforeTEX = NULL;
+	const bool validate = ValidateStats();
+	if (validate)
 	{
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dRayCastTotal -= GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-		{
-			Apply(pd3dImmediateContext, deformable, intersect, batchIdx, penetratorVoxelization);
-		}
+		const UINT clearVals[] = {0,0,0,0};
+		pd3dImmediateContext->ClearUnorderedAccessViewUint(m_statsUAV, clearVals);
+		V_RETURN(CopyDisplacementTiles(pd3dImmediateContext, beforeTEX));
+	}
 
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dRayCastTotal += GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		g_app.g_TimingLog.m_uRayCastCount++;
-	} 
-	else 
 	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::RAYCAST);
+		g_profiler.AddGPUScopeValue(1);
 		Apply(pd3dImmediateContext, deformable, intersect, batchIdx, penetratorVoxelization);
 	}
 
+	if (g_app.g_deformationStats)
+		m_statsDirty = true;
+
+	if (validate)
+	{
+		hr = ValidateStatsCPU(pd3dImmediateContext, deformable, beforeTEX);
+		SAFE_RELEASE(beforeTEX);
+		V_RETURN(hr);
+	}
+
 	deformable->GetOSDMesh()->SetRequiresOverlapUpdate();
 	//UpdateOverlap(mesh);	//is called by main
 
 	return hr;
 }
 
+bool TileEdit::ValidateStats() const
+{
+	// the constraints pass writes the displacement after the counted edit, only the plain edit can be compared
+	return g_app.g_deformationStats && g_app.g_validateDeformationStats && !g_app.g_useDisplacementConstraints;
+}
+
+bool TileEdit::MapStats(ID3D11DeviceContext1* pd3dImmediateContext, UINT slot, bool wait)
+{
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	if (FAILED(pd3dImmediateContext->Map(m_statsStagingBUF[slot], 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &MappedResource)))
+		return false;	// still drawing
+
+	DeformationStats stats = *static_cast<const DeformationStats*>(MappedResource.pData);
+	pd3dImmediateContext->Unmap(m_statsStagingBUF[slot], 0);
+	m_statsPending[slot] = false;
+
+	AddFrameStats(stats);
+	return true;
+}
+
+void TileEdit::AddFrameStats(const DeformationStats& stats)
+{
+	m_lastStats = stats;
+	m_totalStats.Add(stats);
+	m_numStatsFrames++;
+
+	g_app.g_TimingLog.m_uDeformStatsFrames++;
+	g_app.g_TimingLog.m_uDeformTexels += stats.numTexels;
+	g_app.g_TimingLog.m_uDeformRays += stats.numRays;
+	g_app.g_TimingLog.m_uDeformDDASteps += stats.numDDASteps;
+	g_app.g_TimingLog.m_uDeformTexelsWritten += stats.numTexelsWritten;
+	g_app.g_TimingLog.m_uDeformTexelsChanged += stats.numTexelsChanged;
+
+	// counter tracks of the profile trace, sampled when the frame is resolved, not when it was edited
+	g_profiler.AddCounter("deform_rays", stats.numRays);
+	g_profiler.AddCounter("deform_dda_steps", stats.numDDASteps);
+	g_profiler.AddCounter("deform_texels_written", stats.numTexelsWritten);
+	g_profiler.AddCounter("deform_texels_changed", stats.numTexelsChanged);
+	g_profiler.AddCounter("deform_max_delta", stats.maxDelta);
+}
+
+void TileEdit::ResolveStats(ID3D11DeviceContext1 *pd3dImmediateContext)
+{
+	// finished frames in submission order, the oldest frame in flight is at the write slot
+	for (UINT i = 0; i < STATS_FRAMES_IN_FLIGHT; ++i)
+	{
+		const UINT slot = (m_statsWriteSlot + i) % STATS_FRAMES_IN_FLIGHT;
+		if (m_statsPending[slot] && !MapStats(pd3dImmediateContext, slot, false))
+			break;
+	}
+
+	if (!m_statsDirty) return;
+
+	if (ValidateStats())
+	{
+		// read back after every edit
+		AddFrameStats(m_validatedStats);
+		m_validatedStats = DeformationStats();
+	}
+	else
+	{
+		// all staging buffers in flight, the counters stay in the buffer and are resolved with the next frame
+		if (m_statsPending[m_statsWriteSlot]) return;
+
+		pd3dImmediateContext->CopyResource(m_statsStagingBUF[m_statsWriteSlot], m_statsBUF);
+		m_statsPending[m_statsWriteSlot] = true;
+		m_statsWriteSlot = (m_statsWriteSlot + 1) % STATS_FRAMES_IN_FLIGHT;
+	}
+
+	const UINT clearVals[] = {0,0,0,0};
+	pd3dImmediateContext->ClearUnorderedAccessViewUint(m_statsUAV, clearVals);
+	m_statsDirty = false;
+}
+
+void TileEdit::FlushStats(ID3D11DeviceContext1 *pd3dImmediateContext)
+{
+	for (UINT i = 0; i < STATS_FRAMES_IN_FLIGHT; ++i)
+	{
+		const UINT slot = (m_statsWriteSlot + i) % STATS_FRAMES_IN_FLIGHT;
+		if (m_statsPending[slot])
+			MapStats(pd3dImmediateContext, slot, true);
+	}
+
+	// counters of the current frame
+	ResolveStats(pd3dImmediateContext);
+	const UINT last = (m_statsWriteSlot + STATS_FRAMES_IN_FLIGHT - 1) % STATS_FRAMES_IN_FLIGHT;
+	if (m_statsPending[last])
+		MapStats(pd3dImmediateContext, last, true);
+}
+
+void TileEdit::ResetStats()
+{
+	m_lastStats = DeformationStats();
+	m_totalStats = DeformationStats();
+	m_numStatsFrames = 0;
+}
+
+// blocking copy of all displacement pages
+HRESULT TileEdit::CopyDisplacementTiles(ID3D11DeviceContext1* pd3dImmediateContext, ID3D11Texture2D*& stagingTEX) const
+{
+	HRESULT hr = S_OK;
+	ID3D11Resource* resource = NULL;
+	g_memoryManager.GetDisplacementDataUAV()->GetResource(&resource);
+	ID3D11Texture2D* displacementTEX = static_cast<ID3D11Texture2D*>(resource);
+
+	D3D11_TEXTURE2D_DESC desc;
+	displacementTEX->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	hr = DXUTGetD3D11Device()->CreateTexture2D(&desc, NULL, &stagingTEX);
+	if (SUCCEEDED(hr))
+		pd3dImmediateContext->CopyResource(stagingTEX, displacementTEX);
+	SAFE_RELEASE(resource);
+	return hr;
+}
+
+HRESULT TileEdit::ValidateStatsCPU( ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* deformable, ID3D11Texture2D* beforeTEX )
+{
+	HRESULT hr = S_OK;
+
+	DeformationStats statsGPU;
+	{
+		ID3D11Buffer* stagingBUF = NULL;
+		V_RETURN(DXCreateBuffer(DXUTGetD3D11Device(), 0, sizeof(DeformationStats), D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, stagingBUF));
+		pd3dImmediateContext->CopyResource(stagingBUF, m_statsBUF);
+
+		D3D11_MAPPED_SUBRESOURCE MappedResource;
+		hr = pd3dImmediateContext->Map(stagingBUF, 0, D3D11_MAP_READ, 0, &MappedResource);
+		if (SUCCEEDED(hr))
+		{
+			statsGPU = *static_cast<const DeformationStats*>(MappedResource.pData);
+			pd3dImmediateContext->Unmap(stagingBUF, 0);
+		}
+		SAFE_RELEASE(stagingBUF);
+		V_RETURN(hr);
+	}
+	m_validatedStats.Add(statsGPU);
+
+	ID3D11Texture2D* afterTEX = NULL;
+	V_RETURN(CopyDisplacementTiles(pd3dImmediateContext, afterTEX));
+
+	D3D11_TEXTURE2D_DESC desc;
+	afterTEX->GetDesc(&desc);
+
+	// 16 bit tiles round the written values, the kernel compares before rounding
+	const bool compare = desc.Format == DXGI_FORMAT_R32_FLOAT;
+	DeformationStats statsCPU;
+	for (UINT page = 0; compare && page < desc.ArraySize; ++page)
+	{
+		const UINT subresource = D3D11CalcSubresource(0, page, 1);
+		D3D11_MAPPED_SUBRESOURCE mappedBefore, mappedAfter;
+		hr = pd3dImmediateContext->Map(beforeTEX, subresource, D3D11_MAP_READ, 0, &mappedBefore);
+		if (FAILED(hr)) break;
+		hr = pd3dImmediateContext->Map(afterTEX, subresource, D3D11_MAP_READ, 0, &mappedAfter);
+		if (SUCCEEDED(hr))
+		{
+			assert(mappedBefore.RowPitch == mappedAfter.RowPitch);
+			CountDisplacementChangesCPU(static_cast<const BYTE*>(mappedBefore.pData), static_cast<const BYTE*>(mappedAfter.pData),
+										desc.Width, desc.Height, mappedAfter.RowPitch, statsCPU);
+			pd3dImmediateContext->Unmap(afterTEX, subresource);
+		}
+		pd3dImmediateContext->Unmap(beforeTEX, subresource);
+		if (FAILED(hr)) break;
+	}
+	SAFE_RELEASE(afterTEX);
+	V_RETURN(hr);
+
+	const std::string name = deformable->GetOSDMesh()->GetName();
+	if (compare && (statsCPU.numTexelsChanged != statsGPU.numTexelsChanged || statsCPU.maxDelta != statsGPU.maxDelta))
+	{
+		std::cerr << "TileEdit::ValidateStatsCPU " << name << ": " << statsGPU.numTexelsChanged << " gpu changed texels, "
+				  << statsCPU.numTexelsChanged << " cpu changed texels, max delta " << statsGPU.maxDelta << " gpu, " << statsCPU.maxDelta << " cpu" << std::endl;
+		return E_FAIL;
+	}
+
+	std::cout << "deformation stats " << name << ": " << statsGPU.numTiles << " tiles, " << statsGPU.numTexels << " texels, "
+			  << statsGPU.numRays << " rays, " << statsGPU.numDDASteps << " dda steps, " << statsGPU.numVoxelsHit << " voxels hit, "
+			  << statsGPU.numTexelsWritten << " written, " << statsGPU.numTexelsChanged << " changed, max delta " << statsGPU.maxDelta << std::endl;
+	return hr;
+}
+
+void TileEdit::CountDisplacementChangesCPU( const BYTE* before, const BYTE* after, UINT width, UINT height, UINT rowPitch, DeformationStats& stats )
+{
+	for (UINT y = 0; y < height; ++y)
+	{
+		const float* rowBefore = reinterpret_cast<const float*>(before + y * rowPitch);
+		const float* rowAfter  = reinterpret_cast<const float*>(after + y * rowPitch);
+		for (UINT x = 0; x < width; ++x)
+		{
+			if (rowAfter[x] == rowBefore[x])
+				continue;
+
+			stats.numTexelsChanged++;
+			stats.maxDelta = std::max(stats.maxDelta, std::abs(rowAfter[x] - rowBefore[x]));
+		}
+	}
+}
+
 EffectRegistryPaintDeform::ConfigType * EffectRegistryPaintDeform::_CreateDrawConfig( DescType const & desc, SourceConfigType const * sconfig, ID3D11Device1 * pd3dDevice, ID3D11InputLayout ** ppInputLayout, D3D11_INPUT_ELEMENT_DESC const * pInputElementDescs, int numInputElements ) const  // make const
 {
 
@@ -456,6 +708,12 @@ EffectRegistryPaintDeform::SourceConfigType * EffectRegistryPaintDeform::_Create
 	if (effect.update_max_disp != 0)
 		sconfig->computeShader.AddDefine("UPDATE_MAX_DISPLACEMENT");
 
+	if (effect.dirty_edges != 0)
+		sconfig->computeShader.AddDefine("WITH_DIRTY_EDGES");
+
+	if (effect.deformation_stats != 0)
+		sconfig->computeShader.AddDefine("WITH_DEFORMATION_STATS");
+
 	
 	return sconfig;
 }
@@ -17,6 +17,7 @@
 
 #include <DXUT.h>
 #include <SDX/DXShaderManager.h>
+#include <algorithm>
 
 class ModelInstance;
 class IntersectGPU;
@@ -37,6 +38,37 @@ class Voxelizable;
 //  ||6. update overlap for analytic displacement maps || MOVED to TileOverlapUpdater
 
 
+// counters of the tile edit, accumulated by TileEditCS with WITH_DEFORMATION_STATS
+// keep in sync with shader/DeformationStats.h.hlsl
+struct DeformationStats
+{
+	DeformationStats() { ZeroMemory(this, sizeof(DeformationStats)); }
+
+	void Add(const DeformationStats& s)
+	{
+		numTiles += s.numTiles;					numTexels += s.numTexels;
+		numRays += s.numRays;					numDDASteps += s.numDDASteps;			numVoxelsHit += s.numVoxelsHit;
+		numSkipInvisible += s.numSkipInvisible;	numSkipUnallocated += s.numSkipUnallocated;
+		numSkipMiss += s.numSkipMiss;			numSkipZero += s.numSkipZero;
+		numTexelsWritten += s.numTexelsWritten;	numTexelsChanged += s.numTexelsChanged;
+		maxDelta = std::max(maxDelta, s.maxDelta);
+	}
+
+	UINT	numTiles;				// dispatched patch tiles
+	UINT	numTexels;				// texels inside the tiles, evaluated on the surface
+	UINT	numRays;				// VoxelDDA calls, 5 per texel with multisampling
+	UINT	numDDASteps;			// voxels visited by the rays
+	UINT	numVoxelsHit;			// visited voxels that are set
+	UINT	numSkipInvisible;		// early out, ptex face not intersected
+	UINT	numSkipUnallocated;		// early out, no tile memory
+	UINT	numSkipMiss;			// early out, ray origin outside the grid or no voxel hit
+	UINT	numSkipZero;			// early out, zero penetration depth
+	UINT	numTexelsWritten;
+	UINT	numTexelsChanged;		// written with a different value
+	float	maxDelta;				// largest abs displacement change
+};
+static_assert(sizeof(DeformationStats) == 12 * sizeof(UINT), "DeformationStats does not match DEFORM_STATS_COUNT");
+
 enum class EditPatchType : uint32_t
 {
 	REGULAR = 0,
@@ -54,6 +86,8 @@ union PaintDeformConfig{	// settings bitfield, check bit <32 to match int value
 		unsigned int with_culling			: 1;	// enable 
 		unsigned int displacement_tile_size : 4;	// log2 tile size	
 		unsigned int update_max_disp		: 1;
+		unsigned int dirty_edges			: 1;	// mark written border texels for the incremental overlap update
+		unsigned int deformation_stats		: 1;	// count tiles, rays, dda steps and texels (DeformationStats)
 	}; 
 
 	int value;
@@ -87,11 +121,30 @@ public:
 	
 	HRESULT Apply(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance, IntersectGPU* intersect, uint32_t batchIdx, ModelInstance* penetratorVoxelization = NULL);
 	HRESULT VoxelDeformOSD(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* deformable, ModelInstance* penetratorVoxelization, IntersectGPU* intersect, uint32_t batchIdx);
+
+	// deformation counters with g_app.g_deformationStats. the counters of all edits of a frame are copied to a staging buffer in ResolveStats
+	// and mapped a few frames later without waiting for the gpu, a frame is merged into the next one if all staging buffers are still in flight.
+	void	ResolveStats(ID3D11DeviceContext1 *pd3dImmediateContext);	// once per frame after the deformation
+	void	FlushStats(ID3D11DeviceContext1 *pd3dImmediateContext);		// waits for the frames in flight
+	void	ResetStats();
+
+	const DeformationStats&	GetLastStats()		const	{ return m_lastStats; }		// last resolved frame
+	const DeformationStats&	GetTotalStats()		const	{ return m_totalStats; }	// since ResetStats
+	UINT					GetNumStatsFrames()	const	{ return m_numStatsFrames; }
+
+	// cpu reference of the changed texel counters, compares two copies of a displacement page (R32_FLOAT, rowPitch in bytes)
+	static void CountDisplacementChangesCPU(const BYTE* before, const BYTE* after, UINT width, UINT height, UINT rowPitch, DeformationStats& stats);
 		
 	
 protected:
 	void BindShaders(ID3D11DeviceContext1* pd3dImmediateContext, const PaintDeformConfig effect, ModelInstance* instance, IntersectGPU* intersect, ModelInstance* penetratorVoxelization, uint32_t batchIdx);
 	void SetVoxelGridCB(ID3D11DeviceContext1* pd3dImmediateContext, Voxelizable* penetratorVoxelization, ModelInstance* deformableInstance) const;
+
+	bool	ValidateStats() const;
+	bool	MapStats(ID3D11DeviceContext1* pd3dImmediateContext, UINT slot, bool wait);
+	void	AddFrameStats(const DeformationStats& stats);
+	HRESULT CopyDisplacementTiles(ID3D11DeviceContext1* pd3dImmediateContext, ID3D11Texture2D*& stagingTEX) const;
+	HRESULT ValidateStatsCPU(ID3D11DeviceContext1* pd3dImmediateContext, ModelInstance* deformable, ID3D11Texture2D* beforeTEX);
 	
 	ID3D11Buffer*	m_intersectModelCB;
 	ID3D11Buffer*	m_VoxelGridCB;	
@@ -100,6 +153,19 @@ protected:
 
 	ID3D11Buffer*		m_dispatchIndirectBUF;
 
+	static const UINT STATS_FRAMES_IN_FLIGHT = 4;
+
+	ID3D11Buffer*				m_statsBUF;			// DeformationStats, u4
+	ID3D11UnorderedAccessView*	m_statsUAV;
+	ID3D11Buffer*				m_statsStagingBUF[STATS_FRAMES_IN_FLIGHT];
+	bool						m_statsPending[STATS_FRAMES_IN_FLIGHT];
+	UINT						m_statsWriteSlot;	// next staging buffer, the oldest one in flight
+	bool						m_statsDirty;		// edits since the last ResolveStats
+	DeformationStats			m_validatedStats;	// edits of the frame, read back by the validation
+	DeformationStats			m_lastStats;
+	DeformationStats			m_totalStats;
+	UINT						m_numStatsFrames;
+
 	ID3D11SamplerState* m_samplerBilinear;
 	ID3D11SamplerState* m_samplerNearest;
 
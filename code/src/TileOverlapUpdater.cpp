@@ -16,6 +16,7 @@
 #include "stdafx.h"
 #include "TileOverlapUpdater.h"
 #include "MemoryManager.h"
+#include "App.h"
 
 #include "scene/ModelInstance.h"
 #include "scene/DXSubDModel.h"
@@ -50,6 +51,17 @@ TileOverlapUpdater::TileOverlapUpdater()
 	m_updateOverlapCompacted_CornersColorOSD_CS		  = NULL;
 
 	m_compactIntersectAll_CS = NULL;
+
+	m_updateOverlapDirty_EdgesDisplacementOSD_CS			= NULL;
+	m_updateOverlapDirty_CornersDisplacementOSD_CS			= NULL;
+	m_updateOverlapDirty_EqualizeCornerDisplacementOSD_CS	= NULL;
+	m_compactDirtyEdges_CS = NULL;
+
+	m_dirtyStatsBUF = NULL;
+	m_dirtyStatsUAV = NULL;
+	m_dirtyStatsStagingBUF = NULL;
+	m_readbackStats = false;
+
 	m_constraintsMode = false;
 }
 
@@ -68,6 +80,20 @@ HRESULT TileOverlapUpdater::Create( ID3D11Device1* pd3dDevice )
 	V_RETURN(DXCreateBuffer(DXUTGetD3D11Device(),	0,	sizeof(UINT)*4, 0,	D3D11_USAGE_DEFAULT, m_dispatchIndirectBUF, indirectInitialState, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, sizeof(UINT)*4));
 	DXUT_SetDebugName(m_dispatchIndirectBUF, "TileOverlapUpdater dispatchIndirectBUF");
 
+	// counters of the dirty edge compaction, see DirtyEdgeStats
+	V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_UNORDERED_ACCESS, sizeof(DirtyEdgeStats), 0, D3D11_USAGE_DEFAULT, m_dirtyStatsBUF));
+	DXUT_SetDebugName(m_dirtyStatsBUF, "TileOverlapUpdater dirtyStatsBUF");
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
+		ZeroMemory(&descUAV, sizeof(descUAV));
+		descUAV.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		descUAV.Format = DXGI_FORMAT_R32_UINT;
+		descUAV.Buffer.FirstElement = 0;
+		descUAV.Buffer.NumElements = sizeof(DirtyEdgeStats) / sizeof(UINT);
+		V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_dirtyStatsBUF, &descUAV, &m_dirtyStatsUAV));
+	}
+	V_RETURN(DXCreateBuffer(pd3dDevice, 0, sizeof(DirtyEdgeStats), D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, m_dirtyStatsStagingBUF));
+
 
 	// SHADER
 
@@ -99,6 +125,13 @@ HRESULT TileOverlapUpdater::Create( ID3D11Device1* pd3dDevice )
 	
 	m_compactIntersectAll_CS = g_shaderManager.AddComputeShader(L"shader/UpdateOverlap.hlsl", "CompactIntersectAll", "cs_5_0", &pBlob, macro_overlap_displacement);
 
+	D3D_SHADER_MACRO macro_overlap_displacement_dirty[]	= { { "TILE_SIZE", tileSizeDisplacement }, { "DISPLACEMENT_MODE", "1" }, {"DIRTY_EDGES", "1"}, { 0 } };
+	m_updateOverlapDirty_EdgesDisplacementOSD_CS			= g_shaderManager.AddComputeShader(L"shader/UpdateOverlap.hlsl", "OverlapEdgesCS", "cs_5_0", &pBlob, macro_overlap_displacement_dirty);
+	m_updateOverlapDirty_CornersDisplacementOSD_CS			= g_shaderManager.AddComputeShader(L"shader/UpdateOverlap.hlsl", "OverlapCornersCS", "cs_5_0", &pBlob, macro_overlap_displacement_dirty);
+	m_updateOverlapDirty_EqualizeCornerDisplacementOSD_CS	= g_shaderManager.AddComputeShader(L"shader/UpdateOverlap.hlsl", "OverlapEqualizeExtraordinaryCS", "cs_5_0", &pBlob, macro_overlap_displacement_dirty);
+
+	m_compactDirtyEdges_CS = g_shaderManager.AddComputeShader(L"shader/UpdateOverlap.hlsl", "CompactDirtyEdgesCS", "cs_5_0", &pBlob, macro_overlap_displacement_dirty);
+
 
 	SAFE_RELEASE(pBlob);
 
@@ -110,44 +143,52 @@ void TileOverlapUpdater::Destroy()
 {
 	SAFE_RELEASE(m_updateExtraordinaryCB);
 	SAFE_RELEASE(m_dispatchIndirectBUF);
+	SAFE_RELEASE(m_dirtyStatsBUF);
+	SAFE_RELEASE(m_dirtyStatsUAV);
+	SAFE_RELEASE(m_dirtyStatsStagingBUF);
 }
 
 
 HRESULT TileOverlapUpdater::UpdateOverlapDisplacement( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance )
 {
 	HRESULT hr = S_OK;
+	const bool dirtyEdges = UseDirtyEdges(instance);
+
+	const UINT numPtexFaces = instance->GetOSDMesh()->GetNumPTexFaces();
 
-if(g_app.g_useCompactedVisibilityOverlap)
+if(dirtyEdges)
 {
-	if (g_app.g_bTimingsEnabled) 
+	PERF_EVENT_SCOPED(perf, L"Dirty Edge Compaction");
+	TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::COMPACT_VISIBILITY);
+	g_profiler.AddGPUScopeValue(numPtexFaces);
+	CompactDirtyEdges(pd3dImmediateContext, instance);
+}
+else if(g_app.g_useCompactedVisibilityOverlap)
+{
+	PERF_EVENT_SCOPED(perf, L"Intersect Buffer Compaction");
+	TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::COMPACT_VISIBILITY);
+	g_profiler.AddGPUScopeValue(numPtexFaces);
+	CompactIntersectAllBuffer(pd3dImmediateContext, instance);
+}
+
 	{
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dCompactVisibilityAllTotal -= GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-			CompactIntersectAllBuffer(pd3dImmediateContext, instance);
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dCompactVisibilityAllTotal += GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		g_app.g_TimingLog.m_uCompactVisibilityAllOverlapCount++;
+		PERF_EVENT_SCOPED(perf, L"Update Overlap");
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::OVERLAP);
+		g_profiler.AddGPUScopeValue(numPtexFaces);
+		UpdateOverlapDisplacementInternal(pd3dImmediateContext, instance);
 	}
-	else
+
+	if(dirtyEdges)
 	{
-		PERF_EVENT_SCOPED(perf, L"Intersect Buffer Compaction");
-		CompactIntersectAllBuffer(pd3dImmediateContext, instance);
-	}
-}
+		// blocking, only with readback stats (batch), the timings do not read back
+		if(m_readbackStats)
+			V_RETURN(ReadbackDirtyEdgeStats(pd3dImmediateContext));
 
+		if(g_app.g_validateDirtyEdgeOverlap)
+			V_RETURN(ValidateDirtyEdges(pd3dImmediateContext, instance));
 
-	if (g_app.g_bTimingsEnabled) {
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dOverlapTotal -= GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-			UpdateOverlapDisplacementInternal(pd3dImmediateContext, instance);
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dOverlapTotal += GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		g_app.g_TimingLog.m_uOverlapCount++;
-	} else {
-		PERF_EVENT_SCOPED(perf, L"Update Overlap");
-		UpdateOverlapDisplacementInternal(pd3dImmediateContext, instance);
+		// edits of the next frames start with a clean mask, the constraints pass keeps it for the displacement pass
+		ClearDirtyEdges(pd3dImmediateContext, instance);
 	}
 
 	//if(g_app.g_useCompactedVisibilityOverlap)
@@ -163,32 +204,13 @@ HRESULT TileOverlapUpdater::UpdateOverlapColor( ID3D11DeviceContext1 *pd3dImmedi
 	return hr;
 	if(g_app.g_useCompactedVisibilityOverlap)
 	{
-		if (g_app.g_bTimingsEnabled) 
-		{
-			g_app.WaitForGPU();
-			g_app.g_TimingLog.m_dCompactVisibilityAllTotal -= GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-			for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-				CompactIntersectAllBuffer(pd3dImmediateContext, instance);
-			g_app.WaitForGPU();
-			g_app.g_TimingLog.m_dCompactVisibilityAllTotal += GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-			g_app.g_TimingLog.m_uCompactVisibilityAllOverlapCount++;
-		}
-		else
-		{
-			CompactIntersectAllBuffer(pd3dImmediateContext, instance);
-		}
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::COMPACT_VISIBILITY);
+		CompactIntersectAllBuffer(pd3dImmediateContext, instance);
 	}
 
 	// TODO own timer for color overlap
-	if (g_app.g_bTimingsEnabled) {
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dOverlapTotal -= GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns; i++)
-			UpdateOverlapColorInternal(pd3dImmediateContext, instance);
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dOverlapTotal += GetTimeMS()/(double)g_app.g_TimingLog.m_uNumRuns;
-		g_app.g_TimingLog.m_uOverlapCount++;
-	} else {
+	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::OVERLAP);
 		UpdateOverlapColorInternal(pd3dImmediateContext, instance);
 	}
 
@@ -220,9 +242,9 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 	HRESULT hr = S_OK;
 	if(instance->IsSubD())
 	{
-		// TODO overlap update only on modified
 		auto mesh = instance->GetOSDMesh();
 		UINT numPtexFaces = mesh->GetNumPTexFaces();
+		const bool dirtyEdges = UseDirtyEdges(instance);
 
 		// update extraordinary		
 		
@@ -233,9 +255,12 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 			instance->GetDisplacementTileLayout()->SRV,	// t0 tile descriptors/layout				
 			mesh->GetPTexNeighborDataSRV(),				// t1 ptex neighbor data: UINT4 edge to neighbor ptex ids, UINT4 edge to opposite edgeID
 			NULL, NULL,
-			instance->GetCompactedVisibility()->SRV		// t4
+			dirtyEdges ? instance->GetDirtyEdgeRecords()->SRV : instance->GetCompactedVisibility()->SRV,	// t4 dirty edge records or compacted visibility
+			instance->GetDirtyEdges()->SRV				// t5 dirty edge mask
 		};
 
+		Shader<ID3D11ComputeShader>* equalizeCS = dirtyEdges ? m_updateOverlapDirty_EqualizeCornerDisplacementOSD_CS : m_updateOverlapEqualizeCornerDisplacementOSD_CS;
+
 
 		ID3D11ShaderResourceView* ppSRVExtraordinary[] = {			
 			mesh->GetExtraordinaryInfoSRV(),			// t2 offset and valence per extraordinary vertex
@@ -250,10 +275,15 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 				g_memoryManager.GetDisplacementConstraintsUAV()				// u0 displacement data
 			};
 
-			pd3dImmediateContext->CSSetShaderResources(0, 5, ppEdgeCornerSRV);
+			pd3dImmediateContext->CSSetShaderResources(0, 6, ppEdgeCornerSRV);
 			pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, ppUAV, NULL);		
 
-			if(g_app.g_useCompactedVisibilityOverlap)
+			if(dirtyEdges)
+			{
+				PERF_EVENT_SCOPED(perf, L"Dirty Edge Overlap Update");
+				DispatchDirtyEdges(pd3dImmediateContext, instance);
+			}
+			else if(g_app.g_useCompactedVisibilityOverlap)
 			{
 				PERF_EVENT_SCOPED(perf, L"Compacted Overlap Update");
 				pd3dImmediateContext->CopyStructureCount(m_dispatchIndirectBUF, 0, instance->GetCompactedVisibility()->UAV);
@@ -291,11 +321,11 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 			{
 				PERF_EVENT_SCOPED(perf, L"Overlap Update Extraordinary");									
 				pd3dImmediateContext->CSSetShaderResources(2, 2, ppSRVExtraordinary);
-				pd3dImmediateContext->CSSetShader(m_updateOverlapEqualizeCornerDisplacementOSD_CS->Get(), NULL, 0);							
+				pd3dImmediateContext->CSSetShader(equalizeCS->Get(), NULL, 0);							
 				pd3dImmediateContext->Dispatch((mesh->GetNumExtraordinary() + WORK_GROUP_SIZE_EXTRAORDINARY-1)/WORK_GROUP_SIZE_EXTRAORDINARY, 1, 1);
 			}
 
-			pd3dImmediateContext->CSSetShaderResources(0, 5, g_ppSRVNULL);
+			pd3dImmediateContext->CSSetShaderResources(0, 6, g_ppSRVNULL);
 			pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, g_ppUAVNULL, NULL);
 		}
 		else
@@ -303,10 +333,14 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 			ID3D11UnorderedAccessView* ppUAV[] = {	g_memoryManager.GetDisplacementDataUAV()				// u0 displacement data
 												 };
 
-			pd3dImmediateContext->CSSetShaderResources(0, 5, ppEdgeCornerSRV);
+			pd3dImmediateContext->CSSetShaderResources(0, 6, ppEdgeCornerSRV);
 			pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, ppUAV, NULL);		
 
-			if(g_app.g_useCompactedVisibilityOverlap)
+			if(dirtyEdges)
+			{
+				DispatchDirtyEdges(pd3dImmediateContext, instance);
+			}
+			else if(g_app.g_useCompactedVisibilityOverlap)
 			{
 				pd3dImmediateContext->CopyStructureCount(m_dispatchIndirectBUF, 0, instance->GetCompactedVisibility()->UAV);
 				// update edges
@@ -331,10 +365,10 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementInternal( ID3D11DeviceConte
 
 		// update extraordinary
 		pd3dImmediateContext->CSSetShaderResources(2, 2, ppSRVExtraordinary);
-		pd3dImmediateContext->CSSetShader(m_updateOverlapEqualizeCornerDisplacementOSD_CS->Get(), NULL, 0);							
+		pd3dImmediateContext->CSSetShader(equalizeCS->Get(), NULL, 0);							
 		pd3dImmediateContext->Dispatch((mesh->GetNumExtraordinary() + WORK_GROUP_SIZE_EXTRAORDINARY-1)/WORK_GROUP_SIZE_EXTRAORDINARY, 1, 1);
 
-		pd3dImmediateContext->CSSetShaderResources(0, 5, g_ppSRVNULL);
+		pd3dImmediateContext->CSSetShaderResources(0, 6, g_ppSRVNULL);
 		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 1, g_ppUAVNULL, NULL);		
 
 		
@@ -460,7 +494,12 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementConstraints( ID3D11DeviceCo
 	HRESULT hr = S_OK;
 
 	SetConstraintsOverlap(true);
-	if(g_app.g_useCompactedVisibilityOverlap)
+	if(UseDirtyEdges(instance))
+	{
+		PERF_EVENT_SCOPED(perf, L"Overlap Update Compact Dirty Edges");
+		CompactDirtyEdges(pd3dImmediateContext, instance);
+	}
+	else if(g_app.g_useCompactedVisibilityOverlap)
 	{
 		PERF_EVENT_SCOPED(perf, L"Overlap Update Compact Intersect Buffer");
 		CompactIntersectAllBuffer(pd3dImmediateContext, instance);
@@ -473,3 +512,238 @@ HRESULT TileOverlapUpdater::UpdateOverlapDisplacementConstraints( ID3D11DeviceCo
 	SetConstraintsOverlap(false);
 	return hr;
 }
+
+
+bool TileOverlapUpdater::UseDirtyEdges( ModelInstance* instance ) const
+{
+	return g_app.g_useDirtyEdgeOverlap && instance->GetDirtyEdges()->UAV != NULL;
+}
+
+HRESULT TileOverlapUpdater::CompactDirtyEdges( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const
+{
+	HRESULT hr = S_OK;
+	if(instance->IsSubD())
+	{
+		auto mesh = instance->GetOSDMesh();
+		UINT numPtexFaces = mesh->GetNumPTexFaces();
+
+		const UINT clearVals[] = {0,0,0,0};
+		pd3dImmediateContext->ClearUnorderedAccessViewUint(m_dirtyStatsUAV, clearVals);
+
+		ID3D11ShaderResourceView* ppSRV[] = {
+			instance->GetDisplacementTileLayout()->SRV,	// t0 tile descriptors/layout, unallocated faces are skipped
+			mesh->GetPTexNeighborDataSRV(),				// t1 ptex neighbor data
+			NULL, NULL, NULL,
+			instance->GetDirtyEdges()->SRV				// t5 dirty edge mask written by the tile edit
+		};
+		ID3D11UnorderedAccessView* ppUAV[] = {
+			instance->GetDirtyEdgeRecords()->UAV,		// u0 append buffer with one record per face to update
+			m_dirtyStatsUAV								// u1 counters
+		};
+
+		UINT uavCounterVals[] = {0, 0};
+		pd3dImmediateContext->CSSetShaderResources(0, 6, ppSRV);
+		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppUAV, uavCounterVals);
+
+		pd3dImmediateContext->CSSetShader(m_compactDirtyEdges_CS->Get(), NULL, 0);
+		pd3dImmediateContext->Dispatch((numPtexFaces+(BLOCK_SIZE_COMPACT-1))/BLOCK_SIZE_COMPACT, 1, 1);
+
+		pd3dImmediateContext->CSSetShaderResources(0, 6, g_ppSRVNULL);
+		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, g_ppUAVNULL, NULL);
+	}
+	return hr;
+}
+
+void TileOverlapUpdater::DispatchDirtyEdges( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const
+{
+	// one group per record, the kernels skip the edges and corners that are not marked
+	pd3dImmediateContext->CopyStructureCount(m_dispatchIndirectBUF, 0, instance->GetDirtyEdgeRecords()->UAV);
+	{
+		PERF_EVENT_SCOPED(perf, L"Overlap Update Edges");
+		pd3dImmediateContext->CSSetShader(m_updateOverlapDirty_EdgesDisplacementOSD_CS->Get(), NULL, 0);
+		pd3dImmediateContext->DispatchIndirect(m_dispatchIndirectBUF,0);
+	}
+	{
+		PERF_EVENT_SCOPED(perf, L"Overlap Update Corners");
+		pd3dImmediateContext->CSSetShader(m_updateOverlapDirty_CornersDisplacementOSD_CS->Get(), NULL, 0);
+		pd3dImmediateContext->DispatchIndirect(m_dispatchIndirectBUF,0);
+	}
+}
+
+HRESULT TileOverlapUpdater::ClearDirtyEdges( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const
+{
+	HRESULT hr = S_OK;
+	const UINT clearVals[] = {0,0,0,0};
+	pd3dImmediateContext->ClearUnorderedAccessViewUint(instance->GetDirtyEdges()->UAV, clearVals);
+	return hr;
+}
+
+HRESULT TileOverlapUpdater::ReadbackDirtyEdgeStats( ID3D11DeviceContext1 *pd3dImmediateContext )
+{
+	HRESULT hr = S_OK;
+	pd3dImmediateContext->CopyResource(m_dirtyStatsStagingBUF, m_dirtyStatsBUF);
+
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	V_RETURN(pd3dImmediateContext->Map(m_dirtyStatsStagingBUF, 0, D3D11_MAP_READ, 0, &MappedResource));
+	DirtyEdgeStats stats = *static_cast<const DirtyEdgeStats*>(MappedResource.pData);
+	pd3dImmediateContext->Unmap(m_dirtyStatsStagingBUF, 0);
+
+	m_frameStats.Add(stats);
+
+	g_app.g_TimingLog.m_uOverlapDirtyEdges += stats.numEdges;
+	g_app.g_TimingLog.m_uOverlapDirtyCornerFaces += stats.numCornerFaces;
+	g_app.g_TimingLog.m_uOverlapDirtyCount++;
+	return hr;
+}
+
+// blocking copy of the first byteSize bytes of a default usage buffer
+static HRESULT ReadbackBuffer(ID3D11DeviceContext1 *pd3dImmediateContext, ID3D11Buffer* buffer, UINT byteSize, void* data)
+{
+	HRESULT hr = S_OK;
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	assert(byteSize <= desc.ByteWidth);
+
+	ID3D11Buffer* stagingBUF = NULL;
+	V_RETURN(DXCreateBuffer(DXUTGetD3D11Device(), 0, desc.ByteWidth, D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, stagingBUF));
+	pd3dImmediateContext->CopyResource(stagingBUF, buffer);
+
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	hr = pd3dImmediateContext->Map(stagingBUF, 0, D3D11_MAP_READ, 0, &MappedResource);
+	if (SUCCEEDED(hr))
+	{
+		memcpy(data, MappedResource.pData, byteSize);
+		pd3dImmediateContext->Unmap(stagingBUF, 0);
+	}
+	SAFE_RELEASE(stagingBUF);
+	return hr;
+}
+
+HRESULT TileOverlapUpdater::ValidateDirtyEdges( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const
+{
+	HRESULT hr = S_OK;
+	if(!instance->IsSubD()) return hr;
+
+	auto mesh = instance->GetOSDMesh();
+	const UINT numPtexFaces = mesh->GetNumPTexFaces();
+
+	std::vector<UINT> dirtyMask(numPtexFaces);
+	std::vector<uint16_t> tileLayout(numPtexFaces * 4);
+	V_RETURN(ReadbackBuffer(pd3dImmediateContext, instance->GetDirtyEdges()->BUF, numPtexFaces * sizeof(UINT), &dirtyMask[0]));
+	V_RETURN(ReadbackBuffer(pd3dImmediateContext, instance->GetDisplacementTileLayout()->BUF, numPtexFaces * 4 * sizeof(uint16_t), &tileLayout[0]));
+
+	UINT numRecordsGPU = 0;
+	{
+		ID3D11Buffer* stagingBUF = NULL;
+		V_RETURN(DXCreateBuffer(DXUTGetD3D11Device(), 0, sizeof(UINT), D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, stagingBUF));
+		pd3dImmediateContext->CopyStructureCount(stagingBUF, 0, instance->GetDirtyEdgeRecords()->UAV);
+
+		D3D11_MAPPED_SUBRESOURCE MappedResource;
+		hr = pd3dImmediateContext->Map(stagingBUF, 0, D3D11_MAP_READ, 0, &MappedResource);
+		if (SUCCEEDED(hr))
+		{
+			numRecordsGPU = *static_cast<const UINT*>(MappedResource.pData);
+			pd3dImmediateContext->Unmap(stagingBUF, 0);
+		}
+		SAFE_RELEASE(stagingBUF);
+		V_RETURN(hr);
+	}
+
+	std::vector<UINT> recordsGPU(numRecordsGPU);
+	if (numRecordsGPU > 0)
+		V_RETURN(ReadbackBuffer(pd3dImmediateContext, instance->GetDirtyEdgeRecords()->BUF, numRecordsGPU * sizeof(UINT), &recordsGPU[0]));
+	std::sort(recordsGPU.begin(), recordsGPU.end());	// append order is arbitrary
+
+	std::vector<UINT> recordsCPU;
+	DirtyEdgeStats statsCPU;
+	BuildDirtyEdgeRecordsCPU(mesh->GetPtexNeighborDataREF(), dirtyMask, tileLayout, recordsCPU, statsCPU);
+	const UINT numExtraordinary = CountDirtyExtraordinaryCPU(mesh, dirtyMask);
+
+	if (recordsCPU != recordsGPU)
+	{
+		size_t firstMismatch = 0;
+		while (firstMismatch < std::min(recordsCPU.size(), recordsGPU.size()) && recordsCPU[firstMismatch] == recordsGPU[firstMismatch])
+			firstMismatch++;
+
+		std::cerr << "TileOverlapUpdater::ValidateDirtyEdges " << mesh->GetName() << ": " << recordsGPU.size() << " gpu records, "
+				  << recordsCPU.size() << " cpu records, first mismatch at " << firstMismatch << std::endl;
+		return E_FAIL;
+	}
+
+	std::cout << "dirty edges " << mesh->GetName() << ": " << statsCPU.numRecords << " / " << numPtexFaces << " faces, "
+			  << statsCPU.numEdges << " edges, " << statsCPU.numCornerFaces << " corner faces, "
+			  << numExtraordinary << " / " << mesh->GetNumExtraordinary() << " extraordinary" << std::endl;
+	return hr;
+}
+
+void TileOverlapUpdater::BuildDirtyEdgeRecordsCPU( const std::vector<SPtexNeighborData>& neighbors, const std::vector<UINT>& dirtyMask, const std::vector<uint16_t>& tileLayout,
+												   std::vector<UINT>& records, DirtyEdgeStats& stats )
+{
+	const UINT numPtexFaces = static_cast<UINT>(neighbors.size());
+	assert(dirtyMask.size() == numPtexFaces);
+
+	records.clear();
+	stats = DirtyEdgeStats();
+
+	for (UINT ptexID = 0; ptexID < numPtexFaces; ++ptexID)
+	{
+		if (!tileLayout.empty() && tileLayout[ptexID * 4 + 0] == USHRT_MAX)	// not allocated
+			continue;
+
+		const SPtexNeighborData& neigh = neighbors[ptexID];
+		UINT edges   = dirtyMask[ptexID] & DIRTY_EDGE_MASK;
+		UINT corners = dirtyMask[ptexID] & DIRTY_CORNER_MASK;
+
+		for (UINT e = 0; e < 4; ++e)
+		{
+			if (neigh.ptexIDNeighbor[e] < 0)
+				continue;
+
+			const UINT neighMask = dirtyMask[neigh.ptexIDNeighbor[e]];
+			if (neighMask & (1u << neigh.neighEdgeID[e]))
+				edges |= 1u << e;
+			corners |= neighMask & DIRTY_CORNER_MASK;
+
+			// corner overlap is copied from the overlap of the neighbors on edge 0 and 2
+			if (e % 2 == 0)
+			{
+				const SPtexNeighborData& ring = neighbors[neigh.ptexIDNeighbor[e]];
+				for (UINT k = 0; k < 4; ++k)
+				{
+					if (ring.ptexIDNeighbor[k] >= 0)
+						corners |= dirtyMask[ring.ptexIDNeighbor[k]] & DIRTY_CORNER_MASK;
+				}
+			}
+		}
+
+		if (edges == 0 && corners == 0)
+			continue;
+
+		records.push_back((ptexID << DIRTY_RECORD_SHIFT) | edges | (corners ? DIRTY_RECORD_CORNERS : 0));
+		for (UINT bits = edges; bits != 0; bits &= bits - 1)
+			stats.numEdges++;
+		stats.numCornerFaces += corners ? 1 : 0;
+		stats.numRecords++;
+	}
+}
+
+UINT TileOverlapUpdater::CountDirtyExtraordinaryCPU( DXOSDMesh* mesh, const std::vector<UINT>& dirtyMask )
+{
+	const auto& info = mesh->GetExtraordinaryInfoCPURef();
+	const auto& data = mesh->GetExtraordinaryDataCPURef();
+
+	UINT count = 0;
+	for (const auto& vertex : info)
+	{
+		for (UINT i = 0; i < vertex.valence; ++i)
+		{
+			const SExtraordinaryData& faceVertex = data[vertex.startIndex + i];
+			if (dirtyMask[faceVertex.ptexFaceID] & (1u << (DIRTY_CORNER_SHIFT + faceVertex.vertexInFace)))
+			{
+				count++;
+				break;
+			}
+		}
+	}
+	return count;
+}
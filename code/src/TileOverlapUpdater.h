@@ -18,8 +18,35 @@
 #include <DXUT.h>
 #include <SDX/DXShaderManager.h>
 
+#include <vector>
+
 // fwd decls
 class ModelInstance;
+class DXOSDMesh;
+struct SPtexNeighborData;
+
+// per ptex face dirty mask written by the tile edit and compacted records of the overlap update, see shader/DirtyEdges.h.hlsl
+enum DirtyEdgeBits
+{
+	DIRTY_EDGE_MASK			= 0xf,		// bit e: texels along edge e written
+	DIRTY_CORNER_SHIFT		= 4,		// bit 4+v: corner texel of vertex v written
+	DIRTY_CORNER_MASK		= 0xf0,
+	DIRTY_RECORD_SHIFT		= 5,		// record: ptex id << DIRTY_RECORD_SHIFT | edges to copy | DIRTY_RECORD_CORNERS
+	DIRTY_RECORD_CORNERS	= 0x10
+};
+
+// counters of the dirty edge overlap update, layout of the gpu stats buffer
+struct DirtyEdgeStats
+{
+	DirtyEdgeStats() : numEdges(0), numCornerFaces(0), numRecords(0), padding(0) {}
+
+	void Add(const DirtyEdgeStats& s)	{ numEdges += s.numEdges; numCornerFaces += s.numCornerFaces; numRecords += s.numRecords; }
+
+	UINT	numEdges;			// edges copied by OverlapEdgesCS
+	UINT	numCornerFaces;		// faces processed by OverlapCornersCS
+	UINT	numRecords;			// faces with at least one edge or corner update
+	UINT	padding;
+};
 
 
 class TileOverlapUpdater{
@@ -37,12 +64,32 @@ public:
 	void SetConstraintsOverlap(bool b) {m_constraintsMode = b;}
 	HRESULT ClearIntersectAllBuffer( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const;
 
+	// counters of the dirty edge updates since the last reset, only read back with timings enabled or SetReadbackStats(true)
+	const DirtyEdgeStats&	GetFrameStats() const	{ return m_frameStats; }
+	void					ResetFrameStats()		{ m_frameStats = DirtyEdgeStats(); }
+	void					SetReadbackStats(bool b){ m_readbackStats = b; }
+
+	// cpu reference of CompactDirtyEdgesCS, records in ptex id order. tileLayout: 4 uint16 per face as created by the memory manager, empty = all faces allocated
+	static void BuildDirtyEdgeRecordsCPU(const std::vector<SPtexNeighborData>& neighbors, const std::vector<UINT>& dirtyMask, const std::vector<uint16_t>& tileLayout,
+										 std::vector<UINT>& records, DirtyEdgeStats& stats);
+	// cpu reference of the early out in OverlapEqualizeExtraordinaryCS, number of extraordinary vertices with a written corner texel
+	static UINT CountDirtyExtraordinaryCPU(DXOSDMesh* mesh, const std::vector<UINT>& dirtyMask);
+
+	// overlap update only on the edges marked by the tile edit and the tile allocation
+	bool	UseDirtyEdges(ModelInstance* instance) const;
+
 private:
 	HRESULT UpdateOverlapDisplacementInternal(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
 	HRESULT UpdateOverlapColorInternal(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
 	HRESULT UpdateOverlapExtraordinaryCB(ID3D11DeviceContext1 *pd3dImmediateContext, UINT numExtraordinary) const;
 	HRESULT CompactIntersectAllBuffer( ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance ) const;
 
+	HRESULT CompactDirtyEdges(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
+	void	DispatchDirtyEdges(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
+	HRESULT ClearDirtyEdges(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
+	HRESULT ReadbackDirtyEdgeStats(ID3D11DeviceContext1 *pd3dImmediateContext);
+	HRESULT ValidateDirtyEdges(ID3D11DeviceContext1 *pd3dImmediateContext, ModelInstance* instance) const;
+
 	
 	Shader<ID3D11ComputeShader>		*m_updateOverlapEdgesDisplacementOSD_CS;
 	Shader<ID3D11ComputeShader>		*m_updateOverlapCornersDisplacementOSD_CS;
@@ -61,9 +108,23 @@ private:
 	
 	Shader<ID3D11ComputeShader>		*m_compactIntersectAll_CS;
 
+	// dirty edge variants, one group per compacted record
+	Shader<ID3D11ComputeShader>		*m_updateOverlapDirty_EdgesDisplacementOSD_CS;
+	Shader<ID3D11ComputeShader>		*m_updateOverlapDirty_CornersDisplacementOSD_CS;
+	Shader<ID3D11ComputeShader>		*m_updateOverlapDirty_EqualizeCornerDisplacementOSD_CS;
+
+	Shader<ID3D11ComputeShader>		*m_compactDirtyEdges_CS;
+
 	ID3D11Buffer					*m_updateExtraordinaryCB;
 	ID3D11Buffer					*m_dispatchIndirectBUF; 
 
+	ID3D11Buffer					*m_dirtyStatsBUF;
+	ID3D11UnorderedAccessView		*m_dirtyStatsUAV;
+	ID3D11Buffer					*m_dirtyStatsStagingBUF;
+
+	DirtyEdgeStats					m_frameStats;
+	bool							m_readbackStats;
+
 	bool	m_constraintsMode;
 };
 
@@ -0,0 +1,985 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "BatchSimulation.h"
+
+#include "App.h"
+#include "scene/Scene.h"
+#include "scene/DXModel.h"
+#include "dynamics/AnimationGroup.h"
+#include "dynamics/SkinningAnimation.h"
+#include "dynamics/SkinningCPU.h"
+#include "dynamics/AnimationCompression.h"
+#include "dynamics/OBBFitterCPU.h"
+#include "dynamics/AnimationLOD.h"
+#include "Pipeline.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/Timer.h"
+
+#include <SDX/DXBuffer.h>
+
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace DirectX;
+using namespace SkinningAnimationClasses;
+
+// benchmarks of the cpu animation stages.
+// the skinning benchmark skins a synthetic mesh (1..4 influences of a full SKINNING_NUM_MAX_BONES palette, some unused influences with
+// invalid bone ids) with the scalar port of SkinningCS, the avx2 blocks and the avx2 blocks in parallel chunks, into caller provided
+// arrays. the avx2 results are compared with the scalar port on the synthetic mesh and the skinned meshes of the scene, the cpu skinning with a
+// SkinningCS readback of the scene meshes.
+// the keyframe benchmark plays one synthetic clip on many characters with their own cursors and phases and compares the per frame
+// cost of the linear key scan with the cursor sampler for growing clip lengths.
+// the hierarchy benchmark evaluates a synthetic skeleton on many characters recursively, flattened and flattened in parallel jobs,
+// and checks the flattened evaluation of the scene animations against the recursive one.
+// the clip benchmark compresses the scene animations and a synthetic motion clip and compares memory, sampling error and the sampling
+// cost of many characters playing the raw and the compressed clip.
+// the obb benchmark fits the boxes of an animated synthetic mesh with pca on every frame, in parallel and with reused axes, checks the
+// extents against DXObjectOrientedBoundingBox for the fitted axes and compares cost and volume with its eigen based pca fit.
+// the lod benchmark moves the camera away from the scene characters through all lod levels and animates and skins them with and
+// without animation lod. groups at level 0 have to match the full animation.
+
+static const UINT SKINNING_BENCH_MIN_RUNS	= 5;		// runs per variant, the fastest one is reported
+static const float SKINNING_BENCH_GPU_MAX_ERROR = 1e-4f;	// SkinningCS against the cpu port, positions relative, unit normals absolute
+
+static const UINT KEYFRAME_BENCH_CHANNELS	= 32;		// animated nodes per character
+static const UINT KEYFRAME_BENCH_FRAMES		= 16;		// sampled frames per clip length
+static const UINT KEYFRAME_BENCH_MIN_KEYS	= 32;		// clip lengths from MIN_KEYS to MAX_KEYS rotation keys, factor 4
+static const UINT KEYFRAME_BENCH_MAX_KEYS	= 8192;
+static const float KEYFRAME_BENCH_FRAME_TICKS = 0.5f;	// playback advance per frame, key spacing is 0.5..1.5 ticks
+
+static const UINT HIERARCHY_BENCH_NODES		= 96;		// nodes of the synthetic skeleton
+static const UINT HIERARCHY_BENCH_SPINE		= 8;		// the first nodes form a chain
+static const UINT HIERARCHY_BENCH_KEYS		= 64;		// rotation keys per channel
+static const UINT HIERARCHY_BENCH_FRAMES	= 16;
+static const UINT HIERARCHY_BENCH_GRAIN		= 8;		// characters per parallel job
+static const float HIERARCHY_BENCH_MAX_ERROR = 1e-4f;	// flattened against recursive evaluation, relative
+
+static const UINT CLIP_BENCH_CHANNELS		= 64;
+static const UINT CLIP_BENCH_KEYS			= 1800;		// one minute at 30 keys per second
+static const UINT CLIP_BENCH_FRAMES			= 16;
+static const UINT CLIP_BENCH_ERROR_SAMPLES	= 1024;		// sampled times per channel for the error
+
+static const UINT OBB_BENCH_FRAMES			= 32;
+static const float OBB_BENCH_BONE_SPEED		= 0.02f;	// radians per frame of the synthetic bone motion
+static const float OBB_BENCH_MAX_ERROR		= 1e-4f;	// anchor, axes and covariance against the references, relative to the box size
+
+static const float LOD_BENCH_TIME_STEP		= 1.0f / 60.0f;
+static const float LOD_BENCH_SWEEP			= 1.5f;		// camera distance sweep up to this factor of the farthest lod distance
+
+namespace
+{
+
+float Random(UINT& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (1.0f / (1 << 24));
+}
+
+double TimeMS(const std::function<void()>& func)
+{
+	const double start = GetTimeMS();
+	func();
+	return GetTimeMS() - start;
+}
+
+// fastest of the runs
+double MinTimeMS(UINT numRuns, const std::function<void()>& func)
+{
+	double bestMS = DBL_MAX;
+	for (UINT r = 0; r < numRuns; ++r)
+		bestMS = std::min(bestMS, TimeMS(func));
+	return bestMS;
+}
+
+// csv file of a benchmark in the output directory, the values of a row are separated by commas
+class BenchmarkCSV
+{
+public:
+	BenchmarkCSV(const std::string& outputDir, const char* fileName, const char* header)
+		: m_file((outputDir + "/" + fileName).c_str()), m_firstValue(true)
+	{
+		m_file << header << std::endl;
+	}
+
+	template<class T>
+	BenchmarkCSV& operator<<(const T& value)
+	{
+		if (!m_firstValue) m_file << ",";
+		m_file << value;
+		m_firstValue = false;
+		return *this;
+	}
+
+	void EndRow() { m_file << std::endl; m_firstValue = true; }
+
+private:
+	std::ofstream	m_file;
+	bool			m_firstValue;
+};
+
+// prints the summary line of a benchmark, with the failure appended if the validation failed
+HRESULT ReportBenchmark(const std::ostringstream& summary, bool valid, const char* failure)
+{
+	std::cout << "batch: " << summary.str() << (valid ? "" : ", ") << (valid ? "" : failure) << std::endl;
+	return valid ? S_OK : E_FAIL;
+}
+
+// skinned meshes of the scene, their SkinningCPU gets the bone data and the current bone matrices of the group. returns the number of meshes
+UINT ForEachSkinnedSceneMesh(Scene* scene, const std::function<void(AnimationGroup* group, DXModel* mesh)>& func)
+{
+	UINT numMeshes = 0;
+	for (auto group : scene->GetAnimatedModels())
+	{
+		const SkinningMeshAnimationManager* manager = group->GetAnimationManager();
+		if (manager == NULL) continue;
+		for (auto mesh : group->triModels)
+		{
+			if (mesh->_skinningCPU == NULL || mesh->_numVertices == 0) continue;
+			mesh->_skinningCPU->SetBoneData(manager->GetBoneIDsRef(), manager->GetBoneWeightsRef());
+			mesh->_skinningCPU->SetBoneMatrices(manager->GetBoneTransformationsRef());
+			func(group, mesh);
+			numMeshes++;
+		}
+	}
+	return numMeshes;
+}
+
+void CreateSkinnedMesh(UINT numVertices, std::vector<XMFLOAT4A>& vertices, std::vector<XMFLOAT4A>& normals,
+					   std::vector<XMUINT4>& boneIDs, std::vector<XMFLOAT4A>& boneWeights, std::vector<XMMATRIX>& bones)
+{
+	UINT seed = 1;
+	vertices.resize(numVertices);
+	normals.resize(numVertices);
+	boneIDs.resize(numVertices);
+	boneWeights.resize(numVertices);
+	for (UINT i = 0; i < numVertices; ++i)
+	{
+		vertices[i] = XMFLOAT4A(Random(seed) - 0.5f, Random(seed) * 2.0f, Random(seed) - 0.5f, 1.0f);
+		normals[i]	= XMFLOAT4A(Random(seed) - 0.5f, Random(seed) - 0.5f, Random(seed) - 0.5f + 1e-3f, 0.0f);
+
+		// like VertexBoneData: used influences first, unused ones with INDEX_NOT_FOUND and weight 0
+		UINT ids[NUM_MAX_BONES_PER_VERTEX];
+		float weights[NUM_MAX_BONES_PER_VERTEX];
+		const UINT numInfluences = 1 + static_cast<UINT>(Random(seed) * NUM_MAX_BONES_PER_VERTEX) % NUM_MAX_BONES_PER_VERTEX;
+		float sum = 0.0f;
+		for (UINT k = 0; k < NUM_MAX_BONES_PER_VERTEX; ++k)
+		{
+			ids[k]		= k < numInfluences ? static_cast<UINT>(Random(seed) * SKINNING_NUM_MAX_BONES) % SKINNING_NUM_MAX_BONES : INDEX_NOT_FOUND;
+			weights[k]	= k < numInfluences ? 0.1f + Random(seed) : 0.0f;
+			sum += weights[k];
+		}
+		boneIDs[i]		= XMUINT4(ids[0], ids[1], ids[2], ids[3]);
+		boneWeights[i]	= XMFLOAT4A(weights[0] / sum, weights[1] / sum, weights[2] / sum, weights[3] / sum);
+	}
+
+	bones.resize(SKINNING_NUM_MAX_BONES);
+	for (UINT b = 0; b < SKINNING_NUM_MAX_BONES; ++b)
+	{
+		bones[b] = XMMatrixMultiply(XMMatrixRotationRollPitchYaw(Random(seed), Random(seed), Random(seed)),
+									XMMatrixTranslation(Random(seed) - 0.5f, Random(seed) - 0.5f, Random(seed) - 0.5f));
+	}
+}
+
+bool EqualSkinning(const SkinnedVerticesSoA& a, const SkinnedVerticesSoA& b)
+{
+	// bitwise, normals of vertices without influence are nan on both paths
+	const size_t bytes = a.numVertices * sizeof(float);
+	return a.numVertices == b.numVertices && (bytes == 0 ||
+		   (memcmp(&a.x[0], &b.x[0], bytes) == 0 && memcmp(&a.y[0], &b.y[0], bytes) == 0 && memcmp(&a.z[0], &b.z[0], bytes) == 0 &&
+			memcmp(&a.nx[0], &b.nx[0], bytes) == 0 && memcmp(&a.ny[0], &b.ny[0], bytes) == 0 && memcmp(&a.nz[0], &b.nz[0], bytes) == 0));
+}
+
+// all tracks of a channel are keyed independently, translations and scalings with fewer keys than the rotations. returns the duration.
+float AddKeys(NodeAnimation& channel, UINT numKeys, UINT& seed)
+{
+	float time = 0.0f;
+	for (UINT k = 0; k < numKeys; ++k, time += 0.5f + Random(seed))
+		channel.AddRotation(RotationKey(time, XMQuaternionRotationRollPitchYaw(Random(seed) * XM_2PI, Random(seed) * XM_2PI, Random(seed) * XM_2PI)));
+	float duration = channel.GetRotations().times.back();
+
+	time = 0.0f;
+	for (UINT k = 0; k < numKeys / 2 + 1; ++k, time += 1.0f + 2.0f * Random(seed))
+		channel.AddTranslation(TranslationKey(time, XMVectorSet(Random(seed) - 0.5f, Random(seed) - 0.5f, Random(seed) - 0.5f, 1.0f)));
+	duration = std::max(duration, channel.GetTranslations().times.back());
+
+	time = 0.0f;
+	for (UINT k = 0; k < numKeys / 8 + 1; ++k, time += 4.0f + 8.0f * Random(seed))
+		channel.AddScaling(ScalingKey(time, XMVectorSet(0.9f + 0.2f * Random(seed), 0.9f + 0.2f * Random(seed), 0.9f + 0.2f * Random(seed), 1.0f)));
+	return std::max(duration, channel.GetScalings().times.back());
+}
+
+void CreateKeyframeClip(UINT numKeys, std::vector<NodeAnimation>& channels, float& duration)
+{
+	UINT seed = numKeys;
+	duration = 0.0f;
+	channels.assign(KEYFRAME_BENCH_CHANNELS, NodeAnimation());
+	for (auto& channel : channels)
+		duration = std::max(duration, AddKeys(channel, numKeys, seed));
+}
+
+// skeleton with a spine chain and random branches, every fourth node without animation and every eighth one without bone
+Node* CreateSkeleton(UINT numNodes, Animation& animation, std::vector<XMMATRIX>& boneOffsets)
+{
+	UINT seed = 3;
+	std::vector<Node*> nodes;
+	UINT numChannels = 0, numBones = 0;
+	float duration = 0.0f;
+	animation.setNumChannels(numNodes);
+	for (UINT i = 0; i < numNodes; ++i)
+	{
+		Node* node = new Node("node" + std::to_string(i));
+		if (i > 0)
+		{
+			const UINT parent = i < HIERARCHY_BENCH_SPINE ? i - 1 : static_cast<UINT>(Random(seed) * i) % i;
+			nodes[parent]->addChild(node);
+		}
+		node->setTransformation(XMMatrixTranslation(Random(seed) - 0.5f, Random(seed), Random(seed) - 0.5f));
+
+		UINT channel = INDEX_NOT_FOUND;
+		if (i % 4 != 3)
+		{
+			channel = numChannels++;
+			NodeAnimation*& nodeAnimation = animation.getChannelRef(channel);
+			nodeAnimation = new NodeAnimation(node->getNodeName());
+			duration = std::max(duration, AddKeys(*nodeAnimation, HIERARCHY_BENCH_KEYS, seed));
+		}
+		node->setAnimationAndNodeAnimationIDs(0, channel);
+
+		if (i % 8 != 7)
+		{
+			node->setBoneID(numBones++);
+			boneOffsets.push_back(XMMatrixMultiply(XMMatrixRotationRollPitchYaw(Random(seed), Random(seed), Random(seed)),
+												   XMMatrixTranslation(Random(seed) - 0.5f, Random(seed) - 0.5f, Random(seed) - 0.5f)));
+		}
+		nodes.push_back(node);
+	}
+	animation.setNumChannels(numChannels);
+	animation.setDuration(duration);
+	animation.setTicksPerSecond(30.0f);
+	return nodes[0];
+}
+
+// motion capture like clip: a key every tick, smooth rotations, constant translations (bone lengths) except for the root, constant scalings
+void CreateMotionClip(UINT numChannels, UINT numKeys, Animation& animation)
+{
+	UINT seed = 5;
+	animation.setNumChannels(numChannels);
+	for (UINT c = 0; c < numChannels; ++c)
+	{
+		NodeAnimation*& nodeAnimation = animation.getChannelRef(c);
+		nodeAnimation = new NodeAnimation("channel" + std::to_string(c));
+
+		float amplitude[3], frequency[3], phase[3];
+		for (UINT a = 0; a < 3; ++a)
+		{
+			amplitude[a] = 0.2f + 0.8f * Random(seed);
+			frequency[a] = 0.01f + 0.09f * Random(seed);
+			phase[a]	 = Random(seed) * XM_2PI;
+		}
+		const XMVECTOR offset = XMVectorSet(Random(seed) - 0.5f, Random(seed), Random(seed) - 0.5f, 1.0f);
+
+		for (UINT k = 0; k < numKeys; ++k)
+		{
+			const float t = (float)k;
+			const float angles[3] = { amplitude[0] * sinf(frequency[0] * t + phase[0]), amplitude[1] * sinf(frequency[1] * t + phase[1]), amplitude[2] * sinf(frequency[2] * t + phase[2]) };
+			nodeAnimation->AddRotation(RotationKey(t, XMQuaternionRotationRollPitchYaw(angles[0], angles[1], angles[2])));
+			nodeAnimation->AddTranslation(TranslationKey(t, c == 0 ? XMVectorAdd(offset, XMVectorSet(angles[0], 0.0f, angles[1], 0.0f)) : offset));
+			nodeAnimation->AddScaling(ScalingKey(t, g_XMOne));
+		}
+	}
+	animation.setDuration((float)(numKeys - 1));
+	animation.setTicksPerSecond(30.0f);
+}
+
+// largest rotation (radians), translation and scaling error of the compressed clip against the raw keys
+void ClipError(const Animation& animation, const CompressedAnimationClip& clip, XMFLOAT3& error)
+{
+	error = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	for (UINT c = 0; c < animation.getNumChannels(); ++c)
+	{
+		const NodeAnimation* nodeAnimation = animation.getChannel(c);
+		if (nodeAnimation == NULL || nodeAnimation->GetNumRotations() == 0 || nodeAnimation->GetNumTranslations() == 0 || nodeAnimation->GetNumScalings() == 0) continue;
+
+		KeyCursor raw, compressed;
+		for (UINT s = 0; s < CLIP_BENCH_ERROR_SAMPLES; ++s)
+		{
+			const float t = animation.getDuration() * s / CLIP_BENCH_ERROR_SAMPLES;
+			error.x = std::max(error.x, CompressedAnimationClip::RotationError(SkinningMeshAnimationManager::slerpRotation(*nodeAnimation, t, raw.rotation),
+																			   clip.Sample(c, CompressedAnimationClip::ROTATION, t, compressed.rotation)));
+			error.y = std::max(error.y, XMVectorGetX(XMVector3Length(XMVectorSubtract(SkinningMeshAnimationManager::lerpTranslation(*nodeAnimation, t, raw.translation),
+																					   clip.Sample(c, CompressedAnimationClip::TRANSLATION, t, compressed.translation)))));
+			error.z = std::max(error.z, XMVectorGetX(XMVector3Length(XMVectorSubtract(SkinningMeshAnimationManager::lerpScaling(*nodeAnimation, t, raw.scaling),
+																					   clip.Sample(c, CompressedAnimationClip::SCALING, t, compressed.scaling)))));
+		}
+	}
+}
+
+// compression error within twice the key reduction tolerances, the rest is left for the quantisation
+bool ValidClipError(const CompressedAnimationClip& clip, const AnimationCompressionSettings& settings, const XMFLOAT3& error)
+{
+	return error.x <= 2.0f * settings.rotationTolerance && error.y <= 2.0f * clip.GetTranslationTolerance() + 1e-5f && error.z <= 2.0f * settings.scalingTolerance;
+}
+
+// largest difference of the bone transformations relative to their magnitude
+float BoneError(const std::vector<XMMATRIX>& a, const std::vector<XMMATRIX>& b)
+{
+	float error = a.size() == b.size() ? 0.0f : FLT_MAX;
+	for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+	{
+		for (UINT r = 0; r < 4; ++r)
+		{
+			const XMVECTOR scale = XMVectorMax(XMVectorAbs(a[i].r[r]), g_XMOne);
+			const XMVECTOR e = XMVectorDivide(XMVectorAbs(XMVectorSubtract(a[i].r[r], b[i].r[r])), scale);
+			XMFLOAT4 f;
+			XMStoreFloat4(&f, e);
+			error = std::max(error, std::max(std::max(f.x, f.y), std::max(f.z, f.w)));
+		}
+	}
+	return error;
+}
+
+// avx2 against the scalar port, restores the avx2 setting
+bool ValidateSkinning(SkinningCPU& skinning)
+{
+	if (!SkinningCPU::HasAVX2()) return true;
+
+	SkinnedVerticesSoA simd, scalar;
+	simd.Resize(skinning.GetNumVertices());
+	scalar.Resize(skinning.GetNumVertices());
+
+	const bool useAVX2 = skinning.GetUseAVX2();
+	skinning.SetUseAVX2(true);
+	skinning.Skin(SkinningOutput(simd));
+	skinning.SetUseAVX2(false);
+	skinning.Skin(SkinningOutput(scalar), false);
+	skinning.SetUseAVX2(useAVX2);
+
+	return EqualSkinning(simd, scalar);
+}
+
+// difference of a gpu and a cpu value relative to scale, normals of vertices without influence are nan on both sides
+float SkinningError(float gpu, float cpu, float scale)
+{
+	if (std::isnan(gpu) && std::isnan(cpu)) return 0.0f;
+	const float e = fabs(gpu - cpu) / scale;
+	return std::isnan(e) ? FLT_MAX : e;
+}
+
+// SkinningCS of a scene mesh against the cpu skinning with the same bone data and matrices, returns the largest error.
+// ApplySkinning dispatches _numVertices + 1 threads, the entries behind the mesh vertices are not compared
+float SkinningErrorGPU(SkinningAnimation& gpuSkinning, ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, DXModel* mesh)
+{
+	const SkinningCPU& skinning = *mesh->_skinningCPU;
+	if (skinning.GetNumVertices() != mesh->_numVertices) return FLT_MAX;
+
+	SkinnedVerticesSoA reference;
+	reference.Resize(skinning.GetNumVertices());
+	skinning.Skin(SkinningOutput(reference), false);
+
+	gpuSkinning.SkinMesh(pd3dImmediateContext, group, mesh);
+	const float* vertices	= (float*)CreateAndCopyToDebugBuf(pd3dImmediateContext, mesh->GetVertexBuffer());
+	const float* normals	= (float*)CreateAndCopyToDebugBuf(pd3dImmediateContext, mesh->GetNormalsBuffer());
+
+	float error = 0.0f;
+	for (UINT i = 0; i < reference.numVertices; ++i)
+	{
+		const float* v = &vertices[i * 4];
+		const float* n = &normals[i * 4];
+		error = std::max(error, SkinningError(v[0], reference.x[i], std::max(fabs(reference.x[i]), 1.0f)));
+		error = std::max(error, SkinningError(v[1], reference.y[i], std::max(fabs(reference.y[i]), 1.0f)));
+		error = std::max(error, SkinningError(v[2], reference.z[i], std::max(fabs(reference.z[i]), 1.0f)));
+		error = std::max(error, SkinningError(n[0], reference.nx[i], 1.0f));
+		error = std::max(error, SkinningError(n[1], reference.ny[i], 1.0f));
+		error = std::max(error, SkinningError(n[2], reference.nz[i], 1.0f));
+	}
+
+	delete[] vertices;
+	delete[] normals;
+	return error;
+}
+
+float OBBVolume(const DXObjectOrientedBoundingBox& obb)
+{
+	const XMFLOAT3 extent = obb.GetExtent();
+	return extent.x * extent.y * extent.z;
+}
+
+// largest difference of anchor and scaled axes of the fitted box to the box DXObjectOrientedBoundingBox computes for its axes,
+// relative to the largest extent
+float OBBError(const SkinnedVerticesSoA& points, const DXObjectOrientedBoundingBox& obb, std::vector<XMFLOAT3>& scratch)
+{
+	scratch.resize(points.numVertices);
+	for (UINT i = 0; i < points.numVertices; ++i) scratch[i] = XMFLOAT3(points.x[i], points.y[i], points.z[i]);
+	const DXObjectOrientedBoundingBox reference(&scratch[0], points.numVertices, obb);
+
+	XMVECTOR error = XMVectorAbs(XMVectorSubtract(obb.GetAnchor(), reference.GetAnchor()));
+	for (UINT k = 0; k < 3; ++k)
+		error = XMVectorMax(error, XMVectorAbs(XMVectorSubtract(obb.GetAxisScaled(k), reference.GetAxisScaled(k))));
+
+	const XMFLOAT3 extent = reference.GetExtent();
+	const float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+	XMFLOAT3 e;
+	XMStoreFloat3(&e, error);
+	return std::max(std::max(e.x, e.y), e.z) / size;
+}
+
+// simd covariance of OBBFitterCPU against a two pass double precision covariance, relative to the largest variance
+float CovarianceError(const SkinnedVerticesSoA& points)
+{
+	XMFLOAT3 mean;
+	float covariance[6];
+	OBBFitterCPU::ComputeCovariance(&points.x[0], &points.y[0], &points.z[0], points.numVertices, mean, covariance, true);
+
+	const UINT n = points.numVertices;
+	double m[3] = { 0.0, 0.0, 0.0 };
+	for (UINT i = 0; i < n; ++i) { m[0] += points.x[i]; m[1] += points.y[i]; m[2] += points.z[i]; }
+	for (UINT k = 0; k < 3; ++k) m[k] /= n;
+	double c[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	for (UINT i = 0; i < n; ++i)
+	{
+		const double dx = points.x[i] - m[0], dy = points.y[i] - m[1], dz = points.z[i] - m[2];
+		c[0] += dx * dx; c[1] += dy * dy; c[2] += dz * dz; c[3] += dx * dy; c[4] += dx * dz; c[5] += dy * dz;
+	}
+
+	const double scale = std::max(std::max(c[0], c[1]), std::max(c[2], 1e-12)) / n;
+	double error = std::max(std::max(fabs(mean.x - m[0]), fabs(mean.y - m[1])), fabs(mean.z - m[2])) / sqrt(scale);
+	for (UINT k = 0; k < 6; ++k) error = std::max(error, fabs(covariance[k] - c[k] / n) / scale);
+	return (float)error;
+}
+
+}
+
+HRESULT BatchSimulation::RunSkinningBenchmark()
+{
+	if (m_scenario.skinningBenchVertices == 0) return S_OK;
+
+	bool valid = true;
+
+	SkinningAnimation gpuSkinning;
+	V_RETURN(gpuSkinning.Create(DXUTGetD3D11Device()));
+
+	// skinned meshes of the scene with their current bone matrices
+	float gpuError = 0.0f;
+	const UINT numSceneMeshes = ForEachSkinnedSceneMesh(m_scene, [&](AnimationGroup* group, DXModel* mesh)
+	{
+		if (!ValidateSkinning(*mesh->_skinningCPU))
+		{
+			std::cerr << "batch: cpu skinning of a scene mesh with " << mesh->_numVertices << " vertices differs from the scalar port" << std::endl;
+			valid = false;
+		}
+		const float error = SkinningErrorGPU(gpuSkinning, DXUTGetD3D11DeviceContext(), group, mesh);
+		if (error > SKINNING_BENCH_GPU_MAX_ERROR)
+		{
+			std::cerr << "batch: SkinningCS of a scene mesh with " << mesh->_numVertices << " vertices differs from the cpu skinning, error " << error << std::endl;
+			valid = false;
+		}
+		gpuError = std::max(gpuError, error);
+	});
+
+	std::vector<XMFLOAT4A> vertices, normals, boneWeights;
+	std::vector<XMUINT4> boneIDs;
+	std::vector<XMMATRIX> bones;
+	CreateSkinnedMesh(m_scenario.skinningBenchVertices, vertices, normals, boneIDs, boneWeights, bones);
+
+	SkinningCPU skinning;
+	skinning.SetBasePose(vertices, normals);
+	skinning.SetBoneData(boneIDs, boneWeights);
+	skinning.SetBoneMatrices(bones);
+	valid &= ValidateSkinning(skinning);
+
+	// caller provided output, like a collision proxy skinning into its own arrays
+	SkinnedVerticesSoA output;
+	output.Resize(skinning.GetNumVertices());
+	const SkinningOutput out(output);
+
+	auto timeSkinning = [&](bool useAVX2, bool parallel)
+	{
+		skinning.SetUseAVX2(useAVX2);
+		return MinTimeMS(SKINNING_BENCH_MIN_RUNS, [&]{ skinning.Skin(out, parallel); });
+	};
+
+	const double scalarMS	= timeSkinning(false, false);
+	const double simdMS		= timeSkinning(true, false);
+	const double parallelMS	= timeSkinning(true, true);
+	skinning.SetUseAVX2(true);
+
+	// million vertices per second
+	const double numVertices = skinning.GetNumVertices();
+	BenchmarkCSV csv(m_scenario.outputDir, "skinning_bench.csv", "vertices,bones,threads,avx2,scene_meshes,scalar_ms,simd_ms,parallel_ms,scalar_mvps,simd_mvps,parallel_mvps,gpu_error,matches");
+	csv << skinning.GetNumVertices() << SKINNING_NUM_MAX_BONES << g_workStealingPool.GetNumThreads() << (skinning.GetUseAVX2() ? 1 : 0) << numSceneMeshes
+		<< scalarMS << simdMS << parallelMS << numVertices / (scalarMS * 1e3) << numVertices / (simdMS * 1e3) << numVertices / (parallelMS * 1e3) << gpuError << (valid ? 1 : 0);
+	csv.EndRow();
+
+	std::ostringstream summary;
+	summary << "cpu skinning of " << skinning.GetNumVertices() << " vertices, scalar " << scalarMS << " ms, " << (skinning.GetUseAVX2() ? "avx2 " : "no avx2, scalar ")
+			<< simdMS << " ms, parallel " << parallelMS << " ms (" << numVertices / (parallelMS * 1e3) << " M vertices/s)";
+	return ReportBenchmark(summary, valid, "results differ");
+}
+
+HRESULT BatchSimulation::RunKeyframeBenchmark()
+{
+	if (m_scenario.keyframeBenchCharacters == 0) return S_OK;
+
+	const UINT numCharacters = m_scenario.keyframeBenchCharacters;
+	const UINT numSamples = numCharacters * KEYFRAME_BENCH_CHANNELS * 3;
+
+	BenchmarkCSV csv(m_scenario.outputDir, "keyframe_bench.csv", "rotation_keys,characters,channels,frames,linear_ms,cursor_ms,speedup,matches");
+
+	bool valid = true;
+	double linearFirstMS = 0.0, linearLastMS = 0.0, cursorFirstMS = 0.0, cursorLastMS = 0.0;
+
+	for (UINT numKeys = KEYFRAME_BENCH_MIN_KEYS; numKeys <= KEYFRAME_BENCH_MAX_KEYS; numKeys *= 4)
+	{
+		std::vector<NodeAnimation> channels;
+		float duration;
+		CreateKeyframeClip(numKeys, channels, duration);
+
+		// every character plays the clip with its own phase, so loops and seeks happen on different frames
+		UINT seed = 7;
+		std::vector<float> phases(numCharacters);
+		for (auto& phase : phases) phase = Random(seed) * duration;
+		std::vector<KeyCursor> cursors(numCharacters * KEYFRAME_BENCH_CHANNELS);
+
+		std::vector<XMFLOAT4A> linear(numSamples), cursor(numSamples);
+		auto sampleFrame = [&](UINT frame, std::vector<XMFLOAT4A>& out, bool useCursors)
+		{
+			for (UINT c = 0; c < numCharacters; ++c)
+			{
+				const float t = fmod(phases[c] + frame * KEYFRAME_BENCH_FRAME_TICKS, duration);
+				for (UINT n = 0; n < KEYFRAME_BENCH_CHANNELS; ++n)
+				{
+					const NodeAnimation& channel = channels[n];
+					KeyCursor& keyCursor = cursors[c * KEYFRAME_BENCH_CHANNELS + n];
+					XMFLOAT4A* o = &out[(c * KEYFRAME_BENCH_CHANNELS + n) * 3];
+					XMStoreFloat4A(&o[0], SkinningMeshAnimationManager::sampleTrack(channel.GetRotations(),		t, useCursors ? &keyCursor.rotation : NULL, true));
+					XMStoreFloat4A(&o[1], SkinningMeshAnimationManager::sampleTrack(channel.GetTranslations(),	t, useCursors ? &keyCursor.translation : NULL, false));
+					XMStoreFloat4A(&o[2], SkinningMeshAnimationManager::sampleTrack(channel.GetScalings(),		t, useCursors ? &keyCursor.scaling : NULL, false));
+				}
+			}
+		};
+
+		double linearMS = 0.0, cursorMS = 0.0;
+		bool matches = true;
+		for (UINT frame = 0; frame < KEYFRAME_BENCH_FRAMES; ++frame)
+		{
+			linearMS += TimeMS([&]{ sampleFrame(frame, linear, false); });
+			cursorMS += TimeMS([&]{ sampleFrame(frame, cursor, true); });
+
+			// both find the same key interval, so the results are bitwise equal
+			matches &= memcmp(&linear[0], &cursor[0], numSamples * sizeof(XMFLOAT4A)) == 0;
+		}
+		linearMS /= KEYFRAME_BENCH_FRAMES;
+		cursorMS /= KEYFRAME_BENCH_FRAMES;
+		valid &= matches;
+
+		if (numKeys == KEYFRAME_BENCH_MIN_KEYS) { linearFirstMS = linearMS; cursorFirstMS = cursorMS; }
+		linearLastMS = linearMS;
+		cursorLastMS = cursorMS;
+
+		csv << numKeys << numCharacters << KEYFRAME_BENCH_CHANNELS << KEYFRAME_BENCH_FRAMES << linearMS << cursorMS << linearMS / std::max(cursorMS, 1e-6) << (matches ? 1 : 0);
+		csv.EndRow();
+	}
+
+	std::ostringstream summary;
+	summary << "keyframe sampling of " << numCharacters << " characters, " << KEYFRAME_BENCH_MIN_KEYS << " to " << KEYFRAME_BENCH_MAX_KEYS << " keys per frame: linear "
+			<< linearFirstMS << " to " << linearLastMS << " ms, cursor " << cursorFirstMS << " to " << cursorLastMS << " ms";
+	return ReportBenchmark(summary, valid, "results differ");
+}
+
+HRESULT BatchSimulation::RunHierarchyBenchmark()
+{
+	if (m_scenario.hierarchyBenchCharacters == 0) return S_OK;
+
+	const UINT numCharacters = m_scenario.hierarchyBenchCharacters;
+
+	float maxError = 0.0f;
+
+	// scene animations, flattened against recursive
+	UINT numSceneGroups = 0;
+	std::vector<XMMATRIX> reference;
+	for (auto group : m_scene->GetAnimatedModels())
+	{
+		SkinningMeshAnimationManager* manager = group->GetAnimationManager();
+		if (manager == NULL || manager->GetAnimationsRef().empty()) continue;
+		for (UINT frame = 0; frame < HIERARCHY_BENCH_FRAMES; ++frame)
+		{
+			const float t = frame * 0.1f;
+			manager->computeAnimationReference(group->GetCurrentAnimation(), t, reference);
+			manager->computeAnimation(group->GetCurrentAnimation(), t);
+			maxError = std::max(maxError, BoneError(reference, manager->GetBoneTransformationsRef()));
+		}
+		numSceneGroups++;
+	}
+
+	// synthetic characters sharing skeleton and clip, every one with its own phase, cursors and scratch
+	Animation animation;
+	std::vector<XMMATRIX> boneOffsets;
+	Node* root = CreateSkeleton(HIERARCHY_BENCH_NODES, animation, boneOffsets);
+	const XMMATRIX globalInverse = XMMatrixTranslation(0.0f, -0.5f, 0.0f);
+	const UINT numBones = static_cast<UINT>(boneOffsets.size());
+
+	NodeHierarchy hierarchy;
+	hierarchy.Compile(*root);
+
+	UINT seed = 11;
+	std::vector<float> phases(numCharacters);
+	for (auto& phase : phases) phase = Random(seed) * animation.getDuration();
+	std::vector<std::vector<KeyCursor>> cursors(numCharacters, std::vector<KeyCursor>(animation.getNumChannels()));
+	std::vector<std::vector<XMMATRIX>> globals(numCharacters, std::vector<XMMATRIX>(hierarchy.size()));
+	std::vector<std::vector<XMMATRIX>> recursive(numCharacters, std::vector<XMMATRIX>(numBones)), flat(recursive), parallel(recursive);
+
+	auto characterTime = [&](UINT c, UINT frame) { return fmod(phases[c] + frame * KEYFRAME_BENCH_FRAME_TICKS, animation.getDuration()); };
+	auto evaluate = [&](UINT c, UINT frame, std::vector<XMMATRIX>& bones)
+	{
+		SkinningMeshAnimationManager::evaluateHierarchy(hierarchy, animation, cursors[c].data(), globals[c], characterTime(c, frame), globalInverse, boneOffsets, bones);
+	};
+
+	double recursiveMS = 0.0, flatMS = 0.0, parallelMS = 0.0;
+	bool matches = true;
+	for (UINT frame = 0; frame < HIERARCHY_BENCH_FRAMES; ++frame)
+	{
+		recursiveMS += TimeMS([&]
+		{
+			for (UINT c = 0; c < numCharacters; ++c)
+				SkinningMeshAnimationManager::traverseAndAnimateNodeHierachy(*root, animation, cursors[c].data(), characterTime(c, frame), XMMatrixIdentity(), globalInverse, boneOffsets, recursive[c]);
+		});
+
+		flatMS += TimeMS([&]
+		{
+			for (UINT c = 0; c < numCharacters; ++c)
+				evaluate(c, frame, flat[c]);
+		});
+
+		parallelMS += TimeMS([&]
+		{
+			g_workStealingPool.ParallelFor(numCharacters, HIERARCHY_BENCH_GRAIN, [&](UINT begin, UINT end)
+			{
+				for (UINT c = begin; c < end; ++c)
+					evaluate(c, frame, parallel[c]);
+			});
+		});
+
+		for (UINT c = 0; c < numCharacters; ++c)
+		{
+			maxError = std::max(maxError, BoneError(recursive[c], flat[c]));
+			matches &= memcmp(flat[c].data(), parallel[c].data(), numBones * sizeof(XMMATRIX)) == 0;
+		}
+	}
+	delete root;
+
+	recursiveMS /= HIERARCHY_BENCH_FRAMES;
+	flatMS /= HIERARCHY_BENCH_FRAMES;
+	parallelMS /= HIERARCHY_BENCH_FRAMES;
+	const bool valid = matches && maxError <= HIERARCHY_BENCH_MAX_ERROR;
+
+	BenchmarkCSV csv(m_scenario.outputDir, "hierarchy_bench.csv", "characters,nodes,bones,threads,frames,scene_groups,recursive_ms,flat_ms,parallel_ms,max_error,matches");
+	csv << numCharacters << hierarchy.size() << numBones << g_workStealingPool.GetNumThreads() << HIERARCHY_BENCH_FRAMES << numSceneGroups
+		<< recursiveMS << flatMS << parallelMS << maxError << (valid ? 1 : 0);
+	csv.EndRow();
+
+	std::ostringstream summary;
+	summary << "bone hierarchy of " << numCharacters << " characters with " << hierarchy.size() << " nodes per frame, recursive " << recursiveMS
+			<< " ms, flattened " << flatMS << " ms, parallel " << parallelMS << " ms, max error " << maxError;
+	return ReportBenchmark(summary, valid, "results differ");
+}
+
+HRESULT BatchSimulation::RunClipBenchmark()
+{
+	if (m_scenario.clipBenchCharacters == 0) return S_OK;
+
+	const UINT numCharacters = m_scenario.clipBenchCharacters;
+	const AnimationCompressionSettings settings;
+
+	BenchmarkCSV csv(m_scenario.outputDir, "clip_bench.csv",
+					 "clip,channels,source_keys,keys,raw_bytes,bytes,ratio,max_rotation_error,max_translation_error,max_scaling_error,raw_ms,compressed_ms,valid");
+
+	bool valid = true;
+	size_t sceneRawBytes = 0, sceneBytes = 0;
+
+	// raw scene animations, the ones compressed at import have no keys left to compare with
+	UINT sceneClip = 0;
+	for (auto group : m_scene->GetAnimatedModels())
+	{
+		const SkinningMeshAnimationManager* manager = group->GetAnimationManager();
+		if (manager == NULL) continue;
+		for (auto animation : manager->GetAnimationsRef())
+		{
+			if (animation == NULL || animation->getCompressedClip()) continue;
+
+			CompressedAnimationClip clip;
+			if (FAILED(clip.Create(*animation, settings))) { valid = false; continue; }
+			XMFLOAT3 error;
+			ClipError(*animation, clip, error);
+			const bool clipValid = ValidClipError(clip, settings, error);
+			valid &= clipValid;
+
+			const size_t rawBytes = CompressedAnimationClip::GetRawBytes(*animation);
+			sceneRawBytes += rawBytes;
+			sceneBytes += clip.GetNumBytes();
+			csv << "scene" + std::to_string(sceneClip++) << clip.GetNumChannels() << clip.GetNumSourceKeys() << clip.GetNumKeys() << rawBytes << clip.GetNumBytes()
+				<< (double)rawBytes / std::max<size_t>(clip.GetNumBytes(), 1) << error.x << error.y << error.z << 0 << 0 << (clipValid ? 1 : 0);
+			csv.EndRow();
+		}
+	}
+
+	// synthetic clip, raw and compressed animation
+	Animation raw, compressed;
+	CreateMotionClip(CLIP_BENCH_CHANNELS, CLIP_BENCH_KEYS, raw);
+	CreateMotionClip(CLIP_BENCH_CHANNELS, CLIP_BENCH_KEYS, compressed);
+	const size_t rawBytes = CompressedAnimationClip::GetRawBytes(raw);
+	compressed.compress(settings);
+	const CompressedAnimationClip* clip = compressed.getCompressedClip();
+	if (clip == NULL) return E_FAIL;
+
+	XMFLOAT3 error;
+	ClipError(raw, *clip, error);
+	bool clipValid = ValidClipError(*clip, settings, error);
+
+	// every character plays the clip with its own phase and cursors
+	UINT seed = 13;
+	std::vector<float> phases(numCharacters);
+	for (auto& phase : phases) phase = Random(seed) * raw.getDuration();
+	std::vector<KeyCursor> rawCursors(numCharacters * CLIP_BENCH_CHANNELS), compressedCursors(rawCursors);
+	const UINT numSamples = numCharacters * CLIP_BENCH_CHANNELS * 3;
+	std::vector<XMFLOAT4A> rawPoses(numSamples), compressedPoses(numSamples);
+
+	auto sampleFrame = [&](const Animation& animation, UINT frame, std::vector<KeyCursor>& cursors, std::vector<XMFLOAT4A>& poses)
+	{
+		for (UINT c = 0; c < numCharacters; ++c)
+		{
+			const float t = fmod(phases[c] + frame * KEYFRAME_BENCH_FRAME_TICKS, animation.getDuration());
+			for (UINT n = 0; n < CLIP_BENCH_CHANNELS; ++n)
+			{
+				const UINT index = c * CLIP_BENCH_CHANNELS + n;
+				XMVECTOR rotation, translation, scaling;
+				SkinningMeshAnimationManager::sampleChannel(animation, n, t, cursors[index], rotation, translation, scaling);
+				XMStoreFloat4A(&poses[index * 3 + 0], rotation);
+				XMStoreFloat4A(&poses[index * 3 + 1], translation);
+				XMStoreFloat4A(&poses[index * 3 + 2], scaling);
+			}
+		}
+	};
+
+	double rawMS = 0.0, compressedMS = 0.0;
+	for (UINT frame = 0; frame < CLIP_BENCH_FRAMES; ++frame)
+	{
+		rawMS += TimeMS([&]{ sampleFrame(raw, frame, rawCursors, rawPoses); });
+		compressedMS += TimeMS([&]{ sampleFrame(compressed, frame, compressedCursors, compressedPoses); });
+	}
+	rawMS /= CLIP_BENCH_FRAMES;
+	compressedMS /= CLIP_BENCH_FRAMES;
+	valid &= clipValid;
+
+	csv << "synthetic" << clip->GetNumChannels() << clip->GetNumSourceKeys() << clip->GetNumKeys() << rawBytes << clip->GetNumBytes()
+		<< (double)rawBytes / std::max<size_t>(clip->GetNumBytes(), 1) << error.x << error.y << error.z << rawMS << compressedMS << (clipValid ? 1 : 0);
+	csv.EndRow();
+
+	// million channel samples (rotation, translation and scaling) per second
+	const double numChannelSamples = numCharacters * CLIP_BENCH_CHANNELS;
+	std::ostringstream summary;
+	summary << "animation clips, scene " << sceneRawBytes << " -> " << sceneBytes << " bytes, synthetic " << rawBytes << " -> " << clip->GetNumBytes()
+			<< " bytes, " << numCharacters << " characters raw " << rawMS << " ms (" << numChannelSamples / (rawMS * 1e3) << " M/s), compressed " << compressedMS
+			<< " ms (" << numChannelSamples / (compressedMS * 1e3) << " M/s)";
+	return ReportBenchmark(summary, valid, "error above tolerance");
+}
+
+HRESULT BatchSimulation::RunOBBBenchmark()
+{
+	if (m_scenario.obbBenchVertices == 0) return S_OK;
+
+	bool valid = true;
+	float maxError = 0.0f;
+	std::vector<XMFLOAT3> points;
+
+	// skinned meshes of the scene with their current bone matrices
+	const UINT numSceneMeshes = ForEachSkinnedSceneMesh(m_scene, [&](AnimationGroup* group, DXModel* mesh)
+	{
+		mesh->_skinningCPU->Skin();
+
+		OBBFitterCPU fitter;
+		DXObjectOrientedBoundingBox obb;
+		fitter.Fit(mesh->_skinningCPU->GetSkinnedVertices(), obb);
+		const float error = std::max(OBBError(mesh->_skinningCPU->GetSkinnedVertices(), obb, points), CovarianceError(mesh->_skinningCPU->GetSkinnedVertices()));
+		if (error > OBB_BENCH_MAX_ERROR)
+		{
+			std::cerr << "batch: obb of a scene mesh with " << mesh->_numVertices << " vertices differs from the reference by " << error << std::endl;
+			valid = false;
+		}
+		maxError = std::max(maxError, error);
+	});
+
+	std::vector<XMFLOAT4A> vertices, normals, boneWeights;
+	std::vector<XMUINT4> boneIDs;
+	std::vector<XMMATRIX> bones, frameBones;
+	CreateSkinnedMesh(m_scenario.obbBenchVertices, vertices, normals, boneIDs, boneWeights, bones);
+
+	SkinningCPU skinning;
+	skinning.SetBasePose(vertices, normals);
+	skinning.SetBoneData(boneIDs, boneWeights);
+	const SkinnedVerticesSoA& skinned = skinning.GetSkinnedVertices();
+
+	OBBFitterCPU pcaFitter, parallelFitter, reuseFitter;
+	pcaFitter.SetReuseTolerance(0.0f);
+	parallelFitter.SetReuseTolerance(0.0f);
+
+	double pcaMS = 0.0, parallelMS = 0.0, reuseMS = 0.0, referenceMS = 0.0;
+	double volumeOverhead = 0.0, maxVolumeOverhead = 0.0, referenceRatio = 0.0;
+	UINT numReused = 0;
+	for (UINT frame = 0; frame < OBB_BENCH_FRAMES; ++frame)
+	{
+		// every bone turns with its own speed, the mesh deforms smoothly over the frames
+		frameBones.resize(bones.size());
+		for (size_t b = 0; b < bones.size(); ++b)
+			frameBones[b] = XMMatrixMultiply(XMMatrixRotationY(OBB_BENCH_BONE_SPEED * frame * ((b % 7) - 3.0f)), bones[b]);
+		skinning.SetBoneMatrices(frameBones);
+		skinning.Skin();
+
+		DXObjectOrientedBoundingBox pcaOBB, parallelOBB, reuseOBB, referenceOBB;
+		pcaMS		+= TimeMS([&]{ pcaFitter.Fit(skinned, pcaOBB, false); });
+		parallelMS	+= TimeMS([&]{ parallelFitter.Fit(skinned, parallelOBB, true); });
+		reuseMS		+= TimeMS([&]{ reuseFitter.Fit(skinned, reuseOBB, true); });
+		if (reuseFitter.WasReused()) numReused++;
+
+		points.resize(skinned.numVertices);
+		for (UINT i = 0; i < skinned.numVertices; ++i) points[i] = XMFLOAT3(skinned.x[i], skinned.y[i], skinned.z[i]);
+		referenceMS	+= TimeMS([&]{ referenceOBB.ComputeFromPCA(&points[0], skinned.numVertices); });
+
+		const float error = std::max(std::max(OBBError(skinned, pcaOBB, points), OBBError(skinned, parallelOBB, points)),
+									 std::max(OBBError(skinned, reuseOBB, points), CovarianceError(skinned)));
+		maxError = std::max(maxError, error);
+
+		const double overhead = OBBVolume(reuseOBB) / OBBVolume(pcaOBB) - 1.0;
+		volumeOverhead += overhead;
+		maxVolumeOverhead = std::max(maxVolumeOverhead, overhead);
+		referenceRatio += OBBVolume(pcaOBB) / OBBVolume(referenceOBB);
+	}
+	pcaMS /= OBB_BENCH_FRAMES;
+	parallelMS /= OBB_BENCH_FRAMES;
+	reuseMS /= OBB_BENCH_FRAMES;
+	referenceMS /= OBB_BENCH_FRAMES;
+	volumeOverhead /= OBB_BENCH_FRAMES;
+	referenceRatio /= OBB_BENCH_FRAMES;
+	valid &= maxError <= OBB_BENCH_MAX_ERROR;
+
+	BenchmarkCSV csv(m_scenario.outputDir, "obb_bench.csv",
+					 "vertices,frames,threads,scene_meshes,reference_ms,pca_ms,parallel_ms,reuse_ms,reused_frames,volume_overhead,max_volume_overhead,reference_volume_ratio,max_error,valid");
+	csv << skinned.numVertices << OBB_BENCH_FRAMES << g_workStealingPool.GetNumThreads() << numSceneMeshes << referenceMS << pcaMS << parallelMS << reuseMS << numReused
+		<< volumeOverhead << maxVolumeOverhead << referenceRatio << maxError << (valid ? 1 : 0);
+	csv.EndRow();
+
+	std::ostringstream summary;
+	summary << "obb of " << skinned.numVertices << " vertices, reference pca " << referenceMS << " ms, pca " << pcaMS << " ms, parallel " << parallelMS
+			<< " ms, reused axes " << reuseMS << " ms (" << numReused << "/" << OBB_BENCH_FRAMES << " frames, " << volumeOverhead * 100.0 << "% volume)";
+	return ReportBenchmark(summary, valid, "boxes differ from the reference");
+}
+
+HRESULT BatchSimulation::RunAnimationLODBenchmark()
+{
+	if (m_scenario.lodBenchFrames == 0) return S_OK;
+
+	const std::vector<AnimationGroup*>& groups = m_scene->GetAnimatedModels();
+	const UINT numFrames = m_scenario.lodBenchFrames;
+	const UINT numGroups = static_cast<UINT>(groups.size());
+	if (numGroups == 0)
+	{
+		std::cout << "batch: no animated groups for the lod benchmark" << std::endl;
+		return S_OK;
+	}
+
+	const AnimationLODSettings& settings = g_animationLOD.GetSettings();
+	const float maxDistance = LOD_BENCH_SWEEP * std::max(settings.levels.empty() ? 0.0f : settings.levels.back().distance, 1.0f);
+	const XMVECTOR origin = groups[0]->GetModelMatrix().r[3];
+	const bool useLOD = g_app.g_useAnimationLOD;
+	g_animationLOD.Reset(groups);
+
+	BenchmarkCSV csv(m_scenario.outputDir, "lod_bench.csv",
+					 "frame,distance,groups,updated,interpolated,held,touching,sampled_channels,skipped_channels,full_ms,lod_ms,saved_ms_estimate,full_skinning_ms,lod_skinning_ms,skipped_vertices,skipped_dispatches,max_bone_error");
+
+	// the full animation overwrites the bone matrices, the held groups get theirs back before the lod run
+	std::vector<std::vector<XMMATRIX>> reference(numGroups), lodBones(numGroups);
+
+	bool valid = true;
+	double fullMS = 0.0, lodMS = 0.0, fullSkinningMS = 0.0, lodSkinningMS = 0.0, savedMS = 0.0;
+	UINT numUpdated = 0;
+	for (UINT frame = 0; frame < numFrames; ++frame)
+	{
+		const float t = frame * LOD_BENCH_TIME_STEP;
+		const float distance = maxDistance * frame / std::max(numFrames - 1, 1u);
+
+		g_app.g_useAnimationLOD = false;
+		const double frameFullMS			= TimeMS([&]{ SkinningAnimation::ComputeAnimations(groups, t); });
+		const double frameFullSkinningMS	= TimeMS([&]{ SkinningAnimation::ApplySkinningCPU(groups); });
+		for (UINT g = 0; g < numGroups; ++g)
+		{
+			if (groups[g]->GetAnimationManager() == NULL) continue;
+			reference[g] = groups[g]->GetAnimationManager()->GetBoneTransformationsRef();
+			if (frame > 0) groups[g]->GetAnimationManager()->GetBoneTransformationsRef() = lodBones[g];
+		}
+
+		g_app.g_useAnimationLOD = true;
+		g_animationLOD.SelectLevels(groups, XMVectorAdd(origin, XMVectorSet(distance, 0.0f, 0.0f, 0.0f)), g_deformationPipeline.GetCollisionPairs());
+		const double frameLodMS				= TimeMS([&]{ SkinningAnimation::ComputeAnimations(groups, t); });
+		const double frameLodSkinningMS		= TimeMS([&]{ SkinningAnimation::ApplySkinningCPU(groups); });
+
+		float maxBoneError = 0.0f;
+		for (UINT g = 0; g < numGroups; ++g)
+		{
+			if (groups[g]->GetAnimationManager() == NULL) continue;
+			lodBones[g] = groups[g]->GetAnimationManager()->GetBoneTransformationsRef();
+			const float error = BoneError(reference[g], lodBones[g]);
+			maxBoneError = std::max(maxBoneError, error);
+
+			// full rate and all bones, the same evaluation as without lod
+			const AnimationLODState& state = groups[g]->GetLODState();
+			const AnimationLODLevel& level = settings.levels[std::min<size_t>(state.level, settings.levels.size() - 1)];
+			if (level.updateInterval <= 1 && level.maxBoneDepth == INDEX_NOT_FOUND && error > HIERARCHY_BENCH_MAX_ERROR)
+			{
+				std::cerr << "batch: animation lod of group " << g << " differs from the full animation at level " << state.level << std::endl;
+				valid = false;
+			}
+		}
+
+		const AnimationLODStats& stats = g_animationLOD.GetStats();
+		if (stats.numUpdated + stats.numInterpolated + stats.numHeld != stats.numGroups) valid = false;
+
+		fullMS += frameFullMS;
+		lodMS += frameLodMS;
+		fullSkinningMS += frameFullSkinningMS;
+		lodSkinningMS += frameLodSkinningMS;
+		savedMS += stats.savedAnimationMS;
+		numUpdated += stats.numUpdated;
+
+		csv << frame << distance << stats.numGroups << stats.numUpdated << stats.numInterpolated << stats.numHeld << stats.numTouching << stats.numSampled << stats.numSkipped
+			<< frameFullMS << frameLodMS << stats.savedAnimationMS << frameFullSkinningMS << frameLodSkinningMS << stats.numSkippedVertices << stats.numSkippedDispatches << maxBoneError;
+		csv.EndRow();
+	}
+
+	g_app.g_useAnimationLOD = useLOD;
+	g_animationLOD.Reset(groups);
+
+	std::ostringstream summary;
+	summary << "animation lod over " << numFrames << " frames, " << numUpdated << "/" << numFrames * numGroups << " group updates, animation "
+			<< fullMS / numFrames << " -> " << lodMS / numFrames << " ms (estimated saving " << savedMS / numFrames << " ms), cpu skinning "
+			<< fullSkinningMS / numFrames << " -> " << lodSkinningMS / numFrames << " ms";
+	return ReportBenchmark(summary, valid, "lod differs from the full animation");
+}
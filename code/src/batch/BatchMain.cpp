@@ -0,0 +1,158 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include <DXUT.h>
+#include <SDX/DXTextureCache.h>
+
+#include "App.h"
+#include "Pipeline.h"
+#include "TileEdit.h"
+#include "IntersectPatches.h"
+#include "MemoryManager.h"
+#include "TileOverlapUpdater.h"
+#include "Voxelization.h"
+
+#include "rendering/RendererTri.h"
+#include "rendering/RendererSubD.h"
+
+#include "compute/ComputeBackendD3D11.h"
+#include "compute/ComputeBackendCPU.h"
+#include "scene/AsyncModelLoader.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/Profiler.h"
+
+#include "BatchSimulation.h"
+
+// headless runner: DXUT only provides the device (hidden window, tiny back buffer), no render loop and no ui.
+// each process writes to its own output directory, so many scenarios can run side by side.
+// shaders are compiled into the shared shader cache on first use, the cache files are replaced atomically (see DXShaderManager),
+// so parallel processes compiling the same shader at most do the work twice.
+
+BatchScenario	g_batchScenario;
+BatchSimulation g_batchSimulation;
+HRESULT			g_batchResult = S_OK;
+
+bool CALLBACK IsD3D11DeviceAcceptable(const CD3D11EnumAdapterInfo *AdapterInfo, UINT Output, const CD3D11EnumDeviceInfo *DeviceInfo,
+									  DXGI_FORMAT BackBufferFormat, bool bWindowed, void* pUserContext)
+{
+	return true;
+}
+
+bool CALLBACK ModifyDeviceSettings(DXUTDeviceSettings* pDeviceSettings, void* pUserContext)
+{
+	if (g_batchScenario.useWarp)
+		pDeviceSettings->d3d11.DriverType = D3D_DRIVER_TYPE_WARP;
+
+	pDeviceSettings->d3d11.SyncInterval = 0;
+	pDeviceSettings->d3d11.sd.SampleDesc.Count = 1;
+	pDeviceSettings->d3d11.sd.SampleDesc.Quality = 0;
+	return true;
+}
+
+HRESULT CALLBACK OnD3D11CreateDevice(ID3D11Device1* pd3dDevice, const DXGI_SURFACE_DESC* pBackBufferSurfaceDesc, void* pUserContext)
+{
+	g_batchResult = g_batchSimulation.Create(pd3dDevice, DXUTGetD3D11DeviceContext(), g_batchScenario);
+	if (FAILED(g_batchResult))
+		std::cerr << "batch: setup failed" << std::endl;
+
+	// do not fail device creation, DXUT would show a message box
+	return S_OK;
+}
+
+void CALLBACK OnD3D11DestroyDevice(void* pUserContext)
+{
+	g_batchSimulation.Destroy();
+
+	g_app.Destroy();
+	g_voxelization.Destroy();
+	g_renderTriMeshes.Destroy();
+	g_rendererSubD.Destroy();
+	g_shaderManager.Destroy();
+	g_textureManager.Destroy();
+	g_memoryManager.Destroy();
+	g_deformation.Destroy();
+	g_intersectGPU.Destroy();
+	g_overlapUpdater.Destroy();
+	g_computeBackendD3D11.Destroy();
+	g_computeBackendCPU.Destroy();
+	g_profiler.Destroy();
+	g_modelLoader.Destroy();
+	g_workStealingPool.Destroy();
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	if (!g_batchScenario.Parse(argc, argv))
+	{
+		BatchScenario::PrintUsage();
+		return 1;
+	}
+
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	ApplyGlobalSettings();
+	g_app.g_bRunSimulation = true;
+
+	DXUTSetCallbackDeviceChanging(ModifyDeviceSettings);
+	DXUTSetCallbackD3D11DeviceAcceptable(IsD3D11DeviceAcceptable);
+	DXUTSetCallbackD3D11DeviceCreated(OnD3D11CreateDevice);
+	DXUTSetCallbackD3D11DeviceDestroyed(OnD3D11DestroyDevice);
+
+	DXUTInit(false, false);
+	DXUTCreateWindow(L"DeformationGPU Batch");
+	if (FAILED(DXUTCreateDevice(D3D_FEATURE_LEVEL_11_0, true, 64, 64)))
+	{
+		std::cerr << "batch: could not create a d3d11 device" << std::endl;
+		return 1;
+	}
+	ShowWindow(DXUTGetHWND(), SW_HIDE);
+
+	if (SUCCEEDED(g_batchResult))
+		g_batchResult = g_batchSimulation.Run(DXUTGetD3D11Device(), DXUTGetD3D11DeviceContext());
+
+	if (SUCCEEDED(g_batchResult))
+		g_batchResult = g_batchSimulation.WriteResults(DXUTGetD3D11DeviceContext());
+
+	// job scaling and the benchmarks after the scenario, in this order. each one returns S_OK right away when its option is not set
+	typedef HRESULT (BatchSimulation::*Benchmark)();
+	static const Benchmark benchmarks[] =
+	{
+		&BatchSimulation::RunJobScaling,
+		&BatchSimulation::RunPairCacheBenchmark,
+		&BatchSimulation::RunSubdivisionBenchmark,
+		&BatchSimulation::RunStencilBenchmark,
+		&BatchSimulation::RunTopologyBenchmark,
+		&BatchSimulation::RunAdjacencyBenchmark,
+		&BatchSimulation::RunWeldBenchmark,
+		&BatchSimulation::RunSpatialSortBenchmark,
+		&BatchSimulation::RunSceneCacheBenchmark,
+		&BatchSimulation::RunGatherPlanBenchmark,
+		&BatchSimulation::RunSkinningBenchmark,
+		&BatchSimulation::RunKeyframeBenchmark,
+		&BatchSimulation::RunHierarchyBenchmark,
+		&BatchSimulation::RunClipBenchmark,
+		&BatchSimulation::RunOBBBenchmark,
+		&BatchSimulation::RunAnimationLODBenchmark,
+	};
+	for (UINT i = 0; i < ARRAYSIZE(benchmarks) && SUCCEEDED(g_batchResult); ++i)
+		g_batchResult = (g_batchSimulation.*benchmarks[i])();
+
+	DXUTShutdown();
+	CoUninitialize();
+
+	return SUCCEEDED(g_batchResult) ? 0 : 1;
+}
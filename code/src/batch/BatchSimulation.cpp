@@ -0,0 +1,795 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "BatchSimulation.h"
+
+#include "App.h"
+#include "Pipeline.h"
+#include "TileEdit.h"
+#include "IntersectPatches.h"
+#include "MemoryManager.h"
+#include "TileOverlapUpdater.h"
+#include "Voxelization.h"
+
+#include "scene/Scene.h"
+#include "scene/ModelLoader.h"
+#include "scene/AsyncModelLoader.h"
+#include "scene/ModelInstance.h"
+#include "scene/DXSubDModel.h"
+
+#include "dynamics/Physics.h"
+#include "dynamics/DeformablePairCache.h"
+#include "dynamics/Car.h"
+#include "dynamics/AnimationGroup.h"
+#include "dynamics/SkinningAnimation.h"
+
+#include "rendering/RendererTri.h"
+#include "rendering/RendererSubD.h"
+
+#include "compute/ComputeBackendD3D11.h"
+#include "compute/ComputeBackendCPU.h"
+#include "compute/OsdCPUComputeController.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/TaskGraph.h"
+#include "utils/Timer.h"
+#include "utils/Profiler.h"
+
+#include <atlbase.h>
+#include <atlconv.h>
+
+using namespace DirectX;
+
+// frames simulated after the last recorded event so the car comes to rest
+static const UINT MIN_TAIL_FRAMES = 250;
+
+// frames of the collision pair benchmark, stepped at 60hz so every frame runs the broadphase
+static const UINT PAIR_BENCH_FRAMES = 300;
+
+// limit samples per coarse face edge built for the stencil benchmark
+static const UINT STENCIL_BENCH_LIMIT_SAMPLES = 4;
+
+// empty scopes timed to report the cost of a profile scope, one ring buffer per batch
+static const UINT PROFILE_OVERHEAD_SCOPES = Profiler::RING_SIZE;
+static const UINT PROFILE_OVERHEAD_BATCHES = 64;
+
+BatchScenario::BatchScenario()
+{
+	sceneFile	= "media/models/valley/valley.dae";
+	recordFile	= "car.dump";
+	outputDir	= "batch";
+	chassisFile = "media/Models/hummer/Hummer_chassis.dae";
+	wheelFile	= "media/models/hummer/Hummer_wheel.dae";
+	carPosition = XMFLOAT3(-60, -80, -5);
+	numFrames	= 0;
+	timeStep	= 1.0f / 500.f;		// same as record playback in the interactive app
+	useWarp		= false;
+	syncStages	= true;
+	withSnapshot= true;
+	jobScalingIterations = 0;
+	pairBenchBodies = 0;
+	cpuSubdivision = false;
+	subdBenchIterations = 0;
+	stencilRefinement = false;
+	stencilBenchIterations = 0;
+	topologyCache = true;
+	topoBenchMaxFaces = 0;
+	adjacencyBenchFaces = 0;
+	weldBenchMaxVertices = 0;
+	spatialBenchPoints = 0;
+	sceneCache = true;
+	sceneCacheBench = false;
+	dirtyEdgeOverlap = true;
+	validateOverlap = false;
+	gatherBenchIterations = 0;
+	skinningBenchVertices = 0;
+	keyframeBenchCharacters = 0;
+	hierarchyBenchCharacters = 0;
+	compressAnimations = false;
+	clipBenchCharacters = 0;
+	obbBenchVertices = 0;
+	animationLOD = false;
+	lodBenchFrames = 0;
+	profile = false;
+	deformationStats = false;
+	validateDeformation = false;
+	temporalIntersection = false;
+	validateTemporal = false;
+	cpuCompute = false;
+	validateCompute = false;
+}
+
+void BatchScenario::PrintUsage()
+{
+	std::cout << "usage: DeformationGPUBatch [options]" << std::endl;
+	std::cout << "  --scene <file.dae>   scene to load (default media/models/valley/valley.dae)" << std::endl;
+	std::cout << "  --record <file>      car record to replay (default car.dump)" << std::endl;
+	std::cout << "  --out <dir>          output directory, use one per process (default batch)" << std::endl;
+	std::cout << "  --car <x> <y> <z>    initial car position" << std::endl;
+	std::cout << "  --frames <n>         number of frames, 0 = record length" << std::endl;
+	std::cout << "  --dt <seconds>       fixed timestep (default 0.002)" << std::endl;
+	std::cout << "  --warp               use the WARP software device" << std::endl;
+	std::cout << "  --no-sync            do not wait for the gpu between stages" << std::endl;
+	std::cout << "  --no-snapshot        do not write tiles.bin" << std::endl;
+	std::cout << "  --job-scaling <n>    run the cpu frame graph n times with 1..32 threads, checks the pairs against the serial stages" << std::endl;
+	std::cout << "  --pair-bench <n>     collision pair benchmark with n rigid bodies on the terrain" << std::endl;
+	std::cout << "  --cpu-subd           refine subd models on the cpu instead of the d3d11 compute controller" << std::endl;
+	std::cout << "  --subd-bench <n>     validate the cpu subdivision and run each level n times" << std::endl;
+	std::cout << "  --stencils           refine subd models with stencils instead of the kernel batches" << std::endl;
+	std::cout << "  --stencil-bench <n>  compare stencil and kernel batch refinement of the scene, n runs each" << std::endl;
+	std::cout << "  --no-topo-cache      build the subd topology from hbr meshes, do not read or write the topology cache" << std::endl;
+	std::cout << "  --no-scene-cache     import all models with assimp, do not read or write packed scene files" << std::endl;
+	std::cout << "  --topo-bench <faces> validate the uniform far topology builder, compare its build cost with hbr up to <faces>" << std::endl;
+	std::cout << "  --adjacency-bench <faces> validate the ptex adjacency, time it on a cage with <faces> faces" << std::endl;
+	std::cout << "  --weld-bench <n>     compare the vertex welder with spatial sort on inputs up to n vertices" << std::endl;
+	std::cout << "  --spatial-bench <n>  compare the plane and grid spatial sort backends on inputs of n points" << std::endl;
+	std::cout << "  --scene-cache-bench  time cold (assimp) and warm (mapped) loads of the level models" << std::endl;
+	std::cout << "  --full-overlap       update the overlap of all intersected faces, not only the edges written by the deformation" << std::endl;
+	std::cout << "  --validate-overlap   check the dirty edge records of every overlap update against the cpu reference" << std::endl;
+	std::cout << "  --gather-bench <n>   compare the overlap gather plan with the overlap kernels on the cpu, n runs each" << std::endl;
+	std::cout << "  --skinning-bench <n> validate the cpu skinning and measure it on a mesh with n vertices" << std::endl;
+	std::cout << "  --keyframe-bench <n> compare the cursor keyframe sampler with the linear key scan on n characters" << std::endl;
+	std::cout << "  --compress-animations store the imported animations as compressed clips" << std::endl;
+	std::cout << "  --clip-bench <n>     compare memory, error and sampling cost of compressed and raw clips on n characters" << std::endl;
+	std::cout << "  --hierarchy-bench <n> compare the flattened bone hierarchy with the recursive evaluation on n characters" << std::endl;
+	std::cout << "  --obb-bench <n>      validate the cpu obb fitter and compare pca and reused axes on an animated mesh with n vertices" << std::endl;
+	std::cout << "  --animation-lod      animate far groups at lower rates and with fewer bones" << std::endl;
+	std::cout << "  --lod-bench <n>      compare animation lod with the full animation over n frames of a camera distance sweep" << std::endl;
+	std::cout << "  --profile            record cpu and gpu scopes of the run, writes a chrome trace and percentiles per scope" << std::endl;
+	std::cout << "  --deformation-stats  count tiles, rays, dda steps and texels of the tile edit, read back asynchronously" << std::endl;
+	std::cout << "  --validate-deformation check the changed texel counters of every tile edit against the cpu reference" << std::endl;
+	std::cout << "  --temporal           intersect only the patches near the moved obbs, reuse the visibility of the last batch" << std::endl;
+	std::cout << "  --validate-temporal  check the visibility of every incremental intersection against the full test" << std::endl;
+	std::cout << "  --cpu-compute        run the patch intersection on the cpu compute backend" << std::endl;
+	std::cout << "  --validate-cpu-compute  check every cpu intersection batch against d3d11" << std::endl;
+}
+
+bool BatchScenario::Parse(int argc, wchar_t* argv[])
+{
+	USES_CONVERSION;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = W2A(argv[i]);
+		const bool hasValue = i + 1 < argc;
+
+		if		(arg == "--scene"  && hasValue)	sceneFile  = W2A(argv[++i]);
+		else if (arg == "--record" && hasValue)	recordFile = W2A(argv[++i]);
+		else if (arg == "--out"	   && hasValue)	outputDir  = W2A(argv[++i]);
+		else if (arg == "--frames" && hasValue)	numFrames  = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--dt"	   && hasValue)	timeStep   = static_cast<float>(_wtof(argv[++i]));
+		else if (arg == "--job-scaling" && hasValue) jobScalingIterations = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--pair-bench" && hasValue)	pairBenchBodies = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--subd-bench" && hasValue)	subdBenchIterations = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--stencil-bench" && hasValue) stencilBenchIterations = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--topo-bench" && hasValue)	topoBenchMaxFaces = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--adjacency-bench" && hasValue) adjacencyBenchFaces = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--weld-bench" && hasValue)	weldBenchMaxVertices = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--spatial-bench" && hasValue) spatialBenchPoints = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--gather-bench" && hasValue) gatherBenchIterations = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--skinning-bench" && hasValue) skinningBenchVertices = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--keyframe-bench" && hasValue) keyframeBenchCharacters = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--hierarchy-bench" && hasValue) hierarchyBenchCharacters = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--clip-bench" && hasValue) clipBenchCharacters = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--obb-bench" && hasValue) obbBenchVertices = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--animation-lod") animationLOD = true;
+		else if (arg == "--lod-bench" && hasValue) lodBenchFrames = static_cast<UINT>(_wtoi(argv[++i]));
+		else if (arg == "--profile")	   profile = true;
+		else if (arg == "--car"	   && i + 3 < argc)
+		{
+			carPosition.x = static_cast<float>(_wtof(argv[++i]));
+			carPosition.y = static_cast<float>(_wtof(argv[++i]));
+			carPosition.z = static_cast<float>(_wtof(argv[++i]));
+		}
+		else if (arg == "--warp")			useWarp = true;
+		else if (arg == "--no-sync")		syncStages = false;
+		else if (arg == "--no-snapshot")	withSnapshot = false;
+		else if (arg == "--cpu-subd")		cpuSubdivision = true;
+		else if (arg == "--stencils")		stencilRefinement = true;
+		else if (arg == "--no-topo-cache")	topologyCache = false;
+		else if (arg == "--no-scene-cache")	sceneCache = false;
+		else if (arg == "--scene-cache-bench") sceneCacheBench = true;
+		else if (arg == "--full-overlap")	dirtyEdgeOverlap = false;
+		else if (arg == "--validate-overlap") validateOverlap = true;
+		else if (arg == "--deformation-stats") deformationStats = true;
+		else if (arg == "--validate-deformation") { deformationStats = true; validateDeformation = true; }
+		else if (arg == "--temporal")		temporalIntersection = true;
+		else if (arg == "--validate-temporal") { temporalIntersection = true; validateTemporal = true; }
+		else if (arg == "--cpu-compute")	cpuCompute = true;
+		else if (arg == "--validate-cpu-compute") { cpuCompute = true; validateCompute = true; }
+		else if (arg == "--compress-animations") compressAnimations = true;
+		else
+		{
+			std::cerr << "unknown argument " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (timeStep <= 0.0f)
+	{
+		std::cerr << "invalid timestep" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+BatchSimulation::BatchSimulation()
+{
+	m_scene = NULL;
+	m_physics = NULL;
+	m_car = NULL;
+	m_numFrames = 0;
+	m_setupMS = 0;
+	m_runMS = 0;
+}
+
+BatchSimulation::~BatchSimulation()
+{
+	Destroy();
+}
+
+HRESULT BatchSimulation::Create(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext, const BatchScenario& scenario)
+{
+	HRESULT hr = S_OK;
+	m_scenario = scenario;
+	double setupStart = GetTimeMS();
+
+	// the record is optional for the interactive app, a batch run without it is an error
+	{
+		std::ifstream record(m_scenario.recordFile.c_str(), std::ios::in | std::ios::binary);
+		if (!record.is_open())
+		{
+			std::cerr << "could not open car record " << m_scenario.recordFile << std::endl;
+			return E_FAIL;
+		}
+	}
+
+	CreateDirectoryA(m_scenario.outputDir.c_str(), NULL);
+
+	// pipeline components, no renderers except the ones used for voxelization
+	V_RETURN(g_app.Create(pd3dDevice));
+	V_RETURN(g_workStealingPool.Create());
+	V_RETURN(g_modelLoader.Create(g_app.g_numLoaderThreads));
+	V_RETURN(g_computeBackendD3D11.Create(pd3dDevice, pd3dImmediateContext));
+	g_computeBackend = &g_computeBackendD3D11;
+	if (m_scenario.cpuCompute)
+	{
+		V_RETURN(g_computeBackendCPU.Create());
+		g_computeBackend = &g_computeBackendCPU;
+	}
+
+	V_RETURN(g_voxelization.Create(pd3dDevice));
+	V_RETURN(g_renderTriMeshes.Create(pd3dDevice));
+	V_RETURN(g_rendererSubD.Create(pd3dDevice));
+	V_RETURN(g_memoryManager.Create(pd3dDevice));
+	V_RETURN(g_intersectGPU.Create(pd3dDevice));
+	V_RETURN(g_overlapUpdater.Create(pd3dDevice));
+	V_RETURN(g_deformation.Create(pd3dDevice));
+
+	g_app.g_osdSubdivider = new OpenSubdiv::OsdD3D11ComputeController(pd3dImmediateContext);
+	g_app.g_osdSubdividerCPU = new OsdCPUComputeController();
+	g_app.g_useCPUSubdivision = m_scenario.cpuSubdivision;
+	g_app.g_useStencilRefinement = m_scenario.stencilRefinement;
+	g_app.g_useTopologyCache = m_scenario.topologyCache;
+	g_app.g_useSceneCache = m_scenario.sceneCache;
+	g_app.g_compressAnimations = m_scenario.compressAnimations;
+	g_app.g_useAnimationLOD = m_scenario.animationLOD;
+	V_RETURN(g_profiler.Create(pd3dDevice));
+	g_app.g_useDirtyEdgeOverlap = m_scenario.dirtyEdgeOverlap;
+	g_app.g_validateDirtyEdgeOverlap = m_scenario.validateOverlap;
+	g_app.g_deformationStats = m_scenario.deformationStats;
+	g_app.g_validateDeformationStats = m_scenario.validateDeformation;
+	g_app.g_useTemporalIntersection = m_scenario.temporalIntersection;
+	g_app.g_validateTemporalIntersection = m_scenario.validateTemporal;
+	g_app.g_validateComputeBackend = m_scenario.validateCompute;
+	g_overlapUpdater.SetReadbackStats(m_scenario.syncStages);
+	if (m_scenario.stencilBenchIterations > 0)
+		g_app.g_stencilLimitSamples = STENCIL_BENCH_LIMIT_SAMPLES;
+
+	V_RETURN(g_memoryManager.InitTileDisplacementMemory(pd3dDevice, g_app.g_memNumDisplacementTiles, g_app.g_displacementTileSize, 0, 0.0f, true, false, g_app.g_useDisplacementConstraints));
+	V_RETURN(g_memoryManager.InitTileColorMemory(pd3dDevice, g_app.g_memNumColorTiles, g_app.g_colorTileSize, 0, XMFLOAT3A(0.5, 0.5, 0.5), true));
+
+	m_physics = new Physics();
+	m_physics->init();
+
+	m_scene = new Scene();
+	m_scene->SetPhysics(m_physics);
+
+	// the scene is prepared on the loader threads together with the car models, the car inserts it first when it waits for its chassis
+	const UINT sceneJob = g_modelLoader.Enqueue(m_scenario.sceneFile, m_scene);
+
+	m_car = new Car();
+	m_car->SetRecordFile(m_scenario.recordFile);
+	m_car->Create(m_physics, m_scene, m_scenario.chassisFile, m_scenario.wheelFile, false, true, m_scenario.carPosition);
+
+	V_RETURN(g_modelLoader.Wait(sceneJob));
+	g_modelLoader.PrintTimings();
+	g_modelLoader.WriteTimings(m_scenario.outputDir + "/load_timings.csv");
+
+	m_physics->GetDynamicsWorld()->setGravity(btVector3(0, 0, -10));
+	m_physics->stepSimulation(0.02f, 1);
+	m_car->Update(m_physics);
+	for (auto group : m_scene->GetModelGroups()) group->UpdateModelMatrix();
+
+	// feature adaptive subdivision once, the batch has no animated subd models
+	for (auto group : m_scene->GetModelGroups())
+	{
+		for (auto mesh : group->osdModels)
+			mesh->Refine();
+	}
+
+	// the voxelization of subd penetrators reads the gen shadow cb
+	g_app.UpdateGenShadowCBCustom(pd3dImmediateContext, XMMatrixIdentity(), XMMatrixIdentity());
+	g_app.SetGenShadowConstantBuffersHSDSGS(pd3dImmediateContext);
+
+	m_numFrames = m_scenario.numFrames > 0 ? m_scenario.numFrames : m_car->GetRecordLength() + MIN_TAIL_FRAMES;
+	m_frameStats.reserve(m_numFrames);
+
+	Sync();
+	m_setupMS = GetTimeMS() - setupStart;
+	return hr;
+}
+
+void BatchSimulation::Destroy()
+{
+	SAFE_DELETE(m_car);
+	SAFE_DELETE(m_scene);
+	SAFE_DELETE(m_physics);
+}
+
+void BatchSimulation::Sync() const
+{
+	if (m_scenario.syncStages)
+		g_app.WaitForGPU();
+}
+
+// cost of an enabled cpu scope on the calling thread, the collection between the batches is not timed
+static void MeasureProfilerOverhead()
+{
+	g_profiler.SetEnabled(true);
+	g_profiler.SetCapture(false);
+
+	double scopeMS = 0;
+	for (UINT b = 0; b < PROFILE_OVERHEAD_BATCHES; ++b)
+	{
+		double t = GetTimeMS();
+		for (UINT i = 0; i < PROFILE_OVERHEAD_SCOPES; ++i)
+		{
+			PROFILE_SCOPE("overhead");
+		}
+		scopeMS += GetTimeMS() - t;
+		g_profiler.Collect();
+	}
+	g_profiler.Clear();
+
+	const double scopeNS = 1e6 * scopeMS / (PROFILE_OVERHEAD_SCOPES * PROFILE_OVERHEAD_BATCHES);
+	std::cout << "batch: profile scope overhead " << scopeNS << " ns" << std::endl;
+}
+
+void BatchSimulation::Step(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext, BatchFrameStats& stats)
+{
+	const float dt = m_scenario.timeStep;
+	double t = GetTimeMS();
+
+	// physics
+	{
+		PROFILE_SCOPE("physics");
+		m_car->Replay(dt, m_physics);
+		m_car->Update(m_physics, dt);
+		m_physics->stepSimulation(dt, 10);
+		m_scene->UpdateModelMatrices();
+		m_scene->UpdateAABB(false);
+	}
+
+	double now = GetTimeMS();
+	stats.physicsMS = now - t;
+	t = now;
+
+	// collision pairs
+	{
+		PROFILE_SCOPE("detect");
+		g_deformationPipeline.DetectDeformableCollisionPairs(m_physics, true);
+	}
+
+	// entries of one deformable are consecutive
+	const DeformableCollisionPairs& collisionPairs = g_deformationPipeline.GetCollisionPairs();
+	stats.numDeformables = 0;
+	stats.numPenetrators = static_cast<UINT>(collisionPairs.size());
+	for (size_t i = 0; i < collisionPairs.size(); ++i)
+	{
+		if (i == 0 || collisionPairs[i].deformable != collisionPairs[i - 1].deformable)
+			stats.numDeformables++;
+	}
+
+	now = GetTimeMS();
+	stats.detectMS = now - t;
+	t = now;
+
+	// intersection, allocation and deformation
+	{
+		PROFILE_SCOPE("deformation");
+		GPU_PROFILE_SCOPE(pd3dImmediateContext, "deformation");
+		g_deformationPipeline.CheckAndApplyDeformation(pd3dDevice, pd3dImmediateContext);
+		Sync();
+	}
+
+	// the counters of this frame, the gpu is idle anyway when the stages are synced
+	if (m_scenario.deformationStats && m_scenario.syncStages)
+	{
+		g_deformation.FlushStats(pd3dImmediateContext);
+		const DeformationStats& deformStats = g_deformation.GetLastStats();
+		stats.deformRays = deformStats.numRays;
+		stats.deformDDASteps = deformStats.numDDASteps;
+		stats.deformTexelsWritten = deformStats.numTexelsWritten;
+		stats.deformTexelsChanged = deformStats.numTexelsChanged;
+	}
+
+	now = GetTimeMS();
+	stats.deformationMS = now - t;
+	t = now;
+
+	// overlap of the deformed meshes
+	g_overlapUpdater.ResetFrameStats();
+	{
+		PROFILE_SCOPE("overlap");
+		GPU_PROFILE_SCOPE(pd3dImmediateContext, "overlap");
+		for (auto group : m_scene->GetModelGroups())
+		{
+			if (!group->HasDeformables()) continue;
+
+			for (auto deformable : group->modelInstances)
+			{
+				if (!deformable->IsDeformable() || !deformable->IsSubD()) continue;
+				if (deformable->GetOSDMesh()->GetRequiresOverlapUpdate() && g_app.g_withOverlapUpdate)
+					g_overlapUpdater.UpdateOverlapDisplacement(pd3dImmediateContext, deformable);
+
+				if (g_app.g_useCompactedVisibilityOverlap)
+					g_overlapUpdater.ClearIntersectAllBuffer(pd3dImmediateContext, deformable);
+			}
+		}
+		Sync();
+	}
+
+	stats.overlapMS = GetTimeMS() - t;
+	stats.overlapEdges = g_overlapUpdater.GetFrameStats().numEdges;
+	stats.overlapFaces = g_overlapUpdater.GetFrameStats().numRecords;
+}
+
+HRESULT BatchSimulation::Run(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	std::cout << "batch: " << m_scenario.sceneFile << ", record " << m_scenario.recordFile << ", " << m_numFrames << " frames" << std::endl;
+
+	g_deformation.ResetStats();
+	if (m_scenario.profile)
+	{
+		MeasureProfilerOverhead();
+		g_app.g_TimingLog.resetTimings();
+		g_profiler.SetEnabled(true);
+		g_profiler.SetCapture(true);
+	}
+
+	double runStart = GetTimeMS();
+	for (UINT frame = 0; frame < m_numFrames; ++frame)
+	{
+		BatchFrameStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+		stats.frame = frame;
+		g_profiler.BeginFrame(pd3dImmediateContext);
+		{
+			PROFILE_SCOPE("frame");
+			Step(pd3dDevice, pd3dImmediateContext, stats);
+		}
+		g_profiler.EndFrame(pd3dImmediateContext);
+		m_frameStats.push_back(stats);
+
+		// keep the hidden window responsive
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+	g_deformation.FlushStats(pd3dImmediateContext);
+	g_memoryManager.ResolveAllocationStats(pd3dImmediateContext, true);
+	g_app.WaitForGPU();
+	m_runMS = GetTimeMS() - runStart;
+
+	return S_OK;
+}
+
+HRESULT BatchSimulation::WriteResults(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	HRESULT hr = S_OK;
+	const std::string dir = m_scenario.outputDir + "/";
+
+	{
+		std::ofstream file((dir + "metrics.csv").c_str());
+		file << "frame,deformables,penetrators,physics_ms,detect_ms,deformation_ms,overlap_ms,overlap_edges,overlap_faces,"
+			 << "deform_rays,deform_dda_steps,deform_texels_written,deform_texels_changed" << std::endl;
+		for (const auto& s : m_frameStats)
+		{
+			file << s.frame << "," << s.numDeformables << "," << s.numPenetrators << ","
+				 << s.physicsMS << "," << s.detectMS << "," << s.deformationMS << "," << s.overlapMS << ","
+				 << s.overlapEdges << "," << s.overlapFaces << ","
+				 << s.deformRays << "," << s.deformDDASteps << "," << s.deformTexelsWritten << "," << s.deformTexelsChanged << std::endl;
+		}
+	}
+
+	double physicsMS = 0, detectMS = 0, deformationMS = 0, overlapMS = 0;
+	UINT64 overlapEdges = 0;
+	UINT framesWithContact = 0;
+	UINT maxPenetrators = 0;
+	for (const auto& s : m_frameStats)
+	{
+		physicsMS += s.physicsMS;
+		detectMS += s.detectMS;
+		deformationMS += s.deformationMS;
+		overlapMS += s.overlapMS;
+		overlapEdges += s.overlapEdges;
+		if (s.numPenetrators > 0) framesWithContact++;
+		maxPenetrators = std::max(maxPenetrators, s.numPenetrators);
+	}
+	const double n = std::max<size_t>(1, m_frameStats.size());
+
+	FreeMemoryTableState tableState;
+	ZeroMemory(&tableState, sizeof(tableState));
+	V_RETURN(g_memoryManager.GetTableState(tableState));
+
+	{
+		std::ofstream file((dir + "summary.txt").c_str());
+		file << "scene = "						<< m_scenario.sceneFile << std::endl;
+		file << "record = "						<< m_scenario.recordFile << std::endl;
+		file << "frames = "						<< m_frameStats.size() << std::endl;
+		file << "timestep = "					<< m_scenario.timeStep << std::endl;
+		file << "device = "						<< (m_scenario.useWarp ? "warp" : "hardware") << std::endl;
+		file << "synced_stages = "				<< (m_scenario.syncStages ? 1 : 0) << std::endl;
+		file << "setup_ms = "					<< m_setupMS << std::endl;
+		file << "run_ms = "						<< m_runMS << std::endl;
+		file << "avg_frame_ms = "				<< m_runMS / n << std::endl;
+		file << "avg_physics_ms = "				<< physicsMS / n << std::endl;
+		file << "avg_detect_ms = "				<< detectMS / n << std::endl;
+		file << "avg_deformation_ms = "			<< deformationMS / n << std::endl;
+		file << "avg_overlap_ms = "				<< overlapMS / n << std::endl;
+		file << "dirty_edge_overlap = "			<< (m_scenario.dirtyEdgeOverlap ? 1 : 0) << std::endl;
+		file << "avg_overlap_edges = "			<< overlapEdges / n << std::endl;
+		file << "frames_with_contact = "		<< framesWithContact << std::endl;
+		file << "max_penetrators = "			<< maxPenetrators << std::endl;
+		file << "displacement_tiles_used = "	<< tableState.curLocTileDisplacement << std::endl;
+		file << "displacement_tiles_max = "		<< tableState.maxLocTileDisplacement << std::endl;
+	}
+
+	if (m_scenario.deformationStats)
+	{
+		// totals of the run and cost per unit of the tile edit (raycast stage, only timed with --profile)
+		const DeformationStats& s = g_deformation.GetTotalStats();
+		const double raycastMS = g_app.g_TimingLog.getStage(TimingStage::RAYCAST).latency.GetTotalMS();
+		const std::pair<const char*, double> counters[] = {
+			std::make_pair("tiles", (double)s.numTiles),
+			std::make_pair("texels", (double)s.numTexels),
+			std::make_pair("rays", (double)s.numRays),
+			std::make_pair("dda_steps", (double)s.numDDASteps),
+			std::make_pair("voxels_hit", (double)s.numVoxelsHit),
+			std::make_pair("skip_invisible", (double)s.numSkipInvisible),
+			std::make_pair("skip_unallocated", (double)s.numSkipUnallocated),
+			std::make_pair("skip_miss", (double)s.numSkipMiss),
+			std::make_pair("skip_zero", (double)s.numSkipZero),
+			std::make_pair("texels_written", (double)s.numTexelsWritten),
+			std::make_pair("texels_changed", (double)s.numTexelsChanged),
+		};
+
+		std::ofstream file((dir + "deformation_stats.csv").c_str());
+		file << "counter,total,per_frame,ns_per_unit" << std::endl;
+		const double frames = std::max(1u, g_deformation.GetNumStatsFrames());
+		for (const auto& c : counters)
+			file << c.first << "," << c.second << "," << c.second / frames << "," << (c.second > 0 ? 1e6 * raycastMS / c.second : 0.0) << std::endl;
+		file << "max_delta," << s.maxDelta << "," << s.maxDelta << ",0" << std::endl;
+
+		std::cout << "batch: deformation " << s.numRays << " rays, " << (s.numRays > 0 ? s.numDDASteps / (double)s.numRays : 0.0) << " dda steps per ray, "
+				  << s.numTexelsWritten << " texels written, " << s.numTexelsChanged << " changed in " << g_deformation.GetNumStatsFrames() << " frames" << std::endl;
+	}
+
+	if (m_scenario.withSnapshot)
+		V_RETURN(g_memoryManager.SaveDisplacementTiles(pd3dImmediateContext, dir + "tiles.bin"));
+
+	if (m_scenario.profile)
+	{
+		g_profiler.Flush(pd3dImmediateContext);
+		g_profiler.PrintSummary();
+		V_RETURN(g_profiler.WriteTrace(dir + "profile_trace.json"));
+		V_RETURN(g_profiler.WriteSummary(dir + "profile_summary.csv"));
+		g_app.g_TimingLog.printTimings();
+		V_RETURN(g_app.g_TimingLog.writeCSV(dir + "stage_timings.csv"));
+		V_RETURN(g_app.g_TimingLog.writeJSON(dir + "stage_timings.json"));
+		g_profiler.SetEnabled(false);
+	}
+
+	std::cout << "batch: done, " << m_frameStats.size() << " frames in " << m_runMS << " ms, results in " << m_scenario.outputDir << std::endl;
+	return hr;
+}
+
+// same instances in the same order, the obbs bitwise equal
+static bool SameCollisionPairs(const DeformableCollisionPairs& a, const DeformableCollisionPairs& b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (a[i].deformable != b[i].deformable || a[i].penetrator != b[i].penetrator) return false;
+		if (memcmp(&a[i].obb, &b[i].obb, sizeof(DXObjectOrientedBoundingBox)) != 0) return false;
+	}
+	return true;
+}
+
+HRESULT BatchSimulation::RunJobScaling()
+{
+	HRESULT hr = S_OK;
+	if (m_scenario.jobScalingIterations == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+	const UINT threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+	const UINT numThreadCounts = ARRAYSIZE(threadCounts);
+
+	// same stages and dependencies as the interactive frame graph, without the d3d tasks. the skinning runs on the cpu.
+	// the physics state is not advanced, so every iteration does the same work. the cpu skinning fits the obbs the collision pairs read.
+	TaskGraph graph;
+	TaskID modelMatrices	= graph.AddTask("model matrices", [this]{ m_scene->UpdateModelMatrices(); });
+	TaskID sceneAABB		= graph.AddTask("scene aabb", [this]{ m_scene->UpdateAABB(true); });
+	TaskID collisionPairs	= graph.AddTask("collision pairs", [this]{ g_deformationPipeline.DetectDeformableCollisionPairs(m_physics, true); });
+	TaskID animation		= graph.AddTask("animation", [this]{ SkinningAnimation::ComputeAnimations(m_scene->GetAnimatedModels(), 0.0f); });
+	TaskID skinning			= graph.AddTask("cpu skinning", [this]{ SkinningAnimation::ApplySkinningCPU(m_scene->GetAnimatedModels()); });
+	graph.AddDependency(skinning, animation);
+	graph.AddDependency(sceneAABB, modelMatrices);
+	graph.AddDependency(collisionPairs, modelMatrices);
+	graph.AddDependency(modelMatrices, skinning);
+	graph.AddDependency(collisionPairs, skinning);
+
+	// reference without the graph, the stages in dependency order on this thread. every thread count has to give the same pairs
+	SkinningAnimation::ComputeAnimations(m_scene->GetAnimatedModels(), 0.0f);
+	SkinningAnimation::ApplySkinningCPU(m_scene->GetAnimatedModels());
+	m_scene->UpdateModelMatrices();
+	m_scene->UpdateAABB(true);
+	g_deformationPipeline.DetectDeformableCollisionPairs(m_physics, true);
+	const DeformableCollisionPairs referencePairs = g_deformationPipeline.GetCollisionPairs();
+
+	std::ofstream file((dir + "job_scaling.csv").c_str());
+	file << "threads,avg_ms,min_ms,speedup,pairs_match" << std::endl;
+
+	double baseMS = 0;
+	bool allPairsMatch = true;
+	for (UINT t = 0; t < numThreadCounts; ++t)
+	{
+		V_RETURN(g_workStealingPool.Create(threadCounts[t]));
+
+		// warm up, first run touches all the data
+		graph.Execute();
+
+		double totalMS = 0;
+		double minMS = DBL_MAX;
+		for (UINT i = 0; i < m_scenario.jobScalingIterations; ++i)
+		{
+			graph.SetTracing(t + 1 == numThreadCounts && i + 1 == m_scenario.jobScalingIterations);
+			graph.Execute();
+			totalMS += graph.GetLastExecuteMS();
+			minMS = std::min(minMS, graph.GetLastExecuteMS());
+		}
+
+		const double avgMS = totalMS / m_scenario.jobScalingIterations;
+		if (t == 0) baseMS = avgMS;
+
+		const bool pairsMatch = SameCollisionPairs(referencePairs, g_deformationPipeline.GetCollisionPairs());
+		if (!pairsMatch)
+		{
+			std::cerr << "batch: collision pairs of the frame graph with " << threadCounts[t] << " threads differ from the serial stages" << std::endl;
+			allPairsMatch = false;
+		}
+
+		file << threadCounts[t] << "," << avgMS << "," << minMS << "," << baseMS / avgMS << "," << (pairsMatch ? 1 : 0) << std::endl;
+		std::cout << "batch: " << threadCounts[t] << " threads, " << avgMS << " ms per frame graph" << std::endl;
+	}
+
+	V_RETURN(graph.WriteTrace(dir + "jobtrace.json"));
+
+	// back to the default pool size
+	V_RETURN(g_workStealingPool.Create());
+	return allPairsMatch ? hr : E_FAIL;
+}
+
+HRESULT BatchSimulation::RunPairCacheBenchmark()
+{
+	if (m_scenario.pairBenchBodies == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+	btDiscreteDynamicsWorld* world = m_physics->GetDynamicsWorld();
+
+	// boxes without deformables, their pairs with the terrain are tracked by the pair cache
+	ModelGroup* boxGroup = new ModelGroup();
+	boxGroup->SetName("pair benchmark");
+
+	const float mass = 1.0f;
+	btBoxShape* boxShape = new btBoxShape(btVector3(0.5f, 0.5f, 0.5f));
+	btVector3 localInertia(0, 0, 0);
+	boxShape->calculateLocalInertia(mass, localInertia);
+
+	const XMFLOAT3& aabbMin = m_scene->GetSceneAABBMin();
+	const XMFLOAT3& aabbMax = m_scene->GetSceneAABBMax();
+
+	srand(1);
+	std::vector<btRigidBody*> bodies(m_scenario.pairBenchBodies);
+	for (auto& body : bodies)
+	{
+		float x = aabbMin.x + (aabbMax.x - aabbMin.x) * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+		float y = aabbMin.y + (aabbMax.y - aabbMin.y) * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+		float z = aabbMax.z + 10.0f * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+
+		btTransform startTransform;
+		startTransform.setIdentity();
+		startTransform.setOrigin(btVector3(x, y, z));
+
+		btDefaultMotionState* myMotionState = new btDefaultMotionState(startTransform);
+		btRigidBody::btRigidBodyConstructionInfo cInfo(mass, myMotionState, boxShape, localInertia);
+		body = new btRigidBody(cInfo);
+		body->setUserPointer(boxGroup);
+		world->addRigidBody(body);
+	}
+
+	// not installed in the world, rebuilding it every frame is the walk over all overlapping pairs
+	DeformablePairCache* pairCache = m_physics->GetDeformablePairCache();
+	btOverlappingPairCache* overlappingPairs = m_physics->GetBroadPhase()->getOverlappingPairCache();
+	DeformablePairCache scanCache;
+
+	std::ofstream file((dir + "pair_cache.csv").c_str());
+	file << "frame,broadphase_pairs,tracked_pairs,added,removed,physics_ms,incremental_ms,full_scan_ms" << std::endl;
+
+	double incrementalMS = 0, scanMS = 0;
+	for (UINT frame = 0; frame < PAIR_BENCH_FRAMES; ++frame)
+	{
+		pairCache->ResetStatistics();
+
+		double t = GetTimeMS();
+		m_physics->stepSimulation(1.0f / 60.0f, 1);
+		const double physicsMS = GetTimeMS() - t;
+
+		t = GetTimeMS();
+		g_deformationPipeline.DetectDeformableCollisionPairs(m_physics, true);
+		const double frameIncrementalMS = GetTimeMS() - t;
+
+		t = GetTimeMS();
+		scanCache.Rebuild(overlappingPairs);
+		const double frameScanMS = GetTimeMS() - t;
+
+		incrementalMS += frameIncrementalMS;
+		scanMS += frameScanMS;
+
+		file << frame << "," << overlappingPairs->getNumOverlappingPairs() << "," << pairCache->GetPairs().size() << ","
+			 << pairCache->GetNumAdded() << "," << pairCache->GetNumRemoved() << ","
+			 << physicsMS << "," << frameIncrementalMS << "," << frameScanMS << std::endl;
+	}
+
+	std::cout << "batch: " << m_scenario.pairBenchBodies << " bodies, collision pairs " << incrementalMS / PAIR_BENCH_FRAMES << " ms incremental, "
+			  << scanMS / PAIR_BENCH_FRAMES << " ms full scan per frame" << std::endl;
+
+	// removing the bodies drops their pairs from the pair cache
+	for (auto body : bodies)
+	{
+		world->removeRigidBody(body);
+		delete body->getMotionState();
+		delete body;
+	}
+	delete boxShape;
+	delete boxGroup;
+
+	g_deformationPipeline.DetectDeformableCollisionPairs(m_physics, true);
+	return S_OK;
+}
@@ -0,0 +1,194 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <string>
+
+// fwd decls
+class Scene;
+class Physics;
+class Car;
+
+// settings of one batch run, parsed from the command line
+struct BatchScenario
+{
+	BatchScenario();
+
+	bool Parse(int argc, wchar_t* argv[]);
+	static void PrintUsage();
+
+	std::string			sceneFile;			// --scene
+	std::string			recordFile;			// --record, car.dump written by the interactive app
+	std::string			outputDir;			// --out, one directory per process
+	std::string			chassisFile;
+	std::string			wheelFile;
+	DirectX::XMFLOAT3	carPosition;		// --car x y z
+	UINT				numFrames;			// --frames, 0 = record length + MIN_TAIL_FRAMES
+	float				timeStep;			// --dt
+	bool				useWarp;			// --warp, software device to run many processes on one machine
+	bool				syncStages;			// --no-sync disables the gpu sync between stages (faster, per stage timings invalid)
+	bool				withSnapshot;		// --no-snapshot
+	UINT				jobScalingIterations;	// --job-scaling <n>, cpu frame graph benchmark with 1..32 threads after the run
+	UINT				pairBenchBodies;		// --pair-bench <n>, collision pair benchmark with n rigid bodies dropped on the terrain
+	bool				cpuSubdivision;			// --cpu-subd, subd models refined by the cpu compute controller
+	UINT				subdBenchIterations;	// --subd-bench <n>, cpu subdivision validation against hbr and throughput of levels 1..5
+	bool				stencilRefinement;		// --stencils, subd models refined by stencil mat-vec
+	UINT				stencilBenchIterations;	// --stencil-bench <n>, per frame refinement cost of stencils vs kernel batches
+	bool				topologyCache;			// --no-topo-cache disables the binary subd topology cache
+	UINT				topoBenchMaxFaces;		// --topo-bench <faces>, far topology builder validation and build cost up to this grid size
+	UINT				adjacencyBenchFaces;	// --adjacency-bench <faces>, ptex adjacency validation and build cost on a cage of this size
+	UINT				weldBenchMaxVertices;	// --weld-bench <vertices>, vertex welder against spatial sort on 1m.. vertex inputs
+	UINT				spatialBenchPoints;		// --spatial-bench <points>, plane against grid spatial sort backend
+	bool				sceneCache;				// --no-scene-cache imports all models with assimp, no packed scene files
+	bool				sceneCacheBench;		// --scene-cache-bench, cold (assimp) and warm (mapped) scene loads of the level models
+	bool				dirtyEdgeOverlap;		// --full-overlap updates the overlap of all intersected faces instead of the written edges
+	bool				validateOverlap;		// --validate-overlap, compare the dirty edge records with the cpu reference every frame
+	UINT				gatherBenchIterations;	// --gather-bench <n>, overlap gather plan against the cpu port of the overlap kernels
+	UINT				skinningBenchVertices;	// --skinning-bench <vertices>, avx2 cpu skinning against the scalar port of SkinningCS
+	UINT				keyframeBenchCharacters;// --keyframe-bench <characters>, cursor keyframe sampling against the linear key scan
+	UINT				hierarchyBenchCharacters;// --hierarchy-bench <characters>, flattened bone hierarchy against the recursive evaluation
+	bool				compressAnimations;		// --compress-animations, imported animations stored as compressed clips
+	UINT				clipBenchCharacters;	// --clip-bench <characters>, compressed against raw animation clips
+	UINT				obbBenchVertices;		// --obb-bench <vertices>, cpu obb fitter against the DXObjectOrientedBoundingBox reference
+	bool				animationLOD;			// --animation-lod, update rate and bone subset of the animated groups by camera distance
+	UINT				lodBenchFrames;			// --lod-bench <frames>, animation lod against the full animation over a camera distance sweep
+	bool				profile;				// --profile, cpu/gpu scopes of all frames, profile trace, scope percentiles and stage timings
+	bool				deformationStats;		// --deformation-stats, tiles, rays, dda steps and texels of the tile edit
+	bool				validateDeformation;	// --validate-deformation, compare the changed texel counters with the cpu reference every edit
+	bool				temporalIntersection;	// --temporal, incremental obb intersection
+	bool				validateTemporal;		// --validate-temporal, compare every incremental intersection with the full test
+	bool				cpuCompute;				// --cpu-compute, patch intersection on the cpu compute backend
+	bool				validateCompute;		// --validate-cpu-compute, compare every cpu intersection batch with d3d11
+};
+
+// per frame metrics
+struct BatchFrameStats
+{
+	UINT	frame;
+	UINT	numDeformables;
+	UINT	numPenetrators;
+	double	physicsMS;
+	double	detectMS;
+	double	deformationMS;
+	double	overlapMS;
+	UINT	overlapEdges;		// edges copied by the dirty edge overlap update (synced runs only)
+	UINT	overlapFaces;		// faces with an edge or corner update
+	UINT	deformRays;			// tile edit rays (synced runs with --deformation-stats only)
+	UINT	deformDDASteps;		// voxels visited by the rays
+	UINT	deformTexelsWritten;
+	UINT	deformTexelsChanged;
+};
+
+// runs the deformation pipeline without window/ui: physics -> collision pairs -> intersection -> allocation -> deformation -> overlap,
+// driven by a recorded car input at a fixed timestep
+class BatchSimulation
+{
+public:
+	BatchSimulation();
+	~BatchSimulation();
+
+	// called from the device created callback
+	HRESULT Create(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext, const BatchScenario& scenario);
+	void	Destroy();
+
+	HRESULT Run(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext);
+
+	// metrics.csv (per frame), summary.txt and tiles.bin in the output directory, with --deformation-stats deformation_stats.csv,
+	// with --profile also the chrome trace
+	// (profile_trace.json), the per scope percentiles (profile_summary.csv) and the stage histograms (stage_timings.csv/json)
+	HRESULT WriteResults(ID3D11DeviceContext1* pd3dImmediateContext);
+
+	// runs the cpu stages of a frame as task graph on the final scene state with 1..32 threads,
+	// writes job_scaling.csv and the job trace of the largest thread count (jobtrace.json)
+	HRESULT RunJobScaling();
+
+	// drops pairBenchBodies boxes on the terrain and compares the incremental collision pair detection
+	// with a walk over all overlapping pairs per frame, writes pair_cache.csv
+	HRESULT RunPairCacheBenchmark();
+
+	// compares the cpu compute controller with the hbr refinement on small test meshes and measures serial/parallel
+	// refinement for levels 1..5, writes subd_cpu.csv (SubdivisionBenchmark.cpp)
+	HRESULT RunSubdivisionBenchmark();
+
+	// refines the subd models of the scene with the kernel batches (gpu and cpu controller) and with refinement stencils,
+	// evaluates the limit stencils with derivatives, writes stencil_bench.csv (SubdivisionBenchmark.cpp)
+	HRESULT RunStencilBenchmark();
+
+	// compares the far tables of the topology builder with the hbr tables on the test meshes and the build time and memory
+	// of both on grids up to topoBenchMaxFaces faces, writes topo_bench.csv (SubdivisionBenchmark.cpp)
+	HRESULT RunTopologyBenchmark();
+
+	// compares the ptex neighbors and extraordinary vertex rings of the quad adjacency with the hbr loader and
+	// measures both on a closed cage with adjacencyBenchFaces faces, writes adjacency_bench.csv (SubdivisionBenchmark.cpp)
+	HRESULT RunAdjacencyBenchmark();
+
+	// welds quad soups of 1m, 10m.. up to weldBenchMaxVertices vertices with the vertex welder and with spatial sort queries,
+	// height field, planar and degenerate (in the spatial sort plane) inputs, writes weld_bench.csv (LoaderBenchmark.cpp)
+	HRESULT RunWeldBenchmark();
+
+	// builds both spatial sort backends on terrain, character and random point sets of spatialBenchPoints points, compares the
+	// batch radius and identity queries of both and against the single queries, writes spatial_bench.csv (LoaderBenchmark.cpp)
+	HRESULT RunSpatialSortBenchmark();
+
+	// loads the scene, car and skydome models through the scene cache once after deleting their cache files (assimp import)
+	// and once mapped from the written files, writes scene_cache_bench.csv (LoaderBenchmark.cpp)
+	HRESULT RunSceneCacheBenchmark();
+
+	// builds the overlap gather plans of the subd deformables on a synthetic tile layout, compares their executor with the cpu port
+	// of the overlap kernels and the incremental rebuild after moved tiles with a full one, writes gather_bench.csv (OverlapBenchmark.cpp)
+	HRESULT RunGatherPlanBenchmark();
+
+	// compares the avx2 cpu skinning with the scalar port of SkinningCS on the skinned scene meshes and a synthetic mesh of
+	// skinningBenchVertices vertices, measures scalar, avx2 and parallel avx2 skinning, writes skinning_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunSkinningBenchmark();
+
+	// plays synthetic clips of 32 to 8192 keys per track on keyframeBenchCharacters characters, compares the per frame cost and results
+	// of the linear key scan and the cursor sampler, writes keyframe_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunKeyframeBenchmark();
+
+	// compares the flattened bone hierarchy evaluation with the recursive one on the scene animations and a synthetic skeleton played by
+	// hierarchyBenchCharacters characters, measures recursive, flattened and parallel flattened evaluation, writes hierarchy_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunHierarchyBenchmark();
+
+	// compresses the raw scene animations and a synthetic motion clip, reports memory and sampling error per clip and the sampling
+	// cost of clipBenchCharacters characters playing the synthetic clip raw and compressed, writes clip_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunClipBenchmark();
+
+	// fits the obbs of a synthetic mesh with obbBenchVertices vertices over animated frames with pca, parallel pca and reused axes,
+	// validates them and the scene mesh obbs against DXObjectOrientedBoundingBox, writes obb_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunOBBBenchmark();
+
+	// moves the camera away from the animated groups over lodBenchFrames frames and animates and cpu skins them with and without
+	// animation lod, reports the lod counters, the time saved and the bone error per frame, writes lod_bench.csv (AnimationBenchmark.cpp)
+	HRESULT RunAnimationLODBenchmark();
+
+private:
+	void	Step(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext, BatchFrameStats& stats);
+	void	Sync() const;
+
+	BatchScenario					m_scenario;
+	Scene*							m_scene;
+	Physics*						m_physics;
+	Car*							m_car;
+
+	UINT							m_numFrames;
+	std::vector<BatchFrameStats>	m_frameStats;
+	double							m_setupMS;
+	double							m_runMS;
+};
@@ -0,0 +1,403 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "BatchSimulation.h"
+
+#include "App.h"
+#include "scene/SceneCache.h"
+#include "utils/SpatialSort.h"
+#include "utils/VertexWelder.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/Timer.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// benchmarks of the model loader stages which run before the subdivision topology is built.
+// the weld benchmark compares the vertex welder with the spatial sort queries it replaced, on split vertex quad soups
+// (4 copies of each interior vertex like an assimp mesh without shared vertices) of a height field, a planar grid
+// and a grid in the reference plane of the spatial sort.
+// the spatial sort benchmark compares its plane and grid backends on batches of radius and identity queries.
+// the scene cache benchmark times the scene import of the level models with and without their packed scene files.
+
+static const UINT WELD_BENCH_MIN_VERTICES = 1000000;
+static const UINT SPATIAL_BENCH_MAX_QUERIES = 100000;		// queries per batch, sampled evenly from the points
+static const float SPATIAL_BENCH_RADIUS = 2.0f;				// query radius in average point spacings
+static const UINT SCENE_CACHE_BENCH_WARM_LOADS = 5;			// warm loads per model, the fastest one is reported
+
+namespace
+{
+
+// previous MakeSharedVertex, one FindIdenticalPositions query per vertex
+void WeldSpatialSort(const std::vector<XMFLOAT4A>& vertices, std::vector<XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex)
+{
+	uniqueVertices.clear();
+	uniqueVertices.reserve(vertices.size());
+	replaceIndex.assign(vertices.size(), 0xffffffff);
+
+	SpatialSort vertexFinder;
+	vertexFinder.Fill(&vertices[0], static_cast<unsigned int>(vertices.size()), sizeof(XMFLOAT4A));
+
+	std::vector<unsigned int> verticesFound;
+	verticesFound.reserve(10);
+
+	for (unsigned int a = 0; a < vertices.size(); ++a)
+	{
+		vertexFinder.FindIdenticalPositions(vertices[a], verticesFound);
+
+		unsigned int matchIndex = 0xffffffff;
+		for (unsigned int b = 0; b < verticesFound.size(); ++b)
+		{
+			const unsigned int uIdx = replaceIndex[verticesFound[b]];
+			if (uIdx & 0x80000000) continue;
+			matchIndex = uIdx;
+			break;
+		}
+
+		if (matchIndex != 0xffffffff)
+		{
+			replaceIndex[a] = matchIndex | 0x80000000;
+		}
+		else
+		{
+			replaceIndex[a] = static_cast<unsigned int>(uniqueVertices.size());
+			uniqueVertices.push_back(vertices[a]);
+		}
+	}
+
+	for (size_t i = 0; i < replaceIndex.size(); ++i)
+		replaceIndex[i] &= ~0x80000000;
+}
+
+enum class WeldInput
+{
+	HEIGHT_FIELD,
+	PLANAR,
+	SORT_PLANE
+};
+
+const char* GetWeldInputName(WeldInput input)
+{
+	switch (input)
+	{
+	case WeldInput::HEIGHT_FIELD:	return "height_field";
+	case WeldInput::PLANAR:			return "planar";
+	default:						return "sort_plane";
+	}
+}
+
+// corners of size x size quads, every quad has its own 4 vertices
+void CreateQuadSoup(WeldInput input, UINT size, std::vector<XMFLOAT4A>& vertices)
+{
+	// spans the reference plane of SpatialSort, normal (0.8523, 0.34321, 0.5736) normalized
+	const XMVECTOR normal = XMVector3Normalize(XMVectorSet(0.8523f, 0.34321f, 0.5736f, 0.0f));
+	const XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(normal, XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)));
+	const XMVECTOR bitangent = XMVector3Cross(normal, tangent);
+
+	auto position = [&](UINT x, UINT y)
+	{
+		const float u = 100.0f * x / size;
+		const float v = 100.0f * y / size;
+
+		XMFLOAT4A p;
+		if (input == WeldInput::SORT_PLANE)
+			XMStoreFloat4A(&p, XMVectorAdd(XMVectorScale(tangent, u), XMVectorScale(bitangent, v)));
+		else
+			p = XMFLOAT4A(u, input == WeldInput::PLANAR ? 0.0f : 2.0f * sinf(0.3f * u) * cosf(0.2f * v), v, 1.0f);
+		p.w = 1.0f;
+		return p;
+	};
+
+	vertices.resize(4 * size * size);
+	for (UINT y = 0; y < size; ++y)
+	{
+		for (UINT x = 0; x < size; ++x)
+		{
+			XMFLOAT4A* quad = &vertices[4 * (y * size + x)];
+			quad[0] = position(x,	  y);
+			quad[1] = position(x + 1, y);
+			quad[2] = position(x + 1, y + 1);
+			quad[3] = position(x,	  y + 1);
+		}
+	}
+}
+
+enum class SpatialInput
+{
+	TERRAIN,
+	CHARACTER,
+	RANDOM
+};
+
+const char* GetSpatialInputName(SpatialInput input)
+{
+	switch (input)
+	{
+	case SpatialInput::TERRAIN:		return "terrain";
+	case SpatialInput::CHARACTER:	return "character";
+	default:						return "random";
+	}
+}
+
+// terrain: height field vertices of a 1000 x 1000 area, character: surface samples of a body ellipsoid and four limb
+// capsules with 2m height, random: uniform in a 100m cube. returns the average point spacing.
+float CreatePointSet(SpatialInput input, UINT numPoints, std::vector<XMFLOAT4A>& points)
+{
+	points.resize(numPoints);
+	UINT seed = 12345;
+	auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / (1 << 24)); };
+
+	if (input == SpatialInput::TERRAIN)
+	{
+		const UINT size = std::max(1u, static_cast<UINT>(sqrtf(static_cast<float>(numPoints))));
+		for (UINT i = 0; i < numPoints; ++i)
+		{
+			const float u = 1000.0f * (i % size) / size;
+			const float v = 1000.0f * (i / size) / size;
+			points[i] = XMFLOAT4A(u, 20.0f * sinf(0.01f * u) * cosf(0.013f * v) + 2.0f * sinf(0.1f * u + 0.07f * v), v, 1.0f);
+		}
+		return 1000.0f / size;
+	}
+
+	if (input == SpatialInput::CHARACTER)
+	{
+		// body ellipsoid, legs and arms as vertical capsule shells: center, radius, half length
+		const XMFLOAT3 centers[] = { XMFLOAT3(0.0f, 1.3f, 0.0f), XMFLOAT3(-0.15f, 0.45f, 0.0f), XMFLOAT3(0.15f, 0.45f, 0.0f), 
+									 XMFLOAT3(-0.45f, 1.3f, 0.0f), XMFLOAT3(0.45f, 1.3f, 0.0f) };
+		const float radii[] = { 0.0f, 0.08f, 0.08f, 0.05f, 0.05f };
+		const float halfLengths[] = { 0.0f, 0.4f, 0.4f, 0.3f, 0.3f };
+		for (UINT i = 0; i < numPoints; ++i)
+		{
+			const UINT part = i % 5;
+			const float phi = XM_2PI * random();
+			const float h = 2.0f * random() - 1.0f;
+			const float r = sqrtf(1.0f - h * h);
+			if (part == 0)
+				points[i] = XMFLOAT4A(centers[0].x + 0.25f * r * cosf(phi), centers[0].y + 0.45f * h, centers[0].z + 0.15f * r * sinf(phi), 1.0f);
+			else
+				points[i] = XMFLOAT4A(centers[part].x + radii[part] * cosf(phi), centers[part].y + halfLengths[part] * h, centers[part].z + radii[part] * sinf(phi), 1.0f);
+		}
+		// about 2.5 m^2 of surface
+		return sqrtf(2.5f / numPoints);
+	}
+
+	for (UINT i = 0; i < numPoints; ++i)
+		points[i] = XMFLOAT4A(100.0f * random(), 100.0f * random(), 100.0f * random(), 1.0f);
+	return 100.0f / powf(static_cast<float>(numPoints), 1.0f / 3.0f);
+}
+
+// same index sets per query, the backends return them in different order
+bool CompareQueries(const std::vector<UINT>& offsets, std::vector<UINT>& results, const std::vector<UINT>& refOffsets, std::vector<UINT>& refResults)
+{
+	if (offsets != refOffsets) return false;
+
+	for (size_t q = 0; q + 1 < offsets.size(); ++q)
+	{
+		std::sort(results.begin() + offsets[q], results.begin() + offsets[q + 1]);
+		std::sort(refResults.begin() + offsets[q], refResults.begin() + offsets[q + 1]);
+	}
+	return results == refResults;
+}
+
+}
+
+HRESULT BatchSimulation::RunWeldBenchmark()
+{
+	if (m_scenario.weldBenchMaxVertices == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	std::ofstream file((dir + "weld_bench.csv").c_str());
+	file << "input,vertices,unique,threads,spatial_sort_ms,welder_ms,speedup,tolerance_cells,identical" << std::endl;
+
+	const WeldInput inputs[] = { WeldInput::HEIGHT_FIELD, WeldInput::PLANAR, WeldInput::SORT_PLANE };
+
+	bool valid = true;
+	for (UINT numVertices = WELD_BENCH_MIN_VERTICES; numVertices <= m_scenario.weldBenchMaxVertices; numVertices *= 10)
+	{
+		const UINT size = static_cast<UINT>(sqrtf(numVertices / 4.0f) + 0.5f);
+		for (WeldInput input : inputs)
+		{
+			std::vector<XMFLOAT4A> vertices;
+			CreateQuadSoup(input, size, vertices);
+
+			std::vector<XMFLOAT4A> refUnique, unique;
+			std::vector<UINT> refReplace, replace;
+
+			double t = GetTimeMS();
+			WeldSpatialSort(vertices, refUnique, refReplace);
+			const double spatialSortMS = GetTimeMS() - t;
+
+			VertexWelder welder;
+			t = GetTimeMS();
+			welder.Weld(vertices, unique, replace);
+			const double welderMS = GetTimeMS() - t;
+
+			const bool identical = unique.size() == refUnique.size() && replace == refReplace &&
+								   memcmp(&unique[0], &refUnique[0], unique.size() * sizeof(XMFLOAT4A)) == 0;
+			valid &= identical;
+
+			file << GetWeldInputName(input) << "," << vertices.size() << "," << unique.size() << "," << g_workStealingPool.GetNumThreads() << ","
+				 << spatialSortMS << "," << welderMS << "," << (welderMS > 0.0 ? spatialSortMS / welderMS : 0.0) << ","
+				 << (welder.UsedToleranceCells() ? 1 : 0) << "," << (identical ? 1 : 0) << std::endl;
+
+			std::cout << "batch: weld " << GetWeldInputName(input) << " " << vertices.size() << " vertices, spatial sort " << spatialSortMS 
+					  << " ms, welder " << welderMS << " ms" << (identical ? "" : ", results differ") << std::endl;
+		}
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
+
+HRESULT BatchSimulation::RunSpatialSortBenchmark()
+{
+	if (m_scenario.spatialBenchPoints == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	std::ofstream file((dir + "spatial_bench.csv").c_str());
+	file << "input,points,queries,radius,threads,backend,build_ms,radius_ms,single_radius_ms,identical_ms,results,matches" << std::endl;
+
+	const SpatialInput inputs[] = { SpatialInput::TERRAIN, SpatialInput::CHARACTER, SpatialInput::RANDOM };
+	const SpatialSortBackend backends[] = { SpatialSortBackend::PLANE, SpatialSortBackend::GRID };
+
+	bool valid = true;
+	for (SpatialInput input : inputs)
+	{
+		std::vector<XMFLOAT4A> points;
+		const float radius = SPATIAL_BENCH_RADIUS * CreatePointSet(input, m_scenario.spatialBenchPoints, points);
+
+		const UINT numQueries = std::min(SPATIAL_BENCH_MAX_QUERIES, m_scenario.spatialBenchPoints);
+		std::vector<XMFLOAT4A> queries(numQueries);
+		for (UINT q = 0; q < numQueries; ++q)
+			queries[q] = points[static_cast<UINT64>(q) * points.size() / numQueries];
+
+		std::vector<UINT> refOffsets, refResults, refIdenticalOffsets, refIdenticalResults;
+		for (SpatialSortBackend backend : backends)
+		{
+			double t = GetTimeMS();
+			SpatialSort sort(&points[0], static_cast<unsigned int>(points.size()), sizeof(XMFLOAT4A), backend);
+			const double buildMS = GetTimeMS() - t;
+
+			std::vector<UINT> offsets, results, identicalOffsets, identicalResults;
+			t = GetTimeMS();
+			sort.FindPositions(&queries[0], numQueries, radius, offsets, results);
+			const double radiusMS = GetTimeMS() - t;
+
+			// serial single queries, the way the loader used them so far
+			std::vector<UINT> single;
+			bool matches = true;
+			t = GetTimeMS();
+			for (UINT q = 0; q < numQueries; ++q)
+			{
+				sort.FindPositions(queries[q], radius, single);
+				matches &= single.size() == offsets[q + 1] - offsets[q] && std::equal(single.begin(), single.end(), results.begin() + offsets[q]);
+			}
+			const double singleMS = GetTimeMS() - t;
+
+			t = GetTimeMS();
+			sort.FindIdenticalPositions(&queries[0], numQueries, identicalOffsets, identicalResults);
+			const double identicalMS = GetTimeMS() - t;
+
+			const size_t numResults = results.size();
+			if (backend == SpatialSortBackend::PLANE)
+			{
+				refOffsets.swap(offsets);
+				refResults.swap(results);
+				refIdenticalOffsets.swap(identicalOffsets);
+				refIdenticalResults.swap(identicalResults);
+			}
+			else
+			{
+				matches &= CompareQueries(offsets, results, refOffsets, refResults);
+				matches &= CompareQueries(identicalOffsets, identicalResults, refIdenticalOffsets, refIdenticalResults);
+			}
+			valid &= matches;
+
+			const char* backendName = backend == SpatialSortBackend::PLANE ? "plane" : "grid";
+			file << GetSpatialInputName(input) << "," << points.size() << "," << numQueries << "," << radius << "," << g_workStealingPool.GetNumThreads() << ","
+				 << backendName << "," << buildMS << "," << radiusMS << "," << singleMS << "," << identicalMS << "," << numResults << "," << (matches ? 1 : 0) << std::endl;
+
+			std::cout << "batch: spatial sort " << GetSpatialInputName(input) << " " << backendName << ", build " << buildMS << " ms, " 
+					  << numQueries << " radius queries " << radiusMS << " ms (single " << singleMS << " ms)" << (matches ? "" : ", results differ") << std::endl;
+		}
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
+
+HRESULT BatchSimulation::RunSceneCacheBenchmark()
+{
+	if (!m_scenario.sceneCacheBench) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	std::ofstream file((dir + "scene_cache_bench.csv").c_str());
+	file << "model,source_bytes,cache_bytes,cold_ms,warm_ms,speedup,warm_hit" << std::endl;
+
+	const std::string models[] = { m_scenario.sceneFile, m_scenario.chassisFile, m_scenario.wheelFile, "media/models/skydome.dae" };
+
+	const bool useSceneCache = g_app.g_useSceneCache;
+	g_app.g_useSceneCache = true;
+
+	bool valid = true;
+	for (const std::string& model : models)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(model.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			std::cerr << "batch: scene cache benchmark cannot find " << model << std::endl;
+			continue;
+		}
+		const UINT64 sourceBytes = (static_cast<UINT64>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+
+		// cold: assimp import, packing and writing the cache file
+		DeleteFileA(SceneCache::GetFileName(model).c_str());
+
+		SceneCache cache;
+		double t = GetTimeMS();
+		HRESULT hr = cache.Load(model);
+		const double coldMS = GetTimeMS() - t;
+		const UINT64 cacheBytes = cache.GetSize();
+		cache.Close();
+
+		// warm: source hash and mapping
+		double warmMS = 0.0;
+		bool warmHit = SUCCEEDED(hr);
+		for (UINT i = 0; i < SCENE_CACHE_BENCH_WARM_LOADS && warmHit; ++i)
+		{
+			t = GetTimeMS();
+			warmHit = SUCCEEDED(cache.Load(model)) && cache.IsCacheHit();
+			const double ms = GetTimeMS() - t;
+			warmMS = i == 0 ? ms : std::min(warmMS, ms);
+			cache.Close();
+		}
+		valid &= warmHit;
+
+		file << model << "," << sourceBytes << "," << cacheBytes << "," << coldMS << "," << warmMS << "," 
+			 << (warmMS > 0.0 ? coldMS / warmMS : 0.0) << "," << (warmHit ? 1 : 0) << std::endl;
+
+		std::cout << "batch: scene cache " << model << ", cold " << coldMS << " ms, warm " << warmMS << " ms" << (warmHit ? "" : ", no cache hit") << std::endl;
+	}
+
+	g_app.g_useSceneCache = useSceneCache;
+
+	return valid ? S_OK : E_FAIL;
+}
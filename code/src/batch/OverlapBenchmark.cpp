@@ -0,0 +1,200 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "BatchSimulation.h"
+
+#include "App.h"
+#include "OverlapGatherPlan.h"
+#include "scene/Scene.h"
+#include "scene/ModelInstance.h"
+#include "scene/DXSubDModel.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/Timer.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+// benchmarks of the tile overlap update.
+// the gather plan benchmark allocates the tiles of the first ptex faces of every subd deformable of the scene like the memory
+// manager table (rows of tiles with overlap per page), builds the overlap gather plan and compares its executor with the cpu port
+// of OverlapEdgesCS/OverlapCornersCS, then moves a few tiles and times the incremental rebuild against a full one.
+
+static const UINT GATHER_BENCH_MAX_TILES	= 1024;		// allocated tiles per deformable, bounds the texel arrays
+static const UINT GATHER_BENCH_PAGE_TILES	= 16;		// tiles per page row and column
+static const UINT GATHER_BENCH_MOVED_TILES	= 100;		// one tile pair in GATHER_BENCH_MOVED_TILES swaps its slots for the incremental rebuild
+
+namespace
+{
+
+// tile slot per face, -1 = not allocated
+void GetTileLayout(const std::vector<int>& slots, UINT tileSize, std::vector<uint16_t>& tileLayout)
+{
+	const UINT tileWidth = tileSize + 2;
+	const UINT tilesPerPage = GATHER_BENCH_PAGE_TILES * GATHER_BENCH_PAGE_TILES;
+
+	tileLayout.assign(slots.size() * 4, 0);
+	for (size_t ptexID = 0; ptexID < slots.size(); ++ptexID)
+	{
+		uint16_t* entry = &tileLayout[ptexID * 4];
+		if (slots[ptexID] < 0)
+		{
+			entry[0] = USHRT_MAX;
+			continue;
+		}
+
+		const UINT slot = slots[ptexID] % tilesPerPage;
+		entry[0] = static_cast<uint16_t>(slots[ptexID] / tilesPerPage);
+		entry[1] = static_cast<uint16_t>((slot % GATHER_BENCH_PAGE_TILES) * tileWidth + 1);
+		entry[2] = static_cast<uint16_t>((slot / GATHER_BENCH_PAGE_TILES) * tileWidth + 1);
+	}
+}
+
+UINT GetNumActiveRuns(const std::vector<OverlapCopyRun>& runs)
+{
+	return static_cast<UINT>(std::count_if(runs.begin(), runs.end(), [](const OverlapCopyRun& run) { return run.count > 0; }));
+}
+
+bool EqualRuns(const std::vector<OverlapCopyRun>& a, const std::vector<OverlapCopyRun>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(OverlapCopyRun)) == 0);
+}
+
+}
+
+HRESULT BatchSimulation::RunGatherPlanBenchmark()
+{
+	if (m_scenario.gatherBenchIterations == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+	const UINT numIterations = m_scenario.gatherBenchIterations;
+	const UINT tileSize = g_app.g_displacementTileSize;
+	const UINT pageWidth = GATHER_BENCH_PAGE_TILES * (tileSize + 2);
+
+	std::vector<DXOSDMesh*> meshes;
+	for (auto group : m_scene->GetModelGroups())
+	{
+		for (auto instance : group->modelInstances)
+		{
+			if (instance->IsDeformable() && instance->IsSubD() && std::find(meshes.begin(), meshes.end(), instance->GetOSDMesh()) == meshes.end())
+				meshes.push_back(instance->GetOSDMesh());
+		}
+	}
+
+	std::ofstream file((dir + "gather_bench.csv").c_str());
+	file << "mesh,faces,tiles,tile_size,runs,texels,threads,build_ms,check_ms,moved_tiles,rebuilt_faces,update_ms,rebuild_ms,"
+		 << "reference_ms,serial_ms,parallel_ms,reference_gbs,serial_gbs,parallel_gbs,matches" << std::endl;
+
+	bool valid = true;
+	for (size_t m = 0; m < meshes.size(); ++m)
+	{
+		const std::vector<SPtexNeighborData>& neighbors = meshes[m]->GetPtexNeighborDataREF();
+		const UINT numPtexFaces = static_cast<UINT>(neighbors.size());
+		const UINT numTiles = std::min(numPtexFaces, GATHER_BENCH_MAX_TILES);
+		const UINT numPages = (numTiles + GATHER_BENCH_PAGE_TILES * GATHER_BENCH_PAGE_TILES - 1) / (GATHER_BENCH_PAGE_TILES * GATHER_BENCH_PAGE_TILES);
+		if (numTiles == 0) continue;
+
+		std::vector<int> slots(numPtexFaces, -1);
+		for (UINT ptexID = 0; ptexID < numTiles; ++ptexID)
+			slots[ptexID] = ptexID;
+
+		std::vector<uint16_t> tileLayout;
+		GetTileLayout(slots, tileSize, tileLayout);
+
+		std::vector<float> texels(static_cast<size_t>(pageWidth) * pageWidth * numPages);
+		for (size_t i = 0; i < texels.size(); ++i)
+			texels[i] = static_cast<float>(i % 65521);
+
+		OverlapGatherPlan plan;
+		double t = GetTimeMS();
+		HRESULT hr = plan.Create(neighbors, tileLayout, tileSize, pageWidth, pageWidth, numPages);
+		const double buildMS = GetTimeMS() - t;
+		if (FAILED(hr))
+		{
+			valid = false;
+			continue;
+		}
+
+		// detecting an unchanged layout, the cost paid every frame without allocations
+		t = GetTimeMS();
+		bool matches = plan.Update(tileLayout) == 0;
+		const double checkMS = GetTimeMS() - t;
+
+		// one pass of each on the same input
+		std::vector<float> reference = texels;
+		std::vector<float> gathered = texels;
+		OverlapGatherPlan::UpdateOverlapCPU(neighbors, tileLayout, tileSize, pageWidth, pageWidth, &reference[0]);
+		plan.Execute(&gathered[0]);
+		matches &= reference == gathered;
+
+		t = GetTimeMS();
+		for (UINT i = 0; i < numIterations; ++i)
+			OverlapGatherPlan::UpdateOverlapCPU(neighbors, tileLayout, tileSize, pageWidth, pageWidth, &reference[0]);
+		const double referenceMS = (GetTimeMS() - t) / numIterations;
+
+		t = GetTimeMS();
+		for (UINT i = 0; i < numIterations; ++i)
+			plan.Execute(&gathered[0], false);
+		const double serialMS = (GetTimeMS() - t) / numIterations;
+
+		t = GetTimeMS();
+		for (UINT i = 0; i < numIterations; ++i)
+			plan.Execute(&gathered[0], true);
+		const double parallelMS = (GetTimeMS() - t) / numIterations;
+
+		// the allocator moves a few tiles: incremental update against a full rebuild
+		UINT numMoved = 0;
+		for (UINT ptexID = 0; ptexID + numTiles / 2 < numTiles; ptexID += GATHER_BENCH_MOVED_TILES)
+		{
+			std::swap(slots[ptexID], slots[ptexID + numTiles / 2]);
+			numMoved += 2;
+		}
+		GetTileLayout(slots, tileSize, tileLayout);
+
+		t = GetTimeMS();
+		matches &= plan.Update(tileLayout) == numMoved;
+		const double updateMS = GetTimeMS() - t;
+
+		OverlapGatherPlan rebuilt;
+		t = GetTimeMS();
+		rebuilt.Create(neighbors, tileLayout, tileSize, pageWidth, pageWidth, numPages);
+		const double rebuildMS = GetTimeMS() - t;
+		matches &= EqualRuns(plan.GetEdgeRuns(), rebuilt.GetEdgeRuns()) && EqualRuns(plan.GetCornerRuns(), rebuilt.GetCornerRuns());
+
+		reference = texels;
+		gathered = texels;
+		OverlapGatherPlan::UpdateOverlapCPU(neighbors, tileLayout, tileSize, pageWidth, pageWidth, &reference[0]);
+		plan.Execute(&gathered[0]);
+		matches &= reference == gathered;
+		valid &= matches;
+
+		// bytes moved per pass, read + write of every overlap texel
+		const double bytes = static_cast<double>(plan.GetNumBytes());
+		const UINT numRuns = GetNumActiveRuns(plan.GetEdgeRuns()) + GetNumActiveRuns(plan.GetCornerRuns());
+
+		file << m << "," << numPtexFaces << "," << numTiles << "," << tileSize << "," << numRuns << "," << plan.GetNumTexels() << "," << g_workStealingPool.GetNumThreads() << ","
+			 << buildMS << "," << checkMS << "," << numMoved << "," << plan.GetNumRebuiltFaces() << "," << updateMS << "," << rebuildMS << ","
+			 << referenceMS << "," << serialMS << "," << parallelMS << "," << bytes / (referenceMS * 1e6) << "," << bytes / (serialMS * 1e6) << "," << bytes / (parallelMS * 1e6) << ","
+			 << (matches ? 1 : 0) << std::endl;
+
+		std::cout << "batch: overlap gather plan of deformable " << m << ", " << numRuns << " runs built in " << buildMS << " ms, " << numMoved << " moved tiles rebuilt in "
+				  << updateMS << " ms (full " << rebuildMS << " ms), " << bytes / (parallelMS * 1e6) << " GB/s (serial " << bytes / (serialMS * 1e6) << ", kernel port "
+				  << bytes / (referenceMS * 1e6) << ")" << (matches ? "" : ", results differ") << std::endl;
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
@@ -0,0 +1,959 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "BatchSimulation.h"
+
+#include "App.h"
+#include "compute/OsdCPUComputeController.h"
+#include "compute/OsdCPUStencilEvaluator.h"
+#include "compute/FarTopologyBuilder.h"
+#include "scene/QuadAdjacency.h"
+#include "utils/WorkStealingPool.h"
+#include "scene/Scene.h"
+#include "scene/ModelInstance.h"
+#include "scene/DXSubDModel.h"
+#include "utils/Timer.h"
+
+#include <far/meshFactory.h>
+#include <far/mesh.h>
+#include <hbr/mesh.h>
+#include <hbr/catmark.h>
+#include <hbr/loop.h>
+#include <hbr/bilinear.h>
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+// validation of the cpu compute controller against the hbr reference refinement, and its throughput for levels 1..SUBD_BENCH_MAX_LEVEL.
+// hbr evaluates the vertex data while it refines, so every hbr vertex holds the reference position of its far vertex.
+// the stencil benchmark compares the per frame refinement of the scene subd models with stencils and with the kernel batches.
+// the topology benchmark checks the far tables built from quad indices against the hbr tables and compares their build cost,
+// the adjacency benchmark does the same for the tile overlap data of the loader.
+
+static const int	SUBD_BENCH_MAX_LEVEL	= 5;
+static const int	SUBD_BENCH_GRID_SIZE	= 16;
+static const float	SUBD_BENCH_MAX_ERROR	= 1e-4f;		// meshes are unit sized
+static const UINT	TOPO_BENCH_MIN_FACES	= 10000;		// grids of 10k, 100k, 1m faces up to --topo-bench
+static const int	TOPO_BENCH_LEVEL		= 2;
+
+namespace
+{
+
+// position only vertex, evaluated by hbr during refinement
+class ValidationVertex
+{
+public:
+	ValidationVertex()											{ Clear(); }
+	ValidationVertex(int /* index */)							{ Clear(); }
+	ValidationVertex(const ValidationVertex& src)				{ p[0] = src.p[0]; p[1] = src.p[1]; p[2] = src.p[2]; }
+
+	void AddWithWeight(const ValidationVertex& src, float weight, void* = 0)
+	{
+		p[0] += weight * src.p[0];
+		p[1] += weight * src.p[1];
+		p[2] += weight * src.p[2];
+	}
+
+	void AddVaryingWithWeight(const ValidationVertex& /* src */, float /* weight */, void* = 0) {}
+
+	void Clear(void* = 0)										{ p[0] = p[1] = p[2] = 0.0f; }
+
+	// the test meshes have no hierarchical edits
+	void ApplyVertexEdit(const OpenSubdiv::HbrVertexEdit<ValidationVertex>& /* edit */) {}
+	void ApplyVertexEdit(const OpenSubdiv::FarVertexEdit& /* edit */) {}
+	void ApplyMovingVertexEdit(const OpenSubdiv::HbrMovingVertexEdit<ValidationVertex>& /* edit */) {}
+
+	float p[3];
+};
+
+typedef OpenSubdiv::HbrMesh<ValidationVertex> ValidationHbrMesh;
+
+enum class SubdScheme
+{
+	CATMARK,
+	LOOP,
+	BILINEAR
+};
+
+struct SubdCrease
+{
+	int		v0, v1;
+	float	sharpness;
+};
+
+struct SubdTestMesh
+{
+	std::string				name;
+	SubdScheme				scheme;
+	std::vector<float>		positions;		// xyz
+	std::vector<int>		faceSizes;
+	std::vector<int>		faceIndices;
+	std::vector<SubdCrease>	creases;
+	std::vector<std::pair<int, float>> cornerVertices;
+
+	void AddVertex(float x, float y, float z)	{ positions.push_back(x); positions.push_back(y); positions.push_back(z); }
+	void AddTri(int a, int b, int c)			{ faceSizes.push_back(3); faceIndices.push_back(a); faceIndices.push_back(b); faceIndices.push_back(c); }
+	void AddQuad(int a, int b, int c, int d)	{ faceSizes.push_back(4); faceIndices.push_back(a); faceIndices.push_back(b); faceIndices.push_back(c); faceIndices.push_back(d); }
+	int	 GetNumVertices() const					{ return static_cast<int>(positions.size() / 3); }
+};
+
+SubdTestMesh CreateCube(const std::string& name, SubdScheme scheme)
+{
+	SubdTestMesh mesh;
+	mesh.name = name;
+	mesh.scheme = scheme;
+	for (int i = 0; i < 8; ++i)
+		mesh.AddVertex((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f);
+
+	mesh.AddQuad(0, 2, 3, 1);
+	mesh.AddQuad(4, 5, 7, 6);
+	mesh.AddQuad(0, 1, 5, 4);
+	mesh.AddQuad(2, 6, 7, 3);
+	mesh.AddQuad(0, 4, 6, 2);
+	mesh.AddQuad(1, 3, 7, 5);
+	return mesh;
+}
+
+// quads and triangles, the face vertex kernel for non quads
+SubdTestMesh CreatePyramid()
+{
+	SubdTestMesh mesh;
+	mesh.name = "pyramid";
+	mesh.scheme = SubdScheme::CATMARK;
+	mesh.AddVertex(-0.5f, -0.5f, 0.0f);
+	mesh.AddVertex( 0.5f, -0.5f, 0.0f);
+	mesh.AddVertex( 0.5f,  0.5f, 0.0f);
+	mesh.AddVertex(-0.5f,  0.5f, 0.0f);
+	mesh.AddVertex( 0.0f,  0.0f, 0.8f);
+
+	mesh.AddQuad(0, 3, 2, 1);
+	mesh.AddTri(0, 1, 4);
+	mesh.AddTri(1, 2, 4);
+	mesh.AddTri(2, 3, 4);
+	mesh.AddTri(3, 0, 4);
+	return mesh;
+}
+
+// open height field with boundary edges, also the throughput mesh
+SubdTestMesh CreateGrid(int size)
+{
+	SubdTestMesh mesh;
+	mesh.name = "grid";
+	mesh.scheme = SubdScheme::CATMARK;
+	for (int y = 0; y <= size; ++y)
+	{
+		for (int x = 0; x <= size; ++x)
+		{
+			float u = static_cast<float>(x) / size;
+			float v = static_cast<float>(y) / size;
+			mesh.AddVertex(u - 0.5f, v - 0.5f, 0.1f * sinf(6.0f * u) * cosf(4.0f * v));
+		}
+	}
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			int i = y * (size + 1) + x;
+			mesh.AddQuad(i, i + 1, i + size + 2, i + size + 1);
+		}
+	}
+	return mesh;
+}
+
+SubdTestMesh CreateOctahedron()
+{
+	SubdTestMesh mesh;
+	mesh.name = "octahedron";
+	mesh.scheme = SubdScheme::LOOP;
+	mesh.AddVertex( 0.5f,  0.0f,  0.0f);
+	mesh.AddVertex(-0.5f,  0.0f,  0.0f);
+	mesh.AddVertex( 0.0f,  0.5f,  0.0f);
+	mesh.AddVertex( 0.0f, -0.5f,  0.0f);
+	mesh.AddVertex( 0.0f,  0.0f,  0.5f);
+	mesh.AddVertex( 0.0f,  0.0f, -0.5f);
+
+	mesh.AddTri(0, 2, 4);
+	mesh.AddTri(2, 1, 4);
+	mesh.AddTri(1, 3, 4);
+	mesh.AddTri(3, 0, 4);
+	mesh.AddTri(2, 0, 5);
+	mesh.AddTri(1, 2, 5);
+	mesh.AddTri(3, 1, 5);
+	mesh.AddTri(0, 3, 5);
+	return mesh;
+}
+
+ValidationHbrMesh* CreateHbrMesh(const SubdTestMesh& mesh, OpenSubdiv::HbrSubdivision<ValidationVertex>* scheme)
+{
+	ValidationHbrMesh* hmesh = new ValidationHbrMesh(scheme);
+
+	ValidationVertex vertex;
+	for (int i = 0; i < mesh.GetNumVertices(); ++i)
+	{
+		vertex.p[0] = mesh.positions[3 * i + 0];
+		vertex.p[1] = mesh.positions[3 * i + 1];
+		vertex.p[2] = mesh.positions[3 * i + 2];
+		hmesh->NewVertex(i, vertex);
+	}
+
+	int offset = 0;
+	for (size_t i = 0; i < mesh.faceSizes.size(); ++i)
+	{
+		OpenSubdiv::HbrFace<ValidationVertex>* face = hmesh->NewFace(mesh.faceSizes[i], &mesh.faceIndices[offset], 0);
+		face->SetPtexIndex(static_cast<int>(i));
+		offset += mesh.faceSizes[i];
+	}
+
+	for (const auto& crease : mesh.creases)
+	{
+		OpenSubdiv::HbrHalfedge<ValidationVertex>* edge = hmesh->GetVertex(crease.v0)->GetEdge(crease.v1);
+		if (!edge) edge = hmesh->GetVertex(crease.v1)->GetEdge(crease.v0);
+		if (edge) edge->SetSharpness(crease.sharpness);
+	}
+
+	for (const auto& corner : mesh.cornerVertices)
+		hmesh->GetVertex(corner.first)->SetSharpness(corner.second);
+
+	hmesh->SetInterpolateBoundaryMethod(ValidationHbrMesh::k_InterpolateBoundaryEdgeOnly);
+	hmesh->Finish();
+	return hmesh;
+}
+
+struct SubdBenchResult
+{
+	int		numVertices;
+	float	maxError;
+	double	serialMS;
+	double	parallelMS;
+};
+
+SubdBenchResult RefineAndValidate(const SubdTestMesh& mesh, int level, UINT iterations, OsdCPUComputeController* controller)
+{
+	OpenSubdiv::HbrCatmarkSubdivision<ValidationVertex>		catmark;
+	OpenSubdiv::HbrLoopSubdivision<ValidationVertex>		loop;
+	OpenSubdiv::HbrBilinearSubdivision<ValidationVertex>	bilinear;
+
+	OpenSubdiv::HbrSubdivision<ValidationVertex>* scheme = &catmark;
+	if (mesh.scheme == SubdScheme::LOOP)		scheme = &loop;
+	if (mesh.scheme == SubdScheme::BILINEAR)	scheme = &bilinear;
+
+	ValidationHbrMesh* hmesh = CreateHbrMesh(mesh, scheme);
+
+	// refines the hbr mesh uniformly to the given level
+	OpenSubdiv::FarMeshFactory<ValidationVertex> factory(hmesh, level);
+	OpenSubdiv::FarMesh<ValidationVertex>* farMesh = factory.Create();
+	const std::vector<int>& remap = factory.GetRemappingTable();
+
+	OsdCPUComputeContext* context = OsdCPUComputeContext::Create(farMesh->GetSubdivisionTables(), farMesh->GetVertexEditTables());
+	OsdCPUD3D11VertexBuffer* vertexBuffer = OsdCPUD3D11VertexBuffer::Create(3, farMesh->GetNumVertices(), NULL);
+
+	// coarse vertices, the refinement only writes the refined levels so repeated runs give the same result
+	float* data = vertexBuffer->BindCpuBuffer();
+	for (int i = 0; i < mesh.GetNumVertices(); ++i)
+		memcpy(&data[3 * remap[i]], &mesh.positions[3 * i], 3 * sizeof(float));
+
+	const bool wasParallel = controller->GetParallel();
+
+	SubdBenchResult result;
+	result.numVertices = farMesh->GetNumVertices();
+
+	controller->SetParallel(false);
+	double t = GetTimeMS();
+	for (UINT i = 0; i < iterations; ++i)
+		controller->Refine(context, farMesh->GetKernelBatches(), vertexBuffer);
+	result.serialMS = (GetTimeMS() - t) / iterations;
+
+	controller->SetParallel(true);
+	t = GetTimeMS();
+	for (UINT i = 0; i < iterations; ++i)
+		controller->Refine(context, farMesh->GetKernelBatches(), vertexBuffer);
+	result.parallelMS = (GetTimeMS() - t) / iterations;
+
+	controller->SetParallel(wasParallel);
+
+	// every hbr vertex against its far vertex
+	result.maxError = 0.0f;
+	data = vertexBuffer->BindCpuBuffer();
+	for (int id = 0; id < hmesh->GetNumVertices(); ++id)
+	{
+		OpenSubdiv::HbrVertex<ValidationVertex>* v = hmesh->GetVertex(id);
+		if (!v || id >= static_cast<int>(remap.size()) || remap[id] < 0 || remap[id] >= result.numVertices) continue;
+
+		const float* ref = v->GetData().p;
+		const float* val = &data[3 * remap[id]];
+		for (int c = 0; c < 3; ++c)
+			result.maxError = std::max(result.maxError, fabsf(ref[c] - val[c]));
+	}
+
+	delete vertexBuffer;
+	delete context;
+	delete farMesh;
+	delete hmesh;
+	return result;
+}
+
+}
+
+HRESULT BatchSimulation::RunSubdivisionBenchmark()
+{
+	if (m_scenario.subdBenchIterations == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	std::vector<SubdTestMesh> meshes;
+	meshes.push_back(CreateCube("cube", SubdScheme::CATMARK));
+
+	// sharp and fractional semi-sharp creases around the top, an infinitely sharp corner
+	meshes.push_back(CreateCube("creased cube", SubdScheme::CATMARK));
+	SubdTestMesh& creased = meshes.back();
+	const SubdCrease creases[] = { { 4, 5, 2.0f }, { 5, 7, 1.5f }, { 7, 6, 0.75f }, { 6, 4, 3.25f } };
+	creased.creases.assign(creases, creases + ARRAYSIZE(creases));
+	creased.cornerVertices.push_back(std::make_pair(0, static_cast<float>(OpenSubdiv::HbrVertex<ValidationVertex>::k_InfinitelySharp)));
+
+	meshes.push_back(CreatePyramid());
+	meshes.push_back(CreateGrid(SUBD_BENCH_GRID_SIZE));
+	meshes.push_back(CreateOctahedron());
+	meshes.push_back(CreateCube("bilinear cube", SubdScheme::BILINEAR));
+
+	OsdCPUComputeController controller;
+
+	std::ofstream file((dir + "subd_cpu.csv").c_str());
+	file << "mesh,level,vertices,max_error,serial_ms,parallel_ms,parallel_mverts_per_s,speedup" << std::endl;
+
+	bool valid = true;
+	for (const auto& mesh : meshes)
+	{
+		for (int level = 1; level <= SUBD_BENCH_MAX_LEVEL; ++level)
+		{
+			SubdBenchResult result = RefineAndValidate(mesh, level, m_scenario.subdBenchIterations, &controller);
+
+			const int numRefined = result.numVertices - mesh.GetNumVertices();
+			const double mvertsPerS = result.parallelMS > 0.0 ? numRefined / (result.parallelMS * 1000.0) : 0.0;
+			const double speedup = result.parallelMS > 0.0 ? result.serialMS / result.parallelMS : 0.0;
+
+			file << mesh.name << "," << level << "," << result.numVertices << "," << result.maxError << ","
+				 << result.serialMS << "," << result.parallelMS << "," << mvertsPerS << "," << speedup << std::endl;
+
+			if (result.maxError > SUBD_BENCH_MAX_ERROR)
+			{
+				std::cerr << "batch: cpu subdivision of " << mesh.name << " level " << level << " differs from hbr, max error " << result.maxError << std::endl;
+				valid = false;
+			}
+			else if (level == SUBD_BENCH_MAX_LEVEL)
+			{
+				std::cout << "batch: cpu subdivision " << mesh.name << " level " << level << ", " << result.numVertices << " vertices, "
+						  << result.serialMS << " ms serial, " << result.parallelMS << " ms parallel" << std::endl;
+			}
+		}
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
+
+HRESULT BatchSimulation::RunStencilBenchmark()
+{
+	if (m_scenario.stencilBenchIterations == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+	const UINT iterations = m_scenario.stencilBenchIterations;
+
+	OsdCPUComputeController controller;
+
+	std::ofstream file((dir + "stencil_bench.csv").c_str());
+	file << "model,level,coarse_vertices,vertices,nonzeros,stored_entries,build_ms,kernel_gpu_ms,kernel_cpu_serial_ms,kernel_cpu_parallel_ms,"
+		 << "stencil_serial_ms,stencil_parallel_ms,stencil_upload_ms,max_error,limit_points,limit_ms" << std::endl;
+
+	bool valid = true;
+	for (auto group : m_scene->GetModelGroups())
+	{
+		for (auto mesh : group->osdModels)
+		{
+			const OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* farMesh = mesh->GetFarMesh();
+			const std::vector<float>& control = mesh->GetControlVertices();
+			if (!farMesh || control.empty()) continue;
+
+			const int numElements = mesh->GetNumVertexElements();
+			const int numCoarse = static_cast<int>(control.size()) / numElements;
+			const int numVertices = farMesh->GetNumVertices();
+
+			// per frame work of an animated cage with the kernel batches: cage upload and refinement on the mesh controller
+			double t = GetTimeMS();
+			for (UINT i = 0; i < iterations; ++i)
+			{
+				mesh->GetMesh()->UpdateVertexBuffer(&control[0], 0, numCoarse);
+				mesh->GetMesh()->Refine();
+			}
+			g_app.WaitForGPU();
+			const double kernelGpuMS = (GetTimeMS() - t) / iterations;
+
+			// same kernel batches on the cpu controller, also the reference for the stencils
+			OsdCPUComputeContext* context = OsdCPUComputeContext::Create(farMesh->GetSubdivisionTables(), farMesh->GetVertexEditTables());
+			OsdCPUD3D11VertexBuffer* vertexBuffer = OsdCPUD3D11VertexBuffer::Create(numElements, numVertices, NULL);
+
+			double kernelCpuMS[2];
+			for (int parallel = 0; parallel < 2; ++parallel)
+			{
+				controller.SetParallel(parallel != 0);
+				t = GetTimeMS();
+				for (UINT i = 0; i < iterations; ++i)
+				{
+					vertexBuffer->UpdateData(&control[0], 0, numCoarse);
+					controller.Refine(context, farMesh->GetKernelBatches(), vertexBuffer);
+				}
+				kernelCpuMS[parallel] = (GetTimeMS() - t) / iterations;
+			}
+
+			OsdCPUStencilEvaluator stencils;
+			t = GetTimeMS();
+			HRESULT hr = stencils.CreateRefinementStencils(farMesh, numCoarse);
+			const double buildMS = GetTimeMS() - t;
+
+			if (FAILED(hr))
+			{
+				std::cerr << "batch: no refinement stencils for " << mesh->GetName() << std::endl;
+				delete vertexBuffer;
+				delete context;
+				continue;
+			}
+
+			std::vector<float> refined(numVertices * numElements);
+			double stencilMS[2];
+			for (int parallel = 0; parallel < 2; ++parallel)
+			{
+				stencils.SetParallel(parallel != 0);
+				t = GetTimeMS();
+				for (UINT i = 0; i < iterations; ++i)
+					stencils.UpdateValues(&control[0], numElements, &refined[0], numElements);
+				stencilMS[parallel] = (GetTimeMS() - t) / iterations;
+			}
+
+			// the stencils replace the gpu kernels by an upload of all refined vertices
+			t = GetTimeMS();
+			for (UINT i = 0; i < iterations; ++i)
+				mesh->GetMesh()->UpdateVertexBuffer(&refined[0], 0, numVertices);
+			g_app.WaitForGPU();
+			const double uploadMS = (GetTimeMS() - t) / iterations;
+
+			float maxError = 0.0f, maxCoord = 1.0f;
+			const float* reference = vertexBuffer->BindCpuBuffer();
+			for (size_t i = 0; i < refined.size(); ++i)
+			{
+				maxError = std::max(maxError, fabsf(refined[i] - reference[i]));
+				maxCoord = std::max(maxCoord, fabsf(reference[i]));
+			}
+
+			// limit positions and tangents, built with the mesh (g_stencilLimitSamples)
+			UINT numLimitPoints = 0;
+			double limitMS = 0.0;
+			OsdCPUStencilEvaluator* limit = mesh->GetLimitStencils();
+			if (limit)
+			{
+				numLimitPoints = limit->GetNumStencils();
+				std::vector<float> positions(numLimitPoints * 3), uderivs(numLimitPoints * 3), vderivs(numLimitPoints * 3);
+
+				t = GetTimeMS();
+				for (UINT i = 0; i < iterations; ++i)
+				{
+					limit->UpdateValues(&control[0], numElements, &positions[0], 3);
+					limit->UpdateDerivs(&control[0], numElements, &uderivs[0], &vderivs[0], 3);
+				}
+				limitMS = (GetTimeMS() - t) / iterations;
+			}
+
+			// back to the refinement mode of the mesh
+			mesh->Refine();
+
+			file << mesh->GetName() << "," << g_app.g_maxSubdivisions << "," << numCoarse << "," << numVertices << ","
+				 << stencils.GetMatrix().GetNumNonZeros() << "," << stencils.GetMatrix().GetNumStoredEntries() << "," << buildMS << ","
+				 << kernelGpuMS << "," << kernelCpuMS[0] << "," << kernelCpuMS[1] << ","
+				 << stencilMS[0] << "," << stencilMS[1] << "," << uploadMS << "," << maxError << ","
+				 << numLimitPoints << "," << limitMS << std::endl;
+
+			std::cout << "batch: " << mesh->GetName() << ", " << numVertices << " vertices, kernel batches " << kernelGpuMS << " ms, stencils "
+					  << stencilMS[1] << " ms + " << uploadMS << " ms upload" << std::endl;
+
+			if (maxError > SUBD_BENCH_MAX_ERROR * maxCoord)
+			{
+				std::cerr << "batch: refinement stencils of " << mesh->GetName() << " differ from the kernel batches, max error " << maxError << std::endl;
+				valid = false;
+			}
+
+			delete vertexBuffer;
+			delete context;
+		}
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
+
+namespace
+{
+
+struct TopoBenchResult
+{
+	bool	tablesMatch;
+	float	maxError;			// refined positions of the builder tables against the hbr positions, per level as a point set
+	int		numVertices;
+	double	hbrMS;
+	double	builderMS;
+	size_t	hbrBytes;
+	size_t	builderBytes;
+};
+
+std::vector<DirectX::XMUINT4> GetQuads(const SubdTestMesh& mesh)
+{
+	std::vector<DirectX::XMUINT4> quads(mesh.faceSizes.size());
+	for (size_t f = 0; f < quads.size(); ++f)
+		quads[f] = DirectX::XMUINT4(mesh.faceIndices[4 * f + 0], mesh.faceIndices[4 * f + 1], mesh.faceIndices[4 * f + 2], mesh.faceIndices[4 * f + 3]);
+	return quads;
+}
+
+OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* CreateDirectFarMesh(const SubdTestMesh& mesh, int level, FarTopologyBuilder& builder)
+{
+	const std::vector<DirectX::XMUINT4> quads = GetQuads(mesh);
+	builder.SetCage(mesh.GetNumVertices(), &quads[0], static_cast<UINT>(quads.size()));
+	for (const auto& crease : mesh.creases)
+		builder.AddCrease(crease.v0, crease.v1, crease.sharpness);
+	for (const auto& corner : mesh.cornerVertices)
+		builder.SetVertexSharpness(corner.first, corner.second);
+
+	return builder.Create(level);
+}
+
+// same level sizes, kernel batches and table sizes, the vertex order within the blocks may differ
+bool CompareTables(const OpenSubdiv::FarSubdivisionTables* ref, const OpenSubdiv::FarKernelBatchVector& refBatches, const OpenSubdiv::FarPatchTables* refPatches,
+				   const OpenSubdiv::FarSubdivisionTables* val, const OpenSubdiv::FarKernelBatchVector& valBatches, const OpenSubdiv::FarPatchTables* valPatches)
+{
+	if (ref->GetMaxLevel() != val->GetMaxLevel()) return false;
+	for (int level = 0; level < ref->GetMaxLevel(); ++level)
+		if (ref->GetFirstVertexOffset(level) != val->GetFirstVertexOffset(level) || ref->GetNumVertices(level) != val->GetNumVertices(level)) return false;
+
+	if (ref->Get_F_IT().size()  != val->Get_F_IT().size()  || ref->Get_F_ITa().size() != val->Get_F_ITa().size() ||
+		ref->Get_E_IT().size()  != val->Get_E_IT().size()  || ref->Get_E_W().size()   != val->Get_E_W().size()   ||
+		ref->Get_V_ITa().size() != val->Get_V_ITa().size() || ref->Get_V_IT().size()  != val->Get_V_IT().size()  ||
+		ref->Get_V_W().size()   != val->Get_V_W().size())
+		return false;
+
+	if (refBatches.size() != valBatches.size()) return false;
+	for (size_t i = 0; i < refBatches.size(); ++i)
+	{
+		const OpenSubdiv::FarKernelBatch& a = refBatches[i];
+		const OpenSubdiv::FarKernelBatch& b = valBatches[i];
+		if (a.GetKernelType() != b.GetKernelType() || a.GetLevel() != b.GetLevel() || a.GetStart() != b.GetStart() || a.GetEnd() != b.GetEnd() ||
+			a.GetTableOffset() != b.GetTableOffset() || a.GetVertexOffset() != b.GetVertexOffset())
+			return false;
+	}
+
+	return refPatches && valPatches && refPatches->GetNumPatches() == valPatches->GetNumPatches() && refPatches->GetNumPtexFaces() == valPatches->GetNumPtexFaces();
+}
+
+// largest distance of a refined vertex to the closest hbr vertex of the same level, hash grid of the reference positions
+float ComparePositions(const OpenSubdiv::FarSubdivisionTables* tables, const std::vector<float>& ref, const float* val)
+{
+	const float cellSize = 4.0f * SUBD_BENCH_MAX_ERROR;
+	auto cellKey = [&](int x, int y, int z) { return (static_cast<UINT64>(x & 0x1FFFFF) << 42) | (static_cast<UINT64>(y & 0x1FFFFF) << 21) | static_cast<UINT64>(z & 0x1FFFFF); };
+	auto cell = [&](float p) { return static_cast<int>(floorf(p / cellSize)); };
+
+	float maxError = 0.0f;
+	for (int level = 0; level < tables->GetMaxLevel(); ++level)
+	{
+		const int begin = tables->GetFirstVertexOffset(level);
+		const int end = begin + tables->GetNumVertices(level);
+
+		std::unordered_multimap<UINT64, int> grid;
+		grid.reserve(end - begin);
+		for (int i = begin; i < end; ++i)
+			grid.insert(std::make_pair(cellKey(cell(ref[3 * i]), cell(ref[3 * i + 1]), cell(ref[3 * i + 2])), i));
+
+		for (int i = begin; i < end; ++i)
+		{
+			const float* p = &val[3 * i];
+			float best = FLT_MAX;
+			for (int dz = -1; dz <= 1; ++dz)
+			for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				auto range = grid.equal_range(cellKey(cell(p[0]) + dx, cell(p[1]) + dy, cell(p[2]) + dz));
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					const float* q = &ref[3 * it->second];
+					best = std::min(best, std::max(fabsf(p[0] - q[0]), std::max(fabsf(p[1] - q[1]), fabsf(p[2] - q[2]))));
+				}
+			}
+			maxError = std::max(maxError, best);
+		}
+	}
+	return maxError;
+}
+
+TopoBenchResult BuildAndValidate(const SubdTestMesh& mesh, int level, bool comparePositions)
+{
+	TopoBenchResult result;
+
+	// hbr reference, the mesh factory refines the hbr mesh and computes the positions
+	OpenSubdiv::HbrCatmarkSubdivision<ValidationVertex> catmark;
+	double t = GetTimeMS();
+	ValidationHbrMesh* hmesh = CreateHbrMesh(mesh, &catmark);
+	OpenSubdiv::FarMeshFactory<ValidationVertex> factory(hmesh, level);
+	OpenSubdiv::FarMesh<ValidationVertex>* refMesh = factory.Create();
+	result.hbrMS = GetTimeMS() - t;
+	result.hbrBytes = hmesh->GetMemStats() + refMesh->GetSubdivisionTables()->GetMemoryUsed();
+
+	FarTopologyBuilder builder;
+	t = GetTimeMS();
+	OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* farMesh = CreateDirectFarMesh(mesh, level, builder);
+	result.builderMS = GetTimeMS() - t;
+	result.builderBytes = builder.GetPeakBytes();
+
+	result.tablesMatch = farMesh && CompareTables(refMesh->GetSubdivisionTables(), refMesh->GetKernelBatches(), refMesh->GetPatchTables(),
+												  farMesh->GetSubdivisionTables(), farMesh->GetKernelBatches(), farMesh->GetPatchTables());
+	result.numVertices = farMesh ? farMesh->GetNumVertices() : 0;
+	result.maxError = 0.0f;
+
+	if (result.tablesMatch && comparePositions)
+	{
+		const std::vector<int>& remap = factory.GetRemappingTable();
+		std::vector<float> ref(3 * result.numVertices, 0.0f);
+		for (int id = 0; id < hmesh->GetNumVertices(); ++id)
+		{
+			OpenSubdiv::HbrVertex<ValidationVertex>* v = hmesh->GetVertex(id);
+			if (!v || id >= static_cast<int>(remap.size()) || remap[id] < 0 || remap[id] >= result.numVertices) continue;
+			memcpy(&ref[3 * remap[id]], v->GetData().p, 3 * sizeof(float));
+		}
+
+		// the builder keeps the cage vertex order
+		OsdCPUComputeController controller;
+		OsdCPUComputeContext* context = OsdCPUComputeContext::Create(farMesh->GetSubdivisionTables(), NULL);
+		OsdCPUD3D11VertexBuffer* vertexBuffer = OsdCPUD3D11VertexBuffer::Create(3, result.numVertices, NULL);
+		memcpy(vertexBuffer->BindCpuBuffer(), &mesh.positions[0], mesh.positions.size() * sizeof(float));
+		controller.Refine(context, farMesh->GetKernelBatches(), vertexBuffer);
+
+		result.maxError = ComparePositions(farMesh->GetSubdivisionTables(), ref, vertexBuffer->BindCpuBuffer());
+
+		delete vertexBuffer;
+		delete context;
+	}
+
+	delete farMesh;
+	delete refMesh;
+	delete hmesh;
+	return result;
+}
+
+}
+
+HRESULT BatchSimulation::RunTopologyBenchmark()
+{
+	if (m_scenario.topoBenchMaxFaces == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	std::ofstream file((dir + "topo_bench.csv").c_str());
+	file << "mesh,faces,level,vertices,tables_match,max_error,hbr_ms,builder_ms,hbr_mb,builder_mb" << std::endl;
+
+	auto write = [&](const SubdTestMesh& mesh, int level, const TopoBenchResult& result)
+	{
+		file << mesh.name << "," << mesh.faceSizes.size() << "," << level << "," << result.numVertices << "," << (result.tablesMatch ? 1 : 0) << "," 
+			 << result.maxError << "," << result.hbrMS << "," << result.builderMS << "," 
+			 << result.hbrBytes / (1024.0 * 1024.0) << "," << result.builderBytes / (1024.0 * 1024.0) << std::endl;
+	};
+
+	// validation on the catmark test meshes, creases with and without vertex sharpness
+	std::vector<SubdTestMesh> meshes;
+	meshes.push_back(CreateCube("cube", SubdScheme::CATMARK));
+
+	meshes.push_back(CreateCube("creased cube", SubdScheme::CATMARK));
+	const SubdCrease creases[] = { { 4, 5, 2.0f }, { 5, 7, 1.5f }, { 7, 6, 0.75f }, { 6, 4, 3.25f } };
+	meshes.back().creases.assign(creases, creases + ARRAYSIZE(creases));
+
+	meshes.push_back(meshes.back());
+	meshes.back().name = "creased cube corners";
+	meshes.back().cornerVertices.push_back(std::make_pair(0, static_cast<float>(OpenSubdiv::HbrVertex<ValidationVertex>::k_InfinitelySharp)));
+	meshes.back().cornerVertices.push_back(std::make_pair(3, 0.5f));
+
+	meshes.push_back(CreateGrid(SUBD_BENCH_GRID_SIZE));
+
+	bool valid = true;
+	for (const auto& mesh : meshes)
+	{
+		for (int level = 1; level <= SUBD_BENCH_MAX_LEVEL; ++level)
+		{
+			TopoBenchResult result = BuildAndValidate(mesh, level, true);
+			write(mesh, level, result);
+
+			if (!result.tablesMatch || result.maxError > SUBD_BENCH_MAX_ERROR)
+			{
+				std::cerr << "batch: far topology builder " << mesh.name << " level " << level << " differs from hbr, tables " 
+						  << (result.tablesMatch ? "match" : "differ") << ", max error " << result.maxError << std::endl;
+				valid = false;
+			}
+		}
+	}
+
+	// build time and memory of large grids at a fixed level
+	for (UINT numFaces = TOPO_BENCH_MIN_FACES; numFaces <= m_scenario.topoBenchMaxFaces; numFaces *= 10)
+	{
+		const int size = static_cast<int>(sqrtf(static_cast<float>(numFaces)) + 0.5f);
+		const SubdTestMesh grid = CreateGrid(size);
+
+		TopoBenchResult result = BuildAndValidate(grid, TOPO_BENCH_LEVEL, false);
+		write(grid, TOPO_BENCH_LEVEL, result);
+
+		if (!result.tablesMatch)
+		{
+			std::cerr << "batch: far topology builder tables of the " << size << "x" << size << " grid differ from hbr" << std::endl;
+			valid = false;
+		}
+		std::cout << "batch: far topology " << grid.faceSizes.size() << " faces level " << TOPO_BENCH_LEVEL << ", hbr " << result.hbrMS << " ms " 
+				  << result.hbrBytes / (1024 * 1024) << " mb, builder " << result.builderMS << " ms " << result.builderBytes / (1024 * 1024) << " mb" << std::endl;
+	}
+
+	return valid ? S_OK : E_FAIL;
+}
+
+namespace
+{
+
+// unit cube with every side split into n x n quads, closed cage with the 8 valence 3 vertices at the cube corners
+SubdTestMesh CreateSubdividedCube(int n)
+{
+	SubdTestMesh mesh;
+	mesh.name = "subdivided cube";
+	mesh.scheme = SubdScheme::CATMARK;
+
+	// lattice points on the cube surface, shared by the sides
+	std::unordered_map<UINT64, int> lattice;
+	auto vertex = [&](int x, int y, int z)
+	{
+		const UINT64 key = (static_cast<UINT64>(x) << 42) | (static_cast<UINT64>(y) << 21) | static_cast<UINT64>(z);
+		auto it = lattice.find(key);
+		if (it != lattice.end()) return it->second;
+
+		const int index = mesh.GetNumVertices();
+		mesh.AddVertex(static_cast<float>(x) / n - 0.5f, static_cast<float>(y) / n - 0.5f, static_cast<float>(z) / n - 0.5f);
+		lattice[key] = index;
+		return index;
+	};
+
+	// origin, u and v axis per side, u x v is the outward normal
+	const int sides[6][9] = 
+	{
+		{ 0, 0, 0,	0, 1, 0,	1, 0, 0 },
+		{ 0, 0, n,	1, 0, 0,	0, 1, 0 },
+		{ 0, 0, 0,	1, 0, 0,	0, 0, 1 },
+		{ 0, n, 0,	0, 0, 1,	1, 0, 0 },
+		{ 0, 0, 0,	0, 0, 1,	0, 1, 0 },
+		{ n, 0, 0,	0, 1, 0,	0, 0, 1 }
+	};
+
+	for (const auto& side : sides)
+	{
+		auto point = [&](int a, int b) { return vertex(side[0] + a * side[3] + b * side[6], side[1] + a * side[4] + b * side[7], side[2] + a * side[5] + b * side[8]); };
+		for (int b = 0; b < n; ++b)
+			for (int a = 0; a < n; ++a)
+				mesh.AddQuad(point(a, b), point(a + 1, b), point(a + 1, b + 1), point(a, b + 1));
+	}
+	return mesh;
+}
+
+// loader before the flat adjacency: ptex neighbors in GetPrev order, rings of interior extraordinary vertices
+void GetHbrAdjacency(ValidationHbrMesh* hmesh, std::vector<SPtexNeighborData>& ptexNeighborData, std::vector<std::vector<SExtraordinaryData>>& rings)
+{
+	ptexNeighborData.resize(hmesh->GetNumCoarseFaces());
+	for (int i = 0; i < hmesh->GetNumCoarseFaces(); ++i)
+	{
+		OpenSubdiv::HbrFace<ValidationVertex>* face = hmesh->GetFace(i);
+		OpenSubdiv::HbrHalfedge<ValidationVertex>* edge = face->GetFirstEdge();
+		for (int k = 0; k < 4; ++k, edge = edge->GetPrev())
+		{
+			ptexNeighborData[i].ptexIDNeighbor[k] = -1;
+			ptexNeighborData[i].neighEdgeID[k] = -1;
+			if (edge->IsBoundary()) continue;
+
+			OpenSubdiv::HbrFace<ValidationVertex>* neighFace = edge->GetOpposite()->GetFace();
+			OpenSubdiv::HbrHalfedge<ValidationVertex>* neighEdge = neighFace->GetFirstEdge();
+			int neighEdgeID = 0;
+			for (; neighEdgeID < 4; ++neighEdgeID, neighEdge = neighEdge->GetPrev())
+				if (!neighEdge->IsBoundary() && neighEdge->GetOpposite()->GetFace()->GetPtexIndex() == face->GetPtexIndex())
+					break;
+
+			ptexNeighborData[i].ptexIDNeighbor[k] = neighFace->GetPtexIndex();
+			ptexNeighborData[i].neighEdgeID[k] = neighEdgeID;
+		}
+	}
+
+	rings.clear();
+	for (int i = 0; i < hmesh->GetNumVertices(); ++i)
+	{
+		OpenSubdiv::HbrVertex<ValidationVertex>* v = hmesh->GetVertex(i);
+		if (!v->IsExtraordinary() || v->OnBoundary()) continue;
+
+		rings.push_back(std::vector<SExtraordinaryData>());
+		OpenSubdiv::HbrHalfedge<ValidationVertex>* start = v->GetIncidentEdge();
+		OpenSubdiv::HbrHalfedge<ValidationVertex>* edge = start;
+		do
+		{
+			OpenSubdiv::HbrFace<ValidationVertex>* face = edge->GetLeftFace();
+			for (int j = 0; j < face->GetNumVertices(); ++j)
+			{
+				if (face->GetVertexID(j) == v->GetID())
+				{
+					SExtraordinaryData data = { static_cast<UINT>(face->GetPtexIndex()), static_cast<UINT>(j) };
+					rings.back().push_back(data);
+				}
+			}
+			edge = edge->GetOpposite()->GetNext();
+		} while (edge != start);
+	}
+}
+
+inline bool operator<(const SExtraordinaryData& a, const SExtraordinaryData& b)
+{
+	return a.ptexFaceID < b.ptexFaceID || (a.ptexFaceID == b.ptexFaceID && a.vertexInFace < b.vertexInFace);
+}
+
+// identical ptex neighbors, interior extraordinary rings as sets (the walk may start at another face),
+// boundary rings have one entry per face and every entry names a face corner at the vertex
+bool ValidateAdjacency(const SubdTestMesh& mesh, const QuadAdjacency& adjacency)
+{
+	OpenSubdiv::HbrCatmarkSubdivision<ValidationVertex> catmark;
+	ValidationHbrMesh* hmesh = CreateHbrMesh(mesh, &catmark);
+
+	std::vector<SPtexNeighborData> refNeighbors;
+	std::vector<std::vector<SExtraordinaryData>> refRings;
+	GetHbrAdjacency(hmesh, refNeighbors, refRings);
+
+	std::vector<SPtexNeighborData> neighbors;
+	std::vector<SExtraordinaryInfo> info;
+	std::vector<SExtraordinaryData> data;
+	adjacency.GetPtexNeighborData(neighbors);
+	adjacency.GetExtraordinaryInfo(info, data);
+
+	bool valid = neighbors.size() == refNeighbors.size() && memcmp(&neighbors[0], &refNeighbors[0], neighbors.size() * sizeof(SPtexNeighborData)) == 0;
+
+	UINT numInterior = 0;
+	for (const auto& vertexInfo : info)
+	{
+		const SExtraordinaryData* ring = &data[vertexInfo.startIndex];
+		const int vertex = mesh.faceIndices[4 * ring[0].ptexFaceID + ring[0].vertexInFace];
+
+		for (UINT j = 0; j < vertexInfo.valence; ++j)
+			valid &= mesh.faceIndices[4 * ring[j].ptexFaceID + ring[j].vertexInFace] == vertex;
+		if (hmesh->GetVertex(vertex)->OnBoundary()) continue;
+
+		if (numInterior >= refRings.size()) 
+			return false;
+		std::vector<SExtraordinaryData> sorted(ring, ring + vertexInfo.valence);
+		std::vector<SExtraordinaryData> refSorted(refRings[numInterior]);
+		std::sort(sorted.begin(), sorted.end());
+		std::sort(refSorted.begin(), refSorted.end());
+		valid &= sorted.size() == refSorted.size() && memcmp(&sorted[0], &refSorted[0], sorted.size() * sizeof(SExtraordinaryData)) == 0;
+		++numInterior;
+	}
+	valid &= numInterior == refRings.size();
+
+	delete hmesh;
+	return valid;
+}
+
+}
+
+HRESULT BatchSimulation::RunAdjacencyBenchmark()
+{
+	if (m_scenario.adjacencyBenchFaces == 0) return S_OK;
+
+	const std::string dir = m_scenario.outputDir + "/";
+
+	bool valid = true;
+
+	// against the hbr loader on the test meshes
+	std::vector<SubdTestMesh> meshes;
+	meshes.push_back(CreateCube("cube", SubdScheme::CATMARK));
+	meshes.push_back(CreateGrid(SUBD_BENCH_GRID_SIZE));
+	meshes.push_back(CreateSubdividedCube(4));
+
+	for (const auto& mesh : meshes)
+	{
+		QuadAdjacency adjacency;
+		if (FAILED(adjacency.Create(GetQuads(mesh), mesh.GetNumVertices())) || !ValidateAdjacency(mesh, adjacency))
+		{
+			std::cerr << "batch: quad adjacency of " << mesh.name << " differs from hbr" << std::endl;
+			valid = false;
+		}
+	}
+
+	// non manifold cages are rejected
+	{
+		SubdTestMesh fin = CreateCube("cube with fin", SubdScheme::CATMARK);
+		fin.AddVertex(0.0f, 0.0f, 1.0f);
+		fin.AddVertex(0.0f, 0.5f, 1.0f);
+		fin.AddQuad(4, 5, 9, 8);
+		QuadAdjacency adjacency;
+		if (SUCCEEDED(adjacency.Create(GetQuads(fin), fin.GetNumVertices())))
+		{
+			std::cerr << "batch: quad adjacency accepted a non manifold edge" << std::endl;
+			valid = false;
+		}
+	}
+
+	// build time on a closed cage with about adjacencyBenchFaces faces, hbr mesh and loop of the previous loader for reference
+	const int n = std::max(1, static_cast<int>(sqrtf(m_scenario.adjacencyBenchFaces / 6.0f) + 0.5f));
+	const SubdTestMesh cage = CreateSubdividedCube(n);
+	const std::vector<DirectX::XMUINT4> quads = GetQuads(cage);
+
+	std::vector<SPtexNeighborData> neighbors;
+	std::vector<SExtraordinaryInfo> info;
+	std::vector<SExtraordinaryData> data;
+
+	QuadAdjacency adjacency;
+	double t = GetTimeMS();
+	const HRESULT hr = adjacency.Create(quads, cage.GetNumVertices());
+	const double createMS = GetTimeMS() - t;
+
+	t = GetTimeMS();
+	adjacency.GetPtexNeighborData(neighbors);
+	adjacency.GetExtraordinaryInfo(info, data);
+	const double extractMS = GetTimeMS() - t;
+	valid &= SUCCEEDED(hr);
+
+	OpenSubdiv::HbrCatmarkSubdivision<ValidationVertex> catmark;
+	t = GetTimeMS();
+	ValidationHbrMesh* hmesh = CreateHbrMesh(cage, &catmark);
+	const double hbrMeshMS = GetTimeMS() - t;
+
+	std::vector<SPtexNeighborData> refNeighbors;
+	std::vector<std::vector<SExtraordinaryData>> refRings;
+	t = GetTimeMS();
+	GetHbrAdjacency(hmesh, refNeighbors, refRings);
+	const double hbrExtractMS = GetTimeMS() - t;
+	delete hmesh;
+
+	valid &= neighbors.size() == refNeighbors.size() && memcmp(&neighbors[0], &refNeighbors[0], neighbors.size() * sizeof(SPtexNeighborData)) == 0;
+
+	std::ofstream file((dir + "adjacency_bench.csv").c_str());
+	file << "faces,vertices,extraordinary,threads,create_ms,extract_ms,hbr_mesh_ms,hbr_extract_ms" << std::endl;
+	file << quads.size() << "," << cage.GetNumVertices() << "," << info.size() << "," << g_workStealingPool.GetNumThreads() << ","
+		 << createMS << "," << extractMS << "," << hbrMeshMS << "," << hbrExtractMS << std::endl;
+
+	std::cout << "batch: quad adjacency of " << quads.size() << " faces " << createMS + extractMS << " ms, hbr " 
+			  << hbrMeshMS << " ms mesh + " << hbrExtractMS << " ms loop" << std::endl;
+
+	return valid ? S_OK : E_FAIL;
+}
@@ -0,0 +1,250 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "ComputeBackendCPU.h"
+#include "App.h"
+
+using namespace DirectX;
+
+// cpu ports of the kernels in shader/IntersectOSDCS.hlsl
+
+#define INTERSECT_TRUE  1		// see shader/Intersect.h.hlsl
+#define INTERSECT_FALSE 0
+#define INTERSECT_FLT_MAX 3.999e+10F
+
+// b-spline to bezier basis (Q in IntersectOSDCS.hlsl)
+static const float BSPLINE_TO_BEZIER[4][4] = {
+	{ 0.1666666666667f, 0.6666666666667f, 0.1666666666667f, 0.0f },
+	{ 0.0f, 0.6666666666667f, 0.3333333333333f, 0.0f },
+	{ 0.0f, 0.3333333333333f, 0.6666666666667f, 0.0f },
+	{ 0.0f, 0.1666666666667f, 0.6666666666667f, 0.1666666666667f }
+};
+
+// append buffer elements, see IntersectGPU::Create
+struct PatchDataRegular { UINT patchID; UINT firstIndex; };
+struct PatchDataGregory { UINT patchID; UINT firstIndex; UINT quadOffset; };
+
+// hlsl defines of the IntersectRegularCS/IntersectGregoryCS variants
+struct IntersectVariant
+{
+	IntersectVariant(const CPUKernelContext& ctx)
+	{
+		batchSize = ctx.GetDefine("BATCH_SIZE", 4);
+		temporal = ctx.IsDefined("TEMPORAL_CANDIDATES");
+		dynamicMaxDisp = ctx.IsDefined("WITH_DYNAMIC_MAX_DISP");
+	}
+
+	UINT batchSize;
+	bool temporal;
+	bool dynamicMaxDisp;
+};
+
+// mul of the float4x4 g_matModelToOBB, evaluated in the order of the hlsl version
+static inline XMFLOAT3 TransformToOBB(const XMFLOAT4X4& m, const XMFLOAT3& p)
+{
+	return XMFLOAT3(p.x * m._11 + (p.y * m._21 + (p.z * m._31 + m._41)),
+					p.x * m._12 + (p.y * m._22 + (p.z * m._32 + m._42)),
+					p.x * m._13 + (p.y * m._23 + (p.z * m._33 + m._43)));
+}
+
+static inline XMFLOAT3 LoadVertex(const float* vertices, UINT index, UINT numComponents)
+{
+	const float* v = vertices + index * numComponents;
+	return XMFLOAT3(v[0], v[1], v[2]);
+}
+
+// [numthreads(512, 1, 1)], u0 g_ptexFaceVisibleUAV
+static void IntersectClearCS(const CPUKernelContext& ctx, UINT groupX, UINT groupY, UINT groupZ)
+{
+	UINT* visibility = ctx.UAV<UINT>(0);
+	const UINT numElements = ctx.NumElementsUAV(0);
+
+	const UINT begin = groupX * 512;
+	const UINT end = std::min(begin + 512, numElements);	// out of bounds uav writes are discarded on the gpu
+	for (UINT i = begin; i < end; ++i)
+		visibility[i] = INTERSECT_FALSE;
+}
+REGISTER_CPU_KERNEL(IntersectClearCS, IntersectClearCS);
+
+// [numthreads(512, 1, 1)], b CB_LOC::OSD_DEFORMATION_CONFIG, t6 g_temporalCandidates, u0 g_ptexFaceVisibleUAV
+static void IntersectClearCandidatesCS(const CPUKernelContext& ctx, UINT groupX, UINT groupY, UINT groupZ)
+{
+	const CB_OSDConfig& config = ctx.Constants<CB_OSDConfig>(CB_LOC::OSD_DEFORMATION_CONFIG);
+	const UINT* candidates = ctx.SRV<UINT>(6);
+	UINT* visibility = ctx.UAV<UINT>(0);
+	const UINT numElements = ctx.NumElementsUAV(0);
+
+	const UINT begin = groupX * 512;
+	const UINT end = std::min(begin + 512, config.NumCandidates);
+	for (UINT i = begin; i < end; ++i)
+	{
+		UINT face = candidates[config.CandidateOffset + i];
+		if (face < numElements)
+			visibility[face] = INTERSECT_FALSE;
+	}
+}
+REGISTER_CPU_KERNEL(IntersectClearCandidatesCS, IntersectClearCandidatesCS);
+
+// [numthreads(2, 4, 4)], 2 patches per group, one thread per control point
+// b CB_LOC::OSD_DEFORMATION_CONFIG, b CB_LOC::INTERSECT, t0 vertices, t1 patch indices, t2 patch params, t5 max displacement,
+// t6 g_temporalCandidates, u0 g_ptexFaceVisibleUAV, u1 g_ptexFaceVisibleAllUAV, u2.. g_patchDataRegularAppend0..
+// SET_ALL_ACTIVE is ignored like in the hlsl version
+static void IntersectRegularCS(const CPUKernelContext& ctx, UINT groupX, UINT groupY, UINT groupZ)
+{
+	const CB_OSDConfig& config = ctx.Constants<CB_OSDConfig>(CB_LOC::OSD_DEFORMATION_CONFIG);
+	const CB_IntersectOBBBatch& obbs = ctx.Constants<CB_IntersectOBBBatch>(CB_LOC::INTERSECT);
+	const IntersectVariant variant(ctx);
+
+	const float* vertices = ctx.SRV<float>(0);
+	const UINT* indices = ctx.SRV<UINT>(1);
+	const UINT* patchParams = ctx.SRV<UINT>(2);		// uint2 per patch
+	const float* maxDisplacement = ctx.SRV<float>(5);
+	UINT* visibility = ctx.UAV<UINT>(0);
+	UINT* visibilityAll = ctx.UAV<UINT>(1);
+
+	for (UINT blockPatch = 0; blockPatch < 2; ++blockPatch)
+	{
+		UINT localPatchID = groupX * 2 + blockPatch;
+		if (localPatchID >= config.NumPatches) return;
+
+		if (variant.temporal)
+			localPatchID = ctx.SRV<UINT>(6)[config.CandidateOffset + localPatchID];
+
+		const UINT ptexTileID = patchParams[2 * (localPatchID + config.PrimitiveIdBase)];
+		const UINT firstIndex = config.IndexStart + config.NumIndicesPerPatch * localPatchID;
+
+		XMFLOAT3 controlPoints[16];
+		for (UINT k = 0; k < 16; ++k)
+			controlPoints[k] = LoadVertex(vertices, indices[firstIndex + k], config.NumVertexComponents);
+
+		// transform to bezier, thread (i, j) of the hlsl version
+		XMFLOAT3 bezier[16];
+		for (UINT i = 0; i < 4; ++i)
+		{
+			for (UINT j = 0; j < 4; ++j)
+			{
+				XMFLOAT3 cpBez(0.0f, 0.0f, 0.0f);
+				for (UINT l = 0; l < 4; ++l)
+				{
+					XMFLOAT3 H(0.0f, 0.0f, 0.0f);
+					for (UINT k = 0; k < 4; ++k)
+					{
+						const XMFLOAT3& cp = controlPoints[l + 4 * k];
+						H.x += BSPLINE_TO_BEZIER[i][k] * cp.x;
+						H.y += BSPLINE_TO_BEZIER[i][k] * cp.y;
+						H.z += BSPLINE_TO_BEZIER[i][k] * cp.z;
+					}
+					cpBez.x += BSPLINE_TO_BEZIER[j][l] * H.x;
+					cpBez.y += BSPLINE_TO_BEZIER[j][l] * H.y;
+					cpBez.z += BSPLINE_TO_BEZIER[j][l] * H.z;
+				}
+				bezier[j + i * 4] = cpBez;
+			}
+		}
+
+		for (UINT batchIdx = 0; batchIdx < variant.batchSize; ++batchIdx)
+		{
+			const XMFLOAT4X4& modelToOBB = reinterpret_cast<const XMFLOAT4X4&>(obbs.modelToWorld[batchIdx]);
+
+			XMFLOAT3 bbMax(-INTERSECT_FLT_MAX, -INTERSECT_FLT_MAX, -INTERSECT_FLT_MAX);
+			XMFLOAT3 bbMin( INTERSECT_FLT_MAX,  INTERSECT_FLT_MAX,  INTERSECT_FLT_MAX);
+			for (UINT k = 0; k < 16; ++k)
+			{
+				XMFLOAT3 cp = TransformToOBB(modelToOBB, bezier[k]);
+				bbMax = XMFLOAT3(std::max(cp.x, bbMax.x), std::max(cp.y, bbMax.y), std::max(cp.z, bbMax.z));
+				bbMin = XMFLOAT3(std::min(cp.x, bbMin.x), std::min(cp.y, bbMin.y), std::min(cp.z, bbMin.z));
+			}
+
+			const float extent = variant.dynamicMaxDisp ? obbs.g_displacementScale * maxDisplacement[localPatchID + config.PrimitiveIdBase]
+														: 0.1f * obbs.g_displacementScale;
+			bbMax = XMFLOAT3(bbMax.x + extent, bbMax.y + extent, bbMax.z + extent);
+			bbMin = XMFLOAT3(bbMin.x - extent, bbMin.y - extent, bbMin.z - extent);
+
+			if (	bbMin.x <= 1.0f && bbMin.y <= 1.0f && bbMin.z <= 1.0f
+				&&	bbMax.x >= 0.0f && bbMax.y >= 0.0f && bbMax.z >= 0.0f)
+			{
+				visibility[ptexTileID] = INTERSECT_TRUE;
+				visibilityAll[ptexTileID] = INTERSECT_TRUE;
+
+				PatchDataRegular patchData = { localPatchID + config.PrimitiveIdBase, firstIndex };
+				ctx.Append(2 + batchIdx, patchData);
+			}
+		}
+	}
+}
+REGISTER_CPU_KERNEL(IntersectRegularCS, IntersectRegularCS);
+
+// [numthreads(2, 2, 2)], 2 patches per group, one thread per corner. bindings as IntersectRegularCS, u2.. g_patchDataGregoryAppend0..
+// the hlsl version evaluates the gregory patch at the corner uv of each thread, at the corners the bernstein weights are
+// exactly 0 and 1 and the evaluation returns the corner control vertex, so the port bounds the 4 corner control vertices
+static void IntersectGregoryCS(const CPUKernelContext& ctx, UINT groupX, UINT groupY, UINT groupZ)
+{
+	const CB_OSDConfig& config = ctx.Constants<CB_OSDConfig>(CB_LOC::OSD_DEFORMATION_CONFIG);
+	const CB_IntersectOBBBatch& obbs = ctx.Constants<CB_IntersectOBBBatch>(CB_LOC::INTERSECT);
+	const IntersectVariant variant(ctx);
+
+	const float* vertices = ctx.SRV<float>(0);
+	const UINT* indices = ctx.SRV<UINT>(1);
+	const UINT* patchParams = ctx.SRV<UINT>(2);
+	UINT* visibility = ctx.UAV<UINT>(0);
+	UINT* visibilityAll = ctx.UAV<UINT>(1);
+
+	for (UINT blockPatch = 0; blockPatch < 2; ++blockPatch)
+	{
+		UINT localPatchID = groupX * 2 + blockPatch;
+		if (localPatchID >= config.NumPatches) return;
+
+		if (variant.temporal)
+			localPatchID = ctx.SRV<UINT>(6)[config.CandidateOffset + localPatchID];
+
+		const UINT ptexTileID = patchParams[2 * (localPatchID + config.PrimitiveIdBase)];
+		const UINT firstIndex = config.IndexStart + config.NumIndicesPerPatch * localPatchID;
+
+		XMFLOAT3 corners[4];
+		for (UINT k = 0; k < 4; ++k)
+			corners[k] = LoadVertex(vertices, indices[firstIndex + k], config.NumVertexComponents);
+
+		for (UINT batchIdx = 0; batchIdx < variant.batchSize; ++batchIdx)
+		{
+			const XMFLOAT4X4& modelToOBB = reinterpret_cast<const XMFLOAT4X4&>(obbs.modelToWorld[batchIdx]);
+
+			XMFLOAT3 bbMax(-1000.0f, -1000.0f, -1000.0f);
+			XMFLOAT3 bbMin( 1000.0f,  1000.0f,  1000.0f);
+			for (UINT k = 0; k < 4; ++k)
+			{
+				XMFLOAT3 cp = TransformToOBB(modelToOBB, corners[k]);
+				bbMax = XMFLOAT3(std::max(cp.x, bbMax.x), std::max(cp.y, bbMax.y), std::max(cp.z, bbMax.z));
+				bbMin = XMFLOAT3(std::min(cp.x, bbMin.x), std::min(cp.y, bbMin.y), std::min(cp.z, bbMin.z));
+			}
+
+			// the hlsl version moves the box by the displacement scale (maxDisplacement = -g_displacementScaler)
+			const float shift = obbs.g_displacementScale;
+			bbMin = XMFLOAT3(bbMin.x + shift, bbMin.y + shift, bbMin.z + shift);
+			bbMax = XMFLOAT3(bbMax.x + shift, bbMax.y + shift, bbMax.z + shift);
+
+			if ((1.0f < bbMin.x || 0.0f > bbMax.x) || (1.0f < bbMin.y || 0.0f > bbMax.y) || (1.0f < bbMin.z || 0.0f > bbMax.z))
+				continue;
+
+			visibility[ptexTileID] = INTERSECT_TRUE;
+			visibilityAll[ptexTileID] = INTERSECT_TRUE;
+
+			PatchDataGregory patchData = { localPatchID + config.PrimitiveIdBase, firstIndex, 4 * localPatchID + config.GregoryQuadOffsetBase };
+			ctx.Append(2 + batchIdx, patchData);
+		}
+	}
+}
+REGISTER_CPU_KERNEL(IntersectGregoryCS, IntersectGregoryCS);
@@ -0,0 +1,152 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+#include <string>
+
+// backend independent interface for the compute stages (buffers, textures, constants and kernel dispatch).
+// slots follow the d3d11 register layout (b#, t#, u#) so the hlsl kernels and their cpu ports share one binding scheme.
+
+enum class ComputeBackendType
+{
+	D3D11 = 0,
+	CPU = 1
+};
+
+enum ComputeResourceFlags
+{
+	COMPUTE_SRV				= 1 << 0,
+	COMPUTE_UAV				= 1 << 1,
+	COMPUTE_STRUCTURED		= 1 << 2,	// structured buffer, stride = element size
+	COMPUTE_APPEND			= 1 << 3,	// uav has an append/consume counter
+	COMPUTE_INDIRECT_ARGS	= 1 << 4,	// usable as DispatchIndirect argument buffer
+	COMPUTE_CONSTANT		= 1 << 5,	// constant buffer, updated with UpdateConstants
+	COMPUTE_DYNAMIC			= 1 << 6,	// cpu writes (Upload) every frame
+};
+
+struct ComputeBufferDesc
+{
+	ComputeBufferDesc() : numElements(0), stride(0), format(DXGI_FORMAT_UNKNOWN), flags(0) {}
+	ComputeBufferDesc(UINT _numElements, UINT _stride, DXGI_FORMAT _format, UINT _flags)
+		: numElements(_numElements), stride(_stride), format(_format), flags(_flags) {}
+
+	UINT		numElements;
+	UINT		stride;			// bytes per element
+	DXGI_FORMAT format;			// typed views, DXGI_FORMAT_UNKNOWN for structured/constant buffers
+	UINT		flags;
+
+	UINT		GetByteWidth() const { return numElements * stride; }
+};
+
+struct ComputeTextureDesc
+{
+	ComputeTextureDesc() : width(0), height(0), arraySize(1), format(DXGI_FORMAT_UNKNOWN), texelSize(0), flags(0) {}
+
+	UINT		width;
+	UINT		height;
+	UINT		arraySize;
+	DXGI_FORMAT format;
+	UINT		texelSize;		// bytes per texel
+	UINT		flags;
+};
+
+class ComputeResource
+{
+public:
+	enum class Type { BUFFER, TEXTURE };
+
+	virtual ~ComputeResource() {}
+
+	Type						GetType()			const { return m_type; }
+	const ComputeBufferDesc&	GetBufferDesc()		const { return m_bufferDesc; }
+	const ComputeTextureDesc&	GetTextureDesc()	const { return m_textureDesc; }
+
+protected:
+	ComputeResource(const ComputeBufferDesc& desc)	: m_type(Type::BUFFER), m_bufferDesc(desc) {}
+	ComputeResource(const ComputeTextureDesc& desc) : m_type(Type::TEXTURE), m_textureDesc(desc) {}
+
+	Type				m_type;
+	ComputeBufferDesc	m_bufferDesc;
+	ComputeTextureDesc	m_textureDesc;
+};
+
+class ComputeKernel
+{
+public:
+	virtual ~ComputeKernel() {}
+	const std::string& GetName() const { return m_name; }
+
+protected:
+	ComputeKernel(const std::string& name) : m_name(name) {}
+	std::string m_name;
+};
+
+struct ComputeKernelDesc
+{
+	ComputeKernelDesc(const wchar_t* _file, const char* _entry) : file(_file), entry(_entry) {}
+
+	void AddDefine(const std::string& name, const std::string& value = "1")	{ defines.push_back(std::make_pair(name, value)); }
+
+	const wchar_t*										file;		// hlsl source, d3d11 only
+	const char*											entry;		// hlsl entry point, also the name of the cpu kernel
+	std::vector<std::pair<std::string, std::string>>	defines;
+};
+
+class ComputeBackend
+{
+public:
+	static const UINT NUM_CB_SLOTS	= 14;
+	static const UINT NUM_SRV_SLOTS = 16;
+	static const UINT NUM_UAV_SLOTS = 8;
+	static const UINT KEEP_COUNTER	= (UINT)-1;
+
+	virtual ~ComputeBackend() {}
+
+	virtual ComputeBackendType GetType() const = 0;
+
+	// resources
+	virtual HRESULT CreateBuffer (const ComputeBufferDesc& desc,  const void* initData, ComputeResource*& resource) = 0;
+	virtual HRESULT CreateTexture(const ComputeTextureDesc& desc, const void* initData, ComputeResource*& resource) = 0;
+	virtual void	DestroyResource(ComputeResource*& resource) = 0;
+
+	virtual HRESULT CreateKernel(const ComputeKernelDesc& desc, ComputeKernel*& kernel) = 0;
+	virtual void	DestroyKernel(ComputeKernel*& kernel) = 0;
+
+	// data transfer
+	virtual HRESULT UpdateConstants(ComputeResource* cb, const void* data, UINT size) = 0;
+	virtual HRESULT Upload  (ComputeResource* buffer, const void* data, UINT size, UINT offset = 0) = 0;
+	virtual HRESULT Readback(ComputeResource* resource, void* data, UINT size) = 0;	// blocking
+	virtual void	CopyResource(ComputeResource* dst, ComputeResource* src) = 0;
+	virtual void	CopyStructureCount(ComputeResource* dst, UINT dstOffset, ComputeResource* appendSrc) = 0;
+	virtual void	ClearUAVUint(ComputeResource* resource, const UINT values[4]) = 0;
+
+	// binding
+	virtual void	SetConstantBuffer(UINT slot, ComputeResource* cb) = 0;
+	virtual void	SetSRV(UINT slot, ComputeResource* resource) = 0;
+	virtual void	SetUAV(UINT slot, ComputeResource* resource, UINT initialCount = KEEP_COUNTER) = 0;
+	virtual void	SetKernel(ComputeKernel* kernel) = 0;
+	virtual void	UnbindAll() = 0;
+
+	// execution
+	virtual void	Dispatch(UINT groupsX, UINT groupsY, UINT groupsZ) = 0;
+	virtual void	DispatchIndirect(ComputeResource* args, UINT byteOffset) = 0;
+	virtual void	Flush() = 0;	// waits until all submitted work is done
+};
+
+// active backend of the deformation pipeline, set up in OnD3D11CreateDevice or by the headless runner
+extern ComputeBackend* g_computeBackend;
@@ -0,0 +1,206 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "ComputeBackendCPU.h"
+#include "utils/WorkStealingPool.h"
+
+ComputeBackendCPU g_computeBackendCPU;
+
+// thread groups per job, most kernels run 64-512 threads per group
+static const UINT CPU_DISPATCH_GRAIN = 4;
+
+CPUKernelRegistry& CPUKernelRegistry::Get()
+{
+	// constructed on first use, the registrars run during static initialization of other translation units
+	static CPUKernelRegistry registry;
+	return registry;
+}
+
+ComputeBackendCPU::ComputeBackendCPU()
+{
+	m_kernel = NULL;
+	ZeroMemory(&m_bindings, sizeof(m_bindings));
+}
+
+ComputeBackendCPU::~ComputeBackendCPU()
+{
+	Destroy();
+}
+
+HRESULT ComputeBackendCPU::Create()
+{
+	UnbindAll();
+	m_kernel = NULL;
+	return S_OK;
+}
+
+void ComputeBackendCPU::Destroy()
+{
+	UnbindAll();
+	m_kernel = NULL;
+}
+
+HRESULT ComputeBackendCPU::CreateBuffer(const ComputeBufferDesc& desc, const void* initData, ComputeResource*& resource)
+{
+	ComputeResourceCPU* result = new ComputeResourceCPU(desc, desc.GetByteWidth());
+	if (initData)
+		memcpy(result->m_data, initData, desc.GetByteWidth());
+
+	resource = result;
+	return S_OK;
+}
+
+HRESULT ComputeBackendCPU::CreateTexture(const ComputeTextureDesc& desc, const void* initData, ComputeResource*& resource)
+{
+	const UINT byteWidth = desc.width * desc.height * desc.arraySize * desc.texelSize;
+	ComputeResourceCPU* result = new ComputeResourceCPU(desc, byteWidth);
+	if (initData)
+		memcpy(result->m_data, initData, byteWidth);
+
+	resource = result;
+	return S_OK;
+}
+
+void ComputeBackendCPU::DestroyResource(ComputeResource*& resource)
+{
+	SAFE_DELETE(resource);
+}
+
+HRESULT ComputeBackendCPU::CreateKernel(const ComputeKernelDesc& desc, ComputeKernel*& kernel)
+{
+	kernel = NULL;
+	CPUKernelFunc func = CPUKernelRegistry::Get().Find(desc.entry);
+	if (!func)
+	{
+		std::cerr << "ComputeBackendCPU: no cpu port of kernel " << desc.entry << std::endl;
+		return E_NOTIMPL;
+	}
+
+	kernel = new ComputeKernelCPU(desc, func);
+	return S_OK;
+}
+
+void ComputeBackendCPU::DestroyKernel(ComputeKernel*& kernel)
+{
+	SAFE_DELETE(kernel);
+}
+
+HRESULT ComputeBackendCPU::UpdateConstants(ComputeResource* cb, const void* data, UINT size)
+{
+	ComputeResourceCPU* res = static_cast<ComputeResourceCPU*>(cb);
+	if (size > res->m_byteWidth) return E_INVALIDARG;
+	memcpy(res->m_data, data, size);
+	return S_OK;
+}
+
+HRESULT ComputeBackendCPU::Upload(ComputeResource* buffer, const void* data, UINT size, UINT offset)
+{
+	ComputeResourceCPU* res = static_cast<ComputeResourceCPU*>(buffer);
+	if (offset + size > res->m_byteWidth) return E_INVALIDARG;
+	memcpy(res->m_data + offset, data, size);
+	return S_OK;
+}
+
+HRESULT ComputeBackendCPU::Readback(ComputeResource* resource, void* data, UINT size)
+{
+	ComputeResourceCPU* res = static_cast<ComputeResourceCPU*>(resource);
+	memcpy(data, res->m_data, std::min(size, res->m_byteWidth));
+	return S_OK;
+}
+
+void ComputeBackendCPU::CopyResource(ComputeResource* dst, ComputeResource* src)
+{
+	ComputeResourceCPU* d = static_cast<ComputeResourceCPU*>(dst);
+	ComputeResourceCPU* s = static_cast<ComputeResourceCPU*>(src);
+	assert(d->m_byteWidth == s->m_byteWidth);
+	memcpy(d->m_data, s->m_data, std::min(d->m_byteWidth, s->m_byteWidth));
+}
+
+void ComputeBackendCPU::CopyStructureCount(ComputeResource* dst, UINT dstOffset, ComputeResource* appendSrc)
+{
+	ComputeResourceCPU* src = static_cast<ComputeResourceCPU*>(appendSrc);
+	// appends beyond the capacity are dropped, clamp like the gpu does
+	UINT count = std::min<UINT>(src->m_counter, src->GetBufferDesc().numElements);
+	Upload(dst, &count, sizeof(UINT), dstOffset);
+}
+
+void ComputeBackendCPU::ClearUAVUint(ComputeResource* resource, const UINT values[4])
+{
+	ComputeResourceCPU* res = static_cast<ComputeResourceCPU*>(resource);
+	UINT* data = reinterpret_cast<UINT*>(res->m_data);
+	const UINT numUints = res->m_byteWidth / sizeof(UINT);
+	for (UINT i = 0; i < numUints; ++i)
+		data[i] = values[0];
+}
+
+void ComputeBackendCPU::SetConstantBuffer(UINT slot, ComputeResource* cb)
+{
+	assert(slot < NUM_CB_SLOTS);
+	m_bindings.cb[slot] = static_cast<ComputeResourceCPU*>(cb);
+}
+
+void ComputeBackendCPU::SetSRV(UINT slot, ComputeResource* resource)
+{
+	assert(slot < NUM_SRV_SLOTS);
+	m_bindings.srv[slot] = static_cast<ComputeResourceCPU*>(resource);
+}
+
+void ComputeBackendCPU::SetUAV(UINT slot, ComputeResource* resource, UINT initialCount)
+{
+	assert(slot < NUM_UAV_SLOTS);
+	ComputeResourceCPU* res = static_cast<ComputeResourceCPU*>(resource);
+	m_bindings.uav[slot] = res;
+	if (res && initialCount != KEEP_COUNTER)
+		res->m_counter = initialCount;
+}
+
+void ComputeBackendCPU::SetKernel(ComputeKernel* kernel)
+{
+	m_kernel = static_cast<ComputeKernelCPU*>(kernel);
+}
+
+void ComputeBackendCPU::UnbindAll()
+{
+	ZeroMemory(m_bindings.srv, sizeof(m_bindings.srv));
+	ZeroMemory(m_bindings.uav, sizeof(m_bindings.uav));
+}
+
+void ComputeBackendCPU::Dispatch(UINT groupsX, UINT groupsY, UINT groupsZ)
+{
+	assert(m_kernel);
+	const UINT numGroups = groupsX * groupsY * groupsZ;
+	if (numGroups == 0) return;
+
+	m_bindings.numGroups[0] = groupsX;
+	m_bindings.numGroups[1] = groupsY;
+	m_bindings.numGroups[2] = groupsZ;
+	m_bindings.defines = &m_kernel->m_defines;
+
+	const CPUKernelContext& ctx = m_bindings;
+	CPUKernelFunc func = m_kernel->m_func;
+	g_workStealingPool.ParallelFor(numGroups, CPU_DISPATCH_GRAIN, [&ctx, func, groupsX, groupsY](UINT begin, UINT end)
+	{
+		for (UINT g = begin; g < end; ++g)
+			func(ctx, g % groupsX, (g / groupsX) % groupsY, g / (groupsX * groupsY));
+	});
+}
+
+void ComputeBackendCPU::DispatchIndirect(ComputeResource* args, UINT byteOffset)
+{
+	const UINT* groups = reinterpret_cast<const UINT*>(GetData(args) + byteOffset);
+	Dispatch(groups[0], groups[1], groups[2]);
+}
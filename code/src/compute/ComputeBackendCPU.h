@@ -0,0 +1,165 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <atomic>
+#include <unordered_map>
+
+#include "ComputeBackend.h"
+
+class ComputeResourceCPU : public ComputeResource
+{
+public:
+	ComputeResourceCPU(const ComputeBufferDesc& desc, UINT byteWidth)  : ComputeResource(desc), m_data(NULL), m_byteWidth(byteWidth), m_counter(0) { Allocate(); }
+	ComputeResourceCPU(const ComputeTextureDesc& desc, UINT byteWidth) : ComputeResource(desc), m_data(NULL), m_byteWidth(byteWidth), m_counter(0) { Allocate(); }
+	virtual ~ComputeResourceCPU() { _aligned_free(m_data); }
+
+	BYTE*				m_data;			// 16 byte aligned, zero initialized
+	UINT				m_byteWidth;
+	std::atomic<UINT>	m_counter;		// append/consume counter
+
+private:
+	void Allocate()
+	{
+		m_data = (BYTE*)_aligned_malloc(std::max(16u, m_byteWidth), 16);
+		memset(m_data, 0, std::max(16u, m_byteWidth));
+	}
+};
+
+// resources bound for one dispatch, handed to the cpu kernels
+struct CPUKernelContext
+{
+	ComputeResourceCPU* cb[ComputeBackend::NUM_CB_SLOTS];
+	ComputeResourceCPU* srv[ComputeBackend::NUM_SRV_SLOTS];
+	ComputeResourceCPU* uav[ComputeBackend::NUM_UAV_SLOTS];
+	UINT				numGroups[3];
+	const std::vector<std::pair<std::string, std::string>>* defines;	// of the dispatched kernel, see ComputeKernelDesc
+
+	template<typename T> const T&	Constants(UINT slot)	const { return *reinterpret_cast<const T*>(cb[slot]->m_data); }
+	template<typename T> const T*	SRV(UINT slot)			const { return reinterpret_cast<const T*>(srv[slot]->m_data); }
+	template<typename T> T*			UAV(UINT slot)			const { return reinterpret_cast<T*>(uav[slot]->m_data); }
+
+	UINT	NumElementsSRV(UINT slot)	const { return srv[slot]->GetBufferDesc().numElements; }
+	UINT	NumElementsUAV(UINT slot)	const { return uav[slot]->GetBufferDesc().numElements; }
+
+	// defines select the hlsl variants, the cpu ports read them at runtime
+	bool	IsDefined(const char* name) const
+	{
+		for (const auto& define : *defines)
+			if (define.first == name) return true;
+		return false;
+	}
+	UINT	GetDefine(const char* name, UINT defaultValue) const
+	{
+		for (const auto& define : *defines)
+			if (define.first == name) return static_cast<UINT>(atoi(define.second.c_str()));
+		return defaultValue;
+	}
+
+	// AppendStructuredBuffer::Append, returns false if the buffer is full
+	template<typename T> bool Append(UINT slot, const T& value) const
+	{
+		UINT index = uav[slot]->m_counter++;
+		if (index >= uav[slot]->GetBufferDesc().numElements) return false;
+		UAV<T>(slot)[index] = value;
+		return true;
+	}
+};
+
+// one call per thread group, group ids as SV_GroupID. kernels loop over their threads (numthreads of the hlsl version).
+typedef void (*CPUKernelFunc)(const CPUKernelContext& ctx, UINT groupX, UINT groupY, UINT groupZ);
+
+// cpu ports of the hlsl kernels, looked up by the hlsl entry point name
+class CPUKernelRegistry
+{
+public:
+	static CPUKernelRegistry& Get();
+
+	void			Register(const char* entry, CPUKernelFunc func)	{ m_kernels[entry] = func; }
+	CPUKernelFunc	Find(const std::string& entry) const
+	{
+		auto it = m_kernels.find(entry);
+		return it != m_kernels.end() ? it->second : NULL;
+	}
+
+private:
+	std::unordered_map<std::string, CPUKernelFunc> m_kernels;
+};
+
+struct CPUKernelRegistrar
+{
+	CPUKernelRegistrar(const char* entry, CPUKernelFunc func) { CPUKernelRegistry::Get().Register(entry, func); }
+};
+
+#define REGISTER_CPU_KERNEL(entry, func) static CPUKernelRegistrar s_cpuKernel_##entry(#entry, func)
+
+class ComputeKernelCPU : public ComputeKernel
+{
+public:
+	ComputeKernelCPU(const ComputeKernelDesc& desc, CPUKernelFunc func) : ComputeKernel(desc.entry), m_func(func), m_defines(desc.defines) {}
+
+	CPUKernelFunc										m_func;
+	std::vector<std::pair<std::string, std::string>>	m_defines;
+};
+
+// executes the registered cpu kernels on the work stealing pool, thread groups are distributed over the workers.
+// dispatches are synchronous, so Flush is a no-op.
+// the patch intersection stage is ported (CPUKernelsIntersect.cpp), the tile allocation, editing and overlap stages
+// still run on d3d11 only, CreateKernel fails with E_NOTIMPL for them.
+class ComputeBackendCPU : public ComputeBackend
+{
+public:
+	ComputeBackendCPU();
+	virtual ~ComputeBackendCPU();
+
+	HRESULT Create();
+	void	Destroy();
+
+	static BYTE* GetData(ComputeResource* resource) { return resource ? static_cast<ComputeResourceCPU*>(resource)->m_data : NULL; }
+
+	virtual ComputeBackendType GetType() const { return ComputeBackendType::CPU; }
+
+	virtual HRESULT CreateBuffer (const ComputeBufferDesc& desc,  const void* initData, ComputeResource*& resource);
+	virtual HRESULT CreateTexture(const ComputeTextureDesc& desc, const void* initData, ComputeResource*& resource);
+	virtual void	DestroyResource(ComputeResource*& resource);
+
+	virtual HRESULT CreateKernel(const ComputeKernelDesc& desc, ComputeKernel*& kernel);
+	virtual void	DestroyKernel(ComputeKernel*& kernel);
+
+	virtual HRESULT UpdateConstants(ComputeResource* cb, const void* data, UINT size);
+	virtual HRESULT Upload  (ComputeResource* buffer, const void* data, UINT size, UINT offset = 0);
+	virtual HRESULT Readback(ComputeResource* resource, void* data, UINT size);
+	virtual void	CopyResource(ComputeResource* dst, ComputeResource* src);
+	virtual void	CopyStructureCount(ComputeResource* dst, UINT dstOffset, ComputeResource* appendSrc);
+	virtual void	ClearUAVUint(ComputeResource* resource, const UINT values[4]);
+
+	virtual void	SetConstantBuffer(UINT slot, ComputeResource* cb);
+	virtual void	SetSRV(UINT slot, ComputeResource* resource);
+	virtual void	SetUAV(UINT slot, ComputeResource* resource, UINT initialCount = KEEP_COUNTER);
+	virtual void	SetKernel(ComputeKernel* kernel);
+	virtual void	UnbindAll();
+
+	virtual void	Dispatch(UINT groupsX, UINT groupsY, UINT groupsZ);
+	virtual void	DispatchIndirect(ComputeResource* args, UINT byteOffset);
+	virtual void	Flush() {}
+
+protected:
+	CPUKernelContext	m_bindings;
+	ComputeKernelCPU*	m_kernel;
+};
+
+extern ComputeBackendCPU g_computeBackendCPU;
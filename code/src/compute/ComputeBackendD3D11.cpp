@@ -0,0 +1,381 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "ComputeBackendD3D11.h"
+
+#include "App.h"
+
+#include <SDX/DXBuffer.h>
+
+ComputeBackend*		g_computeBackend = NULL;
+ComputeBackendD3D11 g_computeBackendD3D11;
+
+ComputeBackendD3D11::ComputeBackendD3D11()
+{
+	m_pd3dDevice = NULL;
+	m_pd3dImmediateContext = NULL;
+	m_flushQuery = NULL;
+}
+
+ComputeBackendD3D11::~ComputeBackendD3D11()
+{
+	Destroy();
+}
+
+HRESULT ComputeBackendD3D11::Create(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	HRESULT hr = S_OK;
+	m_pd3dDevice = pd3dDevice;
+	m_pd3dImmediateContext = pd3dImmediateContext;
+
+	D3D11_QUERY_DESC queryDesc;
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	queryDesc.MiscFlags = 0;
+	V_RETURN(m_pd3dDevice->CreateQuery(&queryDesc, &m_flushQuery));
+
+	return hr;
+}
+
+void ComputeBackendD3D11::Destroy()
+{
+	SAFE_RELEASE(m_flushQuery);
+	m_pd3dDevice = NULL;
+	m_pd3dImmediateContext = NULL;
+}
+
+ComputeResource* ComputeBackendD3D11::WrapBuffer(const ComputeBufferDesc& desc, ID3D11Buffer* buffer, ID3D11ShaderResourceView* srv, ID3D11UnorderedAccessView* uav)
+{
+	ComputeResourceD3D11* resource = new ComputeResourceD3D11(desc);
+	resource->m_resource = buffer;
+	resource->m_SRV = srv;
+	resource->m_UAV = uav;
+	resource->m_owner = false;
+	return resource;
+}
+
+HRESULT ComputeBackendD3D11::CreateBuffer(const ComputeBufferDesc& desc, const void* initData, ComputeResource*& resource)
+{
+	HRESULT hr = S_OK;
+	resource = NULL;
+
+	const bool isConstant = (desc.flags & COMPUTE_CONSTANT) != 0;
+	const bool isDynamic  = (desc.flags & COMPUTE_DYNAMIC) != 0 || isConstant;
+
+	UINT bindFlags = 0;
+	if (isConstant)						bindFlags |= D3D11_BIND_CONSTANT_BUFFER;
+	if (desc.flags & COMPUTE_SRV)		bindFlags |= D3D11_BIND_SHADER_RESOURCE;
+	if (desc.flags & COMPUTE_UAV)		bindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+
+	UINT miscFlags = 0;
+	UINT structuredStride = 0;
+	if (desc.flags & COMPUTE_STRUCTURED)
+	{
+		miscFlags |= D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		structuredStride = desc.stride;
+	}
+	if (desc.flags & COMPUTE_INDIRECT_ARGS)	miscFlags |= D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+
+	// constant buffers have to be a multiple of 16 bytes
+	UINT byteWidth = isConstant ? ((desc.GetByteWidth() + 15) & ~15u) : desc.GetByteWidth();
+
+	ID3D11Buffer* buffer = NULL;
+	V_RETURN(DXCreateBuffer(m_pd3dDevice, bindFlags, byteWidth, isDynamic ? D3D11_CPU_ACCESS_WRITE : 0, isDynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT,
+							buffer, const_cast<void*>(initData), miscFlags, structuredStride));
+
+	ComputeResourceD3D11* result = new ComputeResourceD3D11(desc);
+	result->m_resource = buffer;
+
+	if (desc.flags & COMPUTE_SRV)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC descSRV;
+		ZeroMemory(&descSRV, sizeof(descSRV));
+		descSRV.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		descSRV.Format = (desc.flags & COMPUTE_STRUCTURED) ? DXGI_FORMAT_UNKNOWN : desc.format;
+		descSRV.Buffer.FirstElement = 0;
+		descSRV.Buffer.NumElements = desc.numElements;
+		hr = m_pd3dDevice->CreateShaderResourceView(buffer, &descSRV, &result->m_SRV);
+	}
+
+	if (SUCCEEDED(hr) && (desc.flags & COMPUTE_UAV))
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
+		ZeroMemory(&descUAV, sizeof(descUAV));
+		descUAV.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		descUAV.Format = (desc.flags & COMPUTE_STRUCTURED) ? DXGI_FORMAT_UNKNOWN : desc.format;
+		descUAV.Buffer.FirstElement = 0;
+		descUAV.Buffer.NumElements = desc.numElements;
+		descUAV.Buffer.Flags = (desc.flags & COMPUTE_APPEND) ? D3D11_BUFFER_UAV_FLAG_APPEND : 0;
+		hr = m_pd3dDevice->CreateUnorderedAccessView(buffer, &descUAV, &result->m_UAV);
+	}
+
+	if (FAILED(hr))
+	{
+		SAFE_DELETE(result);
+		return hr;
+	}
+
+	resource = result;
+	return hr;
+}
+
+HRESULT ComputeBackendD3D11::CreateTexture(const ComputeTextureDesc& desc, const void* initData, ComputeResource*& resource)
+{
+	HRESULT hr = S_OK;
+	resource = NULL;
+
+	D3D11_TEXTURE2D_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = desc.width;
+	texDesc.Height = desc.height;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = desc.arraySize;
+	texDesc.Format = desc.format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = ((desc.flags & COMPUTE_SRV) ? D3D11_BIND_SHADER_RESOURCE : 0) | ((desc.flags & COMPUTE_UAV) ? D3D11_BIND_UNORDERED_ACCESS : 0);
+
+	std::vector<D3D11_SUBRESOURCE_DATA> init;
+	if (initData)
+	{
+		init.resize(desc.arraySize);
+		for (UINT i = 0; i < desc.arraySize; ++i)
+		{
+			init[i].pSysMem = (const BYTE*)initData + i * desc.width * desc.height * desc.texelSize;
+			init[i].SysMemPitch = desc.width * desc.texelSize;
+			init[i].SysMemSlicePitch = desc.width * desc.height * desc.texelSize;
+		}
+	}
+
+	ID3D11Texture2D* texture = NULL;
+	V_RETURN(m_pd3dDevice->CreateTexture2D(&texDesc, initData ? &init[0] : NULL, &texture));
+
+	ComputeResourceD3D11* result = new ComputeResourceD3D11(desc);
+	result->m_resource = texture;
+
+	if (desc.flags & COMPUTE_SRV)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC descSRV;
+		ZeroMemory(&descSRV, sizeof(descSRV));
+		descSRV.Format = desc.format;
+		descSRV.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		descSRV.Texture2DArray.MipLevels = 1;
+		descSRV.Texture2DArray.ArraySize = desc.arraySize;
+		hr = m_pd3dDevice->CreateShaderResourceView(texture, &descSRV, &result->m_SRV);
+	}
+
+	if (SUCCEEDED(hr) && (desc.flags & COMPUTE_UAV))
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
+		ZeroMemory(&descUAV, sizeof(descUAV));
+		descUAV.Format = desc.format;
+		descUAV.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+		descUAV.Texture2DArray.ArraySize = desc.arraySize;
+		hr = m_pd3dDevice->CreateUnorderedAccessView(texture, &descUAV, &result->m_UAV);
+	}
+
+	if (FAILED(hr))
+	{
+		SAFE_DELETE(result);
+		return hr;
+	}
+
+	resource = result;
+	return hr;
+}
+
+void ComputeBackendD3D11::DestroyResource(ComputeResource*& resource)
+{
+	SAFE_DELETE(resource);
+}
+
+HRESULT ComputeBackendD3D11::CreateKernel(const ComputeKernelDesc& desc, ComputeKernel*& kernel)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const auto& define : desc.defines)
+	{
+		D3D_SHADER_MACRO macro = { define.first.c_str(), define.second.c_str() };
+		macros.push_back(macro);
+	}
+	D3D_SHADER_MACRO terminator = { 0 };
+	macros.push_back(terminator);
+
+	ID3DBlob* pBlob = NULL;
+	Shader<ID3D11ComputeShader>* shader = g_shaderManager.AddComputeShader(desc.file, desc.entry, "cs_5_0", &pBlob, &macros[0]);
+	SAFE_RELEASE(pBlob);
+
+	if (!shader)
+	{
+		kernel = NULL;
+		return E_FAIL;
+	}
+
+	kernel = new ComputeKernelD3D11(desc.entry, shader);
+	return S_OK;
+}
+
+void ComputeBackendD3D11::DestroyKernel(ComputeKernel*& kernel)
+{
+	SAFE_DELETE(kernel);
+}
+
+HRESULT ComputeBackendD3D11::UpdateConstants(ComputeResource* cb, const void* data, UINT size)
+{
+	HRESULT hr = S_OK;
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	V_RETURN(m_pd3dImmediateContext->Map(GetResource(cb), 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
+	memcpy(MappedResource.pData, data, size);
+	m_pd3dImmediateContext->Unmap(GetResource(cb), 0);
+	return hr;
+}
+
+HRESULT ComputeBackendD3D11::Upload(ComputeResource* buffer, const void* data, UINT size, UINT offset)
+{
+	HRESULT hr = S_OK;
+	if (buffer->GetBufferDesc().flags & (COMPUTE_DYNAMIC | COMPUTE_CONSTANT))
+	{
+		// discard: partial uploads are not preserved
+		assert(offset == 0);
+		D3D11_MAPPED_SUBRESOURCE MappedResource;
+		V_RETURN(m_pd3dImmediateContext->Map(GetResource(buffer), 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
+		memcpy(MappedResource.pData, data, size);
+		m_pd3dImmediateContext->Unmap(GetResource(buffer), 0);
+	}
+	else
+	{
+		D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+		m_pd3dImmediateContext->UpdateSubresource(GetResource(buffer), 0, &box, data, 0, 0);
+	}
+	return hr;
+}
+
+HRESULT ComputeBackendD3D11::Readback(ComputeResource* resource, void* data, UINT size)
+{
+	HRESULT hr = S_OK;
+	ID3D11Resource* source = GetResource(resource);
+	ID3D11Resource* staging = NULL;
+
+	if (resource->GetType() == ComputeResource::Type::BUFFER)
+	{
+		ID3D11Buffer* stagingBUF = NULL;
+		V_RETURN(DXCreateBuffer(m_pd3dDevice, 0, resource->GetBufferDesc().GetByteWidth(), D3D11_CPU_ACCESS_READ, D3D11_USAGE_STAGING, stagingBUF));
+		staging = stagingBUF;
+	}
+	else
+	{
+		D3D11_TEXTURE2D_DESC texDesc;
+		static_cast<ID3D11Texture2D*>(source)->GetDesc(&texDesc);
+		texDesc.Usage = D3D11_USAGE_STAGING;
+		texDesc.BindFlags = 0;
+		texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		texDesc.MiscFlags = 0;
+		ID3D11Texture2D* stagingTEX = NULL;
+		V_RETURN(m_pd3dDevice->CreateTexture2D(&texDesc, NULL, &stagingTEX));
+		staging = stagingTEX;
+	}
+
+	m_pd3dImmediateContext->CopyResource(staging, source);
+
+	if (resource->GetType() == ComputeResource::Type::BUFFER)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		hr = m_pd3dImmediateContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+		if (SUCCEEDED(hr))
+		{
+			memcpy(data, mapped.pData, size);
+			m_pd3dImmediateContext->Unmap(staging, 0);
+		}
+	}
+	else
+	{
+		// tightly packed slices
+		const ComputeTextureDesc& desc = resource->GetTextureDesc();
+		const UINT rowSize = desc.width * desc.texelSize;
+		BYTE* dst = (BYTE*)data;
+		for (UINT slice = 0; slice < desc.arraySize && SUCCEEDED(hr); ++slice)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped;
+			hr = m_pd3dImmediateContext->Map(staging, D3D11CalcSubresource(0, slice, 1), D3D11_MAP_READ, 0, &mapped);
+			if (FAILED(hr)) break;
+			for (UINT y = 0; y < desc.height; ++y)
+				memcpy(dst + (slice * desc.height + y) * rowSize, (BYTE*)mapped.pData + y * mapped.RowPitch, rowSize);
+			m_pd3dImmediateContext->Unmap(staging, D3D11CalcSubresource(0, slice, 1));
+		}
+	}
+
+	SAFE_RELEASE(staging);
+	return hr;
+}
+
+void ComputeBackendD3D11::CopyResource(ComputeResource* dst, ComputeResource* src)
+{
+	m_pd3dImmediateContext->CopyResource(GetResource(dst), GetResource(src));
+}
+
+void ComputeBackendD3D11::CopyStructureCount(ComputeResource* dst, UINT dstOffset, ComputeResource* appendSrc)
+{
+	m_pd3dImmediateContext->CopyStructureCount(static_cast<ID3D11Buffer*>(GetResource(dst)), dstOffset, GetUAV(appendSrc));
+}
+
+void ComputeBackendD3D11::ClearUAVUint(ComputeResource* resource, const UINT values[4])
+{
+	m_pd3dImmediateContext->ClearUnorderedAccessViewUint(GetUAV(resource), values);
+}
+
+void ComputeBackendD3D11::SetConstantBuffer(UINT slot, ComputeResource* cb)
+{
+	ID3D11Buffer* buffer = static_cast<ID3D11Buffer*>(GetResource(cb));
+	m_pd3dImmediateContext->CSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void ComputeBackendD3D11::SetSRV(UINT slot, ComputeResource* resource)
+{
+	ID3D11ShaderResourceView* srv = GetSRV(resource);
+	m_pd3dImmediateContext->CSSetShaderResources(slot, 1, &srv);
+}
+
+void ComputeBackendD3D11::SetUAV(UINT slot, ComputeResource* resource, UINT initialCount)
+{
+	ID3D11UnorderedAccessView* uav = GetUAV(resource);
+	m_pd3dImmediateContext->CSSetUnorderedAccessViews(slot, 1, &uav, &initialCount);
+}
+
+void ComputeBackendD3D11::SetKernel(ComputeKernel* kernel)
+{
+	m_pd3dImmediateContext->CSSetShader(kernel ? static_cast<ComputeKernelD3D11*>(kernel)->m_shader->Get() : NULL, NULL, 0);
+}
+
+void ComputeBackendD3D11::UnbindAll()
+{
+	m_pd3dImmediateContext->CSSetShaderResources(0, NUM_SRV_SLOTS, g_ppSRVNULL);
+	m_pd3dImmediateContext->CSSetUnorderedAccessViews(0, NUM_UAV_SLOTS, g_ppUAVNULL, NULL);
+}
+
+void ComputeBackendD3D11::Dispatch(UINT groupsX, UINT groupsY, UINT groupsZ)
+{
+	m_pd3dImmediateContext->Dispatch(groupsX, groupsY, groupsZ);
+}
+
+void ComputeBackendD3D11::DispatchIndirect(ComputeResource* args, UINT byteOffset)
+{
+	m_pd3dImmediateContext->DispatchIndirect(static_cast<ID3D11Buffer*>(GetResource(args)), byteOffset);
+}
+
+void ComputeBackendD3D11::Flush()
+{
+	m_pd3dImmediateContext->End(m_flushQuery);
+	while (m_pd3dImmediateContext->GetData(m_flushQuery, NULL, 0, 0) == S_FALSE) { /*Wait*/ }
+}
@@ -0,0 +1,102 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <SDX/DXShaderManager.h>
+
+#include "ComputeBackend.h"
+
+class ComputeResourceD3D11 : public ComputeResource
+{
+public:
+	ComputeResourceD3D11(const ComputeBufferDesc& desc)  : ComputeResource(desc), m_resource(NULL), m_SRV(NULL), m_UAV(NULL), m_owner(true) {}
+	ComputeResourceD3D11(const ComputeTextureDesc& desc) : ComputeResource(desc), m_resource(NULL), m_SRV(NULL), m_UAV(NULL), m_owner(true) {}
+	virtual ~ComputeResourceD3D11()
+	{
+		if (m_owner)
+		{
+			SAFE_RELEASE(m_resource);
+			SAFE_RELEASE(m_SRV);
+			SAFE_RELEASE(m_UAV);
+		}
+	}
+
+	ID3D11Resource*				m_resource;
+	ID3D11ShaderResourceView*	m_SRV;
+	ID3D11UnorderedAccessView*	m_UAV;
+	bool						m_owner;		// false for wrapped resources
+};
+
+class ComputeKernelD3D11 : public ComputeKernel
+{
+public:
+	ComputeKernelD3D11(const std::string& name, Shader<ID3D11ComputeShader>* shader) : ComputeKernel(name), m_shader(shader) {}
+
+	Shader<ID3D11ComputeShader>*	m_shader;		// owned by the shader manager
+};
+
+// thin wrapper around the immediate context
+class ComputeBackendD3D11 : public ComputeBackend
+{
+public:
+	ComputeBackendD3D11();
+	virtual ~ComputeBackendD3D11();
+
+	HRESULT Create(ID3D11Device1* pd3dDevice, ID3D11DeviceContext1* pd3dImmediateContext);
+	void	Destroy();
+
+	// non owning wrapper for resources created outside of the backend
+	ComputeResource* WrapBuffer(const ComputeBufferDesc& desc, ID3D11Buffer* buffer, ID3D11ShaderResourceView* srv, ID3D11UnorderedAccessView* uav);
+
+	static ID3D11ShaderResourceView*	GetSRV(ComputeResource* resource) { return resource ? static_cast<ComputeResourceD3D11*>(resource)->m_SRV : NULL; }
+	static ID3D11UnorderedAccessView*	GetUAV(ComputeResource* resource) { return resource ? static_cast<ComputeResourceD3D11*>(resource)->m_UAV : NULL; }
+
+	virtual ComputeBackendType GetType() const { return ComputeBackendType::D3D11; }
+
+	virtual HRESULT CreateBuffer (const ComputeBufferDesc& desc,  const void* initData, ComputeResource*& resource);
+	virtual HRESULT CreateTexture(const ComputeTextureDesc& desc, const void* initData, ComputeResource*& resource);
+	virtual void	DestroyResource(ComputeResource*& resource);
+
+	virtual HRESULT CreateKernel(const ComputeKernelDesc& desc, ComputeKernel*& kernel);
+	virtual void	DestroyKernel(ComputeKernel*& kernel);
+
+	virtual HRESULT UpdateConstants(ComputeResource* cb, const void* data, UINT size);
+	virtual HRESULT Upload  (ComputeResource* buffer, const void* data, UINT size, UINT offset = 0);
+	virtual HRESULT Readback(ComputeResource* resource, void* data, UINT size);
+	virtual void	CopyResource(ComputeResource* dst, ComputeResource* src);
+	virtual void	CopyStructureCount(ComputeResource* dst, UINT dstOffset, ComputeResource* appendSrc);
+	virtual void	ClearUAVUint(ComputeResource* resource, const UINT values[4]);
+
+	virtual void	SetConstantBuffer(UINT slot, ComputeResource* cb);
+	virtual void	SetSRV(UINT slot, ComputeResource* resource);
+	virtual void	SetUAV(UINT slot, ComputeResource* resource, UINT initialCount = KEEP_COUNTER);
+	virtual void	SetKernel(ComputeKernel* kernel);
+	virtual void	UnbindAll();
+
+	virtual void	Dispatch(UINT groupsX, UINT groupsY, UINT groupsZ);
+	virtual void	DispatchIndirect(ComputeResource* args, UINT byteOffset);
+	virtual void	Flush();
+
+protected:
+	static ID3D11Resource* GetResource(ComputeResource* resource) { return resource ? static_cast<ComputeResourceD3D11*>(resource)->m_resource : NULL; }
+
+	ID3D11Device1*			m_pd3dDevice;
+	ID3D11DeviceContext1*	m_pd3dImmediateContext;
+	ID3D11Query*			m_flushQuery;
+};
+
+extern ComputeBackendD3D11 g_computeBackendD3D11;
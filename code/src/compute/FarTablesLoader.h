@@ -0,0 +1,66 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <far/subdivisionTables.h>
+#include <far/patchTables.h>
+
+#include <vector>
+
+namespace OpenSubdiv {
+namespace OPENSUBDIV_VERSION {
+
+// write access to the far tables without hbr mesh and factories, friend of FarSubdivisionTables and FarPatchTables.
+// used to rebuild the tables of a FarMesh from flat arrays (topology cache)
+class FarTablesLoader
+{
+public:
+	static FarSubdivisionTables* NewSubdivisionTables(int maxlevel, FarSubdivisionTables::Scheme scheme)
+	{
+		return new FarSubdivisionTables(maxlevel, scheme);
+	}
+
+	static std::vector<int>&			VertsOffsets(FarSubdivisionTables* tables)	{ return tables->_vertsOffsets; }
+	static std::vector<int>&			F_ITa(FarSubdivisionTables* tables)			{ return tables->_F_ITa; }
+	static std::vector<unsigned int>&	F_IT(FarSubdivisionTables* tables)			{ return tables->_F_IT; }
+	static std::vector<int>&			E_IT(FarSubdivisionTables* tables)			{ return tables->_E_IT; }
+	static std::vector<float>&			E_W(FarSubdivisionTables* tables)			{ return tables->_E_W; }
+	static std::vector<int>&			V_ITa(FarSubdivisionTables* tables)			{ return tables->_V_ITa; }
+	static std::vector<unsigned int>&	V_IT(FarSubdivisionTables* tables)			{ return tables->_V_IT; }
+	static std::vector<float>&			V_W(FarSubdivisionTables* tables)			{ return tables->_V_W; }
+
+	static const std::vector<int>&		GetVertsOffsets(const FarSubdivisionTables* tables)	{ return tables->_vertsOffsets; }
+
+	static FarPatchTables* NewPatchTables(int maxValence, int numPtexFaces)
+	{
+		FarPatchTables* tables = new FarPatchTables(maxValence);
+		tables->_numPtexFaces = numPtexFaces;
+		return tables;
+	}
+
+	static FarPatchTables::PatchArrayVector&	PatchArrays(FarPatchTables* tables)		{ return tables->_patchArrays; }
+	static FarPatchTables::PTable&				Patches(FarPatchTables* tables)			{ return tables->_patches; }
+	static FarPatchTables::VertexValenceTable&	VertexValences(FarPatchTables* tables)	{ return tables->_vertexValenceTable; }
+	static FarPatchTables::QuadOffsetTable&		QuadOffsets(FarPatchTables* tables)		{ return tables->_quadOffsetTable; }
+	static FarPatchTables::PatchParamTable&		PatchParams(FarPatchTables* tables)		{ return tables->_paramTable; }
+	static std::vector<float>&					FVarData(FarPatchTables* tables)		{ return tables->_fvarData._data; }
+	static void SetFVarWidth(FarPatchTables* tables, int fvarWidth)						{ tables->_fvarData._fvarWidth = fvarWidth; }
+};
+
+} // end namespace OPENSUBDIV_VERSION
+using namespace OPENSUBDIV_VERSION;
+
+} // end namespace OpenSubdiv
@@ -0,0 +1,613 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "compute/FarTopologyBuilder.h"
+#include "compute/FarTablesLoader.h"
+
+#include <far/kernelBatchFactory.h>
+
+#include <algorithm>
+
+using namespace DirectX;
+using namespace OpenSubdiv;
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+namespace
+{
+
+// HbrVertex masks and sharpness constants
+const int	MASK_SMOOTH			= 0;
+const int	MASK_DART			= 1;
+const int	MASK_CREASE			= 2;
+const int	MASK_CORNER			= 3;
+const float	INFINITELY_SHARP	= 10.0f;
+
+// FarSubdivisionTablesFactory::GetMaskRanking
+const int MASK_RANKING[4][4] = 
+{ 
+	{ 0,	1,		6,		4 },
+	{ 0xFF, 2,		5,		3 },
+	{ 0xFF, 0xFF,	9,		7 },
+	{ 0xFF, 0xFF,	0xFF,	8 } 
+};
+
+// quad mesh of one refinement level, local vertex indices
+struct TopologyLevel
+{
+	int					numVertices;
+	std::vector<int>	faceVerts;			// 4 per face
+	std::vector<int>	faceEdges;			// 4 per face, edge i connects corner i and i+1
+	std::vector<int>	edgeVerts;			// 2 per edge
+	std::vector<int>	edgeFaces;			// 2 per edge, second is -1 on the boundary
+	std::vector<float>	edgeSharpness;
+	std::vector<float>	vertexSharpness;
+	std::vector<int>	vertCornerOffsets;	// csr vertex -> corners (4 * face + corner)
+	std::vector<int>	vertCorners;
+	std::vector<int>	vertEdgeOffsets;	// csr vertex -> incident edges
+	std::vector<int>	vertEdges;
+
+	int GetNumFaces() const { return static_cast<int>(faceVerts.size() / 4); }
+	int GetNumEdges() const { return static_cast<int>(edgeVerts.size() / 2); }
+
+	int GetNextVertex(int corner) const { return faceVerts[(corner & ~3) | ((corner + 1) & 3)]; }
+
+	size_t GetBytes() const
+	{
+		return (faceVerts.capacity() + faceEdges.capacity() + edgeVerts.capacity() + edgeFaces.capacity() + vertCornerOffsets.capacity() + 
+				vertCorners.capacity() + vertEdgeOffsets.capacity() + vertEdges.capacity()) * sizeof(int) +
+			   (edgeSharpness.capacity() + vertexSharpness.capacity()) * sizeof(float);
+	}
+};
+
+template<typename T>
+size_t VectorBytes(const std::vector<T>& v) { return v.capacity() * sizeof(T); }
+
+void BuildCSR(int numKeys, const std::vector<int>& keys, int keysPerItem, std::vector<int>& offsets, std::vector<int>& items)
+{
+	offsets.assign(numKeys + 1, 0);
+	for (int key : keys)
+		offsets[key + 1]++;
+	for (int i = 0; i < numKeys; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	items.resize(keys.size());
+	for (size_t i = 0; i < keys.size(); ++i)
+		items[fill[keys[i]]++] = static_cast<int>(i) / keysPerItem;
+}
+
+void BuildVertexRings(TopologyLevel& level)
+{
+	// corners keep their index, BuildCSR divides by the item size
+	BuildCSR(level.numVertices, level.faceVerts, 1, level.vertCornerOffsets, level.vertCorners);
+	BuildCSR(level.numVertices, level.edgeVerts, 2, level.vertEdgeOffsets, level.vertEdges);
+}
+
+// edges of the cage from sorted half edges, fails for non manifold edges, inconsistent winding and degenerate faces
+bool BuildCoarseEdges(TopologyLevel& level)
+{
+	const int numCorners = static_cast<int>(level.faceVerts.size());
+
+	std::vector<std::pair<UINT64, int>> halfEdges(numCorners);
+	for (int c = 0; c < numCorners; ++c)
+	{
+		const UINT64 a = static_cast<UINT64>(level.faceVerts[c]);
+		const UINT64 b = static_cast<UINT64>(level.GetNextVertex(c));
+		if (a == b) 
+			return false;
+		halfEdges[c] = std::make_pair(a < b ? (a << 32) | b : (b << 32) | a, c);
+	}
+	std::sort(halfEdges.begin(), halfEdges.end());
+
+	level.faceEdges.resize(numCorners);
+	level.edgeVerts.reserve(numCorners);
+	level.edgeFaces.reserve(numCorners);
+	level.edgeSharpness.reserve(numCorners / 2);
+
+	for (int i = 0; i < numCorners; )
+	{
+		int n = 1;
+		while (i + n < numCorners && halfEdges[i + n].first == halfEdges[i].first) ++n;
+		if (n > 2)
+			return false;
+
+		const int c0 = halfEdges[i].second;
+		const int c1 = n == 2 ? halfEdges[i + 1].second : -1;
+		if (c1 >= 0 && level.faceVerts[c0] == level.faceVerts[c1])
+			return false;
+
+		const int e = level.GetNumEdges();
+		level.edgeVerts.push_back(level.faceVerts[c0]);
+		level.edgeVerts.push_back(level.GetNextVertex(c0));
+		level.edgeFaces.push_back(c0 / 4);
+		level.edgeFaces.push_back(c1 >= 0 ? c1 / 4 : -1);
+		level.edgeSharpness.push_back(c1 >= 0 ? 0.0f : INFINITELY_SHARP);		// boundary edges are infinitely sharp
+		level.faceEdges[c0] = e;
+		if (c1 >= 0)
+			level.faceEdges[c1] = e;
+
+		i += n;
+	}
+	return true;
+}
+
+// every vertex is referenced and has one fan of faces, hbr would split the other vertices
+bool IsManifold(const TopologyLevel& level)
+{
+	for (int v = 0; v < level.numVertices; ++v)
+	{
+		const int numFaces = level.vertCornerOffsets[v + 1] - level.vertCornerOffsets[v];
+		const int numEdges = level.vertEdgeOffsets[v + 1] - level.vertEdgeOffsets[v];
+		if (numFaces == 0)
+			return false;
+
+		int numBoundary = 0;
+		for (int i = level.vertEdgeOffsets[v]; i < level.vertEdgeOffsets[v + 1]; ++i)
+			numBoundary += level.edgeFaces[2 * level.vertEdges[i] + 1] < 0 ? 1 : 0;
+
+		if (numBoundary == 0 && numEdges != numFaces)
+			return false;
+		if (numBoundary > 0 && (numBoundary != 2 || numEdges != numFaces + 1))
+			return false;
+	}
+	return true;
+}
+
+int FindEdge(const TopologyLevel& level, int v0, int v1)
+{
+	for (int i = level.vertEdgeOffsets[v0]; i < level.vertEdgeOffsets[v0 + 1]; ++i)
+	{
+		const int e = level.vertEdges[i];
+		if (level.edgeVerts[2 * e] == v1 || level.edgeVerts[2 * e + 1] == v1)
+			return e;
+	}
+	return -1;
+}
+
+// HbrVertex::GetMask for the current (0) and next (1) level
+void GetVertexMasks(const TopologyLevel& level, int v, int masks[2])
+{
+	const float vsharp = level.vertexSharpness[v];
+	masks[0] = vsharp >= 1.0f ? MASK_CORNER : MASK_SMOOTH;
+	masks[1] = vsharp >  0.0f ? MASK_CORNER : MASK_SMOOTH;
+
+	for (int i = level.vertEdgeOffsets[v]; i < level.vertEdgeOffsets[v + 1]; ++i)
+	{
+		const float esharp = level.edgeSharpness[level.vertEdges[i]];
+		if (esharp >= 1.0f && masks[0] < MASK_CORNER) masks[0]++;
+		if (esharp >  0.0f && masks[1] < MASK_CORNER) masks[1]++;
+	}
+}
+
+// HbrVertex::GetFractionalMask
+float GetFractionalMask(const TopologyLevel& level, int v)
+{
+	float mask = 0.0f;
+	float n = 0.0f;
+
+	const float vsharp = level.vertexSharpness[v];
+	if (vsharp > 0.0f && vsharp < 1.0f) 
+	{ 
+		mask += vsharp; 
+		n += 1.0f; 
+	}
+
+	for (int i = level.vertEdgeOffsets[v]; i < level.vertEdgeOffsets[v + 1]; ++i)
+	{
+		const float esharp = level.edgeSharpness[level.vertEdges[i]];
+		if (esharp > 0.0f && esharp < 1.0f) 
+		{ 
+			mask += esharp; 
+			n += 1.0f; 
+		}
+	}
+	assert(n > 0.0f);
+	return mask / n;
+}
+
+// HbrSubdivision::SubdivideCreaseWeight with k_CreaseNormal
+inline float SubdivideSharpness(float sharpness)
+{
+	return sharpness >= INFINITELY_SHARP ? INFINITELY_SHARP : std::max(sharpness - 1.0f, 0.0f);
+}
+
+inline int GetEdgeHalf(const TopologyLevel& level, int e, int v)
+{
+	return level.edgeVerts[2 * e] == v ? 2 * e : 2 * e + 1;
+}
+
+}
+
+FarTopologyBuilder::FarTopologyBuilder()
+{
+	m_numVertices = 0;
+	m_peakBytes = 0;
+}
+
+void FarTopologyBuilder::SetCage(UINT numVertices, const XMUINT4* quads, UINT numQuads)
+{
+	m_numVertices = numVertices;
+	m_faceVertices.resize(4 * numQuads);
+	if (numQuads > 0)
+		memcpy(&m_faceVertices[0], quads, numQuads * sizeof(XMUINT4));
+
+	m_creases.clear();
+	m_vertexSharpness.assign(numVertices, 0.0f);
+}
+
+void FarTopologyBuilder::AddCrease(UINT v0, UINT v1, float sharpness)
+{
+	Crease crease = { v0, v1, sharpness };
+	m_creases.push_back(crease);
+}
+
+void FarTopologyBuilder::SetVertexSharpness(UINT vertex, float sharpness)
+{
+	m_vertexSharpness[vertex] = sharpness;
+}
+
+FarMesh<OsdVertex>* FarTopologyBuilder::Create(int maxLevel)
+{
+	m_peakBytes = 0;
+	if (maxLevel < 1 || m_faceVertices.empty())
+		return NULL;
+
+	for (int v : m_faceVertices)
+		if (v < 0 || v >= static_cast<int>(m_numVertices))
+			return NULL;
+
+	// coarse level
+	TopologyLevel parent;
+	parent.numVertices		= static_cast<int>(m_numVertices);
+	parent.faceVerts		= m_faceVertices;
+	parent.vertexSharpness	= m_vertexSharpness;
+
+	if (!BuildCoarseEdges(parent))
+	{
+		std::cerr << "far topology builder: non manifold edge or inconsistent winding" << std::endl;
+		return NULL;
+	}
+	BuildVertexRings(parent);
+	if (!IsManifold(parent))
+	{
+		std::cerr << "far topology builder: non manifold or unreferenced vertex" << std::endl;
+		return NULL;
+	}
+
+	for (const auto& crease : m_creases)
+	{
+		const int e = FindEdge(parent, crease.v0, crease.v1);
+		if (e < 0)
+		{
+			std::cerr << "far topology builder: crease " << crease.v0 << " - " << crease.v1 << " is not an edge" << std::endl;
+			return NULL;
+		}
+		// boundary edges stay infinitely sharp
+		if (parent.edgeFaces[2 * e + 1] >= 0)
+			parent.edgeSharpness[e] = crease.sharpness;
+	}
+
+	// table sizes from the level counts: faces x4, edges x2 + 4 per face, vertices + edges + faces
+	size_t numFaceVerts = 0, numEdgeVerts = 0, numVertVerts = 0;
+	{
+		size_t f = parent.GetNumFaces(), e = parent.GetNumEdges(), v = parent.numVertices;
+		for (int level = 1; level <= maxLevel; ++level)
+		{
+			numFaceVerts += f;
+			numEdgeVerts += e;
+			numVertVerts += v;
+			const size_t nextV = v + e + f;
+			e = 2 * e + 4 * f;
+			f = 4 * f;
+			v = nextV;
+		}
+	}
+
+	FarSubdivisionTables* subdivisionTables = FarTablesLoader::NewSubdivisionTables(maxLevel, FarSubdivisionTables::CATMARK);
+	std::vector<int>&			vertsOffsets	= FarTablesLoader::VertsOffsets(subdivisionTables);
+	std::vector<unsigned int>&	F_IT			= FarTablesLoader::F_IT(subdivisionTables);
+	std::vector<int>&			E_IT			= FarTablesLoader::E_IT(subdivisionTables);
+	std::vector<float>&			E_W				= FarTablesLoader::E_W(subdivisionTables);
+	std::vector<int>&			V_ITa			= FarTablesLoader::V_ITa(subdivisionTables);
+	std::vector<unsigned int>&	V_IT			= FarTablesLoader::V_IT(subdivisionTables);
+	std::vector<float>&			V_W				= FarTablesLoader::V_W(subdivisionTables);
+
+	// all quads, the quad face kernel needs no F_ITa
+	F_IT.reserve(4 * numFaceVerts);
+	E_IT.reserve(4 * numEdgeVerts);
+	E_W.reserve(2 * numEdgeVerts);
+	V_ITa.reserve(5 * numVertVerts);
+	V_W.reserve(numVertVerts);
+
+	FarKernelBatchVector batches;
+	batches.reserve(maxLevel * 5);
+
+	// ptex coordinates of the faces of the current level for the patch params
+	std::vector<UINT> faceU(parent.GetNumFaces(), 0), faceV(parent.GetNumFaces(), 0), facePtex(parent.GetNumFaces());
+	for (int f = 0; f < parent.GetNumFaces(); ++f)
+		facePtex[f] = f;
+
+	std::vector<int>	vertexOrder;
+	std::vector<int>	vertexChild;
+	std::vector<int>	vertexRank;
+
+	FarPatchTables* patchTables = NULL;
+
+	int vertexOffset = parent.numVertices;
+	int edgeTableOffset = 0;
+	int vertTableOffset = 0;
+	vertsOffsets[0] = 0;
+
+	for (int level = 1; level <= maxLevel; ++level)
+	{
+		const int numFaces		= parent.GetNumFaces();
+		const int numEdges		= parent.GetNumEdges();
+		const int numVerts		= parent.numVertices;
+		const int parentOffset	= vertsOffsets[level - 1];
+		const int faceOffset	= vertexOffset;
+		const int edgeOffset	= faceOffset + numFaces;
+		const int vertOffset	= edgeOffset + numEdges;
+
+		vertsOffsets[level] = vertexOffset;
+
+		// face vertices, the quad kernel stores the F_IT offset in the table offset
+		batches.push_back(FarKernelBatch(FarKernelBatch::CATMARK_QUAD_FACE_VERTEX, level, 0, 0, numFaces, static_cast<int>(F_IT.size()), faceOffset));
+		for (int c = 0; c < 4 * numFaces; ++c)
+			F_IT.push_back(parentOffset + parent.faceVerts[c]);
+
+		// edge vertices
+		batches.push_back(FarKernelBatch(FarKernelBatch::CATMARK_EDGE_VERTEX, level, 0, 0, numEdges, edgeTableOffset, edgeOffset));
+		for (int e = 0; e < numEdges; ++e)
+		{
+			const float esharp = parent.edgeSharpness[e];
+			const bool boundary = parent.edgeFaces[2 * e + 1] < 0;
+
+			E_IT.push_back(parentOffset + parent.edgeVerts[2 * e + 0]);
+			E_IT.push_back(parentOffset + parent.edgeVerts[2 * e + 1]);
+
+			float faceWeight = 0.5f, vertWeight = 0.5f;
+			if (!boundary && esharp <= 1.0f)
+			{
+				const float leftWeight = 0.25f, rightWeight = 0.25f;
+				faceWeight = 0.5f * (leftWeight + rightWeight);
+				vertWeight = 0.5f * (1.0f - 2.0f * faceWeight);
+				faceWeight *= (1.0f - esharp);
+				vertWeight = 0.5f * esharp + (1.0f - esharp) * vertWeight;
+
+				E_IT.push_back(faceOffset + parent.edgeFaces[2 * e + 0]);
+				E_IT.push_back(faceOffset + parent.edgeFaces[2 * e + 1]);
+			}
+			else
+			{
+				E_IT.push_back(-1);
+				E_IT.push_back(-1);
+			}
+			E_W.push_back(vertWeight);
+			E_W.push_back(faceWeight);
+		}
+		edgeTableOffset += numEdges;
+
+		// vertex vertices, sorted by the mask ranking to batch the A/B kernels
+		vertexRank.resize(numVerts);
+		for (int v = 0; v < numVerts; ++v)
+		{
+			int masks[2];
+			GetVertexMasks(parent, v, masks);
+			vertexRank[v] = MASK_RANKING[masks[0]][masks[1]];
+		}
+
+		vertexOrder.resize(numVerts);
+		for (int v = 0; v < numVerts; ++v)
+			vertexOrder[v] = v;
+		std::stable_sort(vertexOrder.begin(), vertexOrder.end(), [&](int a, int b) { return vertexRank[a] < vertexRank[b]; });
+
+		vertexChild.resize(numVerts);
+		FarVertexKernelBatchFactory batchFactory(numVerts, 0);
+		for (int i = 0; i < numVerts; ++i)
+		{
+			const int v = vertexOrder[i];
+			vertexChild[v] = numFaces + numEdges + i;
+
+			int masks[2];
+			GetVertexMasks(parent, v, masks);
+
+			// two passes for fractional sharpness, except the smooth to dart transition (same kernel)
+			int npasses = 1;
+			float weights[2] = { 1.0f, 0.0f };
+			if (masks[0] != masks[1] && !(masks[0] == MASK_SMOOTH && masks[1] == MASK_DART))
+			{
+				weights[1] = GetFractionalMask(parent, v);
+				weights[0] = 1.0f - weights[1];
+				npasses = 2;
+			}
+
+			const size_t a = V_ITa.size();
+			V_ITa.push_back(static_cast<int>(V_IT.size()));
+			V_ITa.push_back(0);
+			V_ITa.push_back(parentOffset + v);
+			V_ITa.push_back(-1);
+			V_ITa.push_back(-1);
+
+			for (int p = 0; p < npasses; ++p)
+			{
+				switch (masks[p])
+				{
+				case MASK_SMOOTH:
+				case MASK_DART:
+					// the outgoing edge of every incident face and the face child
+					for (int j = parent.vertCornerOffsets[v]; j < parent.vertCornerOffsets[v + 1]; ++j)
+					{
+						const int c = parent.vertCorners[j];
+						V_ITa[a + 1]++;
+						V_IT.push_back(parentOffset + parent.GetNextVertex(c));
+						V_IT.push_back(faceOffset + c / 4);
+					}
+					break;
+				case MASK_CREASE:
+				{
+					int count = 0;
+					for (int j = parent.vertEdgeOffsets[v]; j < parent.vertEdgeOffsets[v + 1] && count < 2; ++j)
+					{
+						const int e = parent.vertEdges[j];
+						const float esharp = parent.edgeSharpness[e];
+						if (p == 1 ? esharp > 0.0f : esharp >= 1.0f)
+						{
+							const int other = parent.edgeVerts[2 * e] == v ? parent.edgeVerts[2 * e + 1] : parent.edgeVerts[2 * e];
+							V_ITa[a + 3 + count++] = parentOffset + other;
+						}
+					}
+					assert(count == 2);
+					break;
+				}
+				case MASK_CORNER:
+					// crease / corner pass combination, -1 switches the A kernel to the corner rule
+					if (V_ITa[a + 1] == 0)
+						V_ITa[a + 1] = -1;
+					break;
+				}
+			}
+
+			// the single pass corner and crease cases apply a weight of 1, inverted in the kernel
+			V_W.push_back(vertexRank[v] > 7 ? 0.0f : weights[0]);
+			batchFactory.AddVertex(i, vertexRank[v]);
+		}
+		batchFactory.AppendCatmarkBatches(level, vertTableOffset, vertOffset, &batches);
+		vertTableOffset += numVerts;
+		vertexOffset = vertOffset + numVerts;
+
+		// child faces in hbr order (parent face, corner), hbr rotates the child vertices to keep the parametrization
+		TopologyLevel child;
+		child.numVertices = numFaces + numEdges + numVerts;
+		child.faceVerts.resize(16 * numFaces);
+		for (int f = 0; f < numFaces; ++f)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				int* cv = &child.faceVerts[4 * (4 * f + i)];
+				cv[i]			= vertexChild[parent.faceVerts[4 * f + i]];
+				cv[(i + 1) & 3] = numFaces + parent.faceEdges[4 * f + i];
+				cv[(i + 2) & 3] = f;
+				cv[(i + 3) & 3] = numFaces + parent.faceEdges[4 * f + ((i + 3) & 3)];
+			}
+		}
+
+		if (level == maxLevel)
+		{
+			// uniform patch tables: the quads of the finest level
+			patchTables = FarTablesLoader::NewPatchTables(0, static_cast<int>(m_faceVertices.size() / 4));
+
+			const int numPatches = child.GetNumFaces();
+			FarTablesLoader::PatchArrays(patchTables).push_back(FarPatchTables::PatchArray(
+				FarPatchTables::Descriptor(FarPatchTables::QUADS, FarPatchTables::NON_TRANSITION, 0), 0, 0, numPatches, 0));
+
+			FarPatchTables::PTable& patches = FarTablesLoader::Patches(patchTables);
+			patches.resize(child.faceVerts.size());
+			for (size_t c = 0; c < child.faceVerts.size(); ++c)
+				patches[c] = vertsOffsets[level] + child.faceVerts[c];
+
+			FarPatchTables::PatchParamTable& params = FarTablesLoader::PatchParams(patchTables);
+			params.resize(numPatches);
+			for (int f = 0; f < numFaces; ++f)
+			{
+				for (int i = 0; i < 4; ++i)
+				{
+					const UINT u = 2 * faceU[f] + (i == 1 || i == 2 ? 1 : 0);
+					const UINT v = 2 * faceV[f] + (i == 2 || i == 3 ? 1 : 0);
+					params[4 * f + i].Set(facePtex[f], static_cast<short>(u), static_cast<short>(v), 0, static_cast<unsigned char>(level), false);
+				}
+			}
+			m_peakBytes = std::max(m_peakBytes, parent.GetBytes() + child.GetBytes() + VectorBytes(patches) + VectorBytes(params));
+			break;
+		}
+
+		// child edges: two halves per parent edge, one per face corner from the edge child to the face child
+		child.edgeVerts.resize(2 * (2 * numEdges + 4 * numFaces));
+		child.edgeFaces.assign(child.edgeVerts.size(), -1);
+		child.edgeSharpness.resize(2 * numEdges + 4 * numFaces, 0.0f);
+		for (int e = 0; e < numEdges; ++e)
+		{
+			const float csharp = SubdivideSharpness(parent.edgeSharpness[e]);
+			child.edgeVerts[4 * e + 0] = vertexChild[parent.edgeVerts[2 * e]];
+			child.edgeVerts[4 * e + 1] = numFaces + e;
+			child.edgeVerts[4 * e + 2] = numFaces + e;
+			child.edgeVerts[4 * e + 3] = vertexChild[parent.edgeVerts[2 * e + 1]];
+			child.edgeSharpness[2 * e + 0] = csharp;
+			child.edgeSharpness[2 * e + 1] = csharp;
+		}
+		for (int c = 0; c < 4 * numFaces; ++c)
+		{
+			const int e = 2 * numEdges + c;
+			child.edgeVerts[2 * e + 0] = numFaces + parent.faceEdges[c];
+			child.edgeVerts[2 * e + 1] = c / 4;
+		}
+
+		child.faceEdges.resize(16 * numFaces);
+		for (int f = 0; f < numFaces; ++f)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				const int vi	= parent.faceVerts[4 * f + i];
+				const int ei	= parent.faceEdges[4 * f + i];
+				const int eprev = parent.faceEdges[4 * f + ((i + 3) & 3)];
+				const int cf	= 4 * f + i;
+
+				int* ce = &child.faceEdges[4 * cf];
+				ce[i]			= GetEdgeHalf(parent, ei, vi);
+				ce[(i + 1) & 3] = 2 * numEdges + 4 * f + i;
+				ce[(i + 2) & 3] = 2 * numEdges + 4 * f + ((i + 3) & 3);
+				ce[(i + 3) & 3] = GetEdgeHalf(parent, eprev, vi);
+
+				for (int k = 0; k < 4; ++k)
+				{
+					int* faces = &child.edgeFaces[2 * ce[k]];
+					faces[faces[0] < 0 ? 0 : 1] = cf;
+				}
+			}
+		}
+
+		child.vertexSharpness.resize(child.numVertices, 0.0f);
+		for (int v = 0; v < numVerts; ++v)
+			child.vertexSharpness[vertexChild[v]] = SubdivideSharpness(parent.vertexSharpness[v]);
+
+		BuildVertexRings(child);
+
+		std::vector<UINT> childU(4 * numFaces), childV(4 * numFaces), childPtex(4 * numFaces);
+		for (int f = 0; f < numFaces; ++f)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				childU[4 * f + i]	 = 2 * faceU[f] + (i == 1 || i == 2 ? 1 : 0);
+				childV[4 * f + i]	 = 2 * faceV[f] + (i == 2 || i == 3 ? 1 : 0);
+				childPtex[4 * f + i] = facePtex[f];
+			}
+		}
+
+		m_peakBytes = std::max(m_peakBytes, parent.GetBytes() + child.GetBytes() + 
+								VectorBytes(F_IT) + VectorBytes(E_IT) + VectorBytes(E_W) + VectorBytes(V_ITa) + VectorBytes(V_IT) + VectorBytes(V_W));
+
+		std::swap(parent, child);
+		faceU.swap(childU);
+		faceV.swap(childV);
+		facePtex.swap(childPtex);
+	}
+
+	vertsOffsets[maxLevel + 1] = vertexOffset;
+
+	return new FarMesh<OsdVertex>(subdivisionTables, patchTables, NULL, batches);
+}
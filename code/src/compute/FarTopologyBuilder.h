@@ -0,0 +1,63 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+
+#include <osd/vertex.h>
+#include <far/mesh.h>
+
+#include <vector>
+
+// builds the catmark subdivision tables, kernel batches and uniform patch tables of a quad cage directly from index arrays,
+// without the hbr half-edge mesh. every level is a flat quad mesh (face vertices, face edges, edge vertices/faces/sharpness)
+// with csr vertex rings, the next level is generated from it by index arithmetic.
+// the tables are the ones of FarMeshFactory (uniform, hbr k_InterpolateBoundaryEdgeOnly, normal crease rule): same vertex counts
+// per level and kernel type, same stencils and batches. only the order of the vertices inside one block differs, hbr numbers
+// them by creation order during its refinement, here they follow the parent faces/edges/vertices.
+// uniform refinement only: the adaptive tables the model loader needs (feature adaptive refinement, regular/boundary/corner/gregory
+// patches, fvar data) are not built here, PrepareOSDModel still goes through hbr. used by the --topo-bench comparison.
+class FarTopologyBuilder
+{
+public:
+	FarTopologyBuilder();
+
+	// quads of the control cage, all vertices have to be referenced
+	void	SetCage(UINT numVertices, const DirectX::XMUINT4* quads, UINT numQuads);
+	// semi-sharp or sharp edge between two cage vertices (hbr edge sharpness), applied by Create
+	void	AddCrease(UINT v0, UINT v1, float sharpness);
+	void	SetVertexSharpness(UINT vertex, float sharpness);
+
+	// uniformly refined far mesh, owned by the caller. NULL for non manifold cages and unknown creases
+	OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* Create(int maxLevel);
+
+	// highest sum of the topology levels and tables alive during the last Create
+	size_t	GetPeakBytes() const { return m_peakBytes; }
+
+protected:
+	struct Crease
+	{
+		UINT	v0, v1;
+		float	sharpness;
+	};
+
+	UINT								m_numVertices;
+	std::vector<int>					m_faceVertices;
+	std::vector<Crease>					m_creases;
+	std::vector<float>					m_vertexSharpness;
+	size_t								m_peakBytes;
+};
@@ -0,0 +1,629 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+#include "OsdCPUComputeController.h"
+
+#include "utils/WorkStealingPool.h"
+
+using namespace OpenSubdiv;
+
+// vertices per job, batches with fewer vertices run on the calling thread
+static const UINT REFINE_GRAIN_SIZE = 256;
+
+//--------------------------------------------------------------------------------------
+// context
+//--------------------------------------------------------------------------------------
+
+template<typename T>
+static const T* TablePtr(const std::vector<T>& table)
+{
+	return table.empty() ? NULL : &table[0];
+}
+
+OsdCPUComputeContext::OsdCPUComputeContext(FarSubdivisionTables const* subdivisionTables, FarVertexEditTables const* vertexEditTables)
+{
+	m_subdivisionTables = subdivisionTables;
+	m_vertexEditTables = vertexEditTables;
+
+	F_ITa	= TablePtr(subdivisionTables->Get_F_ITa());
+	F_IT	= TablePtr(subdivisionTables->Get_F_IT());
+	E_IT	= TablePtr(subdivisionTables->Get_E_IT());
+	E_W		= TablePtr(subdivisionTables->Get_E_W());
+	V_ITa	= TablePtr(subdivisionTables->Get_V_ITa());
+	V_IT	= TablePtr(subdivisionTables->Get_V_IT());
+	V_W		= TablePtr(subdivisionTables->Get_V_W());
+}
+
+OsdCPUComputeContext* OsdCPUComputeContext::Create(FarSubdivisionTables const* subdivisionTables, FarVertexEditTables const* vertexEditTables)
+{
+	if (!subdivisionTables) return NULL;
+	return new OsdCPUComputeContext(subdivisionTables, vertexEditTables);
+}
+
+//--------------------------------------------------------------------------------------
+// vertex buffer
+//--------------------------------------------------------------------------------------
+
+OsdCPUD3D11VertexBuffer::OsdCPUD3D11VertexBuffer(int numElements, int numVertices)
+{
+	m_numElements = numElements;
+	m_numVertices = numVertices;
+	m_buffer = NULL;
+	m_dirty = false;
+}
+
+OsdCPUD3D11VertexBuffer::~OsdCPUD3D11VertexBuffer()
+{
+	SAFE_RELEASE(m_buffer);
+}
+
+OsdCPUD3D11VertexBuffer* OsdCPUD3D11VertexBuffer::Create(int numElements, int numVertices, ID3D11Device1* device)
+{
+	OsdCPUD3D11VertexBuffer* instance = new OsdCPUD3D11VertexBuffer(numElements, numVertices);
+	if (instance->allocate(device)) return instance;
+
+	delete instance;
+	return NULL;
+}
+
+bool OsdCPUD3D11VertexBuffer::allocate(ID3D11Device1* device)
+{
+	m_cpuBuffer.resize(m_numElements * m_numVertices, 0.0f);
+	if (!device) return true;
+
+	// same layout as OsdD3D11VertexBuffer, the draw context creates its vertex srv on it
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.ByteWidth = m_numElements * m_numVertices * sizeof(float);
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = sizeof(float);
+
+	HRESULT hr = device->CreateBuffer(&bufferDesc, NULL, &m_buffer);
+	if (FAILED(hr))
+	{
+		std::cerr << "OsdCPUD3D11VertexBuffer: failed to create vertex buffer" << std::endl;
+		return false;
+	}
+	DXUT_SetDebugName(m_buffer, "OsdCPUD3D11VertexBuffer");
+	return true;
+}
+
+void OsdCPUD3D11VertexBuffer::UpdateData(const float* src, int startVertex, int numVertices, void* param)
+{
+	memcpy(&m_cpuBuffer[startVertex * m_numElements], src, numVertices * m_numElements * sizeof(float));
+	m_dirty = true;
+}
+
+float* OsdCPUD3D11VertexBuffer::BindCpuBuffer()
+{
+	m_dirty = true;
+	return m_cpuBuffer.empty() ? NULL : &m_cpuBuffer[0];
+}
+
+ID3D11Buffer* OsdCPUD3D11VertexBuffer::BindD3D11Buffer(ID3D11DeviceContext1* deviceContext)
+{
+	if (m_dirty && m_buffer && deviceContext)
+	{
+		deviceContext->UpdateSubresource(m_buffer, 0, NULL, &m_cpuBuffer[0], 0, 0);
+		m_dirty = false;
+	}
+	return m_buffer;
+}
+
+//--------------------------------------------------------------------------------------
+// kernels
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// everything a kernel needs for one batch, i is the vertex index relative to the batch start
+	struct RefineArgs
+	{
+		const OsdCPUComputeContext*	context;
+		float*						vertex;
+		float*						varying;
+		OsdVertexBufferDescriptor	vertexDesc;
+		OsdVertexBufferDescriptor	varyingDesc;
+		int							vertexOffset;
+		int							tableOffset;
+
+		__forceinline float* Vertex(int index) const	{ return vertex + index * vertexDesc.stride + vertexDesc.offset; }
+		__forceinline float* Varying(int index) const	{ return varying + index * varyingDesc.stride + varyingDesc.offset; }
+	};
+
+	// primvar operations, N > 0 fixes the number of components at compile time so the loops unroll and vectorize
+	template<int N>
+	struct Primvar
+	{
+		static __forceinline void Clear(float* __restrict dst, int length)
+		{
+			const int n = N > 0 ? N : length;
+			for (int k = 0; k < n; ++k) dst[k] = 0.0f;
+		}
+
+		static __forceinline void AddWithWeight(float* __restrict dst, const float* __restrict src, float weight, int length)
+		{
+			const int n = N > 0 ? N : length;
+			for (int k = 0; k < n; ++k) dst[k] += src[k] * weight;
+		}
+	};
+
+	// varying data is interpolated linearly with the generic primvar code
+	typedef Primvar<0> VaryingPrimvar;
+
+	// average of the face vertices, catmark and bilinear
+	template<int N>
+	struct FaceVertices
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int h = a.context->F_ITa[2 * t];
+				const int n = a.context->F_ITa[2 * t + 1];
+				const float weight = 1.0f / n;
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				for (int j = 0; j < n; ++j)
+					Primvar<N>::AddWithWeight(dst, a.Vertex(a.context->F_IT[h + j]), weight, len);
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					for (int j = 0; j < n; ++j)
+						VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(a.context->F_IT[h + j]), weight, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// quads and triangles with 4 indices each, triangles repeat the last index
+	template<int N, bool TRI_QUAD>
+	struct QuadFaceVerticesBase
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const unsigned int* fidx = &a.context->F_IT[a.tableOffset + 4 * i];
+				const bool triangle = TRI_QUAD && fidx[3] == fidx[2];
+				const int n = triangle ? 3 : 4;
+				const float weight = triangle ? 1.0f / 3.0f : 0.25f;
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				for (int j = 0; j < n; ++j)
+					Primvar<N>::AddWithWeight(dst, a.Vertex(fidx[j]), weight, len);
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					for (int j = 0; j < n; ++j)
+						VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(fidx[j]), weight, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+	template<int N> struct QuadFaceVertices		: QuadFaceVerticesBase<N, false> {};
+	template<int N> struct TriQuadFaceVertices	: QuadFaceVerticesBase<N, true> {};
+
+	// edge vertices with crease weights, catmark and loop
+	template<int N>
+	struct EdgeVertices
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int* eidx = &a.context->E_IT[4 * t];
+				const float vertWeight = a.context->E_W[2 * t];
+
+				// fully sharp edge : vertWeight = 0.5f
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[0]), vertWeight, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[1]), vertWeight, len);
+
+				if (eidx[2] != -1)
+				{
+					// fractional sharpness
+					const float faceWeight = a.context->E_W[2 * t + 1];
+					Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[2]), faceWeight, len);
+					Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[3]), faceWeight, len);
+				}
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(eidx[0]), 0.5f, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(eidx[1]), 0.5f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// bilinear edge vertices, two indices per edge
+	template<int N>
+	struct BilinearEdgeVertices
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int* eidx = &a.context->E_IT[2 * t];
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[0]), 0.5f, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(eidx[1]), 0.5f, len);
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(eidx[0]), 0.5f, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(eidx[1]), 0.5f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// bilinear vertex vertices are copies of the parent
+	template<int N>
+	struct BilinearVertexVertices
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int p = a.context->V_ITa[i + a.tableOffset];
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(p), 1.0f, len);
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(p), 1.0f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// k_Crease and k_Corner rules, catmark and loop. the second pass adds to the result of the B kernel (fractional sharpness)
+	template<int N, bool PASS>
+	struct VertexVerticesA
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int n		= a.context->V_ITa[5 * t + 1];	// valence
+				const int p		= a.context->V_ITa[5 * t + 2];	// parent vertex
+				const int eidx0 = a.context->V_ITa[5 * t + 3];	// crease rule edges
+				const int eidx1 = a.context->V_ITa[5 * t + 4];
+
+				float weight = PASS ? a.context->V_W[t] : 1.0f - a.context->V_W[t];
+
+				// fractional weights are shared with the smooth kernel and inverted
+				if (weight > 0.0f && weight < 1.0f && n > 0)
+					weight = 1.0f - weight;
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				if (!PASS)
+					Primvar<N>::Clear(dst, len);
+
+				// k_Corner / k_Crease combination is marked with valence -1
+				if (eidx0 == -1 || (!PASS && n == -1))
+				{
+					Primvar<N>::AddWithWeight(dst, a.Vertex(p), weight, len);
+				}
+				else
+				{
+					Primvar<N>::AddWithWeight(dst, a.Vertex(p), weight * 0.75f, len);
+					Primvar<N>::AddWithWeight(dst, a.Vertex(eidx0), weight * 0.125f, len);
+					Primvar<N>::AddWithWeight(dst, a.Vertex(eidx1), weight * 0.125f, len);
+				}
+
+				// varying is the parent value, only written once
+				if (a.varying && !PASS)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(p), 1.0f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+	template<int N> struct VertexVerticesA1 : VertexVerticesA<N, false> {};
+	template<int N> struct VertexVerticesA2 : VertexVerticesA<N, true> {};
+
+	// k_Smooth and k_Dart rules, catmark
+	template<int N>
+	struct CatmarkVertexVerticesB
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int h = a.context->V_ITa[5 * t];		// offset into V_IT
+				const int n = a.context->V_ITa[5 * t + 1];	// valence
+				const int p = a.context->V_ITa[5 * t + 2];	// parent vertex
+
+				const float weight = a.context->V_W[t];
+				const float wp = 1.0f / (n * n);
+				const float wv = (n - 2.0f) * n * wp;
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(p), weight * wv, len);
+
+				for (int j = 0; j < n; ++j)
+				{
+					Primvar<N>::AddWithWeight(dst, a.Vertex(a.context->V_IT[h + j * 2]), weight * wp, len);
+					Primvar<N>::AddWithWeight(dst, a.Vertex(a.context->V_IT[h + j * 2 + 1]), weight * wp, len);
+				}
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(p), 1.0f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// k_Smooth and k_Dart rules, loop
+	template<int N>
+	struct LoopVertexVerticesB
+	{
+		static void Run(const RefineArgs& a, int begin, int end)
+		{
+			const int len = a.vertexDesc.length;
+			for (int i = begin; i < end; ++i)
+			{
+				const int t = i + a.tableOffset;
+				const int h = a.context->V_ITa[5 * t];
+				const int n = a.context->V_ITa[5 * t + 1];
+				const int p = a.context->V_ITa[5 * t + 2];
+
+				const float weight = a.context->V_W[t];
+				const float wp = 1.0f / n;
+				float beta = 0.25f * cosf((float)M_PI * 2.0f * wp) + 0.375f;
+				beta = beta * beta;
+				beta = (0.625f - beta) * wp;
+
+				float* dst = a.Vertex(a.vertexOffset + i);
+				Primvar<N>::Clear(dst, len);
+				Primvar<N>::AddWithWeight(dst, a.Vertex(p), weight * (1.0f - (beta * n)), len);
+
+				for (int j = 0; j < n; ++j)
+					Primvar<N>::AddWithWeight(dst, a.Vertex(a.context->V_IT[h + j]), weight * beta, len);
+
+				if (a.varying)
+				{
+					float* dstVarying = a.Varying(a.vertexOffset + i);
+					VaryingPrimvar::Clear(dstVarying, a.varyingDesc.length);
+					VaryingPrimvar::AddWithWeight(dstVarying, a.Varying(p), 1.0f, a.varyingDesc.length);
+				}
+			}
+		}
+	};
+
+	// runs the kernel over the batch range, specialized for positions (3) and 4 component vertices
+	template<template<int> class KERNEL>
+	void RunKernel(const RefineArgs& args, int start, int end, bool parallel)
+	{
+		if (end <= start || (!args.vertex && !args.varying)) return;
+
+		void (*run)(const RefineArgs&, int, int);
+		switch (args.vertex ? args.vertexDesc.length : 0)
+		{
+		case 3:		run = &KERNEL<3>::Run;	break;
+		case 4:		run = &KERNEL<4>::Run;	break;
+		default:	run = &KERNEL<0>::Run;	break;
+		}
+
+		const UINT count = static_cast<UINT>(end - start);
+		if (!parallel || count <= REFINE_GRAIN_SIZE)
+		{
+			run(args, start, end);
+			return;
+		}
+
+		// vertices of one batch are independent
+		g_workStealingPool.ParallelFor(count, REFINE_GRAIN_SIZE, [&](UINT begin, UINT rangeEnd)
+		{
+			run(args, start + static_cast<int>(begin), start + static_cast<int>(rangeEnd));
+		});
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// controller
+//--------------------------------------------------------------------------------------
+
+OsdCPUComputeController::OsdCPUComputeController()
+{
+	m_parallel = true;
+}
+
+OsdCPUComputeController::~OsdCPUComputeController()
+{
+}
+
+#define OSD_CPU_KERNEL_ARGS(args, batch, context)					\
+	RefineArgs args;												\
+	args.context		= context;									\
+	args.vertex			= m_currentBindState.vertexBuffer;			\
+	args.varying		= m_currentBindState.varyingBuffer;			\
+	args.vertexDesc		= m_currentBindState.vertexDesc;			\
+	args.varyingDesc	= m_currentBindState.varyingDesc;			\
+	args.vertexOffset	= batch.GetVertexOffset();					\
+	args.tableOffset	= batch.GetTableOffset();
+
+void OsdCPUComputeController::ApplyBilinearFaceVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<FaceVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyBilinearEdgeVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<BilinearEdgeVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyBilinearVertexVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<BilinearVertexVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkFaceVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<FaceVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkQuadFaceVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<QuadFaceVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkTriQuadFaceVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<TriQuadFaceVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkEdgeVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<EdgeVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkVertexVerticesKernelB(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<CatmarkVertexVerticesB>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkVertexVerticesKernelA1(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<VertexVerticesA1>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyCatmarkVertexVerticesKernelA2(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<VertexVerticesA2>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyLoopEdgeVerticesKernel(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<EdgeVertices>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyLoopVertexVerticesKernelB(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<LoopVertexVerticesB>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyLoopVertexVerticesKernelA1(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<VertexVerticesA1>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyLoopVertexVerticesKernelA2(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	OSD_CPU_KERNEL_ARGS(args, batch, context);
+	RunKernel<VertexVerticesA2>(args, batch.GetStart(), batch.GetEnd(), m_parallel);
+}
+
+void OsdCPUComputeController::ApplyVertexEdits(FarKernelBatch const& batch, ComputeContext const* context) const
+{
+	assert(context);
+	if (!m_currentBindState.vertexBuffer || !context->GetVertexEditTables()) return;
+
+	const FarVertexEditTables::VertexEditBatch& edit = context->GetVertexEditTables()->GetBatch(batch.GetTableIndex());
+
+	const int primvarOffset = edit.GetPrimvarIndex();
+	const int primvarWidth	= edit.GetPrimvarWidth();
+	if (primvarOffset + primvarWidth > m_currentBindState.vertexDesc.length) return;
+
+	const unsigned int* vertexIndices	= &edit.GetVertexIndices()[batch.GetTableOffset()];
+	const float*		values			= &edit.GetValues()[batch.GetTableOffset() * primvarWidth];
+
+	const OsdVertexBufferDescriptor& desc = m_currentBindState.vertexDesc;
+
+	// serial, several edits of one batch can target the same vertex
+	for (int i = batch.GetStart(); i < batch.GetEnd(); ++i)
+	{
+		float* dst = m_currentBindState.vertexBuffer + (vertexIndices[i] + batch.GetVertexOffset()) * desc.stride + desc.offset + primvarOffset;
+		const float* src = &values[i * primvarWidth];
+
+		if (edit.GetOperation() == FarVertexEdit::Set)
+		{
+			for (int k = 0; k < primvarWidth; ++k) dst[k] = src[k];
+		}
+		else
+		{
+			// subtract edits are stored negated
+			for (int k = 0; k < primvarWidth; ++k) dst[k] += src[k];
+		}
+	}
+}
@@ -0,0 +1,195 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+
+#include <far/dispatcher.h>
+#include <far/subdivisionTables.h>
+#include <far/vertexEditTables.h>
+#include <osd/vertexDescriptor.h>
+#include <osd/nonCopyable.h>
+
+#include <vector>
+
+// cpu implementation of the opensubdiv refinement, drop-in for OsdD3D11ComputeController in OsdMesh<..., OsdD3D11DrawContext>.
+// the batches run in order, the vertices of one batch are split into ranges on the work stealing pool.
+
+// subdivision and vertex edit tables of a FarMesh, the tables are owned by the mesh
+class OsdCPUComputeContext : OpenSubdiv::OsdNonCopyable<OsdCPUComputeContext>
+{
+public:
+	static OsdCPUComputeContext* Create(OpenSubdiv::FarSubdivisionTables const* subdivisionTables, OpenSubdiv::FarVertexEditTables const* vertexEditTables);
+	virtual ~OsdCPUComputeContext() {}
+
+	OpenSubdiv::FarSubdivisionTables const*	GetSubdivisionTables()	const	{ return m_subdivisionTables; }
+	OpenSubdiv::FarVertexEditTables const*	GetVertexEditTables()	const	{ return m_vertexEditTables; }
+
+	// raw table pointers for the kernels, NULL for empty tables
+	const int*			F_ITa;
+	const unsigned int*	F_IT;
+	const int*			E_IT;
+	const float*		E_W;
+	const int*			V_ITa;
+	const unsigned int*	V_IT;
+	const float*		V_W;
+
+protected:
+	OsdCPUComputeContext(OpenSubdiv::FarSubdivisionTables const* subdivisionTables, OpenSubdiv::FarVertexEditTables const* vertexEditTables);
+
+	OpenSubdiv::FarSubdivisionTables const*	m_subdivisionTables;
+	OpenSubdiv::FarVertexEditTables const*	m_vertexEditTables;
+};
+
+// vertex data in system memory, mirrored to a d3d11 vertex buffer for drawing when a device is given
+class OsdCPUD3D11VertexBuffer
+{
+public:
+	// device can be NULL for cpu only buffers (validation, benchmarks)
+	static OsdCPUD3D11VertexBuffer* Create(int numElements, int numVertices, ID3D11Device1* device);
+	virtual ~OsdCPUD3D11VertexBuffer();
+
+	void	UpdateData(const float* src, int startVertex, int numVertices, void* param = NULL);
+
+	int		GetNumElements()	const	{ return m_numElements; }
+	int		GetNumVertices()	const	{ return m_numVertices; }
+
+	// cpu data, the d3d11 buffer is updated on the next BindD3D11Buffer
+	float*	BindCpuBuffer();
+
+	ID3D11Buffer* BindD3D11Buffer(ID3D11DeviceContext1* deviceContext);
+
+protected:
+	OsdCPUD3D11VertexBuffer(int numElements, int numVertices);
+	bool	allocate(ID3D11Device1* device);
+
+	int					m_numElements;
+	int					m_numVertices;
+	std::vector<float>	m_cpuBuffer;
+	ID3D11Buffer*		m_buffer;
+	bool				m_dirty;
+};
+
+class OsdCPUComputeController
+{
+public:
+	typedef OsdCPUComputeContext ComputeContext;
+
+	OsdCPUComputeController();
+	~OsdCPUComputeController();
+
+	template<class VERTEX_BUFFER, class VARYING_BUFFER>
+	void Refine(OsdCPUComputeContext const* context,
+				OpenSubdiv::FarKernelBatchVector const& batches,
+				VERTEX_BUFFER* vertexBuffer,
+				VARYING_BUFFER* varyingBuffer,
+				OpenSubdiv::OsdVertexBufferDescriptor const* vertexDesc = NULL,
+				OpenSubdiv::OsdVertexBufferDescriptor const* varyingDesc = NULL)
+	{
+		if (batches.empty()) return;
+
+		bind(vertexBuffer, varyingBuffer, vertexDesc, varyingDesc);
+
+		OpenSubdiv::FarDispatcher::Refine(this, context, batches, -1);
+
+		unbind();
+	}
+
+	template<class VERTEX_BUFFER>
+	void Refine(OsdCPUComputeContext const* context, OpenSubdiv::FarKernelBatchVector const& batches, VERTEX_BUFFER* vertexBuffer)
+	{
+		Refine(context, batches, vertexBuffer, (VERTEX_BUFFER*)NULL);
+	}
+
+	// kernels run synchronously
+	void Synchronize() {}
+
+	// single threaded refinement for benchmarks and validation
+	void SetParallel(bool parallel)	{ m_parallel = parallel; }
+	bool GetParallel() const		{ return m_parallel; }
+
+protected:
+	friend class OpenSubdiv::FarDispatcher;
+
+	void ApplyBilinearFaceVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyBilinearEdgeVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyBilinearVertexVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+
+	void ApplyCatmarkFaceVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkQuadFaceVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkTriQuadFaceVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkEdgeVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkVertexVerticesKernelB(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkVertexVerticesKernelA1(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyCatmarkVertexVerticesKernelA2(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+
+	void ApplyLoopEdgeVerticesKernel(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyLoopVertexVerticesKernelB(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyLoopVertexVerticesKernelA1(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+	void ApplyLoopVertexVerticesKernelA2(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+
+	void ApplyVertexEdits(OpenSubdiv::FarKernelBatch const& batch, ComputeContext const* context) const;
+
+	template<class VERTEX_BUFFER, class VARYING_BUFFER>
+	void bind(VERTEX_BUFFER* vertex, VARYING_BUFFER* varying,
+			  OpenSubdiv::OsdVertexBufferDescriptor const* vertexDesc,
+			  OpenSubdiv::OsdVertexBufferDescriptor const* varyingDesc)
+	{
+		// without descriptor the data is tightly packed in the buffer
+		if (vertexDesc)
+			m_currentBindState.vertexDesc = *vertexDesc;
+		else
+		{
+			int numElements = vertex ? vertex->GetNumElements() : 0;
+			m_currentBindState.vertexDesc = OpenSubdiv::OsdVertexBufferDescriptor(0, numElements, numElements);
+		}
+
+		if (varyingDesc)
+			m_currentBindState.varyingDesc = *varyingDesc;
+		else
+		{
+			int numElements = varying ? varying->GetNumElements() : 0;
+			m_currentBindState.varyingDesc = OpenSubdiv::OsdVertexBufferDescriptor(0, numElements, numElements);
+		}
+
+		m_currentBindState.vertexBuffer  = vertex  ? vertex->BindCpuBuffer()  : NULL;
+		m_currentBindState.varyingBuffer = varying ? varying->BindCpuBuffer() : NULL;
+	}
+
+	void unbind()
+	{
+		m_currentBindState.Reset();
+	}
+
+private:
+	struct BindState
+	{
+		BindState() : vertexBuffer(NULL), varyingBuffer(NULL) {}
+		void Reset()
+		{
+			vertexBuffer = varyingBuffer = NULL;
+			vertexDesc.Reset();
+			varyingDesc.Reset();
+		}
+		float*									vertexBuffer;
+		float*									varyingBuffer;
+		OpenSubdiv::OsdVertexBufferDescriptor	vertexDesc;
+		OpenSubdiv::OsdVertexBufferDescriptor	varyingDesc;
+	};
+
+	BindState	m_currentBindState;
+	bool		m_parallel;
+};
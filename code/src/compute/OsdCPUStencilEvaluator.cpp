@@ -0,0 +1,487 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+#include "OsdCPUStencilEvaluator.h"
+
+#include <far/dispatcher.h>
+#include <far/stencilTables.h>
+#include <far/stencilTablesFactory.h>
+#include <hbr/catmark.h>
+
+#include "utils/WorkStealingPool.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace OpenSubdiv;
+using namespace DirectX;
+
+// matrix blocks per job, BLOCK_ROWS output vertices each
+static const UINT STENCIL_GRAIN_BLOCKS = 128;
+
+//--------------------------------------------------------------------------------------
+// blocked csr matrix
+//--------------------------------------------------------------------------------------
+
+OsdCPUStencilMatrix::OsdCPUStencilMatrix()
+{
+	m_numRows = 0;
+	m_numChannels = 0;
+}
+
+void OsdCPUStencilMatrix::Create(const std::vector<int>& sizes, const std::vector<int>& offsets, const std::vector<int>& indices, bool reorder)
+{
+	Destroy();
+
+	m_numRows = static_cast<UINT>(sizes.size());
+	if (m_numRows == 0) return;
+
+	std::vector<UINT> order(m_numRows);
+	std::iota(order.begin(), order.end(), 0);
+
+	if (reorder)
+	{
+		// rows with the same first control vertex read the same neighborhood, sorting by it walks the control points
+		// roughly in memory order. ties are sorted by length so a block holds rows of equal size and needs no padding
+		std::vector<int> minIndex(m_numRows, 0);
+		for (UINT r = 0; r < m_numRows; ++r)
+		{
+			if (sizes[r] > 0)
+				minIndex[r] = *std::min_element(indices.begin() + offsets[r], indices.begin() + offsets[r] + sizes[r]);
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](UINT a, UINT b)
+		{
+			if (minIndex[a] != minIndex[b]) return minIndex[a] < minIndex[b];
+			return sizes[a] < sizes[b];
+		});
+	}
+
+	const UINT numBlocks = (m_numRows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+	m_blockStart.resize(numBlocks + 1);
+	m_blockRows.resize(numBlocks);
+
+	UINT numColumns = 0;
+	for (UINT b = 0; b < numBlocks; ++b)
+	{
+		m_blockStart[b] = numColumns;
+
+		int rows[BLOCK_ROWS];
+		int blockSize = 0;
+		for (UINT lane = 0; lane < BLOCK_ROWS; ++lane)
+		{
+			const UINT i = b * BLOCK_ROWS + lane;
+			rows[lane] = i < m_numRows ? static_cast<int>(order[i]) : -1;
+			if (rows[lane] >= 0) blockSize = std::max(blockSize, sizes[rows[lane]]);
+		}
+		m_blockRows[b] = XMINT4(rows[0], rows[1], rows[2], rows[3]);
+		numColumns += blockSize;
+	}
+	m_blockStart[numBlocks] = numColumns;
+
+	// padding entries read the first control vertex of the block row with zero weight
+	m_indices.assign(numColumns, XMUINT4(0, 0, 0, 0));
+	m_entrySlots.assign(indices.size(), 0);
+
+	std::vector<int> rowEntries;
+	for (UINT b = 0; b < numBlocks; ++b)
+	{
+		UINT* blockIndices = &m_indices[m_blockStart[b]].x;
+		const int* rows = &m_blockRows[b].x;
+		const UINT blockSize = m_blockStart[b + 1] - m_blockStart[b];
+
+		for (UINT lane = 0; lane < BLOCK_ROWS; ++lane)
+		{
+			if (rows[lane] < 0) continue;
+			const int offset = offsets[rows[lane]];
+			const int size = sizes[rows[lane]];
+
+			// entries in control vertex order
+			rowEntries.resize(size);
+			std::iota(rowEntries.begin(), rowEntries.end(), offset);
+			std::sort(rowEntries.begin(), rowEntries.end(), [&](int e0, int e1) { return indices[e0] < indices[e1]; });
+
+			for (UINT c = 0; c < blockSize; ++c)
+			{
+				const UINT slot = c * BLOCK_ROWS + lane;
+				if (c < static_cast<UINT>(size))
+				{
+					blockIndices[slot] = static_cast<UINT>(indices[rowEntries[c]]);
+					m_entrySlots[rowEntries[c]] = m_blockStart[b] * BLOCK_ROWS + slot;
+				}
+				else
+				{
+					blockIndices[slot] = size > 0 ? static_cast<UINT>(indices[rowEntries[0]]) : 0;
+				}
+			}
+		}
+	}
+}
+
+void OsdCPUStencilMatrix::Destroy()
+{
+	m_numRows = 0;
+	m_numChannels = 0;
+	m_blockStart.clear();
+	m_blockRows.clear();
+	m_indices.clear();
+	m_entrySlots.clear();
+	for (UINT i = 0; i < MAX_CHANNELS; ++i)
+		m_weights[i].clear();
+}
+
+void OsdCPUStencilMatrix::SetWeights(UINT channel, const std::vector<float>& weights)
+{
+	assert(channel < MAX_CHANNELS);
+	assert(weights.size() == m_entrySlots.size());
+
+	m_weights[channel].assign(m_indices.size(), XMFLOAT4A(0, 0, 0, 0));
+	if (m_indices.empty()) return;
+
+	float* blocked = &m_weights[channel][0].x;
+	for (size_t i = 0; i < weights.size(); ++i)
+		blocked[m_entrySlots[i]] = weights[i];
+
+	m_numChannels = std::max(m_numChannels, channel + 1);
+}
+
+static inline void StoreRow(float* dst, UINT dstStride, int row, FXMVECTOR value)
+{
+	if (row >= 0)
+		XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(dst + row * dstStride), value);
+}
+
+void OsdCPUStencilMatrix::ApplyBlocks(UINT channel, const XMFLOAT4A* controlPoints, float* dst, UINT dstStride, UINT blockBegin, UINT blockEnd) const
+{
+	const XMUINT4* indices = m_indices.empty() ? NULL : &m_indices[0];
+	const XMFLOAT4A* weights = m_weights[channel].empty() ? NULL : &m_weights[channel][0];
+
+	for (UINT b = blockBegin; b < blockEnd; ++b)
+	{
+		// one accumulator per block row, the four rows are independent chains
+		XMVECTOR acc0 = XMVectorZero();
+		XMVECTOR acc1 = XMVectorZero();
+		XMVECTOR acc2 = XMVectorZero();
+		XMVECTOR acc3 = XMVectorZero();
+
+		const UINT end = m_blockStart[b + 1];
+		for (UINT c = m_blockStart[b]; c < end; ++c)
+		{
+			const XMUINT4& index = indices[c];
+			const XMVECTOR w = XMLoadFloat4A(&weights[c]);
+			acc0 = XMVectorMultiplyAdd(XMVectorSplatX(w), XMLoadFloat4A(&controlPoints[index.x]), acc0);
+			acc1 = XMVectorMultiplyAdd(XMVectorSplatY(w), XMLoadFloat4A(&controlPoints[index.y]), acc1);
+			acc2 = XMVectorMultiplyAdd(XMVectorSplatZ(w), XMLoadFloat4A(&controlPoints[index.z]), acc2);
+			acc3 = XMVectorMultiplyAdd(XMVectorSplatW(w), XMLoadFloat4A(&controlPoints[index.w]), acc3);
+		}
+
+		const XMINT4& rows = m_blockRows[b];
+		StoreRow(dst, dstStride, rows.x, acc0);
+		StoreRow(dst, dstStride, rows.y, acc1);
+		StoreRow(dst, dstStride, rows.z, acc2);
+		StoreRow(dst, dstStride, rows.w, acc3);
+	}
+}
+
+void OsdCPUStencilMatrix::Apply(UINT channel, const XMFLOAT4A* controlPoints, float* dst, UINT dstStride, bool parallel) const
+{
+	if (channel >= m_numChannels) return;
+
+	const UINT numBlocks = static_cast<UINT>(m_blockRows.size());
+	if (!parallel || numBlocks <= STENCIL_GRAIN_BLOCKS)
+	{
+		ApplyBlocks(channel, controlPoints, dst, dstStride, 0, numBlocks);
+		return;
+	}
+
+	// blocks write disjoint rows
+	g_workStealingPool.ParallelFor(numBlocks, STENCIL_GRAIN_BLOCKS, [&](UINT begin, UINT end)
+	{
+		ApplyBlocks(channel, controlPoints, dst, dstStride, begin, end);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// stencil construction
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+
+// weights of a far vertex over the coarse vertices, sorted by control vertex.
+// the far kernels run on it like on any vertex type and accumulate the stencils level by level
+class StencilBuildVertex
+{
+public:
+	StencilBuildVertex()										{}
+	StencilBuildVertex(int /* index */)							{}
+
+	void SetControlVertex(int index)							{ entries.assign(1, std::make_pair(index, 1.0f)); }
+
+	void Clear(void* = 0)										{ entries.clear(); }
+
+	void AddWithWeight(const StencilBuildVertex& src, float weight, void* = 0)
+	{
+		if (weight == 0.0f || src.entries.empty()) return;
+
+		if (entries.empty())
+		{
+			entries = src.entries;
+			for (auto& e : entries) e.second *= weight;
+			return;
+		}
+
+		// merge of two sorted lists
+		std::vector<std::pair<int, float>> merged;
+		merged.reserve(entries.size() + src.entries.size());
+
+		auto a = entries.begin(), b = src.entries.begin();
+		while (a != entries.end() || b != src.entries.end())
+		{
+			if (b == src.entries.end() || (a != entries.end() && a->first < b->first))
+				merged.push_back(*a++);
+			else if (a == entries.end() || b->first < a->first)
+			{
+				merged.push_back(std::make_pair(b->first, b->second * weight));
+				++b;
+			}
+			else
+			{
+				merged.push_back(std::make_pair(a->first, a->second + b->second * weight));
+				++a;
+				++b;
+			}
+		}
+		entries.swap(merged);
+	}
+
+	void AddVaryingWithWeight(const StencilBuildVertex& /* src */, float /* weight */, void* = 0) {}
+
+	// meshes with edits are rejected before the build
+	void ApplyVertexEdit(const FarVertexEdit& /* edit */) {}
+
+	std::vector<std::pair<int, float>> entries;
+};
+
+// context of FarComputeController, the single threaded reference kernels
+class StencilBuildContext
+{
+public:
+	typedef StencilBuildVertex VertexType;
+
+	StencilBuildContext(FarSubdivisionTables const* subdivisionTables, int numVertices)
+		: m_subdivisionTables(subdivisionTables), m_vertices(numVertices) {}
+
+	std::vector<StencilBuildVertex>&	GetVertices()					{ return m_vertices; }
+	FarSubdivisionTables const*			GetSubdivisionTables()	const	{ return m_subdivisionTables; }
+	FarVertexEditTables const*			GetVertexEditTables()	const	{ return NULL; }
+
+private:
+	FarSubdivisionTables const*			m_subdivisionTables;
+	std::vector<StencilBuildVertex>		m_vertices;
+};
+
+typedef HbrMesh<FarStencilFactoryVertex>	StencilHbrMesh;
+
+}
+
+//--------------------------------------------------------------------------------------
+// evaluator
+//--------------------------------------------------------------------------------------
+
+OsdCPUStencilEvaluator::OsdCPUStencilEvaluator()
+{
+	m_numControlVertices = 0;
+	m_parallel = true;
+}
+
+OsdCPUStencilEvaluator::~OsdCPUStencilEvaluator()
+{
+	Destroy();
+}
+
+HRESULT OsdCPUStencilEvaluator::CreateRefinementStencils(const FarMesh<OsdVertex>* farMesh, int numCoarseVertices)
+{
+	Destroy();
+
+	if (!farMesh || !farMesh->GetSubdivisionTables() || numCoarseVertices <= 0)
+		return E_FAIL;
+
+	// edits are applied per level and are not linear in the control vertices (set operations)
+	FarVertexEditTables const* vertexEdits = farMesh->GetVertexEditTables();
+	if (vertexEdits && vertexEdits->GetNumBatches() > 0)
+	{
+		std::cerr << "stencil refinement: meshes with hierarchical edits are not supported" << std::endl;
+		return E_FAIL;
+	}
+
+	// the coarse vertices are the first vertices of the far mesh, in hbr order
+	const int numVertices = farMesh->GetNumVertices();
+	StencilBuildContext context(farMesh->GetSubdivisionTables(), numVertices);
+	for (int i = 0; i < numCoarseVertices; ++i)
+		context.GetVertices()[i].SetControlVertex(i);
+
+	FarComputeController controller;
+	FarDispatcher::Refine(&controller, &context, farMesh->GetKernelBatches(), -1);
+
+	// flatten to FarStencilTables layout
+	std::vector<int>	sizes(numVertices);
+	std::vector<int>	offsets(numVertices);
+	std::vector<int>	indices;
+	std::vector<float>	weights;
+	for (int i = 0; i < numVertices; ++i)
+	{
+		std::vector<std::pair<int, float>>& entries = context.GetVertices()[i].entries;
+		offsets[i] = static_cast<int>(indices.size());
+		sizes[i] = static_cast<int>(entries.size());
+		for (const auto& e : entries)
+		{
+			indices.push_back(e.first);
+			weights.push_back(e.second);
+		}
+		std::vector<std::pair<int, float>>().swap(entries);
+	}
+
+	m_matrix.Create(sizes, offsets, indices, true);
+	m_matrix.SetWeights(VALUES, weights);
+	m_numControlVertices = static_cast<UINT>(numCoarseVertices);
+	return S_OK;
+}
+
+HRESULT OsdCPUStencilEvaluator::CreateLimitStencils(const HbrMesh<OsdVertex>* hbrMesh, int numCoarseVertices, UINT samplesPerEdge, int isolationLevel)
+{
+	Destroy();
+
+	if (!hbrMesh || numCoarseVertices <= 0 || samplesPerEdge == 0)
+		return E_FAIL;
+
+	if (dynamic_cast<const HbrCatmarkSubdivision<OsdVertex>*>(hbrMesh->GetSubdivision()) == NULL)
+	{
+		std::cerr << "stencil refinement: limit stencils are only available for catmark meshes" << std::endl;
+		return E_FAIL;
+	}
+
+	// the stencil factory needs its own vertex type and refines (and unrefines) the mesh, it runs on a copy of the coarse topology
+	HbrCatmarkSubdivision<FarStencilFactoryVertex> catmark;
+	StencilHbrMesh* stencilMesh = new StencilHbrMesh(&catmark);
+
+	for (int i = 0; i < numCoarseVertices; ++i)
+	{
+		HbrVertex<FarStencilFactoryVertex>* v = stencilMesh->NewVertex(i, FarStencilFactoryVertex());
+		v->SetSharpness(hbrMesh->GetVertex(i)->GetSharpness());
+	}
+
+	const int numFaces = hbrMesh->GetNumCoarseFaces();
+	std::vector<int> faceIndices;
+	for (int f = 0; f < numFaces; ++f)
+	{
+		const HbrFace<OsdVertex>* face = hbrMesh->GetFace(f);
+		const int nv = face->GetNumVertices();
+
+		faceIndices.resize(nv);
+		for (int j = 0; j < nv; ++j)
+			faceIndices[j] = face->GetVertex(j)->GetID();
+
+		HbrFace<FarStencilFactoryVertex>* stencilFace = stencilMesh->NewFace(nv, &faceIndices[0], 0);
+		stencilFace->SetPtexIndex(face->GetPtexIndex());
+	}
+
+	for (int f = 0; f < numFaces; ++f)
+	{
+		const HbrFace<OsdVertex>* face = hbrMesh->GetFace(f);
+		for (int j = 0; j < face->GetNumVertices(); ++j)
+		{
+			const HbrHalfedge<OsdVertex>* edge = face->GetEdge(j);
+			if (edge->GetSharpness() <= HbrHalfedge<OsdVertex>::k_Smooth) continue;
+
+			HbrHalfedge<FarStencilFactoryVertex>* stencilEdge = stencilMesh->GetVertex(edge->GetOrgVertexID())->GetEdge(edge->GetDestVertexID());
+			if (stencilEdge) stencilEdge->SetSharpness(edge->GetSharpness());
+		}
+	}
+
+	stencilMesh->SetInterpolateBoundaryMethod(static_cast<StencilHbrMesh::InterpolateBoundaryMethod>(static_cast<int>(hbrMesh->GetInterpolateBoundaryMethod())));
+	stencilMesh->Finish();
+
+	// sample locations at the center of a samplesPerEdge^2 grid
+	const UINT numSamples = samplesPerEdge * samplesPerEdge;
+	std::vector<float> u(numSamples), v(numSamples);
+	for (UINT i = 0; i < numSamples; ++i)
+	{
+		u[i] = ((i % samplesPerEdge) + 0.5f) / samplesPerEdge;
+		v[i] = ((i / samplesPerEdge) + 0.5f) / samplesPerEdge;
+	}
+
+	FarStencilTables tables;
+	{
+		FarStencilTablesFactory<> factory(stencilMesh);
+		for (int f = 0; f < numFaces; ++f)
+		{
+			const int nv = stencilMesh->GetFace(f)->GetNumVertices();
+			const int numQuadrants = nv == 4 ? 1 : nv;
+			for (int q = 0; q < numQuadrants; ++q)
+			{
+				if (factory.SetCurrentFace(f, q))
+					factory.AppendStencils(&tables, numSamples, &u[0], &v[0], isolationLevel);
+			}
+		}
+	}
+	delete stencilMesh;
+
+	if (tables.GetNumStencils() == 0)
+		return E_FAIL;
+
+	m_matrix.Create(tables.GetSizes(), tables.GetOffsets(), tables.GetControlIndices(), true);
+	m_matrix.SetWeights(VALUES,  tables.GetWeights());
+	m_matrix.SetWeights(UDERIVS, tables.GetDuWeights());
+	m_matrix.SetWeights(VDERIVS, tables.GetDvWeights());
+	m_numControlVertices = static_cast<UINT>(numCoarseVertices);
+	return S_OK;
+}
+
+void OsdCPUStencilEvaluator::Destroy()
+{
+	m_matrix.Destroy();
+	m_controlPoints.clear();
+	m_numControlVertices = 0;
+}
+
+void OsdCPUStencilEvaluator::LoadControlPoints(const float* controlValues, UINT controlStride)
+{
+	// padded to float4 so every matrix entry is one aligned load
+	m_controlPoints.resize(m_numControlVertices);
+	for (UINT i = 0; i < m_numControlVertices; ++i)
+	{
+		const float* src = controlValues + i * controlStride;
+		m_controlPoints[i] = XMFLOAT4A(src[0], src[1], src[2], 0.0f);
+	}
+}
+
+void OsdCPUStencilEvaluator::UpdateValues(const float* controlValues, UINT controlStride, float* values, UINT valueStride)
+{
+	if (GetNumStencils() == 0) return;
+
+	LoadControlPoints(controlValues, controlStride);
+	m_matrix.Apply(VALUES, &m_controlPoints[0], values, valueStride, m_parallel);
+}
+
+void OsdCPUStencilEvaluator::UpdateDerivs(const float* controlValues, UINT controlStride, float* uderivs, float* vderivs, UINT stride)
+{
+	if (!HasDerivs()) return;
+
+	LoadControlPoints(controlValues, controlStride);
+	m_matrix.Apply(UDERIVS, &m_controlPoints[0], uderivs, stride, m_parallel);
+	m_matrix.Apply(VDERIVS, &m_controlPoints[0], vderivs, stride, m_parallel);
+}
@@ -0,0 +1,110 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+
+#include <osd/vertex.h>
+#include <far/mesh.h>
+#include <hbr/mesh.h>
+
+#include <vector>
+
+// stencil evaluation as sparse matrix vector product: every output vertex is a fixed linear combination of the coarse control vertices,
+// so animated cages skip the per level kernel batches and only run one pass over the stencil weights per frame.
+
+// stencils as blocked csr matrix. rows are grouped in blocks of BLOCK_ROWS and padded to the longest row of the block,
+// the entries of a block are interleaved by column, one column of a block is a single simd load of weights.
+// a matrix has up to MAX_CHANNELS weight sets on the same sparsity pattern (limit position, du, dv).
+class OsdCPUStencilMatrix
+{
+public:
+	static const UINT BLOCK_ROWS	= 4;
+	static const UINT MAX_CHANNELS	= 3;
+
+	OsdCPUStencilMatrix();
+
+	// rows in FarStencilTables layout (entry count and offset per row), reorder sorts the rows by the control vertices they read
+	void Create(const std::vector<int>& sizes, const std::vector<int>& offsets, const std::vector<int>& indices, bool reorder);
+	void Destroy();
+
+	// weights in the entry order of the indices passed to Create
+	void SetWeights(UINT channel, const std::vector<float>& weights);
+
+	// dst[row * dstStride + 0..2] = sum(weight * controlPoints[index].xyz)
+	void Apply(UINT channel, const DirectX::XMFLOAT4A* controlPoints, float* dst, UINT dstStride, bool parallel) const;
+
+	UINT	GetNumRows()			const	{ return m_numRows; }
+	UINT	GetNumNonZeros()		const	{ return static_cast<UINT>(m_entrySlots.size()); }
+	UINT	GetNumStoredEntries()	const	{ return static_cast<UINT>(m_indices.size()) * BLOCK_ROWS; }	// including padding
+	UINT	GetNumChannels()		const	{ return m_numChannels; }
+
+protected:
+	void	ApplyBlocks(UINT channel, const DirectX::XMFLOAT4A* controlPoints, float* dst, UINT dstStride, UINT blockBegin, UINT blockEnd) const;
+
+	UINT								m_numRows;
+	UINT								m_numChannels;
+	std::vector<UINT>					m_blockStart;	// first column of each block, numBlocks + 1 entries
+	std::vector<DirectX::XMINT4>		m_blockRows;	// destination row of the block rows, -1 for padding
+	std::vector<DirectX::XMUINT4>		m_indices;		// control vertex of the block rows per column
+	std::vector<DirectX::XMFLOAT4A>		m_weights[MAX_CHANNELS];
+	std::vector<UINT>					m_entrySlots;	// input entry -> float slot in the blocked weights
+};
+
+// refinement or limit stencils of one subd mesh with the scratch control points
+class OsdCPUStencilEvaluator
+{
+public:
+	enum Channel
+	{
+		VALUES	= 0,
+		UDERIVS = 1,
+		VDERIVS = 2
+	};
+
+	OsdCPUStencilEvaluator();
+	~OsdCPUStencilEvaluator();
+
+	// one stencil per vertex of the far mesh (the coarse vertices are identity rows), same vertex order as the kernel batches.
+	// fails for meshes with hierarchical edits
+	HRESULT CreateRefinementStencils(const OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* farMesh, int numCoarseVertices);
+
+	// limit positions and tangents at samplesPerEdge x samplesPerEdge locations of every coarse face, non quads are sampled per quadrant.
+	// built with FarStencilTablesFactory on a copy of the coarse topology (catmark only)
+	HRESULT CreateLimitStencils(const OpenSubdiv::HbrMesh<OpenSubdiv::OsdVertex>* hbrMesh, int numCoarseVertices, UINT samplesPerEdge, int isolationLevel);
+	void	Destroy();
+
+	// control values are xyz with the given stride in floats
+	void	UpdateValues(const float* controlValues, UINT controlStride, float* values, UINT valueStride);
+	void	UpdateDerivs(const float* controlValues, UINT controlStride, float* uderivs, float* vderivs, UINT stride);
+
+	UINT	GetNumStencils()			const	{ return m_matrix.GetNumRows(); }
+	UINT	GetNumControlVertices()		const	{ return m_numControlVertices; }
+	bool	HasDerivs()					const	{ return m_matrix.GetNumChannels() == OsdCPUStencilMatrix::MAX_CHANNELS; }
+	const OsdCPUStencilMatrix& GetMatrix() const	{ return m_matrix; }
+
+	void	SetParallel(bool parallel)			{ m_parallel = parallel; }
+	bool	GetParallel()				const	{ return m_parallel; }
+
+protected:
+	void	LoadControlPoints(const float* controlValues, UINT controlStride);
+
+	OsdCPUStencilMatrix					m_matrix;
+	std::vector<DirectX::XMFLOAT4A>		m_controlPoints;
+	UINT								m_numControlVertices;
+	bool								m_parallel;
+};
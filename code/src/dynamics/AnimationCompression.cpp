@@ -0,0 +1,292 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "dynamics/AnimationCompression.h"
+
+#include <algorithm>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+using namespace DirectX;
+
+namespace SkinningAnimationClasses {
+
+static const float SMALLEST_THREE_RANGE = 0.70710678f;	// the three smaller components of a unit quaternion are within +-1/sqrt(2)
+static const float SMALLEST_THREE_STEPS = 32767.0f;		// 15 bits per component
+static const float RANGE_STEPS			= 65535.0f;
+
+namespace
+{
+
+const KeyTrack& GetTrack(const NodeAnimation& nodeAnimation, UINT type)
+{
+	if (type == CompressedAnimationClip::ROTATION)		return nodeAnimation.GetRotations();
+	if (type == CompressedAnimationClip::TRANSLATION)	return nodeAnimation.GetTranslations();
+	return nodeAnimation.GetScalings();
+}
+
+float KeyError(FXMVECTOR a, FXMVECTOR b, bool rotation)
+{
+	if (rotation)
+		return CompressedAnimationClip::RotationError(a, b);
+	return XMVectorGetX(XMVector3Length(XMVectorSubtract(a, b)));
+}
+
+// largest error of the keys between first and last against the interpolation of first and last
+float SpanError(const KeyTrack& track, UINT first, UINT last, bool rotation)
+{
+	const float delta = track.times[last] - track.times[first];
+	if (delta <= 0.0f) return FLT_MAX;
+
+	const XMVECTOR a = track.GetValue(first);
+	const XMVECTOR b = track.GetValue(last);
+	float error = 0.0f;
+	for (UINT k = first + 1; k < last; ++k)
+	{
+		const float x = (track.times[k] - track.times[first]) / delta;
+		const XMVECTOR value = rotation ? XMQuaternionSlerp(a, b, x) : XMVectorLerp(a, b, x);
+		error = std::max(error, KeyError(value, track.GetValue(k), rotation));
+	}
+	return error;
+}
+
+// greedy key reduction: extends the span from the last kept key as long as its interpolation reproduces the keys in between.
+// first and last key are kept, a constant track is reduced to its first key.
+void ReduceKeys(const KeyTrack& track, bool rotation, float tolerance, UINT maxSpan, std::vector<UINT>& kept)
+{
+	kept.clear();
+	const UINT numKeys = (UINT)track.size();
+	if (numKeys == 0) return;
+
+	kept.push_back(0);
+	for (UINT anchor = 0; anchor + 1 < numKeys; )
+	{
+		UINT last = anchor + 1;
+		while (last + 1 < numKeys && last + 1 - anchor <= maxSpan && SpanError(track, anchor, last + 1, rotation) <= tolerance)
+			++last;
+		kept.push_back(last);
+		anchor = last;
+	}
+
+	if (kept.size() == 2 && KeyError(track.GetValue(0), track.GetValue(numKeys - 1), rotation) <= tolerance)
+		kept.pop_back();
+}
+
+}
+
+HRESULT CompressedAnimationClip::Create(const Animation& animation, const AnimationCompressionSettings& settings)
+{
+	m_numChannels = animation.getNumChannels();
+	m_numKeys = 0;
+	m_numSourceKeys = 0;
+
+	// the translation tolerance scales with the size of the skeleton
+	XMVECTOR translationMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR translationMax = XMVectorReplicate(-FLT_MAX);
+	for (UINT c = 0; c < m_numChannels; ++c)
+	{
+		const NodeAnimation* nodeAnimation = animation.getChannel(c);
+		if (nodeAnimation == NULL) continue;
+		for (size_t k = 0; k < nodeAnimation->GetNumTranslations(); ++k)
+		{
+			translationMin = XMVectorMin(translationMin, nodeAnimation->GetTranslations().GetValue(k));
+			translationMax = XMVectorMax(translationMax, nodeAnimation->GetTranslations().GetValue(k));
+		}
+	}
+	XMFLOAT3 translationRange(0.0f, 0.0f, 0.0f);
+	if (XMVector3LessOrEqual(translationMin, translationMax))
+		XMStoreFloat3(&translationRange, XMVectorSubtract(translationMax, translationMin));
+	m_translationTolerance = settings.translationTolerance * std::max(translationRange.x, std::max(translationRange.y, translationRange.z));
+
+	const float tolerances[NUM_TRACK_TYPES] = { settings.rotationTolerance, m_translationTolerance, settings.scalingTolerance };
+
+	// kept keys and layout
+	const UINT numTracks = m_numChannels * NUM_TRACK_TYPES;
+	std::vector<TrackHeader> headers(numTracks);
+	std::vector<std::vector<UINT>> kept(numTracks);
+	size_t numBytes = numTracks * sizeof(TrackHeader);
+	for (UINT c = 0; c < m_numChannels; ++c)
+	{
+		const NodeAnimation* nodeAnimation = animation.getChannel(c);
+		for (UINT type = 0; type < NUM_TRACK_TYPES; ++type)
+		{
+			const UINT index = c * NUM_TRACK_TYPES + type;
+			TrackHeader& header = headers[index];
+			if (nodeAnimation)
+			{
+				const KeyTrack& track = GetTrack(*nodeAnimation, type);
+				ReduceKeys(track, type == ROTATION, tolerances[type], std::max(settings.maxKeySpan, 1u), kept[index]);
+				m_numSourceKeys += (UINT)track.size();
+			}
+			header.numKeys		= (UINT)kept[index].size();
+			header.timesOffset	= (UINT)numBytes;
+			numBytes += header.numKeys * sizeof(float);
+			header.valuesOffset	= (UINT)numBytes;
+			numBytes += (header.numKeys * 3 * sizeof(UINT16) + 3) & ~3;
+			m_numKeys += header.numKeys;
+		}
+	}
+	if (numBytes > UINT_MAX) return E_INVALIDARG;
+
+	m_blob.assign(numBytes, 0);
+	for (UINT c = 0; c < m_numChannels; ++c)
+	{
+		const NodeAnimation* nodeAnimation = animation.getChannel(c);
+		if (nodeAnimation == NULL) continue;
+		for (UINT type = 0; type < NUM_TRACK_TYPES; ++type)
+		{
+			const UINT index = c * NUM_TRACK_TYPES + type;
+			TrackHeader& header = headers[index];
+			const KeyTrack& track = GetTrack(*nodeAnimation, type);
+			const std::vector<UINT>& keys = kept[index];
+
+			float* times = reinterpret_cast<float*>(&m_blob[header.timesOffset]);
+			UINT16* values = reinterpret_cast<UINT16*>(&m_blob[header.valuesOffset]);
+
+			XMVECTOR rangeMin = XMVectorReplicate(FLT_MAX);
+			XMVECTOR rangeMax = XMVectorReplicate(-FLT_MAX);
+			for (UINT k = 0; k < header.numKeys; ++k)
+			{
+				rangeMin = XMVectorMin(rangeMin, track.GetValue(keys[k]));
+				rangeMax = XMVectorMax(rangeMax, track.GetValue(keys[k]));
+			}
+			const XMVECTOR rangeStep = XMVectorScale(XMVectorSubtract(rangeMax, rangeMin), 1.0f / RANGE_STEPS);
+			const XMVECTOR invStep = XMVectorSelect(XMVectorReciprocal(rangeStep), XMVectorZero(), XMVectorEqual(rangeStep, XMVectorZero()));
+			XMStoreFloat3(&header.rangeMin, rangeMin);
+			XMStoreFloat3(&header.rangeStep, rangeStep);
+
+			for (UINT k = 0; k < header.numKeys; ++k)
+			{
+				const XMVECTOR value = track.GetValue(keys[k]);
+				times[k] = track.times[keys[k]];
+				if (type == ROTATION)
+				{
+					EncodeRotation(value, &values[k * 3]);
+				}
+				else
+				{
+					XMFLOAT3 q;
+					XMStoreFloat3(&q, XMVectorClamp(XMVectorRound(XMVectorMultiply(XMVectorSubtract(value, rangeMin), invStep)), XMVectorZero(), XMVectorReplicate(RANGE_STEPS)));
+					values[k * 3 + 0] = (UINT16)q.x;
+					values[k * 3 + 1] = (UINT16)q.y;
+					values[k * 3 + 2] = (UINT16)q.z;
+				}
+			}
+		}
+	}
+	if (numTracks > 0)
+		memcpy(m_blob.data(), headers.data(), numTracks * sizeof(TrackHeader));
+
+	return S_OK;
+}
+
+float CompressedAnimationClip::RotationError(FXMVECTOR a, FXMVECTOR b)
+{
+	// the chord between the unit quaternions is 2 sin(angle / 4), unlike acos of the dot product this is accurate for small angles
+	const float chord = std::min(XMVectorGetX(XMVector4Length(XMVectorSubtract(a, b))), XMVectorGetX(XMVector4Length(XMVectorAdd(a, b))));
+	return 4.0f * asinf(std::min(0.5f * chord, 1.0f));
+}
+
+size_t CompressedAnimationClip::GetRawBytes(const Animation& animation)
+{
+	size_t numKeys = 0;
+	for (UINT c = 0; c < animation.getNumChannels(); ++c)
+	{
+		const NodeAnimation* nodeAnimation = animation.getChannel(c);
+		if (nodeAnimation)
+			numKeys += nodeAnimation->GetNumRotations() + nodeAnimation->GetNumTranslations() + nodeAnimation->GetNumScalings();
+	}
+	return numKeys * (sizeof(float) + sizeof(XMFLOAT4A));
+}
+
+void CompressedAnimationClip::EncodeRotation(FXMVECTOR rotation, UINT16 packed[3])
+{
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, XMQuaternionNormalize(rotation));
+	const float c[4] = { q.x, q.y, q.z, q.w };
+
+	// drop the largest component, q and -q are the same rotation so it is positive
+	UINT largest = 0;
+	for (UINT i = 1; i < 4; ++i)
+		if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
+	const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+	UINT u[3];
+	for (UINT i = 0, k = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		const float v = (c[i] * sign / SMALLEST_THREE_RANGE) * 0.5f + 0.5f;
+		u[k++] = (UINT)std::min(std::max(v * SMALLEST_THREE_STEPS + 0.5f, 0.0f), SMALLEST_THREE_STEPS);
+	}
+
+	// 15 bits per component, the index of the largest one in the low bits of the first two
+	packed[0] = (UINT16)((u[0] << 1) | (largest & 1));
+	packed[1] = (UINT16)((u[1] << 1) | (largest >> 1));
+	packed[2] = (UINT16)(u[2] << 1);
+}
+
+XMVECTOR CompressedAnimationClip::DecodeRotation(const UINT16 packed[3])
+{
+	const UINT largest = (packed[0] & 1) | ((packed[1] & 1) << 1);
+
+	float v[3];
+	float sum = 0.0f;
+	for (UINT k = 0; k < 3; ++k)
+	{
+		v[k] = ((packed[k] >> 1) * (2.0f / SMALLEST_THREE_STEPS) - 1.0f) * SMALLEST_THREE_RANGE;
+		sum += v[k] * v[k];
+	}
+
+	float c[4];
+	for (UINT i = 0, k = 0; i < 4; ++i)
+		c[i] = i == largest ? sqrtf(std::max(1.0f - sum, 0.0f)) : v[k++];
+	return XMVectorSet(c[0], c[1], c[2], c[3]);
+}
+
+XMVECTOR CompressedAnimationClip::DecodeKey(const TrackHeader& header, TrackType type, UINT key) const
+{
+	const UINT16* values = reinterpret_cast<const UINT16*>(&m_blob[header.valuesOffset]) + key * 3;
+	if (type == ROTATION)
+		return DecodeRotation(values);
+
+	// w = 1 like the imported keys
+	const XMVECTOR q = XMVectorSet((float)values[0], (float)values[1], (float)values[2], 0.0f);
+	return XMVectorSetW(XMVectorMultiplyAdd(q, XMLoadFloat3(&header.rangeStep), XMLoadFloat3(&header.rangeMin)), 1.0f);
+}
+
+XMVECTOR CompressedAnimationClip::Sample(UINT channel, TrackType type, float t, UINT& cursor) const
+{
+	const TrackHeader& header = GetHeader(channel, type);
+	if (header.numKeys == 0)
+		return type == SCALING ? g_XMOne : g_XMIdentityR3;
+	if (header.numKeys == 1)
+		return DecodeKey(header, type, 0);
+
+	const float* times = reinterpret_cast<const float*>(&m_blob[header.timesOffset]);
+	const UINT i = SkinningMeshAnimationManager::findKey(times, header.numKeys, t, cursor);
+	const UINT j = (i+1) % header.numKeys;
+
+	float delta = (float)fabs(times[j] - times[i]);
+	float x = (t - times[i]) / delta;
+
+	if (type == ROTATION)
+		return XMQuaternionSlerp(DecodeKey(header, type, i), DecodeKey(header, type, j), x);
+	return XMVectorLerp(DecodeKey(header, type, i), DecodeKey(header, type, j), x);
+}
+
+} // SkinningAnimationClasses
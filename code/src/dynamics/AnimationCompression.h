@@ -0,0 +1,87 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "dynamics/SkinningAnimation.h"
+
+namespace SkinningAnimationClasses {
+
+struct AnimationCompressionSettings
+{
+	AnimationCompressionSettings() : rotationTolerance(1e-3f), translationTolerance(1e-4f), scalingTolerance(1e-4f), maxKeySpan(256) {}
+
+	float	rotationTolerance;		// radians, largest angle between a removed key and the interpolation of the kept keys
+	float	translationTolerance;	// relative to the largest translation range of the clip
+	float	scalingTolerance;
+	UINT	maxKeySpan;				// at most maxKeySpan-1 removed keys in a row, bounds the compression time
+};
+
+// animation clip in one contiguous blob: a header per track (channel * NUM_TRACK_TYPES + type), then times and values of the kept
+// keys per track. times are floats, rotations smallest three quaternions in 48 bits, translations and scalings 16 bits per
+// component in the range of their track.
+class CompressedAnimationClip
+{
+public:
+	enum TrackType { ROTATION = 0, TRANSLATION = 1, SCALING = 2, NUM_TRACK_TYPES = 3 };
+
+	CompressedAnimationClip() : m_numChannels(0), m_numKeys(0), m_numSourceKeys(0), m_translationTolerance(0.0f) {}
+
+	// removes the keys the interpolation reproduces within the tolerances and quantises the others. empty channels get empty tracks.
+	HRESULT Create(const Animation& animation, const AnimationCompressionSettings& settings);
+
+	// interpolated value of a track, same key search and interpolation as SkinningMeshAnimationManager::sampleTrack
+	XMVECTOR Sample(UINT channel, TrackType type, float t, UINT& cursor) const;
+
+	UINT	GetNumChannels()			const	{	return m_numChannels;			}
+	UINT	GetNumKeys()				const	{	return m_numKeys;				}
+	UINT	GetNumSourceKeys()			const	{	return m_numSourceKeys;			}
+	size_t	GetNumBytes()				const	{	return m_blob.size();			}
+	float	GetTranslationTolerance()	const	{	return m_translationTolerance;	}	// absolute
+
+	// memory of the uncompressed keys, times and values
+	static size_t	GetRawBytes(const Animation& animation);
+
+	// angle in radians between two rotations given as unit quaternions
+	static float	RotationError(FXMVECTOR a, FXMVECTOR b);
+
+	static void		EncodeRotation(FXMVECTOR rotation, UINT16 packed[3]);
+	static XMVECTOR	DecodeRotation(const UINT16 packed[3]);
+
+protected:
+	struct TrackHeader
+	{
+		UINT		numKeys;
+		UINT		timesOffset;	// byte offsets into the blob
+		UINT		valuesOffset;
+		XMFLOAT3	rangeMin;		// translations and scalings
+		XMFLOAT3	rangeStep;		// range / 65535
+	};
+
+	const TrackHeader&	GetHeader(UINT channel, TrackType type) const	{	return reinterpret_cast<const TrackHeader*>(m_blob.data())[channel * NUM_TRACK_TYPES + type];	}
+	XMVECTOR			DecodeKey(const TrackHeader& header, TrackType type, UINT key) const;
+
+	std::vector<BYTE>	m_blob;
+	UINT				m_numChannels;
+	UINT				m_numKeys;
+	UINT				m_numSourceKeys;
+	float				m_translationTolerance;
+};
+
+} // SkinningAnimationClasses
@@ -17,6 +17,7 @@
 
 #include "scene/ModelInstance.h"
 #include "SkinningAnimation.h"
+#include "AnimationLOD.h"
 
 // class to manage animated models
 class AnimationGroup : public ModelGroup
@@ -28,10 +29,13 @@ public:
 	SkinningAnimationClasses::SkinningMeshAnimationManager* GetAnimationManager() { return m_skinningMgr; }
 	const SkinningAnimationClasses::SkinningMeshAnimationManager* GetAnimationManager() const { return m_skinningMgr; }
 	int GetCurrentAnimation() const {return currAnimation;}
+	AnimationLODState& GetLODState() { return m_lodState; }
+	const AnimationLODState& GetLODState() const { return m_lodState; }
 
 protected:	
 	SkinningAnimationClasses::SkinningMeshAnimationManager* m_skinningMgr;
 	std::vector<std::string> m_animNames;
 	int currAnimation;
 	int queuedAnimation;	
+	AnimationLODState m_lodState;
 };
\ No newline at end of file
@@ -0,0 +1,227 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "dynamics/AnimationLOD.h"
+#include "dynamics/AnimationGroup.h"
+#include "dynamics/SkinningAnimation.h"
+#include "scene/DXModel.h"
+#include "scene/ModelInstance.h"
+#include "utils/Timer.h"
+
+#include <algorithm>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+using namespace DirectX;
+using namespace SkinningAnimationClasses;
+
+static const UINT	LOD_DISPATCHES_PER_MESH	= 7;		// SkinningCS and the six obb passes of SkinningAnimation::ComputeOBB
+static const double	LOD_COST_SMOOTHING		= 0.1;		// weight of the current frame in the cost per channel
+
+AnimationLOD g_animationLOD;
+
+AnimationLODSettings::AnimationLODSettings()
+{
+	levels.push_back(AnimationLODLevel(0.0f,	1, false, INDEX_NOT_FOUND));
+	levels.push_back(AnimationLODLevel(20.0f,	2, true,  INDEX_NOT_FOUND));
+	levels.push_back(AnimationLODLevel(50.0f,	4, true,  6));
+	levels.push_back(AnimationLODLevel(100.0f,	8, false, 4));
+	hysteresis = 0.1f;
+}
+
+AnimationLOD::AnimationLOD()
+{
+	m_msPerChannel = 0.0;
+}
+
+void AnimationLOD::SelectLevels(const std::vector<AnimationGroup*>& groups, FXMVECTOR cameraPosition, const DeformableCollisionPairs& pairs)
+{
+	if (m_settings.levels.empty()) return;
+
+	std::vector<const ModelGroup*> touching;
+	touching.reserve(pairs.size());
+	for (const DeformablePenetratorEntry& pair : pairs)
+		touching.push_back(pair.penetrator->GetGroup());
+	std::sort(touching.begin(), touching.end());
+
+	const UINT numLevels = static_cast<UINT>(m_settings.levels.size());
+	for (auto group : groups)
+	{
+		if (group == NULL) continue;
+		AnimationLODState& state = group->GetLODState();
+
+		const float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(cameraPosition, group->GetModelMatrix().r[3])));
+		UINT level = 0;
+		for (UINT i = 1; i < numLevels; ++i)
+		{
+			const float threshold = m_settings.levels[i].distance * (i > state.level ? 1.0f + m_settings.hysteresis : 1.0f);
+			if (distance >= threshold) level = i;
+		}
+
+		// the penetrator geometry has to match the animation exactly while it deforms
+		state.touching = std::binary_search(touching.begin(), touching.end(), static_cast<const ModelGroup*>(group));
+		state.level = state.touching ? 0 : level;
+	}
+}
+
+void AnimationLOD::Animate(AnimationGroup* group, float t) const
+{
+	SkinningMeshAnimationManager* manager = group->GetAnimationManager();
+	if (manager == NULL || manager->GetAnimationsRef().empty()) return;
+
+	AnimationLODState& state = group->GetLODState();
+	const int animationID = group->GetCurrentAnimation();
+	const AnimationLODLevel& level = m_settings.levels[std::min<size_t>(state.level, m_settings.levels.size() - 1)];
+	const UINT interval = std::max(1u, level.updateInterval);
+	std::vector<XMMATRIX>& bones = manager->GetBoneTransformationsRef();
+
+	const double start = GetTimeMS();
+	const float dt = t - state.lastTime;
+	const float span = interval * dt;
+	const bool levelChanged = !state.hasTarget || state.targetLevel != state.level;
+
+	state.updated = false;
+	state.interpolated = false;
+	state.numSampled = 0;
+	state.skin = true;
+
+	if (interval == 1 || (level.interpolate && span <= 0.0f))
+	{
+		// full rate, or paused/rewound playback without a direction to sample ahead in
+		state.numSampled = manager->computeAnimation(animationID, t, level.maxBoneDepth);
+		state.hasTarget = false;
+		state.updated = true;
+	}
+	else if (level.interpolate)
+	{
+		if (levelChanged || t < state.sourceTime || t >= state.targetTime)
+		{
+			// the last target becomes the source if playback continued into the next interval
+			if (!levelChanged && t >= state.targetTime && t - state.targetTime < span)
+			{
+				std::swap(state.source, state.target);
+				state.sourceTime = state.targetTime;
+			}
+			else
+			{
+				state.numSampled += manager->computeAnimation(animationID, t, level.maxBoneDepth);
+				state.source = bones;
+				state.sourceTime = t;
+			}
+
+			state.targetTime = t + span;
+			state.numSampled += manager->computeAnimation(animationID, state.targetTime, level.maxBoneDepth);
+			state.target = bones;
+			state.targetLevel = state.level;
+			state.hasTarget = true;
+			state.updated = true;
+		}
+		else
+		{
+			state.interpolated = true;
+		}
+
+		// bone matrices blended linearly like the skinning blends them, the interval is short
+		const float alpha = std::min(std::max((t - state.sourceTime) / (state.targetTime - state.sourceTime), 0.0f), 1.0f);
+		const XMVECTOR a = XMVectorReplicate(alpha);
+		for (size_t b = 0; b < bones.size(); ++b)
+		{
+			for (UINT r = 0; r < 4; ++r)
+				bones[b].r[r] = XMVectorLerpV(state.source[b].r[r], state.target[b].r[r], a);
+		}
+	}
+	else
+	{
+		// held: the bone matrices and the skinned vertices of the last update stay
+		if (levelChanged || state.framesSinceUpdate + 1 >= interval || dt < 0.0f)
+		{
+			state.numSampled = manager->computeAnimation(animationID, t, level.maxBoneDepth);
+			state.targetLevel = state.level;
+			state.hasTarget = true;
+			state.updated = true;
+		}
+		else
+		{
+			state.skin = false;
+		}
+	}
+
+	state.framesSinceUpdate = state.updated ? 0 : state.framesSinceUpdate + 1;
+	state.lastTime = t;
+
+	const NodeHierarchy* hierarchy = manager->getHierarchy(animationID);
+	state.numFull = hierarchy ? hierarchy->GetNumAnimated() : 0;
+	state.animationMS = GetTimeMS() - start;
+}
+
+void AnimationLOD::GatherStats(const std::vector<AnimationGroup*>& groups)
+{
+	m_stats.Reset();
+
+	double sampledMS = 0.0;
+	UINT numSampled = 0;
+	for (auto group : groups)
+	{
+		if (group == NULL || group->GetAnimationManager() == NULL) continue;
+		const AnimationLODState& state = group->GetLODState();
+
+		m_stats.numGroups++;
+		if (state.updated)				m_stats.numUpdated++;
+		else if (state.interpolated)	m_stats.numInterpolated++;
+		else if (!state.skin)			m_stats.numHeld++;
+		if (state.touching)				m_stats.numTouching++;
+
+		m_stats.numSampled += state.numSampled;
+		m_stats.numSkipped += state.numFull - std::min(state.numSampled, state.numFull);
+		m_stats.animationMS += state.animationMS;
+		if (state.numSampled > 0)
+		{
+			sampledMS += state.animationMS;
+			numSampled += state.numSampled;
+		}
+
+		for (auto mesh : group->triModels)
+		{
+			if (state.skin)
+			{
+				m_stats.numSkinnedVertices += mesh->_numVertices;
+			}
+			else
+			{
+				m_stats.numSkippedVertices += mesh->_numVertices;
+				m_stats.numSkippedDispatches += LOD_DISPATCHES_PER_MESH;
+			}
+		}
+	}
+
+	if (numSampled > 0)
+	{
+		const double msPerChannel = sampledMS / numSampled;
+		m_msPerChannel = m_msPerChannel > 0.0 ? (1.0 - LOD_COST_SMOOTHING) * m_msPerChannel + LOD_COST_SMOOTHING * msPerChannel : msPerChannel;
+	}
+	m_stats.savedAnimationMS = m_stats.numSkipped * m_msPerChannel;
+}
+
+void AnimationLOD::Reset(const std::vector<AnimationGroup*>& groups)
+{
+	for (auto group : groups)
+	{
+		if (group) group->GetLODState() = AnimationLODState();
+	}
+	m_stats.Reset();
+}
@@ -0,0 +1,121 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Pipeline.h"
+
+class AnimationGroup;
+
+// animation level of detail. every frame SelectLevels picks a level per AnimationGroup from the camera distance, penetrators
+// touching a deformable always get level 0. a level animates every updateInterval frames and only the nodes up to maxBoneDepth,
+// deeper nodes keep their bind pose. in between the updates the bone matrices are either interpolated (the pose of the next update is
+// sampled ahead, the animation time is known) or held, then the group is not skinned again either.
+
+struct AnimationLODLevel
+{
+	AnimationLODLevel(float _distance, UINT _updateInterval, bool _interpolate, UINT _maxBoneDepth)
+		: distance(_distance), updateInterval(_updateInterval), interpolate(_interpolate), maxBoneDepth(_maxBoneDepth) {}
+
+	float	distance;			// camera distance from which the level is used
+	UINT	updateInterval;		// frames per animation update
+	bool	interpolate;		// bone matrices interpolated between updates, otherwise held without skinning
+	UINT	maxBoneDepth;		// deeper nodes are not animated, INDEX_NOT_FOUND = all
+};
+
+struct AnimationLODSettings
+{
+	AnimationLODSettings();
+
+	std::vector<AnimationLODLevel>	levels;			// ascending distance, the first level should be the full animation at distance 0
+	float							hysteresis;		// relative distance beyond a level boundary before a group switches to the coarser level
+};
+
+// per group state, owned by the AnimationGroup
+struct AnimationLODState
+{
+	AnimationLODState() : level(0), touching(false), skin(true), framesSinceUpdate(0), lastTime(0.0f), sourceTime(0.0f), targetTime(0.0f),
+						  hasTarget(false), targetLevel(0), updated(false), interpolated(false), numSampled(0), numFull(0), animationMS(0.0) {}
+
+	UINT					level;
+	bool					touching;			// penetrator of a deformable in the last collision pairs
+	bool					skin;				// bone matrices changed, the meshes of the group need skinning this frame
+
+	UINT					framesSinceUpdate;
+	float					lastTime;
+	float					sourceTime;			// interpolation between the bone matrices at sourceTime and targetTime
+	float					targetTime;
+	bool					hasTarget;
+	UINT					targetLevel;		// level which sampled the target
+	std::vector<DirectX::XMMATRIX> source;
+	std::vector<DirectX::XMMATRIX> target;
+
+	// frame counters, gathered by AnimationLOD::GatherStats
+	bool					updated;			// pose sampled this frame
+	bool					interpolated;
+	UINT					numSampled;			// channels sampled this frame
+	UINT					numFull;			// channels the full animation samples per frame
+	double					animationMS;
+};
+
+struct AnimationLODStats
+{
+	AnimationLODStats() { Reset(); }
+	void Reset() { numGroups = numUpdated = numInterpolated = numHeld = numTouching = 0; numSampled = numSkipped = 0; numSkinnedVertices = numSkippedVertices = numSkippedDispatches = 0;
+				   animationMS = savedAnimationMS = 0.0; }
+
+	UINT	numGroups;
+	UINT	numUpdated;				// groups with a sampled pose
+	UINT	numInterpolated;		// groups with interpolated bone matrices
+	UINT	numHeld;				// groups neither animated nor skinned
+	UINT	numTouching;			// groups forced to level 0 by a deformable contact
+	UINT	numSampled;				// channels sampled
+	UINT	numSkipped;				// channels the full animation would have sampled in addition
+	UINT	numSkinnedVertices;
+	UINT	numSkippedVertices;		// vertices and skinning dispatches (SkinningCS and the obb passes per mesh) saved by held groups
+	UINT	numSkippedDispatches;
+	double	animationMS;			// cpu time of the animation, summed over the groups
+	double	savedAnimationMS;		// estimate, skipped channels times the measured cost per sampled channel
+};
+
+class AnimationLOD
+{
+public:
+	AnimationLOD();
+
+	AnimationLODSettings&			GetSettings()			{ return m_settings; }
+	const AnimationLODSettings&		GetSettings()	const	{ return m_settings; }
+	const AnimationLODStats&		GetStats()		const	{ return m_stats; }
+
+	// level of every group for the frame, on the render thread before the frame graph runs. pairs are the collision pairs of the last frame.
+	void	SelectLevels(const std::vector<AnimationGroup*>& groups, DirectX::FXMVECTOR cameraPosition, const DeformableCollisionPairs& pairs);
+	// animates the group at its level, replaces SkinningMeshAnimationManager::computeAnimation. groups can be animated in parallel.
+	void	Animate(AnimationGroup* group, float t) const;
+	// sums the counters of the groups into GetStats()
+	void	GatherStats(const std::vector<AnimationGroup*>& groups);
+	// all groups back to level 0 with a full update in the next frame
+	void	Reset(const std::vector<AnimationGroup*>& groups);
+
+protected:
+	AnimationLODSettings	m_settings;
+	AnimationLODStats		m_stats;
+	double					m_msPerChannel;		// running average of the animation cost per sampled channel
+};
+
+extern AnimationLOD g_animationLOD;
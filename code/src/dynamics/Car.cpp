@@ -18,6 +18,7 @@
 #include "dynamics/Car.h"
 
 #include "scene/ModelLoader.h"
+#include "scene/AsyncModelLoader.h"
 #include "scene/ModelInstance.h"
 #include "scene/DXModel.h"
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
@@ -106,6 +107,7 @@ Car::Car() {
 	m_carChassis = NULL;
 	m_replayFrame = -1;
 	m_currentReplayIndex = 0;
+	m_recordFile = "car.dump";
 
 	m_initialPosition = btVector3(0,0,0);
 }
@@ -161,7 +163,19 @@ void Car::Create(Physics* physics, Scene* scene, std::string chassisFile, std::s
 	m_wheelShape = new btCylinderShapeX(btVector3(m_wheelWidth, m_wheelRadius, m_wheelRadius));
 
 	m_carChassis = new ModelGroup();
-	ModelLoader::Load(chassisFile, scene, NULL, m_carChassis);
+	m_carWheels[0] = new ModelGroup();
+	m_carWheels[1] = new ModelGroup();
+	m_carWheels[2] = new ModelGroup();
+	m_carWheels[3] = new ModelGroup();
+
+	// the five files are prepared in parallel, inserted in this order once the previously queued files are in the scene
+	const UINT chassisJob = g_modelLoader.Enqueue(chassisFile, scene, NULL, m_carChassis);
+	g_modelLoader.Enqueue(wheelFile, scene, NULL, m_carWheels[0]);
+	g_modelLoader.Enqueue(wheelFile, scene, NULL, m_carWheels[1]);
+	g_modelLoader.Enqueue(wheelFile, scene, NULL, m_carWheels[2]);
+	const UINT wheelJob = g_modelLoader.Enqueue(wheelFile, scene, NULL, m_carWheels[3]);
+
+	g_modelLoader.Wait(chassisJob);
 
 #ifdef FORCE_ZAXIS_UP
 //   indexRightAxis = 0; 
@@ -199,17 +213,7 @@ void Car::Create(Physics* physics, Scene* scene, std::string chassisFile, std::s
 	m_carChassisBody = localCreateRigidBody(600, tr, compound, physics);//chassisShape);
 
 
-	m_carWheels[0] = new ModelGroup();
-	m_carWheels[1] = new ModelGroup();
-	m_carWheels[2] = new ModelGroup();
-	m_carWheels[3] = new ModelGroup();
-	
-
-	
-	ModelLoader::Load(wheelFile,   scene, NULL, m_carWheels[0]);
-	ModelLoader::Load(wheelFile,   scene, NULL, m_carWheels[1]);
-	ModelLoader::Load(wheelFile,   scene, NULL, m_carWheels[2]);
-	ModelLoader::Load(wheelFile,   scene, NULL, m_carWheels[3]);
+	g_modelLoader.Wait(wheelJob);
 
 	scene->AddGroup(m_carChassis);
 	scene->AddGroup(m_carWheels[0]);
@@ -475,7 +479,7 @@ void Car::Replay(float fElapsedTime, Physics* physics) {
 }
 
 void Car::StoreRecord() {
-	std::ofstream outfile("car.dump", std::ios::out | std::ios::binary);
+	std::ofstream outfile(m_recordFile.c_str(), std::ios::out | std::ios::binary);
 	size_t N = m_record.size();
 	if (N == 0) {
 		outfile.close();
@@ -487,7 +491,7 @@ void Car::StoreRecord() {
 }
 
 void Car::LoadRecord() {
-	std::ifstream infile("car.dump", std::ios::in | std::ios::binary);
+	std::ifstream infile(m_recordFile.c_str(), std::ios::in | std::ios::binary);
 	size_t N = 0;
 	infile.read(reinterpret_cast<char*>(&N), sizeof(size_t));
 	if (N <= 0) {
@@ -66,6 +66,11 @@ public:
 	void StoreRecord();
 	void LoadRecord();
 
+	// record file used by StoreRecord/LoadRecord, set before Create
+	void SetRecordFile(const std::string& fileName) { m_recordFile = fileName; }
+	// number of frames covered by the loaded record
+	UINT GetRecordLength() const { return m_record.empty() ? 0 : m_record.back().frame + 1; }
+
 	ModelGroup* GetCarWheels(int idx) { return m_carWheels[idx];}
 private:
 	btRaycastVehicle::btVehicleTuning	m_tuning;
@@ -104,4 +109,5 @@ private:
 	std::vector<CarEvent> m_record;
 	UINT m_replayFrame;
 	UINT m_currentReplayIndex;
+	std::string m_recordFile;
 };
\ No newline at end of file
@@ -20,6 +20,7 @@
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
 
 #include "Physics.h"
+#include "DeformablePairCache.h"
 #include "scene/Scene.h"
 #include "scene/DXModel.h"
 #include "dynamics/AnimationGroup.h"
@@ -426,6 +427,7 @@ public:
 		m_dynamicsWorld->addAction(m_character);
 		
 		m_ghostObject->setUserPointer(animModelGroup);
+		m_physics->GetDeformablePairCache()->Invalidate();		// ghost object was added without user pointer
 		//animModelGroup->SetPhysicsObject(m_ghostObject);
 		animModelGroup->SetGhostObject(m_ghostObject);
 		//m_dynamicsWorld->setGravity(btVector3(0,0,0));
@@ -0,0 +1,137 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+#include "DeformablePairCache.h"
+
+#include "scene/ModelInstance.h"
+
+DeformablePairCache::DeformablePairCache()
+{
+	m_isValid = false;
+	m_version = 0;
+	m_numAdded = 0;
+	m_numRemoved = 0;
+}
+
+DeformablePairCache::~DeformablePairCache()
+{
+}
+
+UINT64 DeformablePairCache::GetKey(const btBroadphaseProxy* proxy0, const btBroadphaseProxy* proxy1)
+{
+	UINT64 uid0 = static_cast<UINT>(proxy0->getUid());
+	UINT64 uid1 = static_cast<UINT>(proxy1->getUid());
+	if (uid0 > uid1) std::swap(uid0, uid1);
+	return (uid0 << 32) | uid1;
+}
+
+bool DeformablePairCache::Classify(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, DeformableGroupPair& pair)
+{
+	// user pointers point to our mesh objects
+	ModelGroup* m0 = (ModelGroup*)((btCollisionObject*)(proxy0->m_clientObject))->getUserPointer();
+	ModelGroup* m1 = (ModelGroup*)((btCollisionObject*)(proxy1->m_clientObject))->getUserPointer();
+
+	if (m0 == NULL || m1 == NULL) return false;
+	if (!(m0->HasDeformables() || m1->HasDeformables())) return false;
+
+	if (proxy0->getUid() > proxy1->getUid()) std::swap(proxy0, proxy1);
+	pair.proxy0 = proxy0;
+	pair.proxy1 = proxy1;
+	pair.bothDeformable = m0->HasDeformables() && m1->HasDeformables();
+
+	// deformable first
+	if (!m0->HasDeformables()) std::swap(m0, m1);
+	pair.deformable = m0;
+	pair.penetrator = m1;
+	return true;
+}
+
+void DeformablePairCache::AddPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1)
+{
+	DeformableGroupPair pair;
+	if (!Classify(proxy0, proxy1, pair)) return;
+
+	const UINT64 key = GetKey(proxy0, proxy1);
+	if (m_pairIndex.find(key) != m_pairIndex.end()) return;
+
+	m_pairIndex[key] = static_cast<UINT>(m_pairs.size());
+	m_pairs.push_back(pair);
+	m_version++;
+}
+
+void DeformablePairCache::RemovePair(UINT64 key)
+{
+	auto it = m_pairIndex.find(key);
+	if (it == m_pairIndex.end()) return;
+
+	const UINT index = it->second;
+	m_pairIndex.erase(it);
+
+	// move the last pair into the gap
+	const UINT last = static_cast<UINT>(m_pairs.size()) - 1;
+	if (index != last)
+	{
+		m_pairs[index] = m_pairs[last];
+		m_pairIndex[GetKey(m_pairs[index].proxy0, m_pairs[index].proxy1)] = index;
+	}
+	m_pairs.pop_back();
+	m_version++;
+}
+
+btBroadphasePair* DeformablePairCache::addOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1)
+{
+	btGhostPairCallback::addOverlappingPair(proxy0, proxy1);
+
+	m_numAdded++;
+	if (m_isValid) AddPair(proxy0, proxy1);
+	return 0;
+}
+
+void* DeformablePairCache::removeOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, btDispatcher* dispatcher)
+{
+	btGhostPairCallback::removeOverlappingPair(proxy0, proxy1, dispatcher);
+
+	m_numRemoved++;
+	if (m_isValid) RemovePair(GetKey(proxy0, proxy1));
+	return 0;
+}
+
+void DeformablePairCache::removeOverlappingPairsContainingProxy(btBroadphaseProxy* proxy0, btDispatcher* dispatcher)
+{
+	btGhostPairCallback::removeOverlappingPairsContainingProxy(proxy0, dispatcher);
+
+	// the pair cache usually reports the single pairs as well, only few pairs are tracked so this walk is cheap
+	for (size_t i = m_pairs.size(); i > 0; --i)
+	{
+		const DeformableGroupPair& pair = m_pairs[i - 1];
+		if (pair.proxy0 == proxy0 || pair.proxy1 == proxy0)
+			RemovePair(GetKey(pair.proxy0, pair.proxy1));
+	}
+}
+
+void DeformablePairCache::Rebuild(btOverlappingPairCache* pairCache)
+{
+	m_pairs.clear();
+	m_pairIndex.clear();
+
+	const int numPairs = pairCache->getNumOverlappingPairs();
+	btBroadphasePair* pairArray = numPairs > 0 ? pairCache->getOverlappingPairArrayPtr() : NULL;
+	for (int i = 0; i < numPairs; ++i)
+		AddPair(pairArray[i].m_pProxy0, pairArray[i].m_pProxy1);
+
+	m_isValid = true;
+	m_version++;
+}
@@ -0,0 +1,81 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <btBulletCollisionCommon.h>
+#include "BulletCollision/CollisionDispatch/btGhostObject.h"
+
+#include <vector>
+#include <unordered_map>
+
+class ModelGroup;
+
+// broadphase pair of a group with deformables and another group, proxies in bullet order (smaller unique id first)
+struct DeformableGroupPair
+{
+	btBroadphaseProxy*	proxy0;
+	btBroadphaseProxy*	proxy1;
+	ModelGroup*			deformable;		// group with deformables
+	ModelGroup*			penetrator;		// other group, also contains deformables for bothDeformable
+	bool				bothDeformable;
+};
+
+// keeps the broadphase pairs that involve deformables up to date from the pair cache callbacks,
+// so the per frame collision pair detection does not have to walk all overlapping pairs.
+// replaces the plain ghost pair callback of the world, ghost objects are forwarded to it.
+// the groups are taken from the user pointers when the pair is added: call Invalidate() after
+// user pointers or deformable flags of bodies that are already in the world have changed
+// (ModelLoader::Create after the bullet import, Character::Create after adding the ghost object).
+// bodies added with their user pointer set or removed from the world are tracked by the callbacks.
+class DeformablePairCache : public btGhostPairCallback
+{
+public:
+	DeformablePairCache();
+	virtual ~DeformablePairCache();
+
+	virtual btBroadphasePair*	addOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1);
+	virtual void*				removeOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, btDispatcher* dispatcher);
+	virtual void				removeOverlappingPairsContainingProxy(btBroadphaseProxy* proxy0, btDispatcher* dispatcher);
+
+	// full walk over the overlapping pairs, done on the first use and after Invalidate()
+	void Rebuild(btOverlappingPairCache* pairCache);
+	void Invalidate()										{ m_isValid = false; }
+	bool IsValid() const									{ return m_isValid; }
+
+	const std::vector<DeformableGroupPair>& GetPairs() const	{ return m_pairs; }
+
+	// incremented whenever the tracked pairs change
+	UINT GetVersion() const									{ return m_version; }
+
+	// callback statistics since the last reset
+	UINT GetNumAdded() const								{ return m_numAdded; }
+	UINT GetNumRemoved() const								{ return m_numRemoved; }
+	void ResetStatistics()									{ m_numAdded = 0; m_numRemoved = 0; }
+
+private:
+	static UINT64	GetKey(const btBroadphaseProxy* proxy0, const btBroadphaseProxy* proxy1);
+	static bool		Classify(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, DeformableGroupPair& pair);
+
+	void			AddPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1);
+	void			RemovePair(UINT64 key);
+
+	std::vector<DeformableGroupPair>	m_pairs;		// flat, removal swaps with the last pair
+	std::unordered_map<UINT64, UINT>	m_pairIndex;	// proxy pair key -> index into m_pairs
+	bool								m_isValid;
+	UINT								m_version;
+	UINT								m_numAdded;
+	UINT								m_numRemoved;
+};
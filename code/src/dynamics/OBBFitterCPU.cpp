@@ -0,0 +1,312 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "dynamics/OBBFitterCPU.h"
+#include "dynamics/SkinningCPU.h"
+#include "utils/WorkStealingPool.h"
+
+#include <Eigen/Eigen>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+using namespace DirectX;
+
+static const UINT	OBB_LANES			= 4;		// points per sse block
+static const UINT	OBB_CHUNK_POINTS	= 16384;	// points per chunk, the float partial sums of a chunk are combined in double in chunk order
+static const UINT	OBB_MAX_REUSED_FITS	= 30;		// pca fit after this many fits with reused axes, a shrinking mesh would otherwise keep loose axes
+static const float	OBB_MIN_EXTENT		= 1e-4f;	// like DXObjectOrientedBoundingBox
+
+namespace
+{
+	// sums of the shifted points d = p - shift and of their products
+	struct MomentSums
+	{
+		MomentSums() : n(0) { for (UINT i = 0; i < 9; ++i) s[i] = 0.0; }
+
+		void Add(const MomentSums& other) { n += other.n; for (UINT i = 0; i < 9; ++i) s[i] += other.s[i]; }
+
+		UINT	n;
+		double	s[9];	// x, y, z, xx, yy, zz, xy, xz, yz
+	};
+
+	float HorizontalAdd(FXMVECTOR v)
+	{
+		XMFLOAT4A f;
+		XMStoreFloat4A(&f, v);
+		return (f.x + f.y) + (f.z + f.w);
+	}
+
+	MomentSums AccumulateMoments(const float* x, const float* y, const float* z, UINT begin, UINT end, const XMFLOAT3& shift)
+	{
+		XMVECTOR sx = XMVectorReplicate(shift.x);
+		XMVECTOR sy = XMVectorReplicate(shift.y);
+		XMVECTOR sz = XMVectorReplicate(shift.z);
+
+		XMVECTOR acc[9];
+		for (UINT i = 0; i < 9; ++i) acc[i] = XMVectorZero();
+
+		UINT i = begin;
+		for (; i + OBB_LANES <= end; i += OBB_LANES)
+		{
+			XMVECTOR dx = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&x[i]), sx);
+			XMVECTOR dy = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&y[i]), sy);
+			XMVECTOR dz = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&z[i]), sz);
+			acc[0] = XMVectorAdd(acc[0], dx);
+			acc[1] = XMVectorAdd(acc[1], dy);
+			acc[2] = XMVectorAdd(acc[2], dz);
+			acc[3] = XMVectorMultiplyAdd(dx, dx, acc[3]);
+			acc[4] = XMVectorMultiplyAdd(dy, dy, acc[4]);
+			acc[5] = XMVectorMultiplyAdd(dz, dz, acc[5]);
+			acc[6] = XMVectorMultiplyAdd(dx, dy, acc[6]);
+			acc[7] = XMVectorMultiplyAdd(dx, dz, acc[7]);
+			acc[8] = XMVectorMultiplyAdd(dy, dz, acc[8]);
+		}
+
+		MomentSums sums;
+		for (UINT k = 0; k < 9; ++k) sums.s[k] = HorizontalAdd(acc[k]);
+		for (; i < end; ++i)
+		{
+			double dx = x[i] - shift.x, dy = y[i] - shift.y, dz = z[i] - shift.z;
+			sums.s[0] += dx;		sums.s[1] += dy;		sums.s[2] += dz;
+			sums.s[3] += dx * dx;	sums.s[4] += dy * dy;	sums.s[5] += dz * dz;
+			sums.s[6] += dx * dy;	sums.s[7] += dx * dz;	sums.s[8] += dy * dz;
+		}
+		sums.n = end - begin;
+		return sums;
+	}
+
+	void AccumulateExtents(const float* x, const float* y, const float* z, UINT begin, UINT end, const XMFLOAT3 axes[3],
+						   XMFLOAT3& minProjection, XMFLOAT3& maxProjection)
+	{
+		XMVECTOR a[3][3];
+		for (UINT k = 0; k < 3; ++k)
+		{
+			a[k][0] = XMVectorReplicate(axes[k].x);
+			a[k][1] = XMVectorReplicate(axes[k].y);
+			a[k][2] = XMVectorReplicate(axes[k].z);
+		}
+
+		XMVECTOR vMin[3], vMax[3];
+		for (UINT k = 0; k < 3; ++k)
+		{
+			vMin[k] = XMVectorReplicate(FLT_MAX);
+			vMax[k] = XMVectorReplicate(-FLT_MAX);
+		}
+
+		UINT i = begin;
+		for (; i + OBB_LANES <= end; i += OBB_LANES)
+		{
+			XMVECTOR px = XMLoadFloat4((const XMFLOAT4*)&x[i]);
+			XMVECTOR py = XMLoadFloat4((const XMFLOAT4*)&y[i]);
+			XMVECTOR pz = XMLoadFloat4((const XMFLOAT4*)&z[i]);
+			for (UINT k = 0; k < 3; ++k)
+			{
+				XMVECTOR d = XMVectorMultiplyAdd(pz, a[k][2], XMVectorMultiplyAdd(py, a[k][1], XMVectorMultiply(px, a[k][0])));
+				vMin[k] = XMVectorMin(vMin[k], d);
+				vMax[k] = XMVectorMax(vMax[k], d);
+			}
+		}
+
+		float fMin[3], fMax[3];
+		for (UINT k = 0; k < 3; ++k)
+		{
+			XMFLOAT4A lMin, lMax;
+			XMStoreFloat4A(&lMin, vMin[k]);
+			XMStoreFloat4A(&lMax, vMax[k]);
+			fMin[k] = std::min(std::min(lMin.x, lMin.y), std::min(lMin.z, lMin.w));
+			fMax[k] = std::max(std::max(lMax.x, lMax.y), std::max(lMax.z, lMax.w));
+		}
+		for (; i < end; ++i)
+		{
+			for (UINT k = 0; k < 3; ++k)
+			{
+				float d = x[i] * axes[k].x + y[i] * axes[k].y + z[i] * axes[k].z;
+				fMin[k] = std::min(fMin[k], d);
+				fMax[k] = std::max(fMax[k], d);
+			}
+		}
+
+		minProjection = XMFLOAT3(fMin[0], fMin[1], fMin[2]);
+		maxProjection = XMFLOAT3(fMax[0], fMax[1], fMax[2]);
+	}
+
+	UINT GetNumChunks(UINT numPoints)
+	{
+		return std::max(1u, (numPoints + OBB_CHUNK_POINTS - 1) / OBB_CHUNK_POINTS);
+	}
+
+	// the chunks are the same with and without the pool, serial and parallel fits give identical boxes
+	void ForEachChunk(UINT numChunks, bool parallel, const std::function<void(UINT begin, UINT end)>& func)
+	{
+		if (parallel)	g_workStealingPool.ParallelFor(numChunks, 1, func);
+		else			func(0, numChunks);
+	}
+}
+
+OBBFitterCPU::OBBFitterCPU()
+{
+	m_reuseTolerance = 0.05f;
+	m_hasAxes = false;
+	m_reused = false;
+	m_numReused = 0;
+	m_volume = 0.0f;
+	m_pcaVolume = 0.0f;
+}
+
+void OBBFitterCPU::Fit(const SkinnedVerticesSoA& points, DXObjectOrientedBoundingBox& obb, bool parallel)
+{
+	if (points.numVertices == 0) return;
+	Fit(&points.x[0], &points.y[0], &points.z[0], points.numVertices, obb, parallel);
+}
+
+void OBBFitterCPU::Fit(const float* x, const float* y, const float* z, UINT numPoints, DXObjectOrientedBoundingBox& obb, bool parallel)
+{
+	if (numPoints == 0) return;
+
+	XMFLOAT3 minProjection, maxProjection;
+	if (m_hasAxes && m_reuseTolerance > 0.0f && m_numReused < OBB_MAX_REUSED_FITS)
+	{
+		ComputeExtents(x, y, z, numPoints, m_axes, minProjection, maxProjection, parallel);
+		float volume = (maxProjection.x - minProjection.x) * (maxProjection.y - minProjection.y) * (maxProjection.z - minProjection.z);
+		if (volume <= m_pcaVolume * (1.0f + m_reuseTolerance))
+		{
+			m_volume = SetBox(m_axes, minProjection, maxProjection, obb);
+			m_reused = true;
+			++m_numReused;
+			return;
+		}
+	}
+
+	XMFLOAT3 mean;
+	float covariance[6];
+	ComputeCovariance(x, y, z, numPoints, mean, covariance, parallel);
+	ComputeAxes(covariance, m_axes);
+	ComputeExtents(x, y, z, numPoints, m_axes, minProjection, maxProjection, parallel);
+
+	m_volume = SetBox(m_axes, minProjection, maxProjection, obb);
+	m_pcaVolume = m_volume;
+	m_hasAxes = true;
+	m_reused = false;
+	m_numReused = 0;
+}
+
+void OBBFitterCPU::ComputeCovariance(const float* x, const float* y, const float* z, UINT numPoints, XMFLOAT3& mean, float covariance[6], bool parallel)
+{
+	mean = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	for (UINT i = 0; i < 6; ++i) covariance[i] = 0.0f;
+	if (numPoints == 0) return;
+
+	// shifting by one of the points keeps the sums small for meshes far away from the origin
+	XMFLOAT3 shift(x[0], y[0], z[0]);
+
+	UINT numChunks = GetNumChunks(numPoints);
+	std::vector<MomentSums> partial(numChunks);
+	ForEachChunk(numChunks, parallel, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			partial[c] = AccumulateMoments(x, y, z, c * OBB_CHUNK_POINTS, std::min(numPoints, (c + 1) * OBB_CHUNK_POINTS), shift);
+		}
+	});
+
+	MomentSums sums;
+	for (const MomentSums& p : partial) sums.Add(p);
+
+	double invN = 1.0 / (double)sums.n;
+	double mx = sums.s[0] * invN, my = sums.s[1] * invN, mz = sums.s[2] * invN;
+	mean = XMFLOAT3((float)(shift.x + mx), (float)(shift.y + my), (float)(shift.z + mz));
+	covariance[0] = (float)(sums.s[3] * invN - mx * mx);
+	covariance[1] = (float)(sums.s[4] * invN - my * my);
+	covariance[2] = (float)(sums.s[5] * invN - mz * mz);
+	covariance[3] = (float)(sums.s[6] * invN - mx * my);
+	covariance[4] = (float)(sums.s[7] * invN - mx * mz);
+	covariance[5] = (float)(sums.s[8] * invN - my * mz);
+}
+
+bool OBBFitterCPU::ComputeAxes(const float covariance[6], XMFLOAT3 axes[3])
+{
+	Eigen::Matrix3f c;
+	c << covariance[0], covariance[3], covariance[4],
+		 covariance[3], covariance[1], covariance[5],
+		 covariance[4], covariance[5], covariance[2];
+
+	// eigenvalues come in ascending order, axis 0 gets the largest like in DXObjectOrientedBoundingBox::ComputeFromPCA
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(c);
+	if (solver.info() != Eigen::Success)
+	{
+		axes[0] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		axes[1] = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		axes[2] = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		return false;
+	}
+
+	const Eigen::Matrix3f& v = solver.eigenvectors();
+	for (UINT k = 0; k < 3; ++k)
+	{
+		XMVECTOR axis = XMVectorSet(v(0, 2 - k), v(1, 2 - k), v(2, 2 - k), 0.0f);
+		XMStoreFloat3(&axes[k], XMVector3Normalize(axis));
+	}
+	return true;
+}
+
+void OBBFitterCPU::ComputeExtents(const float* x, const float* y, const float* z, UINT numPoints, const XMFLOAT3 axes[3],
+								  XMFLOAT3& minProjection, XMFLOAT3& maxProjection, bool parallel)
+{
+	UINT numChunks = GetNumChunks(numPoints);
+	std::vector<XMFLOAT3> partialMin(numChunks), partialMax(numChunks);
+	ForEachChunk(numChunks, parallel, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			AccumulateExtents(x, y, z, c * OBB_CHUNK_POINTS, std::min(numPoints, (c + 1) * OBB_CHUNK_POINTS), axes, partialMin[c], partialMax[c]);
+		}
+	});
+
+	XMVECTOR vMin = XMLoadFloat3(&partialMin[0]);
+	XMVECTOR vMax = XMLoadFloat3(&partialMax[0]);
+	for (UINT c = 1; c < numChunks; ++c)
+	{
+		vMin = XMVectorMin(vMin, XMLoadFloat3(&partialMin[c]));
+		vMax = XMVectorMax(vMax, XMLoadFloat3(&partialMax[c]));
+	}
+	XMStoreFloat3(&minProjection, vMin);
+	XMStoreFloat3(&maxProjection, vMax);
+}
+
+float OBBFitterCPU::SetBox(const XMFLOAT3 axes[3], const XMFLOAT3& minProjection, const XMFLOAT3& maxProjection, DXObjectOrientedBoundingBox& obb)
+{
+	XMVECTOR a0 = XMLoadFloat3(&axes[0]);
+	XMVECTOR a1 = XMLoadFloat3(&axes[1]);
+	XMVECTOR a2 = XMLoadFloat3(&axes[2]);
+
+	XMVECTOR anchor = XMVectorMultiplyAdd(a2, XMVectorReplicate(minProjection.z),
+					  XMVectorMultiplyAdd(a1, XMVectorReplicate(minProjection.y), XMVectorScale(a0, minProjection.x)));
+
+	float e0 = std::max(maxProjection.x - minProjection.x, OBB_MIN_EXTENT);
+	float e1 = std::max(maxProjection.y - minProjection.y, OBB_MIN_EXTENT);
+	float e2 = std::max(maxProjection.z - minProjection.z, OBB_MIN_EXTENT);
+
+	XMFLOAT3 fAnchor, fAxes[3];
+	XMStoreFloat3(&fAnchor, anchor);
+	XMStoreFloat3(&fAxes[0], XMVectorScale(a0, e0));
+	XMStoreFloat3(&fAxes[1], XMVectorScale(a1, e1));
+	XMStoreFloat3(&fAxes[2], XMVectorScale(a2, e2));
+	obb.setAnchorAndScaledAxes(&fAnchor, &fAxes[0], &fAxes[1], &fAxes[2]);
+
+	return e0 * e1 * e2;
+}
@@ -0,0 +1,68 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <SDX/DXObjectOrientedBoundingBox.h>
+
+struct SkinnedVerticesSoA;
+
+// cpu version of the obb passes of SkinningAnimation::ComputeOBB on structure of arrays positions. mean and covariance are
+// accumulated in one pass over blocks of 4 points (shifted by the first point against cancellation), the axes are the eigenvectors
+// of the 3x3 covariance and the extents the min/max of the projections onto the axes, again 4 points per step. large inputs are
+// reduced in parallel chunks, the partial sums are combined in chunk order so the result does not depend on the thread count.
+// with axis reuse the axes of the last pca fit are kept and only the extents are refit while the box stays within the reuse
+// tolerance of the volume of that fit.
+class OBBFitterCPU
+{
+public:
+	OBBFitterCPU();
+
+	// fits the box around the points, the result has the layout of DXObjectOrientedBoundingBox (anchor and scaled axes)
+	void	Fit(const float* x, const float* y, const float* z, UINT numPoints, DXObjectOrientedBoundingBox& obb, bool parallel = true);
+	void	Fit(const SkinnedVerticesSoA& points, DXObjectOrientedBoundingBox& obb, bool parallel = true);
+
+	// relative volume growth over the last pca fit up to which its axes are reused, 0 = pca on every fit
+	void	SetReuseTolerance(float tolerance)	{ m_reuseTolerance = tolerance; }
+	float	GetReuseTolerance()			const	{ return m_reuseTolerance; }
+	// forgets the axes of the last fit
+	void	Reset()								{ m_hasAxes = false; m_numReused = 0; }
+
+	bool	WasReused()					const	{ return m_reused; }		// the last fit kept the axes
+	float	GetVolume()					const	{ return m_volume; }		// of the last fit
+	float	GetPCAVolume()				const	{ return m_pcaVolume; }		// of the last fit with new axes
+
+	// mean and covariance (xx, yy, zz, xy, xz, yz) of the points
+	static void ComputeCovariance(const float* x, const float* y, const float* z, UINT numPoints, DirectX::XMFLOAT3& mean, float covariance[6], bool parallel);
+	// eigenvectors of the covariance by descending eigenvalue, false if the eigen solver failed (the axes are the coordinate axes then)
+	static bool ComputeAxes(const float covariance[6], DirectX::XMFLOAT3 axes[3]);
+	// smallest and largest projection of the points onto the normalized axes
+	static void ComputeExtents(const float* x, const float* y, const float* z, UINT numPoints, const DirectX::XMFLOAT3 axes[3],
+							   DirectX::XMFLOAT3& minProjection, DirectX::XMFLOAT3& maxProjection, bool parallel);
+
+protected:
+	// anchor and scaled axes like DXObjectOrientedBoundingBox::ComputeAnchorAndExtentsForGivenNormalizedAxis, returns the volume
+	static float SetBox(const DirectX::XMFLOAT3 axes[3], const DirectX::XMFLOAT3& minProjection, const DirectX::XMFLOAT3& maxProjection, DXObjectOrientedBoundingBox& obb);
+
+	float				m_reuseTolerance;
+	bool				m_hasAxes;
+	bool				m_reused;
+	UINT				m_numReused;		// fits since the last pca fit
+	DirectX::XMFLOAT3	m_axes[3];
+	float				m_volume;
+	float				m_pcaVolume;
+};
@@ -15,6 +15,7 @@
 
 #include "stdafx.h"
 #include "Physics.h"
+#include "DeformablePairCache.h"
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
 
 #include <iostream>
@@ -65,7 +66,12 @@ void customNearCallback(btBroadphasePair& collisionPair, btCollisionDispatcher&
 
 Physics::Physics()
 {
-
+	_broadphase = NULL;
+	_collisionConfig = NULL;
+	_dispatcher = NULL;
+	_solver = NULL;
+	_dynamicsWorld = NULL;
+	_deformablePairCache = NULL;
 }
 
 Physics::~Physics()
@@ -75,6 +81,7 @@ Physics::~Physics()
 	delete _collisionConfig;
 	delete _dispatcher;
 	delete _solver;	
+	delete _deformablePairCache;	// after the world, removing the objects still calls it
 	
 }
 
@@ -95,7 +102,8 @@ HRESULT Physics::init()
 	_solver				= new btSequentialImpulseConstraintSolver();			
 	_dynamicsWorld		= new btDiscreteDynamicsWorld(_dispatcher, _broadphase, _solver, _collisionConfig);	
 	
-	_dynamicsWorld->getPairCache()->setInternalGhostPairCallback(new btGhostPairCallback());
+	_deformablePairCache = new DeformablePairCache();
+	_dynamicsWorld->getPairCache()->setInternalGhostPairCallback(_deformablePairCache);
 	
 	return hr;
 }
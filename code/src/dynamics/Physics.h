@@ -25,6 +25,7 @@ class btCollisionConfiguration;
 class btCollisionDispatcher;			
 class btSequentialImpulseConstraintSolver;
 class btDiscreteDynamicsWorld;
+class DeformablePairCache;
 
 class Physics
 {
@@ -39,10 +40,12 @@ public:
 	__forceinline btDiscreteDynamicsWorld* GetDynamicsWorld()  {		return _dynamicsWorld;	}
 
 	__forceinline btBroadphaseInterface* GetBroadPhase() const { return _broadphase;}
+	__forceinline DeformablePairCache* GetDeformablePairCache() const { return _deformablePairCache; }
 private:
 	btBroadphaseInterface*				 _broadphase;		// shape overlap detection
 	btCollisionConfiguration*			 _collisionConfig;	// 
 	btCollisionDispatcher*				 _dispatcher;		
 	btSequentialImpulseConstraintSolver* _solver;			// physics solver
 	btDiscreteDynamicsWorld*			 _dynamicsWorld;	// world container
+	DeformablePairCache*				 _deformablePairCache;	// pairs with deformables, also the ghost pair callback
 };
\ No newline at end of file
@@ -22,8 +22,15 @@
 
 #include "dynamics/SkinningAnimation.h"
 #include "dynamics/AnimationGroup.h"
+#include "dynamics/AnimationLOD.h"
+#include "dynamics/SkinningCPU.h"
+#include "dynamics/OBBFitterCPU.h"
+#include "dynamics/AnimationCompression.h"
 
 #include <SDX/StringConversion.h>
+#include <algorithm>
+
+#include "utils/WorkStealingPool.h"
 
 //Henry: has to be last header
 #include "utils/DbgNew.h"
@@ -70,11 +77,12 @@ Node*& Node::addChild(Node* child)
 }
 
 
-Animation::Animation() : m_numChannels(0) {}
+Animation::Animation() : m_numChannels(0), m_compressedClip(NULL) {}
 
 Animation::~Animation() {
 	for (UINT i = 0; i < m_numChannels; ++i)
 		if (m_channels[i] != NULL) delete m_channels[i];
+	SAFE_DELETE(m_compressedClip);
 }
 
 void Animation::setTicksPerSecond(float ticksPerSecond) {
@@ -97,7 +105,7 @@ void Animation::setNumChannels(UINT numChannels) {
 	m_channels.resize(m_numChannels = numChannels, NULL);
 }
 
-UINT Animation::getNumChannels() {
+UINT Animation::getNumChannels() const {
 	return m_numChannels;
 }
 
@@ -111,6 +119,18 @@ NodeAnimation*& Animation::getChannelRef(UINT i) {
 	return m_channels[i];
 }
 
+void Animation::compress(const AnimationCompressionSettings& settings) {
+	CompressedAnimationClip* clip = new CompressedAnimationClip();
+	if (FAILED(clip->Create(*this, settings))) {
+		delete clip;
+		return;
+	}
+	SAFE_DELETE(m_compressedClip);
+	m_compressedClip = clip;
+	for (UINT i = 0; i < m_numChannels; ++i)
+		if (m_channels[i] != NULL) m_channels[i]->ClearKeys();
+}
+
 VertexBoneData::VertexBoneData() {
 	for (UINT i = 0; i < NUM_MAX_BONES_PER_VERTEX; ++i) 
 	{
@@ -186,121 +206,172 @@ UINT SkinningMeshAnimationManager::findBoneID(const Node& node) const
 	return iterator->second;
 }
 
-UINT SkinningMeshAnimationManager::getRotationID(const NodeAnimation& nodeAnimation, float t) const 
+UINT SkinningMeshAnimationManager::findKey(const float* times, UINT numKeys, float t, UINT& cursor)
 {
-	const std::vector<RotationKey>& rotations = nodeAnimation.GetRotations();
-	for (UINT i = 0; i < nodeAnimation.GetNumRotations()-1; ++i)
-		if (t >= (float)rotations[i].GetTime() && t < (float)rotations[i+1].GetTime())
-			return i;
-	
-	//LogError("findRotationID() failed - t = %f", t);
-	return 0;//nodeAnimation.getNumRotations()-1;
+	// playback advances by less than one key interval per frame in most cases
+	UINT i = cursor;
+	if (i + 1 < numKeys && t >= times[i] && t < times[i+1])
+		return i;
+	++i;
+	if (i + 1 < numKeys && t >= times[i] && t < times[i+1])
+	{
+		cursor = i;
+		return i;
+	}
+
+	// seek: last key with times[i] <= t
+	i = (UINT)(std::upper_bound(times, times + numKeys, t) - times);
+	i = (i == 0 || i >= numKeys) ? 0 : i - 1;
+	cursor = i;
+	return i;
 }
 
-UINT SkinningMeshAnimationManager::getTranslationID(const NodeAnimation& nodeAnimation, float t) const 
+UINT SkinningMeshAnimationManager::findKeyLinear(const KeyTrack& track, float t)
 {
-	const std::vector<TranslationKey>& translations = nodeAnimation.GetTranslations();
-	for (UINT i = 0; i < nodeAnimation.GetNumTranslations()-1; ++i)
-		if (t >= (float)translations[i].GetTime() && t < (float)translations[i+1].GetTime())
+	const std::vector<float>& times = track.times;
+	for (UINT i = 0; i + 1 < times.size(); ++i)
+		if (t >= times[i] && t < times[i+1])
 			return i;
-	
-	//LogError("findTranslationID() failed - t = %f", t);
-	return 0;//nodeAnimation.getNumTranslations()-1;
+
+	//LogError("findKeyLinear() failed - t = %f", t);
+	return 0;
 }
 
-UINT SkinningMeshAnimationManager::getScalingID(const NodeAnimation& nodeAnimation, float t) const 
+void SkinningMeshAnimationManager::sampleChannel(const Animation& animation, UINT channel, float t, KeyCursor& cursor, XMVECTOR& rotation, XMVECTOR& translation, XMVECTOR& scaling)
 {
-	const std::vector<ScalingKey>& scalings = nodeAnimation.GetScalings();
-	for (UINT i = 0; i < nodeAnimation.GetNumScalings()-1; ++i)
-		if (t >= (float)scalings[i].GetTime() && t < (float)scalings[i+1].GetTime())
-			return i;
-	
-	//LogError("findScalingID() failed - t = %f", t);
-	return 0;//nodeAnimation.getNumScalings()-1;
+	const CompressedAnimationClip* clip = animation.getCompressedClip();
+	if (clip)
+	{
+		rotation	= clip->Sample(channel, CompressedAnimationClip::ROTATION,		t, cursor.rotation);
+		translation	= clip->Sample(channel, CompressedAnimationClip::TRANSLATION,	t, cursor.translation);
+		scaling		= clip->Sample(channel, CompressedAnimationClip::SCALING,		t, cursor.scaling);
+	}
+	else
+	{
+		const NodeAnimation& nodeAnimation = *animation.getChannel(channel);
+		rotation	= slerpRotation(nodeAnimation, t, cursor.rotation);
+		translation	= lerpTranslation(nodeAnimation, t, cursor.translation);
+		scaling		= lerpScaling(nodeAnimation, t, cursor.scaling);
+	}
 }
 
-XMVECTOR SkinningMeshAnimationManager::slerpRotation(const NodeAnimation& nodeAnimation, float t) const 
+XMVECTOR SkinningMeshAnimationManager::sampleTrack(const KeyTrack& track, float t, UINT* cursor, bool slerp)
 {
-	if (nodeAnimation.GetNumRotations() == 1) {
-		return nodeAnimation.GetRotations()[0].GetRotation();
+	if (track.size() == 1) {
+		return track.GetValue(0);
 	}
-	UINT i = getRotationID(nodeAnimation, t);
+	UINT i = cursor ? findKey(track, t, *cursor) : findKeyLinear(track, t);
+	UINT j = (i+1) % track.size();
 
-	const RotationKey& a = nodeAnimation.GetRotations()[i];
-	const RotationKey& b = nodeAnimation.GetRotations()[(i+1) % nodeAnimation.GetNumRotations()];
+	float delta = (float)fabs(track.times[j] - track.times[i]);
+	float x = (t - track.times[i]) / delta;
 
-	float delta = (float)fabs(b.GetTime() - a.GetTime());
-	float x = (t - (float)a.GetTime()) / delta;
-
-	//if (x < 0.0f || x > 1.0f) LogError("slerpRotation(): x < 0.0f || x > 1.0f - x = %f & t = %f", x, t);
-	//return glm::normalize(glm::slerp(a.getRotation(), b.getRotation(), x));
-	//XMFLOAT4A result;
-	//XMStoreFloat4A(&result, XMQuaternionSlerp(XMLoadFloat4(&a.GetRotation()), XMLoadFloat4(&b.GetRotation()), x));
-	//return result;
-
-	return  XMQuaternionSlerp(a.GetRotation(), b.GetRotation(), x);
+	//if (x < 0.0f || x > 1.0f) LogError("sampleTrack(): x < 0.0f || x > 1.0f - x = %f & t = %f", x, t);
+	if (slerp)
+		return XMQuaternionSlerp(track.GetValue(i), track.GetValue(j), x);
+	return XMVectorLerp(track.GetValue(i), track.GetValue(j), x);
 }
 
-
-XMVECTOR SkinningMeshAnimationManager::lerpTranslation(const NodeAnimation& nodeAnimation, float t) const 
+void NodeHierarchy::Compile(const Node& root)
 {
-	if (nodeAnimation.GetNumTranslations() == 1) {
-		return nodeAnimation.GetTranslations()[0].GetTranslation();
+	parents.clear();
+	channels.clear();
+	boneIDs.clear();
+	depths.clear();
+	transformations.clear();
+
+	// depth first like the recursive evaluation, so bones referenced by several nodes are written in the same order
+	std::vector<std::pair<const Node*, UINT>> stack(1, std::make_pair(&root, INDEX_NOT_FOUND));
+	while (!stack.empty())
+	{
+		const Node* node = stack.back().first;
+		const UINT parent = stack.back().second;
+		stack.pop_back();
+
+		const UINT index = (UINT)parents.size();
+		parents.push_back(parent);
+		channels.push_back(node->getNodeAnimationID());
+		boneIDs.push_back(node->getBoneID());
+		depths.push_back(parent == INDEX_NOT_FOUND ? 0 : depths[parent] + 1);
+		transformations.push_back(node->getTransformation());
+
+		const std::vector<Node*>& children = node->getChildren();
+		for (size_t i = children.size(); i > 0; --i)
+			stack.push_back(std::make_pair(children[i-1], index));
 	}
-	UINT i = getTranslationID(nodeAnimation, t);
-
-	const TranslationKey& a = nodeAnimation.GetTranslations()[i];
-	const TranslationKey& b = nodeAnimation.GetTranslations()[(i+1) % nodeAnimation.GetNumTranslations()];
-
-	float delta = (float)fabs(b.GetTime() - a.GetTime());
-	float x = (t - (float)a.GetTime()) / delta;
-
-	//if (x < 0.0f || x > 1.0f) LogError("lerpTranslation(): x < 0.0f || x > 1.0f - x = %f & t = %f", x, t);
-	//return glm::mix(a.getTranslation(), b.getTranslation(), x);
-	//return XMFLOAT3A();
-	//XMFLOAT3A result;
-	//XMStoreFloat3A(&result, XMVectorLerp(XMLoadFloat3A(&a.GetTranslation()), XMLoadFloat3A(&b.GetTranslation()), x));
-	//return result;
+}
 
-	return XMVectorLerp(a.GetTranslation(), b.GetTranslation(), x);
+UINT NodeHierarchy::GetNumAnimated(UINT maxDepth) const
+{
+	UINT n = 0;
+	for (size_t i = 0; i < channels.size(); ++i)
+		if (channels[i] != INDEX_NOT_FOUND && depths[i] <= maxDepth) n++;
+	return n;
+}
 
+XMMATRIX SkinningMeshAnimationManager::localTransformation(FXMVECTOR rotation, FXMVECTOR translation, FXMVECTOR scaling)
+{
+	// the inverse rotation is the rotation of the conjugate, the inverse scaling scales the columns by the reciprocal,
+	// the transposed translation moves the translation into the last column
+	XMMATRIX M = XMMatrixRotationQuaternion(XMQuaternionConjugate(rotation));
+	const XMVECTOR invScaling = XMVectorSelect(g_XMOne, XMVectorReciprocal(scaling), g_XMSelect1110);
+	M.r[0] = XMVectorSelect(XMVectorMultiply(M.r[0], invScaling), XMVectorSplatX(translation), g_XMSelect0001);
+	M.r[1] = XMVectorSelect(XMVectorMultiply(M.r[1], invScaling), XMVectorSplatY(translation), g_XMSelect0001);
+	M.r[2] = XMVectorSelect(XMVectorMultiply(M.r[2], invScaling), XMVectorSplatZ(translation), g_XMSelect0001);
+	return M;
 }
 
-XMVECTOR SkinningMeshAnimationManager::lerpScaling(const NodeAnimation& nodeAnimation, float t) const 
+UINT SkinningMeshAnimationManager::evaluateHierarchy(const NodeHierarchy& hierarchy, const Animation& animation, KeyCursor* cursors, std::vector<XMMATRIX>& globals, float t,
+													 const XMMATRIX& globalInverseTransformation, const std::vector<XMMATRIX>& boneOffsets, std::vector<XMMATRIX>& boneTransformations,
+													 UINT maxDepth)
 {
-	if (nodeAnimation.GetNumScalings() == 1) 
+	const UINT numNodes = (UINT)hierarchy.size();
+	globals.resize(numNodes);
+	UINT numSampled = 0;
+
+	// local transformations, independent per node
+	for (UINT i = 0; i < numNodes; ++i)
 	{
-		return nodeAnimation.GetScalings()[0].GetScaling();
+		const UINT channel = hierarchy.channels[i];
+		const NodeAnimation* nodeAnimation = animation.getChannel(channel);
+		if (nodeAnimation && hierarchy.depths[i] <= maxDepth)
+		{
+			XMVECTOR rotation, translation, scaling;
+			sampleChannel(animation, channel, t, cursors[channel], rotation, translation, scaling);
+			globals[i] = localTransformation(rotation, translation, scaling);
+			numSampled++;
+		}
+		else
+		{
+			// No animation for the current node found
+			globals[i] = hierarchy.transformations[i];
+		}
 	}
-	UINT i = getTranslationID(nodeAnimation, t);
-
-	const ScalingKey& a = nodeAnimation.GetScalings()[i];
-	const ScalingKey& b = nodeAnimation.GetScalings()[(i+1) % nodeAnimation.GetNumScalings()];
 
-	float delta = (float)fabs(b.GetTime() - a.GetTime());
-	float x = (t - (float)a.GetTime()) / delta;
-
-	//if (x < 0.0f || x > 1.0f) LogError("lerpScaling(): x < 0.0f || x > 1.0f - x = %f & t = %f", x, t);
-	//return glm::mix(a.getScaling(), b.getScaling(), x);
-
-	//XMFLOAT3A result;
-	//XMStoreFloat3A(&result, XMVectorLerp(XMLoadFloat3A(&a.GetScaling()), XMLoadFloat3A(&b.GetScaling()), x));	
-	//return result;
+	// local to global, the parents are already global
+	for (UINT i = 0; i < numNodes; ++i)
+	{
+		const UINT parent = hierarchy.parents[i];
+		if (parent != INDEX_NOT_FOUND)
+			globals[i] = XMMatrixMultiply(globals[parent], globals[i]);
 
-	return XMVectorLerp(a.GetScaling(), b.GetScaling(), x);
+		const UINT boneID = hierarchy.boneIDs[i];
+		if (boneID != INDEX_NOT_FOUND)
+			boneTransformations[boneID] = XMMatrixMultiply(globalInverseTransformation, XMMatrixMultiply(globals[i], boneOffsets[boneID]));
+	}
+	return numSampled;
 }
 
-void SkinningMeshAnimationManager::traverseAndAnimateNodeHierachy(const Node& node, std::vector<XMMATRIX>& boneTransformations, const XMMATRIX& parentTransformation, float t) const
+void SkinningMeshAnimationManager::traverseAndAnimateNodeHierachy(const Node& node, const Animation& animation, KeyCursor* cursors, float t, const XMMATRIX& parentTransformation,
+																  const XMMATRIX& globalInverseTransformation, const std::vector<XMMATRIX>& boneOffsets, std::vector<XMMATRIX>& boneTransformations)
 {
-	const Animation* animation = m_animations[node.getAnimationID()];
-	const NodeAnimation* nodeAnimation = animation->getChannel(node.getNodeAnimationID());
+	const NodeAnimation* nodeAnimation = animation.getChannel(node.getNodeAnimationID());
 
 	XMMATRIX nodeTransformation;
 
 	if (nodeAnimation) {
-		XMVECTOR translation	= lerpTranslation(*nodeAnimation, t);
-		XMVECTOR rotation		= slerpRotation(*nodeAnimation, t);
-		XMVECTOR scaling		= lerpScaling(*nodeAnimation, t);
+		XMVECTOR translation, rotation, scaling;
+		sampleChannel(animation, node.getNodeAnimationID(), t, cursors[node.getNodeAnimationID()], rotation, translation, scaling);
 				
 		XMMATRIX T = XMMatrixTranslationFromVector(translation);		
 		XMMATRIX R = XMMatrixInverse(NULL, XMMatrixRotationQuaternion(rotation));
@@ -320,18 +391,35 @@ void SkinningMeshAnimationManager::traverseAndAnimateNodeHierachy(const Node& no
 	const int boneID = node.getBoneID();
 	if (boneID != INDEX_NOT_FOUND) 
 	{
-		boneTransformations[boneID] = XMMatrixMultiply(m_globalInverseTransformation, XMMatrixMultiply(globalTransformation, m_boneOffsets[boneID]));
+		boneTransformations[boneID] = XMMatrixMultiply(globalInverseTransformation, XMMatrixMultiply(globalTransformation, boneOffsets[boneID]));
 	}
 
 	for (const auto& childNode : node.getChildren())
 	{
-		traverseAndAnimateNodeHierachy(*childNode, boneTransformations, globalTransformation, t);
+		traverseAndAnimateNodeHierachy(*childNode, animation, cursors, t, globalTransformation, globalInverseTransformation, boneOffsets, boneTransformations);
 	}
 }
 
-void SkinningMeshAnimationManager::computeAnimation(int animationID, float t) 
+void SkinningMeshAnimationManager::compileHierarchies()
+{
+	m_hierarchies.resize(m_roots.size());
+	for (size_t i = 0; i < m_roots.size(); ++i)
+		if (m_roots[i]) m_hierarchies[i].Compile(*m_roots[i]);
+}
+
+void SkinningMeshAnimationManager::prepareAnimation(int animationID)
+{
+	if (m_hierarchies.size() != m_roots.size())
+		compileHierarchies();
+
+	if (m_keyCursors.size() != m_animations.size())
+		m_keyCursors.resize(m_animations.size());
+	if (m_keyCursors[animationID].size() != m_animations[animationID]->getNumChannels())
+		m_keyCursors[animationID].assign(m_animations[animationID]->getNumChannels(), KeyCursor());
+}
+
+float SkinningMeshAnimationManager::getAnimationTime(int animationID, float t)
 {
-	if (m_animations.size() == 0) return;
 	float ticksPerSecond = (float)m_animations[animationID]->getTicksPerSecond();
 	ticksPerSecond <= 0.0f ? 25.0f : ticksPerSecond;
 
@@ -341,9 +429,28 @@ void SkinningMeshAnimationManager::computeAnimation(int animationID, float t)
 		//animationTime = (float)m_animations[animationID]->getDuration()-0.1f;
 		//animationTime = (float)m_animations[animationID]->getDuration()-0.1f;
 	}
-	//traverseAndAnimateNodeHierachy(*m_roots[animationID], m_boneTransformations, XMFLOAT4X4A(1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1), animationTime);
+	return animationTime;
+}
+
+void SkinningMeshAnimationManager::computeAnimationReference(int animationID, float t, std::vector<XMMATRIX>& boneTransformations)
+{
+	if (m_animations.size() == 0) return;
+	prepareAnimation(animationID);
+
+	boneTransformations.resize(m_boneTransformations.size());
+	traverseAndAnimateNodeHierachy(*m_roots[animationID], *m_animations[animationID], m_keyCursors[animationID].data(), getAnimationTime(animationID, t), XMMatrixIdentity(),
+								   m_globalInverseTransformation, m_boneOffsets, boneTransformations);
+}
+
+UINT SkinningMeshAnimationManager::computeAnimation(int animationID, float t, UINT maxDepth) 
+{
+	if (m_animations.size() == 0) return 0;
+	prepareAnimation(animationID);
+
+	float animationTime = getAnimationTime(animationID, t);
 	//fprintf(stderr, "%f\n", animationTime);
-	traverseAndAnimateNodeHierachy(*m_roots[animationID], m_boneTransformations, XMMatrixIdentity(), animationTime);
+	return evaluateHierarchy(m_hierarchies[animationID], *m_animations[animationID], m_keyCursors[animationID].data(), m_globals, animationTime,
+							 m_globalInverseTransformation, m_boneOffsets, m_boneTransformations, maxDepth);
 
 	////checkme using elapsed time or uncomment above
 	//static double lastPlaying = 0.;
@@ -967,67 +1074,129 @@ void SkinningAnimation::Destroy()
 //	return hr;
 //}
 
-HRESULT SkinningAnimation::ApplySkinning( ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, float fTime )
+void SkinningAnimation::ComputeAnimations(const std::vector<AnimationGroup*>& groups, float fTime)
+{
+	// every group owns its animation manager, so the groups can be animated independently
+	const bool useLOD = g_app.g_useAnimationLOD;
+	g_workStealingPool.ParallelFor(static_cast<UINT>(groups.size()), 1, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			AnimationGroup* group = groups[i];
+			if (group == NULL || group->GetAnimationManager() == NULL) continue;
+
+			if (useLOD)	g_animationLOD.Animate(group, fTime);
+			else		group->GetAnimationManager()->computeAnimation(group->GetCurrentAnimation(), fTime);
+		}
+	});
+
+	if (useLOD) g_animationLOD.GatherStats(groups);
+}
+
+void SkinningAnimation::ApplySkinningCPU(const std::vector<AnimationGroup*>& groups)
+{
+	// the meshes are large, the vertices are skinned in parallel chunks instead of one job per group
+	for (auto group : groups)
+	{
+		if (group == NULL || group->GetAnimationManager() == NULL) continue;
+		// held by the animation lod, the skinned vertices of the last update are still valid
+		if (g_app.g_useAnimationLOD && !group->GetLODState().skin) continue;
+		const SkinningAnimationClasses::SkinningMeshAnimationManager* manager = group->GetAnimationManager();
+
+		for (auto mesh : group->triModels)
+		{
+			SkinningCPU* skinning = mesh->_skinningCPU;
+			if (skinning == NULL) continue;
+
+			// same bone data for all meshes of the group, like the bone buffers bound in ApplySkinning
+			if (!skinning->HasBoneData())
+				skinning->SetBoneData(manager->GetBoneIDsRef(), manager->GetBoneWeightsRef());
+			skinning->SetBoneMatrices(manager->GetBoneTransformationsRef());
+			skinning->Skin();
+
+			// counterpart of ComputeOBB, the skinned vertices are in the same space as the gpu obb input
+			if (mesh->_obbFitterCPU)
+			{
+				DXObjectOrientedBoundingBox obb;
+				mesh->_obbFitterCPU->Fit(skinning->GetSkinnedVertices(), obb);
+				for (auto& submesh : mesh->submeshes)
+					submesh.GetModelOBB() = obb;
+			}
+		}
+	}
+}
+
+HRESULT SkinningAnimation::ApplySkinning( ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, float fTime, bool computeBones )
 {
 	HRESULT hr = S_OK;
 	if(group == NULL) return S_FALSE;
 	if(group->GetAnimationManager() == NULL) return S_FALSE;
 
-	group->GetAnimationManager()->computeAnimation(group->GetCurrentAnimation(), fTime);
+	if (computeBones)
+		group->GetAnimationManager()->computeAnimation(group->GetCurrentAnimation(), fTime);
+	else if (g_app.g_useAnimationLOD && !group->GetLODState().skin)
+		return S_OK;	// held by the animation lod
 	// TODO indepenent anims in group
 
 	for(auto mesh : group->triModels)
 	{			
-		UINT voffset = 0, stride = sizeof(XMFLOAT4A);
-		HRESULT hr = S_OK;
-		ID3D11Buffer* ppBuffer[] = { NULL, NULL, NULL };
-		pd3dImmediateContext->IASetVertexBuffers(0, 3, ppBuffer, &stride, &voffset);
+		SkinMesh(pd3dImmediateContext, group, mesh);
 
+		// Compute the OBB
+		// TODO fix me
+		ComputeOBB(pd3dImmediateContext, mesh);
 
-		ID3D11ShaderResourceView* ppSRVNULL[] =  { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-		ID3D11UnorderedAccessView* ppUAVNULL[] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-		pd3dImmediateContext->CSSetShaderResources(0, 8, ppSRVNULL);
-		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 8, ppUAVNULL, NULL);
+	}
 
-		D3D11_MAPPED_SUBRESOURCE mappedBuf;
-		pd3dImmediateContext->Map(m_cbSkinning, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedBuf);
-		CB_SKINNING_AND_OBB* cbSkinning = reinterpret_cast<CB_SKINNING_AND_OBB*>(mappedBuf.pData);
-		//cbSkinning->mNumOriginalVertices = mesh->_numVertices;
+	return hr;
+}
 
-		cbSkinning->mNumOriginalVertices = mesh->_numVertices+1;  // CHECKME something is off by one in minmax, ugly fix here 
-		
-		//cbSkinning->mBaseVertex = mesh->_baseVertex;
-		for (UINT i = 0; i < group->GetAnimationManager()->GetBoneTransformationsRef().size() && i < SKINNING_NUM_MAX_BONES; ++i)
-			cbSkinning->mBoneMatrices[i] =  group->GetAnimationManager()->GetBoneTransformationsRef()[i]; //XMFLOAT4X4A(1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1) ;//
+HRESULT SkinningAnimation::SkinMesh(ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, DXModel* mesh)
+{
+	HRESULT hr = S_OK;
+	UINT voffset = 0, stride = sizeof(XMFLOAT4A);
+	ID3D11Buffer* ppBuffer[] = { NULL, NULL, NULL };
+	pd3dImmediateContext->IASetVertexBuffers(0, 3, ppBuffer, &stride, &voffset);
 
-		pd3dImmediateContext->Unmap(m_cbSkinning, 0);
 
-		ID3D11Buffer* constantBuffers[] = { m_cbSkinning };
-		pd3dImmediateContext->CSSetConstantBuffers(CB_LOC::SKINNING_AND_OBB, ARRAYSIZE(constantBuffers), constantBuffers);
+	ID3D11ShaderResourceView* ppSRVNULL[] =  { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	ID3D11UnorderedAccessView* ppUAVNULL[] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	pd3dImmediateContext->CSSetShaderResources(0, 8, ppSRVNULL);
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 8, ppUAVNULL, NULL);
 
-		// Original vertices, boneIDs per vertex, bone weights per vertex
-		ID3D11ShaderResourceView* ppSRV[] = { mesh->g_pVertexBufferBasePoseSRV,  mesh->g_pNormalsBufferBasePoseSRV,
-											  group->GetAnimationManager()->g_pBoneIDBufferSRV, group->GetAnimationManager()->g_pBoneWeightBufferSRV };
-		pd3dImmediateContext->CSSetShaderResources(0, 4, ppSRV);
+	D3D11_MAPPED_SUBRESOURCE mappedBuf;
+	pd3dImmediateContext->Map(m_cbSkinning, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedBuf);
+	CB_SKINNING_AND_OBB* cbSkinning = reinterpret_cast<CB_SKINNING_AND_OBB*>(mappedBuf.pData);
+	//cbSkinning->mNumOriginalVertices = mesh->_numVertices;
 
-		ID3D11UnorderedAccessView* ppUAV[] = { mesh->GetVertexBufferUAV(), mesh->GetNormalsBufferUAV() };
-		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppUAV, NULL);
+	cbSkinning->mNumOriginalVertices = mesh->_numVertices+1;  // CHECKME something is off by one in minmax, ugly fix here 
+	
+	//cbSkinning->mBaseVertex = mesh->_baseVertex;
+	for (UINT i = 0; i < group->GetAnimationManager()->GetBoneTransformationsRef().size() && i < SKINNING_NUM_MAX_BONES; ++i)
+		cbSkinning->mBoneMatrices[i] =  group->GetAnimationManager()->GetBoneTransformationsRef()[i]; //XMFLOAT4X4A(1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1) ;//
 
-		pd3dImmediateContext->CSSetShader(s_skinningCS->Get(), NULL, 0);
+	pd3dImmediateContext->Unmap(m_cbSkinning, 0);
 
-		// todo set num dispatches
-		int numDispatches = GET_THREAD_GROUP_COUNT(mesh->_numVertices, 128);
-		pd3dImmediateContext->Dispatch(numDispatches, 1, 1);
+	ID3D11Buffer* constantBuffers[] = { m_cbSkinning };
+	pd3dImmediateContext->CSSetConstantBuffers(CB_LOC::SKINNING_AND_OBB, ARRAYSIZE(constantBuffers), constantBuffers);
 
-		// Reset
-		pd3dImmediateContext->CSSetShaderResources(0, 8, ppSRVNULL);
-		pd3dImmediateContext->CSSetUnorderedAccessViews(0, 8, ppUAVNULL, NULL);
+	// Original vertices, boneIDs per vertex, bone weights per vertex
+	ID3D11ShaderResourceView* ppSRV[] = { mesh->g_pVertexBufferBasePoseSRV,  mesh->g_pNormalsBufferBasePoseSRV,
+										  group->GetAnimationManager()->g_pBoneIDBufferSRV, group->GetAnimationManager()->g_pBoneWeightBufferSRV };
+	pd3dImmediateContext->CSSetShaderResources(0, 4, ppSRV);
 
-		// Compute the OBB
-		// TODO fix me
-		ComputeOBB(pd3dImmediateContext, mesh);
+	ID3D11UnorderedAccessView* ppUAV[] = { mesh->GetVertexBufferUAV(), mesh->GetNormalsBufferUAV() };
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppUAV, NULL);
 
-	}
+	pd3dImmediateContext->CSSetShader(s_skinningCS->Get(), NULL, 0);
+
+	// todo set num dispatches
+	int numDispatches = GET_THREAD_GROUP_COUNT(mesh->_numVertices, 128);
+	pd3dImmediateContext->Dispatch(numDispatches, 1, 1);
+
+	// Reset
+	pd3dImmediateContext->CSSetShaderResources(0, 8, ppSRVNULL);
+	pd3dImmediateContext->CSSetUnorderedAccessViews(0, 8, ppUAVNULL, NULL);
 
 	return hr;
 }
@@ -30,6 +30,9 @@ class AnimationGroup;
 
 namespace SkinningAnimationClasses {
 
+class CompressedAnimationClip;
+struct AnimationCompressionSettings;
+
 #define INDEX_NOT_FOUND ((UINT)-1)
 class Node {
 public:
@@ -142,6 +145,23 @@ protected:
 	XMVECTOR m_scaling;
 };
 
+// keys of one channel, times and values in separate arrays so the key search only touches the times
+struct KeyTrack
+{
+	std::vector<float>		times;
+	std::vector<XMFLOAT4A>	values;
+
+	size_t		size()				const	{	return times.size();					}
+	XMVECTOR	GetValue(size_t i)	const	{	return XMLoadFloat4A(&values[i]);		}
+	void		Add(float time, const XMVECTOR& value)
+	{
+		XMFLOAT4A v;
+		XMStoreFloat4A(&v, value);
+		times.push_back(time);
+		values.push_back(v);
+	}
+};
+
 class NodeAnimation {
 public:	
 
@@ -151,25 +171,38 @@ public:
 	void				SetNodeName(const std::string& nodeName)		{		m_nodeName = nodeName;	}
 	const std::string&	GetNodeName()							const	{		return m_nodeName;		}
 
-	void AddRotation	(const RotationKey& rotation) 		{	m_rotations.push_back(rotation);		}
-	void AddTranslation	(const TranslationKey& translation) {	m_translations.push_back(translation);	}
-	void AddScaling		(const ScalingKey& scaling) 		{	m_scalings.push_back(scaling);			}
+	void AddRotation	(const RotationKey& rotation) 		{	m_rotations.Add(rotation.GetTime(), rotation.GetRotation());				}
+	void AddTranslation	(const TranslationKey& translation) {	m_translations.Add(translation.GetTime(), translation.GetTranslation());	}
+	void AddScaling		(const ScalingKey& scaling) 		{	m_scalings.Add(scaling.GetTime(), scaling.GetScaling());					}
 
 	size_t GetNumRotations()	const {	return m_rotations.size();		}
 	size_t GetNumTranslations()	const {	return m_translations.size();	}
 	size_t GetNumScalings()		const {	return m_scalings.size();		}
 
-	const std::vector<RotationKey>&		GetRotations()	  const {	return m_rotations;		}
-	const std::vector<TranslationKey>&	GetTranslations() const {	return m_translations;	}
-	const std::vector<ScalingKey>&		GetScalings()	  const {	return m_scalings;		}
+	// releases the keys, the animation samples its compressed clip
+	void ClearKeys()	{	m_rotations = KeyTrack();	m_translations = KeyTrack();	m_scalings = KeyTrack();	}
+
+	const KeyTrack&	GetRotations()	  const {	return m_rotations;		}
+	const KeyTrack&	GetTranslations() const {	return m_translations;	}
+	const KeyTrack&	GetScalings()	  const {	return m_scalings;		}
 
 protected:
 	std::string m_nodeName;
 	const Node* m_node;
 
-	std::vector<RotationKey>	m_rotations;
-	std::vector<TranslationKey> m_translations;
-	std::vector<ScalingKey>		m_scalings;
+	KeyTrack	m_rotations;
+	KeyTrack	m_translations;
+	KeyTrack	m_scalings;
+};
+
+// playback position of one channel, the key intervals used by the last sample of the rotation, translation and scaling track
+struct KeyCursor
+{
+	KeyCursor() : rotation(0), translation(0), scaling(0) {}
+
+	UINT rotation;
+	UINT translation;
+	UINT scaling;
 };
 
 class Animation 
@@ -185,16 +218,37 @@ public:
 	float getDuration() const;
 
 	void setNumChannels(UINT numChannels);
-	UINT getNumChannels();
+	UINT getNumChannels() const;
 
 	const NodeAnimation* getChannel(UINT i) const;
 	NodeAnimation*& getChannelRef(UINT i);
 
+	// encodes the keys of all channels into a compressed clip and releases them
+	void compress(const AnimationCompressionSettings& settings);
+	const CompressedAnimationClip* getCompressedClip() const	{	return m_compressedClip;	}
+
 protected:
 	float m_ticksPerSecond;
 	float m_duration;
 	UINT  m_numChannels;
 	std::vector<NodeAnimation*> m_channels;
+	CompressedAnimationClip* m_compressedClip;
+};
+
+// node tree of one animation flattened in depth first order, every parent is stored before its children so the global
+// transformations are one forward loop
+struct NodeHierarchy
+{
+	std::vector<UINT>		parents;			// INDEX_NOT_FOUND for the root
+	std::vector<UINT>		channels;			// node animation of the node, INDEX_NOT_FOUND for nodes without animation
+	std::vector<UINT>		boneIDs;			// INDEX_NOT_FOUND for nodes without bone
+	std::vector<UINT>		depths;				// 0 for the root
+	std::vector<XMMATRIX>	transformations;	// local transformation of the nodes without animation
+
+	size_t size() const {	return parents.size();	}
+	void Compile(const Node& root);
+	// nodes with animation up to the depth, the ones evaluateHierarchy samples
+	UINT GetNumAnimated(UINT maxDepth = INDEX_NOT_FOUND) const;
 };
 
 #define NUM_MAX_BONES_PER_VERTEX 4
@@ -264,19 +318,55 @@ public:
 	UINT findNodeAnimationID(UINT animationID, const Node& node)			const;
 	UINT findBoneID			(const Node& node)								const;
 
-	UINT getRotationID		(const NodeAnimation& nodeAnimation, float t)	const;
-	UINT getTranslationID	(const NodeAnimation& nodeAnimation, float t)	const;
-	UINT getScalingID		(const NodeAnimation& nodeAnimation, float t)	const;
+	// index i of the key interval [times[i], times[i+1]) containing t, 0 if t lies outside of the track.
+	// findKey tries the interval of the cursor and its successor first (monotonic playback) and falls back to a binary search (seeks, loops),
+	// findKeyLinear is the reference scan.
+	static UINT findKey			(const float* times, UINT numKeys, float t, UINT& cursor);
+	static UINT findKey			(const KeyTrack& track, float t, UINT& cursor)	{	return findKey(track.times.data(), (UINT)track.size(), t, cursor);	}
+	static UINT findKeyLinear	(const KeyTrack& track, float t);
+
+	// interpolated value of the track at t, slerp for rotations and lerp otherwise. without cursor the key is found by the linear scan.
+	static XMVECTOR sampleTrack(const KeyTrack& track, float t, UINT* cursor, bool slerp);
+
+	static XMVECTOR slerpRotation	(const NodeAnimation& nodeAnimation, float t, UINT& cursor)	{	return sampleTrack(nodeAnimation.GetRotations(),	t, &cursor, true);	}
+	static XMVECTOR lerpTranslation	(const NodeAnimation& nodeAnimation, float t, UINT& cursor)	{	return sampleTrack(nodeAnimation.GetTranslations(),	t, &cursor, false);	}
+	static XMVECTOR lerpScaling		(const NodeAnimation& nodeAnimation, float t, UINT& cursor)	{	return sampleTrack(nodeAnimation.GetScalings(),		t, &cursor, false);	}
+
+	// local pose of one animated channel, decoded from the compressed clip if the animation has one
+	static void sampleChannel(const Animation& animation, UINT channel, float t, KeyCursor& cursor, XMVECTOR& rotation, XMVECTOR& translation, XMVECTOR& scaling);
+
+	// local transformation of an animated node, Transpose(T) * Inverse(R) * Inverse(S) of the recursive evaluation without the inversions
+	static XMMATRIX localTransformation(FXMVECTOR rotation, FXMVECTOR translation, FXMVECTOR scaling);
+
+	// samples the local transformations of all nodes, then computes the global and bone transformations in one forward loop.
+	// cursors holds one KeyCursor per channel of the animation, globals is the caller's scratch for the global transformations of the
+	// nodes, so characters sharing the hierarchy evaluate in parallel. nodes deeper than maxDepth keep their bind pose transformation
+	// (animation lod), returns the number of sampled channels.
+	static UINT evaluateHierarchy(const NodeHierarchy& hierarchy, const Animation& animation, KeyCursor* cursors, std::vector<XMMATRIX>& globals, float t,
+								  const XMMATRIX& globalInverseTransformation, const std::vector<XMMATRIX>& boneOffsets, std::vector<XMMATRIX>& boneTransformations,
+								  UINT maxDepth = INDEX_NOT_FOUND);
 
-	XMVECTOR slerpRotation(const NodeAnimation& nodeAnimation, float t)	const;
-	XMVECTOR lerpTranslation(const NodeAnimation& nodeAnimation, float t)	const;
-	XMVECTOR lerpScaling(const NodeAnimation& nodeAnimation, float t)		const;
+	// recursive evaluation over the node tree, reference of evaluateHierarchy
+	static void traverseAndAnimateNodeHierachy(const Node& node, const Animation& animation, KeyCursor* cursors, float t, const XMMATRIX& parentTransformation,
+											   const XMMATRIX& globalInverseTransformation, const std::vector<XMMATRIX>& boneOffsets, std::vector<XMMATRIX>& boneTransformations);
 
-	void traverseAndAnimateNodeHierachy(const Node& node, std::vector<XMMATRIX>& boneTransformations, const XMMATRIX& parentTransformation, float t) const;
-	void computeAnimation(int animationID, float t);
+	// flattens the node trees of all animations, called after the import (or by the first computeAnimation)
+	void compileHierarchies();
+
+	// returns the number of sampled channels
+	UINT computeAnimation(int animationID, float t, UINT maxDepth = INDEX_NOT_FOUND);
+	// same bone transformations with the recursive evaluation
+	void computeAnimationReference(int animationID, float t, std::vector<XMMATRIX>& boneTransformations);
 
 	HRESULT setupBuffers();
 
+	// flattened node tree of the animation, NULL before the first computeAnimation or compileHierarchies
+	const NodeHierarchy* getHierarchy(int animationID) const { return (size_t)animationID < m_hierarchies.size() ? &m_hierarchies[animationID] : NULL; }
+
+protected:
+	float	getAnimationTime(int animationID, float t);
+	void	prepareAnimation(int animationID);
+
 public:
 	ID3D11Buffer*					g_pBoneIDBuffer;
 	ID3D11ShaderResourceView*		g_pBoneIDBufferSRV;
@@ -300,6 +390,12 @@ private:
 	std::vector<Node*> m_roots;
 	// Animation channels
 	std::vector<Animation*> m_animations;
+	// Playback cursors per animation and channel, owned by the manager so every AnimationGroup samples with its own cursors
+	std::vector<std::vector<KeyCursor>> m_keyCursors;
+	// Flattened node trees per animation
+	std::vector<NodeHierarchy> m_hierarchies;
+	// Global node transformations of the last evaluation
+	std::vector<XMMATRIX> m_globals;
 };
 
 } // SkinningAnimationClasses
@@ -319,7 +415,17 @@ public:
 	HRESULT ApplySkinning(ID3D11DeviceContext1* pd3dImmediateContext, DXModel* mesh, float fTime);
 	HRESULT ComputeOBB(ID3D11DeviceContext1* pd3dImmediateContext, DXModel* mesh);
 
-	HRESULT ApplySkinning( ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, float fTime);
+	// computeBones = false if the bone matrices are already up to date (ComputeAnimations)
+	HRESULT ApplySkinning( ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, float fTime, bool computeBones = true);
+	// SkinningCS for one mesh of the group with the current bone matrices, into the vertex and normal buffers of the mesh. no obb
+	HRESULT SkinMesh(ID3D11DeviceContext1* pd3dImmediateContext, AnimationGroup* group, DXModel* mesh);
+
+	// cpu part of the skinning: bone matrices of all groups, one job per group. no d3d calls, runs on any thread
+	static void ComputeAnimations(const std::vector<AnimationGroup*>& groups, float fTime);
+
+	// cpu version of the skinning dispatch: skins the meshes of the groups with the current bone matrices into their SkinningCPU
+	// (collision proxies, headless runs) and fits the submesh obbs with their OBBFitterCPU. no d3d calls
+	static void ApplySkinningCPU(const std::vector<AnimationGroup*>& groups);
 
 protected:
 
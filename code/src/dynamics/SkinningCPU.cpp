@@ -0,0 +1,267 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "App.h"
+#include "dynamics/SkinningCPU.h"
+#include "dynamics/SkinningAnimation.h"
+#include "utils/WorkStealingPool.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+using namespace DirectX;
+
+static const UINT SKINNING_LANES		= 8;		// vertices per avx2 block
+static const UINT SKINNING_GRAIN_BLOCKS	= 512;		// blocks per parallel chunk
+static const UINT SKINNING_MATRIX_SIZE	= 12;		// floats per palette matrix, 3 rows
+static const UINT SKINNING_ZERO_BONE	= SKINNING_NUM_MAX_BONES;
+
+const float		SkinningCPU::OUTPUT_SCALE	= 15.0f;
+const XMFLOAT3	SkinningCPU::OUTPUT_OFFSET	= XMFLOAT3(0.0f, 0.0f, -0.75f);
+
+SkinningCPU::SkinningCPU()
+{
+	m_numVertices = 0;
+	m_hasNormals = false;
+	m_hasBoneData = false;
+	m_useAVX2 = HasAVX2();
+	m_palette.assign((SKINNING_NUM_MAX_BONES + 1) * SKINNING_MATRIX_SIZE, 0.0f);
+}
+
+bool SkinningCPU::HasAVX2()
+{
+	static int s_hasAVX2 = -1;
+	if (s_hasAVX2 < 0)
+	{
+		int info[4];
+		__cpuid(info, 0);
+		const bool hasLeaf7 = info[0] >= 7;
+
+		// avx enabled by the os (ymm state saved), then the avx2 bit
+		__cpuid(info, 1);
+		bool avx2 = hasLeaf7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		if (avx2)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		s_hasAVX2 = avx2 ? 1 : 0;
+	}
+	return s_hasAVX2 == 1;
+}
+
+void SkinningCPU::SetBasePose( const std::vector<XMFLOAT4A>& vertices, const std::vector<XMFLOAT4A>& normals )
+{
+	m_numVertices = static_cast<UINT>(vertices.size());
+	m_hasNormals = normals.size() == vertices.size();
+
+	m_x.resize(m_numVertices);
+	m_y.resize(m_numVertices);
+	m_z.resize(m_numVertices);
+	for (UINT i = 0; i < m_numVertices; ++i)
+	{
+		m_x[i] = vertices[i].x;
+		m_y[i] = vertices[i].y;
+		m_z[i] = vertices[i].z;
+	}
+
+	m_nx.assign(m_hasNormals ? m_numVertices : 0, 0.0f);
+	m_ny.assign(m_hasNormals ? m_numVertices : 0, 0.0f);
+	m_nz.assign(m_hasNormals ? m_numVertices : 0, 0.0f);
+	for (UINT i = 0; i < m_nx.size(); ++i)
+	{
+		m_nx[i] = normals[i].x;
+		m_ny[i] = normals[i].y;
+		m_nz[i] = normals[i].z;
+	}
+
+	m_boneOffsets.assign(NUM_MAX_BONES_PER_VERTEX * m_numVertices, SKINNING_ZERO_BONE * SKINNING_MATRIX_SIZE);
+	m_boneWeights.assign(NUM_MAX_BONES_PER_VERTEX * m_numVertices, 0.0f);
+	m_hasBoneData = false;
+}
+
+void SkinningCPU::SetBoneData( const std::vector<XMUINT4>& boneIDs, const std::vector<XMFLOAT4A>& boneWeights )
+{
+	const UINT numInfluenced = std::min(m_numVertices, static_cast<UINT>(std::min(boneIDs.size(), boneWeights.size())));
+	for (UINT i = 0; i < numInfluenced; ++i)
+	{
+		const UINT ids[] = { boneIDs[i].x, boneIDs[i].y, boneIDs[i].z, boneIDs[i].w };
+		const float weights[] = { boneWeights[i].x, boneWeights[i].y, boneWeights[i].z, boneWeights[i].w };
+		for (UINT k = 0; k < NUM_MAX_BONES_PER_VERTEX; ++k)
+		{
+			const bool valid = ids[k] < SKINNING_NUM_MAX_BONES;
+			m_boneOffsets[k * m_numVertices + i] = (valid ? ids[k] : SKINNING_ZERO_BONE) * SKINNING_MATRIX_SIZE;
+			m_boneWeights[k * m_numVertices + i] = valid ? weights[k] : 0.0f;
+		}
+	}
+	m_hasBoneData = true;
+}
+
+void SkinningCPU::SetBoneMatrices( const std::vector<XMMATRIX>& boneTransformations )
+{
+	const UINT numBones = std::min(static_cast<UINT>(boneTransformations.size()), static_cast<UINT>(SKINNING_NUM_MAX_BONES));
+	for (UINT b = 0; b < numBones; ++b)
+	{
+		// the constant buffer holds the row major matrix column major, the shader transforms with the rows: p' = M p
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, boneTransformations[b]);
+		memcpy(&m_palette[b * SKINNING_MATRIX_SIZE], &m.m[0][0], SKINNING_MATRIX_SIZE * sizeof(float));
+	}
+}
+
+void SkinningCPU::Skin( bool parallel )
+{
+	if (m_skinned.numVertices != m_numVertices)
+		m_skinned.Resize(m_numVertices);
+	if (m_numVertices == 0) return;
+
+	SkinningOutput out(m_skinned);
+	if (!m_hasNormals) out.nx = out.ny = out.nz = NULL;
+	Skin(out, parallel);
+}
+
+void SkinningCPU::Skin( const SkinningOutput& out, bool parallel ) const
+{
+	// full avx2 blocks, the tail and cpus without avx2 on the scalar path
+	const UINT numBlocks = m_useAVX2 ? m_numVertices / SKINNING_LANES : 0;
+	const UINT tailBegin = numBlocks * SKINNING_LANES;
+
+	if (parallel)
+	{
+		g_workStealingPool.ParallelFor(numBlocks, SKINNING_GRAIN_BLOCKS, [&](UINT begin, UINT end)
+		{
+			SkinAVX2(out, begin * SKINNING_LANES, end * SKINNING_LANES);
+		});
+		g_workStealingPool.ParallelFor(m_numVertices - tailBegin, SKINNING_GRAIN_BLOCKS * SKINNING_LANES, [&](UINT begin, UINT end)
+		{
+			SkinScalar(out, tailBegin + begin, tailBegin + end);
+		});
+	}
+	else
+	{
+		SkinAVX2(out, 0, tailBegin);
+		SkinScalar(out, tailBegin, m_numVertices);
+	}
+}
+
+void SkinningCPU::SkinScalar( const SkinningOutput& out, UINT begin, UINT end ) const
+{
+	const float* palette = &m_palette[0];
+	const UINT n = m_numVertices;
+
+	for (UINT i = begin; i < end; ++i)
+	{
+		const float* m0 = palette + m_boneOffsets[0 * n + i];
+		const float* m1 = palette + m_boneOffsets[1 * n + i];
+		const float* m2 = palette + m_boneOffsets[2 * n + i];
+		const float* m3 = palette + m_boneOffsets[3 * n + i];
+		const float w0 = m_boneWeights[0 * n + i];
+		const float w1 = m_boneWeights[1 * n + i];
+		const float w2 = m_boneWeights[2 * n + i];
+		const float w3 = m_boneWeights[3 * n + i];
+
+		float m[SKINNING_MATRIX_SIZE];
+		for (UINT c = 0; c < SKINNING_MATRIX_SIZE; ++c)
+			m[c] = m0[c] * w0 + m1[c] * w1 + m2[c] * w2 + m3[c] * w3;
+
+		const float x = m_x[i], y = m_y[i], z = m_z[i];
+		out.x[i] = (x * m[0] + y * m[1] + z * m[2]  + m[3])  * OUTPUT_SCALE + OUTPUT_OFFSET.x;
+		out.y[i] = (x * m[4] + y * m[5] + z * m[6]  + m[7])  * OUTPUT_SCALE + OUTPUT_OFFSET.y;
+		out.z[i] = (x * m[8] + y * m[9] + z * m[10] + m[11]) * OUTPUT_SCALE + OUTPUT_OFFSET.z;
+
+		if (out.nx && m_hasNormals)
+		{
+			float len = 1.0f / sqrtf(m_nx[i] * m_nx[i] + m_ny[i] * m_ny[i] + m_nz[i] * m_nz[i]);
+			const float nx = m_nx[i] * len, ny = m_ny[i] * len, nz = m_nz[i] * len;
+
+			const float sx = nx * m[0] + ny * m[1] + nz * m[2];
+			const float sy = nx * m[4] + ny * m[5] + nz * m[6];
+			const float sz = nx * m[8] + ny * m[9] + nz * m[10];
+			len = 1.0f / sqrtf(sx * sx + sy * sy + sz * sz);
+			out.nx[i] = sx * len;
+			out.ny[i] = sy * len;
+			out.nz[i] = sz * len;
+		}
+	}
+}
+
+void SkinningCPU::SkinAVX2( const SkinningOutput& out, UINT begin, UINT end ) const
+{
+	const float* palette = &m_palette[0];
+	const UINT n = m_numVertices;
+	const __m256 one	= _mm256_set1_ps(1.0f);
+	const __m256 scale	= _mm256_set1_ps(OUTPUT_SCALE);
+	const __m256 offsetX = _mm256_set1_ps(OUTPUT_OFFSET.x);
+	const __m256 offsetY = _mm256_set1_ps(OUTPUT_OFFSET.y);
+	const __m256 offsetZ = _mm256_set1_ps(OUTPUT_OFFSET.z);
+
+	for (UINT i = begin; i < end; i += SKINNING_LANES)
+	{
+		__m256i offsets[NUM_MAX_BONES_PER_VERTEX];
+		__m256  weights[NUM_MAX_BONES_PER_VERTEX];
+		for (UINT k = 0; k < NUM_MAX_BONES_PER_VERTEX; ++k)
+		{
+			offsets[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_boneOffsets[k * n + i]));
+			weights[k] = _mm256_loadu_ps(&m_boneWeights[k * n + i]);
+		}
+
+		// blended matrix, one gather per bone and element, summed in the order of the shader
+		__m256 m[SKINNING_MATRIX_SIZE];
+		for (UINT c = 0; c < SKINNING_MATRIX_SIZE; ++c)
+		{
+			__m256 s = _mm256_mul_ps(_mm256_i32gather_ps(palette + c, offsets[0], 4), weights[0]);
+			s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_i32gather_ps(palette + c, offsets[1], 4), weights[1]));
+			s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_i32gather_ps(palette + c, offsets[2], 4), weights[2]));
+			m[c] = _mm256_add_ps(s, _mm256_mul_ps(_mm256_i32gather_ps(palette + c, offsets[3], 4), weights[3]));
+		}
+
+		const __m256 x = _mm256_loadu_ps(&m_x[i]);
+		const __m256 y = _mm256_loadu_ps(&m_y[i]);
+		const __m256 z = _mm256_loadu_ps(&m_z[i]);
+		__m256 r;
+		r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m[0]), _mm256_mul_ps(y, m[1])), _mm256_mul_ps(z, m[2])), m[3]);
+		_mm256_storeu_ps(out.x + i, _mm256_add_ps(_mm256_mul_ps(r, scale), offsetX));
+		r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m[4]), _mm256_mul_ps(y, m[5])), _mm256_mul_ps(z, m[6])), m[7]);
+		_mm256_storeu_ps(out.y + i, _mm256_add_ps(_mm256_mul_ps(r, scale), offsetY));
+		r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m[8]), _mm256_mul_ps(y, m[9])), _mm256_mul_ps(z, m[10])), m[11]);
+		_mm256_storeu_ps(out.z + i, _mm256_add_ps(_mm256_mul_ps(r, scale), offsetZ));
+
+		if (out.nx && m_hasNormals)
+		{
+			__m256 nx = _mm256_loadu_ps(&m_nx[i]);
+			__m256 ny = _mm256_loadu_ps(&m_ny[i]);
+			__m256 nz = _mm256_loadu_ps(&m_nz[i]);
+			__m256 len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+			len = _mm256_div_ps(one, _mm256_sqrt_ps(len));
+			nx = _mm256_mul_ps(nx, len);
+			ny = _mm256_mul_ps(ny, len);
+			nz = _mm256_mul_ps(nz, len);
+
+			const __m256 sx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, m[0]), _mm256_mul_ps(ny, m[1])), _mm256_mul_ps(nz, m[2]));
+			const __m256 sy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, m[4]), _mm256_mul_ps(ny, m[5])), _mm256_mul_ps(nz, m[6]));
+			const __m256 sz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, m[8]), _mm256_mul_ps(ny, m[9])), _mm256_mul_ps(nz, m[10]));
+			len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy)), _mm256_mul_ps(sz, sz));
+			len = _mm256_div_ps(one, _mm256_sqrt_ps(len));
+			_mm256_storeu_ps(out.nx + i, _mm256_mul_ps(sx, len));
+			_mm256_storeu_ps(out.ny + i, _mm256_mul_ps(sy, len));
+			_mm256_storeu_ps(out.nz + i, _mm256_mul_ps(sz, len));
+		}
+	}
+}
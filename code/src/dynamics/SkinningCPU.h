@@ -0,0 +1,96 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+
+// skinned positions and normals as structure of arrays
+struct SkinnedVerticesSoA
+{
+	SkinnedVerticesSoA() : numVertices(0) {}
+
+	void Resize(UINT n)	{ numVertices = n; x.resize(n); y.resize(n); z.resize(n); nx.resize(n); ny.resize(n); nz.resize(n); }
+
+	UINT				numVertices;
+	std::vector<float>	x, y, z;
+	std::vector<float>	nx, ny, nz;
+};
+
+// caller provided output arrays with one entry per vertex, normals are skipped if nx is NULL
+struct SkinningOutput
+{
+	SkinningOutput() : x(NULL), y(NULL), z(NULL), nx(NULL), ny(NULL), nz(NULL) {}
+	SkinningOutput(SkinnedVerticesSoA& soa)
+		: x(&soa.x[0]), y(&soa.y[0]), z(&soa.z[0]), nx(&soa.nx[0]), ny(&soa.ny[0]), nz(&soa.nz[0]) {}
+
+	float	*x, *y, *z;
+	float	*nx, *ny, *nz;
+};
+
+// cpu version of SkinningCS: blends the 4 bone matrices of a vertex (NUM_MAX_BONES_PER_VERTEX), transforms the base pose position and
+// normal and applies the output scale and offset of the shader. influences with a bone id outside of the SKINNING_NUM_MAX_BONES palette
+// contribute nothing, like the out of range constant buffer reads on the gpu.
+// blocks of 8 vertices are skinned with avx2 (bone matrix gathers), in parallel chunks on the work stealing pool. the scalar path is
+// the reference port of the shader and uses the same operation order, both produce identical results.
+class SkinningCPU
+{
+public:
+	SkinningCPU();
+
+	// base pose in the layout of the skinning buffers, normals may be empty
+	void	SetBasePose(const std::vector<DirectX::XMFLOAT4A>& vertices, const std::vector<DirectX::XMFLOAT4A>& normals);
+	// per vertex bone ids and weights of SkinningMeshAnimationManager, vertices without bone data are not influenced
+	void	SetBoneData(const std::vector<DirectX::XMUINT4>& boneIDs, const std::vector<DirectX::XMFLOAT4A>& boneWeights);
+	// bone palette of the frame, the first SKINNING_NUM_MAX_BONES matrices like the skinning constant buffer
+	void	SetBoneMatrices(const std::vector<DirectX::XMMATRIX>& boneTransformations);
+
+	// skins into GetSkinnedVertices()
+	void	Skin(bool parallel = true);
+	// skins into caller provided arrays with GetNumVertices() entries
+	void	Skin(const SkinningOutput& out, bool parallel = true) const;
+
+	// false = scalar path only (benchmark), default is avx2 if the cpu and os support it
+	void	SetUseAVX2(bool b)	{ m_useAVX2 = b && HasAVX2(); }
+	bool	GetUseAVX2() const	{ return m_useAVX2; }
+	static bool HasAVX2();
+
+	UINT						GetNumVertices()		const { return m_numVertices; }
+	bool						HasBoneData()			const { return m_hasBoneData; }
+	const SkinnedVerticesSoA&	GetSkinnedVertices()	const { return m_skinned; }
+
+	// output transform of SkinningCS
+	static const float			OUTPUT_SCALE;
+	static const DirectX::XMFLOAT3 OUTPUT_OFFSET;
+
+protected:
+	void	SkinScalar(const SkinningOutput& out, UINT begin, UINT end) const;
+	void	SkinAVX2(const SkinningOutput& out, UINT begin, UINT end) const;
+
+	UINT				m_numVertices;
+	bool				m_hasNormals;
+	bool				m_hasBoneData;
+	bool				m_useAVX2;
+
+	std::vector<float>	m_x, m_y, m_z;			// base pose
+	std::vector<float>	m_nx, m_ny, m_nz;
+	std::vector<INT>	m_boneOffsets;			// 4 arrays of palette offsets (bone * 12), invalid bones point to the zero matrix
+	std::vector<float>	m_boneWeights;			// 4 arrays of weights
+	std::vector<float>	m_palette;				// first 3 rows of the bone matrices, + zero matrix
+
+	SkinnedVerticesSoA	m_skinned;
+};
@@ -31,12 +31,14 @@
 
 #include "scene/Scene.h"
 #include "scene/ModelLoader.h"
+#include "scene/AsyncModelLoader.h"
 #include "scene/ModelInstance.h"
 #include "scene/DXSubDModel.h"
 
 #include "dynamics/Physics.h"
 #include "dynamics/AnimationGroup.h"
 #include "dynamics/SkinningAnimation.h"
+#include "dynamics/AnimationLOD.h"
 #include "dynamics/Car.h"
 #include "dynamics/Character.h"
 
@@ -60,6 +62,10 @@
 #include <SDX/DXPerfEvent.h>
 #include <SDX/DXShaderManager.h>
 #include "utils/FrameProfiler.h"
+#include "utils/WorkStealingPool.h"
+#include "utils/TaskGraph.h"
+#include "compute/OsdCPUComputeController.h"
+#include "compute/ComputeBackendD3D11.h"
 
 //#define TW_NO_LIB_PRAGMA
 #include "AntTweakBar.h"
@@ -75,8 +81,6 @@ using namespace DirectX;
 using namespace Microsoft::WRL;
 
 
-App g_app;
-
 Scene*						g_scene = NULL;
 Physics*					g_physics = NULL;
 
@@ -185,6 +189,9 @@ bool						g_UseMSAABackBuffer = true;
 XMFLOAT3					g_LightDir(0.0f, 0.0f, -1.0f);
 bool						g_UpdateLightDir = true;
 
+TaskGraph					g_frameGraph;
+bool						g_dumpJobTrace = false;	// writes the per job timings of the next frame
+
 std::string					g_CurrentCameraFile = std::string("camera.cam");
 std::string					g_CurrentCharFile = std::string("character.char");
 
@@ -212,40 +219,6 @@ D3D_DRIVER_TYPE DXDriverType = D3D_DRIVER_TYPE_HARDWARE;
 HINSTANCE hInst;								// current instance
 
 
-void ApplyGlobalSettings()
-{
-	g_app.g_bRunSimulation = false;
-	g_app.g_fDisplacementScalar = 1.0f;
-	g_app.g_displacementTileSize = 128;
-	g_app.g_colorTileSize	     = 32;
-	g_app.g_maxSubdivisions      = 5;
-
-	g_app.g_memDebugDoPrealloc		= false; // prealloc for all mesh patches and disable mem management
-
-	// with memory management
-	g_app.g_memNumColorTiles	    = 3000;	 // preallocated buffer elements
-	g_app.g_memNumDisplacementTiles = 3000;//2000;	 // preallocated buffer elements
-
-	g_app.g_memMaxNumTilesPerObject = 85000;
-
-	g_app.g_adaptiveVoxelizationScale	= 50;
-	g_app.g_bShowVoxelization			= false;
-	g_app.g_showAllocated				= false;
-	g_app.g_fTessellationFactor			= 32.f;
-	g_app.g_voxelDeformationMultiSampling = false;
-	g_app.g_withVoxelJittering			= true;
-	g_app.g_withVoxelOBBRotate			= false;
-	g_app.g_profilePipelineStages		= false;
-	g_app.g_useCompactedVisibilityOverlap = true;
-	g_app.g_withOverlapUpdate = true;
-
-	g_app.g_useCulling					= true;		// ALWAYS ENABLE!!!, use below to disable culling for ray casting		// culling doubles performance on gtx 480, TODO patch frustum culling
-	g_app.g_useCullingForRayCast		= true;
-
-	g_app.g_useDisplacementConstraints = false;  // activate for best quality - ! has to be active on app start 
-
-	g_app.g_withPaintSculptTimings = false;
-}
 
 
 void RenderSkydome(ID3D11DeviceContext1* pd3dImmediateContext) 
@@ -299,7 +272,7 @@ void RenderSceneObjects( ID3D11DeviceContext1* pd3dImmediateContext, bool showTr
 //--------------------------------------------------------------------------------------
 void RenderText()
 {
-	if (g_app.g_bTimingsEnabled) g_app.g_TimingLog.printTimings();	
+	// the stage timings are printed when they are switched off again (T)
 }
 
 
@@ -476,24 +449,10 @@ void ApplyAdaptiveSubdivision(ID3D11DeviceContext1* pd3dImmediateContext, const
 			// todo maybe precompute tess factors to make them match in shadow and standard rendering
 			// todo maybe refine only up to specific subd level (<MAX_SUBDIVS) depending on model distance
 
-			if (g_app.g_bTimingsEnabled) 
 			{
-				g_app.WaitForGPU();
-
-				g_app.g_TimingLog.m_dGPUSubdivTotal -= GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-
-				for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns+1; i++) //needs to be an odd number
-				{
-					mesh->GetMesh()->Refine();  // run gpu subdiv			
-				}
-
-				g_app.WaitForGPU();
-				g_app.g_TimingLog.m_dGPUSubdivTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-				g_app.g_TimingLog.m_uGPUSubdivCount++;
-			}
-			else 
-			{					
-				mesh->GetMesh()->Refine();  // run gpu subdiv				
+				TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::GPU_SUBDIV);
+				g_profiler.AddGPUScopeValue(mesh->GetNumPTexFaces());
+				mesh->Refine();  // run gpu subdiv				
 				//mesh->GetMesh()->Synchronize(); // wait for update
 			}
 
@@ -714,6 +673,11 @@ HRESULT CALLBACK OnD3D11CreateDevice( ID3D11Device1* pd3dDevice,
 	OutputDebugStringW(L"App::Create()\n");
 	V_RETURN(g_app.Create(pd3dDevice));
 
+	V_RETURN(g_workStealingPool.Create());
+	V_RETURN(g_modelLoader.Create(g_app.g_numLoaderThreads));
+	V_RETURN(g_computeBackendD3D11.Create(pd3dDevice, pd3dImmediateContext));
+	g_computeBackend = &g_computeBackendD3D11;
+
 	OutputDebugStringW(L"Create FrameProfiler\n");
 	V_RETURN(g_frameProfiler.Create(pd3dDevice));
 
@@ -758,6 +722,7 @@ HRESULT CALLBACK OnD3D11CreateDevice( ID3D11Device1* pd3dDevice,
 
 
 	g_app.g_osdSubdivider =  new OpenSubdiv::OsdD3D11ComputeController(DXUTGetD3D11DeviceContext());
+	g_app.g_osdSubdividerCPU = new OsdCPUComputeController();
 	
 	int numDisplMipMaps = 0;
 	int numColorMipMaps = 0;
@@ -787,7 +752,7 @@ g_app.g_envMapSRV = g_textureManager.AddTexture("../../media/textures/env_sky.dd
 	g_LightCamera.SetProjParams( XM_PIDIV4, 1, 20.f, 1000.0f );
 	g_LightCamera.FrameMove( 0);
 
-	ModelLoader::Load("media/models/valley/valley.dae", g_scene);
+	g_modelLoader.Enqueue("media/models/valley/valley.dae", g_scene);
 	//ModelLoader::Load("media/models/valley/valley2.dae", g_scene);
 	
 	//ModelLoader::Load("../../media/models/terrain7.dae", g_scene);
@@ -796,9 +761,11 @@ g_app.g_envMapSRV = g_textureManager.AddTexture("../../media/textures/env_sky.dd
 	{
 		// Skydome
 		g_SkydomeGroup = new ModelGroup();
-		ModelLoader::Load("media/models/skydome.dae", g_scene, NULL, g_SkydomeGroup);
+		g_modelLoader.Enqueue("media/models/skydome.dae", g_scene, NULL, g_SkydomeGroup);
 	}
 
+	// terrain, skydome and car files are prepared together on the loader threads.
+	// the car waits for its models, which inserts the files queued before them first, so groups and instance ids keep the synchronous order
 	if (g_UseCar) 
 	{
 		g_Car = new Car();
@@ -861,6 +828,14 @@ void CALLBACK OnD3D11DestroyDevice( void* pUserContext )
 	SAFE_RELEASE(g_pDepthStencilStateDefault);
 	SAFE_RELEASE(g_pDepthStencilStateNoDepth);
 	
+	// stage histograms of the session
+	if (g_app.g_TimingLog.hasTimings())
+	{
+		g_app.g_TimingLog.printTimings();
+		g_app.g_TimingLog.writeCSV("timings.csv");
+		g_app.g_TimingLog.writeJSON("timings.json");
+	}
+
 	g_app.Destroy();
 	g_frameProfiler.Destroy();
 	g_rendererBBoxes.Destroy();
@@ -878,6 +853,9 @@ void CALLBACK OnD3D11DestroyDevice( void* pUserContext )
 	g_deformation.Destroy();
 	g_intersectGPU.Destroy();
 	g_overlapUpdater.Destroy();
+	g_computeBackendD3D11.Destroy();
+	g_modelLoader.Destroy();
+	g_workStealingPool.Destroy();
 
 
 	delete g_scene;
@@ -889,108 +867,11 @@ void CALLBACK OnD3D11DestroyDevice( void* pUserContext )
 
 }
 
-//------------------------------------------------------------ --------------------------
-// Render 
-//--------------------------------------------------------------------------------------
-void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContext1* pd3dImmediateContext,  double fTime,  float fElapsedTime,  void* pUserContext )
+// follow cameras, runs as main thread task of the frame graph once the car has moved
+void UpdateFollowCamera()
 {
-	HRESULT hr = S_OK;
-
-#ifdef _DEBUG
-	ReloadShadersDebug();
-#endif
-	g_frameProfiler.FrameStart(pd3dImmediateContext);
-
-	if (g_UpdateLightDir) {
-		XMFLOAT3 eye = *g_LightCamera.GetEyePt();
-		XMFLOAT3 lookAt = *g_LightCamera.GetLookAtPt();
-
-		float distance;
-		XMStoreFloat(&distance, XMVector3Length(XMVectorSubtract(XMLoadFloat3(&lookAt), XMLoadFloat3(&eye))));
-		XMStoreFloat3(&lookAt, XMVectorScale(XMLoadFloat3(&g_LightDir), distance));
-		g_LightCamera.SetViewParams(&eye, &lookAt);
-		g_LightCamera.SetProjParams(XM_PIDIV4, 1, 20.f, 1000.0f);
-		g_LightCamera.FrameMove(0);
-	}
-
-	// skinning update	
-//#ifdef FRANKIE
-	double currentTime = fTime;
-	static bool paused = true;
-	if(g_AnimatedCharacter)
-	{
-			
-
-	static double startPauseTime = 0;
-	static double accumulatedPauseDuration = 0;
-	
-	if (g_bTriggerPause) {
-		if (paused) 
-		{
-			accumulatedPauseDuration += currentTime - startPauseTime;
-		}
-		else 
-		{
-			startPauseTime = currentTime;
-		}
-		paused = !paused;
-		g_bTriggerPause = false;
-	}
-
-	if (paused) 
-		currentTime = startPauseTime;		
-
-	currentTime -= accumulatedPauseDuration;
-	}
-//#endif
-
-	if ((g_PlayRecord || g_DumpRecord) && (g_Car || g_Character)) {
-#ifdef TERRAIN
-		//fElapsedTime = 1.0f/(40.f);
-		fElapsedTime = 1.0f/(500.f);
-#endif
-	}
-
-	if(g_UseSkinning && g_app.g_bRunSimulation && g_AnimatedCharacter)	
-	{	
-		if ((g_PlayRecord || g_DumpRecord)) {
-			static int frame = -1;
-			if (!paused)
-				frame++;
-			if (frame < 0) frame = 0;
- 			currentTime = frame * fElapsedTime;
-		}
-
-
-
-		for(auto group : g_scene->GetAnimatedModels())
-		{ 
-			g_skinning.ApplySkinning(pd3dImmediateContext, group, (float) currentTime);
-		}
-	}
-	
-	if(g_app.g_bRunSimulation)
-	{
-		GameControls(fElapsedTime); // keyboard control character or car
-	}
-
-	// update pysics and model trafos
-	if(g_physics && g_app.g_bRunSimulation)
-	{	
-		if(g_physics && g_Car)	
-			g_Car->Update(g_physics, fElapsedTime);
-
-		g_physics->stepSimulation(fElapsedTime, 10);
-		
-		for(auto group : g_scene->GetModelGroups() ) 
-			group->UpdateModelMatrix();
-	}
-
-	g_scene->UpdateAABB(false); // do not update each frame
-
-
 	// CAM_FOLLOW1
-	if(g_CameraSelector == CAM_FOLLOW1 && g_scene->GetModelGroups().size() > 0)
+	if(g_CameraSelector == CAM_FOLLOW1 && g_scene->GetModelGroups().size() > 0 && !g_scene->GetStadiumCamPositions().empty())
 	{		
 		const std::vector<XMFLOAT3>& scp = g_scene->GetStadiumCamPositions();
 		int N = (int)scp.size();
@@ -1072,7 +953,155 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContex
 
 		}
 	}
+}
+
+//------------------------------------------------------------ --------------------------
+// Render 
+//--------------------------------------------------------------------------------------
+void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContext1* pd3dImmediateContext,  double fTime,  float fElapsedTime,  void* pUserContext )
+{
+	HRESULT hr = S_OK;
+
+#ifdef _DEBUG
+	ReloadShadersDebug();
+#endif
+	g_frameProfiler.FrameStart(pd3dImmediateContext);
+
+	// models finished by the loader threads, inserted before the cpu stages of the frame see the scene
+	if (!g_modelLoader.IsIdle() && g_modelLoader.Update(g_app.g_loadBudgetMS) > 0 && g_modelLoader.IsIdle())
+		g_modelLoader.PrintTimings();
+
+	if (g_UpdateLightDir) {
+		XMFLOAT3 eye = *g_LightCamera.GetEyePt();
+		XMFLOAT3 lookAt = *g_LightCamera.GetLookAtPt();
+
+		float distance;
+		XMStoreFloat(&distance, XMVector3Length(XMVectorSubtract(XMLoadFloat3(&lookAt), XMLoadFloat3(&eye))));
+		XMStoreFloat3(&lookAt, XMVectorScale(XMLoadFloat3(&g_LightDir), distance));
+		g_LightCamera.SetViewParams(&eye, &lookAt);
+		g_LightCamera.SetProjParams(XM_PIDIV4, 1, 20.f, 1000.0f);
+		g_LightCamera.FrameMove(0);
+	}
+
+	// skinning update	
+//#ifdef FRANKIE
+	double currentTime = fTime;
+	static bool paused = true;
+	if(g_AnimatedCharacter)
+	{
+			
+
+	static double startPauseTime = 0;
+	static double accumulatedPauseDuration = 0;
+	
+	if (g_bTriggerPause) {
+		if (paused) 
+		{
+			accumulatedPauseDuration += currentTime - startPauseTime;
+		}
+		else 
+		{
+			startPauseTime = currentTime;
+		}
+		paused = !paused;
+		g_bTriggerPause = false;
+	}
+
+	if (paused) 
+		currentTime = startPauseTime;		
+
+	currentTime -= accumulatedPauseDuration;
+	}
+//#endif
+
+	if ((g_PlayRecord || g_DumpRecord) && (g_Car || g_Character)) {
+#ifdef TERRAIN
+		//fElapsedTime = 1.0f/(40.f);
+		fElapsedTime = 1.0f/(500.f);
+#endif
+	}
+
+	const bool runSkinning = g_UseSkinning && g_app.g_bRunSimulation && g_AnimatedCharacter;
+	if(runSkinning)	
+	{	
+		if ((g_PlayRecord || g_DumpRecord)) {
+			static int frame = -1;
+			if (!paused)
+				frame++;
+			if (frame < 0) frame = 0;
+ 			currentTime = frame * fElapsedTime;
+		}
+	}
+	
+	if(g_app.g_bRunSimulation)
+	{
+		GameControls(fElapsedTime); // keyboard control character or car
+	}
 
+	// cpu stages of the frame as task graph, independent stages run in parallel on the work stealing pool.
+	// tasks which use the immediate context or the ui cameras run on this thread
+	{
+		// the car would fall through terrain which has not been inserted yet
+		const bool runPhysics = g_physics && g_app.g_bRunSimulation && g_modelLoader.IsIdle();
+		const bool detectCollisions = !g_physics || g_app.g_bRunSimulation || g_app.g_bShowVoxelization;
+		const float animationTime = (float)currentTime;
+
+		// camera and collision pairs of the last frame, both are written by tasks of the graph
+		if (runSkinning && g_app.g_useAnimationLOD)
+			g_animationLOD.SelectLevels(g_scene->GetAnimatedModels(), XMLoadFloat3(g_Camera.GetEyePt()), g_deformationPipeline.GetCollisionPairs());
+
+		g_frameGraph.Clear();
+
+		TaskID animation = g_frameGraph.AddTask("animation", [=]{
+			if (runSkinning) g_skinning.ComputeAnimations(g_scene->GetAnimatedModels(), animationTime);
+		});
+		TaskID skinning = g_frameGraph.AddTask("skinning", [=]{
+			if (!runSkinning) return;
+			for(auto group : g_scene->GetAnimatedModels())
+				g_skinning.ApplySkinning(pd3dImmediateContext, group, animationTime, false);
+		}, true);
+
+		// update pysics and model trafos
+		TaskID physics = g_frameGraph.AddTask("physics", [=]{
+			if (!runPhysics) return;
+			if(g_Car)	
+				g_Car->Update(g_physics, fElapsedTime);
+			g_physics->stepSimulation(fElapsedTime, 10);
+		});
+		TaskID modelMatrices = g_frameGraph.AddTask("model matrices", [=]{
+			if (runPhysics) g_scene->UpdateModelMatrices();
+		});
+		TaskID sceneAABB = g_frameGraph.AddTask("scene aabb", []{
+			g_scene->UpdateAABB(false); // do not update each frame
+		});
+		TaskID collisionPairs = g_frameGraph.AddTask("collision pairs", [=]{
+			if (detectCollisions) g_deformationPipeline.DetectDeformableCollisionPairs(g_physics, g_bUsePhysicsCollisionDetection);
+		});
+
+		TaskID camera = g_frameGraph.AddTask("camera", []{ UpdateFollowCamera(); }, true);
+		TaskID cascades = g_frameGraph.AddTask("cascades", []{
+			if (g_UseShadowMapping) g_shadow.ComputeCascades(&g_Camera, g_LightDir);
+		});
+
+		g_frameGraph.AddDependency(skinning, animation);
+		g_frameGraph.AddDependency(modelMatrices, physics);
+		g_frameGraph.AddDependency(sceneAABB, modelMatrices);
+		g_frameGraph.AddDependency(collisionPairs, modelMatrices);
+		// the skinning refits the model obbs, the world obbs and the collision pairs are derived from them
+		g_frameGraph.AddDependency(modelMatrices, skinning);
+		g_frameGraph.AddDependency(collisionPairs, skinning);
+		g_frameGraph.AddDependency(camera, physics);
+		g_frameGraph.AddDependency(cascades, camera);
+
+		g_frameGraph.SetTracing(g_dumpJobTrace);
+		g_frameGraph.Execute();
+		if (g_dumpJobTrace)
+		{
+			g_frameGraph.WriteTrace("jobtrace.json");
+			std::cout << "job trace written to jobtrace.json (" << g_frameGraph.GetLastExecuteMS() << " ms)" << std::endl;
+			g_dumpJobTrace = false;
+		}
+	}
 
 
 	XMMATRIX mView  = g_Camera.GetViewMatrix();	
@@ -1111,7 +1140,7 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContex
 		g_frameProfiler.BeginQuery(pd3dImmediateContext,DXPerformanceQuery::DEFORMATION);
 		if (!g_physics || g_app.g_bRunSimulation || g_app.g_bShowVoxelization)
 		{
-			g_deformationPipeline.DetectDeformableCollisionPairs(g_physics, g_bUsePhysicsCollisionDetection);
+			// collision pairs are detected by the frame graph
 			g_deformationPipeline.CheckAndApplyDeformation(pd3dDevice, pd3dImmediateContext);
 		}
 		
@@ -1124,13 +1153,8 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContex
 
 			for (auto& deformationPair : g_deformationPipeline.GetCollisionPairs())
 			{
-				for (auto& penetratorMap : deformationPair.second)
-				{
-					ModelInstance* penetrator = penetratorMap.first;
-					DXObjectOrientedBoundingBox isctOBB = penetratorMap.second;
-					g_rendererBBoxes.RenderOBB(&isctOBB);
-				}
-
+				DXObjectOrientedBoundingBox isctOBB = deformationPair.obb;
+				g_rendererBBoxes.RenderOBB(&isctOBB);
 			}
 		}
 		
@@ -1450,12 +1474,6 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device1* pd3dDevice,  ID3D11DeviceContex
 	g_frameProfiler.EndQuery(pd3dImmediateContext, DXPerformanceQuery::GUI);
 	g_frameProfiler.FrameEnd(pd3dImmediateContext);
 
-	if(g_app.g_bTimingsEnabled)
-	{
-		g_app.g_TimingLog.printTimings();
-		g_app.g_TimingLog.resetTimings();
-	}
-
 	if(g_app.g_useCompactedVisibilityOverlap)
 	{	
 		for(auto groups : g_scene->GetModelGroups())
@@ -1691,8 +1709,17 @@ void CALLBACK OnKeyboard( UINT nChar, bool bKeyDown, bool bAltDown, void* pUserC
 				std::cout << "shader errors" << std::endl;
 			break;
 		case UINT('T'):	
-			std::cout << "Reset" << std::endl;	
+			// the stage histograms keep collecting until the timings are switched off
 			g_app.g_bTimingsEnabled = !g_app.g_bTimingsEnabled;
+			if (g_app.g_bTimingsEnabled)
+			{
+				std::cout << "stage timings on" << std::endl;
+				g_app.g_TimingLog.resetTimings();
+			}
+			else
+			{
+				g_app.g_TimingLog.printTimings();
+			}
 			break;
 
 		case UINT('P'):
@@ -1754,6 +1781,19 @@ HRESULT InitGUI()
 
 		TwAddVarCB(mainBar, "simulation", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_bRunSimulation = *static_cast<const bool *>(value); },
 			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_bRunSimulation; }, NULL, "label = 'run physics'");
+		TwAddButton(mainBar, "JobTrace", (TwButtonCallback)[](void* clientData){ g_dumpJobTrace = true; }, NULL, "label = 'dump job trace' group='Scene'");
+
+		// animation lod
+		TwAddVarCB(mainBar, "AnimationLOD", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){
+			g_app.g_useAnimationLOD = *static_cast<const bool *>(value);
+			if (g_scene) g_animationLOD.Reset(g_scene->GetAnimatedModels());
+		}, (TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_useAnimationLOD; }, NULL, "label = 'animation lod' group='Animation'");
+		TwAddVarRO(mainBar, "LODUpdated", TW_TYPE_UINT32, (UINT*)&g_animationLOD.GetStats().numUpdated, "label = 'updated groups' group='Animation'");
+		TwAddVarRO(mainBar, "LODInterpolated", TW_TYPE_UINT32, (UINT*)&g_animationLOD.GetStats().numInterpolated, "label = 'interpolated groups' group='Animation'");
+		TwAddVarRO(mainBar, "LODHeld", TW_TYPE_UINT32, (UINT*)&g_animationLOD.GetStats().numHeld, "label = 'held groups' group='Animation'");
+		TwAddVarRO(mainBar, "LODSavedMS", TW_TYPE_DOUBLE, (double*)&g_animationLOD.GetStats().savedAnimationMS, "label = 'saved cpu ms' group='Animation'");
+		TwAddVarRO(mainBar, "LODSkippedVertices", TW_TYPE_UINT32, (UINT*)&g_animationLOD.GetStats().numSkippedVertices, "label = 'skipped skinning vertices' group='Animation'");
+		TwAddVarRO(mainBar, "LODSkippedDispatches", TW_TYPE_UINT32, (UINT*)&g_animationLOD.GetStats().numSkippedDispatches, "label = 'skipped gpu dispatches' group='Animation'");
 
 		// deformation
 		TwAddVarRW(mainBar, "voxelscaler", TW_TYPE_FLOAT, (float*)&(g_app.g_adaptiveVoxelizationScale), "min=1 max=100 step=0.5 label='voxel scaler' group='Deformation'");
@@ -1767,10 +1807,36 @@ HRESULT InitGUI()
 			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_withVoxelOBBRotate; }, NULL, "label = 'voxel obb rotate' group='Deformation'");
 		TwAddVarCB(mainBar, "CompactedOverlap", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_useCompactedVisibilityOverlap = *static_cast<const bool *>(value); },
 			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_useCompactedVisibilityOverlap; }, NULL, "label = 'compacted overlap' group='Deformation'");
+		TwAddVarCB(mainBar, "DirtyEdgeOverlap", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_useDirtyEdgeOverlap = *static_cast<const bool *>(value); },
+			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_useDirtyEdgeOverlap; }, NULL, "label = 'dirty edge overlap' group='Deformation'");
 		TwAddVarCB(mainBar, "CulledRaycast", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_useCullingForRayCast = *static_cast<const bool *>(value); },
 			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_useCullingForRayCast; }, NULL, "label = 'culling raycast' group='Deformation'");
 		TwAddVarCB(mainBar, "OverlapUpdate", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_withOverlapUpdate = *static_cast<const bool *>(value); },
 			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_withOverlapUpdate; }, NULL, "label = 'update overlap' group='Deformation'");
+		TwAddVarCB(mainBar, "TemporalIsct", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_useTemporalIntersection = *static_cast<const bool *>(value); },
+			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_useTemporalIntersection; }, NULL, "label = 'temporal intersection' group='Deformation'");
+		TwAddVarCB(mainBar, "ValidateTemporalIsct", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_validateTemporalIntersection = *static_cast<const bool *>(value); },
+			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_validateTemporalIntersection; }, NULL, "label = 'validate temporal (stalls)' group='Deformation'");
+
+		// deformation counters of the last resolved frame
+		TwAddVarCB(mainBar, "DeformationStats", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){
+			g_app.g_deformationStats = *static_cast<const bool *>(value);
+			g_deformation.ResetStats();
+		}, (TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_deformationStats; }, NULL, "label = 'count work' group='Deformation Stats'");
+		TwAddVarCB(mainBar, "ValidateDeformationStats", TW_TYPE_BOOLCPP, (TwSetVarCallback)[](const void *value, void* clientData){g_app.g_validateDeformationStats = *static_cast<const bool *>(value); },
+			(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) = g_app.g_validateDeformationStats; }, NULL, "label = 'validate (stalls)' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformTiles", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numTiles, "label = 'tiles' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformTexels", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numTexels, "label = 'texels evaluated' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformRays", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numRays, "label = 'rays' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformDDASteps", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numDDASteps, "label = 'dda steps' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformVoxelsHit", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numVoxelsHit, "label = 'voxels hit' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformSkipInvisible", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numSkipInvisible, "label = 'skip not intersected' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformSkipUnallocated", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numSkipUnallocated, "label = 'skip unallocated' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformSkipMiss", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numSkipMiss, "label = 'skip no hit' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformSkipZero", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numSkipZero, "label = 'skip zero depth' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformTexelsWritten", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numTexelsWritten, "label = 'texels written' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformTexelsChanged", TW_TYPE_UINT32, (UINT*)&g_deformation.GetLastStats().numTexelsChanged, "label = 'texels changed' group='Deformation Stats'");
+		TwAddVarRO(mainBar, "DeformMaxDelta", TW_TYPE_FLOAT, (float*)&g_deformation.GetLastStats().maxDelta, "label = 'max delta' group='Deformation Stats'");
 
 
 		// debug vis
@@ -571,23 +571,9 @@ HRESULT RendererSubD::FrameRender( ID3D11DeviceContext1* pd3dImmediateContext, M
 	if(!instance->IsSubD()) return S_OK;
 
 	
-	if (g_app.g_bTimingsEnabled) {
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dDrawSubDTotal -= GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns+1; i++) { //needs to be an odd number
-			//g_app.SetCameraConstantBuffersAllStages(pd3dImmediateContext);
-			V(FrameRenderInternal(pd3dImmediateContext, instance));
-			if(FAILED(hr))
-			{
-				g_app.g_TimingLog.m_dDrawSubDTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-				g_app.g_TimingLog.m_uDrawSubDCount++;
-				break;
-			}
-		}
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dDrawSubDTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		g_app.g_TimingLog.m_uDrawSubDCount++;
-	} else {
+	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::DRAW_SUBD);
+		g_profiler.AddGPUScopeValue(1);
 		V_RETURN(FrameRenderInternal(pd3dImmediateContext, instance));
 	}
 
@@ -822,26 +808,9 @@ HRESULT RendererSubD::Voxelize( ID3D11DeviceContext1* pd3dImmediateContext, Mode
 	
 	_voxelizeMode		= true;
 
-	if (g_app.g_bTimingsEnabled) 
-	{
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dVoxelizationTotal -= GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns+1; i++) //needs to be an odd number			
-		{ 
-			V(FrameRenderInternal(pd3dImmediateContext, instance));
-			if(FAILED(hr))
-			{
-				g_app.g_TimingLog.m_dVoxelizationTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-				g_app.g_TimingLog.m_uVoxelizationCount++;
-				break;
-			}
-		}
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dVoxelizationTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		g_app.g_TimingLog.m_uVoxelizationCount++;
-	}
-	else 
 	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::VOXELIZATION);
+		g_profiler.AddGPUScopeValue(1);
 		V_RETURN(FrameRenderInternal(pd3dImmediateContext, instance));
 	}
 		
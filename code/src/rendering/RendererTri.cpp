@@ -219,20 +219,9 @@ HRESULT RenderTri::FrameRender( ID3D11DeviceContext1* pd3dImmediateContext, cons
 	// setup vertex buffers
 	//pd3dImmediateContext->IASetInputLayout( m_inputLayout );
 
-	if (g_app.g_bTimingsEnabled) 
-	{
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dDrawTotal -= GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns+1; i++) { //needs to be an odd number
-			FrameRenderInternal(pd3dImmediateContext, instance);
-		}
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dDrawTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		g_app.g_TimingLog.m_uDrawCount++;
-
-	}
-	else 
 	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::DRAW_TRI);
+		g_profiler.AddGPUScopeValue(1);
 		FrameRenderInternal(pd3dImmediateContext, instance);
 	}
 
@@ -297,24 +286,11 @@ HRESULT RenderTri::Voxelize( ID3D11DeviceContext1* pd3dImmediateContext, const M
 
 	if(instance->IsSubD()) return hr;
 
-	if (g_app.g_bTimingsEnabled) {
-		g_app.WaitForGPU();
-
-		g_app.g_TimingLog.m_dVoxelizationTotal -= GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-
-		for (UINT i = 0; i < g_app.g_TimingLog.m_uNumRuns+1; i++)  //needs to be an odd number
-		{
-			VoxelizeInternal(pd3dImmediateContext, instance);
-		}
-
-		g_app.WaitForGPU();
-		g_app.g_TimingLog.m_dVoxelizationTotal += GetTimeMS()/(double)(g_app.g_TimingLog.m_uNumRuns+1);
-		g_app.g_TimingLog.m_uVoxelizationCount++;
-	}
-	else 
 	{
+		TIMING_STAGE_SCOPE(pd3dImmediateContext, TimingStage::VOXELIZATION);
+		g_profiler.AddGPUScopeValue(1);
 		VoxelizeInternal(pd3dImmediateContext, instance);
-	}	
+	}
 
 	return hr;
 }
@@ -540,7 +540,7 @@ ShadowMapping::ShadowMapping()
 	m_useBlurCS			 = false;
 	m_useBlurSharedMemCS = false;
 	m_useSinglePassShadow = false;
-	
+	m_cascadesComputed = false;
 
 }
 
@@ -984,51 +984,24 @@ void ShadowMapping::Destroy()
 
 
 
-//void ShadowMapping::ComputeCascades( CModelViewerCamera* renderCam, CModelViewerCamera* lightCam, Scene* scene )
-void ShadowMapping::ComputeCascades(CBaseCamera* renderCam, CModelViewerCamera* lightCam, Scene* scene )
+// fits the cascades to the camera frustum, cpu only so it can run as a job before RenderShadowMap
+void ShadowMapping::ComputeCascades(CBaseCamera* renderCam, const XMFLOAT3& lightDir)
 {
-	XMVECTOR sceneAABBMin = XMLoadFloat3(&scene->GetSceneAABBMin());
-	XMVECTOR sceneAABBMax = XMLoadFloat3(&scene->GetSceneAABBMax());
-	sceneAABBMin = XMVectorSetW(sceneAABBMin, 1);
-	sceneAABBMax = XMVectorSetW(sceneAABBMax, 1);
-	
-	const XMMATRIX& matViewCameraProjection = renderCam->GetProjMatrix();	
-	const XMMATRIX& matViewCameraView = renderCam->GetViewMatrix();
-	XMMATRIX matInverseViewCamera = XMMatrixInverse( NULL,  matViewCameraView );
-	const XMMATRIX& matLightCameraView = lightCam->GetViewMatrix();
-
-
-	// Convert from min max representation to center extents representation.
-	// This will make it easier to pull the points out of the transformation.
-	XMVECTOR vSceneCenter = (sceneAABBMin + sceneAABBMax) * g_vHalfVector;
-	XMVECTOR vSceneExtents = (sceneAABBMax - sceneAABBMin) * g_vHalfVector ;
-		
-	XMVECTOR vSceneAABBPointsLightSpace[8];
-	// This function simply converts the center and extents of an AABB into 8 points
-	CreateAABBPoints( vSceneAABBPointsLightSpace, vSceneCenter, vSceneExtents );
-	
-	// Transform the scene AABB to Light space.
-	for( int index =0; index < 8; ++index ) 
-	{
-#ifdef SHADOW_DEBUG
-		XMStoreFloat3(&m_sceneAABBCorners[index],vSceneAABBPointsLightSpace[index]);
-#endif
-		vSceneAABBPointsLightSpace[index] = XMVector4Transform( vSceneAABBPointsLightSpace[index], matLightCameraView ); 		
-	}
-
-	const float minDistance = m_useDepthReduction ? m_depthMinMax.x : m_fCascadePartitionsMin;
-	const float maxDistance = m_useDepthReduction ? m_depthMinMax.y : m_fCascadePartitionsMax;
+	//const float minDistance = m_useDepthReduction ? XMMax(m_depthMinMax.x-0.1f, 0.f) : m_fCascadePartitionsMin;
+	//const float maxDistance = m_useDepthReduction ? XMMin(m_depthMinMax.y+0.1f,1.f) : m_fCascadePartitionsMax;
+	const float minDistance = m_useDepthReduction ? XMMax(m_depthMinMax.x, 0.f) : m_fCascadePartitionsMin;
+	const float maxDistance = m_useDepthReduction ? XMMin(m_depthMinMax.y, 1.f) : m_fCascadePartitionsMax;
 
-	float cascadeSplits[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	float cascadeSplits[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
 	if(m_ePartitionMode == PartitionMode::MANUAL)
 	{	
 		cascadeSplits[0] = minDistance + m_fSplitDistance[0] * maxDistance;
 		cascadeSplits[1] = minDistance + m_fSplitDistance[1] * maxDistance;
 		cascadeSplits[2] = minDistance + m_fSplitDistance[2] * maxDistance;
-	#if NUM_CASCADES == 4
+#if NUM_CASCADES == 4
 		cascadeSplits[3] = minDistance + m_fSplitDistance[3] * maxDistance;
-	#endif
+#endif
 	}
 	else if(m_ePartitionMode == PartitionMode::LOGARTIHMIC ||  m_ePartitionMode == PartitionMode::PSSM)
 	{
@@ -1043,292 +1016,350 @@ void ShadowMapping::ComputeCascades(CBaseCamera* renderCam, CModelViewerCamera*
 		float clipRange = farClip - nearClip;
 
 		float minZ = nearClip+minDistance*clipRange;
-		float maxZ = nearClip+minDistance*clipRange;
+		float maxZ = nearClip+maxDistance*clipRange;
 
 		float range = maxZ - minZ;
 		float ratio = maxZ / minZ;
-
+		//std::cout << "ration = " << ratio << std::endl;
 		for(UINT i = 0; i < NUM_CASCADES; ++i)
 		{
-			float p = (i+1) / (float)NUM_CASCADES;
+			float p = float(i+1) / (float)NUM_CASCADES;
+			//std::cout << "p_" <<i << " = " << p  << std::endl;
 			float log = minZ*std::pow(ratio, p);
 			float uniform = minZ + range * p;
 			float d = lambda*(log - uniform) + uniform;
 			cascadeSplits[i] = (d-nearClip)/clipRange;
+			//std::cout << "cascadeSplit"  << i << " = " << cascadeSplits[i] << std::endl;
 		}
 	}
 
 
-	float fFrustumIntervalBegin, fFrustumIntervalEnd;
-	XMVECTOR vLightCameraOrthographicMin;  // light space frustum AABB
-	XMVECTOR vLightCameraOrthographicMax;
-	float clipRange = renderCam->GetFarClip() - renderCam->GetNearClip();
+	// cascade splits computed
+
 
-	XMVECTOR vWorldUnitsPerTexel = g_vZero; 
+	// light direction
+	XMVECTOR vLightDir = XMVector3Normalize(-XMLoadFloat3(&lightDir)); //checkme -lightdir	
+	XMStoreFloat3(&m_lightDir, vLightDir);
 
-	// We loop over the cascades to calculate the orthographic projection for each cascade.
-	for( INT iCascadeIndex=0; iCascadeIndex < NUM_CASCADES; ++iCascadeIndex ) 
+	XMMATRIX renderViewProjectionMatrix = renderCam->GetViewMatrix()*renderCam->GetProjMatrix();
+	// compute global shadow matrix
+	XMMATRIX globalShadowMatrix;
 	{
-		// Calculate the interval of the View Frustum that this cascade covers. We measure the interval 
-		// the cascade covers as a Min and Max distance along the Z Axis.
-		if( m_eSelectedCascadesFit == FIT_PROJECTION_TO::CASCADES ) 
-		{
-			// Because we want to fit the orthographic projection tightly around the Cascade, we set the minimum cascade 
-			// value to the previous Frustum end Interval
-			if( iCascadeIndex==0 ) fFrustumIntervalBegin = minDistance;//0.0f;
-			else fFrustumIntervalBegin = cascadeSplits[ iCascadeIndex - 1 ];
-		} 
-		else 
+		
+		XMVECTOR frustumCorners[8] =
 		{
-			// In the FIT_TO_SCENE technique the Cascades overlap each other.  In other words, interval 1 is covered by
-			// cascades 1 to 8, interval 2 is covered by cascades 2 to 8 and so forth.
-			fFrustumIntervalBegin = 0.0f;
+			XMVectorSet(-1.0f,  1.0f, 0.0f, 1.0f),
+			XMVectorSet( 1.0f,  1.0f, 0.0f, 1.0f),
+			XMVectorSet( 1.0f, -1.0f, 0.0f, 1.0f),
+			XMVectorSet(-1.0f, -1.0f, 0.0f, 1.0f),
+			XMVectorSet(-1.0f,  1.0f, 1.0f, 1.0f),
+			XMVectorSet( 1.0f,  1.0f, 1.0f, 1.0f),
+			XMVectorSet( 1.0f, -1.0f, 1.0f, 1.0f),
+			XMVectorSet(-1.0f, -1.0f, 1.0f, 1.0f),
+		};
+		
+		XMMATRIX invViewProj = XMMatrixInverse(NULL, renderViewProjectionMatrix );
+		XMVECTOR frustumCenter = XMVectorSet(0,0,0,0);
+		for(unsigned int i = 0; i < 8; ++i)
+		{			
+			frustumCorners[i] = XMVector3TransformCoord(frustumCorners[i], invViewProj);//Float3::Transform(frustumCorners[i], invViewProj);
+			frustumCenter += frustumCorners[i];
 		}
 
-		// Scale the intervals between 0 and 1. They are now percentages that we can scale with.
-		fFrustumIntervalEnd = cascadeSplits[ iCascadeIndex ];        
-		fFrustumIntervalBegin = fFrustumIntervalBegin * clipRange;
-		fFrustumIntervalEnd = fFrustumIntervalEnd * clipRange;
-
-
-		XMVECTOR vFrustumPoints[8];		
-
-		// This function takes the began and end intervals along with the projection matrix and returns the 8
-		// points that represent the cascade Interval
-		CreateFrustumPointsFromCascadeInterval( fFrustumIntervalBegin, fFrustumIntervalEnd, matViewCameraProjection, vFrustumPoints );
+		frustumCenter /= 8.0f;
+		//XMVectorSetW(frustumCenter, 1);
+		// Pick the up vector to use for the light camera
+		
 
-		vLightCameraOrthographicMin = g_vFLTMAX;
-		vLightCameraOrthographicMax = g_vFLTMIN;
+		XMFLOAT3 upDir = renderCam->GetWorldRight();
+		
+		// This needs to be constant for it to be stable
+		if(m_stabilizeCascades)
+			upDir = XMFLOAT3(0.0f, 0.0f, 1.0f); // HENRY CHECKME 0,0,1?
+		
+		XMVECTOR vUpDir = XMLoadFloat3(&upDir);
+		
 
-		XMVECTOR vTempTranslatedCornerPoint;
-		// This next section of code calculates the min and max values for the orthographic projection.
-		for( int icpIndex=0; icpIndex < 8; ++icpIndex ) 
-		{
-			// Transform the frustum from camera view space to world space.
-			vFrustumPoints[icpIndex] = XMVector4Transform ( vFrustumPoints[icpIndex], matInverseViewCamera );
-			
-			// debug
-			#ifdef SHADOW_DEBUG
-			XMStoreFloat3(&m_viewFrustumCorners[iCascadeIndex][icpIndex], vFrustumPoints[icpIndex]);
-			#endif
+		// Create a temporary view matrix for the light
+		XMVECTOR lightCameraPos = frustumCenter;
+		XMVECTOR lookAt = frustumCenter - vLightDir;
+		XMMATRIX lightView = XMMatrixLookAtLH(lightCameraPos, lookAt, vUpDir);
 
-			// Transform the point from world space to Light Camera Space.
-			vTempTranslatedCornerPoint = XMVector4Transform ( vFrustumPoints[icpIndex], matLightCameraView );
 
-			// Find the closest point.
-			vLightCameraOrthographicMin = XMVectorMin ( vTempTranslatedCornerPoint, vLightCameraOrthographicMin );
-			vLightCameraOrthographicMax = XMVectorMax ( vTempTranslatedCornerPoint, vLightCameraOrthographicMax );
-		}
+		// Get position of the shadow camera
+		XMVECTOR shadowCameraPos = frustumCenter + vLightDir * -0.5;//-0.5f;
 
+		//PrintXMVECTOR_F4("light cam shadowCameraPos ", shadowCameraPos );
+		//PrintXMVECTOR_F4("light cam lookAt ", lookAt );
 
-		// This code removes the shimmering effect along the edges of shadows due to
-		// the light changing to fit the camera.
-		if( m_eSelectedCascadesFit == FIT_PROJECTION_TO::SCENE ) 
-		{
-			// Fit the ortho projection to the cascades far plane and a near plane of zero. 
-			// Pad the projection to be the size of the diagonal of the Frustum partition. 
-			// 
-			// To do this, we pad the ortho transform so that it is always big enough to cover 
-			// the entire camera view frustum.
-			XMVECTOR vDiagonal = vFrustumPoints[0] - vFrustumPoints[6];
-			vDiagonal = XMVector3Length( vDiagonal );
-
-			// The bound is the length of the diagonal of the frustum interval.
-			FLOAT fCascadeBound = XMVectorGetX( vDiagonal );
-
-			// The offset calculated will pad the ortho projection so that it is always the same size 
-			// and big enough to cover the entire cascade interval.
-			XMVECTOR vBoarderOffset = ( vDiagonal - 
-				( vLightCameraOrthographicMax - vLightCameraOrthographicMin ) ) 
-				* g_vHalfVector;
-			// Set the Z and W components to zero.
-			vBoarderOffset *= g_vMultiplySetzwToZero;
-
-			// Add the offsets to the projection.
-			vLightCameraOrthographicMax += vBoarderOffset;
-			vLightCameraOrthographicMin -= vBoarderOffset;
-
-			// The world units per texel are used to snap the shadow the orthographic projection
-			// to texel sized increments.  This keeps the edges of the shadows from shimmering.
-			FLOAT fWorldUnitsPerTexel = fCascadeBound / (float)SHADOW_MAP_RES;
-			vWorldUnitsPerTexel = XMVectorSet( fWorldUnitsPerTexel, fWorldUnitsPerTexel, 0.0f, 0.0f ); 
-		} 
-		else if( m_eSelectedCascadesFit == FIT_PROJECTION_TO::CASCADES ) 
-		{
+		// Come up with a new orthographic camera for the shadow caster
 
-			// We calculate a looser bound based on the size of the PCF blur.  This ensures us that we're 
-			// sampling within the correct map.
-			float fScaleDuetoBlureAMT = ( (float)( BLUR_KERNEL_SIZE * 2 + 1 ) / (float)SHADOW_MAP_RES );
-			XMVECTORF32 vScaleDuetoBlureAMT = { fScaleDuetoBlureAMT, fScaleDuetoBlureAMT, 0.0f, 0.0f };
+		XMMATRIX shadowProj = XMMatrixOrthographicOffCenterLH(-0.5, 0.5, -0.5, 0.5, 0.0, 1.0);
+		XMMATRIX shadowView = XMMatrixLookAtLH(shadowCameraPos, frustumCenter, vUpDir);
+		XMMATRIX shadowViewProj = shadowView * shadowProj;
+		//globalShadowMatrix = shadowView * shadowProj * XMMatrixScaling(0.5f, -0.5f, 1.0f) * XMMatrixTranslation(0.5f, 0.5f, 0.0f);
+		globalShadowMatrix = shadowViewProj *   XMMatrixScaling(0.5f, -0.5f, 1.0f) * XMMatrixTranslation(0.5f, 0.5f, 0.0f);
+		m_matShadowView = XMMatrixInverse(NULL, renderCam->GetViewMatrix()) * globalShadowMatrix;//shadowView;
+		//m_matShadowView = shadowView;		
+	}
 
 
-			float fNormalizeByBufferSize = ( 1.0f / (float)SHADOW_MAP_RES );
-			XMVECTOR vNormalizeByBufferSize = XMVectorSet( fNormalizeByBufferSize, fNormalizeByBufferSize, 0.0f, 0.0f );
+	// fit an orthographic projection to each cascade
+	for(uint32_t cascadeIdx = 0; cascadeIdx < NUM_CASCADES; ++cascadeIdx)
+	{
+		// set viewport
+		//set shadow map as render target
+		//clear
 
-			// We calculate the offsets as a percentage of the bound.
-			XMVECTOR vBoarderOffset = vLightCameraOrthographicMax - vLightCameraOrthographicMin;
-			vBoarderOffset *= g_vHalfVector;
-			vBoarderOffset *= vScaleDuetoBlureAMT;
-			vLightCameraOrthographicMax += vBoarderOffset;
-			vLightCameraOrthographicMin -= vBoarderOffset;
+		// Get the 8 points of the view frustum in world space
+		XMVECTOR frustumCornersWS[8] =
+		{
+			XMVectorSet(-1.0f,  1.0f, 0.0f, 1.0f),
+			XMVectorSet( 1.0f,  1.0f, 0.0f, 1.0f),
+			XMVectorSet( 1.0f, -1.0f, 0.0f, 1.0f),
+			XMVectorSet(-1.0f, -1.0f, 0.0f, 1.0f),
+			XMVectorSet(-1.0f,  1.0f, 1.0f, 1.0f),
+			XMVectorSet( 1.0f,  1.0f, 1.0f, 1.0f),
+			XMVectorSet( 1.0f, -1.0f, 1.0f, 1.0f),
+			XMVectorSet(-1.0f, -1.0f, 1.0f, 1.0f),
+		};
 
-			// The world units per texel are used to snap  the orthographic projection
-			// to texel sized increments.  
-			// Because we're fitting tightly to the cascades, the shimmering shadow edges will still be present when the 
-			// camera rotates.  However, when zooming in or strafing the shadow edge will not shimmer.
-			vWorldUnitsPerTexel = vLightCameraOrthographicMax - vLightCameraOrthographicMin;
-			vWorldUnitsPerTexel *= vNormalizeByBufferSize;
+		//float prevSplitDist = cascadeIdx == 0 ? minDistance : m_fSplitDistance[cascadeIdx - 1];		
+		//float splitDist = m_fSplitDistance[cascadeIdx];
+		float prevSplitDist = cascadeIdx == 0 ? minDistance : cascadeSplits[cascadeIdx - 1];
+		float splitDist = cascadeSplits[cascadeIdx];
+		
+		XMMATRIX invViewProj = XMMatrixInverse(nullptr, renderCam->GetViewMatrix()*renderCam->GetProjMatrix());
+		for(uint32_t i = 0; i < 8; ++i)
+		{
+			//frustumCornersWS[i] = Float3::Transform(frustumCornersWS[i], invViewProj);
+			frustumCornersWS[i] = XMVector3TransformCoord(frustumCornersWS[i], invViewProj);			
+		}
 
+		// Get the corners of the current cascade slice of the view frustum
+		for(uint32_t i = 0; i < 4; ++i)
+		{
+			XMVECTOR cornerRay = frustumCornersWS[i + 4] - frustumCornersWS[i];
+			XMVECTOR nearCornerRay = cornerRay * prevSplitDist;
+			XMVECTOR farCornerRay = cornerRay * splitDist;
+			frustumCornersWS[i + 4] = frustumCornersWS[i] + farCornerRay;
+			frustumCornersWS[i] = frustumCornersWS[i] + nearCornerRay;
 		}
 
+		// Calculate the centroid of the view frustum slice
+		XMVECTOR frustumCenter = XMVectorSet(0,0,0,0);
+		for(uint32_t i = 0; i < 8; ++i)
+			frustumCenter = frustumCenter + frustumCornersWS[i];
+		frustumCenter /=  8.0f;
+		//XMVectorSetW(frustumCenter,1.0);
+
+		// Pick the up vector to use for the light camera
+		XMFLOAT3 upDir = renderCam->GetWorldRight();
+		XMVECTOR vUpDir = XMLoadFloat3(&upDir);
 
-		if( m_bMoveLightTexelSize ) 
+		XMVECTOR minExtents;
+		XMVECTOR maxExtents;
+		if(m_stabilizeCascades)
 		{
+			// This needs to be constant for it to be stable
+			vUpDir = XMVectorSet(0.0f, 0.0f, 1.0f, 0.f);
 
-			// We snap the camera to 1 pixel increments so that moving the camera does not cause the shadows to jitter.
-			// This is a matter of integer dividing by the world space size of a texel
-			vLightCameraOrthographicMin /= vWorldUnitsPerTexel;
-			vLightCameraOrthographicMin = XMVectorFloor( vLightCameraOrthographicMin );
-			vLightCameraOrthographicMin *= vWorldUnitsPerTexel;
-
-			vLightCameraOrthographicMax /= vWorldUnitsPerTexel;
-			vLightCameraOrthographicMax = XMVectorFloor( vLightCameraOrthographicMax );
-			vLightCameraOrthographicMax *= vWorldUnitsPerTexel;
+			// Calculate the radius of a bounding sphere surrounding the frustum corners
+			float sphereRadius = 0.0f;
+			for(uint32_t i = 0; i < 8; ++i)
+			{
+				
+				float dist = XMVectorGetX(XMVector3Length(frustumCornersWS[i] - frustumCenter));
+				sphereRadius = std::max(sphereRadius, dist);
+			}
 
-		}
+			//sphereRadius = std::ceil(sphereRadius * 16.0f) / 16.0f;
+			//sphereRadius = 0.76*std::ceil(sphereRadius * 16.0f) / 16.0f; // CHECKME magic numer
+			sphereRadius = std::ceil(sphereRadius * 16.0f) / 16.0f; // CHECKME magic numer
 
-		//These are the unconfigured near and far plane values.  They are purposly awful to show 
-		// how important calculating accurate near and far planes is.
-		FLOAT fNearPlane = 0.0f;
-		FLOAT fFarPlane = 10000.0f;
 
-		if( m_eSelectedNearFarFit == FIT_NEAR_FAR::AABB ) 
+			maxExtents = XMVectorSet(sphereRadius, sphereRadius, sphereRadius, 0);
+			minExtents = -maxExtents;
+		}
+		else
 		{
+			// Create a temporary view matrix for the light
+			XMVECTOR lightCameraPos = frustumCenter;
+			XMVECTOR lookAt = frustumCenter - vLightDir;
+			XMMATRIX lightView = XMMatrixLookAtLH(lightCameraPos, lookAt, vUpDir);
 
-			XMVECTOR vLightSpaceSceneAABBminValue = g_vFLTMAX;  // world space scene aabb 
-			XMVECTOR vLightSpaceSceneAABBmaxValue = g_vFLTMIN;       
-			// We calculate the min and max vectors of the scene in light space. The min and max "Z" values of the  
-			// light space AABB can be used for the near and far plane. This is easier than intersecting the scene with the AABB
-			// and in some cases provides similar results.
-			for(int index=0; index< 8; ++index) 
+			// Calculate an AABB around the frustum corners
+			XMVECTOR mins = g_vFLTMAX;
+			XMVECTOR maxes = g_vFLTMIN;
+			for(uint32_t i = 0; i < 8; ++i)
 			{
-				vLightSpaceSceneAABBminValue = XMVectorMin( vSceneAABBPointsLightSpace[index], vLightSpaceSceneAABBminValue );
-				vLightSpaceSceneAABBmaxValue = XMVectorMax( vSceneAABBPointsLightSpace[index], vLightSpaceSceneAABBmaxValue );
+				XMVECTOR corner = XMVector3TransformCoord(frustumCornersWS[i], lightView);
+				mins = XMVectorMin(mins, corner);
+				maxes = XMVectorMax(maxes, corner);
 			}
 
-			// The min and max z values are the near and far planes.
-			fNearPlane = XMVectorGetZ( vLightSpaceSceneAABBminValue );
-			fFarPlane  = XMVectorGetZ( vLightSpaceSceneAABBmaxValue );
-		} 
-		else if( m_eSelectedNearFarFit == FIT_NEAR_FAR::SCENE_AABB ) 
-		{
-			// By intersecting the light frustum with the scene AABB we can get a tighter bound on the near and far plane.
-			ComputeNearAndFar( fNearPlane, fFarPlane, vLightCameraOrthographicMin,	vLightCameraOrthographicMax, vSceneAABBPointsLightSpace );
-		} 
-		else 
-		{
-			//exit(1);
+			minExtents = mins;
+			maxExtents = maxes;
+
+			// Adjust the min/max to accommodate the filtering size
+			float scale = (SHADOW_MAP_RES + BLUR_KERNEL_SIZE) / static_cast<float>(SHADOW_MAP_RES);
+			XMVECTOR vScale = XMVectorSet(scale,scale,1,1);	// scale x and y, leave z 
+			minExtents *= vScale;
+			maxExtents *= vScale;
 		}
 
-		// Crete the orthographic projection for this cascade.
-		m_matShadowProj[ iCascadeIndex ] = XMMatrixOrthographicOffCenterLH(	XMVectorGetX( vLightCameraOrthographicMin ), 
-																			XMVectorGetX( vLightCameraOrthographicMax ), 
-																			XMVectorGetY( vLightCameraOrthographicMin ), 
-																			XMVectorGetY( vLightCameraOrthographicMax ), 
-																			fNearPlane, fFarPlane );
+		XMVECTOR cascadeExtents = maxExtents - minExtents;
 
-		XMMATRIX mShadowTexture = m_matShadowProj[iCascadeIndex] * g_matTextureScale * g_matTextureTranslation;
-		XMFLOAT4X4 matShadowTexture;
-		XMStoreFloat4x4(&matShadowTexture, mShadowTexture);
+		// Get position of the shadow camera
+		XMVECTOR shadowCameraPos = frustumCenter + vLightDir * -XMVectorGetZ(minExtents);
 
-		m_cascadeOffsets[iCascadeIndex] = XMFLOAT3(matShadowTexture._41, matShadowTexture._42, matShadowTexture._43);
-		m_cascadeScales[iCascadeIndex] = XMFLOAT3(matShadowTexture._11,	matShadowTexture._22, matShadowTexture._33);
-		
-		// debug
-		#ifdef SHADOW_DEBUG
-		{
-			//std::cout << "cascade " << iCascadeIndex << std::endl;
-			std::cout << "left: " << 	XMVectorGetX( vLightCameraOrthographicMin ) << ", right: " <<  XMVectorGetX( vLightCameraOrthographicMax ) 
-				<< " bottom: " << XMVectorGetY( vLightCameraOrthographicMin ) << ", top: " << XMVectorGetY( vLightCameraOrthographicMax ) 
-				<< " near: " << fNearPlane << " far: " << fFarPlane << " frustum intervalEnd: " << fFrustumIntervalEnd << std::endl;
-
-			// debug
-			XMMATRIX matInverseLightCameraView = XMMatrixInverse( NULL,  matLightCameraView );
-
-			// transform corners to world space
-			// near
-			FLOAT l = XMVectorGetX( vLightCameraOrthographicMin );
-			FLOAT r = XMVectorGetX( vLightCameraOrthographicMax );
-			FLOAT b = XMVectorGetY( vLightCameraOrthographicMin );
-			FLOAT t = XMVectorGetY( vLightCameraOrthographicMax );
-						
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][0], XMVector4Transform ( XMVectorSet(l, b, fNearPlane,1), matInverseLightCameraView )); // lbn
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][1], XMVector4Transform ( XMVectorSet(r, b, fNearPlane,1), matInverseLightCameraView )); // rbn
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][2], XMVector4Transform ( XMVectorSet(r, t, fNearPlane,1), matInverseLightCameraView )); // rtn
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][3], XMVector4Transform ( XMVectorSet(l, t, fNearPlane,1), matInverseLightCameraView )); // ltn
-
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][4], XMVector4Transform ( XMVectorSet(l, b, fFarPlane,1), matInverseLightCameraView ));  // lbf
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][5], XMVector4Transform ( XMVectorSet(r, b, fFarPlane,1), matInverseLightCameraView ));  // rbf
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][6], XMVector4Transform ( XMVectorSet(r, t, fFarPlane,1), matInverseLightCameraView ));  // rtf
-			XMStoreFloat3(&m_cascadeFrustumCorners[iCascadeIndex][7], XMVector4Transform ( XMVectorSet(l, t, fFarPlane,1), matInverseLightCameraView ));  // ltf
-		}
-		#endif
+		// Come up with a new orthographic camera for the shadow caster
+		//OrthographicCamera shadowCamera(minExtents.x, minExtents.y, maxExtents.x,
+		//	maxExtents.y, 0.0f, cascadeExtents.z);
+		//shadowCamera.SetLookAt(shadowCameraPos, frustumCenter, upDir);
 
-		m_fCascadePartitionsFrustum[ iCascadeIndex ] = fFrustumIntervalEnd;
-	}
-	m_matShadowView = XMMatrixInverse(NULL, renderCam->GetViewMatrix()) * lightCam->GetViewMatrix();
+		// Come up with a new orthographic camera for the shadow caster
 
-	XMVECTOR lightEye    = XMLoadFloat3(lightCam->GetEyePt());
-	XMVECTOR lightLookAt = XMLoadFloat3(lightCam->GetLookAtPt());
-	XMVECTOR lightDir = XMVector3Normalize(lightEye-lightLookAt);	
-	XMStoreFloat3(&m_lightDir, lightDir);
+		//XMMATRIX shadowCameraProj = XMMatrixOrthographicOffCenterLH(	XMVectorGetX(minExtents),
+		//																XMVectorGetX(maxExtents),
+		//																XMVectorGetY(minExtents),
+		//																XMVectorGetY(maxExtents),
+		//																0.0f,
+		//																XMVectorGetZ(cascadeExtents)
+		//																);
 
-	if(m_useSinglePassShadow) // set per cascade projection matrix for geometry shader
-	{
-		UpdateShadowCascadesCB(DXUTGetD3D11DeviceContext());		
-	}
-}
+		XMMATRIX shadowCameraProj = XMMatrixOrthographicOffCenterLH(	XMVectorGetX(minExtents),
+																		XMVectorGetX(maxExtents),
+																		XMVectorGetY(minExtents),
+																		XMVectorGetY(maxExtents),
+																		0.0f,
+																		XMVectorGetZ(cascadeExtents)
+			);
 
-HRESULT ShadowMapping::RenderShadowsForAllCascades( ID3D11DeviceContext1* pd3dImmediateContext, XMMATRIX lightViewMatrix, Scene* scene, RenderTri* triRenderer, RendererSubD* osdRenderer )
-{
-	HRESULT hr = S_OK;
-	ID3D11RenderTargetView* nullView[] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL};
-	
-	{			
+		XMMATRIX shadowCameraView = XMMatrixLookAtLH(shadowCameraPos, frustumCenter, vUpDir);
 
-		triRenderer->SetGenShadows(true);
-		osdRenderer->SetGenShadows(true);
+		XMMATRIX shadowCameraViewProj = shadowCameraView * shadowCameraProj ;
 
-		pd3dImmediateContext->RSSetState( m_prsShadow );
-		
-		g_app.SetViewMatrix(lightViewMatrix);
-		
-		//if(m_useSinglePassShadowGen)
-		if(m_useSinglePassShadow)
+		if(m_stabilizeCascades)
 		{
-			PERF_EVENT_SCOPED(perfGen, L"Render Shadow Cascades");
-			osdRenderer->SetGenShadowsFast(true);
-			triRenderer->SetGenShadowsFast(true);
-
-			pd3dImmediateContext->GSSetConstantBuffers( CB_LOC::CASCADE_PROJECTION, 1, &m_shadowCascadesProjCB );
-			
-			float ClearColor[4] = { 0.0, 0.0, 0.0, 0.0 };
-			// clear rtv? pd3dDevice->ClearRenderTargetView( g_pEnvMapRTV, ClearColor );
-			//pd3dImmediateContext->ClearRenderTargetView( m_pCascadedShadowMapVarianceRTVArrayAll, ClearColor );
-			pd3dImmediateContext->ClearDepthStencilView( m_pDepthBufferArrayDSV, D3D11_CLEAR_DEPTH, 1.0, 0 );
-			pd3dImmediateContext->OMSetRenderTargets( 1, &m_pVarianceShadowArrayRTV, m_pDepthBufferArrayDSV );
-			pd3dImmediateContext->RSSetViewports( 1, &m_RenderOneTileVP );
-					
-			scene->RenderSceneObjects(pd3dImmediateContext, triRenderer, osdRenderer);
-			
-			pd3dImmediateContext->OMSetRenderTargets(1, nullView, NULL );
+			// Create the rounding matrix, by projecting the world-space origin and determining
+			// the fractional offset in texel space
+			//XMMATRIX shadowMatrix = shadowCamera.ViewProjectionMatrix().ToSIMD();
+			XMVECTOR shadowOrigin = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+			shadowOrigin = XMVector4Transform(shadowOrigin, shadowCameraViewProj);
+			shadowOrigin = XMVectorScale(shadowOrigin, SHADOW_MAP_RES / 2.0f);
 
-			
-			osdRenderer->SetGenShadowsFast(false);		
-			triRenderer->SetGenShadowsFast(false);
-		}
-		else
-		{		
+			XMVECTOR roundedOrigin = XMVectorRound(shadowOrigin);
+			XMVECTOR roundOffset = XMVectorSubtract(roundedOrigin, shadowOrigin);
+			roundOffset = XMVectorScale(roundOffset, 2.0f / SHADOW_MAP_RES);
+			roundOffset = XMVectorSetZ(roundOffset, 0.0f);
+			roundOffset = XMVectorSetW(roundOffset, 0.0f);
+
+			//XMMATRIX shadowProj = shadowCamera.ProjectionMatrix().ToSIMD();
+			//shadowProj.r[3] = XMVectorAdd(shadowProj.r[3], roundOffset);
+			//shadowCamera.SetProjection(shadowProj);
+
+			shadowCameraProj.r[3] = XMVectorAdd(shadowCameraProj.r[3], roundOffset);
+			shadowCameraViewProj = shadowCameraView * shadowCameraProj ;			
+		}
+
+		m_matShadowProj[cascadeIdx] = shadowCameraProj;
+		m_matCascadeView[cascadeIdx] = shadowCameraView;
+
+		//// Apply the scale/offset matrix, which transforms from [-1,1]
+		//// post-projection space to [0,1] UV space
+		XMMATRIX texScaleBias;
+		texScaleBias.r[0] = XMVectorSet(0.5f,  0.0f, 0.0f, 0.0f);
+		texScaleBias.r[1] = XMVectorSet(0.0f, -0.5f, 0.0f, 0.0f);
+		texScaleBias.r[2] = XMVectorSet(0.0f,  0.0f, 1.0f, 0.0f);
+		texScaleBias.r[3] = XMVectorSet(0.5f,  0.5f, 0.0f, 1.0f);
+		XMMATRIX shadowMatrix = shadowCameraViewProj * texScaleBias;
+		//shadowMatrix = XMMatrixMultiply(shadowMatrix, texScaleBias);
+		//shadowMatrix = shadowMatrix *  texScaleBias;
+		//shadowMatrix = shadowMatrix * g_matTextureScale * g_matTextureTranslation;
+		
+		// Store the split distance in terms of view space depth
+		const float clipDist = renderCam->GetFarClip() - renderCam->GetNearClip();
+		//meshPSConstants.Data.CascadeSplits[cascadeIdx] = camera.NearClip() + splitDist * clipDist;
+		//fFrustumIntervalEnd = cascadeSplits[ iCascadeIndex ];        
+		//fFrustumIntervalBegin = fFrustumIntervalBegin * clipRange;
+		//fFrustumIntervalEnd = fFrustumIntervalEnd * clipRange;
+		//m_fCascadePartitionsFrustum[cascadeIdx] = renderCam->GetNearClip() + splitDist * clipDist;
+		//m_fCascadePartitionsFrustum[cascadeIdx] = cascadeSplits[ cascadeIdx ] * clipDist;//renderCam->GetNearClip() + splitDist * clipDist;
+		//m_fCascadePartitionsFrustum[cascadeIdx] = cascadeSplits[ cascadeIdx ] * renderCam->GetNearClip() + splitDist * clipDist;
+		m_fCascadePartitionsFrustum[cascadeIdx] = renderCam->GetNearClip() + splitDist * clipDist;
+		////m_fCascadePartitionsFrustum[ cascadeIdx ] = fFrustumIntervalEnd;
+
+		// Calculate the position of the lower corner of the cascade partition, in the UV space
+		// of the first cascade partition
+		XMMATRIX invCascadeMat = XMMatrixInverse(nullptr, shadowMatrix);
+		XMVECTOR cascadeCorner = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invCascadeMat);
+		cascadeCorner = XMVector3TransformCoord(cascadeCorner, globalShadowMatrix);
+
+		//// Do the same for the upper corner
+		XMVECTOR otherCorner = XMVector3TransformCoord(XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f), invCascadeMat);
+		otherCorner = XMVector3TransformCoord(otherCorner, globalShadowMatrix);
+
+		//// Calculate the scale and offset
+		XMVECTOR cascadeScale = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f) / (otherCorner - cascadeCorner);
+
+		//meshPSConstants.Data.CascadeOffsets[cascadeIdx] = Float4(-cascadeCorner, 0.0f);
+		//meshPSConstants.Data.CascadeScales[cascadeIdx] = Float4(cascadeScale, 1.0f);
+
+
+		XMStoreFloat3(&m_cascadeOffsets[cascadeIdx],-cascadeCorner);
+		XMStoreFloat3(&m_cascadeScales[cascadeIdx],cascadeScale);
+		//m_cascadeOffsets[cascadeIdx] = fCascadeOffset;
+		//m_cascadeScales[cascadeIdx] = fCascadeScale;
+
+		//if(AppSettings::UseVSM())
+		//	ConvertToVSM(context, cascadeIdx, meshPSConstants.Data.CascadeScales[cascadeIdx].To3D(),
+		//	meshPSConstants.Data.CascadeScales[0].To3D());
+	}
+
+	m_cascadesComputed = true;
+}
+
+HRESULT ShadowMapping::RenderShadowsForAllCascades( ID3D11DeviceContext1* pd3dImmediateContext, XMMATRIX lightViewMatrix, Scene* scene, RenderTri* triRenderer, RendererSubD* osdRenderer )
+{
+	HRESULT hr = S_OK;
+	ID3D11RenderTargetView* nullView[] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+	
+	{			
+
+		triRenderer->SetGenShadows(true);
+		osdRenderer->SetGenShadows(true);
+
+		pd3dImmediateContext->RSSetState( m_prsShadow );
+		
+		g_app.SetViewMatrix(lightViewMatrix);
+		
+		//if(m_useSinglePassShadowGen)
+		if(m_useSinglePassShadow)
+		{
+			PERF_EVENT_SCOPED(perfGen, L"Render Shadow Cascades");
+			osdRenderer->SetGenShadowsFast(true);
+			triRenderer->SetGenShadowsFast(true);
+
+			pd3dImmediateContext->GSSetConstantBuffers( CB_LOC::CASCADE_PROJECTION, 1, &m_shadowCascadesProjCB );
+			
+			float ClearColor[4] = { 0.0, 0.0, 0.0, 0.0 };
+			// clear rtv? pd3dDevice->ClearRenderTargetView( g_pEnvMapRTV, ClearColor );
+			//pd3dImmediateContext->ClearRenderTargetView( m_pCascadedShadowMapVarianceRTVArrayAll, ClearColor );
+			pd3dImmediateContext->ClearDepthStencilView( m_pDepthBufferArrayDSV, D3D11_CLEAR_DEPTH, 1.0, 0 );
+			pd3dImmediateContext->OMSetRenderTargets( 1, &m_pVarianceShadowArrayRTV, m_pDepthBufferArrayDSV );
+			pd3dImmediateContext->RSSetViewports( 1, &m_RenderOneTileVP );
+					
+			scene->RenderSceneObjects(pd3dImmediateContext, triRenderer, osdRenderer);
+			
+			pd3dImmediateContext->OMSetRenderTargets(1, nullView, NULL );
+
+			
+			osdRenderer->SetGenShadowsFast(false);		
+			triRenderer->SetGenShadowsFast(false);
+		}
+		else
+		{		
 
 			//pd3dDeviceContext->PSSetShaderResources( 12, 1, nullSRV );
 			for ( int iCurrentCascade=0; iCurrentCascade < NUM_CASCADES; ++iCurrentCascade ) 
@@ -1811,283 +1842,16 @@ HRESULT ShadowMapping::RenderShadowMap( ID3D11DeviceContext1* pd3dImmediateConte
 
 	ID3D11RenderTargetView* nullView[] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL};
  
-	//const float minDistance = m_useDepthReduction ? XMMax(m_depthMinMax.x-0.1f, 0.f) : m_fCascadePartitionsMin;
-	//const float maxDistance = m_useDepthReduction ? XMMin(m_depthMinMax.y+0.1f,1.f) : m_fCascadePartitionsMax;
-	const float minDistance = m_useDepthReduction ? XMMax(m_depthMinMax.x, 0.f) : m_fCascadePartitionsMin;
-	const float maxDistance = m_useDepthReduction ? XMMin(m_depthMinMax.y, 1.f) : m_fCascadePartitionsMax;
-
-	float cascadeSplits[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-
-	if(m_ePartitionMode == PartitionMode::MANUAL)
-	{	
-		cascadeSplits[0] = minDistance + m_fSplitDistance[0] * maxDistance;
-		cascadeSplits[1] = minDistance + m_fSplitDistance[1] * maxDistance;
-		cascadeSplits[2] = minDistance + m_fSplitDistance[2] * maxDistance;
-#if NUM_CASCADES == 4
-		cascadeSplits[3] = minDistance + m_fSplitDistance[3] * maxDistance;
-#endif
-	}
-	else if(m_ePartitionMode == PartitionMode::LOGARTIHMIC ||  m_ePartitionMode == PartitionMode::PSSM)
-	{
-		float lambda = 1.0f;
-		if(m_ePartitionMode == PartitionMode::PSSM)
-		{
-			lambda = m_pssmLambda;
-		}
-
-		float nearClip  = renderCam->GetNearClip();
-		float farClip   = renderCam->GetFarClip();
-		float clipRange = farClip - nearClip;
-
-		float minZ = nearClip+minDistance*clipRange;
-		float maxZ = nearClip+maxDistance*clipRange;
-
-		float range = maxZ - minZ;
-		float ratio = maxZ / minZ;
-		//std::cout << "ration = " << ratio << std::endl;
-		for(UINT i = 0; i < NUM_CASCADES; ++i)
-		{
-			float p = float(i+1) / (float)NUM_CASCADES;
-			//std::cout << "p_" <<i << " = " << p  << std::endl;
-			float log = minZ*std::pow(ratio, p);
-			float uniform = minZ + range * p;
-			float d = lambda*(log - uniform) + uniform;
-			cascadeSplits[i] = (d-nearClip)/clipRange;
-			//std::cout << "cascadeSplit"  << i << " = " << cascadeSplits[i] << std::endl;
-		}
-	}
-
-
-	// cascade splits computed
-
-
-	// render cascades
-	XMVECTOR vLightDir = XMVector3Normalize(-XMLoadFloat3(&lightDir)); //checkme -lightdir	
-	XMStoreFloat3(&m_lightDir, vLightDir);
-
-	XMMATRIX renderViewProjectionMatrix = renderCam->GetViewMatrix()*renderCam->GetProjMatrix();
-	// compute global shadow matrix
-	XMMATRIX globalShadowMatrix;
-	{
-		
-		XMVECTOR frustumCorners[8] =
-		{
-			XMVectorSet(-1.0f,  1.0f, 0.0f, 1.0f),
-			XMVectorSet( 1.0f,  1.0f, 0.0f, 1.0f),
-			XMVectorSet( 1.0f, -1.0f, 0.0f, 1.0f),
-			XMVectorSet(-1.0f, -1.0f, 0.0f, 1.0f),
-			XMVectorSet(-1.0f,  1.0f, 1.0f, 1.0f),
-			XMVectorSet( 1.0f,  1.0f, 1.0f, 1.0f),
-			XMVectorSet( 1.0f, -1.0f, 1.0f, 1.0f),
-			XMVectorSet(-1.0f, -1.0f, 1.0f, 1.0f),
-		};
-		
-		XMMATRIX invViewProj = XMMatrixInverse(NULL, renderViewProjectionMatrix );
-		XMVECTOR frustumCenter = XMVectorSet(0,0,0,0);
-		for(unsigned int i = 0; i < 8; ++i)
-		{			
-			frustumCorners[i] = XMVector3TransformCoord(frustumCorners[i], invViewProj);//Float3::Transform(frustumCorners[i], invViewProj);
-			frustumCenter += frustumCorners[i];
-		}
-
-		frustumCenter /= 8.0f;
-		//XMVectorSetW(frustumCenter, 1);
-		// Pick the up vector to use for the light camera
-		
-
-		XMFLOAT3 upDir = renderCam->GetWorldRight();
-		
-		// This needs to be constant for it to be stable
-		if(m_stabilizeCascades)
-			upDir = XMFLOAT3(0.0f, 0.0f, 1.0f); // HENRY CHECKME 0,0,1?
-		
-		XMVECTOR vUpDir = XMLoadFloat3(&upDir);
-		
-
-		// Create a temporary view matrix for the light
-		XMVECTOR lightCameraPos = frustumCenter;
-		XMVECTOR lookAt = frustumCenter - vLightDir;
-		XMMATRIX lightView = XMMatrixLookAtLH(lightCameraPos, lookAt, vUpDir);
-
-
-		// Get position of the shadow camera
-		XMVECTOR shadowCameraPos = frustumCenter + vLightDir * -0.5;//-0.5f;
-
-		//PrintXMVECTOR_F4("light cam shadowCameraPos ", shadowCameraPos );
-		//PrintXMVECTOR_F4("light cam lookAt ", lookAt );
-
-		// Come up with a new orthographic camera for the shadow caster
-
-		XMMATRIX shadowProj = XMMatrixOrthographicOffCenterLH(-0.5, 0.5, -0.5, 0.5, 0.0, 1.0);
-		XMMATRIX shadowView = XMMatrixLookAtLH(shadowCameraPos, frustumCenter, vUpDir);
-		XMMATRIX shadowViewProj = shadowView * shadowProj;
-		//globalShadowMatrix = shadowView * shadowProj * XMMatrixScaling(0.5f, -0.5f, 1.0f) * XMMatrixTranslation(0.5f, 0.5f, 0.0f);
-		globalShadowMatrix = shadowViewProj *   XMMatrixScaling(0.5f, -0.5f, 1.0f) * XMMatrixTranslation(0.5f, 0.5f, 0.0f);
-		m_matShadowView = XMMatrixInverse(NULL, renderCam->GetViewMatrix()) * globalShadowMatrix;//shadowView;
-		//m_matShadowView = shadowView;		
-	}
-
+	// cascades are usually computed by the frame graph, compute them here otherwise
+	if (!m_cascadesComputed)
+		ComputeCascades(renderCam, lightDir);
+	m_cascadesComputed = false;
 
 	// render meshes to cascades
 	for(uint32_t cascadeIdx = 0; cascadeIdx < NUM_CASCADES; ++cascadeIdx)
 	{
-		// set viewport
-		//set shadow map as render target
-		//clear
-
-		// Get the 8 points of the view frustum in world space
-		XMVECTOR frustumCornersWS[8] =
-		{
-			XMVectorSet(-1.0f,  1.0f, 0.0f, 1.0f),
-			XMVectorSet( 1.0f,  1.0f, 0.0f, 1.0f),
-			XMVectorSet( 1.0f, -1.0f, 0.0f, 1.0f),
-			XMVectorSet(-1.0f, -1.0f, 0.0f, 1.0f),
-			XMVectorSet(-1.0f,  1.0f, 1.0f, 1.0f),
-			XMVectorSet( 1.0f,  1.0f, 1.0f, 1.0f),
-			XMVectorSet( 1.0f, -1.0f, 1.0f, 1.0f),
-			XMVectorSet(-1.0f, -1.0f, 1.0f, 1.0f),
-		};
-
-		//float prevSplitDist = cascadeIdx == 0 ? minDistance : m_fSplitDistance[cascadeIdx - 1];		
-		//float splitDist = m_fSplitDistance[cascadeIdx];
-		float prevSplitDist = cascadeIdx == 0 ? minDistance : cascadeSplits[cascadeIdx - 1];
-		float splitDist = cascadeSplits[cascadeIdx];
-		
-		XMMATRIX invViewProj = XMMatrixInverse(nullptr, renderCam->GetViewMatrix()*renderCam->GetProjMatrix());
-		for(uint32_t i = 0; i < 8; ++i)
-		{
-			//frustumCornersWS[i] = Float3::Transform(frustumCornersWS[i], invViewProj);
-			frustumCornersWS[i] = XMVector3TransformCoord(frustumCornersWS[i], invViewProj);			
-		}
-
-		// Get the corners of the current cascade slice of the view frustum
-		for(uint32_t i = 0; i < 4; ++i)
-		{
-			XMVECTOR cornerRay = frustumCornersWS[i + 4] - frustumCornersWS[i];
-			XMVECTOR nearCornerRay = cornerRay * prevSplitDist;
-			XMVECTOR farCornerRay = cornerRay * splitDist;
-			frustumCornersWS[i + 4] = frustumCornersWS[i] + farCornerRay;
-			frustumCornersWS[i] = frustumCornersWS[i] + nearCornerRay;
-		}
-
-		// Calculate the centroid of the view frustum slice
-		XMVECTOR frustumCenter = XMVectorSet(0,0,0,0);
-		for(uint32_t i = 0; i < 8; ++i)
-			frustumCenter = frustumCenter + frustumCornersWS[i];
-		frustumCenter /=  8.0f;
-		//XMVectorSetW(frustumCenter,1.0);
-
-		// Pick the up vector to use for the light camera
-		XMFLOAT3 upDir = renderCam->GetWorldRight();
-		XMVECTOR vUpDir = XMLoadFloat3(&upDir);
-
-		XMVECTOR minExtents;
-		XMVECTOR maxExtents;
-		if(m_stabilizeCascades)
-		{
-			// This needs to be constant for it to be stable
-			vUpDir = XMVectorSet(0.0f, 0.0f, 1.0f, 0.f);
-
-			// Calculate the radius of a bounding sphere surrounding the frustum corners
-			float sphereRadius = 0.0f;
-			for(uint32_t i = 0; i < 8; ++i)
-			{
-				
-				float dist = XMVectorGetX(XMVector3Length(frustumCornersWS[i] - frustumCenter));
-				sphereRadius = std::max(sphereRadius, dist);
-			}
-
-			//sphereRadius = std::ceil(sphereRadius * 16.0f) / 16.0f;
-			//sphereRadius = 0.76*std::ceil(sphereRadius * 16.0f) / 16.0f; // CHECKME magic numer
-			sphereRadius = std::ceil(sphereRadius * 16.0f) / 16.0f; // CHECKME magic numer
-
-
-			maxExtents = XMVectorSet(sphereRadius, sphereRadius, sphereRadius, 0);
-			minExtents = -maxExtents;
-		}
-		else
-		{
-			// Create a temporary view matrix for the light
-			XMVECTOR lightCameraPos = frustumCenter;
-			XMVECTOR lookAt = frustumCenter - vLightDir;
-			XMMATRIX lightView = XMMatrixLookAtLH(lightCameraPos, lookAt, vUpDir);
-
-			// Calculate an AABB around the frustum corners
-			XMVECTOR mins = g_vFLTMAX;
-			XMVECTOR maxes = g_vFLTMIN;
-			for(uint32_t i = 0; i < 8; ++i)
-			{
-				XMVECTOR corner = XMVector3TransformCoord(frustumCornersWS[i], lightView);
-				mins = XMVectorMin(mins, corner);
-				maxes = XMVectorMax(maxes, corner);
-			}
-
-			minExtents = mins;
-			maxExtents = maxes;
-
-			// Adjust the min/max to accommodate the filtering size
-			float scale = (SHADOW_MAP_RES + BLUR_KERNEL_SIZE) / static_cast<float>(SHADOW_MAP_RES);
-			XMVECTOR vScale = XMVectorSet(scale,scale,1,1);	// scale x and y, leave z 
-			minExtents *= vScale;
-			maxExtents *= vScale;
-		}
-
-		XMVECTOR cascadeExtents = maxExtents - minExtents;
-
-		// Get position of the shadow camera
-		XMVECTOR shadowCameraPos = frustumCenter + vLightDir * -XMVectorGetZ(minExtents);
-
-		// Come up with a new orthographic camera for the shadow caster
-		//OrthographicCamera shadowCamera(minExtents.x, minExtents.y, maxExtents.x,
-		//	maxExtents.y, 0.0f, cascadeExtents.z);
-		//shadowCamera.SetLookAt(shadowCameraPos, frustumCenter, upDir);
-
-		// Come up with a new orthographic camera for the shadow caster
-
-		//XMMATRIX shadowCameraProj = XMMatrixOrthographicOffCenterLH(	XMVectorGetX(minExtents),
-		//																XMVectorGetX(maxExtents),
-		//																XMVectorGetY(minExtents),
-		//																XMVectorGetY(maxExtents),
-		//																0.0f,
-		//																XMVectorGetZ(cascadeExtents)
-		//																);
-
-		XMMATRIX shadowCameraProj = XMMatrixOrthographicOffCenterLH(	XMVectorGetX(minExtents),
-																		XMVectorGetX(maxExtents),
-																		XMVectorGetY(minExtents),
-																		XMVectorGetY(maxExtents),
-																		0.0f,
-																		XMVectorGetZ(cascadeExtents)
-			);
-
-		XMMATRIX shadowCameraView = XMMatrixLookAtLH(shadowCameraPos, frustumCenter, vUpDir);
-
-		XMMATRIX shadowCameraViewProj = shadowCameraView * shadowCameraProj ;
-
-		if(m_stabilizeCascades)
-		{
-			// Create the rounding matrix, by projecting the world-space origin and determining
-			// the fractional offset in texel space
-			//XMMATRIX shadowMatrix = shadowCamera.ViewProjectionMatrix().ToSIMD();
-			XMVECTOR shadowOrigin = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-			shadowOrigin = XMVector4Transform(shadowOrigin, shadowCameraViewProj);
-			shadowOrigin = XMVectorScale(shadowOrigin, SHADOW_MAP_RES / 2.0f);
-
-			XMVECTOR roundedOrigin = XMVectorRound(shadowOrigin);
-			XMVECTOR roundOffset = XMVectorSubtract(roundedOrigin, shadowOrigin);
-			roundOffset = XMVectorScale(roundOffset, 2.0f / SHADOW_MAP_RES);
-			roundOffset = XMVectorSetZ(roundOffset, 0.0f);
-			roundOffset = XMVectorSetW(roundOffset, 0.0f);
-
-			//XMMATRIX shadowProj = shadowCamera.ProjectionMatrix().ToSIMD();
-			//shadowProj.r[3] = XMVectorAdd(shadowProj.r[3], roundOffset);
-			//shadowCamera.SetProjection(shadowProj);
-
-			shadowCameraProj.r[3] = XMVectorAdd(shadowCameraProj.r[3], roundOffset);
-			shadowCameraViewProj = shadowCameraView * shadowCameraProj ;			
-		}
-
-		m_matShadowProj[cascadeIdx] = shadowCameraProj;
+		const XMMATRIX shadowCameraView = m_matCascadeView[cascadeIdx];
+		const XMMATRIX shadowCameraProj = m_matShadowProj[cascadeIdx];
 
 		// Draw the mesh with depth only, using the new shadow camera
 		//RenderDepthCPU(context, shadowCamera, world, characterWorld, true);
@@ -2130,57 +1894,6 @@ HRESULT ShadowMapping::RenderShadowMap( ID3D11DeviceContext1* pd3dImmediateConte
 
 		triRenderer->SetGenShadows(false);
 		osdRenderer->SetGenShadows(false);
-
-
-		//// Apply the scale/offset matrix, which transforms from [-1,1]
-		//// post-projection space to [0,1] UV space
-		XMMATRIX texScaleBias;
-		texScaleBias.r[0] = XMVectorSet(0.5f,  0.0f, 0.0f, 0.0f);
-		texScaleBias.r[1] = XMVectorSet(0.0f, -0.5f, 0.0f, 0.0f);
-		texScaleBias.r[2] = XMVectorSet(0.0f,  0.0f, 1.0f, 0.0f);
-		texScaleBias.r[3] = XMVectorSet(0.5f,  0.5f, 0.0f, 1.0f);
-		XMMATRIX shadowMatrix = shadowCameraViewProj * texScaleBias;
-		//shadowMatrix = XMMatrixMultiply(shadowMatrix, texScaleBias);
-		//shadowMatrix = shadowMatrix *  texScaleBias;
-		//shadowMatrix = shadowMatrix * g_matTextureScale * g_matTextureTranslation;
-		
-		// Store the split distance in terms of view space depth
-		const float clipDist = renderCam->GetFarClip() - renderCam->GetNearClip();
-		//meshPSConstants.Data.CascadeSplits[cascadeIdx] = camera.NearClip() + splitDist * clipDist;
-		//fFrustumIntervalEnd = cascadeSplits[ iCascadeIndex ];        
-		//fFrustumIntervalBegin = fFrustumIntervalBegin * clipRange;
-		//fFrustumIntervalEnd = fFrustumIntervalEnd * clipRange;
-		//m_fCascadePartitionsFrustum[cascadeIdx] = renderCam->GetNearClip() + splitDist * clipDist;
-		//m_fCascadePartitionsFrustum[cascadeIdx] = cascadeSplits[ cascadeIdx ] * clipDist;//renderCam->GetNearClip() + splitDist * clipDist;
-		//m_fCascadePartitionsFrustum[cascadeIdx] = cascadeSplits[ cascadeIdx ] * renderCam->GetNearClip() + splitDist * clipDist;
-		m_fCascadePartitionsFrustum[cascadeIdx] = renderCam->GetNearClip() + splitDist * clipDist;
-		////m_fCascadePartitionsFrustum[ cascadeIdx ] = fFrustumIntervalEnd;
-
-		// Calculate the position of the lower corner of the cascade partition, in the UV space
-		// of the first cascade partition
-		XMMATRIX invCascadeMat = XMMatrixInverse(nullptr, shadowMatrix);
-		XMVECTOR cascadeCorner = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invCascadeMat);
-		cascadeCorner = XMVector3TransformCoord(cascadeCorner, globalShadowMatrix);
-
-		//// Do the same for the upper corner
-		XMVECTOR otherCorner = XMVector3TransformCoord(XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f), invCascadeMat);
-		otherCorner = XMVector3TransformCoord(otherCorner, globalShadowMatrix);
-
-		//// Calculate the scale and offset
-		XMVECTOR cascadeScale = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f) / (otherCorner - cascadeCorner);
-
-		//meshPSConstants.Data.CascadeOffsets[cascadeIdx] = Float4(-cascadeCorner, 0.0f);
-		//meshPSConstants.Data.CascadeScales[cascadeIdx] = Float4(cascadeScale, 1.0f);
-
-
-		XMStoreFloat3(&m_cascadeOffsets[cascadeIdx],-cascadeCorner);
-		XMStoreFloat3(&m_cascadeScales[cascadeIdx],cascadeScale);
-		//m_cascadeOffsets[cascadeIdx] = fCascadeOffset;
-		//m_cascadeScales[cascadeIdx] = fCascadeScale;
-
-		//if(AppSettings::UseVSM())
-		//	ConvertToVSM(context, cascadeIdx, meshPSConstants.Data.CascadeScales[cascadeIdx].To3D(),
-		//	meshPSConstants.Data.CascadeScales[0].To3D());
 	}
 
 	if (BLUR_KERNEL_SIZE > 1 ) 
@@ -44,8 +44,9 @@ public:
 							RendererSubD* osdRenderer);
 	void DebugRenderCascade(ID3D11DeviceContext1* pd3dImmediateContext, ID3D11RenderTargetView* outputRTV) const;
 
-	// compute cascade settings, run once per frame before render shadows to offscreen buffers
-	void ComputeCascades(CBaseCamera* renderCam, CModelViewerCamera* lightCam, Scene* scene);
+	// compute cascade settings, run once per frame before render shadows to offscreen buffers.
+	// no d3d calls, can run on a worker thread. RenderShadowMap computes them itself if this was not called
+	void ComputeCascades(CBaseCamera* renderCam, const DirectX::XMFLOAT3& lightDir);
 
 	HRESULT UpdateShadowCB(ID3D11DeviceContext1* pd3dImmediateContext, DirectX::XMMATRIX matCameraView, DirectX::XMMATRIX matCameraProj);
 	HRESULT UpdateShadowCascadesCB(ID3D11DeviceContext1* pd3dImmediateContext);
@@ -132,6 +133,8 @@ protected:
 	float						m_pssmLambda;
 	
 	DirectX::XMMATRIX           m_matShadowProj[NUM_CASCADES]; 
+	DirectX::XMMATRIX           m_matCascadeView[NUM_CASCADES]; 
+	bool						m_cascadesComputed;
 	DirectX::XMFLOAT3			m_cascadeScales[NUM_CASCADES];
 	DirectX::XMFLOAT3			m_cascadeOffsets[NUM_CASCADES];
 	DirectX::XMMATRIX			m_lightViewMatrix;
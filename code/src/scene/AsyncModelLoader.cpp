@@ -0,0 +1,323 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "scene/AsyncModelLoader.h"
+#include "scene/Scene.h"
+#include "scene/ModelInstance.h"
+#include "utils/Timer.h"
+#include "utils/WorkStealingPool.h"
+
+#include <iostream>
+#include <fstream>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+AsyncModelLoader g_modelLoader;
+
+static const char* GetJobStateName(AsyncModelLoader::JobState state)
+{
+	switch (state)
+	{
+	case AsyncModelLoader::JobState::QUEUED:	return "queued";
+	case AsyncModelLoader::JobState::PREPARING:	return "preparing";
+	case AsyncModelLoader::JobState::PREPARED:	return "prepared";
+	case AsyncModelLoader::JobState::INSERTED:	return "inserted";
+	default:									return "failed";
+	}
+}
+
+AsyncModelLoader::AsyncModelLoader()
+{
+	m_nextInsert = 0;
+	m_shutdown = false;
+}
+
+AsyncModelLoader::~AsyncModelLoader()
+{
+	Destroy();
+}
+
+HRESULT AsyncModelLoader::Create(UINT numThreads)
+{
+	Destroy();
+
+	for (UINT i = 0; i < numThreads; ++i)
+		m_threads.push_back(std::thread(&AsyncModelLoader::LoaderMain, this));
+
+	return S_OK;
+}
+
+void AsyncModelLoader::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> l(m_lock);
+		m_shutdown = true;
+		m_queue.clear();
+	}
+	m_queueCV.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+
+	for (auto job : m_jobs)
+	{
+		ModelLoader::Release(job->data);
+		delete job;
+	}
+	m_jobs.clear();
+	m_nextInsert = 0;
+	m_shutdown = false;
+}
+
+UINT AsyncModelLoader::Enqueue(const std::string& fileName, Scene* scene, AnimationGroup* animGroup, ModelGroup* loadToGroup)
+{
+	Job* job = new Job();
+	job->fileName = fileName;
+	job->scene = scene;
+	job->animGroup = animGroup;
+	job->loadToGroup = loadToGroup;
+	job->data = NULL;
+	job->state = JobState::QUEUED;
+	job->hr = S_OK;
+	job->enqueueTime = GetTimeMS();
+
+	UINT jobID = 0;
+	{
+		std::lock_guard<std::mutex> l(m_lock);
+		jobID = static_cast<UINT>(m_jobs.size());
+		m_jobs.push_back(job);
+		if (!m_threads.empty())
+			m_queue.push_back(job);
+	}
+
+	if (m_threads.empty())
+		Prepare(job);
+	else
+		m_queueCV.notify_one();
+
+	return jobID;
+}
+
+void AsyncModelLoader::Prepare(Job* job)
+{
+	const double start = GetTimeMS();
+	{
+		std::lock_guard<std::mutex> l(m_lock);
+		job->state = JobState::PREPARING;
+	}
+
+	ModelLoadData* data = NULL;
+	const HRESULT hr = ModelLoader::Prepare(job->fileName, data);
+
+	{
+		std::lock_guard<std::mutex> l(m_lock);
+		job->data = data;
+		job->hr = hr;
+		if (data) job->timings = ModelLoader::GetTimings(data);
+		job->timings.queuedMS = start - job->enqueueTime;
+		job->state = JobState::PREPARED;
+	}
+	m_preparedCV.notify_all();
+}
+
+void AsyncModelLoader::Insert(Job* job)
+{
+	const size_t firstNewGroup = job->scene->GetModelGroups().size();
+
+	if (SUCCEEDED(job->hr))
+	{
+		job->hr = ModelLoader::Create(job->data, job->scene, job->animGroup, job->loadToGroup);
+		job->timings.createMS = ModelLoader::GetTimings(job->data).createMS;
+	}
+	ModelLoader::Release(job->data);
+
+	if (FAILED(job->hr))
+		std::cerr << "could not load " << job->fileName << std::endl;
+
+	// initial position of the new groups, later frames only move them while the physics run
+	const auto& groups = job->scene->GetModelGroups();
+	for (size_t i = firstNewGroup; i < groups.size(); ++i)
+		groups[i]->UpdateModelMatrix();
+
+	std::lock_guard<std::mutex> l(m_lock);
+	job->timings.totalMS = GetTimeMS() - job->enqueueTime;
+	job->state = SUCCEEDED(job->hr) ? JobState::INSERTED : JobState::FAILED;
+}
+
+void AsyncModelLoader::LoaderMain()
+{
+	// the loops of the welder and the adjacency builder would go to the shared queue and run in the render thread's waits
+	WorkStealingPool::SetSerialThread(true);
+
+	for (;;)
+	{
+		Job* job = NULL;
+		{
+			std::unique_lock<std::mutex> l(m_lock);
+			m_queueCV.wait(l, [this]{ return m_shutdown || !m_queue.empty(); });
+			if (m_shutdown) break;
+
+			job = m_queue.front();
+			m_queue.pop_front();
+		}
+		Prepare(job);
+	}
+}
+
+UINT AsyncModelLoader::Update(double budgetMS)
+{
+	const double start = GetTimeMS();
+
+	UINT numInserted = 0;
+	for (;;)
+	{
+		Job* job = NULL;
+		{
+			std::lock_guard<std::mutex> l(m_lock);
+			if (m_nextInsert >= m_jobs.size() || m_jobs[m_nextInsert]->state != JobState::PREPARED)
+				break;
+			job = m_jobs[m_nextInsert];
+		}
+
+		Insert(job);
+		{
+			std::lock_guard<std::mutex> l(m_lock);
+			m_nextInsert++;
+		}
+		numInserted++;
+
+		std::cout << "inserted " << job->fileName << " (" << GetNumInserted() << "/" << GetNumJobs() << ")" << std::endl;
+
+		if (GetTimeMS() - start >= budgetMS)
+			break;
+	}
+
+	return numInserted;
+}
+
+HRESULT AsyncModelLoader::Wait(UINT jobID)
+{
+	if (jobID >= GetNumJobs()) return E_INVALIDARG;
+
+	for (;;)
+	{
+		Update(FLT_MAX);
+
+		std::unique_lock<std::mutex> l(m_lock);
+		if (m_nextInsert > jobID)
+			return m_jobs[jobID]->hr;
+
+		m_preparedCV.wait(l, [this]{ return m_jobs[m_nextInsert]->state == JobState::PREPARED; });
+	}
+}
+
+HRESULT AsyncModelLoader::WaitAll()
+{
+	HRESULT hr = S_OK;
+
+	const UINT numJobs = GetNumJobs();
+	for (UINT i = 0; i < numJobs; ++i)
+	{
+		if (FAILED(Wait(i)))
+			hr = E_FAIL;
+	}
+
+	return hr;
+}
+
+UINT AsyncModelLoader::GetNumJobs() const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return static_cast<UINT>(m_jobs.size());
+}
+
+UINT AsyncModelLoader::GetNumInserted() const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return m_nextInsert;
+}
+
+float AsyncModelLoader::GetProgress() const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	if (m_jobs.empty()) return 1.0f;
+
+	float done = static_cast<float>(m_nextInsert);
+	for (size_t i = m_nextInsert; i < m_jobs.size(); ++i)
+	{
+		if (m_jobs[i]->state == JobState::PREPARED)
+			done += 0.5f;
+	}
+
+	return done / static_cast<float>(m_jobs.size());
+}
+
+AsyncModelLoader::JobState AsyncModelLoader::GetState(UINT jobID) const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return m_jobs[jobID]->state;
+}
+
+HRESULT AsyncModelLoader::GetResult(UINT jobID) const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return m_jobs[jobID]->hr;
+}
+
+const std::string& AsyncModelLoader::GetFileName(UINT jobID) const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return m_jobs[jobID]->fileName;
+}
+
+const ModelLoadTimings& AsyncModelLoader::GetTimings(UINT jobID) const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	return m_jobs[jobID]->timings;
+}
+
+void AsyncModelLoader::PrintTimings() const
+{
+	std::lock_guard<std::mutex> l(m_lock);
+	for (auto job : m_jobs)
+	{
+		const ModelLoadTimings& t = job->timings;
+		std::cout << job->fileName << " (" << GetJobStateName(job->state) << "): queued " << t.queuedMS << " ms, parse " << t.parseMS 
+				  << " ms, meshes " << t.meshMS << " ms, topology " << t.topologyMS << " ms, create " << t.createMS << " ms, total " << t.totalMS << " ms" << std::endl;
+	}
+}
+
+HRESULT AsyncModelLoader::WriteTimings(const std::string& csvFile) const
+{
+	std::ofstream file(csvFile.c_str());
+	if (!file.is_open())
+		return E_FAIL;
+
+	file << "model,state,queued_ms,parse_ms,mesh_ms,topology_ms,create_ms,total_ms" << std::endl;
+
+	std::lock_guard<std::mutex> l(m_lock);
+	for (auto job : m_jobs)
+	{
+		const ModelLoadTimings& t = job->timings;
+		file << job->fileName << "," << GetJobStateName(job->state) << "," << t.queuedMS << "," << t.parseMS << "," << t.meshMS << ","
+			 << t.topologyMS << "," << t.createMS << "," << t.totalMS << std::endl;
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,97 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "scene/ModelLoader.h"
+
+// background model loading. loader threads run ModelLoader::Prepare (parse, weld, half edges, far tables) for several
+// files at once, Update creates the gpu resources and inserts the finished files into the scene at a frame boundary.
+// files are inserted in the order they were queued, so group order and global instance ids match the synchronous load
+class AsyncModelLoader
+{
+public:
+	enum class JobState { QUEUED, PREPARING, PREPARED, INSERTED, FAILED };
+
+	AsyncModelLoader();
+	~AsyncModelLoader();
+
+	// numThreads loader threads, each prepares one file at a time. 0 prepares inline in Enqueue
+	HRESULT Create(UINT numThreads);
+	// waits for the files being prepared, drops the ones which were not inserted yet
+	void	Destroy();
+
+	// returns the job id, the models are inserted by a later Update. the groups stay owned by the caller
+	UINT	Enqueue(const std::string& fileName, Scene* scene, AnimationGroup* animGroup = NULL, ModelGroup* loadToGroup = NULL);
+
+	// render thread, once per frame: inserts prepared files until budgetMS is spent, at least one. returns the number of inserted files
+	UINT	Update(double budgetMS);
+	// blocks until the job has been inserted, inserts all jobs queued before it
+	HRESULT Wait(UINT jobID);
+	HRESULT WaitAll();
+
+	// progress
+	UINT	GetNumJobs()		const;
+	UINT	GetNumInserted()	const;	// inserted or failed
+	bool	IsIdle()			const	{ return GetNumInserted() == GetNumJobs(); }
+	float	GetProgress()		const;	// 0..1, a prepared file counts half
+
+	JobState				GetState(UINT jobID)	const;
+	HRESULT					GetResult(UINT jobID)	const;
+	const std::string&		GetFileName(UINT jobID) const;
+	const ModelLoadTimings& GetTimings(UINT jobID)	const;
+
+	// one line per file
+	void	PrintTimings() const;
+	HRESULT WriteTimings(const std::string& csvFile) const;
+
+private:
+	struct Job
+	{
+		std::string			fileName;
+		Scene*				scene;
+		AnimationGroup*		animGroup;
+		ModelGroup*			loadToGroup;
+		ModelLoadData*		data;
+		JobState			state;
+		HRESULT				hr;
+		double				enqueueTime;
+		ModelLoadTimings	timings;
+	};
+
+	void	Prepare(Job* job);
+	void	Insert(Job* job);
+	void	LoaderMain();
+
+	std::vector<std::thread>	m_threads;
+	std::vector<Job*>			m_jobs;			// indexed by job id
+	std::deque<Job*>			m_queue;		// not picked up by a loader thread yet
+	UINT						m_nextInsert;	// first job which has not been inserted
+
+	mutable std::mutex			m_lock;			// job states, m_jobs and m_queue
+	std::condition_variable		m_queueCV;		// loader threads wait for jobs
+	std::condition_variable		m_preparedCV;	// Wait waits for prepared jobs
+	bool						m_shutdown;
+};
+
+extern AsyncModelLoader g_modelLoader;
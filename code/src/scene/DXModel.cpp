@@ -16,6 +16,8 @@
 #include "stdafx.h"
 #include "DXModel.h"
 #include "ModelLoader.h"
+#include "dynamics/SkinningCPU.h"
+#include "dynamics/OBBFitterCPU.h"
 #include <SDX/DXBuffer.h>
 #include <vector>
 
@@ -103,6 +105,8 @@ DXModel::DXModel()
 	g_pNormalsBufferBasePoseSRV = NULL;
 	g_pNormalsBufferBasePoseSRV4Components = NULL;
 
+	_skinningCPU = NULL;
+	_obbFitterCPU = NULL;
 	//m_skinningMeshAnimationManager = NULL;
 
 	//_baseVertex = 0;
@@ -140,6 +144,9 @@ DXModel::~DXModel()
 	SAFE_RELEASE(g_pNormalsBufferBasePose);
 	SAFE_RELEASE(g_pNormalsBufferBasePoseSRV);
 	SAFE_RELEASE(g_pNormalsBufferBasePoseSRV4Components);
+
+	SAFE_DELETE(_skinningCPU);
+	SAFE_DELETE(_obbFitterCPU);
 	//_name.clear();
 }
 
@@ -199,6 +206,11 @@ HRESULT DXModel::Create( ID3D11Device1* pd3dDevice,
 	// ---- skinning stuff begin (if animated?)
 	//if (m_skinningMeshAnimationManager) {
 	if (meshData->withSkinning) {
+		// bone data is set by the first cpu skinning of the animation group
+		_skinningCPU = new SkinningCPU();
+		_skinningCPU->SetBasePose(meshData->vertices, meshData->normals.empty() ? std::vector<XMFLOAT4A>() : N);
+		_obbFitterCPU = new OBBFitterCPU();
+
 		D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
 		ZeroMemory( &SRVDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );		
 		SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
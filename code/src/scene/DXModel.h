@@ -7,6 +7,8 @@
 struct DXMaterial;
 struct MeshData;
 struct SubMeshData;
+class SkinningCPU;
+class OBBFitterCPU;
 
 //#include "DXMaterial.h"
 //#include "MovableObject.h"
@@ -105,6 +107,9 @@ struct DXModel// : public MovableObject,  Voxelizable
 	ID3D11ShaderResourceView*		g_pNormalsBufferBasePoseSRV4Components;
 
 	UINT							_numVertices;
+
+	SkinningCPU*					_skinningCPU;		// base pose and skinned vertices on the cpu, skinned models only
+	OBBFitterCPU*					_obbFitterCPU;		// obb of the cpu skinned vertices, keeps the axes between frames
 	
 	//SkinningAnimationClasses::SkinningMeshAnimationManager* m_skinningMeshAnimationManager;
 	//---- end skinning stuff		
@@ -16,6 +16,8 @@
 #include "stdafx.h"
 #include "scene/DXSubDModel.h"
 #include <SDX/DXBuffer.h>
+#include "compute/OsdCPUComputeController.h"
+#include "compute/OsdCPUStencilEvaluator.h"
 
 using namespace OpenSubdiv;
 using namespace DirectX;
@@ -26,6 +28,9 @@ using namespace DirectX;
 DXOSDMesh::DXOSDMesh()
 {
 	_model = NULL;
+	_farMesh = NULL;
+	m_refinementStencils = NULL;
+	m_limitStencils = NULL;
 	_material = NULL;
 	_name = "noname";
 	_bbMax = XMFLOAT4A(-FLT_MAX,-FLT_MAX,-FLT_MAX, 1.f);
@@ -58,7 +63,31 @@ DXOSDMesh::~DXOSDMesh()
 	Destroy();
 }
 
+// osd mesh built by the far mesh factory from the hbr mesh, or around prebuilt far tables
+template<class VERTEX_BUFFER, class COMPUTE_CONTROLLER>
+static OsdD3D11MeshInterface* NewOsdMesh(COMPUTE_CONTROLLER* controller, HbrMesh<OsdVertex>* hbrMesh, FarMesh<OsdVertex>* farMesh, 
+										 int numVertexElements, int numVaryingElements, OsdMeshBitset configBits, 
+										 const FarMesh<OsdVertex>*& createdFarMesh)
+{
+	typedef OsdMesh<VERTEX_BUFFER, COMPUTE_CONTROLLER, OsdD3D11DrawContext> Mesh;
+
+	Mesh* model = hbrMesh ? new Mesh(controller, hbrMesh, numVertexElements, numVaryingElements, g_app.g_maxSubdivisions, configBits, DXUTGetD3D11DeviceContext())
+						  : new Mesh(controller, farMesh, numVertexElements, numVaryingElements, configBits, DXUTGetD3D11DeviceContext());
+	createdFarMesh = model->GetFarMesh();
+	return model;
+}
+
 HRESULT DXOSDMesh::Create( ID3D11Device1* pd3dDevice, HbrMesh<OsdVertex> *hbrMesh, const std::vector<XMFLOAT4A>& verticesF4, bool hasTexcoords, bool isDeformable )
+{
+	return CreateInternal(pd3dDevice, hbrMesh, NULL, NULL, verticesF4, hasTexcoords, isDeformable);
+}
+
+HRESULT DXOSDMesh::CreateFromFarMesh( ID3D11Device1* pd3dDevice, FarMesh<OsdVertex> *farMesh, const std::vector<XMUINT4>& faces, const std::vector<XMFLOAT4A>& verticesF4, bool hasTexcoords, bool isDeformable )
+{
+	return CreateInternal(pd3dDevice, NULL, farMesh, &faces, verticesF4, hasTexcoords, isDeformable);
+}
+
+HRESULT DXOSDMesh::CreateInternal( ID3D11Device1* pd3dDevice, HbrMesh<OsdVertex> *hbrMesh, FarMesh<OsdVertex> *farMesh, const std::vector<XMUINT4>* faces, const std::vector<XMFLOAT4A>& verticesF4, bool hasTexcoords, bool isDeformable )
 {
 	HRESULT hr = S_OK;
 	//if(!g_app.g_osdSubdivider)
@@ -67,22 +96,23 @@ HRESULT DXOSDMesh::Create( ID3D11Device1* pd3dDevice, HbrMesh<OsdVertex> *hbrMes
 	if(!_material)
 	{
 		std::cerr << "material has not been set yet before DXOSDMesh::Create" << std::endl;
+		delete farMesh;
 		return S_FALSE;
 	}
 
 	// control cage - edge vertex assignment has to be done before creating osdmesh, otherwise num faces reports subdivided mesh faces
 	{	
 		std::vector<XMFLOAT3> cageEdges;
-		UINT numFaces = hbrMesh->GetNumFaces();
+		UINT numFaces = hbrMesh ? hbrMesh->GetNumFaces() : static_cast<UINT>(faces->size());
 		std::cout << "num Faces" << numFaces << std::endl;
 		for (unsigned int i = 0; i < numFaces; ++i)
 		{
-			const OsdHbrFace *face = hbrMesh->GetFace(i);
-			int nv = face->GetNumVertices();
+			const OsdHbrFace *face = hbrMesh ? hbrMesh->GetFace(i) : NULL;
+			int nv = face ? face->GetNumVertices() : 4;
 			for(int j = 0; j < nv; ++j)
 			{
-				auto eStart = face->GetVertex(j)->GetID();
-				auto eEnd = face->GetVertex((j+1)%nv)->GetID();
+				auto eStart = face ? face->GetVertex(j)->GetID()		: (&(*faces)[i].x)[j];
+				auto eEnd	= face ? face->GetVertex((j+1)%nv)->GetID() : (&(*faces)[i].x)[(j+1)%nv];
 				const auto &vStart = verticesF4[eStart];
 				const auto &vEnd = verticesF4[eEnd];
 
@@ -113,19 +143,46 @@ HRESULT DXOSDMesh::Create( ID3D11Device1* pd3dDevice, HbrMesh<OsdVertex> *hbrMes
 	_numOSDVertexElements =  3;		// only position data, uvs are in FVarData																		
 	int numVaryingElements = 0;
 
+	// limit stencils from the coarse topology, before the far mesh factory refines the hbr mesh
+	if (g_app.g_stencilLimitSamples > 0 && !hbrMesh)
+	{
+		std::cerr << "no limit stencils for " << _name << ", the mesh was created without hbr topology" << std::endl;
+	}
+	else if (g_app.g_stencilLimitSamples > 0)
+	{
+		m_limitStencils = new OsdCPUStencilEvaluator();
+		if (FAILED(m_limitStencils->CreateLimitStencils(hbrMesh, static_cast<int>(verticesF4.size()), g_app.g_stencilLimitSamples, g_app.g_maxSubdivisions)))
+		{
+			std::cerr << "could not create limit stencils for " << _name << std::endl;
+			SAFE_DELETE(m_limitStencils);
+		}
+	}
+
 	// create the gpu mesh	
 	
-	_model = new OsdMesh<OsdD3D11VertexBuffer,
-						OsdD3D11ComputeController,
-						OsdD3D11DrawContext> 
-			(	
-				g_app.g_osdSubdivider,
-				hbrMesh,
-				_numOSDVertexElements,
-				numVaryingElements,
-				g_app.g_maxSubdivisions,
-				configBits, DXUTGetD3D11DeviceContext()
-			);
+	if (g_app.g_useCPUSubdivision && g_app.g_osdSubdividerCPU)
+	{
+		// refinement on the cpu, drawing with the same d3d11 draw context
+		_model = NewOsdMesh<OsdCPUD3D11VertexBuffer>(g_app.g_osdSubdividerCPU, hbrMesh, farMesh, _numOSDVertexElements, numVaryingElements, configBits, _farMesh);
+	}
+	else
+	{
+		_model = NewOsdMesh<OsdD3D11VertexBuffer>(g_app.g_osdSubdivider, hbrMesh, farMesh, _numOSDVertexElements, numVaryingElements, configBits, _farMesh);
+	}
+
+	if (g_app.g_useStencilRefinement)
+	{
+		m_refinementStencils = new OsdCPUStencilEvaluator();
+		if (FAILED(m_refinementStencils->CreateRefinementStencils(_farMesh, static_cast<int>(verticesF4.size()))))
+		{
+			std::cerr << "could not create refinement stencils for " << _name << ", using the kernel batches" << std::endl;
+			SAFE_DELETE(m_refinementStencils);
+		}
+		else
+		{
+			m_refinedVertices.resize(m_refinementStencils->GetNumStencils() * _numOSDVertexElements);
+		}
+	}
 	
 
 	// opensubdiv expects float array with vertex positions xyz
@@ -150,8 +207,8 @@ HRESULT DXOSDMesh::Create( ID3D11Device1* pd3dDevice, HbrMesh<OsdVertex> *hbrMes
 
 
 	// upload vertex positions to gpu and run subdivision kernel
-	_model->UpdateVertexBuffer(&verticesFloatArray[0], 0, numV);
-	_model->Refine();
+	UpdateControlVertices(&verticesFloatArray[0], 0, numV);
+	Refine();
 	_model->Synchronize();	
 
 
@@ -265,6 +322,13 @@ void DXOSDMesh::Destroy()
 {
 	std::cerr << "delete osd model" << std::endl;
 	delete _model;
+	_model = NULL;
+	_farMesh = NULL;
+
+	SAFE_DELETE(m_refinementStencils);
+	SAFE_DELETE(m_limitStencils);
+	m_controlVertices.clear();
+	m_refinedVertices.clear();
 	
 	SAFE_RELEASE(_inputLayout);
 
@@ -284,4 +348,29 @@ void DXOSDMesh::Destroy()
 	m_extraordinaryDataCPU.clear();
 	m_extraordinaryInfoCPU.clear();
 	
-}
\ No newline at end of file
+}
+
+void DXOSDMesh::UpdateControlVertices(const float* positions, int startVertex, int numVertices)
+{
+	const size_t end = static_cast<size_t>(startVertex + numVertices) * _numOSDVertexElements;
+	if (m_controlVertices.size() < end)
+		m_controlVertices.resize(end);
+	memcpy(&m_controlVertices[startVertex * _numOSDVertexElements], positions, numVertices * _numOSDVertexElements * sizeof(float));
+
+	// the stencils write the whole vertex buffer in Refine
+	if (!m_refinementStencils)
+		_model->UpdateVertexBuffer(positions, startVertex, numVertices);
+}
+
+void DXOSDMesh::Refine()
+{
+	if (m_refinementStencils && !m_controlVertices.empty())
+	{
+		m_refinementStencils->UpdateValues(&m_controlVertices[0], _numOSDVertexElements, &m_refinedVertices[0], _numOSDVertexElements);
+		_model->UpdateVertexBuffer(&m_refinedVertices[0], 0, static_cast<int>(m_refinementStencils->GetNumStencils()));
+	}
+	else
+	{
+		_model->Refine();
+	}
+}
@@ -17,6 +17,8 @@ typedef OpenSubdiv::HbrHalfedge<OpenSubdiv::OsdVertex> OsdHbrHalfedge;
 #include <scene/DXMaterial.h>
 #include <SDX/DXObjectOrientedBoundingBox.h>
 
+class OsdCPUStencilEvaluator;
+
 
 class DXOSDMesh{
 public:
@@ -28,6 +30,13 @@ public:
 					const std::vector<DirectX::XMFLOAT4A>& verticesF4,
 					bool hasTexcoords,
 					bool isDeformable);
+	// same as Create with prebuilt far tables (topology cache), takes ownership of farMesh. faces are the quads of the control cage
+	HRESULT CreateFromFarMesh(	ID3D11Device1* pd3dDevice,
+								OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex> *farMesh,
+								const std::vector<DirectX::XMUINT4>& faces,
+								const std::vector<DirectX::XMFLOAT4A>& verticesF4,
+								bool hasTexcoords,
+								bool isDeformable);
 	void Destroy();
 
 	void		SetName(const std::string name) { _name = name; }
@@ -46,6 +55,16 @@ public:
 	void SetRequiresOverlapUpdate()		  {	_bRequiresOverlapUpdate = true;}
 
 	OpenSubdiv::OsdD3D11MeshInterface* GetMesh() const { return _model; }
+	const OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* GetFarMesh() const { return _farMesh; }
+
+	// refines the current control vertices, with the kernel batches of the compute controller or the refinement stencils
+	void	Refine();
+	// positions xyz of the control cage, refined on the next Refine
+	void	UpdateControlVertices(const float* positions, int startVertex, int numVertices);
+	const std::vector<float>& GetControlVertices() const	{ return m_controlVertices; }
+
+	const OsdCPUStencilEvaluator* GetRefinementStencils() const { return m_refinementStencils; }
+		  OsdCPUStencilEvaluator* GetLimitStencils()			{ return m_limitStencils; }
 	int		GetNumVertexElements()		const	{ return _numOSDVertexElements;		}
 	int		GetNumPTexFaces()			const	{ return _model->GetNumPTexFaces(); }
 	UINT	GetNumExtraordinary()		const	{ return m_numExtraordinary;		}
@@ -71,10 +90,24 @@ public:
 
 
 protected:
+	HRESULT CreateInternal(	ID3D11Device1* pd3dDevice,
+							OpenSubdiv::HbrMesh<OpenSubdiv::OsdVertex> *hbrMesh,
+							OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex> *farMesh,
+							const std::vector<DirectX::XMUINT4>* faces,
+							const std::vector<DirectX::XMFLOAT4A>& verticesF4,
+							bool hasTexcoords,
+							bool isDeformable);
+
 	DXMaterial*				_material;	
 	std::string				_name;
 	ID3D11InputLayout*		_inputLayout;
 	OpenSubdiv::OsdD3D11MeshInterface *_model;
+	const OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* _farMesh;	// owned by _model
+
+	std::vector<float>				m_controlVertices;
+	std::vector<float>				m_refinedVertices;
+	OsdCPUStencilEvaluator*			m_refinementStencils;	// g_useStencilRefinement
+	OsdCPUStencilEvaluator*			m_limitStencils;		// g_stencilLimitSamples > 0
 	
 	std::vector<SPtexNeighborData> m_ptexNeighDataCPU;
 	int _numOSDVertexElements;
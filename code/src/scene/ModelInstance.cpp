@@ -21,6 +21,7 @@
 #include "DXSubDModel.h"
 #include "MemoryManager.h"
 #include "IntersectPatches.h"
+#include "compute/ComputeBackendD3D11.h"
 #include "BulletCollision/CollisionDispatch/btGhostObject.h"
 
 #include "utils/DbgNew.h" // has to be last include
@@ -100,6 +101,7 @@ ModelInstance::ModelInstance( DXModel* model, TriangleSubmesh* subMesh )
 
 	m_hasDynamicTileColor = false;
 	m_hasDynamicTileDisplacement = false;
+	m_visibilityCompute = NULL;
 }
 
 ModelInstance::ModelInstance( DXOSDMesh* osdMesh )
@@ -120,6 +122,7 @@ ModelInstance::ModelInstance( DXOSDMesh* osdMesh )
 
 	m_hasDynamicTileColor = false;
 	m_hasDynamicTileDisplacement = false;
+	m_visibilityCompute = NULL;
 }
 
 ModelInstance::~ModelInstance()
@@ -163,6 +166,16 @@ HRESULT ModelInstance::EnableDynamicDisplacement()
 				V_RETURN(g_intersectGPU.CreateCompactedVisibilityBuffer(pd3dDevice, numTiles, m_visibilityAppend.BUF, m_visibilityAppend.SRV, m_visibilityAppend.UAV));
 			}
 
+			// dirty edges of the tile edit for the incremental overlap update, same layout as the visibility buffers
+			if(!m_dirtyEdges.BUF)
+			{
+				V_RETURN(g_intersectGPU.CreateVisibilityBuffer(pd3dDevice, numTiles, m_dirtyEdges.BUF, m_dirtyEdges.SRV, m_dirtyEdges.UAV));
+				V_RETURN(g_intersectGPU.CreateCompactedVisibilityBuffer(pd3dDevice, numTiles, m_dirtyEdgeRecords.BUF, m_dirtyEdgeRecords.SRV, m_dirtyEdgeRecords.UAV));
+
+				const UINT clearVals[] = {0,0,0,0};
+				DXUTGetD3D11DeviceContext()->ClearUnorderedAccessViewUint(m_dirtyEdges.UAV, clearVals);
+			}
+
 			{
 				std::vector<float> initMaxDisplacement(numTiles, 0);
 				V_RETURN(DXCreateBuffer(pd3dDevice, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, numTiles * sizeof(float), 0, D3D11_USAGE_DEFAULT, m_maxDisplacement.BUF, &initMaxDisplacement[0]));
@@ -250,13 +263,35 @@ HRESULT ModelInstance::EnableDynamicColor()
 
 }
 
+ComputeResource* ModelInstance::GetVisibilityCompute()
+{
+	if (!m_visibilityCompute && m_isSubD)
+	{
+		ComputeBufferDesc desc(m_osdMesh->GetNumPTexFaces(), sizeof(UINT), DXGI_FORMAT_R32_UINT, COMPUTE_SRV | COMPUTE_UAV);
+		if (g_computeBackend->GetType() == ComputeBackendType::D3D11)
+		{
+			// share the buffer with the d3d11 stages
+			assert(m_visibility.BUF);
+			m_visibilityCompute = g_computeBackendD3D11.WrapBuffer(desc, m_visibility.BUF, m_visibility.SRV, m_visibility.UAV);
+		}
+		else
+		{
+			g_computeBackend->CreateBuffer(desc, NULL, m_visibilityCompute);
+		}
+	}
+	return m_visibilityCompute;
+}
+
 void ModelInstance::Destroy()
 {
 	m_tileLayoutDisplacement.Destroy();
 	m_tileLayoutColor.Destroy();
+	if (m_visibilityCompute) g_computeBackend->DestroyResource(m_visibilityCompute);
 	m_visibility.Destroy();
 	m_visibilityAll.Destroy();
 	m_visibilityAppend.Destroy();
+	m_dirtyEdges.Destroy();
+	m_dirtyEdgeRecords.Destroy();
 	m_maxDisplacement.Destroy();
 }
 
@@ -12,6 +12,7 @@ class  DXOSDMesh;
 struct DXMaterial;
 
 class ModelGroup;
+class ComputeResource;
 
 class ModelInstance : public Voxelizable
 {
@@ -46,11 +47,15 @@ public:
 	DirectX::DXBufferSRVUAV*	GetColorTileLayout() { return &m_tileLayoutColor; }
 	
 	DirectX::DXBufferSRVUAV*	GetVisibility() { return &m_visibility; }
+	ComputeResource*			GetVisibilityCompute();		// visibility buffer for g_computeBackend
 	
 	DirectX::DXBufferSRVUAV*	GetVisibilityAll() { return &m_visibilityAll; }
 	
 	DirectX::DXBufferSRVUAV*  GetCompactedVisibility(){ return &m_visibilityAppend; }
 
+	DirectX::DXBufferSRVUAV*	GetDirtyEdges()			{ return &m_dirtyEdges; }			// per ptex face dirty edge/corner mask written by the tile edit and allocation
+	DirectX::DXBufferSRVUAV*	GetDirtyEdgeRecords()	{ return &m_dirtyEdgeRecords; }	// append buffer, compacted dirty faces for the overlap update
+
 
 	DirectX::DXBufferSRVUAV* GetMaxDisplacement() { return &m_maxDisplacement; }
 
@@ -93,10 +98,13 @@ protected:
 	
 	// for storing intersection with brush/ voxelization (culling)
 	DirectX::DXBufferSRVUAV		m_visibility;
+	ComputeResource*			m_visibilityCompute;
 	
 	DirectX::DXBufferSRVUAV		m_visibilityAll;
 	
 	DirectX::DXBufferSRVUAV		m_visibilityAppend;
+	DirectX::DXBufferSRVUAV		m_dirtyEdges;
+	DirectX::DXBufferSRVUAV		m_dirtyEdgeRecords;
 	
 	DirectX::DXBufferSRVUAV		m_maxDisplacement;	
 	
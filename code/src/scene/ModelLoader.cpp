@@ -13,18 +13,12 @@
 //   language governing permissions and limitations under the Apache License.
 //
 
-#define ASSIMP_DLL
 //#define CHECKLEAKS
 
 #include "stdafx.h"
 
 
 #include <SDKMisc.h>
-#include <assimp/cimport.h>
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
-#include <assimp/scene.h>
-#include <assimp/mesh.h>
 
 #include "ModelLoader.h"
 #include "DXModel.h"
@@ -33,12 +27,18 @@
 
 
 #include "dynamics/Physics.h"
+#include "dynamics/DeformablePairCache.h"
 #include <SDX/StringConversion.h>
-#include "utils/SpatialSort.h"
+#include "utils/VertexWelder.h"
 #include "scene/ModelInstance.h"
 #include "dynamics/AnimationGroup.h"
+#include "dynamics/AnimationCompression.h"
 
 #include "scene/DXSubDModel.h"
+#include "scene/SubDTopologyCache.h"
+#include "scene/SceneCache.h"
+#include "scene/QuadAdjacency.h"
+#include "utils/Timer.h"
 
 #include <iostream>
 #include <fstream>
@@ -76,68 +76,100 @@ bool StringContains(const std::string& str, const std::string& search)
 // non sharable attributes such as uv coords are applied per face
 bool MakeSharedVertex(const std::vector<XMFLOAT4A> &vertices, std::vector<XMFLOAT4A>& uniqueVertices, std::vector<unsigned int>& replaceIndex)
 {
-	uniqueVertices.reserve(vertices.size());
-	replaceIndex.resize(vertices.size(), 0xffffffff);
+	// same result as a SpatialSort::FindIdenticalPositions query per vertex, hashed and merged in parallel
+	VertexWelder welder;
+	welder.Weld(vertices, uniqueVertices, replaceIndex);
 
-	SpatialSort vertexFinder;
-	vertexFinder.Fill(&vertices[0], static_cast<unsigned int>(vertices.size()),sizeof(XMFLOAT4A));
+	return S_OK;
+}
 
-	std::vector<unsigned int> verticesFound;
-	verticesFound.reserve(10);
 
-	for(unsigned int a = 0; a < vertices.size(); ++a)
-	{
-		XMFLOAT4A v = vertices[a];
-		vertexFinder.FindIdenticalPositions(v, verticesFound);
-		unsigned int matchIndex = 0xffffffff;
+// cpu side of a subd model, built on a loader thread. the far mesh (or the hbr mesh when limit stencils are needed) is
+// handed to the DXOSDMesh by CreateOSDModel on the render thread
+struct PreparedOSDMesh
+{
+	PreparedOSDMesh() : farMesh(NULL), hbrMesh(NULL), numExtraordinary(0), isDeformable(false) {}
+
+	bool	IsValid() const { return farMesh != NULL || hbrMesh != NULL; }
+	void	Release()		{ delete farMesh; farMesh = NULL; delete hbrMesh; hbrMesh = NULL; }
+
+	OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>*	farMesh;
+	OpenSubdiv::HbrMesh<OpenSubdiv::OsdVertex>*	hbrMesh;
+	std::vector<XMFLOAT4A>						vertices;	// welded control cage
+	std::vector<XMUINT4>						faces;
+	std::vector<SPtexNeighborData>				ptexNeighborData;
+	std::vector<SExtraordinaryInfo>				extraordinaryInfo;
+	std::vector<SExtraordinaryData>				extraordinaryData;
+	UINT										numExtraordinary;
+	bool										isDeformable;
+};
+
+// welding, half edges and far tables of a quad mesh, does not touch the device
+HRESULT PrepareOSDModel(const MeshData* meshData, bool isDeformable, PreparedOSDMesh& prepared)
+{	
+	HRESULT hr = S_OK;
+	assert(meshData->meshes.size() == 1);
 
-		// check unique indices close enough if vertex is already present
-		for(unsigned int b = 0; b < verticesFound.size();++b)
-		{
-			const unsigned int vIdx = verticesFound[b];	
-			const unsigned int uIdx = replaceIndex[vIdx];
+	std::cout << "prepare osd model " << meshData->name << std::endl;
 
-			if(uIdx & 0x80000000) continue;
+	prepared.Release();
+	prepared.isDeformable = isDeformable;
 
-			matchIndex = uIdx;
-			break;
-		}
+	const bool hasTexcoords = !meshData->texcoords.empty();
 
-		if(matchIndex != 0xffffffff)
+	// far tables and tile overlap data from a previous load of the same mesh, skips the hbr mesh.
+	// limit stencils are built from the hbr mesh, they bypass the cache
+	const bool useTopologyCache = g_app.g_useTopologyCache && g_app.g_stencilLimitSamples == 0;
+	UINT64 topologyKey = 0;
+	if (useTopologyCache)
+	{
+		topologyKey = SubDTopologyCache::ComputeKey(meshData, isDeformable);
+
+		SubDTopologyCache cache;
+		if (SUCCEEDED(cache.Open(SubDTopologyCache::GetFileName(topologyKey), topologyKey)))
 		{
-			// store mapping to unique vertex
-			replaceIndex[a] = matchIndex | 0x80000000;		
+			std::cout << "topology cache hit " << SubDTopologyCache::GetFileName(topologyKey) << std::endl;
+
+			cache.GetVertices(prepared.vertices);
+			cache.GetFaces(prepared.faces);
+			cache.GetPtexNeighborData(prepared.ptexNeighborData);
+			cache.GetExtraordinaryInfo(prepared.extraordinaryInfo, prepared.extraordinaryData);
+			prepared.numExtraordinary = static_cast<UINT>(prepared.extraordinaryInfo.size());
+			prepared.farMesh = cache.CreateFarMesh();
+			return hr;
 		}
-		else
-		{			
-			// no unique vertex found, so add it
-			replaceIndex[a] = (unsigned int) uniqueVertices.size();
-			uniqueVertices.push_back(v);
-		}		
 	}
 
-	for(int i = 0 ; i < replaceIndex.size(); ++i)
-		replaceIndex[i] &= ~0x80000000;
-
-	return S_OK;
-}
-
-
-HRESULT CreateOSDModel(const MeshData* meshData, DXOSDMesh* model, bool isDeformable)
-{	
-	HRESULT hr = S_OK;
-	assert(meshData->meshes.size() == 1);
-
-	std::cout << "create osd model" << std::endl;
-
 	// make shared vertex set using only position attribute
-	std::vector<XMFLOAT4A>	uniqueVertices;
+	std::vector<XMFLOAT4A>&	uniqueVertices = prepared.vertices;
 	std::vector<UINT>		mapSepToShared;
 	MakeSharedVertex(meshData->vertices, uniqueVertices, mapSepToShared);
 
 	UINT numV	= static_cast<UINT>(uniqueVertices.size());	
 	UINT numF	= static_cast<UINT>(meshData->meshes[0].indicesQuad.size());
 
+	// TODO create OBB	
+	std::vector<XMUINT4>& uniqueFaceIndices = prepared.faces;
+	uniqueFaceIndices.reserve(numF);
+	for(auto origIndices : meshData->meshes[0].indicesQuad)
+	{
+		XMUINT4 sharedIndices;		
+		sharedIndices.x =  mapSepToShared[origIndices.x];
+		sharedIndices.y =  mapSepToShared[origIndices.y];
+		sharedIndices.z =  mapSepToShared[origIndices.z];
+		sharedIndices.w =  mapSepToShared[origIndices.w];
+
+		uniqueFaceIndices.push_back(sharedIndices);
+	}
+
+	// half edges of the cage for the tile overlap data, also rejects cages hbr cannot represent
+	QuadAdjacency adjacency;
+	if (FAILED(adjacency.Create(uniqueFaceIndices, numV)))
+	{
+		std::cerr << "invalid subd cage topology in " << meshData->name << std::endl;
+		return E_FAIL;
+	}
+
 	// create OpenSubdiv CPU mesh data, optionally with uv coordinates	
 	const int fvarwith = meshData->texcoords.empty() ? 0 : 2; 
 	static int indices[2] = {0, 1};
@@ -155,22 +187,6 @@ HRESULT CreateOSDModel(const MeshData* meshData, DXOSDMesh* model, bool isDeform
 																									   fvarwith);		// hierarchy 
 
 
-	// TODO create OBB	
-	std::vector<XMUINT4> uniqueFaceIndices;
-	uniqueFaceIndices.reserve(numF);
-	for(auto origIndices : meshData->meshes[0].indicesQuad)
-	{
-		XMUINT4 sharedIndices;		
-		sharedIndices.x =  mapSepToShared[origIndices.x];
-		sharedIndices.y =  mapSepToShared[origIndices.y];
-		sharedIndices.z =  mapSepToShared[origIndices.z];
-		sharedIndices.w =  mapSepToShared[origIndices.w];
-
-		uniqueFaceIndices.push_back(sharedIndices);
-	}
-
-	bool hasTexcoords = !meshData->texcoords.empty();
-
 
 	// alloc vertex data
 	for(UINT i = 0 ; i < numV; ++i)
@@ -224,199 +240,77 @@ HRESULT CreateOSDModel(const MeshData* meshData, DXOSDMesh* model, bool isDeform
 	}
 
 
-	std::cout << "numCoarseFaces: " << hmesh->GetNumCoarseFaces() << std::endl;
+	// Tile Overlap Updater: the regular case requires the neighboring tile and the edge on that tile for each edge,
+	// extraordinary vertices need the incident tiles and the corner of the vertex in each tile to equalize the tile corners
+	adjacency.GetPtexNeighborData(prepared.ptexNeighborData);
+	adjacency.GetExtraordinaryInfo(prepared.extraordinaryInfo, prepared.extraordinaryData);
+	prepared.numExtraordinary = adjacency.GetNumExtraordinary();
 
+	std::cout << "num faces: " << numF << ", extraordinary vertices: " << adjacency.GetNumExtraordinary() 
+			  << ", incident faces: " << prepared.extraordinaryData.size() << std::endl;
 
-	// Tile Overlap Updater: Regular Case requires neighboring
-	// tile IDs and edge on that neighboring tile
-	// that is one int4 to store neighbors to each edge in a tile,
-	// edges are ordered by ordered by winding (ccw in our case)
-	// further we need one int4 to store which edge on neighbor is connected to 
-	// current tiles edges 
-		
-	std::vector<SPtexNeighborData>& ptexNeighborData = model->GetPtexNeighborDataREF();
-	ptexNeighborData.clear();
-	ptexNeighborData.resize(hmesh->GetNumCoarseFaces());
-
-	UINT cntExtraordinaryVertices = 0;
-	UINT cntFacesWithExtraordinaryVertices = 0;
-	for(int i = 0; i <  hmesh->GetNumCoarseFaces(); ++i)
+	if (g_app.g_stencilLimitSamples > 0)
 	{
-		auto face = hmesh->GetFace(i);
-		auto ownPtexID = face->GetPtexIndex();
-
-		// get neighbors
-		auto startEdge = face->GetFirstEdge();
-		//std::cout << "PTex IDs: self: " << ownPtexID << std::endl;
-
-		bool faceHasExtrardinary  = false;
-		for(int vID = 0; vID < face->GetNumVertices(); ++vID)
-		{
-			if(face->GetVertex(vID)->IsExtraordinary())
-			{
-				//std::cout << "face " << i << " has extraordinary vertex at id: " << vID << std::endl;
-				faceHasExtrardinary  = true;
-				cntExtraordinaryVertices++;
-			}
-		}
-		if(faceHasExtrardinary)
-			++cntFacesWithExtraordinaryVertices;
-
-
-		int eIdx = 0;
-		auto currEdge = startEdge;		
-		do{
-
-			if(currEdge->IsBoundary())
-			{
-				//std::cout << "boundary" << std::endl;
-				ptexNeighborData[ownPtexID].ptexIDNeighbor[eIdx] = -1;
-				ptexNeighborData[ownPtexID].neighEdgeID[eIdx] = -1;
-			}
-			else
-			{
-				auto neighEdge = currEdge->GetOpposite();
-				auto neighFace = neighEdge->GetFace();
-				auto neighPtexID = neighFace->GetPtexIndex();
-				auto neighStartEdge = neighFace->GetFirstEdge();
-
-				UINT nEdgeIdx = 0;
-				auto currNeighEdge = neighStartEdge;	
-				do{
-
-					if(!currNeighEdge->IsBoundary() && currNeighEdge->GetOpposite()->GetFace()->GetPtexIndex() == ownPtexID)
-					{
-						break;
-					}
-
-					nEdgeIdx++;
-					currNeighEdge = currNeighEdge->GetPrev();
-				} while(currNeighEdge != neighStartEdge);
-
-
-				//std::cout << "e" << eIdx << " neigh id: "<< neighPtexID << " we are neighEdgeID " << nEdgeIdx << std::endl;
-
-				ptexNeighborData[ownPtexID].ptexIDNeighbor[eIdx] = neighPtexID;
-				ptexNeighborData[ownPtexID].neighEdgeID[eIdx] = nEdgeIdx;			
-			}
-
-			eIdx++;
-			currEdge = currEdge->GetPrev();		// WRONG? use getPrev for counter clockwise  ordering
-		} while (currEdge != startEdge);		
+		// the limit stencils are built from the hbr mesh in DXOSDMesh::Create
+		prepared.hbrMesh = hmesh;
+		return hr;
 	}
 
+	// same far tables as the osd mesh builds from the hbr mesh (adaptive, fvar data with texcoords).
+	// FarTopologyBuilder only produces uniform tables, the adaptive patches need the hbr mesh
+	OpenSubdiv::FarMeshFactory<OpenSubdiv::OsdVertex> meshFactory(hmesh, g_app.g_maxSubdivisions, true);
+	prepared.farMesh = meshFactory.Create(hasTexcoords);
+	
+	delete hmesh;
 
-
-#if 0
-	std::vector<PtexNeighborData>& ptexNeighborDataCheck = model->GetPtexNeighborDataREF();
-	for(int ptxID = 0; ptxID < 5; ++ptxID)
+	if (useTopologyCache && prepared.farMesh)
 	{
-		for(int e = 0; e < 4; ++e)
+		CreateDirectoryA(g_app.g_topologyCacheDir.c_str(), NULL);
+		if (FAILED(SubDTopologyCache::Save(SubDTopologyCache::GetFileName(topologyKey), topologyKey, prepared.farMesh, uniqueVertices, uniqueFaceIndices,
+										   prepared.ptexNeighborData, prepared.extraordinaryInfo, prepared.extraordinaryData)))
 		{
-			auto neighPtexID = ptexNeighborDataCheck[ptxID].ptexIDNeighbor[e];
-			auto nEdgeIdx = ptexNeighborDataCheck[ptxID].neighEdgeID[e];
-			std::cout << "e" << e << " neigh id: "<< neighPtexID << " we are neighEdgeID " << nEdgeIdx << std::endl;
+			std::cerr << "could not write the topology cache of " << meshData->name << std::endl;
 		}
 	}
-	//	std::cout << "face: " << i << " ptex ID: " << hmesh->GetFace(i)->GetPtexIndex() << "\t\t";
-#endif
-
-	UINT numFaces = hmesh->GetNumFaces();
-	std::cout << "num Faces: " << numFaces << std::endl;
-	std::cout << "numFaces with extraordinary Vertices: " << cntFacesWithExtraordinaryVertices << " numExtraordinary Vertices: " << cntExtraordinaryVertices << std::endl;
-
-	//for(int i = 0; i < hmesh->GetNumCoarseFaces(); ++i)
-	//	std::cout << "face: " << i << " ptex ID: " << hmesh->GetFace(i)->GetPtexIndex() << "\t\t";
-
-	// Tile Overlap Updater Data:	
-	// for each extraordinary vertex extract neighboring face IDs
-	// and the next adjacent edge on that neighboring face edge
-	// to later exqualize the tile data around an extraordinary vertex
-	{
-		std::vector<SExtraordinaryInfo>& eInfo = model->GetExtraordinaryInfoCPURef();
-		eInfo.clear();
-
-		std::vector<SExtraordinaryData>& eData = model->GetExtraordinaryDataCPURef();
-		eData.clear();
-
-		UINT cntExtraordinary = 0;
-		UINT cntValences = 0;
-
-		UINT numVertices = hmesh->GetNumVertices();
-		/// TODO BOUNDARY CASES
-		for (unsigned int i = 0; i < numVertices; ++i)
-		{
-			auto v = hmesh->GetVertex(i);
-
-			if(v->IsExtraordinary())
-			{		
-				cntExtraordinary++;
-				int valence =  v->GetValence();
-
-				cntValences+= valence;
-
-				SExtraordinaryInfo info;
-				info.valence = valence;
-				info.startIndex = static_cast<UINT>(eData.size());  // start index in data array // checkme here or in shader * 2 
-				eInfo.push_back(info);
 
+	return prepared.farMesh ? hr : E_FAIL;
+}
 
-				// traverse around vertex to get ptex face ids and vertex in face number
-
-				auto startEdge = v->GetIncidentEdge();
-
-				auto currEdge = startEdge;	
+// gpu mesh from the prepared tables, takes ownership of the far or hbr mesh
+HRESULT CreateOSDModel(const MeshData* meshData, PreparedOSDMesh& prepared, DXOSDMesh* model, bool isDeformable)
+{	
+	HRESULT hr = S_OK;
+	assert(meshData->meshes.size() == 1);
 
-				int cnt = 0;
-				do 
-				{
-					// quick fix, does not work 
-					if(currEdge->IsBoundary())
-						break;
-					auto vID    = currEdge->GetVertex()->GetID();
-					auto face   = currEdge->GetLeftFace();
-					auto ptexID = face->GetPtexIndex();					
-
-					// vertex 0,1,2,3 in face 					
-					for(int vNumber = 0; vNumber < face->GetNumVertices(); ++vNumber)
-					{					
-						if(vID == face->GetVertexID(vNumber))
-						{
-							SExtraordinaryData data;
-							data.ptexFaceID = ptexID;
-							data.vertexInFace = vNumber;
-							eData.push_back(data);
-							break;
-							//std::cout << "im vertex number " << vNumber << " in face " << face->GetID() << std::endl;
-						}
-					}
-					cnt++;
-					if(vID  != startEdge->GetVertex()->GetID())
-					{
-						std::cerr << "ERROR" << std::endl;
-						exit(1);
-					}
+	std::cout << "create osd model" << std::endl;
 
-					//currEdge = currEdge->GetPrev()->GetOpposite(); // checkme ccw
-					currEdge = currEdge->GetOpposite()->GetNext(); // checkme ccw
-				} while (currEdge != startEdge);
-			}
-		}
+	// models which share one mesh of the file consume the prepared tables only once
+	if (!prepared.IsValid() || prepared.isDeformable != isDeformable)
+	{
+		V_RETURN(PrepareOSDModel(meshData, isDeformable, prepared));
+	}
 
-		model->SetNumExtraordinary(static_cast<UINT>(eInfo.size()));
+	const bool hasTexcoords = !meshData->texcoords.empty();
 
-		std::cout << "numExtraordinary " << eInfo.size() << "should be: " << cntExtraordinary << std::endl;
-		std::cout << "numDataEntries " << eData.size() << "should match sumValences: " << cntValences << std::endl;
-		std::cout << "num vertices in mesh: " << hmesh->GetNumVertices() << " unique vertices from loader: " << uniqueVertices.size() << std::endl;
-	}
+	model->GetPtexNeighborDataREF().swap(prepared.ptexNeighborData);
+	model->GetExtraordinaryInfoCPURef().swap(prepared.extraordinaryInfo);
+	model->GetExtraordinaryDataCPURef().swap(prepared.extraordinaryData);
+	model->SetNumExtraordinary(prepared.numExtraordinary);
 
 	model->SetMaterial(meshData->meshes[0].material);
 	model->SetName(meshData->name);
 
-	V(model->Create(DXUTGetD3D11Device(),hmesh, uniqueVertices, hasTexcoords, isDeformable));
+	if (prepared.farMesh)
+	{
+		V(model->CreateFromFarMesh(DXUTGetD3D11Device(), prepared.farMesh, prepared.faces, prepared.vertices, hasTexcoords, isDeformable));
+		prepared.farMesh = NULL;
+	}
+	else
+	{
+		V(model->Create(DXUTGetD3D11Device(), prepared.hbrMesh, prepared.vertices, hasTexcoords, isDeformable));
+	}
+	prepared.Release();
 	
-	delete hmesh;
-
 	return hr;
 }
 
@@ -428,64 +322,63 @@ HRESULT CreateOSDModel(const MeshData* meshData, DXOSDMesh* model, bool isDeform
 //	
 //}
 
-HRESULT CreateMaterial(const aiMaterial* aimat, Scene* scene, DXMaterial*& mat) 
+HRESULT CreateMaterial(const SceneCache& cache, UINT materialIndex, Scene* scene, DXMaterial*& mat) 
 {
 	HRESULT hr = S_OK;
 
-	aiString aiMatName;
-	if(aimat->Get(AI_MATKEY_NAME, aiMatName) != AI_SUCCESS)
+	const SceneCache::CachedMaterial& cachedMat = cache.GetSection<SceneCache::CachedMaterial>(SceneCache::SECTION_MATERIALS)[materialIndex];
+
+	const char* matName = cache.GetString(cachedMat.name);
+	if(!matName)
 	{
 		std::cerr << "[ERROR] material has no name" << std::endl;
-		aiMatName = "default1337";
+		matName = "default1337";
 	}
 
 	// check if material is cached
-	if(scene->GetMaterials().IsCached(aiMatName.C_Str()))
+	if(scene->GetMaterials().IsCached(matName))
 	{
 		//std::cout << "use cached material" << std::endl;
-		mat = scene->GetMaterials().GetCachedMaterial(aiMatName.C_Str());
+		mat = scene->GetMaterials().GetCachedMaterial(matName);
 		return S_OK;
 	}
 	else
 	{
 		std::string displacementTileFile = "";
 		mat = new DXMaterial();
-		mat->_name = aiMatName.C_Str();
+		mat->_name = matName;
 
-		aiColor3D col;
-		if(aimat->Get(AI_MATKEY_COLOR_AMBIENT, col) == AI_SUCCESS)
+		if(cachedMat.flags & SceneCache::MATERIAL_AMBIENT)
 		{
 			//std::cout << "amb: " << mat->_kDiffuse.x << ", " << mat->_kDiffuse.y << ", " << mat->_kDiffuse.z << std::endl;
-			mat->_kAmbient = XMFLOAT3A(&col[0]);				
+			mat->_kAmbient = XMFLOAT3A(cachedMat.ambient.x, cachedMat.ambient.y, cachedMat.ambient.z);				
 		}
 
-		if(aimat->Get(AI_MATKEY_COLOR_DIFFUSE, col) == AI_SUCCESS)
+		if(cachedMat.flags & SceneCache::MATERIAL_DIFFUSE)
 		{
-			mat->_kDiffuse = XMFLOAT3A(col.r, col.g, col.b);
+			mat->_kDiffuse = XMFLOAT3A(cachedMat.diffuse.x, cachedMat.diffuse.y, cachedMat.diffuse.z);
 			//std::cout << mat->_kDiffuse.x << ", " << mat->_kDiffuse.y << ", " << mat->_kDiffuse.z << std::endl;
 		}
 
-		if(aimat->Get(AI_MATKEY_COLOR_SPECULAR, col) == AI_SUCCESS)
+		if(cachedMat.flags & SceneCache::MATERIAL_SPECULAR)
 		{
-			mat->_kSpecular = XMFLOAT3A(&col[0]);
+			mat->_kSpecular = XMFLOAT3A(cachedMat.specular.x, cachedMat.specular.y, cachedMat.specular.z);
 		}
 
 		//used for special material flag like snow
-		if(aimat->Get(AI_MATKEY_COLOR_EMISSIVE, col) == AI_SUCCESS)
+		if(cachedMat.flags & SceneCache::MATERIAL_EMISSIVE)
 		{
 			//std::cout << "emmisive col: " << col.r << ", " << col.g  << ", " << col.b << std::endl;
 
-			mat->_specialMaterialFlag = col.r;	
+			mat->_specialMaterialFlag = cachedMat.emissive.x;	
 		}
 
-		float shininess;
-		if(aimat->Get(AI_MATKEY_SHININESS, shininess) == AI_SUCCESS)
-			mat->_shininess = shininess;	
+		if(cachedMat.flags & SceneCache::MATERIAL_SHININESS)
+			mat->_shininess = cachedMat.shininess;	
 
-		float deformationHardness;
-		if(aimat->Get(AI_MATKEY_REFRACTI, deformationHardness) == AI_SUCCESS)
+		if(cachedMat.flags & SceneCache::MATERIAL_REFRACTION)
 		{
-			float hardness = deformationHardness - 1;
+			float hardness = cachedMat.refraction - 1;
             // set default value for non tagged meshes
 			if(hardness < 0.001)
 				hardness = 0.25;
@@ -497,11 +390,10 @@ HRESULT CreateMaterial(const aiMaterial* aimat, Scene* scene, DXMaterial*& mat)
 
 
 
-		aiString aiTexPath;
-		if(aimat->GetTexture(aiTextureType_DIFFUSE, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_DIFFUSE]))
 		{
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetDiffuseSRV(g_textureManager.AddTexture(texPath));
 
 			//std::cout << "has diffuse texture" <<texPath << std::endl;			
@@ -512,56 +404,56 @@ HRESULT CreateMaterial(const aiMaterial* aimat, Scene* scene, DXMaterial*& mat)
 			// mat->SetDiffuseSRV(g_textureManager.AddTexture("../../media/models/white.dds"));
 		}
 
-		if(aimat->GetTexture(aiTextureType_NORMALS, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_NORMALS]))
 		{				
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetNormalsSRV(g_textureManager.AddTexture(texPath));		
 			//std::cout << "has normal texture" <<texPath << std::endl;			
 		}
 
-		if(aimat->GetTexture(aiTextureType_SPECULAR, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_SPECULAR]))
 		{
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetSpecularTexSRV(g_textureManager.AddTexture(texPath));
 
 			//std::cout << "has specular texture" <<texPath << std::endl;			
 		}
 
-		if(aimat->GetTexture(aiTextureType_OPACITY, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_OPACITY]))
 		{
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetAlphaTexSRV(g_textureManager.AddTexture(texPath));
 
 			//std::cout << "has alpha texture" <<texPath << std::endl;			
 		}
 
-		if(aimat->GetTexture(aiTextureType_DISPLACEMENT, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_DISPLACEMENT]))
 		{
 			//std::cout << "has displacement texture" << std::endl;
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetDisplacementSRV(g_textureManager.AddTexture(texPath));
 			displacementTileFile = texPath;
 		}
 
-		if(aimat->GetTexture(aiTextureType_HEIGHT, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_HEIGHT]))
 		{
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetDisplacementSRV(g_textureManager.AddTexture(texPath));		
 
 			displacementTileFile = texPath;
 			//std::cout << "has displacement texture (disguised as aiTextureType_HEIGHT) " << std::endl;
 		}
 
-		if(aimat->GetTexture(aiTextureType_EMISSIVE, 0, &aiTexPath) == AI_SUCCESS)
+		if(const char* texFile = cache.GetString(cachedMat.textures[SceneCache::TEXTURE_EMISSIVE]))
 		{			
 			//std::cout << "has displacement texture (we use aiTextureType_EMISSIVE) " << std::endl;
 			std::string texPath = gCurrModelPath;
-			texPath.append(std::string(aiTexPath.C_Str()));
+			texPath.append(texFile);
 			mat->SetDisplacementSRV(g_textureManager.AddTexture(texPath));			
 			displacementTileFile = texPath;
 		}
@@ -586,13 +478,16 @@ HRESULT CreateMaterial(const aiMaterial* aimat, Scene* scene, DXMaterial*& mat)
 }
 
 
-void TraverseAndStoreAssimpNodeHierachy(const aiNode* assimpNode, Node*& node, UINT animationID, SkinningMeshAnimationManager* mgr) 
+void TraverseAndStoreNodeHierachy(const SceneCache& cache, UINT nodeIndex, Node*& node, UINT animationID, SkinningMeshAnimationManager* mgr) 
 {
+	const SceneCache::CachedNode* nodes = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES);
+	const SceneCache::CachedNode& cachedNode = nodes[nodeIndex];
+
 	// Handle root node
 	if (node == NULL) 
 	{
-		XMMATRIX nodeTransformation(assimpNode->mTransformation[0]);
-		node = new Node(std::string(assimpNode->mName.data));
+		XMMATRIX nodeTransformation = XMLoadFloat4x4(&cachedNode.transformation);
+		node = new Node(std::string(cache.GetString(cachedNode.name)));
 		node->setTransformation(nodeTransformation);
 		UINT boneID = mgr->findBoneID(*node);
 		if(boneID != INDEX_NOT_FOUND)
@@ -605,10 +500,10 @@ void TraverseAndStoreAssimpNodeHierachy(const aiNode* assimpNode, Node*& node, U
 	}
 
 	// Traverse and store children
-	for (UINT i = 0; i < assimpNode->mNumChildren; ++i) 
+	for (UINT i = cachedNode.firstChild; i < cachedNode.firstChild + cachedNode.numChildren; ++i) 
 	{
-		XMMATRIX nodeTransformation(assimpNode->mChildren[i]->mTransformation[0]);		
-		Node*& newNode = node->addChild(new Node(std::string(assimpNode->mChildren[i]->mName.data)));
+		XMMATRIX nodeTransformation = XMLoadFloat4x4(&nodes[i].transformation);		
+		Node*& newNode = node->addChild(new Node(std::string(cache.GetString(nodes[i].name))));
 		newNode->setTransformation(nodeTransformation);
 		UINT boneID = mgr->findBoneID(*newNode);
 		if(boneID != INDEX_NOT_FOUND)
@@ -618,105 +513,117 @@ void TraverseAndStoreAssimpNodeHierachy(const aiNode* assimpNode, Node*& node, U
 			//exit(1);
 		}
 		newNode->setAnimationAndNodeAnimationIDs(animationID, mgr->findNodeAnimationID(animationID, *newNode));
-		TraverseAndStoreAssimpNodeHierachy(assimpNode->mChildren[i], newNode, animationID, mgr);
+		TraverseAndStoreNodeHierachy(cache, i, newNode, animationID, mgr);
 	}
 }
 
 
 
-static void PrintMeshes(const aiNode* node, const aiScene* scene,  int level)
+static void PrintMeshes(const SceneCache& cache, UINT nodeIndex, int level)
 {
-	for(UINT  i = 0; i< node->mNumMeshes; ++i)
+	const SceneCache::CachedNode& node = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES)[nodeIndex];
+	const UINT* nodeMeshes = cache.GetSection<UINT>(SceneCache::SECTION_NODE_MESHES);
+	for(UINT  i = 0; i< node.numMeshes; ++i)
 	{
 		for(int j = 0 ; j < level; ++j)
 		{
 			std::cout << "*";
 		}
-		std::cout << scene->mMeshes[node->mMeshes[i]]->mName.C_Str() << std::endl;
+		std::cout << cache.GetString(cache.GetSection<SceneCache::CachedMesh>(SceneCache::SECTION_MESHES)[nodeMeshes[node.firstMesh + i]].name) << std::endl;
 	}
 }
-static void PrintAssimpHierarchy(const aiNode* node, const aiScene* scene, int level)
+static void PrintHierarchy(const SceneCache& cache, UINT nodeIndex, int level)
 {
+	const SceneCache::CachedNode& node = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES)[nodeIndex];
 	for(int j = 0 ; j < level; ++j)
 	{
 		std::cout << "*";
 	}
-	std::cout << "numMeshes "<< node->mNumMeshes << std::endl; 
+	std::cout << "numMeshes "<< node.numMeshes << std::endl; 
 
-	PrintMeshes(node, scene, level);
-	for(UINT i = 0; i < node->mNumChildren; ++i)
+	PrintMeshes(cache, nodeIndex, level);
+	for(UINT i = 0; i < node.numChildren; ++i)
 	{
 		for(int j = 0 ; j < level; ++j)
 		{
 			std::cout << "*";
 		}
 
-		std::cout << node->mName.C_Str() << " numMeshes " << node->mNumMeshes << " children: " << node->mNumChildren <<std::endl;
+		std::cout << cache.GetString(node.name) << " numMeshes " << node.numMeshes << " children: " << node.numChildren <<std::endl;
 
 
-		PrintAssimpHierarchy(node->mChildren[i],scene, (level+1));
+		PrintHierarchy(cache, node.firstChild + i, (level+1));
 	}
 }
 
 
-void GetMeshesInSubtree(const aiNode* node, std::vector<UINT>& meshIDs, const aiScene* aiscene)
+void GetMeshesInSubtree(const SceneCache& cache, UINT nodeIndex, std::vector<UINT>& meshIDs)
 {
-	node->mTransformation[0];
-	for(UINT i = 0; i < node->mNumMeshes; ++i)
+	const SceneCache::CachedNode* nodes = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES);
+	const SceneCache::CachedMesh* meshes = cache.GetSection<SceneCache::CachedMesh>(SceneCache::SECTION_MESHES);
+	const UINT* nodeMeshes = cache.GetSection<UINT>(SceneCache::SECTION_NODE_MESHES);
+	const SceneCache::CachedNode& node = nodes[nodeIndex];
+
+	for(UINT i = 0; i < node.numMeshes; ++i)
 	{
-		const UINT meshID  = node->mMeshes[i];
-		std::string meshName = aiscene->mMeshes[meshID]->mName.C_Str();
+		const UINT meshID  = nodeMeshes[node.firstMesh + i];
+		std::string meshName = cache.GetString(meshes[meshID].name);
 		if(StringContains(meshName, "phy"))
 			continue;
 		else
 			meshIDs.push_back(meshID);
 	}
 
-	for(UINT i = 0; i < node->mNumChildren; ++i)
+	for(UINT i = node.firstChild; i < node.firstChild + node.numChildren; ++i)
 	{
-		aiNode* childNode =  node->mChildren[i];
-		if(StringContains(childNode->mName.C_Str(), "phy"))
+		if(StringContains(cache.GetString(nodes[i].name), "phy"))
 			continue;
 		else
-			GetMeshesInSubtree(childNode, meshIDs, aiscene);
+			GetMeshesInSubtree(cache, i, meshIDs);
 	}
 }
 
-static void TraverseAssimpNodeHierachy(const aiNode* assimpNode, std::map<UINT,const aiNode*>& meshIDtoNode, const std::string& fileName) 
+static void TraverseNodeHierachy(const SceneCache& cache, UINT nodeIndex, std::map<UINT,UINT>& meshIDtoNode, const std::string& fileName) 
 {
-	std::string nodeName = assimpNode->mName.C_Str();
+	const SceneCache::CachedNode& node = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES)[nodeIndex];
+	std::string nodeName = cache.GetString(node.name);
 
-	if(assimpNode->mNumMeshes > 1)
+	if(node.numMeshes > 1)
 		std::cerr << "[WARNING] model node " << nodeName << " mNumMeshes > 1 !" << std::endl; 
 
-	if(assimpNode->mNumMeshes > 0) 
+	if(node.numMeshes > 0) 
 	{
-		const UINT meshID = assimpNode->mMeshes[0];
-		meshIDtoNode[meshID] = assimpNode;
+		const UINT meshID = cache.GetSection<UINT>(SceneCache::SECTION_NODE_MESHES)[node.firstMesh];
+		meshIDtoNode[meshID] = nodeIndex;
 	}
 
 	// Traverse children
-	for (UINT i = 0; i < assimpNode->mNumChildren; ++i) 
+	for (UINT i = node.firstChild; i < node.firstChild + node.numChildren; ++i) 
 	{
-		TraverseAssimpNodeHierachy(assimpNode->mChildren[i],  meshIDtoNode, fileName);
+		TraverseNodeHierachy(cache, i,  meshIDtoNode, fileName);
 	}
 }
 
 
 
-HRESULT ParseAnimation(const aiScene* aiscene, AnimationGroup* animGroup)
+HRESULT ParseAnimation(const SceneCache& cache, AnimationGroup* animGroup)
 {
 	HRESULT hr = S_OK;
 	if (animGroup) 
 	{		
-		std::cout << "has " << aiscene->mNumAnimations << " animations " << std::endl;
+		const SceneCache::CachedAnimation* animations = cache.GetSection<SceneCache::CachedAnimation>(SceneCache::SECTION_ANIMATIONS);
+		const SceneCache::CachedChannel* channels = cache.GetSection<SceneCache::CachedChannel>(SceneCache::SECTION_CHANNELS);
+		const SceneCache::CachedRotationKey* rotationKeys = cache.GetSection<SceneCache::CachedRotationKey>(SceneCache::SECTION_ROTATION_KEYS);
+		const SceneCache::CachedVectorKey* vectorKeys = cache.GetSection<SceneCache::CachedVectorKey>(SceneCache::SECTION_VECTOR_KEYS);
+
+		std::cout << "has " << cache.GetCount(SceneCache::SECTION_ANIMATIONS) << " animations " << std::endl;
 		auto* skinningMgr =  animGroup->GetAnimationManager();
 		skinningMgr->printBones();
 
 		// Check animations and get all the node data.
-		UINT numAnimations = aiscene->HasAnimations() ? aiscene->mNumAnimations : 0;
+		UINT numAnimations = cache.GetCount(SceneCache::SECTION_ANIMATIONS);
 		fprintf(stderr, "\n----\n#Animations: %d \n----\n", numAnimations);
-		skinningMgr->globalInverseTransformationRef()= XMMatrixInverse(NULL, XMMATRIX(aiscene->mRootNode->mTransformation[0]));
+		skinningMgr->globalInverseTransformationRef()= XMMatrixInverse(NULL, XMLoadFloat4x4(&cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES)[0].transformation));
 
 		UINT numExistingAnimations = (UINT)skinningMgr->GetAnimationsRef().size();
 		skinningMgr->GetRootNodesRef().resize(skinningMgr->GetRootNodesRef().size() + numAnimations, NULL);
@@ -725,317 +632,417 @@ HRESULT ParseAnimation(const aiScene* aiscene, AnimationGroup* animGroup)
 		// Load and store animation data
 		for (UINT i = 0; i < numAnimations; ++i) 
 		{		
-			aiAnimation* assimpAnimation = aiscene->mAnimations[i];
+			const SceneCache::CachedAnimation& cachedAnimation = animations[i];
 			int animID = i + numExistingAnimations;
 			skinningMgr->GetAnimationsRef()[animID] = new Animation();
-			skinningMgr->GetAnimationsRef()[animID]->setNumChannels(assimpAnimation->mNumChannels);
-			skinningMgr->GetAnimationsRef()[animID]->setDuration((float)assimpAnimation->mDuration);
-			skinningMgr->GetAnimationsRef()[animID]->setTicksPerSecond((float)assimpAnimation->mTicksPerSecond);
-			//std::cout << "anim duration: " << assimpAnimation->mDuration << ", ticks per second: " << assimpAnimation->mTicksPerSecond << ", numChannels: " << assimpAnimation->mNumChannels << std::endl;
+			skinningMgr->GetAnimationsRef()[animID]->setNumChannels(cachedAnimation.numChannels);
+			skinningMgr->GetAnimationsRef()[animID]->setDuration(cachedAnimation.duration);
+			skinningMgr->GetAnimationsRef()[animID]->setTicksPerSecond(cachedAnimation.ticksPerSecond);
+			//std::cout << "anim duration: " << cachedAnimation.duration << ", ticks per second: " << cachedAnimation.ticksPerSecond << ", numChannels: " << cachedAnimation.numChannels << std::endl;
 
 
-			for (UINT j = 0; j < assimpAnimation->mNumChannels; ++j) {
-				aiNodeAnim* assimpNodeAnimation = assimpAnimation->mChannels[j];				
+			for (UINT j = 0; j < cachedAnimation.numChannels; ++j) {
+				const SceneCache::CachedChannel& channel = channels[cachedAnimation.firstChannel + j];				
 				NodeAnimation*& nodeAnimation = skinningMgr->GetAnimationsRef()[animID]->getChannelRef(j);
-				nodeAnimation = new NodeAnimation(std::string(assimpNodeAnimation->mNodeName.data));
+				nodeAnimation = new NodeAnimation(std::string(cache.GetString(channel.nodeName)));
 
 				// rotation
-				for (UINT k = 0; k < assimpNodeAnimation->mNumRotationKeys; ++k) 
+				for (UINT k = channel.firstRotation; k < channel.firstRotation + channel.numRotations; ++k) 
 				{
-					const aiQuaternion& quat = assimpNodeAnimation->mRotationKeys[k].mValue;	// assimp quaternion layout w, x, y, z
+					const XMFLOAT4& quat = rotationKeys[k].value;
 					XMVECTOR R = XMVectorSet( quat.x, quat.y,	quat.z,	quat.w);
-					nodeAnimation->AddRotation(RotationKey((float)assimpNodeAnimation->mRotationKeys[k].mTime, R));
+					nodeAnimation->AddRotation(RotationKey(rotationKeys[k].time, R));
 				}
 
 				// translation
-				for (UINT k = 0; k < assimpNodeAnimation->mNumPositionKeys; ++k) 
+				for (UINT k = channel.firstTranslation; k < channel.firstTranslation + channel.numTranslations; ++k) 
 				{					
-					const aiVector3D& trans = assimpNodeAnimation->mPositionKeys[k].mValue;					
+					const XMFLOAT3& trans = vectorKeys[k].value;					
 					XMVECTOR T = XMVectorSet(trans.x, trans.y, trans.z, 1);
-					nodeAnimation->AddTranslation(TranslationKey((float)assimpNodeAnimation->mPositionKeys[k].mTime, T));				
+					nodeAnimation->AddTranslation(TranslationKey(vectorKeys[k].time, T));				
 				}
 
 				// scaling
-				for (UINT k = 0; k < assimpNodeAnimation->mNumScalingKeys; ++k) 
+				for (UINT k = channel.firstScaling; k < channel.firstScaling + channel.numScalings; ++k) 
 				{				
-					XMVECTOR S = XMVectorSet(assimpNodeAnimation->mScalingKeys[k].mValue.x, assimpNodeAnimation->mScalingKeys[k].mValue.y, assimpNodeAnimation->mScalingKeys[k].mValue.z, 1);
-					nodeAnimation->AddScaling(ScalingKey((float)assimpNodeAnimation->mScalingKeys[k].mTime, S));
+					XMVECTOR S = XMVectorSet(vectorKeys[k].value.x, vectorKeys[k].value.y, vectorKeys[k].value.z, 1);
+					nodeAnimation->AddScaling(ScalingKey(vectorKeys[k].time, S));
 				}
 
 			}
+
+			if (g_app.g_compressAnimations)
+			{
+				Animation* animation = skinningMgr->GetAnimationsRef()[animID];
+				const size_t rawBytes = CompressedAnimationClip::GetRawBytes(*animation);
+				animation->compress(AnimationCompressionSettings());
+				if (animation->getCompressedClip())
+					fprintf(stderr, "compressed animation %d: %u of %u keys, %u -> %u bytes\n", animID, animation->getCompressedClip()->GetNumKeys(),
+							animation->getCompressedClip()->GetNumSourceKeys(), (UINT)rawBytes, (UINT)animation->getCompressedClip()->GetNumBytes());
+			}
 		}
 
-		// Traverse assimp node hierachy and copy it into the local datastructures
+		// Traverse the node hierachy and copy it into the local datastructures
 		//if(numExistingAnimations == 0)
 		{
 			for (UINT i = 0; i < numAnimations; ++i) 
 			{
 				int animID = i + numExistingAnimations;
-				TraverseAndStoreAssimpNodeHierachy(aiscene->mRootNode, skinningMgr->GetRootNodesRef()[animID], animID, skinningMgr);
+				TraverseAndStoreNodeHierachy(cache, 0, skinningMgr->GetRootNodesRef()[animID], animID, skinningMgr);
 			}
 		}
+		skinningMgr->compileHierarchies();
 	}
 
 	return hr;
 }
 
 
-// load non animated meshes
-HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* animGroup, ModelGroup* loadToGroup)
-{	
+// cpu data of one model file, see ModelLoader::Prepare
+struct ModelLoadData
+{
+	struct MultiMesh
+	{
+		bool isQuadMesh;
+		int meshID;
+		int submeshID;
+		UINT baseVertex;	// first vertex of the submesh in the vertex arrays of the mesh
+		bool loaded;		// false for physics meshes and meshes without faces
+	};
+
+	~ModelLoadData()
+	{
+		for(auto& osdMesh : osdMeshes) osdMesh.Release();
+	}
+
+	std::string						fileName;
+	SceneCache						cache;				// packed scene, mapped until the models are created
+	std::vector<MultiMesh>			idToMesh;
+	std::vector<MeshData>			meshDataTri;		// hold meshdata, create tri or subd meshes from that data later
+	std::vector<MeshData>			meshDataQuad;		// hold meshdata, create tri or subd meshes from that data later
+	std::vector<PreparedOSDMesh>	osdMeshes;			// far tables of meshDataQuad
+	ModelLoadTimings				timings;
+};
+
+
+HRESULT ModelLoader::Prepare(const std::string& fileName, ModelLoadData*& data)
+{
 	HRESULT hr = S_OK;
 
-	const struct aiScene* aiscene = NULL;
-	unsigned int ppFlags = 	0			// import post-processing flags
-		//| aiProcess_Triangulate
-		//| aiProcess_GenSmoothNormals 
-		| aiProcess_ValidateDataStructure 
-		| aiProcess_FindInstances 
-		| aiProcess_JoinIdenticalVertices
-		//| aiProcess_Debone // BE CAREFUL WITH THIS.
-		//| aiProcess_SortByPType
-		//| aiProcess_PreTransformVertices
-		//| aiProcess_ConvertToLeftHanded				// for directx 
-		//| aiProcess_MakeLeftHanded
-		//| aiProcess_FlipUVs
-		//| aiProcess_FlipWindingOrder
-		//| aiProcess_Debone
-		//| aiProcess_GenUVCoords               // convert spherical, cylindrical, box and planar mapping to proper UVs
-		//| aiProcess_TransformUVCoords         // preprocess UV transformations (scaling, translation ...)
-		| aiProcess_LimitBoneWeights
-		;
-
-	aiPropertyStore* props = aiCreatePropertyStore();
-	aiSetImportPropertyInteger(props,AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT ); // we dont want to load lines and points
-
-    std::cout << "Load: " << fileName.c_str() << std::endl;
-	aiscene = (aiScene*)aiImportFileExWithProperties(fileName.c_str(),ppFlags, NULL, props);
-	aiReleasePropertyStore(props);
-
-	if(!aiscene)
+	data = new ModelLoadData();
+	data->fileName = fileName;
+	ModelLoadTimings& timings = data->timings;
+
+	// packed scene, mapped from the scene cache or imported with assimp on a miss
+	SceneCache& cache = data->cache;
+	std::cout << "Load: " << fileName.c_str() << std::endl;
+	double start = GetTimeMS();
+	if(FAILED(cache.Load(fileName)))
 	{
-		MessageBoxA(0, aiGetErrorString(), "ERROR", MB_OK);	
-		return S_FALSE;
+		std::cerr << "could not import " << fileName << std::endl;
+		Release(data);
+		return E_FAIL;
 	}
+	timings.parseMS = GetTimeMS() - start;
+	std::cout << (cache.IsCacheHit() ? "scene cache hit, " : "scene imported, ") << timings.parseMS << " ms" << std::endl;
 
-	gCurrModelPath = ExtractPath(fileName).append("/");	
+	const SceneCache::CachedMesh* cachedMeshes = cache.GetSection<SceneCache::CachedMesh>(SceneCache::SECTION_MESHES);
+	const SceneCache::CachedNode* cachedNodes = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES);
+	const UINT numMeshes = cache.GetCount(SceneCache::SECTION_MESHES);
 
+	start = GetTimeMS();
 
-	// physics loader, check if physics component is available
-	bool withPhysics = scene->GetPhysics() != NULL;	
-#ifndef CHECKLEAKS
-	btBulletWorldImporter* physicsLoader = withPhysics ? new btBulletWorldImporter(scene->GetPhysics()->GetDynamicsWorld()) :  NULL;
+	std::unordered_map<std::string, int> nameToIDTri;		// map assimp mesh name to our mesh	
+	std::unordered_map<std::string, int> nameToIDQuad;		// map assimp mesh name to our mesh	
 
-	//std::cout << physicsLoader << std::endl;
+	auto& idToMesh = data->idToMesh;
+	auto& meshDataTri = data->meshDataTri;
+	auto& meshDataQuad = data->meshDataQuad;
+	idToMesh.resize(numMeshes);
 
-	std::string physicsFile = ReplaceFileExtension(fileName, ".bullet");
-	withPhysics = withPhysics && physicsLoader->loadFile(physicsFile.c_str());
-	if(!withPhysics) std::cerr << "cannot find " << physicsFile << std::endl;
-#else
-	withPhysics = false;
-#endif
+	// load geometry data, try to combine submeshes. materials and bones are added by Create
+	for(UINT i = 0; i < numMeshes; ++i)
+	{		
+		const SceneCache::CachedMesh& cachedMesh = cachedMeshes[i];		
+		const std::string name = cache.GetString(cachedMesh.name);
+
+		if(ToUpperCase(std::string(name)).find("PHY") != std::string::npos )
+		{
+			std::cout << "skip physics mesh" << std::endl;			
+			continue;
+		}
 
-	std::cout << "num meshes in scene: " << aiscene->mNumMeshes << std::endl;
-	//PrintAssimpHierarchy(aiscene->mRootNode, aiscene, 0);
+		// only triangle and polygon meshes have data in the cache
+		if(!(cachedMesh.flags & (SceneCache::MESH_TRIANGLES | SceneCache::MESH_QUADS)))					
+			continue;
 
-	//std::map<UINT,const aiNode*> meshIDtoNode;
-	//traverseAssimpNodeHierachy(aiscene->mRootNode,  meshIDtoNode, fileName);
+		bool isQuadMesh = (cachedMesh.flags & SceneCache::MESH_QUADS) != 0;				
+		auto& it = isQuadMesh ? nameToIDQuad.find(name) : nameToIDTri.find(name);		
 
-	UINT numAnimations = aiscene->HasAnimations() ? aiscene->mNumAnimations : 0;
-	fprintf(stderr, "\n----\n#Animations: %d \n----\n", numAnimations);
+		// always create new entry for subd models
+		if(isQuadMesh)
+		{	
+			nameToIDQuad[name] = (int)meshDataQuad.size();
 
-	std::unordered_map<std::string, int>  sceneCamNameToId;
-	if(animGroup == NULL && loadToGroup == NULL && aiscene->HasCameras())
-	{	
-		for(UINT i = 0; i < aiscene->mNumCameras; ++i)
+			idToMesh[i].meshID = (int)meshDataQuad.size();
+			idToMesh[i].submeshID = 0;
+			idToMesh[i].isQuadMesh = true;			
+			MeshData mData;
+			mData.name = name;
+			meshDataQuad.push_back(mData);						
+		}
+		else if(!isQuadMesh && it == nameToIDTri.end())
 		{
-			sceneCamNameToId[aiscene->mCameras[i]->mName.C_Str()] =  i;						
+			nameToIDTri[name] = (int)meshDataTri.size();
+
+			idToMesh[i].meshID = (int)meshDataTri.size();
+			idToMesh[i].submeshID = 0;
+			idToMesh[i].isQuadMesh = false;
+			MeshData mData;
+			mData.name = name;
+			meshDataTri.push_back(mData);
+		}
+		else 
+		{
+			idToMesh[i].meshID = it->second;			
 		}
-	}
 
-	bool parseGeometry = animGroup== NULL || (animGroup != NULL && animGroup->GetAnimationManager()->GetAnimationsRef().size() == 0);
-	if( parseGeometry )
-	{
-		// multimesh - one animation manager, multiple vertex groups
-		//std::cout << "numMeshes " << aiscene->mNumMeshes << std::endl;	
-		//std::cout << " num Lights " << aiscene->mNumLights << std::endl;
 
+		// fill mesh data		
+		int meshID = idToMesh[i].meshID;		
+		auto& mesh = isQuadMesh ? meshDataQuad[meshID] : meshDataTri[meshID];
+
+		int submeshID = (int)mesh.meshes.size();
+		idToMesh[i].submeshID = submeshID;
+		idToMesh[i].baseVertex = mesh.numVertices;
+		idToMesh[i].loaded = true;
+
+
+
+		UINT baseVertexIndex = mesh.numVertices;
+		UINT numV = cachedMesh.numVertices;
+		UINT numF = cachedMesh.numFaces;
+
+		SubMeshData subdata;
+		subdata.baseVertex = baseVertexIndex;
+		subdata.numVertices = numV;		
+		subdata.name = name;		
+		mesh.numVertices += numV;		
 
-		std::unordered_map<std::string, int> nameToIDTri;		// map assimp mesh name to our mesh	
-		std::unordered_map<std::string, int> nameToIDQuad;		// map assimp mesh name to our mesh	
+		// the cached arrays have the layout of the mesh data, one block copy each
+		const XMFLOAT4A* positions = cache.GetSection<XMFLOAT4A>(SceneCache::SECTION_POSITIONS) + cachedMesh.firstVertex;
+		mesh.vertices.resize(baseVertexIndex);
+		mesh.vertices.insert(mesh.vertices.end(), positions, positions + numV);
 
-		struct MultiMesh
+		// TODO check if existing mesh also has normals otherwise vertex,normals buffer dont match indices		
+		if(cachedMesh.flags & SceneCache::MESH_NORMALS)
+		{			
+			assert(submeshID ==0 || (mesh.normals.size() > 0 && submeshID > 0) );
+			const XMFLOAT3A* normals = cache.GetSection<XMFLOAT3A>(SceneCache::SECTION_NORMALS) + cachedMesh.firstVertex;
+			mesh.normals.resize(baseVertexIndex);
+			mesh.normals.insert(mesh.normals.end(), normals, normals + numV);
+		}
+
+		// TODO check if existing mesh also has texcoords otherwise vertex, texcoord buffers dont match indices		
+		if(cachedMesh.flags & SceneCache::MESH_TEXCOORDS)
+		{		
+			assert(submeshID ==0 || (mesh.texcoords.size() > 0 && submeshID > 0));
+			const XMFLOAT2A* texcoords = cache.GetSection<XMFLOAT2A>(SceneCache::SECTION_TEXCOORDS) + cachedMesh.firstVertex;
+			mesh.texcoords.resize(baseVertexIndex);
+			mesh.texcoords.insert(mesh.texcoords.end(), texcoords, texcoords + numV);
+		}
+
+
+		if(isQuadMesh)
+		{			
+			const XMUINT4* quads = cache.GetSection<XMUINT4>(SceneCache::SECTION_QUADS) + cachedMesh.firstFace;
+			subdata.indicesQuad.assign(quads, quads + numF);
+		}
+		else
 		{
-			bool isQuadMesh;
-			int meshID;
-			int submeshID;
-		};
+			const XMUINT3* triangles = cache.GetSection<XMUINT3>(SceneCache::SECTION_TRIANGLES) + cachedMesh.firstFace;
+			subdata.indicesTri.resize(numF);
+			for(UINT i = 0; i < numF; ++i)
+			{
+				const XMUINT3& face = triangles[i];		
+				subdata.indicesTri[i] = XMUINT3(face.x + baseVertexIndex,face.y + baseVertexIndex ,face.z + baseVertexIndex);		
+			}			
+		}
 
+		mesh.meshes.push_back(subdata);
+	}
+	timings.meshMS = GetTimeMS() - start;
+
+	// subd meshes are deformable if their group node says so, the first group which references a mesh decides
+	start = GetTimeMS();
+	std::vector<bool> quadDeformable(meshDataQuad.size(), false);
+	std::vector<bool> quadReferenced(meshDataQuad.size(), false);
+	const SceneCache::CachedNode& rootNode = cachedNodes[0];
+	for(UINT i = 0; i < rootNode.numChildren; ++i)
+	{
+		const SceneCache::CachedNode& node = cachedNodes[rootNode.firstChild + i];
+		if(node.numMeshes == 0) continue;
 
-		std::vector<MultiMesh> idToMesh(aiscene->mNumMeshes);
-		std::vector<MeshData> meshDataTri;		// hold meshdata, create tri or subd meshes from that data later
-		std::vector<MeshData> meshDataQuad;		// hold meshdata, create tri or subd meshes from that data later
+		const std::string name = ToUpperCase(std::string(cache.GetString(node.name)));
+		if(name.find("PHY") != std::string::npos) continue;
 
-		for(UINT i = 0; i < aiscene->mNumAnimations; ++i)
+		std::vector<UINT> meshIDs;
+		GetMeshesInSubtree(cache, rootNode.firstChild + i, meshIDs);
+		for(auto meshID : meshIDs)
 		{
-			std::cout << "animation: " <<  aiscene->mAnimations[i]->mChannels[0]->mNodeName.C_Str() << std::endl;
+			const auto& model = idToMesh[meshID];
+			if(!model.loaded || !model.isQuadMesh || quadReferenced[model.meshID]) continue;
+
+			quadReferenced[model.meshID] = true;
+			quadDeformable[model.meshID] = name.find("DEFORMABLE") != std::string::npos;
 		}
+	}
 
+	// welding, half edges and far tables of the referenced subd meshes
+	data->osdMeshes.resize(meshDataQuad.size());
+	for(size_t i = 0; i < meshDataQuad.size(); ++i)
+	{
+		if(!quadReferenced[i] || meshDataQuad[i].meshes.size() != 1) continue;
+		if(FAILED(PrepareOSDModel(&meshDataQuad[i], quadDeformable[i], data->osdMeshes[i])))
+			std::cerr << "could not prepare subd mesh " << meshDataQuad[i].name << std::endl;
+	}
+	timings.topologyMS = GetTimeMS() - start;
 
+	return hr;
+}
 
+void ModelLoader::Release(ModelLoadData*& data)
+{
+	SAFE_DELETE(data);
+}
 
+const ModelLoadTimings& ModelLoader::GetTimings(const ModelLoadData* data)
+{
+	return data->timings;
+}
 
-		// load geometry data, try to combine submeshes
-		for(UINT i = 0; i < aiscene->mNumMeshes; ++i)
-		{		
-			const aiMesh* aimesh = aiscene->mMeshes[i];		
-			const std::string name = aimesh->mName.C_Str();
+// load non animated meshes
+HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* animGroup, ModelGroup* loadToGroup)
+{	
+	HRESULT hr = S_OK;
 
-			if(ToUpperCase(std::string(name)).find("PHY") != std::string::npos )
-			{
-				std::cout << "skip physics mesh" << std::endl;			
-				continue;
-			}
+	ModelLoadData* data = NULL;
+	if(FAILED(Prepare(fileName, data)))
+	{
+		MessageBoxA(0, ("could not import " + fileName).c_str(), "ERROR", MB_OK);	
+		return S_FALSE;
+	}
 
-			UINT primitiveType = aimesh->mPrimitiveTypes;
-			if(primitiveType != aiPrimitiveType_TRIANGLE && primitiveType != aiPrimitiveType_POLYGON)					
-				continue;
+	hr = Create(data, scene, animGroup, loadToGroup);
+	Release(data);
 
-			bool isQuadMesh = aimesh->mPrimitiveTypes == aiPrimitiveType_POLYGON;				
-			auto& it = isQuadMesh ? nameToIDQuad.find(name) : nameToIDTri.find(name);		
+	return hr;
+}
 
-			// always create new entry for subd models
-			if(isQuadMesh)
-			{	
-				nameToIDQuad[aimesh->mName.C_Str()] = (int)meshDataQuad.size();
+HRESULT ModelLoader::Create(ModelLoadData* loadData, Scene* scene, AnimationGroup* animGroup, ModelGroup* loadToGroup)
+{	
+	HRESULT hr = S_OK;
 
-				idToMesh[i].meshID = (int)meshDataQuad.size();
-				idToMesh[i].submeshID = 0;
-				idToMesh[i].isQuadMesh = true;			
-				MeshData mData;
-				mData.name = name;
-				meshDataQuad.push_back(mData);						
-			}
-			else if(!isQuadMesh && it == nameToIDTri.end())
-			{
-				nameToIDTri[aimesh->mName.C_Str()] = (int)meshDataTri.size();
-
-				idToMesh[i].meshID = (int)meshDataTri.size();
-				idToMesh[i].submeshID = 0;
-				idToMesh[i].isQuadMesh = false;
-				MeshData mData;
-				mData.name = name;
-				meshDataTri.push_back(mData);
-			}
-			else 
-			{
-				idToMesh[i].meshID = it->second;			
-			}
+	const double createStart = GetTimeMS();
+	const std::string& fileName = loadData->fileName;
+	const SceneCache& cache = loadData->cache;
 
+	const SceneCache::CachedMesh* cachedMeshes = cache.GetSection<SceneCache::CachedMesh>(SceneCache::SECTION_MESHES);
+	const SceneCache::CachedNode* cachedNodes = cache.GetSection<SceneCache::CachedNode>(SceneCache::SECTION_NODES);
+	const SceneCache::CachedCamera* cachedCameras = cache.GetSection<SceneCache::CachedCamera>(SceneCache::SECTION_CAMERAS);
+	const UINT numMeshes = cache.GetCount(SceneCache::SECTION_MESHES);
+	const UINT numCameras = cache.GetCount(SceneCache::SECTION_CAMERAS);
 
-			// fill mesh data		
-			int meshID = idToMesh[i].meshID;		
-			auto& mesh = isQuadMesh ? meshDataQuad[meshID] : meshDataTri[meshID];
+	gCurrModelPath = ExtractPath(fileName).append("/");	
 
-			int submeshID = (int)mesh.meshes.size();
-			idToMesh[i].submeshID = submeshID;
+	// physics loader, check if physics component is available
+	bool withPhysics = scene->GetPhysics() != NULL;	
+#ifndef CHECKLEAKS
+	btBulletWorldImporter* physicsLoader = withPhysics ? new btBulletWorldImporter(scene->GetPhysics()->GetDynamicsWorld()) :  NULL;
 
+	//std::cout << physicsLoader << std::endl;
 
+	std::string physicsFile = ReplaceFileExtension(fileName, ".bullet");
+	withPhysics = withPhysics && physicsLoader->loadFile(physicsFile.c_str());
+	if(!withPhysics) std::cerr << "cannot find " << physicsFile << std::endl;
+#else
+	withPhysics = false;
+#endif
 
-			UINT baseVertexIndex = mesh.numVertices;
-			UINT numV = aimesh->mNumVertices;
-			UINT numF = aimesh->mNumFaces;
+	std::cout << "num meshes in scene: " << numMeshes << std::endl;
+	//PrintHierarchy(cache, 0, 0);
 
-			SubMeshData subdata;
-			subdata.baseVertex = baseVertexIndex;
-			subdata.numVertices = numV;		
-			subdata.name = name;		
-			mesh.numVertices += aimesh->mNumVertices;		
-			mesh.vertices.resize(mesh.numVertices);
+	//std::map<UINT,UINT> meshIDtoNode;
+	//TraverseNodeHierachy(cache, 0,  meshIDtoNode, fileName);
 
-			for(UINT i = 0; i < numV; ++i)
-			{
-				const aiVector3D& v = aimesh->mVertices[i];
-				mesh.vertices[baseVertexIndex+i] = XMFLOAT4A(v.x, v.y, v.z, 1.f);
-			}
+	UINT numAnimations = cache.GetCount(SceneCache::SECTION_ANIMATIONS);
+	fprintf(stderr, "\n----\n#Animations: %d \n----\n", numAnimations);
 
-			// TODO check if existing mesh also has normals otherwise vertex,normals buffer dont match indices		
-			if(aimesh->HasNormals())
-			{			
-				assert(submeshID ==0 || (mesh.normals.size() > 0 && submeshID > 0) );
-				mesh.normals.resize(mesh.numVertices);
-				for(UINT i = 0; i < numV; ++i)
-				{
-					const aiVector3D& n = aimesh->mNormals[i];
-					mesh.normals[baseVertexIndex+i] = XMFLOAT3A(n.x, n.y, n.z);			
-				}	
-			}
+	std::unordered_map<std::string, int>  sceneCamNameToId;
+	if(animGroup == NULL && loadToGroup == NULL && numCameras > 0)
+	{	
+		for(UINT i = 0; i < numCameras; ++i)
+		{
+			sceneCamNameToId[cache.GetString(cachedCameras[i].name)] =  i;						
+		}
+	}
 
-			// TODO check if existing mesh also has texcoords otherwise vertex, texcoord buffers dont match indices		
-			if( aimesh->HasTextureCoords(0) )
-			{		
-				assert(submeshID ==0 || (mesh.texcoords.size() > 0 && submeshID > 0));
-				mesh.texcoords.resize(mesh.numVertices);			
-				for(UINT i = 0; i < numV; ++i)
-				{
-					const aiVector3D& uv = aimesh->mTextureCoords[0][i];
-					mesh.texcoords[baseVertexIndex+i] = XMFLOAT2A(uv.x, uv.y);
-				}
-			}
+	bool parseGeometry = animGroup== NULL || (animGroup != NULL && animGroup->GetAnimationManager()->GetAnimationsRef().size() == 0);
+	if( parseGeometry )
+	{
+		auto& idToMesh = loadData->idToMesh;
+		auto& meshDataTri = loadData->meshDataTri;
+		auto& meshDataQuad = loadData->meshDataQuad;
 
+		const SceneCache::CachedAnimation* cachedAnimations = cache.GetSection<SceneCache::CachedAnimation>(SceneCache::SECTION_ANIMATIONS);
+		for(UINT i = 0; i < numAnimations; ++i)
+		{
+			if(cachedAnimations[i].numChannels > 0)
+				std::cout << "animation: " <<  cache.GetString(cache.GetSection<SceneCache::CachedChannel>(SceneCache::SECTION_CHANNELS)[cachedAnimations[i].firstChannel].nodeName) << std::endl;
+		}
 
-			if(isQuadMesh)
-			{			
-				subdata.indicesQuad.resize(numF);
-				for(UINT i = 0; i < numF; ++i)
-				{
-					const aiFace& face = aimesh->mFaces[i];		
-					subdata.indicesQuad[i] = XMUINT4(face.mIndices[0],face.mIndices[1] ,face.mIndices[2],face.mIndices[3]);		
-				}
+		// bones and materials of the prepared meshes, they go to the animation manager and the material cache of the scene
+		for(UINT i = 0; i < numMeshes; ++i)
+		{
+			const auto& model = idToMesh[i];
+			if(!model.loaded) continue;
 
-			}
-			else
-			{
-				subdata.indicesTri.resize(numF);
-				for(UINT i = 0; i < numF; ++i)
-				{
-					const aiFace& face = aimesh->mFaces[i];		
-					subdata.indicesTri[i] = XMUINT3(face.mIndices[0] + baseVertexIndex,face.mIndices[1] + baseVertexIndex ,face.mIndices[2] + baseVertexIndex);		
-				}			
-			}
+			const SceneCache::CachedMesh& cachedMesh = cachedMeshes[i];
+			auto& mesh = model.isQuadMesh ? meshDataQuad[model.meshID] : meshDataTri[model.meshID];
+			UINT baseVertexIndex = model.baseVertex;
 
 			// skinning
-			if(animGroup != NULL && aimesh->HasBones())
+			if(animGroup != NULL && cachedMesh.numBones > 0)
 			{
 				mesh.withSkinning = true;
 				//if(mesh.skinning == NULL)	mesh.skinning = new SkinningMeshAnimationManager();
 				auto* skinningMgr = animGroup->GetAnimationManager();
 				auto& boneData = skinningMgr->GetBoneDataRef();
 
-				boneData.resize(mesh.numVertices);
-				UINT numBones = aimesh->mNumBones;
+				boneData.resize(baseVertexIndex + cachedMesh.numVertices);
+				const SceneCache::CachedBone* bones = cache.GetSection<SceneCache::CachedBone>(SceneCache::SECTION_BONES) + cachedMesh.firstBone;
+				const SceneCache::CachedBoneWeight* weights = cache.GetSection<SceneCache::CachedBoneWeight>(SceneCache::SECTION_BONE_WEIGHTS);
+				UINT numBones = cachedMesh.numBones;
 				UINT boneID = 0;
 				for(UINT j = 0; j < numBones; ++j)
 				{
-					const aiBone* bone = aimesh->mBones[j];
-					const std::string boneName = bone->mName.C_Str();
+					const SceneCache::CachedBone& bone = bones[j];
+					const std::string boneName = cache.GetString(bone.name);
 
 					std::cout << "processing bone \" " << boneName << "\" "<< std::endl;				
-					boneID = skinningMgr->addBone(boneName, XMMATRIX(bone->mOffsetMatrix[0]));
-					for(UINT w = 0; w < bone->mNumWeights; ++w)
+					boneID = skinningMgr->addBone(boneName, XMLoadFloat4x4(&bone.offsetMatrix));
+					for(UINT w = bone.firstWeight; w < bone.firstWeight + bone.numWeights; ++w)
 					{
-						UINT vertexID = bone->mWeights[w].mVertexId + baseVertexIndex;
-						boneData[vertexID].setBoneData(boneID, bone->mWeights[w].mWeight);
+						UINT vertexID = weights[w].vertexId + baseVertexIndex;
+						boneData[vertexID].setBoneData(boneID, weights[w].weight);
 					}
 				}
 			}
 
 			// material
 			DXMaterial* mat = NULL;
-			CreateMaterial(aiscene->mMaterials[aimesh->mMaterialIndex], scene, mat);
-			subdata.material = mat;
-
-			mesh.meshes.push_back(subdata);
+			CreateMaterial(cache, cachedMesh.materialIndex, scene, mat);
+			mesh.meshes[model.submeshID].material = mat;
 		}
 
 
@@ -1055,34 +1062,37 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 				std::cerr << "subd models should never be compound meshes" << std::endl;
 		}
 
-		// now all models are created, next we traverse assimp hierarchy to find model instances and add the models to the scene
-		std::vector<std::vector<const aiNode*>> meshToSubmesh(aiscene->mNumMeshes);
+		// now all models are created, next we traverse the node hierarchy to find model instances and add the models to the scene
+		std::vector<std::vector<UINT>> meshToSubmesh(numMeshes);
 
 		UINT countGroups = 0;
 		std::vector<ModelInstance*>& globalIDToMesh = scene->GetGlobalIDToInstanceMap();
-		for(UINT i = 0; i < aiscene->mRootNode->mNumChildren; ++i)
+		const SceneCache::CachedNode& rootNode = cachedNodes[0];
+		for(UINT i = 0; i < rootNode.numChildren; ++i)
 		{
-			const aiNode*  node = aiscene->mRootNode->mChildren[i];
+			const UINT nodeIndex = rootNode.firstChild + i;
+			const SceneCache::CachedNode& node = cachedNodes[nodeIndex];
 
 			// parse scene cam positions
-			if(animGroup == NULL && loadToGroup == NULL && aiscene->HasCameras())
+			if(animGroup == NULL && loadToGroup == NULL && numCameras > 0)
 			{			
-				auto it = sceneCamNameToId.find(node->mName.C_Str());
+				auto it = sceneCamNameToId.find(cache.GetString(node.name));
 				if(it != sceneCamNameToId.end())
 				{
-					const aiCamera* cam = aiscene->mCameras[it->second];
-					aiVector3D camPos = node->mTransformation * cam->mPosition;
+					const SceneCache::CachedCamera& cam = cachedCameras[it->second];
+					XMFLOAT3 camPos;
+					XMStoreFloat3(&camPos, XMVector3Transform(XMLoadFloat3(&cam.position), XMMatrixTranspose(XMLoadFloat4x4(&node.transformation))));
 
-					scene->AddStadiumCamPosition(XMFLOAT3(camPos.x, camPos.y, camPos.z));			
+					scene->AddStadiumCamPosition(camPos);			
 				}
 			}
 
-			if(node->mNumMeshes == 0) continue;
-			std::cout << "num meshes: " << node->mNumMeshes << std::endl;
+			if(node.numMeshes == 0) continue;
+			std::cout << "num meshes: " << node.numMeshes << std::endl;
 
 
 
-			const char*	   name = node->mName.C_Str();
+			const char*	   name = cache.GetString(node.name);
 			//std::cout << "name: " << name << std::endl;
 			if(ToUpperCase(std::string(name)).find("PHY") != std::string::npos )
 			{
@@ -1108,7 +1118,7 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 			group->SetHasDeformables(hasDeformables);	
 			countGroups +=1;
 			std::vector<UINT> meshIDs;
-			GetMeshesInSubtree(node, meshIDs, aiscene);
+			GetMeshesInSubtree(cache, nodeIndex, meshIDs);
 			//std::cout << "num meshIDs for group: " << name << ": " << meshIDs.size() << std::endl;
 
 			std::set<int> uniqueTri;		
@@ -1125,7 +1135,7 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 					assert(data.meshes.size() == 1);
 
 					DXOSDMesh* subdModel = new DXOSDMesh();
-					V_RETURN(CreateOSDModel(&data, subdModel, hasDeformables));
+					V_RETURN(CreateOSDModel(&data, loadData->osdMeshes[model.meshID], subdModel, hasDeformables));
 					subdModel->SetMaterial(data.meshes[0].material);
 					group->osdModels.push_back(subdModel);	
 
@@ -1187,7 +1197,7 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 					assert(data.meshes.size() == 1);
 
 					DXOSDMesh* subdModel = new DXOSDMesh();
-					V_RETURN(CreateOSDModel(&data, subdModel, hasDeformables));
+					V_RETURN(CreateOSDModel(&data, loadData->osdMeshes[model.meshID], subdModel, hasDeformables));
 					subdModel->SetMaterial(data.meshes[0].material);
 					group->osdModels.push_back(subdModel);	
 					
@@ -1312,7 +1322,7 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 
 
 
-			XMMATRIX  modelMatrix = XMMatrixTranspose(DirectX::XMMATRIX(node->mTransformation[0]));	
+			XMMATRIX  modelMatrix = XMMatrixTranspose(XMLoadFloat4x4(&node.transformation));	
 			//XMMATRIX flipX = XMMATRIX(  1,0,0,0,
 			//	0,1,0,0,
 			//	0,0,1,0,
@@ -1381,14 +1391,18 @@ HRESULT ModelLoader::Load( std::string fileName, Scene* scene, AnimationGroup* a
 		}
 	}
 
-	ParseAnimation(aiscene, animGroup);
+	ParseAnimation(cache, animGroup);
 
 
 #ifndef CHECKLEAKS
 	delete physicsLoader; 
 #endif
 
-	aiReleaseImport(aiscene);
+	// the importer adds the bodies before their user pointers are set, pairs with them may be classified without a group
+	if(withPhysics)
+		scene->GetPhysics()->GetDeformablePairCache()->Invalidate();
+
+	loadData->timings.createMS = GetTimeMS() - createStart;
 
 	return hr;
 }
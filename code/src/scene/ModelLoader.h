@@ -56,8 +56,32 @@ struct MeshData
 	std::string name;
 };
 
+// per file timings of a load, all in ms
+struct ModelLoadTimings
+{
+	ModelLoadTimings() : queuedMS(0), parseMS(0), meshMS(0), topologyMS(0), createMS(0), totalMS(0) {}
+
+	double queuedMS;	// waiting for a loader thread
+	double parseMS;		// scene cache or assimp import
+	double meshMS;		// mesh data from the packed scene
+	double topologyMS;	// welding, half edges and far tables of the subd meshes
+	double createMS;	// materials, gpu resources, physics and scene insertion on the render thread
+	double totalMS;		// until the models are in the scene
+};
+
+// cpu data of one file between Prepare and Create
+struct ModelLoadData;
+
 class ModelLoader
 {
 public:
 	static HRESULT Load(std::string fileName, Scene* scene, AnimationGroup* animGroup = NULL, ModelGroup* loadToGroup = NULL);
+
+	// Load in two steps. Prepare parses the file and builds the subd tables without touching the device or the scene,
+	// it may run on any thread. Create makes the gpu resources and inserts the models, on the render thread
+	static HRESULT Prepare(const std::string& fileName, ModelLoadData*& data);
+	static HRESULT Create(ModelLoadData* data, Scene* scene, AnimationGroup* animGroup = NULL, ModelGroup* loadToGroup = NULL);
+	static void	   Release(ModelLoadData*& data);
+
+	static const ModelLoadTimings& GetTimings(const ModelLoadData* data);
 };
\ No newline at end of file
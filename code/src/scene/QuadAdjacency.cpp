@@ -0,0 +1,279 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "scene/QuadAdjacency.h"
+#include "utils/WorkStealingPool.h"
+
+#include <atomic>
+
+using namespace DirectX;
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const UINT QUAD_ADJACENCY_GRAIN_SIZE = 4096;
+
+namespace
+{
+
+const UINT64 NO_TOPOLOGY_ERROR = ~0ull;
+
+enum TopologyError
+{
+	TOPOLOGY_OK = 0,
+	TOPOLOGY_INVALID_INDEX,
+	TOPOLOGY_DEGENERATE_FACE,
+	TOPOLOGY_NON_MANIFOLD_EDGE,
+	TOPOLOGY_NON_MANIFOLD_VERTEX
+};
+
+const char* GetTopologyErrorString(UINT error)
+{
+	switch (error)
+	{
+	case TOPOLOGY_INVALID_INDEX:		return "vertex index out of range";
+	case TOPOLOGY_DEGENERATE_FACE:		return "degenerate face";
+	case TOPOLOGY_NON_MANIFOLD_EDGE:	return "edge with more than two faces or inconsistent winding";
+	case TOPOLOGY_NON_MANIFOLD_VERTEX:	return "vertex with more than one fan of faces";
+	default:							return "unknown";
+	}
+}
+
+// keeps the error of the smallest face, independent of the thread schedule
+inline void ReportError(std::atomic<UINT64>& firstError, UINT face, TopologyError error)
+{
+	const UINT64 value = (static_cast<UINT64>(face) << 8) | error;
+	UINT64 current = firstError.load();
+	while (value < current && !firstError.compare_exchange_weak(current, value)) {}
+}
+
+}
+
+HRESULT QuadAdjacency::Create(const std::vector<XMUINT4>& faces, UINT numVertices)
+{
+	const UINT numFaces = static_cast<UINT>(faces.size());
+	const UINT numCorners = 4 * numFaces;
+
+	m_faceVertices.resize(numCorners);
+	if (numFaces > 0)
+		memcpy(&m_faceVertices[0], &faces[0], numCorners * sizeof(UINT));
+
+	std::atomic<UINT64> firstError(NO_TOPOLOGY_ERROR);
+
+	for (UINT f = 0; f < numFaces; ++f)
+	{
+		const UINT* fv = &m_faceVertices[4 * f];
+		if (fv[0] >= numVertices || fv[1] >= numVertices || fv[2] >= numVertices || fv[3] >= numVertices)
+		{
+			ReportError(firstError, f, TOPOLOGY_INVALID_INDEX);
+			break;
+		}
+		if (fv[0] == fv[1] || fv[1] == fv[2] || fv[2] == fv[3] || fv[3] == fv[0] || fv[0] == fv[2] || fv[1] == fv[3])
+		{
+			ReportError(firstError, f, TOPOLOGY_DEGENERATE_FACE);
+			break;
+		}
+	}
+
+	if (firstError.load() == NO_TOPOLOGY_ERROR)
+	{
+		// vertex -> corners, corners of a vertex in face order
+		m_vertexOffsets.assign(numVertices + 1, 0);
+		for (UINT c = 0; c < numCorners; ++c)
+			m_vertexOffsets[m_faceVertices[c] + 1]++;
+		for (UINT v = 0; v < numVertices; ++v)
+			m_vertexOffsets[v + 1] += m_vertexOffsets[v];
+
+		m_vertexCorners.resize(numCorners);
+		m_ringSize.resize(numVertices);
+		for (UINT v = 0; v < numVertices; ++v)
+			m_ringSize[v] = m_vertexOffsets[v];		// fill position, reset by the ring walk
+		for (UINT c = 0; c < numCorners; ++c)
+			m_vertexCorners[m_ringSize[m_faceVertices[c]]++] = c;
+
+		// opposite half edge: the corner of the other end vertex pointing back, a second corner along the same direction
+		// or a third face on the edge is non manifold
+		m_opposite.resize(numCorners);
+		g_workStealingPool.ParallelFor(numCorners, QUAD_ADJACENCY_GRAIN_SIZE, [&](UINT begin, UINT end)
+		{
+			for (UINT c = begin; c < end; ++c)
+			{
+				const UINT v = m_faceVertices[c];
+				const UINT w = m_faceVertices[GetNextCorner(c)];
+
+				int opposite = -1;
+				UINT numOpposite = 0, numSame = 0;
+				for (UINT i = m_vertexOffsets[w]; i < m_vertexOffsets[w + 1]; ++i)
+				{
+					const UINT d = m_vertexCorners[i];
+					if (m_faceVertices[GetNextCorner(d)] == v)
+					{
+						opposite = static_cast<int>(d);
+						numOpposite++;
+					}
+				}
+				for (UINT i = m_vertexOffsets[v]; i < m_vertexOffsets[v + 1]; ++i)
+				{
+					const UINT d = m_vertexCorners[i];
+					numSame += m_faceVertices[GetNextCorner(d)] == w ? 1 : 0;
+				}
+
+				if (numOpposite > 1 || numSame > 1)
+					ReportError(firstError, c / 4, TOPOLOGY_NON_MANIFOLD_EDGE);
+				m_opposite[c] = opposite;
+			}
+		});
+	}
+
+	if (firstError.load() == NO_TOPOLOGY_ERROR)
+	{
+		// ring walk per vertex, starts after the boundary edge so that one walk visits all faces of a manifold vertex
+		m_ringStart.resize(numVertices);
+		m_extraordinary.resize(numVertices);
+		g_workStealingPool.ParallelFor(numVertices, QUAD_ADJACENCY_GRAIN_SIZE, [&](UINT begin, UINT end)
+		{
+			for (UINT v = begin; v < end; ++v)
+			{
+				const UINT numCornersV = m_vertexOffsets[v + 1] - m_vertexOffsets[v];
+				m_ringSize[v] = numCornersV;
+				m_extraordinary[v] = 0;
+				if (numCornersV == 0)
+				{
+					m_ringStart[v] = -1;
+					continue;
+				}
+
+				UINT start = m_vertexCorners[m_vertexOffsets[v]];
+				UINT numBoundary = 0;
+				for (UINT i = m_vertexOffsets[v]; i < m_vertexOffsets[v + 1]; ++i)
+				{
+					const UINT c = m_vertexCorners[i];
+					if (m_opposite[GetPrevCorner(c)] < 0)
+					{
+						start = c;
+						numBoundary++;
+					}
+				}
+
+				UINT numVisited = 0;
+				UINT c = start;
+				do
+				{
+					numVisited++;
+					const int opposite = m_opposite[c];
+					if (opposite < 0) break;
+					c = GetNextCorner(static_cast<UINT>(opposite));
+				} while (c != start && numVisited <= numCornersV);
+
+				if (numBoundary > 1 || numVisited != numCornersV)
+				{
+					ReportError(firstError, start / 4, TOPOLOGY_NON_MANIFOLD_VERTEX);
+					continue;
+				}
+
+				// hbr valence counts edges, boundary vertices have one more edge than faces
+				const UINT valence = numBoundary > 0 ? numCornersV + 1 : numCornersV;
+				m_ringStart[v] = static_cast<int>(start);
+				m_extraordinary[v] = valence != 4 ? 1 : 0;
+			}
+		});
+	}
+
+	const UINT64 error = firstError.load();
+	if (error != NO_TOPOLOGY_ERROR)
+	{
+		const UINT face = static_cast<UINT>(error >> 8);
+		const XMUINT4& fv = faces[face];
+		std::cerr << "quad adjacency: " << GetTopologyErrorString(static_cast<UINT>(error & 0xFF)) << " at face " << face 
+				  << " (" << fv.x << ", " << fv.y << ", " << fv.z << ", " << fv.w << ")" << std::endl;
+		return E_FAIL;
+	}
+
+	m_extraordinaryVertices.clear();
+	for (UINT v = 0; v < numVertices; ++v)
+		if (m_extraordinary[v])
+			m_extraordinaryVertices.push_back(v);
+
+	return S_OK;
+}
+
+void QuadAdjacency::GetPtexNeighborData(std::vector<SPtexNeighborData>& ptexNeighborData) const
+{
+	// ptex index = face index, edge k is the hbr face edge (4 - k) % 4 (the loader walks the edges with GetPrev)
+	ptexNeighborData.resize(GetNumFaces());
+	g_workStealingPool.ParallelFor(GetNumFaces(), QUAD_ADJACENCY_GRAIN_SIZE, [&](UINT begin, UINT end)
+	{
+		for (UINT f = begin; f < end; ++f)
+		{
+			SPtexNeighborData& neighbors = ptexNeighborData[f];
+			for (UINT k = 0; k < 4; ++k)
+			{
+				const int opposite = m_opposite[4 * f + ((4 - k) & 3)];
+				if (opposite < 0)
+				{
+					neighbors.ptexIDNeighbor[k] = -1;
+					neighbors.neighEdgeID[k] = -1;
+					continue;
+				}
+
+				// first edge of the neighbor in the same order which is shared with this face
+				const UINT g = static_cast<UINT>(opposite) / 4;
+				int neighEdge = 0;
+				for (; neighEdge < 4; ++neighEdge)
+				{
+					const int back = m_opposite[4 * g + ((4 - neighEdge) & 3)];
+					if (back >= 0 && static_cast<UINT>(back) / 4 == f)
+						break;
+				}
+				neighbors.ptexIDNeighbor[k] = static_cast<int32_t>(g);
+				neighbors.neighEdgeID[k] = neighEdge;
+			}
+		}
+	});
+}
+
+void QuadAdjacency::GetExtraordinaryInfo(std::vector<SExtraordinaryInfo>& info, std::vector<SExtraordinaryData>& data) const
+{
+	const UINT numExtraordinary = GetNumExtraordinary();
+
+	info.resize(numExtraordinary);
+	UINT numData = 0;
+	for (UINT i = 0; i < numExtraordinary; ++i)
+	{
+		info[i].startIndex = numData;
+		info[i].valence = m_ringSize[m_extraordinaryVertices[i]];
+		numData += info[i].valence;
+	}
+
+	data.resize(numData);
+	g_workStealingPool.ParallelFor(numExtraordinary, QUAD_ADJACENCY_GRAIN_SIZE / 16, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			const SExtraordinaryInfo& vertexInfo = info[i];
+			UINT c = static_cast<UINT>(m_ringStart[m_extraordinaryVertices[i]]);
+			for (UINT j = 0; j < vertexInfo.valence; ++j)
+			{
+				data[vertexInfo.startIndex + j].ptexFaceID = c / 4;
+				data[vertexInfo.startIndex + j].vertexInFace = c & 3;
+				const int opposite = m_opposite[c];
+				if (opposite < 0) break;
+				c = GetNextCorner(static_cast<UINT>(opposite));
+			}
+		}
+	});
+}
@@ -0,0 +1,58 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include <App.h>
+
+// flat half edge representation of a quad cage. corner c = 4 * face + i is the half edge from vertex i to vertex i + 1 of the face,
+// the opposite corner is the same edge in the neighboring face. vertex rings are walked over the opposite corners (ccw),
+// the tile overlap data of DXOSDMesh (ptex neighbors, extraordinary vertices) is extracted in parallel on the work stealing pool.
+class QuadAdjacency
+{
+public:
+	// fails for out of range indices, degenerate faces, edges with more than two faces, inconsistent winding and
+	// vertices with more than one fan of faces (the cases hbr splits or rejects), the first offending face is logged
+	HRESULT Create(const std::vector<DirectX::XMUINT4>& faces, UINT numVertices);
+
+	// neighbor ptex face and edge per edge, edges in the order of the hbr loader (0, 3, 2, 1), -1 on the boundary
+	void	GetPtexNeighborData(std::vector<SPtexNeighborData>& ptexNeighborData) const;
+
+	// incident faces of extraordinary vertices (valence != 4, boundary edges count as incident) in ring order.
+	// boundary vertices store their faces from one boundary edge to the other, valence is the number of faces
+	void	GetExtraordinaryInfo(std::vector<SExtraordinaryInfo>& info, std::vector<SExtraordinaryData>& data) const;
+
+	UINT	GetNumFaces()			const { return static_cast<UINT>(m_faceVertices.size() / 4); }
+	UINT	GetNumVertices()		const { return static_cast<UINT>(m_ringSize.size()); }
+	UINT	GetNumExtraordinary()	const { return static_cast<UINT>(m_extraordinaryVertices.size()); }
+	int		GetOpposite(UINT corner) const { return m_opposite[corner]; }
+
+protected:
+	static UINT GetNextCorner(UINT corner) { return (corner & ~3u) | ((corner + 1) & 3u); }
+	static UINT GetPrevCorner(UINT corner) { return (corner & ~3u) | ((corner + 3) & 3u); }
+
+	std::vector<UINT>	m_faceVertices;		// 4 per face
+	std::vector<int>	m_opposite;			// per corner, -1 on the boundary
+	std::vector<UINT>	m_vertexOffsets;	// csr vertex -> corners
+	std::vector<UINT>	m_vertexCorners;
+	std::vector<int>	m_ringStart;		// first corner of the ring walk, the corner after the boundary for boundary vertices, -1 if unreferenced
+	std::vector<UINT>	m_ringSize;			// number of incident faces
+	std::vector<BYTE>	m_extraordinary;
+	std::vector<UINT>	m_extraordinaryVertices;	// in vertex order
+};
@@ -24,6 +24,8 @@
 #include "rendering/RendererTri.h"
 #include "rendering/RendererSubD.h"
 
+#include "utils/WorkStealingPool.h"
+
 #include "utils/DbgNew.h" // has to be last include
 
 
@@ -33,6 +35,7 @@ Scene::Scene()
 {
 	m_sceneAABBMin =  XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
 	m_sceneAABBMax =  XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	m_sceneAABBDirty = true;
 }
 
 Scene::~Scene()
@@ -73,6 +76,7 @@ HRESULT Scene::AddGroup( ModelGroup* model )
 {
 	HRESULT hr = S_OK;
 	_modelGroups.push_back(model);
+	m_sceneAABBDirty = true;
 	return hr;
 }
 
@@ -86,32 +90,62 @@ HRESULT Scene::AddGroup( AnimationGroup* group )
 	//_skinningAnimationManagers.push_back(group->m_skinningMgr);
 	_modelGroups.push_back(group);
 	_animGroups.push_back(group);
+	m_sceneAABBDirty = true;
 
 	return S_OK;
 }
 
+void Scene::UpdateModelMatrices()
+{
+	// groups are independent, each one only writes its own matrix and the obbs of its instances
+	g_workStealingPool.ParallelFor(static_cast<UINT>(_modelGroups.size()), 16, [this](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+			_modelGroups[i]->UpdateModelMatrix();
+	});
+}
+
 const void Scene::UpdateAABB(bool updateEachFrame) 
 {		
-	static bool firstRun = true;
-	if(firstRun || updateEachFrame)
+	if(m_sceneAABBDirty || updateEachFrame)
 	{
-		firstRun = false;
-	
-		XMVECTOR b_min = XMVectorSet(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
-		XMVECTOR b_max = XMVectorSet(-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
-		for(auto m : _modelGroups)
+		m_sceneAABBDirty = false;
+
+		// min/max per range of groups, reduced afterwards
+		const UINT grainSize = 16;
+		const UINT numGroups = static_cast<UINT>(_modelGroups.size());
+		const UINT numRanges = (numGroups + grainSize - 1) / grainSize;
+		std::vector<XMFLOAT3> rangeMin(numRanges, XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX));
+		std::vector<XMFLOAT3> rangeMax(numRanges, XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+
+		g_workStealingPool.ParallelFor(numGroups, grainSize, [&](UINT begin, UINT end)
 		{
-			for( auto instance : m->modelInstances)
+			XMVECTOR b_min = XMVectorSet(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
+			XMVECTOR b_max = XMVectorSet(-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (UINT g = begin; g < end; ++g)
 			{
-				XMFLOAT3 points[8];
-				instance->GetOBBWorld().GetCornerPoints(points);
-				for(int i = 0; i < 8; ++i)
+				for( auto instance : _modelGroups[g]->modelInstances)
 				{
-					XMVECTOR corner = XMLoadFloat3(&points[i]);
-					b_min = XMVectorMin(b_min, corner);
-					b_max = XMVectorMax(b_max, corner);
+					XMFLOAT3 points[8];
+					instance->GetOBBWorld().GetCornerPoints(points);
+					for(int i = 0; i < 8; ++i)
+					{
+						XMVECTOR corner = XMLoadFloat3(&points[i]);
+						b_min = XMVectorMin(b_min, corner);
+						b_max = XMVectorMax(b_max, corner);
+					}
 				}
 			}
+			XMStoreFloat3(&rangeMin[begin / grainSize], b_min);
+			XMStoreFloat3(&rangeMax[begin / grainSize], b_max);
+		});
+
+		XMVECTOR b_min = XMVectorSet(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
+		XMVECTOR b_max = XMVectorSet(-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (UINT r = 0; r < numRanges; ++r)
+		{
+			b_min = XMVectorMin(b_min, XMLoadFloat3(&rangeMin[r]));
+			b_max = XMVectorMax(b_max, XMLoadFloat3(&rangeMax[r]));
 		}
 			
 		XMStoreFloat3(&m_sceneAABBMin, b_min);
@@ -92,6 +92,9 @@ public:
 		return _animGroups;
 	}
 
+	// model matrices and world obbs of all groups, runs on the work stealing pool
+	void UpdateModelMatrices();
+
 	const void UpdateAABB(bool updateEachFrame);
 	const DirectX::XMFLOAT3& GetSceneAABBMin() const { return m_sceneAABBMin;}
 	const DirectX::XMFLOAT3& GetSceneAABBMax() const { return m_sceneAABBMax;}
@@ -112,6 +115,7 @@ private:
 
 	DirectX::XMFLOAT3 m_sceneAABBMin;
 	DirectX::XMFLOAT3 m_sceneAABBMax;
+	bool			  m_sceneAABBDirty;	// groups were added since the last UpdateAABB
 
 	std::vector<DirectX::XMFLOAT3> m_stadiumCamPositions;
 };
\ No newline at end of file
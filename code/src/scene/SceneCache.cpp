@@ -0,0 +1,676 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#define ASSIMP_DLL
+
+#include "stdafx.h"
+
+#include <assimp/cimport.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+
+#include "scene/SceneCache.h"
+#include <App.h>
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <mutex>
+
+using namespace DirectX;
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const char	SCENE_CACHE_MAGIC[8]	= { 'S', 'C', 'E', 'N', 'E', 'P', 'A', 'K' };
+static const UINT64	SCENE_CACHE_ALIGNMENT	= 16;
+
+static const UINT g_sectionElementSize[SceneCache::NUM_SECTIONS] =
+{
+	sizeof(char),
+	sizeof(SceneCache::CachedMesh),
+	sizeof(XMFLOAT4A),
+	sizeof(XMFLOAT3A),
+	sizeof(XMFLOAT2A),
+	sizeof(XMUINT3),
+	sizeof(XMUINT4),
+	sizeof(SceneCache::CachedBone),
+	sizeof(SceneCache::CachedBoneWeight),
+	sizeof(SceneCache::CachedMaterial),
+	sizeof(SceneCache::CachedNode),
+	sizeof(UINT),
+	sizeof(SceneCache::CachedCamera),
+	sizeof(SceneCache::CachedAnimation),
+	sizeof(SceneCache::CachedChannel),
+	sizeof(SceneCache::CachedRotationKey),
+	sizeof(SceneCache::CachedVectorKey)
+};
+
+// FNV-1a
+static void HashBytes(UINT64& hash, const void* data, size_t size)
+{
+	const BYTE* bytes = static_cast<const BYTE*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+// FNV-1a on 8 byte words, for whole source files
+static void HashWords(UINT64& hash, const BYTE* data, size_t size)
+{
+	const size_t numWords = size / sizeof(UINT64);
+	for (size_t i = 0; i < numWords; ++i)
+	{
+		UINT64 word;
+		memcpy(&word, data + i * sizeof(UINT64), sizeof(UINT64));
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	HashBytes(hash, data + numWords * sizeof(UINT64), size - numWords * sizeof(UINT64));
+}
+
+static inline bool InRange(UINT first, UINT count, UINT total)
+{
+	return static_cast<UINT64>(first) + count <= total;
+}
+
+SceneCache::SceneCache()
+{
+	m_file		= INVALID_HANDLE_VALUE;
+	m_mapping	= NULL;
+	m_view		= NULL;
+	m_size		= 0;
+	m_header	= NULL;
+	m_sections	= NULL;
+	m_cacheHit	= false;
+}
+
+SceneCache::~SceneCache()
+{
+	Close();
+}
+
+HRESULT SceneCache::ComputeKey(const std::string& sourceFile, UINT64& key)
+{
+	HANDLE file = CreateFileA(sourceFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = NULL;
+	const BYTE* view = NULL;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		view = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (view)
+	{
+		const UINT64 settings[2] = { VERSION, static_cast<UINT64>(fileSize.QuadPart) };
+		key = 14695981039346656037ull;
+		HashBytes(key, settings, sizeof(settings));
+		HashWords(key, view, static_cast<size_t>(fileSize.QuadPart));
+		UnmapViewOfFile(view);
+	}
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+
+	return view ? S_OK : E_FAIL;
+}
+
+std::string SceneCache::GetFileName(const std::string& sourceFile)
+{
+	UINT64 hash = 14695981039346656037ull;
+	HashBytes(hash, sourceFile.c_str(), sourceFile.size());
+
+	std::stringstream ss;
+	ss << g_app.g_sceneCacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".scene";
+	return ss.str();
+}
+
+HRESULT SceneCache::Load(const std::string& sourceFile)
+{
+	Close();
+
+	UINT64 key = 0;
+	const bool useCache = g_app.g_useSceneCache && SUCCEEDED(ComputeKey(sourceFile, key));
+	const std::string fileName = GetFileName(sourceFile);
+	if (useCache && SUCCEEDED(Open(fileName, key)))
+	{
+		m_cacheHit = true;
+		return S_OK;
+	}
+
+	const unsigned int ppFlags = 0			// import post-processing flags
+		//| aiProcess_Triangulate
+		//| aiProcess_GenSmoothNormals 
+		| aiProcess_ValidateDataStructure 
+		| aiProcess_FindInstances 
+		| aiProcess_JoinIdenticalVertices
+		//| aiProcess_Debone // BE CAREFUL WITH THIS.
+		//| aiProcess_SortByPType
+		//| aiProcess_PreTransformVertices
+		//| aiProcess_ConvertToLeftHanded				// for directx 
+		//| aiProcess_MakeLeftHanded
+		//| aiProcess_FlipUVs
+		//| aiProcess_FlipWindingOrder
+		//| aiProcess_GenUVCoords               // convert spherical, cylindrical, box and planar mapping to proper UVs
+		//| aiProcess_TransformUVCoords         // preprocess UV transformations (scaling, translation ...)
+		| aiProcess_LimitBoneWeights
+		;
+
+	// the c api keeps the last error and the logger in globals, one import at a time for the loader threads
+	static std::mutex importLock;
+	std::vector<BYTE> image;
+	{
+		std::lock_guard<std::mutex> lock(importLock);
+
+		aiPropertyStore* props = aiCreatePropertyStore();
+		aiSetImportPropertyInteger(props, AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT); // we dont want to load lines and points
+		const aiScene* aiscene = aiImportFileExWithProperties(sourceFile.c_str(), ppFlags, NULL, props);
+		aiReleasePropertyStore(props);
+
+		if (!aiscene)
+		{
+			std::cerr << "could not import " << sourceFile << ": " << aiGetErrorString() << std::endl;
+			return E_FAIL;
+		}
+
+		Pack(aiscene, key, image);
+		aiReleaseImport(aiscene);
+	}
+
+	if (useCache)
+	{
+		CreateDirectoryA(g_app.g_sceneCacheDir.c_str(), NULL);
+		if (SUCCEEDED(Save(fileName, image)) && SUCCEEDED(Open(fileName, key)))
+			return S_OK;
+		std::cerr << "could not write scene cache " << fileName << std::endl;
+	}
+
+	// read the packed scene from memory
+	m_image.swap(image);
+	return OpenView(&m_image[0], m_image.size(), key);
+}
+
+HRESULT SceneCache::Open(const std::string& fileName, UINT64 key)
+{
+	Close();
+
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader) + NUM_SECTIONS * sizeof(SectionEntry)))
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const BYTE* view = m_mapping ? static_cast<const BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+	if (!view)
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	if (FAILED(OpenView(view, static_cast<UINT64>(fileSize.QuadPart), key)))
+	{
+		UnmapViewOfFile(view);
+		Close();
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+HRESULT SceneCache::OpenView(const BYTE* view, UINT64 size, UINT64 key)
+{
+	if (size < sizeof(FileHeader) + NUM_SECTIONS * sizeof(SectionEntry))
+		return E_FAIL;
+
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(view);
+	const SectionEntry* sections = reinterpret_cast<const SectionEntry*>(view + sizeof(FileHeader));
+
+	if (memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0 || 
+		header->version != VERSION || header->numSections != NUM_SECTIONS || header->key != key)
+		return E_FAIL;
+
+	for (UINT i = 0; i < NUM_SECTIONS; ++i)
+	{
+		const SectionEntry& section = sections[i];
+		if (section.elementSize != g_sectionElementSize[i] || 
+			section.offset % SCENE_CACHE_ALIGNMENT != 0 ||
+			section.offset + static_cast<UINT64>(section.count) * section.elementSize > size)
+			return E_FAIL;
+	}
+
+	m_view		= view;
+	m_size		= size;
+	m_header	= header;
+	m_sections	= sections;
+
+	if (!Validate())
+	{
+		std::cerr << "scene cache is corrupt" << std::endl;
+		m_view		= NULL;
+		m_size		= 0;
+		m_header	= NULL;
+		m_sections	= NULL;
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+// all references between the sections are in range, so the loader can index without checks
+bool SceneCache::Validate() const
+{
+	const UINT numStrings = GetCount(SECTION_STRINGS);
+	if (numStrings > 0 && GetSection<char>(SECTION_STRINGS)[numStrings - 1] != 0)
+		return false;
+	auto validString = [numStrings](UINT offset) { return offset == NO_STRING || offset < numStrings; };
+
+	const UINT numVertices = GetCount(SECTION_POSITIONS);
+	if ((GetCount(SECTION_NORMALS) != numVertices) || (GetCount(SECTION_TEXCOORDS) != numVertices))
+		return false;
+
+	const CachedMesh* meshes = GetSection<CachedMesh>(SECTION_MESHES);
+	const CachedBone* bones = GetSection<CachedBone>(SECTION_BONES);
+	const CachedBoneWeight* weights = GetSection<CachedBoneWeight>(SECTION_BONE_WEIGHTS);
+	const XMUINT3* triangles = GetSection<XMUINT3>(SECTION_TRIANGLES);
+	const XMUINT4* quads = GetSection<XMUINT4>(SECTION_QUADS);
+	for (UINT i = 0; i < GetCount(SECTION_MESHES); ++i)
+	{
+		const CachedMesh& m = meshes[i];
+		if (!validString(m.name) || m.materialIndex >= GetCount(SECTION_MATERIALS) || !InRange(m.firstVertex, m.numVertices, numVertices) ||
+			!InRange(m.firstBone, m.numBones, GetCount(SECTION_BONES)))
+			return false;
+
+		if (m.flags & MESH_TRIANGLES)
+		{
+			if (!InRange(m.firstFace, m.numFaces, GetCount(SECTION_TRIANGLES)))
+				return false;
+			for (UINT f = m.firstFace; f < m.firstFace + m.numFaces; ++f)
+				if (triangles[f].x >= m.numVertices || triangles[f].y >= m.numVertices || triangles[f].z >= m.numVertices)
+					return false;
+		}
+		else if (m.flags & MESH_QUADS)
+		{
+			if (!InRange(m.firstFace, m.numFaces, GetCount(SECTION_QUADS)))
+				return false;
+			for (UINT f = m.firstFace; f < m.firstFace + m.numFaces; ++f)
+				if (quads[f].x >= m.numVertices || quads[f].y >= m.numVertices || quads[f].z >= m.numVertices || quads[f].w >= m.numVertices)
+					return false;
+		}
+		else if (m.numFaces > 0)
+			return false;
+
+		for (UINT b = m.firstBone; b < m.firstBone + m.numBones; ++b)
+		{
+			if (!validString(bones[b].name) || !InRange(bones[b].firstWeight, bones[b].numWeights, GetCount(SECTION_BONE_WEIGHTS)))
+				return false;
+			for (UINT w = bones[b].firstWeight; w < bones[b].firstWeight + bones[b].numWeights; ++w)
+				if (weights[w].vertexId >= m.numVertices)
+					return false;
+		}
+	}
+
+	const CachedMaterial* materials = GetSection<CachedMaterial>(SECTION_MATERIALS);
+	for (UINT i = 0; i < GetCount(SECTION_MATERIALS); ++i)
+	{
+		if (!validString(materials[i].name))
+			return false;
+		for (UINT t = 0; t < NUM_TEXTURES; ++t)
+			if (!validString(materials[i].textures[t]))
+				return false;
+	}
+
+	// children come after their parent, the hierarchy has no cycles
+	const UINT numNodes = GetCount(SECTION_NODES);
+	const CachedNode* nodes = GetSection<CachedNode>(SECTION_NODES);
+	const UINT* nodeMeshes = GetSection<UINT>(SECTION_NODE_MESHES);
+	if (numNodes == 0)
+		return false;
+	for (UINT i = 0; i < numNodes; ++i)
+	{
+		const CachedNode& n = nodes[i];
+		if (!validString(n.name) || !InRange(n.firstChild, n.numChildren, numNodes) || (n.numChildren > 0 && n.firstChild <= i) ||
+			!InRange(n.firstMesh, n.numMeshes, GetCount(SECTION_NODE_MESHES)))
+			return false;
+		for (UINT m = n.firstMesh; m < n.firstMesh + n.numMeshes; ++m)
+			if (nodeMeshes[m] >= GetCount(SECTION_MESHES))
+				return false;
+	}
+
+	const CachedCamera* cameras = GetSection<CachedCamera>(SECTION_CAMERAS);
+	for (UINT i = 0; i < GetCount(SECTION_CAMERAS); ++i)
+		if (!validString(cameras[i].name))
+			return false;
+
+	const CachedAnimation* animations = GetSection<CachedAnimation>(SECTION_ANIMATIONS);
+	for (UINT i = 0; i < GetCount(SECTION_ANIMATIONS); ++i)
+		if (!InRange(animations[i].firstChannel, animations[i].numChannels, GetCount(SECTION_CHANNELS)))
+			return false;
+
+	const CachedChannel* channels = GetSection<CachedChannel>(SECTION_CHANNELS);
+	for (UINT i = 0; i < GetCount(SECTION_CHANNELS); ++i)
+	{
+		const CachedChannel& c = channels[i];
+		if (!validString(c.nodeName) || !InRange(c.firstRotation, c.numRotations, GetCount(SECTION_ROTATION_KEYS)) ||
+			!InRange(c.firstTranslation, c.numTranslations, GetCount(SECTION_VECTOR_KEYS)) || 
+			!InRange(c.firstScaling, c.numScalings, GetCount(SECTION_VECTOR_KEYS)))
+			return false;
+	}
+
+	return true;
+}
+
+void SceneCache::Close()
+{
+	if (m_view && m_mapping)
+		UnmapViewOfFile(m_view);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_file		= INVALID_HANDLE_VALUE;
+	m_mapping	= NULL;
+	m_view		= NULL;
+	m_size		= 0;
+	m_header	= NULL;
+	m_sections	= NULL;
+	m_cacheHit	= false;
+	std::vector<BYTE>().swap(m_image);
+}
+
+template<typename T>
+static void SetSection(SceneCache::SectionEntry& entry, const void*& data, const std::vector<T>& src)
+{
+	entry.count			= static_cast<UINT>(src.size());
+	entry.elementSize	= sizeof(T);
+	data				= src.empty() ? NULL : &src[0];
+}
+
+void SceneCache::Pack(const aiScene* aiscene, UINT64 key, std::vector<BYTE>& image)
+{
+	std::vector<char> strings;
+	auto addString = [&strings](const aiString& str) -> UINT
+	{
+		const UINT offset = static_cast<UINT>(strings.size());
+		strings.insert(strings.end(), str.C_Str(), str.C_Str() + str.length + 1);
+		return offset;
+	};
+
+	// meshes, only triangle and polygon meshes are read by the loader
+	std::vector<CachedMesh> meshes(aiscene->mNumMeshes);
+	std::vector<XMFLOAT4A> positions;
+	std::vector<XMFLOAT3A> normals;
+	std::vector<XMFLOAT2A> texcoords;
+	std::vector<XMUINT3> triangles;
+	std::vector<XMUINT4> quads;
+	std::vector<CachedBone> bones;
+	std::vector<CachedBoneWeight> weights;
+	for (UINT i = 0; i < aiscene->mNumMeshes; ++i)
+	{
+		const aiMesh* aimesh = aiscene->mMeshes[i];
+		CachedMesh& m = meshes[i];
+		memset(&m, 0, sizeof(m));
+		m.name = addString(aimesh->mName);
+		m.primitiveTypes = aimesh->mPrimitiveTypes;
+		m.materialIndex = aimesh->mMaterialIndex;
+		m.firstVertex = static_cast<UINT>(positions.size());
+		m.firstBone = static_cast<UINT>(bones.size());
+
+		const bool isTriMesh = aimesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+		const bool isQuadMesh = aimesh->mPrimitiveTypes == aiPrimitiveType_POLYGON;
+		if (!isTriMesh && !isQuadMesh)
+			continue;
+
+		const UINT numV = aimesh->mNumVertices;
+		m.numVertices = numV;
+		m.flags = (isTriMesh ? MESH_TRIANGLES : MESH_QUADS) | (aimesh->HasNormals() ? MESH_NORMALS : 0) | (aimesh->HasTextureCoords(0) ? MESH_TEXCOORDS : 0);
+
+		positions.resize(m.firstVertex + numV);
+		normals.resize(m.firstVertex + numV, XMFLOAT3A(0.0f, 0.0f, 0.0f));
+		texcoords.resize(m.firstVertex + numV, XMFLOAT2A(0.0f, 0.0f));
+		for (UINT v = 0; v < numV; ++v)
+		{
+			const aiVector3D& p = aimesh->mVertices[v];
+			positions[m.firstVertex + v] = XMFLOAT4A(p.x, p.y, p.z, 1.0f);
+			if (aimesh->HasNormals())
+				normals[m.firstVertex + v] = XMFLOAT3A(aimesh->mNormals[v].x, aimesh->mNormals[v].y, aimesh->mNormals[v].z);
+			if (aimesh->HasTextureCoords(0))
+				texcoords[m.firstVertex + v] = XMFLOAT2A(aimesh->mTextureCoords[0][v].x, aimesh->mTextureCoords[0][v].y);
+		}
+
+		// subd cages are quad only, other polygons repeat their last corner
+		m.firstFace = static_cast<UINT>(isTriMesh ? triangles.size() : quads.size());
+		m.numFaces = aimesh->mNumFaces;
+		for (UINT f = 0; f < aimesh->mNumFaces; ++f)
+		{
+			const aiFace& face = aimesh->mFaces[f];
+			auto corner = [&face](UINT k) { return face.mNumIndices > 0 ? face.mIndices[std::min(k, face.mNumIndices - 1)] : 0; };
+			if (isTriMesh)
+				triangles.push_back(XMUINT3(corner(0), corner(1), corner(2)));
+			else
+				quads.push_back(XMUINT4(corner(0), corner(1), corner(2), corner(3)));
+		}
+
+		m.numBones = aimesh->mNumBones;
+		for (UINT b = 0; b < aimesh->mNumBones; ++b)
+		{
+			const aiBone* aibone = aimesh->mBones[b];
+			CachedBone bone;
+			memcpy(&bone.offsetMatrix, &aibone->mOffsetMatrix, sizeof(bone.offsetMatrix));
+			bone.name = addString(aibone->mName);
+			bone.firstWeight = static_cast<UINT>(weights.size());
+			bone.numWeights = aibone->mNumWeights;
+			bone.pad = 0;
+			bones.push_back(bone);
+
+			for (UINT w = 0; w < aibone->mNumWeights; ++w)
+			{
+				CachedBoneWeight weight = { aibone->mWeights[w].mVertexId, aibone->mWeights[w].mWeight };
+				weights.push_back(weight);
+			}
+		}
+	}
+
+	// materials, the properties and texture slots CreateMaterial reads
+	static const aiTextureType textureTypes[NUM_TEXTURES] = 
+	{
+		aiTextureType_DIFFUSE, aiTextureType_NORMALS, aiTextureType_SPECULAR, aiTextureType_OPACITY,
+		aiTextureType_DISPLACEMENT, aiTextureType_HEIGHT, aiTextureType_EMISSIVE
+	};
+
+	std::vector<CachedMaterial> materials(aiscene->mNumMaterials);
+	for (UINT i = 0; i < aiscene->mNumMaterials; ++i)
+	{
+		const aiMaterial* aimat = aiscene->mMaterials[i];
+		CachedMaterial& mat = materials[i];
+		memset(&mat, 0, sizeof(mat));
+
+		aiString str;
+		mat.name = aimat->Get(AI_MATKEY_NAME, str) == AI_SUCCESS ? addString(str) : NO_STRING;
+
+		aiColor3D col;
+		if (aimat->Get(AI_MATKEY_COLOR_AMBIENT, col) == AI_SUCCESS)		{ mat.flags |= MATERIAL_AMBIENT;	mat.ambient = XMFLOAT3(col.r, col.g, col.b); }
+		if (aimat->Get(AI_MATKEY_COLOR_DIFFUSE, col) == AI_SUCCESS)		{ mat.flags |= MATERIAL_DIFFUSE;	mat.diffuse = XMFLOAT3(col.r, col.g, col.b); }
+		if (aimat->Get(AI_MATKEY_COLOR_SPECULAR, col) == AI_SUCCESS)	{ mat.flags |= MATERIAL_SPECULAR;	mat.specular = XMFLOAT3(col.r, col.g, col.b); }
+		if (aimat->Get(AI_MATKEY_COLOR_EMISSIVE, col) == AI_SUCCESS)	{ mat.flags |= MATERIAL_EMISSIVE;	mat.emissive = XMFLOAT3(col.r, col.g, col.b); }
+		if (aimat->Get(AI_MATKEY_SHININESS, mat.shininess) == AI_SUCCESS)		mat.flags |= MATERIAL_SHININESS;
+		if (aimat->Get(AI_MATKEY_REFRACTI, mat.refraction) == AI_SUCCESS)		mat.flags |= MATERIAL_REFRACTION;
+
+		for (UINT t = 0; t < NUM_TEXTURES; ++t)
+			mat.textures[t] = aimat->GetTexture(textureTypes[t], 0, &str) == AI_SUCCESS ? addString(str) : NO_STRING;
+	}
+
+	// node hierarchy breadth first, so the children of each node are consecutive
+	std::vector<const aiNode*> nodeOrder(1, aiscene->mRootNode);
+	std::vector<CachedNode> nodes;
+	std::vector<UINT> nodeMeshes;
+	for (size_t i = 0; i < nodeOrder.size(); ++i)
+	{
+		const aiNode* ainode = nodeOrder[i];
+		CachedNode node;
+		memset(&node, 0, sizeof(node));
+		memcpy(&node.transformation, &ainode->mTransformation, sizeof(node.transformation));
+		node.name = addString(ainode->mName);
+		node.firstChild = static_cast<UINT>(nodeOrder.size());
+		node.numChildren = ainode->mNumChildren;
+		node.firstMesh = static_cast<UINT>(nodeMeshes.size());
+		node.numMeshes = ainode->mNumMeshes;
+		nodes.push_back(node);
+
+		nodeOrder.insert(nodeOrder.end(), ainode->mChildren, ainode->mChildren + ainode->mNumChildren);
+		nodeMeshes.insert(nodeMeshes.end(), ainode->mMeshes, ainode->mMeshes + ainode->mNumMeshes);
+	}
+
+	std::vector<CachedCamera> cameras(aiscene->mNumCameras);
+	for (UINT i = 0; i < aiscene->mNumCameras; ++i)
+	{
+		const aiCamera* cam = aiscene->mCameras[i];
+		cameras[i].name = addString(cam->mName);
+		cameras[i].position = XMFLOAT3(cam->mPosition.x, cam->mPosition.y, cam->mPosition.z);
+	}
+
+	std::vector<CachedAnimation> animations(aiscene->mNumAnimations);
+	std::vector<CachedChannel> channels;
+	std::vector<CachedRotationKey> rotationKeys;
+	std::vector<CachedVectorKey> vectorKeys;
+	for (UINT i = 0; i < aiscene->mNumAnimations; ++i)
+	{
+		const aiAnimation* aianim = aiscene->mAnimations[i];
+		animations[i].duration = static_cast<float>(aianim->mDuration);
+		animations[i].ticksPerSecond = static_cast<float>(aianim->mTicksPerSecond);
+		animations[i].firstChannel = static_cast<UINT>(channels.size());
+		animations[i].numChannels = aianim->mNumChannels;
+
+		for (UINT j = 0; j < aianim->mNumChannels; ++j)
+		{
+			const aiNodeAnim* aichannel = aianim->mChannels[j];
+			CachedChannel channel;
+			channel.nodeName = addString(aichannel->mNodeName);
+
+			channel.firstRotation = static_cast<UINT>(rotationKeys.size());
+			channel.numRotations = aichannel->mNumRotationKeys;
+			for (UINT k = 0; k < aichannel->mNumRotationKeys; ++k)
+			{
+				const aiQuatKey& key = aichannel->mRotationKeys[k];	// assimp quaternion layout w, x, y, z
+				CachedRotationKey rotation = { static_cast<float>(key.mTime), XMFLOAT4(key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w) };
+				rotationKeys.push_back(rotation);
+			}
+
+			channel.firstTranslation = static_cast<UINT>(vectorKeys.size());
+			channel.numTranslations = aichannel->mNumPositionKeys;
+			for (UINT k = 0; k < aichannel->mNumPositionKeys; ++k)
+			{
+				const aiVectorKey& key = aichannel->mPositionKeys[k];
+				CachedVectorKey translation = { static_cast<float>(key.mTime), XMFLOAT3(key.mValue.x, key.mValue.y, key.mValue.z) };
+				vectorKeys.push_back(translation);
+			}
+
+			channel.firstScaling = static_cast<UINT>(vectorKeys.size());
+			channel.numScalings = aichannel->mNumScalingKeys;
+			for (UINT k = 0; k < aichannel->mNumScalingKeys; ++k)
+			{
+				const aiVectorKey& key = aichannel->mScalingKeys[k];
+				CachedVectorKey scaling = { static_cast<float>(key.mTime), XMFLOAT3(key.mValue.x, key.mValue.y, key.mValue.z) };
+				vectorKeys.push_back(scaling);
+			}
+
+			channels.push_back(channel);
+		}
+	}
+
+	FileHeader header;
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+	header.version		= VERSION;
+	header.numSections	= NUM_SECTIONS;
+	header.key			= key;
+
+	SectionEntry sections[NUM_SECTIONS];
+	const void* data[NUM_SECTIONS];
+	SetSection(sections[SECTION_STRINGS],		data[SECTION_STRINGS],			strings);
+	SetSection(sections[SECTION_MESHES],		data[SECTION_MESHES],			meshes);
+	SetSection(sections[SECTION_POSITIONS],		data[SECTION_POSITIONS],		positions);
+	SetSection(sections[SECTION_NORMALS],		data[SECTION_NORMALS],			normals);
+	SetSection(sections[SECTION_TEXCOORDS],		data[SECTION_TEXCOORDS],		texcoords);
+	SetSection(sections[SECTION_TRIANGLES],		data[SECTION_TRIANGLES],		triangles);
+	SetSection(sections[SECTION_QUADS],			data[SECTION_QUADS],			quads);
+	SetSection(sections[SECTION_BONES],			data[SECTION_BONES],			bones);
+	SetSection(sections[SECTION_BONE_WEIGHTS],	data[SECTION_BONE_WEIGHTS],		weights);
+	SetSection(sections[SECTION_MATERIALS],		data[SECTION_MATERIALS],		materials);
+	SetSection(sections[SECTION_NODES],			data[SECTION_NODES],			nodes);
+	SetSection(sections[SECTION_NODE_MESHES],	data[SECTION_NODE_MESHES],		nodeMeshes);
+	SetSection(sections[SECTION_CAMERAS],		data[SECTION_CAMERAS],			cameras);
+	SetSection(sections[SECTION_ANIMATIONS],	data[SECTION_ANIMATIONS],		animations);
+	SetSection(sections[SECTION_CHANNELS],		data[SECTION_CHANNELS],			channels);
+	SetSection(sections[SECTION_ROTATION_KEYS],	data[SECTION_ROTATION_KEYS],	rotationKeys);
+	SetSection(sections[SECTION_VECTOR_KEYS],	data[SECTION_VECTOR_KEYS],		vectorKeys);
+
+	UINT64 offset = sizeof(FileHeader) + sizeof(sections);
+	for (UINT i = 0; i < NUM_SECTIONS; ++i)
+	{
+		offset = (offset + SCENE_CACHE_ALIGNMENT - 1) & ~(SCENE_CACHE_ALIGNMENT - 1);
+		sections[i].offset = offset;
+		offset += static_cast<UINT64>(sections[i].count) * sections[i].elementSize;
+	}
+
+	image.assign(static_cast<size_t>(offset), 0);
+	memcpy(&image[0], &header, sizeof(header));
+	memcpy(&image[sizeof(header)], sections, sizeof(sections));
+	for (UINT i = 0; i < NUM_SECTIONS; ++i)
+	{
+		if (sections[i].count > 0)
+			memcpy(&image[static_cast<size_t>(sections[i].offset)], data[i], static_cast<size_t>(sections[i].count) * sections[i].elementSize);
+	}
+}
+
+HRESULT SceneCache::Save(const std::string& fileName, const std::vector<BYTE>& image)
+{
+	// write to a temporary file and move it in place once complete, per thread since loader threads may write the same file
+	const std::string tmpFileName = fileName + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+	{
+		std::ofstream file(tmpFileName.c_str(), std::ios::out | std::ios::binary);
+		if (!file.is_open())
+			return E_FAIL;
+
+		file.write(reinterpret_cast<const char*>(&image[0]), static_cast<std::streamsize>(image.size()));
+		if (!file.good())
+		{
+			file.close();
+			DeleteFileA(tmpFileName.c_str());
+			return E_FAIL;
+		}
+	}
+
+	if (!MoveFileExA(tmpFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tmpFileName.c_str());
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
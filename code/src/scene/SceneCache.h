@@ -0,0 +1,221 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <string>
+
+struct aiScene;
+
+// packed binary copy of the parts of an assimp scene the model loader reads: meshes (positions, normals, uvs, tri or quad
+// indices, bones), materials, the node hierarchy, cameras and animations. written after the first import of a source file
+// and mapped on the next loads, the arrays are read in place from the mapped view. keyed by a hash of the source file.
+class SceneCache
+{
+public:
+	static const UINT VERSION = 1;
+	static const UINT NO_STRING = ~0u;
+
+	enum Section
+	{
+		SECTION_STRINGS = 0,		// zero terminated names and texture paths, char
+		SECTION_MESHES,				// CachedMesh
+		SECTION_POSITIONS,			// XMFLOAT4A, w = 1, all meshes
+		SECTION_NORMALS,			// XMFLOAT3A, same indices as the positions, zero for meshes without normals
+		SECTION_TEXCOORDS,			// XMFLOAT2A, same indices as the positions, zero for meshes without uvs
+		SECTION_TRIANGLES,			// XMUINT3, mesh local vertex indices
+		SECTION_QUADS,				// XMUINT4, mesh local vertex indices
+		SECTION_BONES,				// CachedBone
+		SECTION_BONE_WEIGHTS,		// CachedBoneWeight
+		SECTION_MATERIALS,			// CachedMaterial
+		SECTION_NODES,				// CachedNode, breadth first, the root is node 0
+		SECTION_NODE_MESHES,		// UINT mesh indices of the nodes
+		SECTION_CAMERAS,			// CachedCamera
+		SECTION_ANIMATIONS,			// CachedAnimation
+		SECTION_CHANNELS,			// CachedChannel
+		SECTION_ROTATION_KEYS,		// CachedRotationKey
+		SECTION_VECTOR_KEYS,		// CachedVectorKey, translation and scaling keys
+		NUM_SECTIONS
+	};
+
+	enum MeshFlags
+	{
+		MESH_TRIANGLES	= 1 << 0,	// faces in SECTION_TRIANGLES
+		MESH_QUADS		= 1 << 1,	// faces in SECTION_QUADS
+		MESH_NORMALS	= 1 << 2,
+		MESH_TEXCOORDS	= 1 << 3,
+	};
+
+	enum MaterialFlags
+	{
+		MATERIAL_AMBIENT	= 1 << 0,
+		MATERIAL_DIFFUSE	= 1 << 1,
+		MATERIAL_SPECULAR	= 1 << 2,
+		MATERIAL_EMISSIVE	= 1 << 3,
+		MATERIAL_SHININESS	= 1 << 4,
+		MATERIAL_REFRACTION	= 1 << 5,
+	};
+
+	enum MaterialTexture
+	{
+		TEXTURE_DIFFUSE = 0,
+		TEXTURE_NORMALS,
+		TEXTURE_SPECULAR,
+		TEXTURE_OPACITY,
+		TEXTURE_DISPLACEMENT,
+		TEXTURE_HEIGHT,
+		TEXTURE_EMISSIVE,
+		NUM_TEXTURES
+	};
+
+	struct CachedMesh
+	{
+		UINT name;
+		UINT primitiveTypes;		// aiPrimitiveType bits, meshes other than triangle or polygon meshes have no data
+		UINT flags;					// MeshFlags
+		UINT materialIndex;
+		UINT firstVertex, numVertices;
+		UINT firstFace, numFaces;
+		UINT firstBone, numBones;
+	};
+
+	struct CachedBone
+	{
+		DirectX::XMFLOAT4X4 offsetMatrix;	// aiMatrix4x4 layout
+		UINT name;
+		UINT firstWeight, numWeights;
+		UINT pad;
+	};
+
+	struct CachedBoneWeight
+	{
+		UINT vertexId;				// mesh local
+		float weight;
+	};
+
+	struct CachedMaterial
+	{
+		UINT name;
+		UINT flags;					// MaterialFlags, values which are present in the source material
+		DirectX::XMFLOAT3 ambient, diffuse, specular, emissive;
+		float shininess, refraction;
+		UINT textures[NUM_TEXTURES];	// paths relative to the source file, NO_STRING if not set
+	};
+
+	struct CachedNode
+	{
+		DirectX::XMFLOAT4X4 transformation;	// aiMatrix4x4 layout
+		UINT name;
+		UINT firstChild, numChildren;
+		UINT firstMesh, numMeshes;	// into SECTION_NODE_MESHES
+		UINT pad[3];
+	};
+
+	struct CachedCamera
+	{
+		UINT name;
+		DirectX::XMFLOAT3 position;	// in the space of the node with the camera name
+	};
+
+	struct CachedAnimation
+	{
+		float duration, ticksPerSecond;
+		UINT firstChannel, numChannels;
+	};
+
+	struct CachedChannel
+	{
+		UINT nodeName;
+		UINT firstRotation, numRotations;
+		UINT firstTranslation, numTranslations;
+		UINT firstScaling, numScalings;
+	};
+
+	struct CachedRotationKey
+	{
+		float time;
+		DirectX::XMFLOAT4 value;	// x, y, z, w
+	};
+
+	struct CachedVectorKey
+	{
+		float time;
+		DirectX::XMFLOAT3 value;
+	};
+
+	struct FileHeader
+	{
+		char	magic[8];			// "SCENEPAK"
+		UINT	version;
+		UINT	numSections;
+		UINT64	key;
+	};
+
+	struct SectionEntry
+	{
+		UINT64	offset;				// bytes from the file start, 16 byte aligned
+		UINT	count;
+		UINT	elementSize;
+	};
+
+	SceneCache();
+	~SceneCache();
+
+	// hash of the source file contents and the cache layout
+	static HRESULT		ComputeKey(const std::string& sourceFile, UINT64& key);
+	static std::string	GetFileName(const std::string& sourceFile);
+
+	// maps the cache of the source file, on a miss the file is imported with assimp and the cache is written.
+	// without g_app.g_useSceneCache the import is read from memory and nothing is written.
+	HRESULT Load(const std::string& sourceFile);
+
+	// maps a cache file, fails for missing files, other versions, other keys and broken references
+	HRESULT Open(const std::string& fileName, UINT64 key);
+	void	Close();
+	bool	IsOpen()		const { return m_view != NULL; }
+	bool	IsCacheHit()	const { return m_cacheHit; }
+	UINT64	GetSize()		const { return m_size; }
+
+	template<typename T> 
+	const T* GetSection(Section section) const
+	{
+		return m_sections[section].count > 0 ? reinterpret_cast<const T*>(m_view + m_sections[section].offset) : NULL;
+	}
+	UINT GetCount(Section section) const { return m_sections[section].count; }
+
+	// NULL for NO_STRING
+	const char* GetString(UINT offset) const { return offset == NO_STRING ? NULL : GetSection<char>(SECTION_STRINGS) + offset; }
+
+	// packs an imported scene into a cache image
+	static void		Pack(const aiScene* scene, UINT64 key, std::vector<BYTE>& image);
+	// writes an image through a temporary file so concurrent loads never map a partial file
+	static HRESULT	Save(const std::string& fileName, const std::vector<BYTE>& image);
+
+protected:
+	HRESULT OpenView(const BYTE* view, UINT64 size, UINT64 key);
+	bool	Validate() const;
+
+	HANDLE					m_file;
+	HANDLE					m_mapping;
+	const BYTE*				m_view;
+	UINT64					m_size;
+	const FileHeader*		m_header;
+	const SectionEntry*		m_sections;
+	std::vector<BYTE>		m_image;		// imported scene if the cache could not be written
+	bool					m_cacheHit;
+};
@@ -0,0 +1,402 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "scene/SubDTopologyCache.h"
+#include "scene/ModelLoader.h"
+#include "compute/FarTablesLoader.h"
+
+#include <sstream>
+#include <iomanip>
+
+using namespace DirectX;
+using namespace OpenSubdiv;
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const char	SUBD_TOPOLOGY_MAGIC[8]	= { 'S', 'U', 'B', 'D', 'T', 'O', 'P', 'O' };
+static const UINT64	SUBD_TOPOLOGY_ALIGNMENT	= 16;
+
+static const UINT g_sectionElementSize[SubDTopologyCache::NUM_SECTIONS] =
+{
+	sizeof(XMFLOAT4A),
+	sizeof(XMUINT4),
+	sizeof(SPtexNeighborData),
+	sizeof(SExtraordinaryInfo),
+	sizeof(SExtraordinaryData),
+	sizeof(int),
+	sizeof(int),
+	sizeof(unsigned int),
+	sizeof(int),
+	sizeof(float),
+	sizeof(int),
+	sizeof(unsigned int),
+	sizeof(float),
+	sizeof(SubDTopologyCache::CachedKernelBatch),
+	sizeof(SubDTopologyCache::CachedPatchArray),
+	sizeof(unsigned int),
+	sizeof(int),
+	sizeof(unsigned int),
+	sizeof(FarPatchParam),
+	sizeof(float)
+};
+
+// FNV-1a
+static void HashBytes(UINT64& hash, const void* data, size_t size)
+{
+	const BYTE* bytes = static_cast<const BYTE*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+SubDTopologyCache::SubDTopologyCache()
+{
+	m_file		= INVALID_HANDLE_VALUE;
+	m_mapping	= NULL;
+	m_view		= NULL;
+	m_size		= 0;
+	m_header	= NULL;
+	m_sections	= NULL;
+}
+
+SubDTopologyCache::~SubDTopologyCache()
+{
+	Close();
+}
+
+UINT64 SubDTopologyCache::ComputeKey(const MeshData* meshData, bool isDeformable)
+{
+	const auto& faces = meshData->meshes[0].indicesQuad;
+
+	// everything that changes the created tables: cache layout, refinement level, ptex data and fvar uvs
+	const UINT settings[6] = 
+	{ 
+		VERSION, 
+		g_app.g_maxSubdivisions, 
+		isDeformable ? 1u : 0u, 
+		static_cast<UINT>(meshData->vertices.size()),
+		static_cast<UINT>(faces.size()),
+		static_cast<UINT>(meshData->texcoords.size())
+	};
+
+	UINT64 hash = 14695981039346656037ull;
+	HashBytes(hash, settings, sizeof(settings));
+
+	for (const auto& v : meshData->vertices)
+		HashBytes(hash, &v.x, 3 * sizeof(float));
+
+	if (!faces.empty())
+		HashBytes(hash, &faces[0], faces.size() * sizeof(XMUINT4));
+
+	for (const auto& uv : meshData->texcoords)
+		HashBytes(hash, &uv.x, 2 * sizeof(float));
+
+	return hash;
+}
+
+std::string SubDTopologyCache::GetFileName(UINT64 key)
+{
+	std::stringstream ss;
+	ss << g_app.g_topologyCacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".subd";
+	return ss.str();
+}
+
+HRESULT SubDTopologyCache::Open(const std::string& fileName, UINT64 key)
+{
+	Close();
+
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader) + NUM_SECTIONS * sizeof(SectionEntry)))
+	{
+		Close();
+		return E_FAIL;
+	}
+	m_size = static_cast<UINT64>(fileSize.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping)
+		m_view = static_cast<const BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_view)
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	m_header	= reinterpret_cast<const FileHeader*>(m_view);
+	m_sections	= reinterpret_cast<const SectionEntry*>(m_view + sizeof(FileHeader));
+
+	if (memcmp(m_header->magic, SUBD_TOPOLOGY_MAGIC, sizeof(SUBD_TOPOLOGY_MAGIC)) != 0 || 
+		m_header->version != VERSION || m_header->numSections != NUM_SECTIONS || m_header->key != key)
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	for (UINT i = 0; i < NUM_SECTIONS; ++i)
+	{
+		const SectionEntry& section = m_sections[i];
+		if (section.elementSize != g_sectionElementSize[i] || 
+			section.offset % SUBD_TOPOLOGY_ALIGNMENT != 0 ||
+			section.offset + static_cast<UINT64>(section.count) * section.elementSize > m_size)
+		{
+			std::cerr << "topology cache " << fileName << " is corrupt" << std::endl;
+			Close();
+			return E_FAIL;
+		}
+	}
+
+	// far tables always have at least one refinement level
+	if (m_sections[SECTION_VERTS_OFFSETS].count < 3)
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+void SubDTopologyCache::Close()
+{
+	if (m_view)
+		UnmapViewOfFile(m_view);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_file		= INVALID_HANDLE_VALUE;
+	m_mapping	= NULL;
+	m_view		= NULL;
+	m_size		= 0;
+	m_header	= NULL;
+	m_sections	= NULL;
+}
+
+template<typename T> 
+const T* SubDTopologyCache::GetSection(Section section, UINT& count) const
+{
+	count = m_sections[section].count;
+	return count > 0 ? reinterpret_cast<const T*>(m_view + m_sections[section].offset) : NULL;
+}
+
+template<typename T> 
+void SubDTopologyCache::CopySection(Section section, std::vector<T>& dst) const
+{
+	UINT count;
+	const T* src = GetSection<T>(section, count);
+	dst.assign(src, src + count);
+}
+
+FarMesh<OsdVertex>* SubDTopologyCache::CreateFarMesh() const
+{
+	assert(IsOpen());
+
+	// subdivision tables
+	const int maxLevel = static_cast<int>(m_sections[SECTION_VERTS_OFFSETS].count) - 2;
+	FarSubdivisionTables* subdivisionTables = FarTablesLoader::NewSubdivisionTables(maxLevel, static_cast<FarSubdivisionTables::Scheme>(m_header->scheme));
+
+	CopySection(SECTION_VERTS_OFFSETS,	FarTablesLoader::VertsOffsets(subdivisionTables));
+	CopySection(SECTION_F_ITA,			FarTablesLoader::F_ITa(subdivisionTables));
+	CopySection(SECTION_F_IT,			FarTablesLoader::F_IT(subdivisionTables));
+	CopySection(SECTION_E_IT,			FarTablesLoader::E_IT(subdivisionTables));
+	CopySection(SECTION_E_W,			FarTablesLoader::E_W(subdivisionTables));
+	CopySection(SECTION_V_ITA,			FarTablesLoader::V_ITa(subdivisionTables));
+	CopySection(SECTION_V_IT,			FarTablesLoader::V_IT(subdivisionTables));
+	CopySection(SECTION_V_W,			FarTablesLoader::V_W(subdivisionTables));
+
+	// patch tables
+	FarPatchTables* patchTables = FarTablesLoader::NewPatchTables(m_header->maxValence, m_header->numPtexFaces);
+
+	UINT numPatchArrays;
+	const CachedPatchArray* patchArrays = GetSection<CachedPatchArray>(SECTION_PATCH_ARRAYS, numPatchArrays);
+	FarPatchTables::PatchArrayVector& dstPatchArrays = FarTablesLoader::PatchArrays(patchTables);
+	dstPatchArrays.reserve(numPatchArrays);
+	for (UINT i = 0; i < numPatchArrays; ++i)
+	{
+		const CachedPatchArray& pa = patchArrays[i];
+		FarPatchTables::Descriptor desc(pa.type, pa.pattern, static_cast<unsigned char>(pa.rotation));
+		dstPatchArrays.push_back(FarPatchTables::PatchArray(desc, pa.vertIndex, pa.patchIndex, pa.numPatches, pa.quadOffsetIndex));
+	}
+
+	CopySection(SECTION_PATCH_TABLE,		FarTablesLoader::Patches(patchTables));
+	CopySection(SECTION_VERTEX_VALENCES,	FarTablesLoader::VertexValences(patchTables));
+	CopySection(SECTION_QUAD_OFFSETS,		FarTablesLoader::QuadOffsets(patchTables));
+	CopySection(SECTION_PATCH_PARAMS,		FarTablesLoader::PatchParams(patchTables));
+	CopySection(SECTION_FVAR_DATA,			FarTablesLoader::FVarData(patchTables));
+	FarTablesLoader::SetFVarWidth(patchTables, m_header->fvarWidth);
+
+	// kernel batches
+	UINT numBatches;
+	const CachedKernelBatch* batches = GetSection<CachedKernelBatch>(SECTION_KERNEL_BATCHES, numBatches);
+	FarKernelBatchVector kernelBatches;
+	kernelBatches.reserve(numBatches);
+	for (UINT i = 0; i < numBatches; ++i)
+	{
+		const CachedKernelBatch& b = batches[i];
+		kernelBatches.push_back(FarKernelBatch(b.kernelType, b.level, b.tableIndex, b.start, b.end, b.tableOffset, b.vertexOffset, b.meshIndex));
+	}
+
+	return new FarMesh<OsdVertex>(subdivisionTables, patchTables, NULL, kernelBatches);
+}
+
+void SubDTopologyCache::GetVertices(std::vector<XMFLOAT4A>& vertices) const
+{
+	CopySection(SECTION_VERTICES, vertices);
+}
+
+void SubDTopologyCache::GetFaces(std::vector<XMUINT4>& faces) const
+{
+	CopySection(SECTION_FACES, faces);
+}
+
+void SubDTopologyCache::GetPtexNeighborData(std::vector<SPtexNeighborData>& ptexNeighborData) const
+{
+	CopySection(SECTION_PTEX_NEIGHBORS, ptexNeighborData);
+}
+
+void SubDTopologyCache::GetExtraordinaryInfo(std::vector<SExtraordinaryInfo>& eInfo, std::vector<SExtraordinaryData>& eData) const
+{
+	CopySection(SECTION_EXTRAORDINARY_INFO, eInfo);
+	CopySection(SECTION_EXTRAORDINARY_DATA, eData);
+}
+
+template<typename T>
+static void SetSection(SubDTopologyCache::SectionEntry& entry, const void*& data, const std::vector<T>& src)
+{
+	entry.count			= static_cast<UINT>(src.size());
+	entry.elementSize	= sizeof(T);
+	data				= src.empty() ? NULL : &src[0];
+}
+
+HRESULT SubDTopologyCache::Save(const std::string& fileName, UINT64 key, const FarMesh<OsdVertex>* farMesh,
+								const std::vector<XMFLOAT4A>& vertices, const std::vector<XMUINT4>& faces,
+								const std::vector<SPtexNeighborData>& ptexNeighborData,
+								const std::vector<SExtraordinaryInfo>& eInfo, const std::vector<SExtraordinaryData>& eData)
+{
+	const FarSubdivisionTables* subdivisionTables = farMesh->GetSubdivisionTables();
+	const FarPatchTables* patchTables = farMesh->GetPatchTables();
+
+	// hierarchical edits are not part of the flat tables
+	if (farMesh->GetVertexEditTables() || !patchTables)
+		return E_FAIL;
+
+	std::vector<CachedKernelBatch> kernelBatches;
+	kernelBatches.reserve(farMesh->GetKernelBatches().size());
+	for (const auto& b : farMesh->GetKernelBatches())
+	{
+		CachedKernelBatch cb = { b.GetKernelType(), b.GetLevel(), b.GetTableIndex(), b.GetStart(), b.GetEnd(), b.GetTableOffset(), b.GetVertexOffset(), b.GetMeshIndex() };
+		kernelBatches.push_back(cb);
+	}
+
+	std::vector<CachedPatchArray> patchArrays;
+	patchArrays.reserve(patchTables->GetPatchArrayVector().size());
+	for (const auto& pa : patchTables->GetPatchArrayVector())
+	{
+		const FarPatchTables::Descriptor desc = pa.GetDescriptor();
+		CachedPatchArray cpa = { desc.GetType(), desc.GetPattern(), desc.GetRotation(), 
+								 static_cast<int>(pa.GetVertIndex()), static_cast<int>(pa.GetPatchIndex()), static_cast<int>(pa.GetNumPatches()), static_cast<int>(pa.GetQuadOffsetIndex()), 0 };
+		patchArrays.push_back(cpa);
+	}
+
+	FileHeader header;
+	memcpy(header.magic, SUBD_TOPOLOGY_MAGIC, sizeof(SUBD_TOPOLOGY_MAGIC));
+	header.version		= VERSION;
+	header.numSections	= NUM_SECTIONS;
+	header.key			= key;
+	header.scheme		= subdivisionTables->GetScheme();
+	header.maxValence	= patchTables->GetMaxValence();
+	header.numPtexFaces	= patchTables->GetNumPtexFaces();
+	header.fvarWidth	= patchTables->GetFVarData().GetFVarWidth();
+
+	SectionEntry sections[NUM_SECTIONS];
+	const void* data[NUM_SECTIONS];
+	SetSection(sections[SECTION_VERTICES],				data[SECTION_VERTICES],				vertices);
+	SetSection(sections[SECTION_FACES],					data[SECTION_FACES],				faces);
+	SetSection(sections[SECTION_PTEX_NEIGHBORS],		data[SECTION_PTEX_NEIGHBORS],		ptexNeighborData);
+	SetSection(sections[SECTION_EXTRAORDINARY_INFO],	data[SECTION_EXTRAORDINARY_INFO],	eInfo);
+	SetSection(sections[SECTION_EXTRAORDINARY_DATA],	data[SECTION_EXTRAORDINARY_DATA],	eData);
+	SetSection(sections[SECTION_VERTS_OFFSETS],			data[SECTION_VERTS_OFFSETS],		FarTablesLoader::GetVertsOffsets(subdivisionTables));
+	SetSection(sections[SECTION_F_ITA],					data[SECTION_F_ITA],				subdivisionTables->Get_F_ITa());
+	SetSection(sections[SECTION_F_IT],					data[SECTION_F_IT],					subdivisionTables->Get_F_IT());
+	SetSection(sections[SECTION_E_IT],					data[SECTION_E_IT],					subdivisionTables->Get_E_IT());
+	SetSection(sections[SECTION_E_W],					data[SECTION_E_W],					subdivisionTables->Get_E_W());
+	SetSection(sections[SECTION_V_ITA],					data[SECTION_V_ITA],				subdivisionTables->Get_V_ITa());
+	SetSection(sections[SECTION_V_IT],					data[SECTION_V_IT],					subdivisionTables->Get_V_IT());
+	SetSection(sections[SECTION_V_W],					data[SECTION_V_W],					subdivisionTables->Get_V_W());
+	SetSection(sections[SECTION_KERNEL_BATCHES],		data[SECTION_KERNEL_BATCHES],		kernelBatches);
+	SetSection(sections[SECTION_PATCH_ARRAYS],			data[SECTION_PATCH_ARRAYS],			patchArrays);
+	SetSection(sections[SECTION_PATCH_TABLE],			data[SECTION_PATCH_TABLE],			patchTables->GetPatchTable());
+	SetSection(sections[SECTION_VERTEX_VALENCES],		data[SECTION_VERTEX_VALENCES],		patchTables->GetVertexValenceTable());
+	SetSection(sections[SECTION_QUAD_OFFSETS],			data[SECTION_QUAD_OFFSETS],			patchTables->GetQuadOffsetTable());
+	SetSection(sections[SECTION_PATCH_PARAMS],			data[SECTION_PATCH_PARAMS],			patchTables->GetPatchParamTable());
+	SetSection(sections[SECTION_FVAR_DATA],				data[SECTION_FVAR_DATA],			patchTables->GetFVarData().GetAllData());
+
+	UINT64 offset = sizeof(FileHeader) + sizeof(sections);
+	for (UINT i = 0; i < NUM_SECTIONS; ++i)
+	{
+		offset = (offset + SUBD_TOPOLOGY_ALIGNMENT - 1) & ~(SUBD_TOPOLOGY_ALIGNMENT - 1);
+		sections[i].offset = offset;
+		offset += static_cast<UINT64>(sections[i].count) * sections[i].elementSize;
+	}
+
+	// write to a temporary file and move it in place once complete, per thread since loader threads may write the same file
+	const std::string tmpFileName = fileName + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+	{
+		std::ofstream file(tmpFileName.c_str(), std::ios::out | std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "could not write topology cache " << tmpFileName << std::endl;
+			return E_FAIL;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+
+		static const char padding[SUBD_TOPOLOGY_ALIGNMENT] = { 0 };
+		UINT64 pos = sizeof(FileHeader) + sizeof(sections);
+		for (UINT i = 0; i < NUM_SECTIONS; ++i)
+		{
+			file.write(padding, static_cast<std::streamsize>(sections[i].offset - pos));
+			const UINT64 size = static_cast<UINT64>(sections[i].count) * sections[i].elementSize;
+			if (size > 0)
+				file.write(static_cast<const char*>(data[i]), static_cast<std::streamsize>(size));
+			pos = sections[i].offset + size;
+		}
+
+		if (!file.good())
+		{
+			file.close();
+			DeleteFileA(tmpFileName.c_str());
+			return E_FAIL;
+		}
+	}
+
+	if (!MoveFileExA(tmpFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tmpFileName.c_str());
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,131 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <string>
+
+#include <osd/vertex.h>
+#include <far/mesh.h>
+#include <App.h>
+
+struct MeshData;
+
+// binary cache of the subdivision topology of one mesh, skips the hbr mesh and far factories on the next load.
+// stores the far subdivision and patch tables, the kernel batches and the tile overlap data (ptex neighbors,
+// extraordinary vertices) as flat arrays. the file is mapped and every table is copied once from the mapped view.
+class SubDTopologyCache
+{
+public:
+	static const UINT VERSION = 2;
+
+	// arrays of the file in order of the section table
+	enum Section
+	{
+		SECTION_VERTICES = 0,		// unique control vertices, XMFLOAT4A
+		SECTION_FACES,				// quad face vertex indices into the unique vertices, XMUINT4
+		SECTION_PTEX_NEIGHBORS,		// SPtexNeighborData per ptex face
+		SECTION_EXTRAORDINARY_INFO,	// SExtraordinaryInfo per extraordinary vertex
+		SECTION_EXTRAORDINARY_DATA,	// SExtraordinaryData per incident face
+		SECTION_VERTS_OFFSETS,		// far subdivision tables
+		SECTION_F_ITA,
+		SECTION_F_IT,
+		SECTION_E_IT,
+		SECTION_E_W,
+		SECTION_V_ITA,
+		SECTION_V_IT,
+		SECTION_V_W,
+		SECTION_KERNEL_BATCHES,		// CachedKernelBatch
+		SECTION_PATCH_ARRAYS,		// CachedPatchArray, far patch tables
+		SECTION_PATCH_TABLE,
+		SECTION_VERTEX_VALENCES,
+		SECTION_QUAD_OFFSETS,
+		SECTION_PATCH_PARAMS,
+		SECTION_FVAR_DATA,
+		NUM_SECTIONS
+	};
+
+	SubDTopologyCache();
+	~SubDTopologyCache();
+
+	// hash of the mesh data and the subdivision settings the topology depends on
+	static UINT64		ComputeKey(const MeshData* meshData, bool isDeformable);
+	static std::string	GetFileName(UINT64 key);
+
+	// maps the cache file, fails for missing files, other versions and other keys
+	HRESULT Open(const std::string& fileName, UINT64 key);
+	void	Close();
+	bool	IsOpen() const { return m_view != NULL; }
+
+	// far mesh from the cached tables, owned by the caller (the osd mesh)
+	OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* CreateFarMesh() const;
+
+	void	GetVertices(std::vector<DirectX::XMFLOAT4A>& vertices) const;
+	void	GetFaces(std::vector<DirectX::XMUINT4>& faces) const;
+	void	GetPtexNeighborData(std::vector<SPtexNeighborData>& ptexNeighborData) const;
+	void	GetExtraordinaryInfo(std::vector<SExtraordinaryInfo>& eInfo, std::vector<SExtraordinaryData>& eData) const;
+
+	// writes the topology of a created mesh, through a temporary file so concurrent loads never map a partial file
+	static HRESULT Save(const std::string& fileName, UINT64 key,
+						const OpenSubdiv::FarMesh<OpenSubdiv::OsdVertex>* farMesh,
+						const std::vector<DirectX::XMFLOAT4A>& vertices,
+						const std::vector<DirectX::XMUINT4>& faces,
+						const std::vector<SPtexNeighborData>& ptexNeighborData,
+						const std::vector<SExtraordinaryInfo>& eInfo,
+						const std::vector<SExtraordinaryData>& eData);
+
+	struct CachedKernelBatch
+	{
+		int kernelType, level, tableIndex, start, end, tableOffset, vertexOffset, meshIndex;
+	};
+
+	struct CachedPatchArray
+	{
+		int type, pattern, rotation, vertIndex, patchIndex, numPatches, quadOffsetIndex, pad;
+	};
+
+	struct FileHeader
+	{
+		char	magic[8];			// "SUBDTOPO"
+		UINT	version;
+		UINT	numSections;
+		UINT64	key;
+		int		scheme;				// FarSubdivisionTables::Scheme
+		int		maxValence;
+		int		numPtexFaces;
+		int		fvarWidth;
+	};
+
+	struct SectionEntry
+	{
+		UINT64	offset;				// bytes from the file start, 16 byte aligned
+		UINT	count;
+		UINT	elementSize;
+	};
+
+protected:
+	template<typename T> const T*	GetSection(Section section, UINT& count) const;
+	template<typename T> void		CopySection(Section section, std::vector<T>& dst) const;
+
+	HANDLE					m_file;
+	HANDLE					m_mapping;
+	const BYTE*				m_view;
+	UINT64					m_size;
+	const FileHeader*		m_header;
+	const SectionEntry*		m_sections;
+};
@@ -16,49 +16,30 @@
 #include "stdafx.h"
 
 #include "FrameProfiler.h"
+#include "Profiler.h"
 #include "App.h"
 
 #include "AntTweakBar.h"
 
 FrameProfiler	g_frameProfiler;
 
+static const char* g_stageNames[] = { "render", "subd_kernel", "deformation", "paint_sculpt", "shadow", "gui", "postpro", "overlap" };
+static_assert(ARRAYSIZE(g_stageNames) == static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS), "stage names do not match DXPerformanceQuery");
+
 FrameProfiler::FrameProfiler()
 {
-	m_qryTimestampDisjoint = NULL;
-	m_qryStart.resize(static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS), NULL);
-	m_qryEnd.resize(static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS), NULL);
 	m_stageTimings.resize(static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS), 0);
-	m_stageActive.resize(static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS), false);
-
-	
+	m_frameActive = false;
 }
 
 FrameProfiler::~FrameProfiler()
 {
-	Destroy();
+	// g_profiler may already be gone here, Destroy is called in OnD3D11DestroyDevice
 }
 
 HRESULT FrameProfiler::Create( ID3D11Device1* pd3dDevice )
 {
-	HRESULT hr = NULL;
-	D3D11_QUERY_DESC perfQueryDesc;
-
-	perfQueryDesc.MiscFlags = 0;
-
-	perfQueryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
-	V_RETURN(pd3dDevice->CreateQuery(&perfQueryDesc, &m_qryTimestampDisjoint));
-
-	perfQueryDesc.Query = D3D11_QUERY_TIMESTAMP;
-
-	for(int i = 0; i< static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS); ++i )
-	{		
-		V_RETURN(pd3dDevice->CreateQuery(&perfQueryDesc, &m_qryStart[i]));
-		V_RETURN(pd3dDevice->CreateQuery(&perfQueryDesc, &m_qryEnd[i]));
-	}
-
-
-
-	return hr;
+	return g_profiler.Create(pd3dDevice);
 }
 
 void FrameProfiler::InitGUI()
@@ -68,6 +49,8 @@ void FrameProfiler::InitGUI()
 
 	TwAddVarCB(profileBar, "Enable", TW_TYPE_BOOLCPP, 		(TwSetVarCallback)[](const void *value, void* clientData){g_app.g_profilePipelineStages = *static_cast<const bool *>(value);},
 															(TwGetVarCallback)[](void *value, void*){*static_cast<bool*>(value) =g_app.g_profilePipelineStages;},NULL, "label = 'enable' " );
+	// the profile is written after the captured frames, see Profiler::CaptureFrames
+	TwAddButton(profileBar, "DumpProfile", (TwButtonCallback)[](void* clientData){ g_app.g_profilePipelineStages = true; g_profiler.CaptureFrames(60, "profile"); }, NULL, "label='dump profile (60 frames)'");
 	
 	TwAddVarRO(profileBar, "Render", TW_TYPE_FLOAT, 		&m_stageTimings[(UINT)DXPerformanceQuery::RENDER],		"" );
 	TwAddVarRO(profileBar, "Shadows", TW_TYPE_FLOAT, 		&m_stageTimings[(UINT)DXPerformanceQuery::SHADOW],		"" );
@@ -84,79 +67,56 @@ void FrameProfiler::InitGUI()
 
 void FrameProfiler::Destroy()
 {
-	SAFE_RELEASE(m_qryTimestampDisjoint);
-	for(int i = 0; i< static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS); ++i )
-	{
-		SAFE_RELEASE(m_qryStart[i]);
-		SAFE_RELEASE(m_qryEnd[i]);
-	}
+	g_profiler.Destroy();
 }
 
-void FrameProfiler::FrameStart(ID3D11DeviceContext1* pd3dImmediateContext)
+const char* FrameProfiler::GetStageName(DXPerformanceQuery query)
 {
-	if(!g_app.g_profilePipelineStages) return;
-	pd3dImmediateContext->Begin(m_qryTimestampDisjoint);
+	return g_stageNames[static_cast<unsigned int>(query)];
 }
 
-void FrameProfiler::FrameEnd(ID3D11DeviceContext1* pd3dImmediateContext)
+const std::vector<float>& FrameProfiler::GetStageTimings() const
 {
-	if(!g_app.g_profilePipelineStages) return;
-
-	pd3dImmediateContext->End(m_qryTimestampDisjoint);
-	
-
+	return m_stageTimings;
+}
 
-	while (pd3dImmediateContext->GetData(m_qryTimestampDisjoint, NULL, 0, 0) == S_FALSE){	Sleep(1);    }   // Wait a bit, but give other threads a chance to run	
+void FrameProfiler::FrameStart(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	// the flags are only picked up at the frame begin, so the scopes of one frame are always balanced.
+	// the stage timings of the TimingLog are fed by the profiler as well
+	g_profiler.SetEnabled(g_app.g_profilePipelineStages || g_app.g_bTimingsEnabled);
+	m_frameActive = g_profiler.IsEnabled();
+	if(!m_frameActive) return;
+
+	g_profiler.BeginFrame(pd3dImmediateContext);
+	g_profiler.BeginScope("frame");
+}
 
-	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT timestampDisjoint;
-	pd3dImmediateContext->GetData(m_qryTimestampDisjoint, &timestampDisjoint, sizeof(timestampDisjoint), 0);
+void FrameProfiler::FrameEnd(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	if(!m_frameActive) return;
 
-	if(timestampDisjoint.Disjoint)
-		return;
+	g_profiler.EndScope();
+	g_profiler.EndFrame(pd3dImmediateContext);
+	m_frameActive = false;
 
-	// eval perf timers
+	// no waiting for the gpu, the timings are the ones of the last resolved frame
 	for(int i = 0; i< static_cast<unsigned int>(DXPerformanceQuery::NUM_QUERYS); ++i )
 	{
-		if(!m_stageActive[i])
-		{
-			m_stageTimings[i] = -1;
-			continue;
-		}
-
-		UINT64 timestampStart;
-		UINT64 timestampEnd;
-
-		while(pd3dImmediateContext->GetData(m_qryStart[i], &timestampStart, sizeof(timestampStart), 0)!= S_OK);
-		while(pd3dImmediateContext->GetData(m_qryEnd[i],   &timestampEnd,   sizeof(timestampEnd),   0) != S_OK);
-
-		//pd3dImmediateContext->GetData(m_qryStart[i], &timestampStart, sizeof(timestampStart),0);
-		//pd3dImmediateContext->GetData(m_qryEnd[i],   &timestampEnd,   sizeof(timestampEnd),0);
-
-
-
-		m_stageTimings[i] = static_cast<float>(1000 * double(timestampEnd - timestampStart) / double(timestampDisjoint.Frequency));
-		m_stageActive[i] = false;
+		m_stageTimings[i] = static_cast<float>(g_profiler.GetLastMS(g_stageNames[i], true));
 	}
-	//std::cout << "Deformation " << m_stageTimings[(UINT)DXPerformanceQuery::DEFORMATION] << std::endl;
-	//std::cout << "Shadows " << m_stageTimings[(UINT)DXPerformanceQuery::SHADOW] << std::endl;
-	//std::cout << "Render Shaded " << m_stageTimings[(UINT)DXPerformanceQuery::RENDER] << std::endl;	
-	//std::cout << "SubD Kernel " << m_stageTimings[(UINT)DXPerformanceQuery::SUBD_KERNEL] << std::endl;
-	//std::cout << "freq: " << timestampDisjoint.Frequency << std::endl;
-	//if(g_qryTimeActive)	std::cerr << "perf query is active in GPUPerfTimerElapsed, check your code for nested timings" << std::endl;
-	//return (float)elapsed*1000.0;	
 }
 
 void FrameProfiler::BeginQuery(ID3D11DeviceContext1* pd3dImmediateContext, DXPerformanceQuery query )
 {
-	if(!g_app.g_profilePipelineStages) return;	
-	m_stageActive[static_cast<unsigned int>(query)] = true;
-	pd3dImmediateContext->End(m_qryStart[static_cast<unsigned int>(query)]);
-	
-	
+	if(!m_frameActive) return;
+	g_profiler.BeginScope(GetStageName(query));
+	g_profiler.BeginGPUScope(pd3dImmediateContext, GetStageName(query));
 }
 
 void FrameProfiler::EndQuery(ID3D11DeviceContext1* pd3dImmediateContext, DXPerformanceQuery query )
 {	
-	if(!g_app.g_profilePipelineStages) return;	
-	pd3dImmediateContext->End(m_qryEnd[static_cast<unsigned int>(query)]);	
+	if(!m_frameActive) return;
+	g_profiler.EndGPUScope(pd3dImmediateContext);
+	g_profiler.EndScope();
 }
@@ -34,7 +34,7 @@ enum class DXPerformanceQuery
 	NUM_QUERYS
 };
 
-
+// pipeline stage timings of the viewer, the stages are nested cpu and gpu scopes of g_profiler
 class FrameProfiler{
 public:
 	FrameProfiler();
@@ -49,18 +49,14 @@ public:
 	void BeginQuery(ID3D11DeviceContext1* pd3dImmediateContext, DXPerformanceQuery query);
 	void EndQuery(ID3D11DeviceContext1* pd3dImmediateContext, DXPerformanceQuery query);
 	
+	static const char* GetStageName(DXPerformanceQuery query);
+
+	// gpu times of the stages in ms, resolved a few frames late, -1 for stages that did not run
 	const std::vector<float>& GetStageTimings() const;
 	void InitGUI();
 protected:
-	std::vector<ID3D11Query*> m_qryStart;
-	std::vector<ID3D11Query*> m_qryEnd;
-
 	std::vector<float>		  m_stageTimings;
-	std::vector<bool>		  m_stageActive;
-
-	ID3D11Query* m_qryTimestampDisjoint;
-
-	//DISJOINT = 0,
+	bool					  m_frameActive;
 };
 
 extern FrameProfiler	g_frameProfiler;
\ No newline at end of file
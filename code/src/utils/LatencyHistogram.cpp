@@ -0,0 +1,99 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <intrin.h>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+// linear buckets for [0, 2 * SUB_BUCKETS), then SUB_BUCKETS per power of two
+static const UINT LATENCY_LINEAR_BUCKETS = 2 * LatencyHistogram::SUB_BUCKETS;
+static const UINT LATENCY_NUM_BUCKETS = LATENCY_LINEAR_BUCKETS + (LatencyHistogram::MAX_NS_BITS - LatencyHistogram::SUB_BUCKET_BITS) * LatencyHistogram::SUB_BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+{
+	m_counts.resize(LATENCY_NUM_BUCKETS, 0);
+	Reset();
+}
+
+UINT LatencyHistogram::GetBucket(UINT64 ns)
+{
+	if (ns < LATENCY_LINEAR_BUCKETS) return static_cast<UINT>(ns);
+
+	DWORD msb;
+	_BitScanReverse64(&msb, ns);
+	const UINT shift = msb - SUB_BUCKET_BITS;									// >= 1
+	const UINT sub = static_cast<UINT>(ns >> shift) - SUB_BUCKETS;				// [0, SUB_BUCKETS)
+	return std::min(LATENCY_LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + sub, LATENCY_NUM_BUCKETS - 1);
+}
+
+UINT64 LatencyHistogram::GetBucketUpper(UINT bucket)
+{
+	if (bucket < LATENCY_LINEAR_BUCKETS) return bucket;
+
+	const UINT shift = (bucket - LATENCY_LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+	const UINT64 sub = (bucket - LATENCY_LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(double ms)
+{
+	const UINT64 ns = static_cast<UINT64>(std::min(std::max(ms, 0.0) * 1e6, (double)MAX_NS));
+	m_counts[GetBucket(ns)]++;
+	m_count++;
+	m_totalMS += ms;
+	m_minNS = std::min(m_minNS, ns);
+	m_maxNS = std::max(m_maxNS, ns);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+	for (size_t i = 0; i < m_counts.size(); ++i)
+		m_counts[i] += other.m_counts[i];
+	m_count += other.m_count;
+	m_totalMS += other.m_totalMS;
+	m_minNS = std::min(m_minNS, other.m_minNS);
+	m_maxNS = std::max(m_maxNS, other.m_maxNS);
+}
+
+void LatencyHistogram::Reset()
+{
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_count = 0;
+	m_totalMS = 0.0;
+	m_minNS = UINT64(-1);
+	m_maxNS = 0;
+}
+
+double LatencyHistogram::GetPercentileMS(double p) const
+{
+	if (m_count == 0) return 0.0;
+
+	// nearest rank
+	const UINT64 rank = std::max<UINT64>(1, static_cast<UINT64>(ceil(std::min(std::max(p, 0.0), 100.0) * 0.01 * m_count)));
+	UINT64 seen = 0;
+	for (UINT i = 0; i < LATENCY_NUM_BUCKETS; ++i)
+	{
+		seen += m_counts[i];
+		if (seen >= rank)
+			return std::min(GetBucketUpper(i), m_maxNS) * 1e-6;
+	}
+	return GetMaxMS();
+}
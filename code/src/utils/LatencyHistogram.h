@@ -0,0 +1,55 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+
+// latency histogram in the style of hdr histograms: exact below 256 ns, above that 128 linear sub buckets per power of two,
+// so every recorded value keeps a relative precision of better than 1% up to MAX_NS. recording is a few integer operations
+// and the memory does not depend on the number of samples, so the histograms can run over whole sessions.
+class LatencyHistogram
+{
+public:
+	static const UINT	SUB_BUCKET_BITS = 7;
+	static const UINT	SUB_BUCKETS		= 1 << SUB_BUCKET_BITS;
+	static const UINT	MAX_NS_BITS		= 40;
+	static const UINT64	MAX_NS			= 1ull << MAX_NS_BITS;		// ~18 minutes, larger values go into the last bucket
+
+	LatencyHistogram();
+
+	void	Record(double ms);
+	void	Merge(const LatencyHistogram& other);
+	void	Reset();
+
+	UINT64	GetCount()		const	{ return m_count; }
+	double	GetTotalMS()	const	{ return m_totalMS; }
+	double	GetMeanMS()		const	{ return m_count > 0 ? m_totalMS / m_count : 0.0; }
+	double	GetMinMS()		const	{ return m_count > 0 ? m_minNS * 1e-6 : 0.0; }
+	double	GetMaxMS()		const	{ return m_maxNS * 1e-6; }
+	// highest value equivalent to the sample at percentile p (0..100), clamped to the recorded max
+	double	GetPercentileMS(double p) const;
+
+protected:
+	static UINT		GetBucket(UINT64 ns);
+	static UINT64	GetBucketUpper(UINT bucket);
+
+	std::vector<UINT64>	m_counts;
+	UINT64				m_count;
+	double				m_totalMS;
+	UINT64				m_minNS;
+	UINT64				m_maxNS;
+};
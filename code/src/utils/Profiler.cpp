@@ -0,0 +1,552 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "Profiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+Profiler g_profiler;
+
+static const UINT PROFILER_GPU_TRACE_TID = 1000;	// track of the gpu scopes in the trace
+
+// buffer of the calling thread, set on its first scope
+static __declspec(thread) void* t_profilerBuffer = NULL;
+
+namespace
+{
+	__forceinline UINT64 Now()
+	{
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return static_cast<UINT64>(counter.QuadPart);
+	}
+
+	UINT64 Frequency()
+	{
+		static UINT64 frequency = 0;
+		if (frequency == 0)
+		{
+			LARGE_INTEGER f;
+			QueryPerformanceFrequency(&f);
+			frequency = static_cast<UINT64>(f.QuadPart);
+		}
+		return frequency;
+	}
+
+	// names are literals, quotes and backslashes are escaped anyway
+	std::string EscapeJSON(const char* s)
+	{
+		std::string r;
+		for (; *s; ++s)
+		{
+			if (*s == '"' || *s == '\\') r += '\\';
+			r += *s;
+		}
+		return r;
+	}
+
+	// nearest rank
+	double Percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty()) return 0.0;
+		size_t rank = static_cast<size_t>(ceil(p * sorted.size()));
+		return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+	}
+}
+
+Profiler::Profiler()
+{
+	m_enabled = false;
+	m_capture = false;
+	m_frame = 0;
+	m_eventsDropped = 0;
+	m_captureFrames = 0;
+	m_gpuFrame = NULL;
+	m_gpuDropped = 0;
+}
+
+Profiler::~Profiler()
+{
+	Destroy();
+
+	// threads keep their buffer pointer, the buffers live as long as the profiler
+	for (auto buffer : m_threads)
+		delete buffer;
+	m_threads.clear();
+}
+
+HRESULT Profiler::Create(ID3D11Device1* pd3dDevice)
+{
+	HRESULT hr = S_OK;
+
+	D3D11_QUERY_DESC desc;
+	desc.MiscFlags = 0;
+	for (UINT i = 0; i < GPU_FRAMES_IN_FLIGHT; ++i)
+	{
+		GPUFrame& frame = m_gpuFrames[i];
+		desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		V_RETURN(pd3dDevice->CreateQuery(&desc, &frame.disjoint));
+
+		desc.Query = D3D11_QUERY_TIMESTAMP;
+		frame.queries.resize(1 + 2 * MAX_GPU_SCOPES, NULL);
+		for (auto& query : frame.queries)
+			V_RETURN(pd3dDevice->CreateQuery(&desc, &query));
+		frame.pending = false;
+	}
+	return hr;
+}
+
+void Profiler::Destroy()
+{
+	for (UINT i = 0; i < GPU_FRAMES_IN_FLIGHT; ++i)
+	{
+		GPUFrame& frame = m_gpuFrames[i];
+		SAFE_RELEASE(frame.disjoint);
+		for (auto& query : frame.queries)
+			SAFE_RELEASE(query);
+		frame.queries.clear();
+		frame.scopes.clear();
+		frame.pending = false;
+	}
+	m_gpuFrame = NULL;
+	m_gpuStack.clear();
+}
+
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+	if (t_profilerBuffer) return static_cast<ThreadBuffer*>(t_profilerBuffer);
+
+	ThreadBuffer* buffer = new ThreadBuffer();
+	{
+		std::lock_guard<std::mutex> l(m_threadLock);
+		buffer->index = static_cast<UINT>(m_threads.size());
+		m_threads.push_back(buffer);
+	}
+	t_profilerBuffer = buffer;
+	return buffer;
+}
+
+void Profiler::BeginScope(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (buffer->depth < MAX_DEPTH)
+	{
+		buffer->stack[buffer->depth].name = name;
+		buffer->stack[buffer->depth].value = 0;
+		buffer->stack[buffer->depth].begin = Now();
+	}
+	buffer->depth++;
+}
+
+void Profiler::EndScope()
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (buffer->depth == 0) return;
+
+	const UINT depth = --buffer->depth;
+	if (depth >= MAX_DEPTH)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const UINT64 end = Now();
+	const UINT64 write = buffer->writePos.load(std::memory_order_relaxed);
+	if (write - buffer->readPos.load(std::memory_order_acquire) >= RING_SIZE)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ProfileEvent& e = buffer->ring[write & (RING_SIZE - 1)];
+	e.name		= buffer->stack[depth].name;
+	e.begin		= buffer->stack[depth].begin;
+	e.end		= end;
+	e.depth		= depth;
+	e.thread	= buffer->index;
+	e.frame		= m_frame.load(std::memory_order_relaxed);
+	e.value		= buffer->stack[depth].value;
+
+	// publishes the event to Collect
+	buffer->writePos.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::AddScopeValue(UINT64 value)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (buffer->depth > 0 && buffer->depth <= MAX_DEPTH)
+		buffer->stack[buffer->depth - 1].value += value;
+}
+
+void Profiler::AddEvent(const ProfileEvent& e)
+{
+	if (!m_capture) return;
+	if (m_events.size() < MAX_EVENTS)	m_events.push_back(e);
+	else								m_eventsDropped++;
+}
+
+void Profiler::AddCounter(const char* name, double value)
+{
+	if (!m_enabled || !m_capture) return;
+
+	ProfileCounter c;
+	c.name = name;
+	c.time = Now();
+	c.frame = m_frame.load(std::memory_order_relaxed);
+	c.value = value;
+	if (m_counters.size() < MAX_EVENTS)	m_counters.push_back(c);
+	else								m_eventsDropped++;
+}
+
+void Profiler::Collect()
+{
+	std::lock_guard<std::mutex> l(m_threadLock);
+
+	m_lastCPU.clear();
+	for (auto buffer : m_threads)
+	{
+		const UINT64 read = buffer->readPos.load(std::memory_order_relaxed);
+		const UINT64 write = buffer->writePos.load(std::memory_order_acquire);
+		for (UINT64 i = read; i < write; ++i)
+		{
+			const ProfileEvent& e = buffer->ring[i & (RING_SIZE - 1)];
+			m_lastCPU[e.name] += TicksToMS(e.end - e.begin);
+			if (m_eventCallback) m_eventCallback(e);
+			AddEvent(e);
+		}
+		// frees the slots for the owning thread
+		buffer->readPos.store(write, std::memory_order_release);
+	}
+}
+
+void Profiler::BeginFrame(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	m_gpuFrame = NULL;
+	m_gpuStack.clear();
+	if (!m_enabled || pd3dImmediateContext == NULL || m_gpuFrames[0].disjoint == NULL) return;
+
+	const UINT frameIndex = m_frame.load(std::memory_order_relaxed);
+	GPUFrame& frame = m_gpuFrames[frameIndex % GPU_FRAMES_IN_FLIGHT];
+	if (frame.pending && !ResolveGPUFrame(pd3dImmediateContext, frame, false))
+	{
+		// the gpu is more than GPU_FRAMES_IN_FLIGHT frames behind, this frame is not measured instead of waiting
+		m_gpuDropped++;
+		return;
+	}
+
+	frame.scopes.clear();
+	frame.frame = frameIndex;
+	frame.cpuBegin = Now();
+	pd3dImmediateContext->Begin(frame.disjoint);
+	pd3dImmediateContext->End(frame.queries[0]);
+	m_gpuFrame = &frame;
+}
+
+void Profiler::EndFrame(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	if (m_gpuFrame)
+	{
+		pd3dImmediateContext->End(m_gpuFrame->disjoint);
+		m_gpuFrame->pending = true;
+		m_gpuFrame = NULL;
+	}
+
+	// oldest first, stops at the first frame the gpu is still working on
+	if (pd3dImmediateContext)
+	{
+		const UINT frameIndex = m_frame.load(std::memory_order_relaxed);
+		for (UINT i = 1; i <= GPU_FRAMES_IN_FLIGHT; ++i)
+		{
+			GPUFrame& frame = m_gpuFrames[(frameIndex + i) % GPU_FRAMES_IN_FLIGHT];
+			if (frame.pending && !ResolveGPUFrame(pd3dImmediateContext, frame, false)) break;
+		}
+	}
+
+	Collect();
+	m_frame.fetch_add(1, std::memory_order_relaxed);
+
+	if (m_captureFrames > 0 && --m_captureFrames == 0)
+	{
+		Flush(pd3dImmediateContext);
+		m_capture = false;
+		WriteTrace(m_captureName + "_trace.json");
+		WriteSummary(m_captureName + "_summary.csv");
+		std::cout << "profile of " << m_captureName << " written, " << m_events.size() << " scopes" << std::endl;
+	}
+}
+
+void Profiler::Flush(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	if (pd3dImmediateContext)
+	{
+		const UINT frameIndex = m_frame.load(std::memory_order_relaxed);
+		for (UINT i = 0; i < GPU_FRAMES_IN_FLIGHT; ++i)
+		{
+			GPUFrame& frame = m_gpuFrames[(frameIndex + i) % GPU_FRAMES_IN_FLIGHT];
+			if (frame.pending) ResolveGPUFrame(pd3dImmediateContext, frame, true);
+		}
+	}
+	Collect();
+}
+
+bool Profiler::ResolveGPUFrame(ID3D11DeviceContext1* pd3dImmediateContext, GPUFrame& frame, bool wait)
+{
+	// without waiting the queries are only polled, no flush of the command buffer
+	const UINT flags = wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH;
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	HRESULT hr;
+	while ((hr = pd3dImmediateContext->GetData(frame.disjoint, &disjoint, sizeof(disjoint), flags)) == S_FALSE)
+	{
+		if (!wait) return false;
+		Sleep(0);
+	}
+	frame.pending = false;
+	if (FAILED(hr) || disjoint.Disjoint || disjoint.Frequency == 0)
+	{
+		m_gpuDropped += frame.scopes.size();
+		return true;
+	}
+
+	// the timestamps were issued before the end of the disjoint query, they are available
+	auto timestamp = [&](ID3D11Query* query)
+	{
+		UINT64 t = 0;
+		while (pd3dImmediateContext->GetData(query, &t, sizeof(t), 0) == S_FALSE) Sleep(0);
+		return t;
+	};
+
+	const UINT64 gpuBegin = timestamp(frame.queries[0]);
+	const double toCPU = (double)Frequency() / (double)disjoint.Frequency;
+
+	m_lastGPU.clear();
+	for (const GPUScope& scope : frame.scopes)
+	{
+		const UINT64 begin = timestamp(frame.queries[scope.query]);
+		const UINT64 end = timestamp(frame.queries[scope.query + 1]);
+		if (begin < gpuBegin || end < begin) continue;
+
+		// gpu timeline mapped onto the cpu timeline at the frame begin
+		ProfileEvent e;
+		e.name		= scope.name;
+		e.begin		= frame.cpuBegin + static_cast<UINT64>((begin - gpuBegin) * toCPU);
+		e.end		= frame.cpuBegin + static_cast<UINT64>((end - gpuBegin) * toCPU);
+		e.depth		= scope.depth;
+		e.thread	= GPU_THREAD;
+		e.frame		= frame.frame;
+		e.value		= scope.value;
+		m_lastGPU[e.name] += TicksToMS(e.end - e.begin);
+		if (m_eventCallback) m_eventCallback(e);
+		AddEvent(e);
+	}
+	return true;
+}
+
+void Profiler::BeginGPUScope(ID3D11DeviceContext1* pd3dImmediateContext, const char* name)
+{
+	if (m_gpuFrame == NULL) return;
+
+	if (m_gpuFrame->scopes.size() >= MAX_GPU_SCOPES)
+	{
+		m_gpuStack.push_back(static_cast<UINT>(DROPPED_SCOPE));
+		m_gpuDropped++;
+		return;
+	}
+
+	GPUScope scope;
+	scope.name = name;
+	scope.depth = static_cast<UINT>(m_gpuStack.size());
+	scope.query = 1 + 2 * static_cast<UINT>(m_gpuFrame->scopes.size());
+	scope.value = 0;
+	pd3dImmediateContext->End(m_gpuFrame->queries[scope.query]);
+
+	m_gpuStack.push_back(static_cast<UINT>(m_gpuFrame->scopes.size()));
+	m_gpuFrame->scopes.push_back(scope);
+}
+
+void Profiler::EndGPUScope(ID3D11DeviceContext1* pd3dImmediateContext)
+{
+	if (m_gpuFrame == NULL || m_gpuStack.empty()) return;
+
+	const UINT index = m_gpuStack.back();
+	m_gpuStack.pop_back();
+	if (index != DROPPED_SCOPE)
+		pd3dImmediateContext->End(m_gpuFrame->queries[m_gpuFrame->scopes[index].query + 1]);
+}
+
+void Profiler::AddGPUScopeValue(UINT64 value)
+{
+	if (m_gpuFrame == NULL || m_gpuStack.empty() || m_gpuStack.back() == DROPPED_SCOPE) return;
+	m_gpuFrame->scopes[m_gpuStack.back()].value += value;
+}
+
+double Profiler::GetLastMS(const std::string& name, bool gpu) const
+{
+	const std::map<std::string, double>& last = gpu ? m_lastGPU : m_lastCPU;
+	auto it = last.find(name);
+	return it != last.end() ? it->second : -1.0;
+}
+
+void Profiler::CaptureFrames(UINT numFrames, const std::string& baseName)
+{
+	Clear();
+	m_capture = numFrames > 0;
+	m_captureFrames = numFrames;
+	m_captureName = baseName;
+}
+
+void Profiler::Clear()
+{
+	m_events.clear();
+	m_counters.clear();
+	m_eventsDropped = 0;
+	m_gpuDropped = 0;
+
+	std::lock_guard<std::mutex> l(m_threadLock);
+	for (auto buffer : m_threads)
+		buffer->dropped.store(0, std::memory_order_relaxed);
+}
+
+UINT64 Profiler::GetNumDropped() const
+{
+	UINT64 dropped = m_eventsDropped + m_gpuDropped;
+	std::lock_guard<std::mutex> l(m_threadLock);
+	for (auto buffer : m_threads)
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
+
+double Profiler::TicksToMS(UINT64 ticks)
+{
+	return 1000.0 * (double)ticks / (double)Frequency();
+}
+
+HRESULT Profiler::WriteTrace(const std::string& fileName) const
+{
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "could not write profile trace " << fileName << std::endl;
+		return E_FAIL;
+	}
+
+	UINT64 base = UINT64(-1);
+	for (const ProfileEvent& e : m_events)
+		base = std::min(base, e.begin);
+	for (const ProfileCounter& c : m_counters)
+		base = std::min(base, c.time);
+
+	// thread names, then complete events with timestamps in microseconds
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[" << std::endl;
+	UINT numThreads;
+	{
+		std::lock_guard<std::mutex> l(m_threadLock);
+		numThreads = static_cast<UINT>(m_threads.size());
+	}
+	for (UINT i = 0; i < numThreads; ++i)
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":\"cpu " << i << "\"}}," << std::endl;
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << PROFILER_GPU_TRACE_TID << ",\"args\":{\"name\":\"gpu\"}}";
+
+	for (const ProfileEvent& e : m_events)
+	{
+		file << "," << std::endl << "{\"name\":\"" << EscapeJSON(e.name) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+			 << (e.thread == GPU_THREAD ? PROFILER_GPU_TRACE_TID : e.thread) << ",\"ts\":" << TicksToMS(e.begin - base) * 1000.0
+			 << ",\"dur\":" << TicksToMS(e.end - e.begin) * 1000.0 << ",\"args\":{\"frame\":" << e.frame << ",\"value\":" << e.value << "}}";
+	}
+	for (const ProfileCounter& c : m_counters)
+	{
+		file << "," << std::endl << "{\"name\":\"" << EscapeJSON(c.name) << "\",\"ph\":\"C\",\"pid\":0,\"ts\":" << TicksToMS(c.time - base) * 1000.0
+			 << ",\"args\":{\"value\":" << c.value << "}}";
+	}
+	file << std::endl << "]}" << std::endl;
+
+	return S_OK;
+}
+
+void Profiler::GetSummaries(std::vector<ProfileScopeSummary>& summaries) const
+{
+	// durations per scope name, cpu and gpu scopes of the same name are separate
+	std::map<std::pair<std::string, bool>, std::vector<double>> durations;
+	for (const ProfileEvent& e : m_events)
+		durations[std::make_pair(std::string(e.name), e.thread == GPU_THREAD)].push_back(TicksToMS(e.end - e.begin));
+
+	summaries.clear();
+	for (auto& it : durations)
+	{
+		std::vector<double>& d = it.second;
+		std::sort(d.begin(), d.end());
+
+		ProfileScopeSummary s;
+		s.name		= it.first.first;
+		s.gpu		= it.first.second;
+		s.count		= static_cast<UINT>(d.size());
+		s.totalMS	= 0.0;
+		for (double ms : d) s.totalMS += ms;
+		s.meanMS	= s.totalMS / d.size();
+		s.p50MS		= Percentile(d, 0.5);
+		s.p90MS		= Percentile(d, 0.9);
+		s.p99MS		= Percentile(d, 0.99);
+		s.maxMS		= d.back();
+		summaries.push_back(s);
+	}
+
+	std::sort(summaries.begin(), summaries.end(), [](const ProfileScopeSummary& a, const ProfileScopeSummary& b) { return a.totalMS > b.totalMS; });
+}
+
+HRESULT Profiler::WriteSummary(const std::string& fileName) const
+{
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "could not write profile summary " << fileName << std::endl;
+		return E_FAIL;
+	}
+
+	std::vector<ProfileScopeSummary> summaries;
+	GetSummaries(summaries);
+
+	file << "scope,gpu,count,total_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms" << std::endl;
+	for (const ProfileScopeSummary& s : summaries)
+	{
+		file << s.name << "," << (s.gpu ? 1 : 0) << "," << s.count << "," << s.totalMS << "," << s.meanMS << "," << s.p50MS << ","
+			 << s.p90MS << "," << s.p99MS << "," << s.maxMS << std::endl;
+	}
+	return S_OK;
+}
+
+void Profiler::PrintSummary() const
+{
+	std::vector<ProfileScopeSummary> summaries;
+	GetSummaries(summaries);
+
+	std::cout << std::endl;
+	for (const ProfileScopeSummary& s : summaries)
+	{
+		std::cout << (s.gpu ? "gpu " : "cpu ") << s.name << "\t" << s.count << "x, mean " << s.meanMS << " ms, p50 " << s.p50MS
+				  << " ms, p99 " << s.p99MS << " ms, max " << s.maxMS << " ms" << std::endl;
+	}
+	const UINT64 dropped = GetNumDropped();
+	if (dropped > 0)
+		std::cout << dropped << " scopes dropped" << std::endl;
+}
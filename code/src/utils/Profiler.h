@@ -0,0 +1,228 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+// hierarchical cpu/gpu profiler. cpu scopes can be opened on any thread, every thread writes its closed scopes into its own ring
+// buffer (single producer, the render thread collects them in EndFrame, no locks on the scope path). gpu scopes are timestamp
+// queries on the immediate context, resolved a few frames later without waiting for the gpu and mapped onto the cpu timeline
+// at the frame begin. the captured scopes can be written as chrome://tracing json and as per scope percentile summaries.
+// the thread buffers are found through a thread local pointer, so there is one profiler per process (g_profiler).
+
+// one closed scope, times in performance counter ticks
+struct ProfileEvent
+{
+	const char*	name;		// string literal or other persistent string
+	UINT64		begin;
+	UINT64		end;
+	UINT		depth;		// nesting level on its thread
+	UINT		thread;		// registration order of the thread, Profiler::GPU_THREAD for gpu scopes
+	UINT		frame;
+	UINT64		value;		// work done in the scope, see AddScopeValue
+};
+
+// sampled value, a counter track in the trace
+struct ProfileCounter
+{
+	const char*	name;		// string literal or other persistent string
+	UINT64		time;
+	UINT		frame;
+	double		value;
+};
+
+struct ProfileScopeSummary
+{
+	std::string	name;
+	bool		gpu;
+	UINT		count;
+	double		totalMS;
+	double		meanMS;
+	double		p50MS;
+	double		p90MS;
+	double		p99MS;
+	double		maxMS;
+};
+
+class Profiler
+{
+public:
+	static const UINT GPU_THREAD			= (UINT)-1;
+	static const UINT RING_SIZE				= 1 << 12;	// events per thread between two collections, power of two
+	static const UINT MAX_DEPTH				= 64;		// open scopes per thread
+	static const UINT GPU_FRAMES_IN_FLIGHT	= 4;		// frames until the gpu scopes of a frame have to be resolved
+	static const UINT MAX_GPU_SCOPES		= 512;		// per frame
+	static const UINT MAX_EVENTS			= 1 << 20;	// captured events
+
+	Profiler();
+	~Profiler();
+
+	// the gpu scopes need the device, the cpu scopes work without Create
+	HRESULT Create(ID3D11Device1* pd3dDevice);
+	void	Destroy();
+
+	void	SetEnabled(bool enable)		{ m_enabled = enable; }
+	bool	IsEnabled()			const	{ return m_enabled; }
+	// index of the current frame, ProfileEvent::frame of the scopes issued in it
+	UINT	GetFrame()			const	{ return m_frame.load(std::memory_order_relaxed); }
+
+	// frame boundaries on the render thread. EndFrame collects the cpu rings and resolves the finished gpu frames.
+	// the context may be NULL (cpu only).
+	void	BeginFrame(ID3D11DeviceContext1* pd3dImmediateContext);
+	void	EndFrame(ID3D11DeviceContext1* pd3dImmediateContext);
+	// moves the closed cpu scopes of all threads to the profiler
+	void	Collect();
+	// waits for the pending gpu frames and collects everything
+	void	Flush(ID3D11DeviceContext1* pd3dImmediateContext);
+
+	// cpu scopes, any thread, use PROFILE_SCOPE
+	void	BeginScope(const char* name);
+	void	EndScope();
+	// adds to the work counter of the innermost open scope of the calling thread
+	void	AddScopeValue(UINT64 value);
+
+	// gpu scopes on the immediate context between BeginFrame and EndFrame, use GPU_PROFILE_SCOPE
+	void	BeginGPUScope(ID3D11DeviceContext1* pd3dImmediateContext, const char* name);
+	void	EndGPUScope(ID3D11DeviceContext1* pd3dImmediateContext);
+	void	AddGPUScopeValue(UINT64 value);
+
+	// counter sample at the current time, render thread. only kept with capture, written as counter track to the trace
+	void	AddCounter(const char* name, double value);
+
+	// called on the render thread for every collected cpu and resolved gpu scope, also without capture
+	void	SetEventCallback(const std::function<void(const ProfileEvent&)>& callback) { m_eventCallback = callback; }
+
+	// summed duration of the scope in the last collected (cpu) or resolved (gpu) frame, -1 if it did not occur
+	double	GetLastMS(const std::string& name, bool gpu) const;
+
+	// keeps all collected events for WriteTrace and the summaries, otherwise only GetLastMS is updated
+	void	SetCapture(bool capture)	{ m_capture = capture; }
+	bool	GetCapture()		const	{ return m_capture; }
+	// captures the next frames and writes <baseName>_trace.json and <baseName>_summary.csv after the last one
+	void	CaptureFrames(UINT numFrames, const std::string& baseName);
+	void	Clear();
+
+	const std::vector<ProfileEvent>& GetEvents() const { return m_events; }
+	const std::vector<ProfileCounter>& GetCounters() const { return m_counters; }
+	UINT64	GetNumDropped()		const;		// scopes lost to full rings, the depth limit or the gpu query limit
+
+	// chrome://tracing json, one track per thread, one for the gpu and one per counter
+	HRESULT WriteTrace(const std::string& fileName) const;
+	// per scope name count, total, mean, p50, p90, p99 and max of the captured events
+	void	GetSummaries(std::vector<ProfileScopeSummary>& summaries) const;
+	HRESULT WriteSummary(const std::string& fileName) const;
+	void	PrintSummary() const;
+
+	static double TicksToMS(UINT64 ticks);
+
+protected:
+	struct ThreadBuffer
+	{
+		ThreadBuffer() : index(0), depth(0), writePos(0), readPos(0), dropped(0) { ring.resize(RING_SIZE); }
+
+		struct OpenScope { const char* name; UINT64 begin; UINT64 value; };
+
+		UINT						index;
+		UINT						depth;				// may exceed MAX_DEPTH, the deeper scopes are dropped
+		OpenScope					stack[MAX_DEPTH];
+		std::vector<ProfileEvent>	ring;
+		std::atomic<UINT64>			writePos;			// written by the owning thread
+		std::atomic<UINT64>			readPos;			// written by Collect
+		std::atomic<UINT64>			dropped;
+	};
+
+	struct GPUScope
+	{
+		const char*		name;
+		UINT			depth;
+		UINT			query;		// begin timestamp, the end timestamp is query + 1
+		UINT64			value;
+	};
+
+	struct GPUFrame
+	{
+		GPUFrame() : disjoint(NULL), pending(false), frame(0), cpuBegin(0) {}
+
+		ID3D11Query*				disjoint;
+		std::vector<ID3D11Query*>	queries;		// [0] frame begin, then begin/end pairs of the scopes
+		std::vector<GPUScope>		scopes;
+		bool						pending;
+		UINT						frame;
+		UINT64						cpuBegin;
+	};
+
+	static const UINT DROPPED_SCOPE = (UINT)-1;
+
+	ThreadBuffer*	GetThreadBuffer();
+	void			AddEvent(const ProfileEvent& e);
+	bool			ResolveGPUFrame(ID3D11DeviceContext1* pd3dImmediateContext, GPUFrame& frame, bool wait);
+
+	bool						m_enabled;
+	bool						m_capture;
+	std::atomic<UINT>			m_frame;
+
+	mutable std::mutex			m_threadLock;		// thread registration and collection
+	std::vector<ThreadBuffer*>	m_threads;
+
+	std::vector<ProfileEvent>	m_events;
+	std::vector<ProfileCounter>	m_counters;
+	std::map<std::string, double> m_lastCPU;
+	std::map<std::string, double> m_lastGPU;
+	UINT64						m_eventsDropped;
+	std::function<void(const ProfileEvent&)> m_eventCallback;
+
+	UINT						m_captureFrames;
+	std::string					m_captureName;
+
+	GPUFrame					m_gpuFrames[GPU_FRAMES_IN_FLIGHT];
+	GPUFrame*					m_gpuFrame;			// frame between BeginFrame and EndFrame, NULL if gpu profiling is off
+	std::vector<UINT>			m_gpuStack;			// open gpu scopes, DROPPED_SCOPE for dropped ones
+	UINT64						m_gpuDropped;
+};
+
+extern Profiler g_profiler;
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name) : m_active(g_profiler.IsEnabled())	{ if (m_active) g_profiler.BeginScope(name); }
+	~ProfileScope()														{ if (m_active) g_profiler.EndScope(); }
+private:
+	bool m_active;
+};
+
+class GPUProfileScope
+{
+public:
+	GPUProfileScope(ID3D11DeviceContext1* pd3dImmediateContext, const char* name) : m_context(g_profiler.IsEnabled() ? pd3dImmediateContext : NULL)
+	{
+		if (m_context) g_profiler.BeginGPUScope(m_context, name);
+	}
+	~GPUProfileScope() { if (m_context) g_profiler.EndGPUScope(m_context); }
+private:
+	ID3D11DeviceContext1* m_context;
+};
+
+#define PROFILE_CONCAT_INNER(a, b)	a##b
+#define PROFILE_CONCAT(a, b)		PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name)							ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define GPU_PROFILE_SCOPE(context, name)			GPUProfileScope PROFILE_CONCAT(_gpuProfileScope, __LINE__)(context, name)
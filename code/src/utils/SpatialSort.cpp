@@ -15,27 +15,44 @@
 
 #include "stdafx.h"
 #include "SpatialSort.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <cmath>
 // has to be last header
 #include "utils/DbgNew.h"
 
 using namespace DirectX;
+
+static const unsigned int GRID_CHUNK_SIZE			= 1 << 16;	// positions per job of the grid build
+static const unsigned int GRID_QUERY_CHUNK_SIZE		= 1 << 10;	// queries per job of the batch queries
+static const unsigned int GRID_BUCKET_BITS			= 10;		// coarse buckets of the parallel counting sort
+static const unsigned int GRID_NUM_BUCKETS			= 1 << GRID_BUCKET_BITS;
+static const unsigned int GRID_MAX_RESOLUTION		= 1024;		// cells per axis
+static const float		  GRID_POSITIONS_PER_CELL	= 2.0f;
+static const float		  GRID_IDENTICAL_EXTENT		= 1e-20f;	// larger than the 3d tolerance of FindIdenticalPositions
+
 // ------------------------------------------------------------------------------------------------
 // Constructs a spatially sorted representation from the given position array.
-SpatialSort::SpatialSort( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, unsigned int pElementOffset)
+SpatialSort::SpatialSort( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, unsigned int pElementOffset, SpatialSortBackend backend)
 
 	// define the reference plane. We choose some arbitrary vector away from all basic axises 
 	// in the hope that no model spreads all its vertices along this plane.
 	
 {
 	mPlaneNormal = XMVector3Normalize( XMVectorSet(0.8523f, 0.34321f, 0.5736f,0));	
+	mBackend = backend;
+	mGridResolution[0] = mGridResolution[1] = mGridResolution[2] = 0;
 	Fill(pPositions, pNumPositions, pElementOffset);
 }
 
 // ------------------------------------------------------------------------------------------------
-SpatialSort :: SpatialSort()
+SpatialSort :: SpatialSort(SpatialSortBackend backend)
 //: mPlaneNormal(0.8523f, 0.34321f, 0.5736f)
 {
 	mPlaneNormal = XMVector3Normalize( XMVectorSet(0.8523f, 0.34321f, 0.5736f,0));	
+	mBackend = backend;
+	mGridResolution[0] = mGridResolution[1] = mGridResolution[2] = 0;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -55,9 +72,216 @@ void SpatialSort::Fill( const XMFLOAT4A* pPositions, unsigned int pNumPositions,
 // ------------------------------------------------------------------------------------------------
 void SpatialSort :: Finalize()
 {
-	std::sort( mPositions.begin(), mPositions.end());
+	if (mBackend == SpatialSortBackend::GRID)
+		FinalizeGrid();
+	else
+		std::sort( mPositions.begin(), mPositions.end());
+}
+
+// ------------------------------------------------------------------------------------------------
+// Sorts the positions by cell of a uniform grid over their bounding box. The resolution aims at 
+// GRID_POSITIONS_PER_CELL positions per cell, flat axes get a single cell.
+void SpatialSort::FinalizeGrid()
+{
+	const unsigned int numPositions = (unsigned int)mPositions.size();
+	const unsigned int numChunks = (numPositions + GRID_CHUNK_SIZE - 1) / GRID_CHUNK_SIZE;
+
+	mGridMin = XMFLOAT3(0, 0, 0);
+	mGridInvCellSize = XMFLOAT3(0, 0, 0);
+	mGridResolution[0] = mGridResolution[1] = mGridResolution[2] = 1;
+	mCellOffsets.assign(2, 0);
+	mCellOffsets[1] = numPositions;
+	if (numPositions == 0)
+		return;
+
+	// bounding box
+	std::vector<XMFLOAT3> chunkMin(numChunks), chunkMax(numChunks);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			const UINT last = std::min(numPositions, (c + 1) * GRID_CHUNK_SIZE);
+			XMVECTOR vMin = XMLoadFloat4A(&mPositions[c * GRID_CHUNK_SIZE].mPosition);
+			XMVECTOR vMax = vMin;
+			for (UINT i = c * GRID_CHUNK_SIZE + 1; i < last; ++i)
+			{
+				XMVECTOR v = XMLoadFloat4A(&mPositions[i].mPosition);
+				vMin = XMVectorMin(vMin, v);
+				vMax = XMVectorMax(vMax, v);
+			}
+			XMStoreFloat3(&chunkMin[c], vMin);
+			XMStoreFloat3(&chunkMax[c], vMax);
+		}
+	});
+
+	XMVECTOR vMin = XMLoadFloat3(&chunkMin[0]);
+	XMVECTOR vMax = XMLoadFloat3(&chunkMax[0]);
+	for (UINT c = 1; c < numChunks; ++c)
+	{
+		vMin = XMVectorMin(vMin, XMLoadFloat3(&chunkMin[c]));
+		vMax = XMVectorMax(vMax, XMLoadFloat3(&chunkMax[c]));
+	}
+	XMFLOAT3 extent;
+	XMStoreFloat3(&mGridMin, vMin);
+	XMStoreFloat3(&extent, vMax - vMin);
+
+	// cell size from the volume (area, length) spanned by the non flat axes
+	const float ext[3] = { extent.x, extent.y, extent.z };
+	const float maxExtent = std::max(ext[0], std::max(ext[1], ext[2]));
+	const float targetCells = std::max(1.0f, numPositions / GRID_POSITIONS_PER_CELL);
+	float volume = 1.0f;
+	int numDims = 0;
+	for (int a = 0; a < 3; ++a)
+	{
+		if (ext[a] > maxExtent * 1e-6f)
+		{
+			volume *= ext[a] / maxExtent;
+			numDims++;
+		}
+	}
+
+	float invCellSize[3] = { 0.0f, 0.0f, 0.0f };
+	if (numDims > 0)
+	{
+		const float cellSize = maxExtent * std::pow(volume / targetCells, 1.0f / numDims);
+		for (int a = 0; a < 3; ++a)
+		{
+			if (ext[a] <= maxExtent * 1e-6f)
+				continue;
+			mGridResolution[a] = std::min(GRID_MAX_RESOLUTION, std::max(1u, (unsigned int)std::ceil(ext[a] / cellSize)));
+			invCellSize[a] = mGridResolution[a] / ext[a];
+		}
+	}
+	mGridInvCellSize = XMFLOAT3(invCellSize[0], invCellSize[1], invCellSize[2]);
+
+	const unsigned int numCells = mGridResolution[0] * mGridResolution[1] * mGridResolution[2];
+
+	// cell of each position and bucket histogram per chunk, buckets are contiguous ranges of cells
+	std::vector<unsigned int> cells(numPositions);
+	std::vector<unsigned int> chunkOffsets(numChunks * GRID_NUM_BUCKETS, 0);
+	auto bucketOf = [numCells](unsigned int cell) { return (unsigned int)((UINT64)cell * GRID_NUM_BUCKETS / numCells); };
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			unsigned int* counts = &chunkOffsets[c * GRID_NUM_BUCKETS];
+			const UINT last = std::min(numPositions, (c + 1) * GRID_CHUNK_SIZE);
+			for (UINT i = c * GRID_CHUNK_SIZE; i < last; ++i)
+			{
+				cells[i] = GetCell(mPositions[i].mPosition);
+				counts[bucketOf(cells[i])]++;
+			}
+		}
+	});
+
+	// bucket major offsets, the chunks of a bucket stay in input order
+	std::vector<unsigned int> bucketOffsets(GRID_NUM_BUCKETS + 1);
+	unsigned int offset = 0;
+	for (UINT b = 0; b < GRID_NUM_BUCKETS; ++b)
+	{
+		bucketOffsets[b] = offset;
+		for (UINT c = 0; c < numChunks; ++c)
+		{
+			const unsigned int count = chunkOffsets[c * GRID_NUM_BUCKETS + b];
+			chunkOffsets[c * GRID_NUM_BUCKETS + b] = offset;
+			offset += count;
+		}
+	}
+	bucketOffsets[GRID_NUM_BUCKETS] = offset;
+
+	std::vector<Entry> sorted(numPositions);
+	std::vector<unsigned int> sortedCells(numPositions);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			unsigned int* offsets = &chunkOffsets[c * GRID_NUM_BUCKETS];
+			const UINT last = std::min(numPositions, (c + 1) * GRID_CHUNK_SIZE);
+			for (UINT i = c * GRID_CHUNK_SIZE; i < last; ++i)
+			{
+				const unsigned int dst = offsets[bucketOf(cells[i])]++;
+				sorted[dst] = mPositions[i];
+				sortedCells[dst] = cells[i];
+			}
+		}
+	});
+
+	// counting sort of the cells within each bucket, fills the cell offsets of the bucket
+	mCellOffsets.resize(numCells + 1);
+	mCellOffsets[numCells] = numPositions;
+	g_workStealingPool.ParallelFor(GRID_NUM_BUCKETS, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT b = begin; b < end; ++b)
+		{
+			// first cell of the bucket: smallest cell with bucketOf(cell) == b
+			const unsigned int firstCell = (unsigned int)(((UINT64)b * numCells + GRID_NUM_BUCKETS - 1) / GRID_NUM_BUCKETS);
+			const unsigned int endCell = (unsigned int)(((UINT64)(b + 1) * numCells + GRID_NUM_BUCKETS - 1) / GRID_NUM_BUCKETS);
+			if (firstCell >= endCell)
+				continue;
+
+			const unsigned int first = bucketOffsets[b], last = bucketOffsets[b + 1];
+			for (unsigned int c = firstCell; c < endCell; ++c)
+				mCellOffsets[c] = 0;
+			for (unsigned int i = first; i < last; ++i)
+				mCellOffsets[sortedCells[i]]++;
+
+			unsigned int cellOffset = first;
+			for (unsigned int c = firstCell; c < endCell; ++c)
+			{
+				const unsigned int count = mCellOffsets[c];
+				mCellOffsets[c] = cellOffset;
+				cellOffset += count;
+			}
+
+			// stable scatter back into mPositions, the offsets advance to the cell ends
+			for (unsigned int i = first; i < last; ++i)
+				mPositions[mCellOffsets[sortedCells[i]]++] = sorted[i];
+			// restore the cell starts
+			for (unsigned int c = endCell; c-- > firstCell; )
+				mCellOffsets[c] = c > firstCell ? mCellOffsets[c - 1] : first;
+		}
+	});
+}
+
+// ------------------------------------------------------------------------------------------------
+unsigned int SpatialSort::GetCell( const XMFLOAT4A& pPosition) const
+{
+	const float p[3] = { pPosition.x, pPosition.y, pPosition.z };
+	const float gridMin[3] = { mGridMin.x, mGridMin.y, mGridMin.z };
+	const float invCellSize[3] = { mGridInvCellSize.x, mGridInvCellSize.y, mGridInvCellSize.z };
+
+	unsigned int cell[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		const float v = (p[a] - gridMin[a]) * invCellSize[a];
+		cell[a] = v >= 0.0f ? std::min(mGridResolution[a] - 1, (unsigned int)std::min(v, (float)GRID_MAX_RESOLUTION)) : 0;
+	}
+	return (cell[2] * mGridResolution[1] + cell[1]) * mGridResolution[0] + cell[0];
 }
 
+// ------------------------------------------------------------------------------------------------
+bool SpatialSort::GetCellRange( const XMFLOAT3& pMin, const XMFLOAT3& pMax, unsigned int poRange[6]) const
+{
+	const float boxMin[3] = { pMin.x, pMin.y, pMin.z };
+	const float boxMax[3] = { pMax.x, pMax.y, pMax.z };
+	const float gridMin[3] = { mGridMin.x, mGridMin.y, mGridMin.z };
+	const float invCellSize[3] = { mGridInvCellSize.x, mGridInvCellSize.y, mGridInvCellSize.z };
+
+	// same arithmetic as GetCell, so a position inside the box always lies in one of the cells.
+	// positions beyond the last cell are clamped into it, so only boxes below the grid miss
+	for (int a = 0; a < 3; ++a)
+	{
+		const float lo = (boxMin[a] - gridMin[a]) * invCellSize[a];
+		const float hi = (boxMax[a] - gridMin[a]) * invCellSize[a];
+		if (!(hi >= 0.0f))
+			return false;
+		poRange[a] = lo >= 0.0f ? std::min(mGridResolution[a] - 1, (unsigned int)std::min(lo, (float)GRID_MAX_RESOLUTION)) : 0;
+		poRange[a + 3] = std::min(mGridResolution[a] - 1, (unsigned int)std::min(hi, (float)GRID_MAX_RESOLUTION));
+	}
+	return true;
+}
+
+
 // ------------------------------------------------------------------------------------------------
 void SpatialSort::Append( const XMFLOAT4A* pPositions, unsigned int pNumPositions, unsigned int pElementOffset,	bool pFinalize /*= true */)
 {
@@ -86,14 +310,97 @@ void SpatialSort::Append( const XMFLOAT4A* pPositions, unsigned int pNumPosition
 // Returns an iterator for all positions close to the given position.
 void SpatialSort::FindPositions( const XMFLOAT4A& pPosition, float pRadius, std::vector<unsigned int>& poResults) const
 {
-	XMVECTOR pVec = XMLoadFloat4A(&pPosition);
-	
-	const float dist = XMVectorGetX(XMVector3Dot(mPlaneNormal, pVec));
-	const float minDist = dist - pRadius, maxDist = dist + pRadius;
-
 	// clear the array in this strange fashion because a simple clear() would also deallocate
     // the array which we want to avoid
 	poResults.erase( poResults.begin(), poResults.end());
+	AppendPositions(pPosition, pRadius, poResults);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Runs the queries in chunks, each chunk collects its results and the chunks are concatenated.
+void SpatialSort::FindPositions( const XMFLOAT4A* pPositions, unsigned int pNumPositions, float pRadius, 
+								 std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults) const
+{
+	FindBatch(pNumPositions, poOffsets, poResults, [&](unsigned int q, std::vector<unsigned int>& results)
+	{
+		AppendPositions(pPositions[q], pRadius, results);
+	});
+}
+
+// ------------------------------------------------------------------------------------------------
+void SpatialSort::FindBatch( unsigned int pNumQueries, std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults,
+							 const std::function<void(unsigned int, std::vector<unsigned int>&)>& pQuery) const
+{
+	const unsigned int numChunks = (pNumQueries + GRID_QUERY_CHUNK_SIZE - 1) / GRID_QUERY_CHUNK_SIZE;
+	std::vector<std::vector<unsigned int>> chunkResults(numChunks);
+
+	// local offsets within the chunk first
+	poOffsets.resize(pNumQueries + 1);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			const UINT last = std::min(pNumQueries, (c + 1) * GRID_QUERY_CHUNK_SIZE);
+			for (UINT q = c * GRID_QUERY_CHUNK_SIZE; q < last; ++q)
+			{
+				poOffsets[q] = (unsigned int)chunkResults[c].size();
+				pQuery(q, chunkResults[c]);
+			}
+		}
+	});
+
+	std::vector<unsigned int> chunkOffsets(numChunks + 1, 0);
+	for (unsigned int c = 0; c < numChunks; ++c)
+		chunkOffsets[c + 1] = chunkOffsets[c] + (unsigned int)chunkResults[c].size();
+	poOffsets[pNumQueries] = chunkOffsets[numChunks];
+
+	poResults.resize(chunkOffsets[numChunks]);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			const UINT last = std::min(pNumQueries, (c + 1) * GRID_QUERY_CHUNK_SIZE);
+			for (UINT q = c * GRID_QUERY_CHUNK_SIZE; q < last; ++q)
+				poOffsets[q] += chunkOffsets[c];
+			if (!chunkResults[c].empty())
+				memcpy(&poResults[chunkOffsets[c]], &chunkResults[c][0], chunkResults[c].size() * sizeof(unsigned int));
+		}
+	});
+}
+
+// ------------------------------------------------------------------------------------------------
+void SpatialSort::AppendPositions( const XMFLOAT4A& pPosition, float pRadius, std::vector<unsigned int>& poResults) const
+{
+	XMVECTOR pVec = XMLoadFloat4A(&pPosition);
+	const float pSquared = pRadius*pRadius;
+
+	if (mBackend == SpatialSortBackend::GRID)
+	{
+		// visit all cells overlapping the box around the sphere, in cell order
+		unsigned int range[6];
+		const XMFLOAT3 boxMin(pPosition.x - pRadius, pPosition.y - pRadius, pPosition.z - pRadius);
+		const XMFLOAT3 boxMax(pPosition.x + pRadius, pPosition.y + pRadius, pPosition.z + pRadius);
+		if (mPositions.size() == 0 || !GetCellRange(boxMin, boxMax, range))
+			return;
+
+		for (unsigned int z = range[2]; z <= range[5]; ++z)
+		{
+			for (unsigned int y = range[1]; y <= range[4]; ++y)
+			{
+				const unsigned int row = (z * mGridResolution[1] + y) * mGridResolution[0];
+				const unsigned int first = mCellOffsets[row + range[0]], last = mCellOffsets[row + range[3] + 1];
+				for (unsigned int i = first; i < last; ++i)
+				{
+					if (XMVectorGetX(XMVector3LengthSq(XMLoadFloat4A(&mPositions[i].mPosition) - pVec)) < pSquared)
+						poResults.push_back(mPositions[i].mIndex);
+				}
+			}
+		}
+		return;
+	}
+
+	const float dist = XMVectorGetX(XMVector3Dot(mPlaneNormal, pVec));
+	const float minDist = dist - pRadius, maxDist = dist + pRadius;
 
 	// quick check for positions outside the range
 	if( mPositions.size() == 0)
@@ -126,7 +433,6 @@ void SpatialSort::FindPositions( const XMFLOAT4A& pPosition, float pRadius, std:
 	// Mow start iterating from there until the first position lays outside of the distance range.
 	// Add all positions inside the distance range within the given radius to the result aray
 	std::vector<Entry>::const_iterator it = mPositions.begin() + index;
-	const float pSquared = pRadius*pRadius;
 
 	XMVECTOR itVPos;
 	while( it->mDistance < maxDist)
@@ -155,6 +461,18 @@ namespace {
 	//	comparisons on many platforms).
 	typedef signed int BinFloat;
 
+	// tolerances of FindIdenticalPositions and IsIdenticalPosition
+	const int toleranceInULPs = 4;
+	// An interesting point is that the inaccuracy grows linear with the number of operations:
+	//	multiplying to numbers, each inaccurate to four ULPs, results in an inaccuracy of four ULPs
+	//	plus 0.5 ULPs for the multiplication.
+	// To compute the distance to the plane, a dot product is needed - that is a multiplication and
+	//	an addition on each number.
+	const int distanceToleranceInULPs = toleranceInULPs + 1;
+	// The squared distance between two 3D vectors is computed the same way, but with an additional
+	//	subtraction.
+	const int distance3DToleranceInULPs = distanceToleranceInULPs + 1;
+
 	// --------------------------------------------------------------------------------------------
 	// Converts the bit pattern of a floating-point number to its signed integer representation.
 	BinFloat ToBinary( const float & pValue) {
@@ -209,6 +527,50 @@ namespace {
 // FindPositions(), not an epsilon is used but a (very low) tolerance of four floating-point units.
 void SpatialSort::FindIdenticalPositions( const XMFLOAT4A& pPosition, std::vector<unsigned int>& poResults) const
 {
+	// clear the array in this strange fashion because a simple clear() would also deallocate
+    // the array which we want to avoid
+	poResults.erase( poResults.begin(), poResults.end());
+	AppendIdenticalPositions(pPosition, poResults);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SpatialSort::FindIdenticalPositions( const XMFLOAT4A* pPositions, unsigned int pNumPositions, 
+										  std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults) const
+{
+	FindBatch(pNumPositions, poOffsets, poResults, [&](unsigned int q, std::vector<unsigned int>& results)
+	{
+		AppendIdenticalPositions(pPositions[q], results);
+	});
+}
+
+// ------------------------------------------------------------------------------------------------
+void SpatialSort::AppendIdenticalPositions( const XMFLOAT4A& pPosition, std::vector<unsigned int>& poResults) const
+{
+	if (mBackend == SpatialSortBackend::GRID)
+	{
+		// identical positions are closer than GRID_IDENTICAL_EXTENT on each axis, so they lie in the cells of this box
+		unsigned int range[6];
+		const XMFLOAT3 boxMin(pPosition.x - GRID_IDENTICAL_EXTENT, pPosition.y - GRID_IDENTICAL_EXTENT, pPosition.z - GRID_IDENTICAL_EXTENT);
+		const XMFLOAT3 boxMax(pPosition.x + GRID_IDENTICAL_EXTENT, pPosition.y + GRID_IDENTICAL_EXTENT, pPosition.z + GRID_IDENTICAL_EXTENT);
+		if (mPositions.size() == 0 || !GetCellRange(boxMin, boxMax, range))
+			return;
+
+		for (unsigned int z = range[2]; z <= range[5]; ++z)
+		{
+			for (unsigned int y = range[1]; y <= range[4]; ++y)
+			{
+				const unsigned int row = (z * mGridResolution[1] + y) * mGridResolution[0];
+				const unsigned int first = mCellOffsets[row + range[0]], last = mCellOffsets[row + range[3] + 1];
+				for (unsigned int i = first; i < last; ++i)
+				{
+					if (IsIdenticalPosition(pPosition, mPositions[i].mPosition))
+						poResults.push_back(mPositions[i].mIndex);
+				}
+			}
+		}
+		return;
+	}
+
 	// Epsilons have a huge disadvantage: they are of constant precision, while floating-point
 	//	values are of log2 precision. If you apply e=0.01 to 100, the epsilon is rather small, but
 	//	if you apply it to 0.001, it is enormous.
@@ -220,17 +582,7 @@ void SpatialSort::FindIdenticalPositions( const XMFLOAT4A& pPosition, std::vecto
 	// For standard C math, we can assume a precision of 0.5 ULPs according to IEEE 754. The
 	//	incoming vertex positions might have already been transformed, probably using rather
 	//	inaccurate SSE instructions, so we assume a tolerance of 4 ULPs to safely identify
-	//	identical vertex positions.
-	static const int toleranceInULPs = 4;
-	// An interesting point is that the inaccuracy grows linear with the number of operations:
-	//	multiplying to numbers, each inaccurate to four ULPs, results in an inaccuracy of four ULPs
-	//	plus 0.5 ULPs for the multiplication.
-	// To compute the distance to the plane, a dot product is needed - that is a multiplication and
-	//	an addition on each number.
-	static const int distanceToleranceInULPs = toleranceInULPs + 1;
-	// The squared distance between two 3D vectors is computed the same way, but with an additional
-	//	subtraction.
-	static const int distance3DToleranceInULPs = distanceToleranceInULPs + 1;
+	//	identical vertex positions (see the tolerances above ToBinary).
 
 	// Convert the plane distance to its signed integer representation so the ULPs tolerance can be
 	//	applied. For some reason, VC won't optimize two calls of the bit pattern conversion.
@@ -238,10 +590,6 @@ void SpatialSort::FindIdenticalPositions( const XMFLOAT4A& pPosition, std::vecto
 	XMVECTOR pPos = XMLoadFloat4A(&pPosition);
 	const BinFloat minDistBinary = ToBinary( XMVectorGetX(XMVector3Dot(pPos,mPlaneNormal))) - distanceToleranceInULPs;
 	const BinFloat maxDistBinary = minDistBinary + 2 * distanceToleranceInULPs;
-	
-	// clear the array in this strange fashion because a simple clear() would also deallocate
-    // the array which we want to avoid
-	poResults.erase( poResults.begin(), poResults.end());
 
 	// do a binary search for the minimal distance to start the iteration there
 	unsigned int index = (unsigned int)mPositions.size() / 2;
@@ -283,9 +631,47 @@ void SpatialSort::FindIdenticalPositions( const XMFLOAT4A& pPosition, std::vecto
 	// that's it
 }
 
+// ------------------------------------------------------------------------------------------------
+// Pairwise test of FindIdenticalPositions, for callers which find the candidates themselves.
+bool SpatialSort::IsIdenticalPosition(const XMFLOAT4A& pPosition, const XMFLOAT4A& pOther) const
+{
+	XMVECTOR pPos = XMLoadFloat4A(&pPosition);
+	XMVECTOR oPos = XMLoadFloat4A(&pOther);
+
+	const BinFloat distBinary = ToBinary(XMVectorGetX(XMVector3Dot(pPos, mPlaneNormal)));
+	const BinFloat otherDistBinary = ToBinary(XMVectorGetX(XMVector3Dot(oPos, mPlaneNormal)));
+	if (otherDistBinary < distBinary - distanceToleranceInULPs || otherDistBinary >= distBinary + distanceToleranceInULPs)
+		return false;
+
+	return distance3DToleranceInULPs >= ToBinary(XMVectorGetX(XMVector3LengthSq(oPos - pPos)));
+}
+
 // ------------------------------------------------------------------------------------------------
 unsigned int SpatialSort::GenerateMappingTable(std::vector<unsigned int>& fill,float pRadius) const
 {
+	if (mBackend == SpatialSortBackend::GRID)
+	{
+		fill.assign(mPositions.size(), UINT_MAX);
+
+		unsigned int t = 0;
+		std::vector<unsigned int> neighbors;
+		for (size_t i = 0; i < mPositions.size(); ++i)
+		{
+			if (fill[mPositions[i].mIndex] != UINT_MAX)
+				continue;
+
+			fill[mPositions[i].mIndex] = t;
+			FindPositions(mPositions[i].mPosition, pRadius, neighbors);
+			for (size_t n = 0; n < neighbors.size(); ++n)
+			{
+				if (fill[neighbors[n]] == UINT_MAX)
+					fill[neighbors[n]] = t;
+			}
+			++t;
+		}
+		return t;
+	}
+
 	fill.resize(mPositions.size(),UINT_MAX);
 	float dist, maxDist;
 	
@@ -17,8 +17,17 @@
 
 // based on assimp lib spatial sort
 #include <vector>
+#include <functional>
 #include <DXUT.h>
 
+// index behind the queries: the assimp sort by distance to a reference plane, or a uniform grid over the bounding box
+// which stays O(1) per query on inputs spread along the plane (flat terrain)
+enum class SpatialSortBackend
+{
+	PLANE = 0,
+	GRID
+};
+
 // ------------------------------------------------------------------------------------------------
 /** A little helper class to quickly find all vertices in the epsilon environment of a given
  * position. Construct an instance with an array of positions. The class stores the given positions
@@ -31,7 +40,7 @@ class SpatialSort
 {
 public:
 
-	SpatialSort();
+	SpatialSort(SpatialSortBackend backend = SpatialSortBackend::PLANE);
 
 	// ------------------------------------------------------------------------------------
 	/** Constructs a spatially sorted representation from the given position array.
@@ -41,7 +50,7 @@ public:
 	 * @param pNumPositions Number of vectors to expect in that array.
 	 * @param pElementOffset Offset in bytes from the beginning of one vector in memory 
 	 *   to the beginning of the next vector. */
-	SpatialSort( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, unsigned int pElementOffset);
+	SpatialSort( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, unsigned int pElementOffset, SpatialSortBackend backend = SpatialSortBackend::PLANE);
 
 	/** Destructor */
 	~SpatialSort();
@@ -76,6 +85,8 @@ public:
 	 *  can be called to query the spatial sort.*/
 	void Finalize();
 
+	SpatialSortBackend GetBackend() const { return mBackend; }
+
 	// ------------------------------------------------------------------------------------
 	/** Returns an iterator for all positions close to the given position.
 	 * @param pPosition The position to look for vertices.
@@ -85,6 +96,14 @@ public:
 	 * @return An iterator to iterate over all vertices in the given area.*/
 	void FindPositions( const DirectX::XMFLOAT4A& pPosition, float pRadius, std::vector<unsigned int>& poResults) const;
 
+	// ------------------------------------------------------------------------------------
+	/** Batch version of FindPositions, the queries run in parallel on the work stealing pool.
+	 * The results of a query are ordered by plane distance (PLANE) or by grid cell (GRID).
+	 * @param poOffsets numQueries + 1 entries, the results of query i are poResults[poOffsets[i]..poOffsets[i+1]).
+	 * @param poResults Indices of the found positions of all queries (CSR). */
+	void FindPositions( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, float pRadius, 
+						std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults) const;
+
 	// ------------------------------------------------------------------------------------
 	/** Fills an array with indices of all positions indentical to the given position. In
 	 *  opposite to FindPositions(), not an epsilon is used but a (very low) tolerance of
@@ -94,6 +113,16 @@ public:
 	 *   Will be emptied by the call so it may contain anything.*/
 	void FindIdenticalPositions( const DirectX::XMFLOAT4A& pPosition, std::vector<unsigned int>& poResults) const;
 
+	// ------------------------------------------------------------------------------------
+	/** Batch version of FindIdenticalPositions with the CSR output of the batch FindPositions. */
+	void FindIdenticalPositions( const DirectX::XMFLOAT4A* pPositions, unsigned int pNumPositions, 
+								 std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults) const;
+
+	// ------------------------------------------------------------------------------------
+	/** Returns whether FindIdenticalPositions(pPosition) would report pOther, same plane
+	 *  distance and 3D tolerances. Does not need the sorted data. */
+	bool IsIdenticalPosition( const DirectX::XMFLOAT4A& pPosition, const DirectX::XMFLOAT4A& pOther) const;
+
 	// ------------------------------------------------------------------------------------
 	/** Compute a table that maps each vertex ID referring to a spatially close
 	 *  enough position to the same output ID. Output IDs are assigned in ascending order
@@ -101,13 +130,38 @@ public:
 	 * @param fill Will be filled with numPositions entries. 
 	 * @param pRadius Maximal distance from the position a vertex may have to
 	 *   be counted in.
+	 *  The grid backend assigns the ids greedily in grid order: every position which is not 
+	 *  mapped yet starts a new id and takes all unmapped positions within the radius.
 	 *  @return Number of unique vertices (n).  */
 	unsigned int GenerateMappingTable(std::vector<unsigned int>& fill, float pRadius) const;
 
 protected:
+	// single queries of both backends, append to poResults
+	void AppendPositions( const DirectX::XMFLOAT4A& pPosition, float pRadius, std::vector<unsigned int>& poResults) const;
+	void AppendIdenticalPositions( const DirectX::XMFLOAT4A& pPosition, std::vector<unsigned int>& poResults) const;
+
+	// runs pQuery(query, chunkResults) for all queries in parallel and concatenates the results
+	void FindBatch( unsigned int pNumQueries, std::vector<unsigned int>& poOffsets, std::vector<unsigned int>& poResults,
+					const std::function<void(unsigned int, std::vector<unsigned int>&)>& pQuery) const;
+
+	// sorts the positions by grid cell, parallel counting sort
+	void FinalizeGrid();
+
+	// inclusive cell range of the box [pMin, pMax], false if it misses the grid
+	bool GetCellRange( const DirectX::XMFLOAT3& pMin, const DirectX::XMFLOAT3& pMax, unsigned int poRange[6]) const;
+	unsigned int GetCell( const DirectX::XMFLOAT4A& pPosition) const;
+
 	/** Normal of the sorting plane, normalized. The center is always at (0, 0, 0) */
 	DirectX::XMVECTOR mPlaneNormal;
 
+	SpatialSortBackend mBackend;
+
+	// grid backend, mPositions are sorted by cell
+	DirectX::XMFLOAT3 mGridMin;
+	DirectX::XMFLOAT3 mGridInvCellSize;
+	unsigned int mGridResolution[3];
+	std::vector<unsigned int> mCellOffsets;		///< numCells + 1, entries of cell c are mPositions[mCellOffsets[c]..mCellOffsets[c+1])
+
 	/** An entry in a spatially sorted position array. Consists of a vertex index,
 	 * its position and its precalculated distance from the reference plane */
 	struct Entry
@@ -0,0 +1,168 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "TaskGraph.h"
+#include "Timer.h"
+#include "Profiler.h"
+
+TaskGraph::TaskGraph(WorkStealingPool* pool)
+{
+	m_pool = pool;
+	m_remaining = 0;
+	m_tracing = false;
+	m_executeStartMS = 0;
+	m_lastExecuteMS = 0;
+}
+
+TaskGraph::~TaskGraph()
+{
+	Clear();
+}
+
+TaskID TaskGraph::AddTask(const char* name, const TaskFunc& func, bool mainThread)
+{
+	Task* task = new Task();
+	task->name = name;
+	task->func = func;
+	task->mainThread = mainThread;
+	task->numDependencies = 0;
+	task->pending = 0;
+
+	m_tasks.push_back(task);
+	return static_cast<TaskID>(m_tasks.size() - 1);
+}
+
+void TaskGraph::AddDependency(TaskID task, TaskID dependsOn)
+{
+	assert(task < m_tasks.size() && dependsOn < m_tasks.size() && task != dependsOn);
+	m_tasks[dependsOn]->successors.push_back(task);
+	m_tasks[task]->numDependencies++;
+}
+
+void TaskGraph::Clear()
+{
+	for (auto task : m_tasks)
+		SAFE_DELETE(task);
+	m_tasks.clear();
+}
+
+void TaskGraph::Schedule(TaskID task)
+{
+	if (m_tasks[task]->mainThread)
+	{
+		std::lock_guard<std::mutex> l(m_mainThreadLock);
+		m_mainThreadReady.push_back(task);
+	}
+	else
+	{
+		m_pool->Submit([this, task]{ Run(task); }, &m_jobs);
+	}
+}
+
+void TaskGraph::Run(TaskID task)
+{
+	Task* t = m_tasks[task];
+
+	double start = m_tracing ? GetTimeMS() : 0;
+	{
+		PROFILE_SCOPE(t->name);
+		t->func();
+	}
+
+	if (m_tracing)
+	{
+		TaskTraceEvent e;
+		e.name = t->name;
+		e.threadIndex = m_pool->GetThreadIndex();
+		e.startMS = start - m_executeStartMS;
+		e.endMS = GetTimeMS() - m_executeStartMS;
+
+		std::lock_guard<std::mutex> l(m_traceLock);
+		m_trace.push_back(e);
+	}
+
+	for (auto successor : t->successors)
+	{
+		if (--m_tasks[successor]->pending == 0)
+			Schedule(successor);
+	}
+	m_remaining--;
+}
+
+void TaskGraph::Execute()
+{
+	if (m_tasks.empty()) return;
+
+	m_executeStartMS = GetTimeMS();
+	if (m_tracing) m_trace.clear();
+
+	m_remaining = static_cast<int>(m_tasks.size());
+	for (auto task : m_tasks)
+		task->pending = static_cast<int>(task->numDependencies);
+
+	for (TaskID i = 0; i < m_tasks.size(); ++i)
+	{
+		if (m_tasks[i]->numDependencies == 0)
+			Schedule(i);
+	}
+
+	while (m_remaining > 0)
+	{
+		TaskID task = INVALID_TASK;
+		{
+			std::lock_guard<std::mutex> l(m_mainThreadLock);
+			if (!m_mainThreadReady.empty())
+			{
+				task = m_mainThreadReady.back();
+				m_mainThreadReady.pop_back();
+			}
+		}
+
+		if (task != INVALID_TASK)
+			Run(task);
+		else if (!m_pool->TryRunOne())
+			std::this_thread::yield();
+	}
+
+	// the last job may still be between Run and its counter decrement
+	m_pool->Wait(&m_jobs);
+
+	m_lastExecuteMS = GetTimeMS() - m_executeStartMS;
+}
+
+HRESULT TaskGraph::WriteTrace(const std::string& fileName) const
+{
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "could not write task trace " << fileName << std::endl;
+		return E_FAIL;
+	}
+
+	// complete events, timestamps in microseconds
+	file << "{\"traceEvents\":[" << std::endl;
+	for (size_t i = 0; i < m_trace.size(); ++i)
+	{
+		const TaskTraceEvent& e = m_trace[i];
+		file << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.threadIndex
+			 << ",\"ts\":" << e.startMS * 1000.0 << ",\"dur\":" << (e.endMS - e.startMS) * 1000.0 << "}"
+			 << (i + 1 < m_trace.size() ? "," : "") << std::endl;
+	}
+	file << "]}" << std::endl;
+
+	return S_OK;
+}
@@ -0,0 +1,94 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include "WorkStealingPool.h"
+
+typedef UINT TaskID;
+
+// one executed task, times relative to the start of TaskGraph::Execute
+struct TaskTraceEvent
+{
+	const char*	name;
+	UINT		threadIndex;
+	double		startMS;
+	double		endMS;
+};
+
+// dependency graph of jobs executed on the work stealing pool. tasks become ready when all tasks they depend on are done.
+// main thread tasks (d3d context, ui state) are only run by the thread that calls Execute, which also helps with the pool jobs while waiting.
+// the graph is kept after Execute, so a graph which does not change can be executed every frame.
+class TaskGraph
+{
+public:
+	typedef std::function<void()> TaskFunc;
+	static const TaskID INVALID_TASK = (TaskID)-1;
+
+	TaskGraph(WorkStealingPool* pool = &g_workStealingPool);
+	~TaskGraph();
+
+	TaskID	AddTask(const char* name, const TaskFunc& func, bool mainThread = false);
+	void	AddDependency(TaskID task, TaskID dependsOn);
+	void	Clear();
+
+	// blocks until all tasks are done
+	void	Execute();
+
+	UINT	GetNumTasks()		const	{ return static_cast<UINT>(m_tasks.size()); }
+	double	GetLastExecuteMS()	const	{ return m_lastExecuteMS; }
+
+	// per task timings of the next Execute calls
+	void	SetTracing(bool enable)		{ m_tracing = enable; }
+	bool	GetTracing()		const	{ return m_tracing; }
+	const std::vector<TaskTraceEvent>& GetTrace() const { return m_trace; }
+
+	// chrome://tracing json
+	HRESULT WriteTrace(const std::string& fileName) const;
+
+private:
+	struct Task
+	{
+		const char*				name;
+		TaskFunc				func;
+		bool					mainThread;
+		UINT					numDependencies;
+		std::vector<TaskID>		successors;
+		std::atomic<int>		pending;
+	};
+
+	void	Schedule(TaskID task);
+	void	Run(TaskID task);
+
+	WorkStealingPool*			m_pool;
+	std::vector<Task*>			m_tasks;
+
+	JobCounter					m_jobs;
+	std::atomic<int>			m_remaining;
+
+	std::mutex					m_mainThreadLock;
+	std::vector<TaskID>			m_mainThreadReady;
+
+	bool						m_tracing;
+	std::mutex					m_traceLock;
+	std::vector<TaskTraceEvent>	m_trace;
+	double						m_executeStartMS;
+	double						m_lastExecuteMS;
+};
@@ -0,0 +1,223 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "TimingLog.h"
+
+#include <fstream>
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const char* g_timingStageNames[] = { "draw_tri", "draw_subd", "voxelization", "culling", "culling_temporal", "temporal_query",
+											"raycast", "compact_visibility", "overlap", "gpu_subdiv", "allocation" };
+static const char* g_timingWorkUnits[]	= { "draws", "draws", "draws", "patches", "patches", "patches",
+											"penetrators", "ptex_faces", "ptex_faces", "ptex_faces", "tiles_allocated" };
+static_assert(ARRAYSIZE(g_timingStageNames) == static_cast<UINT>(TimingStage::NUM_STAGES), "stage names do not match TimingStage");
+static_assert(ARRAYSIZE(g_timingWorkUnits) == static_cast<UINT>(TimingStage::NUM_STAGES), "work units do not match TimingStage");
+
+const char* TimingLog::getStageName(TimingStage stage)
+{
+	return g_timingStageNames[static_cast<UINT>(stage)];
+}
+
+const char* TimingLog::getWorkUnit(TimingStage stage)
+{
+	return g_timingWorkUnits[static_cast<UINT>(stage)];
+}
+
+void TimingLog::onProfileEvent(const ProfileEvent& e)
+{
+	for (UINT i = 0; i < static_cast<UINT>(TimingStage::NUM_STAGES); ++i)
+	{
+		if (e.name != g_timingStageNames[i]) continue;
+
+		m_stages[i].latency.Record(Profiler::TicksToMS(e.end - e.begin));
+		m_stages[i].work += e.value;
+
+		if (i == static_cast<UINT>(TimingStage::ALLOCATION))
+		{
+			auto pending = m_allocationTilesPending.find(e.frame);
+			if (pending != m_allocationTilesPending.end())
+			{
+				m_stages[i].work += pending->second;
+				m_allocationTilesPending.erase(pending);
+			}
+			m_allocationFramesResolved.insert(e.frame);
+			pruneAllocationFrames(e.frame);
+		}
+		return;
+	}
+}
+
+void TimingLog::addTilesAllocated(UINT frame, UINT64 numTiles)
+{
+	m_uTilesAllocated += numTiles;
+	if (m_allocationFramesResolved.count(frame) > 0)
+		m_stages[static_cast<UINT>(TimingStage::ALLOCATION)].work += numTiles;
+	else
+		m_allocationTilesPending[frame] += numTiles;
+	pruneAllocationFrames(frame);
+}
+
+void TimingLog::pruneAllocationFrames(UINT frame)
+{
+	// older frames are either matched or their scope was dropped, the pending tiles stay out of the work
+	if (frame < ALLOCATION_FRAME_WINDOW) return;
+	const UINT oldest = frame - ALLOCATION_FRAME_WINDOW;
+	m_allocationTilesPending.erase(m_allocationTilesPending.begin(), m_allocationTilesPending.lower_bound(oldest));
+	m_allocationFramesResolved.erase(m_allocationFramesResolved.begin(), m_allocationFramesResolved.lower_bound(oldest));
+}
+
+bool TimingLog::hasTimings() const
+{
+	for (const auto& stage : m_stages)
+	{
+		if (stage.latency.GetCount() > 0) return true;
+	}
+	return false;
+}
+
+void TimingLog::resetTimings()
+{
+	for (auto& stage : m_stages)
+	{
+		stage.latency.Reset();
+		stage.work = 0;
+	}
+
+	m_uTemporalIncremental = 0;
+	m_uTemporalFallback = 0;
+	m_uTemporalCandidatePatches = 0;
+	m_uTemporalTotalPatches = 0;
+	m_uTemporalValidated = 0;
+	m_uTemporalMismatches = 0;
+	m_uComputeValidated = 0;
+	m_uComputeMismatches = 0;
+	m_uOverlapDirtyEdges = 0;
+	m_uOverlapDirtyCornerFaces = 0;
+	m_uOverlapDirtyCount = 0;
+	m_uTilesAllocated = 0;
+	m_allocationTilesPending.clear();
+	m_allocationFramesResolved.clear();
+	m_uDeformStatsFrames = 0;
+	m_uDeformTexels = 0;
+	m_uDeformRays = 0;
+	m_uDeformDDASteps = 0;
+	m_uDeformTexelsWritten = 0;
+	m_uDeformTexelsChanged = 0;
+}
+
+void TimingLog::printTimings() const
+{
+	std::cout << std::endl;
+	for (UINT i = 0; i < static_cast<UINT>(TimingStage::NUM_STAGES); ++i)
+	{
+		const TimingStageStats& s = m_stages[i];
+		if (s.latency.GetCount() == 0) continue;
+
+		std::cout << g_timingStageNames[i] << "\t" << s.latency.GetCount() << "x, p50 " << s.latency.GetPercentileMS(50) << " ms, p95 "
+				  << s.latency.GetPercentileMS(95) << " ms, p99 " << s.latency.GetPercentileMS(99) << " ms, max " << s.latency.GetMaxMS() << " ms";
+		if (s.work > 0)
+			std::cout << ", " << 1e6 * s.latency.GetTotalMS() / s.work << " ns per " << g_timingWorkUnits[i];
+		std::cout << std::endl;
+	}
+	if (m_uTemporalIncremental + m_uTemporalFallback > 0)
+	{
+		std::cout << "Temporal Incremental\t" << m_uTemporalIncremental << " / " << m_uTemporalIncremental + m_uTemporalFallback << " batches, "
+				  << 100.0*m_uTemporalCandidatePatches/(double)m_uTemporalTotalPatches << " % patches tested" << std::endl;
+	}
+	if (m_uTemporalValidated > 0)
+	{
+		std::cout << "Temporal Validation	" << m_uTemporalMismatches << " / " << m_uTemporalValidated << " batches differ from the full test" << std::endl;
+	}
+	if (m_uComputeValidated > 0)
+	{
+		std::cout << "Compute Validation\t" << m_uComputeMismatches << " / " << m_uComputeValidated << " batches differ from d3d11" << std::endl;
+	}
+	if (m_uOverlapDirtyCount > 0)
+	{
+		std::cout << "Overlap Dirty\t\t" << m_uOverlapDirtyEdges/(double)m_uOverlapDirtyCount << " edges, "
+				  << m_uOverlapDirtyCornerFaces/(double)m_uOverlapDirtyCount << " corner faces per update" << std::endl;
+	}
+	if (m_uTilesAllocated > 0)
+		std::cout << "Tiles Allocated\t" << m_uTilesAllocated << std::endl;
+	if (m_uDeformStatsFrames > 0)
+	{
+		// the counters are resolved a few frames after the raycast timings, the cost per ray is an estimate over the whole run
+		const TimingStageStats& raycast = m_stages[static_cast<UINT>(TimingStage::RAYCAST)];
+		std::cout << "Deformation\t\t" << m_uDeformRays/(double)m_uDeformStatsFrames << " rays, "
+				  << (m_uDeformRays > 0 ? m_uDeformDDASteps/(double)m_uDeformRays : 0.0) << " dda steps per ray, "
+				  << m_uDeformTexelsWritten/(double)m_uDeformStatsFrames << " / " << m_uDeformTexels/(double)m_uDeformStatsFrames << " texels written, "
+				  << m_uDeformTexelsChanged/(double)m_uDeformStatsFrames << " changed per frame";
+		if (m_uDeformRays > 0 && raycast.latency.GetCount() > 0)
+			std::cout << ", " << 1e6 * raycast.latency.GetTotalMS() / m_uDeformRays << " ns per ray";
+		std::cout << std::endl;
+	}
+}
+
+HRESULT TimingLog::writeCSV(const std::string& fileName) const
+{
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "could not write timings " << fileName << std::endl;
+		return E_FAIL;
+	}
+
+	file << "stage,calls,total_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,work,work_unit,ns_per_unit" << std::endl;
+	for (UINT i = 0; i < static_cast<UINT>(TimingStage::NUM_STAGES); ++i)
+	{
+		const TimingStageStats& s = m_stages[i];
+		file << g_timingStageNames[i] << "," << s.latency.GetCount() << "," << s.latency.GetTotalMS() << "," << s.latency.GetMeanMS() << ","
+			 << s.latency.GetPercentileMS(50) << "," << s.latency.GetPercentileMS(95) << "," << s.latency.GetPercentileMS(99) << ","
+			 << s.latency.GetMaxMS() << "," << s.work << "," << g_timingWorkUnits[i] << ","
+			 << (s.work > 0 ? 1e6 * s.latency.GetTotalMS() / s.work : 0.0) << std::endl;
+	}
+	return S_OK;
+}
+
+HRESULT TimingLog::writeJSON(const std::string& fileName) const
+{
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open())
+	{
+		std::cerr << "could not write timings " << fileName << std::endl;
+		return E_FAIL;
+	}
+
+	file << "{" << std::endl << "\"stages\":[";
+	for (UINT i = 0; i < static_cast<UINT>(TimingStage::NUM_STAGES); ++i)
+	{
+		const TimingStageStats& s = m_stages[i];
+		file << (i > 0 ? "," : "") << std::endl
+			 << "{\"stage\":\"" << g_timingStageNames[i] << "\",\"calls\":" << s.latency.GetCount() << ",\"total_ms\":" << s.latency.GetTotalMS()
+			 << ",\"mean_ms\":" << s.latency.GetMeanMS() << ",\"p50_ms\":" << s.latency.GetPercentileMS(50) << ",\"p95_ms\":" << s.latency.GetPercentileMS(95)
+			 << ",\"p99_ms\":" << s.latency.GetPercentileMS(99) << ",\"max_ms\":" << s.latency.GetMaxMS() << ",\"work\":" << s.work
+			 << ",\"work_unit\":\"" << g_timingWorkUnits[i] << "\",\"ns_per_unit\":" << (s.work > 0 ? 1e6 * s.latency.GetTotalMS() / s.work : 0.0) << "}";
+	}
+	file << std::endl << "]," << std::endl;
+	file << "\"temporal_incremental\":" << m_uTemporalIncremental << ",\"temporal_fallback\":" << m_uTemporalFallback
+		 << ",\"temporal_candidate_patches\":" << m_uTemporalCandidatePatches << ",\"temporal_total_patches\":" << m_uTemporalTotalPatches
+		 << ",\"temporal_validated\":" << m_uTemporalValidated << ",\"temporal_mismatches\":" << m_uTemporalMismatches
+		 << ",\"compute_validated\":" << m_uComputeValidated << ",\"compute_mismatches\":" << m_uComputeMismatches << "," << std::endl
+		 << "\"overlap_dirty_edges\":" << m_uOverlapDirtyEdges << ",\"overlap_dirty_corner_faces\":" << m_uOverlapDirtyCornerFaces
+		 << ",\"overlap_dirty_updates\":" << m_uOverlapDirtyCount << ",\"tiles_allocated\":" << m_uTilesAllocated << "," << std::endl
+		 << "\"deform_stats_frames\":" << m_uDeformStatsFrames << ",\"deform_texels\":" << m_uDeformTexels << ",\"deform_rays\":" << m_uDeformRays
+		 << ",\"deform_dda_steps\":" << m_uDeformDDASteps << ",\"deform_texels_written\":" << m_uDeformTexelsWritten
+		 << ",\"deform_texels_changed\":" << m_uDeformTexelsChanged << std::endl << "}" << std::endl;
+	return S_OK;
+}
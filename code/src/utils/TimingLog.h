@@ -15,16 +15,46 @@
 
 #pragma once
 
-#include<DXUT.h>
+#include <DXUT.h>
 #include <SDX/StringConversion.h>
 #include <iostream>
- 
+#include <string>
+#include <map>
+#include <set>
+
+#include "LatencyHistogram.h"
+#include "Profiler.h"
+
+// stages with latency histograms. the gpu stages are gpu profile scopes named after the stage (TIMING_STAGE_SCOPE),
+// their latency comes from the resolved timestamps of real frames, nothing is rerun or synchronized for the timings.
+enum class TimingStage
+{
+	DRAW_TRI			= 0,
+	DRAW_SUBD			= 1,
+	VOXELIZATION		= 2,
+	CULLING				= 3,
+	CULLING_TEMPORAL	= 4,
+	TEMPORAL_QUERY		= 5,	// cpu
+	RAYCAST				= 6,
+	COMPACT_VISIBILITY	= 7,
+	OVERLAP				= 8,
+	GPU_SUBDIV			= 9,
+	ALLOCATION			= 10,
+	NUM_STAGES
+};
+
+struct TimingStageStats
+{
+	TimingStageStats() : work(0) {}
+
+	LatencyHistogram	latency;
+	UINT64				work;		// summed scope values, in the work unit of the stage
+};
+
 class TimingLog
 {
 public:
 	TimingLog(void) {
-		//number of test runs for timings
-		m_uNumRuns = 100;
 		resetTimings();
 	}
 
@@ -32,64 +62,54 @@ public:
 
 	}
 
-	void resetTimings() {
-		m_dDrawTotal = 0.0;
-		m_uDrawCount = 0;
-		m_dDrawSubDTotal = 0.0;
-		m_uDrawSubDCount = 0;
-
-		m_dVoxelizationTotal = 0.0;
-		m_uVoxelizationCount = 0;
-		m_dCullingTotal = 0.0;
-		m_uCullingCount = 0;
-		m_dRayCastTotal = 0.0;
-		m_uRayCastCount = 0;
-		m_dCompactVisibilityAllTotal = 0.0;
-		m_uCompactVisibilityAllOverlapCount = 0;
-		m_dOverlapTotal = 0.0;
-		m_uOverlapCount = 0;
-		m_dGPUSubdivTotal = 0.0;
-		m_uGPUSubdivCount = 0;
-
-		m_dShadowTotal = 0.0;
-		m_uShadowCount = 0;
+	static const char* getStageName(TimingStage stage);
+	static const char* getWorkUnit(TimingStage stage);
 
-	}
+	// profile scopes named after a stage, the name pointers are compared
+	void onProfileEvent(const ProfileEvent& e);
 
-	void printTimings() {
-		std::cout << std::endl;
-		std::cout << "Draw Tri\t\t" << m_dDrawTotal/(double)m_uDrawCount << " ms " << std::endl;
-		std::cout << "Draw SubD\t\t" << m_dDrawSubDTotal/(double)m_uDrawSubDCount << " ms " << std::endl;
-		std::cout << "Voxelization\t" << m_dVoxelizationTotal/(double)m_uVoxelizationCount << " ms " << std::endl;
-		std::cout << "Culling\t\t" << m_dCullingTotal/(double)m_uCullingCount << " ms " << std::endl;
-		std::cout << "RayCast\t\t" << m_dRayCastTotal/(double)m_uRayCastCount << " ms " << std::endl;
-		std::cout << "Compact Vis\t\t" << m_dCompactVisibilityAllTotal/(double)m_uCompactVisibilityAllOverlapCount << " ms " << std::endl;
-		std::cout << "Overlap\t\t" << m_dOverlapTotal/(double)m_uOverlapCount << " ms " << std::endl;
-		std::cout << "GPU Subdiv\t\t" << m_dGPUSubdivTotal/(double)m_uGPUSubdivCount << " ms " << std::endl;
-		//std::cout << "Shadow Cascades\t\t" << m_dShadowTotal/(double)m_uShadowCount << " ms " << std::endl;
-	}
+	const TimingStageStats& getStage(TimingStage stage) const { return m_stages[static_cast<UINT>(stage)]; }
+
+	bool hasTimings() const;
+	void resetTimings();
+	void printTimings() const;
+
+	// one row per stage: calls, p50/p95/p99/max latency, work and cost per unit
+	HRESULT writeCSV(const std::string& fileName) const;
+	HRESULT writeJSON(const std::string& fileName) const;
+
+	// displacement tiles allocated in a profiler frame (MemoryManager::ResolveAllocationStats). they are the work of the
+	// allocation stage only if the allocation scope of that frame resolved, tiles of dropped gpu frames are not matched with a latency
+	void addTilesAllocated(UINT frame, UINT64 numTiles);
+
+	UINT	m_uTemporalIncremental;			// batches run incrementally
+	UINT	m_uTemporalFallback;			// batches which required the full test
+	UINT64	m_uTemporalCandidatePatches;
+	UINT64	m_uTemporalTotalPatches;
+	UINT	m_uTemporalValidated;			// incremental batches compared with the full test
+	UINT	m_uTemporalMismatches;			// of these, batches with a different visibility
+	UINT	m_uComputeValidated;			// cpu compute backend intersection batches compared with d3d11
+	UINT	m_uComputeMismatches;			// of these, batches with a different visibility or patch lists
+	UINT64	m_uOverlapDirtyEdges;			// dirty edge overlap, edges copied
+	UINT64	m_uOverlapDirtyCornerFaces;		// dirty edge overlap, faces with corner update
+	UINT	m_uOverlapDirtyCount;
+	UINT64	m_uTilesAllocated;				// displacement tiles, see addTilesAllocated
+	UINT	m_uDeformStatsFrames;			// frames with resolved tile edit counters (DeformationStats)
+	UINT64	m_uDeformTexels;				// tile edit, texels evaluated
+	UINT64	m_uDeformRays;					// tile edit, rays cast
+	UINT64	m_uDeformDDASteps;				// tile edit, voxels visited by the rays
+	UINT64	m_uDeformTexelsWritten;
+	UINT64	m_uDeformTexelsChanged;
+
+protected:
+	// the table state readback and the gpu scopes resolve independently, both at most a few frames late
+	static const UINT ALLOCATION_FRAME_WINDOW = 16;
+	void pruneAllocationFrames(UINT frame);
 
-	double	m_dDrawTotal;
-	UINT	m_uDrawCount;
-	double  m_dDrawSubDTotal;
-	UINT    m_uDrawSubDCount;
-	double	m_dVoxelizationTotal;
-	UINT	m_uVoxelizationCount;
-	double	m_dCullingTotal;
-	UINT	m_uCullingCount;
-	double	m_dRayCastTotal;
-	UINT	m_uRayCastCount;
-	double	m_dOverlapTotal;
-	UINT	m_uOverlapCount;
-	double	m_dGPUSubdivTotal;
-	UINT	m_uGPUSubdivCount;
-	
-	double	m_dCompactVisibilityAllTotal;
-	UINT	m_uCompactVisibilityAllOverlapCount;
-
-	double	m_dShadowTotal;
-	UINT	m_uShadowCount;
-
-	UINT	m_uNumRuns;
+	TimingStageStats m_stages[static_cast<UINT>(TimingStage::NUM_STAGES)];
+	std::map<UINT, UINT64>	m_allocationTilesPending;		// frame -> tiles, waiting for the allocation scope of the frame
+	std::set<UINT>			m_allocationFramesResolved;		// frames with a resolved allocation scope
 };
 
+#define TIMING_STAGE_SCOPE(context, stage)	GPU_PROFILE_SCOPE(context, TimingLog::getStageName(stage))
+#define TIMING_CPU_STAGE_SCOPE(stage)		PROFILE_SCOPE(TimingLog::getStageName(stage))
@@ -0,0 +1,274 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "utils/VertexWelder.h"
+#include "utils/WorkStealingPool.h"
+
+#include <atomic>
+#include <unordered_map>
+
+using namespace DirectX;
+
+//Henry: has to be last header
+#include "utils/DbgNew.h"
+
+static const UINT	WELD_CHUNK_SIZE			= 1 << 16;		// vertices per counting / scatter job
+static const UINT	WELD_BUCKET_BITS		= 10;
+static const UINT	WELD_NUM_BUCKETS		= 1 << WELD_BUCKET_BITS;
+static const float	WELD_TOLERANCE_RANGE	= 1.0f / (1ull << 49);	// below: ulps smaller than the 3d tolerance of SpatialSort
+static const float	WELD_TOLERANCE_CELL		= WELD_TOLERANCE_RANGE / (1ull << 24);	// 2^-73, larger than the 3d tolerance
+
+namespace
+{
+
+// bit pattern of a coordinate, +0 and -0 compare equal
+inline UINT GetCoordinateBits(float x)
+{
+	if (x == 0.0f) return 0;
+	return reinterpret_cast<const UINT&>(x);
+}
+
+inline UINT64 HashPosition(const XMFLOAT4A& p)
+{
+	UINT64 hash = 14695981039346656037ull;
+	hash = (hash ^ GetCoordinateBits(p.x)) * 1099511628211ull;
+	hash = (hash ^ GetCoordinateBits(p.y)) * 1099511628211ull;
+	hash = (hash ^ GetCoordinateBits(p.z)) * 1099511628211ull;
+	return hash ^ (hash >> 29);
+}
+
+inline bool IsToleranceCoordinate(float x)
+{
+	return x != 0.0f && fabsf(x) < WELD_TOLERANCE_RANGE;
+}
+
+// cell of a coordinate on the serial path, coordinates near zero are quantized, all others keep their bit pattern
+inline int GetToleranceCell(float x, bool& quantized)
+{
+	quantized = fabsf(x) < WELD_TOLERANCE_RANGE;
+	return quantized ? static_cast<int>(floorf(x / WELD_TOLERANCE_CELL)) : static_cast<int>(GetCoordinateBits(x));
+}
+
+inline UINT64 HashCell(int x, int y, int z)
+{
+	UINT64 hash = 14695981039346656037ull;
+	hash = (hash ^ static_cast<UINT>(x)) * 1099511628211ull;
+	hash = (hash ^ static_cast<UINT>(y)) * 1099511628211ull;
+	hash = (hash ^ static_cast<UINT>(z)) * 1099511628211ull;
+	return hash;
+}
+
+}
+
+VertexWelder::VertexWelder()
+{
+	m_usedToleranceCells = false;
+}
+
+void VertexWelder::Weld(const std::vector<XMFLOAT4A>& vertices, std::vector<XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex)
+{
+	const UINT numVertices = static_cast<UINT>(vertices.size());
+	uniqueVertices.clear();
+	replaceIndex.resize(numVertices);
+	if (numVertices == 0) return;
+
+	std::atomic<bool> hasToleranceCoordinates(false);
+	g_workStealingPool.ParallelFor(numVertices, WELD_CHUNK_SIZE, [&](UINT begin, UINT end)
+	{
+		bool found = false;
+		for (UINT i = begin; i < end && !found; ++i)
+			found = IsToleranceCoordinate(vertices[i].x) || IsToleranceCoordinate(vertices[i].y) || IsToleranceCoordinate(vertices[i].z);
+		if (found)
+			hasToleranceCoordinates = true;
+	});
+
+	m_usedToleranceCells = hasToleranceCoordinates;
+	if (m_usedToleranceCells)
+		WeldToleranceCells(vertices, uniqueVertices, replaceIndex);
+	else
+		WeldExact(vertices, uniqueVertices, replaceIndex);
+}
+
+// identical positions have identical bit patterns: the first vertex of each group of equal positions is the unique vertex
+void VertexWelder::WeldExact(const std::vector<XMFLOAT4A>& vertices, std::vector<XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex)
+{
+	const UINT numVertices = static_cast<UINT>(vertices.size());
+	const UINT numChunks = (numVertices + WELD_CHUNK_SIZE - 1) / WELD_CHUNK_SIZE;
+
+	m_keys.resize(numVertices);
+	m_sorted.resize(numVertices);
+	m_representative.resize(numVertices);
+	m_chunkOffsets.assign(numChunks * WELD_NUM_BUCKETS, 0);
+	m_bucketOffsets.resize(WELD_NUM_BUCKETS + 1);
+
+	// bucket histogram per chunk
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			UINT* counts = &m_chunkOffsets[c * WELD_NUM_BUCKETS];
+			const UINT last = std::min(numVertices, (c + 1) * WELD_CHUNK_SIZE);
+			for (UINT i = c * WELD_CHUNK_SIZE; i < last; ++i)
+			{
+				m_keys[i] = HashPosition(vertices[i]);
+				counts[m_keys[i] >> (64 - WELD_BUCKET_BITS)]++;
+			}
+		}
+	});
+
+	// bucket major offsets, the chunks of a bucket stay in vertex order
+	UINT offset = 0;
+	for (UINT b = 0; b < WELD_NUM_BUCKETS; ++b)
+	{
+		m_bucketOffsets[b] = offset;
+		for (UINT c = 0; c < numChunks; ++c)
+		{
+			const UINT count = m_chunkOffsets[c * WELD_NUM_BUCKETS + b];
+			m_chunkOffsets[c * WELD_NUM_BUCKETS + b] = offset;
+			offset += count;
+		}
+	}
+	m_bucketOffsets[WELD_NUM_BUCKETS] = offset;
+
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			UINT* offsets = &m_chunkOffsets[c * WELD_NUM_BUCKETS];
+			const UINT last = std::min(numVertices, (c + 1) * WELD_CHUNK_SIZE);
+			for (UINT i = c * WELD_CHUNK_SIZE; i < last; ++i)
+				m_sorted[offsets[m_keys[i] >> (64 - WELD_BUCKET_BITS)]++] = i;
+		}
+	});
+
+	// sort each bucket by position and vertex index, the first vertex of a run represents it
+	g_workStealingPool.ParallelFor(WELD_NUM_BUCKETS, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT b = begin; b < end; ++b)
+		{
+			UINT* first = &m_sorted[0] + m_bucketOffsets[b];
+			UINT* last = &m_sorted[0] + m_bucketOffsets[b + 1];
+			std::sort(first, last, [&](UINT i, UINT j)
+			{
+				if (m_keys[i] != m_keys[j]) return m_keys[i] < m_keys[j];
+				const UINT xi = GetCoordinateBits(vertices[i].x), xj = GetCoordinateBits(vertices[j].x);
+				if (xi != xj) return xi < xj;
+				const UINT yi = GetCoordinateBits(vertices[i].y), yj = GetCoordinateBits(vertices[j].y);
+				if (yi != yj) return yi < yj;
+				const UINT zi = GetCoordinateBits(vertices[i].z), zj = GetCoordinateBits(vertices[j].z);
+				if (zi != zj) return zi < zj;
+				return i < j;
+			});
+
+			for (UINT* it = first; it != last; )
+			{
+				const XMFLOAT4A& p = vertices[*it];
+				UINT* runEnd = it + 1;
+				while (runEnd != last && m_keys[*runEnd] == m_keys[*it] && 
+					   GetCoordinateBits(vertices[*runEnd].x) == GetCoordinateBits(p.x) &&
+					   GetCoordinateBits(vertices[*runEnd].y) == GetCoordinateBits(p.y) &&
+					   GetCoordinateBits(vertices[*runEnd].z) == GetCoordinateBits(p.z))
+					++runEnd;
+
+				for (UINT* r = it; r != runEnd; ++r)
+					m_representative[*r] = *it;
+				it = runEnd;
+			}
+		}
+	});
+
+	// unique indices in vertex order: count per chunk, then number the unique vertices and map the others
+	std::vector<UINT> chunkUnique(numChunks + 1, 0);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			const UINT last = std::min(numVertices, (c + 1) * WELD_CHUNK_SIZE);
+			for (UINT i = c * WELD_CHUNK_SIZE; i < last; ++i)
+				chunkUnique[c + 1] += m_representative[i] == i ? 1 : 0;
+		}
+	});
+	for (UINT c = 0; c < numChunks; ++c)
+		chunkUnique[c + 1] += chunkUnique[c];
+
+	uniqueVertices.resize(chunkUnique[numChunks]);
+	g_workStealingPool.ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; ++c)
+		{
+			UINT index = chunkUnique[c];
+			const UINT last = std::min(numVertices, (c + 1) * WELD_CHUNK_SIZE);
+			for (UINT i = c * WELD_CHUNK_SIZE; i < last; ++i)
+			{
+				if (m_representative[i] != i) continue;
+				uniqueVertices[index] = vertices[i];
+				replaceIndex[i] = index++;
+			}
+		}
+	});
+
+	g_workStealingPool.ParallelFor(numVertices, WELD_CHUNK_SIZE, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+			if (m_representative[i] != i)
+				replaceIndex[i] = replaceIndex[m_representative[i]];
+	});
+}
+
+// tolerance matches near zero are not transitive, vertices are added in order and matched against the unique vertices
+// in their cell and the neighbor cells of quantized coordinates. ties resolve to the lowest unique index.
+void VertexWelder::WeldToleranceCells(const std::vector<XMFLOAT4A>& vertices, std::vector<XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex)
+{
+	const UINT numVertices = static_cast<UINT>(vertices.size());
+	uniqueVertices.reserve(numVertices);
+
+	std::unordered_multimap<UINT64, UINT> cells;
+	cells.reserve(numVertices);
+
+	for (UINT i = 0; i < numVertices; ++i)
+	{
+		const XMFLOAT4A& p = vertices[i];
+
+		bool quantized[3];
+		const int cell[3] = { GetToleranceCell(p.x, quantized[0]), GetToleranceCell(p.y, quantized[1]), GetToleranceCell(p.z, quantized[2]) };
+		const int range[3] = { quantized[0] ? 1 : 0, quantized[1] ? 1 : 0, quantized[2] ? 1 : 0 };
+
+		UINT match = UINT_MAX;
+		for (int dz = -range[2]; dz <= range[2]; ++dz)
+		for (int dy = -range[1]; dy <= range[1]; ++dy)
+		for (int dx = -range[0]; dx <= range[0]; ++dx)
+		{
+			auto candidates = cells.equal_range(HashCell(cell[0] + dx, cell[1] + dy, cell[2] + dz));
+			for (auto it = candidates.first; it != candidates.second; ++it)
+			{
+				if (it->second < match && m_identical.IsIdenticalPosition(p, uniqueVertices[it->second]))
+					match = it->second;
+			}
+		}
+
+		if (match != UINT_MAX)
+		{
+			replaceIndex[i] = match;
+		}
+		else
+		{
+			replaceIndex[i] = static_cast<UINT>(uniqueVertices.size());
+			cells.insert(std::make_pair(HashCell(cell[0], cell[1], cell[2]), replaceIndex[i]));
+			uniqueVertices.push_back(p);
+		}
+	}
+}
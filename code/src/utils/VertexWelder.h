@@ -0,0 +1,49 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "utils/SpatialSort.h"
+
+// merges vertices with identical positions, same tolerance and result as a SpatialSort::FindIdenticalPositions query per vertex.
+// positions are hashed by their bit patterns (+0 and -0 are one key) into buckets which are sorted and merged in parallel.
+// the ulp tolerance only joins different bit patterns for coordinates below 2^-49 (smaller ulps than the 3d tolerance),
+// inputs with such coordinates take a serial path over quantized cells with neighbor cell checks.
+class VertexWelder
+{
+public:
+	VertexWelder();
+
+	// unique vertices in order of their first occurrence, replaceIndex maps each input vertex to its unique vertex
+	void	Weld(const std::vector<DirectX::XMFLOAT4A>& vertices, std::vector<DirectX::XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex);
+
+	bool	UsedToleranceCells() const { return m_usedToleranceCells; }
+
+protected:
+	void	WeldExact(const std::vector<DirectX::XMFLOAT4A>& vertices, std::vector<DirectX::XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex);
+	void	WeldToleranceCells(const std::vector<DirectX::XMFLOAT4A>& vertices, std::vector<DirectX::XMFLOAT4A>& uniqueVertices, std::vector<UINT>& replaceIndex);
+
+	SpatialSort				m_identical;		// empty, reference plane and tolerance test
+	std::vector<UINT64>		m_keys;
+	std::vector<UINT>		m_sorted;			// vertex indices grouped by bucket, ascending per bucket
+	std::vector<UINT>		m_representative;	// first vertex with the same position
+	std::vector<UINT>		m_chunkOffsets;		// per chunk and bucket
+	std::vector<UINT>		m_bucketOffsets;
+	bool					m_usedToleranceCells;
+};
@@ -0,0 +1,206 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#include "stdafx.h"
+
+#include "WorkStealingPool.h"
+
+WorkStealingPool g_workStealingPool;
+
+// index of the pool worker running on this thread, -1 for external threads
+static __declspec(thread) int t_workerIndex = -1;
+static __declspec(thread) bool t_serial = false;
+
+WorkStealingPool::WorkStealingPool()
+{
+	m_numQueued = 0;
+	m_shutdown = false;
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	Destroy();
+}
+
+HRESULT WorkStealingPool::Create(UINT numThreads)
+{
+	Destroy();
+
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	m_shutdown = false;
+	m_numQueued = 0;
+
+	const UINT numWorkers = numThreads - 1;
+	for (UINT i = 0; i < numWorkers + 1; ++i)
+		m_queues.push_back(new JobQueue());
+
+	for (UINT i = 0; i < numWorkers; ++i)
+		m_workers.push_back(std::thread(&WorkStealingPool::WorkerMain, this, i));
+
+	return S_OK;
+}
+
+void WorkStealingPool::Destroy()
+{
+	if (m_queues.empty()) return;
+
+	{
+		std::lock_guard<std::mutex> l(m_sleepLock);
+		m_shutdown = true;
+	}
+	m_sleepCV.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	for (auto queue : m_queues)
+		SAFE_DELETE(queue);
+	m_queues.clear();
+}
+
+UINT WorkStealingPool::GetThreadIndex() const
+{
+	return t_workerIndex >= 0 ? static_cast<UINT>(t_workerIndex) : static_cast<UINT>(m_workers.size());
+}
+
+void WorkStealingPool::SetSerialThread(bool serial)
+{
+	t_serial = serial;
+}
+
+void WorkStealingPool::Submit(const JobFunc& job, JobCounter* counter)
+{
+	assert(counter);
+	counter->pending++;
+
+	if (m_queues.empty())
+	{
+		// no pool, run inline
+		job();
+		counter->pending--;
+		return;
+	}
+
+	Job j;
+	j.func = job;
+	j.counter = counter;
+
+	JobQueue* queue = m_queues[GetThreadIndex()];
+	{
+		std::lock_guard<std::mutex> l(queue->lock);
+		queue->jobs.push_back(j);
+	}
+
+	m_numQueued++;
+	{
+		// empty critical section orders the counter increment with the sleeping workers' predicate check
+		std::lock_guard<std::mutex> l(m_sleepLock);
+	}
+	m_sleepCV.notify_one();
+}
+
+bool WorkStealingPool::Pop(UINT queueIndex, Job& job)
+{
+	JobQueue* queue = m_queues[queueIndex];
+	std::lock_guard<std::mutex> l(queue->lock);
+	if (queue->jobs.empty()) return false;
+
+	job = queue->jobs.back();
+	queue->jobs.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::Steal(UINT thief, Job& job)
+{
+	const UINT numQueues = static_cast<UINT>(m_queues.size());
+	for (UINT i = 1; i < numQueues; ++i)
+	{
+		JobQueue* queue = m_queues[(thief + i) % numQueues];
+		std::lock_guard<std::mutex> l(queue->lock);
+		if (queue->jobs.empty()) continue;
+
+		job = queue->jobs.front();
+		queue->jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+bool WorkStealingPool::RunOne(UINT threadIndex)
+{
+	Job job;
+	if (!Pop(threadIndex, job) && !Steal(threadIndex, job))
+		return false;
+
+	m_numQueued--;
+	job.func();
+	job.counter->pending--;
+	return true;
+}
+
+bool WorkStealingPool::TryRunOne()
+{
+	if (m_queues.empty()) return false;
+	return RunOne(GetThreadIndex());
+}
+
+void WorkStealingPool::Wait(JobCounter* counter)
+{
+	if (m_queues.empty()) return;
+
+	const UINT self = GetThreadIndex();
+	while (counter->pending > 0)
+	{
+		if (!RunOne(self))
+			std::this_thread::yield();
+	}
+}
+
+void WorkStealingPool::WorkerMain(UINT threadIndex)
+{
+	t_workerIndex = static_cast<int>(threadIndex);
+
+	for (;;)
+	{
+		if (RunOne(threadIndex)) continue;
+
+		std::unique_lock<std::mutex> l(m_sleepLock);
+		m_sleepCV.wait(l, [this]{ return m_shutdown || m_numQueued > 0; });
+		if (m_shutdown) break;
+	}
+}
+
+void WorkStealingPool::ParallelFor(UINT count, UINT grainSize, const std::function<void(UINT begin, UINT end)>& func)
+{
+	if (count == 0) return;
+	grainSize = std::max(1u, grainSize);
+
+	if (m_queues.empty() || t_serial || count <= grainSize)
+	{
+		func(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (UINT begin = 0; begin < count; begin += grainSize)
+	{
+		UINT end = std::min(count, begin + grainSize);
+		Submit([&func, begin, end]{ func(begin, end); }, &counter);
+	}
+	Wait(&counter);
+}
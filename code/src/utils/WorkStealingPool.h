@@ -0,0 +1,93 @@
+//   Copyright 2013 Henry Schfer
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License  is  distributed on an 
+//   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//	 either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+#pragma once
+
+#include <DXUT.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// counts outstanding jobs, Wait() returns when it reaches zero
+struct JobCounter
+{
+	JobCounter() : pending(0) {}
+	std::atomic<int> pending;
+};
+
+// thread pool with one job deque per thread. owners push/pop at the back, idle threads steal from the front of other deques.
+// threads which wait for a counter help executing jobs, so nested submission from within jobs is fine.
+class WorkStealingPool
+{
+public:
+	typedef std::function<void()> JobFunc;
+
+	WorkStealingPool();
+	~WorkStealingPool();
+
+	// numThreads includes the calling thread, 0 uses the hardware concurrency
+	HRESULT Create(UINT numThreads = 0);
+	void	Destroy();
+
+	UINT	GetNumThreads()		const	{ return static_cast<UINT>(m_workers.size()) + 1; }
+	bool	IsCreated()			const	{ return !m_queues.empty(); }
+
+	void	Submit(const JobFunc& job, JobCounter* counter);
+	void	Wait(JobCounter* counter);
+
+	// runs one queued job on the calling thread, false if there was nothing to do
+	bool	TryRunOne();
+
+	// splits [0, count) into ranges of grainSize and runs func(begin, end) on all threads, blocks until done
+	void	ParallelFor(UINT count, UINT grainSize, const std::function<void(UINT begin, UINT end)>& func);
+
+	// 0..numThreads-2 for pool workers, numThreads-1 for any external thread
+	UINT	GetThreadIndex() const;
+
+	// ParallelFor runs inline on the calling thread while set, for threads whose jobs must not end up in the shared queue
+	static void SetSerialThread(bool serial);
+
+private:
+	struct Job
+	{
+		JobFunc		func;
+		JobCounter*	counter;
+	};
+
+	struct JobQueue
+	{
+		std::mutex			lock;
+		std::deque<Job>		jobs;
+	};
+
+	bool	Pop(UINT queue, Job& job);
+	bool	Steal(UINT thief, Job& job);
+	bool	RunOne(UINT threadIndex);
+	void	WorkerMain(UINT threadIndex);
+
+	std::vector<std::thread>	m_workers;
+	std::vector<JobQueue*>		m_queues;		// one per worker + one shared by external threads
+
+	std::mutex					m_sleepLock;
+	std::condition_variable		m_sleepCV;
+	std::atomic<int>			m_numQueued;
+	std::atomic<bool>			m_shutdown;
+};
+
+extern WorkStealingPool g_workStealingPool;